@@ -34,7 +34,10 @@
 
  You can enable and disable logging altogether by defining: IO_LOGGING_DEBUG
  You can set the levels as a bit mask of the above levels using flag: IO_LOGGING_DEFAULT_LEVEL
+ You can remove all logging for levels at compile time with a bit mask using flag: IO_LOGGING_COMPILED_LEVELS
  At runtime a level can be turned on/off using: void serEnableLevel(SerLoggingLevel level, bool active)
+ Defining IO_LOGGING_DEFERRED as well records the serlogF* calls into a ring that a task prints later, so logging
+ takes very little time at the call site, see startDeferredLogging below.
  */
 
 #include <TaskManagerIO.h>
@@ -56,6 +59,9 @@ void setup() {
     // we can use this to start the logging delegate that logs task manager notifications at IOA_DEBUG level
     startTaskManagerLogDelegate();
 
+    // when IO_LOGGING_DEFERRED is defined this starts the task that prints the deferred records, otherwise it does nothing
+    startDeferredLogging();
+
     // enable an extra level
     serEnableLevel(SER_IOA_DEBUG, true);
 
@@ -21,6 +21,83 @@
  */
 enum AnalogDirection { DIR_IN, DIR_OUT, DIR_PWM };
 
+/**
+ * An analog reading as a fixed point fraction of full scale, where 0 is the lowest reading and ANALOG_FIXED_MAX the
+ * highest, regardless of the bit depth of the device. It is the integer equivalent of getCurrentFloat, so that boards
+ * without floating point hardware can work with readings and thresholds without any soft float maths.
+ */
+typedef uint16_t AnalogFixed;
+
+#define ANALOG_FIXED_BITS 16
+#define ANALOG_FIXED_MAX 0xffffU
+
+/**
+ * Converts a float between 0 and 1 into fixed point, intended for converting thresholds once at setup.
+ * @param value the value between 0 and 1, it is clamped to that range
+ * @return the fixed point equivalent
+ */
+inline AnalogFixed analogFloatToFixed(float value) {
+    if(value <= 0.0F) return 0;
+    if(value >= 1.0F) return ANALOG_FIXED_MAX;
+    return AnalogFixed(value * float(ANALOG_FIXED_MAX) + 0.5F);
+}
+
+/**
+ * @param value a fixed point value
+ * @return the value as a float between 0 and 1
+ */
+inline float analogFixedToFloat(AnalogFixed value) {
+    return float(value) / float(ANALOG_FIXED_MAX);
+}
+
+/**
+ * Converts a raw reading into fixed point without division, the bits are repeated into the lower part so that the
+ * maximum reading becomes ANALOG_FIXED_MAX.
+ * @param counts the raw reading
+ * @param bitDepth the bit depth of the reading, between 1 and 16
+ * @return the fixed point equivalent
+ */
+inline AnalogFixed analogCountsToFixed(unsigned int counts, uint8_t bitDepth) {
+    if(bitDepth >= ANALOG_FIXED_BITS) return AnalogFixed(counts >> (bitDepth - ANALOG_FIXED_BITS));
+    if(bitDepth == 0) return 0;
+    if(counts >= (1U << bitDepth)) return ANALOG_FIXED_MAX;
+    uint16_t value = uint16_t(counts << (ANALOG_FIXED_BITS - bitDepth));
+    for(uint8_t filled = bitDepth; filled < ANALOG_FIXED_BITS; filled *= 2) {
+        value |= value >> filled;
+    }
+    return value;
+}
+
+/**
+ * Converts a fixed point value into raw counts for a given bit depth, for example to pre-scale a threshold so that
+ * it can be compared directly with getCurrentValue.
+ * @param value the fixed point value
+ * @param bitDepth the bit depth of the device, between 1 and 16
+ * @return the equivalent raw reading
+ */
+inline unsigned int analogFixedToCounts(AnalogFixed value, uint8_t bitDepth) {
+    if(bitDepth >= ANALOG_FIXED_BITS) return (unsigned int)value << (bitDepth - ANALOG_FIXED_BITS);
+    return value >> (ANALOG_FIXED_BITS - bitDepth);
+}
+
+class AnalogStream;
+
+/**
+ * Receives threshold crossings from a device that watches a pin in hardware, such as with a comparator or ADC
+ * watchdog, see AnalogDevice::startThresholdWatch. AnalogInEvent implements this.
+ */
+class AnalogThresholdWatcher {
+public:
+    virtual ~AnalogThresholdWatcher() = default;
+
+    /**
+     * Called from the interrupt when the watched pin crosses the threshold, and once when the watch starts with the
+     * initial state. Implementations must be safe to call from an interrupt.
+     * @param above true if the pin is now above the threshold, otherwise false
+     */
+    virtual void thresholdCrossed(bool above) = 0;
+};
+
 /**
  * Describes an analog device that has commands to both read values from and write values to
  * a device. Not all devices will support both input and output. When such a case occurs the
@@ -66,6 +143,16 @@ public:
 	 */
 	virtual float getCurrentFloat(pinid_t pin) = 0;
 
+    /**
+     * Returns the current value on the ADC as a fixed point fraction of full scale, see AnalogFixed. The default
+     * converts getCurrentValue using the bit depth, so it involves no floating point.
+     * @param pin the pin to read from
+     * @return the current value as fixed point
+     */
+    virtual AnalogFixed getCurrentFixed(pinid_t pin) {
+        return analogCountsToFixed(getCurrentValue(pin), getBitDepth(DIR_IN, pin));
+    }
+
 	/**
 	 * Sets the current value on an output capable device to a new value
 	 * @param pin the pin to read from
@@ -81,6 +168,75 @@ public:
 	 */
     virtual void setCurrentFloat(pinid_t pin, float newValue)=0;
 
+    /**
+     * Reads several pins in one call, in the order given, a pin can appear more than once to take repeated samples.
+     * Devices that can convert a sequence of channels, such as round robin on the RP2040, do so back to back. The
+     * default reads each pin with getCurrentValue.
+     * @param pins the pins to read
+     * @param values the array to hold the reading of each pin, at least count long
+     * @param count the number of pins
+     */
+    virtual void getCurrentValues(const pinid_t* pins, unsigned int* values, uint8_t count) {
+        for(uint8_t i = 0; i < count; i++) values[i] = getCurrentValue(pins[i]);
+    }
+
+    /**
+     * Reads several pins in one call as floats between 0 and 1, in the same way as getCurrentValues. The default reads
+     * each pin with getCurrentFloat.
+     * @param pins the pins to read
+     * @param values the array to hold the reading of each pin, at least count long
+     * @param count the number of pins
+     */
+    virtual void getCurrentFloats(const pinid_t* pins, float* values, uint8_t count) {
+        for(uint8_t i = 0; i < count; i++) values[i] = getCurrentFloat(pins[i]);
+    }
+
+    /**
+     * Asks the device to watch a pin against a threshold in hardware, reporting each crossing to the watcher from its
+     * interrupt, so no polling is needed. The default returns false, as do devices that cannot watch that pin or
+     * threshold, in which case the caller should poll instead.
+     * @param pin the pin to watch
+     * @param thresholdCounts the threshold in raw counts of the device
+     * @param watcher the watcher to notify on each crossing
+     * @return true if the hardware is now watching the pin
+     */
+    virtual bool startThresholdWatch(pinid_t pin, unsigned int thresholdCounts, AnalogThresholdWatcher* watcher) { return false; }
+
+    /**
+     * Stops a hardware watch that was started with startThresholdWatch.
+     * @param pin the pin that was being watched
+     */
+    virtual void stopThresholdWatch(pinid_t pin) { }
+
+    /**
+     * Called on task manager once the watcher has processed a crossing. Devices that turn their interrupt off on each
+     * crossing, so that a signal sitting at the threshold cannot flood it, turn it back on here. The default does
+     * nothing.
+     * @param pin the pin being watched
+     */
+    virtual void rearmThresholdWatch(pinid_t pin) { }
+
+    /**
+     * Starts continuous sampling of the stream's channels in hardware, called by AnalogStream::start. Devices that
+     * support it fill the stream's blocks, call blockComplete as each one fills, and return true. The default returns
+     * false, and the stream then samples in software using getCurrentValue.
+     * @param stream the stream to fill
+     * @return true if the hardware is now streaming
+     */
+    virtual bool startStreaming(AnalogStream& stream) { return false; }
+
+    /**
+     * Stops the hardware streaming that was started by startStreaming.
+     * @param stream the stream that was being filled
+     */
+    virtual void stopStreaming(AnalogStream& stream) { }
+
+    /**
+     * For devices that set a service interval on the stream, called on task manager at that interval while streaming,
+     * for example to drain a driver buffer into the stream.
+     * @param stream the stream being filled
+     */
+    virtual void serviceStreaming(AnalogStream& stream) { }
 };
 
 #if defined(IOA_USE_MBED)
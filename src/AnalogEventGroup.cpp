@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "AnalogEventGroup.h"
+#include "IoLogging.h"
+
+AnalogEventGroup::AnalogEventGroup(AnalogDevice* device, uint32_t pollInterval)
+        : device(device), events{}, eventPinIndex{}, pins{}, readings{}, pollInterval(pollInterval), eventCount(0),
+          pinCount(0), registered(false) {
+}
+
+bool AnalogEventGroup::addEvent(AnalogInEvent* event) {
+    if(event->getAnalogDevice() != device || eventCount == ANALOG_EVENT_GROUP_MAX_EVENTS) {
+        serlogF(SER_WARNING, "Analog group cannot add event");
+        return false;
+    }
+
+    uint8_t pinIdx = 0;
+    while(pinIdx < pinCount && pins[pinIdx] != event->getAnalogPin()) pinIdx++;
+    if(pinIdx == pinCount) {
+        if(pinCount == ANALOG_EVENT_GROUP_MAX_PINS) {
+            serlogF2(SER_WARNING, "Analog group pins full ", event->getAnalogPin());
+            return false;
+        }
+        pins[pinCount++] = event->getAnalogPin();
+    }
+
+    events[eventCount] = event;
+    eventPinIndex[eventCount] = pinIdx;
+    eventCount++;
+    event->setGrouped(true);
+    return true;
+}
+
+void AnalogEventGroup::start() {
+    if(!registered) {
+        registered = true;
+        taskManager.registerEvent(this);
+    }
+}
+
+uint8_t AnalogEventGroup::sampleAndEvaluate() {
+    if(pinCount == 0) return 0;
+    device->getCurrentValues(pins, readings, pinCount);
+    uint8_t triggered = 0;
+    for(uint8_t i = 0; i < eventCount; i++) {
+        if(events[i]->evaluateReading(readings[eventPinIndex[i]])) triggered++;
+    }
+    return triggered;
+}
+
+uint32_t AnalogEventGroup::timeOfNextCheck() {
+    sampleAndEvaluate();
+    return wakeDeadline.nextRunIn(pollInterval);
+}
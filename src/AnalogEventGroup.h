@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_ANALOGEVENTGROUP_H
+#define IOABSTRACTION_ANALOGEVENTGROUP_H
+
+/**
+ * @file AnalogEventGroup.h
+ * @brief Samples every pin used by a set of analog events once per tick and evaluates all their conditions against
+ * that one reading, rather than each event polling on its own.
+ */
+
+#include "PlatformDetermination.h"
+#include "DeviceEvents.h"
+
+// START user adjustable section
+
+/**
+ * The number of events that a group can hold.
+ */
+#ifndef ANALOG_EVENT_GROUP_MAX_EVENTS
+#define ANALOG_EVENT_GROUP_MAX_EVENTS 12
+#endif
+
+/**
+ * The number of distinct pins that a group can sample.
+ */
+#ifndef ANALOG_EVENT_GROUP_MAX_PINS
+#define ANALOG_EVENT_GROUP_MAX_PINS 8
+#endif
+
+// END user adjustable section
+
+/**
+ * Groups a number of AnalogInEvent instances on the same analog device, so that each pin is read once per tick with a
+ * single batch read, and every event on that pin is evaluated against the same reading. All the events then wake on
+ * the same tick, instead of each at its own offset. The events must still be registered with task manager as usual,
+ * so that they run when triggered, but once in the group they no longer read the pin themselves and their own poll
+ * interval is not used. Use setHysteresis on the events to stop noisy signals triggering repeatedly.
+ */
+class AnalogEventGroup : public BaseEvent {
+private:
+    AnalogDevice* device;
+    AnalogInEvent* events[ANALOG_EVENT_GROUP_MAX_EVENTS];
+    uint8_t eventPinIndex[ANALOG_EVENT_GROUP_MAX_EVENTS];
+    pinid_t pins[ANALOG_EVENT_GROUP_MAX_PINS];
+    unsigned int readings[ANALOG_EVENT_GROUP_MAX_PINS];
+    uint32_t pollInterval;
+    uint8_t eventCount;
+    uint8_t pinCount;
+    bool registered;
+    WakeDeadline wakeDeadline;
+public:
+    /**
+     * Create a group that samples a device at a fixed interval.
+     * @param device the analog device that all the events use
+     * @param pollInterval the interval between samples in microseconds
+     */
+    AnalogEventGroup(AnalogDevice* device, uint32_t pollInterval);
+
+    /**
+     * Adds an event to the group, from then on the group reads its pin and evaluates its condition.
+     * @param event the event to add, it must use the same analog device as the group
+     * @return true if added, false if it uses another device or the group has no room for it or its pin
+     */
+    bool addEvent(AnalogInEvent* event);
+
+    /** Registers the group with task manager, so that it starts sampling. */
+    void start();
+
+    /** @param micros the new interval between samples in microseconds */
+    void setPollInterval(uint32_t micros) { pollInterval = micros; }
+
+    uint8_t getEventCount() const { return eventCount; }
+    uint8_t getPinCount() const { return pinCount; }
+
+    /**
+     * Reads every pin once and evaluates all the events, called on each tick from timeOfNextCheck.
+     * @return the number of events that were triggered
+     */
+    uint8_t sampleAndEvaluate();
+
+    uint32_t timeOfNextCheck() override;
+
+    /** The group itself never triggers, the events it evaluates do. */
+    void exec() override { }
+};
+
+#endif //IOABSTRACTION_ANALOGEVENTGROUP_H
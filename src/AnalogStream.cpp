@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "AnalogStream.h"
+#include "IoLogging.h"
+
+AnalogStream::AnalogStream(AnalogDevice* device, uint16_t framesPerBlock, AnalogBlockCallbackFn callback)
+        : device(device), callback(callback), buffers(nullptr), pins{}, sampleRateHz(0), overruns(0), serviceMicros(0),
+          framesPerBlock(framesPerBlock), softwareFrame(0), channelCount(0), fillingBlock(0), nextToDeliver(0),
+          blockReady{}, running(false), hardware(false), eventTaskId(TASKMGR_INVALIDID) {
+}
+
+AnalogStream::~AnalogStream() {
+    stop();
+    // task manager would otherwise keep calling the event after it has gone.
+    if(eventTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(eventTaskId);
+    delete[] buffers;
+}
+
+bool AnalogStream::addChannel(pinid_t pin) {
+    if(running || buffers != nullptr || channelCount >= ANALOG_STREAM_MAX_CHANNELS) return false;
+    pins[channelCount++] = pin;
+    return true;
+}
+
+bool AnalogStream::start(uint32_t rateHz) {
+    if(running) stop();
+    if(channelCount == 0 || framesPerBlock == 0 || rateHz == 0) return false;
+    if(buffers == nullptr) {
+        buffers = new uint16_t[getSamplesPerBlock() * 2];
+        if(buffers == nullptr) {
+            serlogF(SER_ERROR, "No memory for stream");
+            return false;
+        }
+    }
+
+    sampleRateHz = rateHz;
+    fillingBlock = 0;
+    nextToDeliver = 0;
+    blockReady[0] = blockReady[1] = false;
+    softwareFrame = 0;
+    overruns = 0;
+    serviceMicros = 0;
+    running = true;
+    hardware = device->startStreaming(*this);
+    serlogF3(SER_IOA_INFO, "Analog stream start ", rateHz, hardware);
+
+    if(eventTaskId == TASKMGR_INVALIDID) {
+        eventTaskId = taskManager.registerEvent(this);
+    }
+    return true;
+}
+
+void AnalogStream::stop() {
+    if(!running) return;
+    if(hardware) device->stopStreaming(*this);
+    running = false;
+    hardware = false;
+    blockReady[0] = blockReady[1] = false;
+}
+
+uint16_t* AnalogStream::blockComplete() {
+    // only set here and only cleared by exec once delivered, so if the block just filled is still ready the previous
+    // use of it was never delivered.
+    if(blockReady[fillingBlock]) {
+        overruns++;
+    }
+    blockReady[fillingBlock] = true;
+    fillingBlock = fillingBlock ^ 1U;
+    markTriggeredAndNotify();
+    return getBlockBuffer(fillingBlock);
+}
+
+void AnalogStream::softwareSample() {
+    uint16_t* frame = getFillingBuffer() + (softwareFrame * channelCount);
+    unsigned int values[ANALOG_STREAM_MAX_CHANNELS];
+    device->getCurrentValues(pins, values, channelCount);
+    for(uint8_t i = 0; i < channelCount; i++) {
+        frame[i] = values[i];
+    }
+    if(++softwareFrame == framesPerBlock) {
+        softwareFrame = 0;
+        blockComplete();
+    }
+}
+
+void AnalogStream::blockAvailable(const uint16_t* samples, uint16_t frames) {
+    if(callback) callback(samples, frames, channelCount);
+}
+
+uint32_t AnalogStream::timeOfNextCheck() {
+    if(!running) return secondsToMicros(1);
+    if(!hardware) {
+        setTriggered(true);
+        uint32_t interval = 1000000UL / sampleRateHz;
+        return interval ? interval : 1;
+    }
+    if(serviceMicros != 0) {
+        setTriggered(true);
+        return serviceMicros;
+    }
+    return secondsToMicros(1);
+}
+
+void AnalogStream::exec() {
+    if(!running) return;
+    if(!hardware) {
+        softwareSample();
+    } else if(serviceMicros != 0) {
+        device->serviceStreaming(*this);
+    }
+
+    // deliver in the order filled, the oldest ready block first, clearing it only once delivered so that the hardware
+    // refilling it early is seen as an overrun.
+    while(blockReady[nextToDeliver]) {
+        blockAvailable(getBlockBuffer(nextToDeliver), framesPerBlock);
+        blockReady[nextToDeliver] = false;
+        nextToDeliver ^= 1U;
+    }
+}
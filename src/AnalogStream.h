@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_ANALOGSTREAM_H
+#define IOABSTRACTION_ANALOGSTREAM_H
+
+/**
+ * @file AnalogStream.h
+ * @brief Continuous sampling of a set of analog channels at a fixed rate into a double buffer, with each completed
+ * block handed to task manager, for uses such as vibration monitoring where one shot reads cannot keep up.
+ */
+
+#include "PlatformDetermination.h"
+#include "AnalogDeviceAbstraction.h"
+#include <TaskManagerIO.h>
+
+// START user adjustable section
+
+/**
+ * The largest number of channels that a stream can sample.
+ */
+#ifndef ANALOG_STREAM_MAX_CHANNELS
+#define ANALOG_STREAM_MAX_CHANNELS 5
+#endif
+
+// END user adjustable section
+
+/**
+ * The signature of the function called with each completed block of samples, always called on task manager.
+ * @param samples the samples in frames, a frame being one sample from each channel in the order they were added
+ * @param frames the number of frames in the block
+ * @param channels the number of channels in each frame
+ */
+typedef void (*AnalogBlockCallbackFn)(const uint16_t* samples, uint16_t frames, uint8_t channels);
+
+/**
+ * Samples a set of analog channels continuously at a fixed rate, filling one half of a double buffer while the other
+ * half is delivered. Each completed block is handed to task manager in the same way as `AnalogInEvent`, by marking
+ * the event as triggered, then the callback, or an overridden blockAvailable, is called from exec.
+ *
+ * When the analog device supports streaming in hardware, such as the ADC FIFO and DMA on the RP2040 or the digital
+ * controller DMA on ESP32, the samples are taken by the hardware and the blocks are completed from its interrupt.
+ * Otherwise the stream falls back to reading a frame with getCurrentValue on each run of the event, which works with
+ * any analog device but at rates limited by how busy task manager is.
+ *
+ * Samples are in the raw range of the device, see getMaximumRange.
+ */
+class AnalogStream : public BaseEvent {
+private:
+    AnalogDevice* device;
+    AnalogBlockCallbackFn callback;
+    uint16_t* buffers;
+    pinid_t pins[ANALOG_STREAM_MAX_CHANNELS];
+    uint32_t sampleRateHz;
+    uint32_t overruns;
+    uint32_t serviceMicros;
+    uint16_t framesPerBlock;
+    uint16_t softwareFrame;
+    uint8_t channelCount;
+    uint8_t fillingBlock;
+    uint8_t nextToDeliver;
+    volatile bool blockReady[2];
+    bool running;
+    bool hardware;
+    taskid_t eventTaskId;
+public:
+    /**
+     * Create a stream on an analog device, add the channels and then call start.
+     * @param device the analog device to sample
+     * @param framesPerBlock the number of frames in each block delivered, a frame is one sample of every channel
+     * @param callback the function called with each block, or nullptr if blockAvailable is overridden
+     */
+    AnalogStream(AnalogDevice* device, uint16_t framesPerBlock, AnalogBlockCallbackFn callback = nullptr);
+    ~AnalogStream() override;
+
+    /**
+     * Adds a channel, call only while stopped. Some hardware needs the channels in ascending pin order.
+     * @param pin the analog pin, which must already be initialised with initPin
+     * @return true if added, false if there are already ANALOG_STREAM_MAX_CHANNELS
+     */
+    bool addChannel(pinid_t pin);
+
+    /**
+     * Starts sampling, the buffers are allocated on the first start. Streaming is done by the hardware if the
+     * device supports it, otherwise by the software fallback.
+     * @param rateHz the number of frames per second, each channel is sampled at this rate
+     * @return true if started, false if there are no channels or no memory for the buffers
+     */
+    bool start(uint32_t rateHz);
+
+    /** Stops sampling, any blocks not yet delivered are dropped. */
+    void stop();
+
+    /** @return true if sampling */
+    bool isRunning() const { return running; }
+
+    /** @return true if the samples are being taken by the hardware rather than the software fallback */
+    bool isHardwareStreaming() const { return hardware; }
+
+    /** @return the number of times a block completed before the previous use of its buffer was delivered */
+    uint32_t getOverruns() const { return overruns; }
+
+    uint8_t getChannelCount() const { return channelCount; }
+    pinid_t getChannelPin(uint8_t idx) const { return pins[idx]; }
+    uint32_t getSampleRate() const { return sampleRateHz; }
+    uint16_t getFramesPerBlock() const { return framesPerBlock; }
+    /** @return the number of samples in each block, which is the frames multiplied by the channels */
+    uint16_t getSamplesPerBlock() const { return framesPerBlock * channelCount; }
+
+    /**
+     * For device implementations, gets a block of the buffer.
+     * @param block either 0 or 1
+     * @return the buffer for the block
+     */
+    uint16_t* getBlockBuffer(uint8_t block) { return buffers + (block * getSamplesPerBlock()); }
+
+    /** For device implementations, @return the buffer of the block that should be filled now */
+    uint16_t* getFillingBuffer() { return getBlockBuffer(fillingBlock); }
+
+    /**
+     * For device implementations, marks the block being filled as complete and triggers the event to deliver it,
+     * safe to call from an interrupt.
+     * @return the buffer of the block to fill next
+     */
+    uint16_t* blockComplete();
+
+    /**
+     * For device implementations that must be serviced on task manager, such as draining a driver's buffer, the
+     * device's serviceStreaming is called at this interval while streaming.
+     * @param micros the interval in microseconds, or 0 for none, which is the default
+     */
+    void setServiceInterval(uint32_t micros) { serviceMicros = micros; }
+
+    /**
+     * Called on task manager with each completed block, by default it calls the callback, override it to handle the
+     * blocks in a subclass instead.
+     * @param samples the samples in frames
+     * @param frames the number of frames
+     */
+    virtual void blockAvailable(const uint16_t* samples, uint16_t frames);
+
+    uint32_t timeOfNextCheck() override;
+    void exec() override;
+private:
+    void softwareSample();
+};
+
+#endif //IOABSTRACTION_ANALOGSTREAM_H
@@ -9,6 +9,14 @@
 #include <Arduino.h>
 #include "EEPROM.h"
 #include "EepromAbstraction.h"
+#include <TaskManagerIO.h>
+
+/**
+ * Defined on cores where EEPROM is emulated in flash and changes must be committed to be saved.
+ */
+#if defined(ESP8266) || defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+#define IOA_EEPROM_NEEDS_COMMIT
+#endif
 
 /**
  * @file ArduinoEEPROMAbstraction.h
@@ -26,15 +34,64 @@
  * AT24Cxxx EEPROM devices which cost about $1 and you will not risk damaging your FLASH. Me having 
  * implemented this is not an indicator that I agree with using FLASH as EEPROM, I personally wouldn't
  * do that on a production board.
+ *
+ * To keep commits to a minimum, bytes that are unchanged are never written, and the object tracks whether anything
+ * has changed since the last commit. Call setCommitInterval to have task manager commit any changes at most once per
+ * interval, and wrap a group of writes, such as saving all settings, in beginTransaction and endTransaction so that
+ * they are committed together once at the end. Call commitIfDirty at any time to commit straight away.
  */
-class ArduinoEEPROMAbstraction : public EepromAbstraction {
+class ArduinoEEPROMAbstraction : public EepromAbstraction, public Executable {
 private:
     EEPROMClass* eepromProxy;
+    uint32_t commitIntervalMillis = 0;
+    bool dirty = false;
+    bool inTransaction = false;
+    bool commitScheduled = false;
 public:
     ArduinoEEPROMAbstraction(EEPROMClass* proxy) {
         this->eepromProxy = proxy;
     }
 
+    /**
+     * Sets the interval at which task manager commits changes, at most one commit is made per interval however many
+     * writes there are. Commits are held back during a transaction.
+     * @param intervalMillis the interval in milliseconds, or 0 to only commit when asked
+     */
+    void setCommitInterval(uint32_t intervalMillis) { commitIntervalMillis = intervalMillis; }
+
+    /**
+     * Starts a group of writes that should be committed together, no commit is made until endTransaction.
+     */
+    void beginTransaction() { inTransaction = true; }
+
+    /**
+     * Ends a group of writes, committing them once if anything changed.
+     */
+    void endTransaction() {
+        inTransaction = false;
+        commitIfDirty();
+    }
+
+    /** @return true if there are changes not yet committed */
+    bool isDirty() const { return dirty; }
+
+    /**
+     * Commits the changes if there are any, on cores that do not emulate EEPROM in flash this only clears the state.
+     */
+    void commitIfDirty() {
+        if(!dirty) return;
+#ifdef IOA_EEPROM_NEEDS_COMMIT
+        eepromProxy->commit();
+#endif
+        dirty = false;
+    }
+
+    /** Called by task manager to make the interval commit, see setCommitInterval */
+    void exec() override {
+        commitScheduled = false;
+        if(!inTransaction) commitIfDirty();
+    }
+
    	uint8_t read8(EepromPosition position) override {
         return eepromProxy->read(position);
     }
@@ -49,23 +106,23 @@ public:
     }
 
     void write8(EepromPosition pos, uint8_t val) override {
-        eepromProxy->write(pos, val);
+        writeByte(pos, val);
     }
 
     void write16(EepromPosition pos, uint16_t val) override {
-        eepromProxy->write(pos, val);
+        writeByte(pos, (uint8_t)val);
         val >>= 8;
-        eepromProxy->write(pos + 1, (uint8_t)val);
+        writeByte(pos + 1, (uint8_t)val);
     }
 
    	void write32(EepromPosition pos, uint32_t val) override {
-        eepromProxy->write(pos, (uint8_t)val);
+        writeByte(pos, (uint8_t)val);
         val >>= 8;
-        eepromProxy->write(pos + 1, (uint8_t)val);
+        writeByte(pos + 1, (uint8_t)val);
         val >>= 8;
-        eepromProxy->write(pos + 2, (uint8_t)val);
+        writeByte(pos + 2, (uint8_t)val);
         val >>= 8;
-        eepromProxy->write(pos + 3, (uint8_t)val);
+        writeByte(pos + 3, (uint8_t)val);
     }
 
 	void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override {
@@ -77,10 +134,21 @@ public:
 
 	void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override {
         for(int i=0;i<len;i++) {
-            eepromProxy->write(romDest + i, *memSrc);
+            writeByte(romDest + i, *memSrc);
             memSrc++;
         }
     }
+private:
+    void writeByte(EepromPosition pos, uint8_t val) {
+        // unchanged bytes are skipped, so rewriting the same settings does not make the sector dirty.
+        if(eepromProxy->read(pos) == val) return;
+        eepromProxy->write(pos, val);
+        dirty = true;
+        if(commitIntervalMillis != 0 && !commitScheduled) {
+            // when task manager is full, the next write tries again.
+            commitScheduled = taskManager.scheduleOnce(commitIntervalMillis, this, TIME_MILLIS) != TASKMGR_INVALIDID;
+        }
+    }
 };
 
 #endif // !defined(_ARDUNIO_EEPROM_ABS_H) && !defined(_NO_EEPROM_CLASS_)
@@ -15,6 +15,12 @@
 
 #define IO_PIN_NOT_DEFINED 0xFF
 
+/**
+ * A set of pins used by the multi pin functions `readPinMask` and `writePinMask`. Bit 0 of the mask represents the
+ * start pin provided to the function, bit 1 the pin after it and so on, so up to 32 pins can be handled in one call.
+ */
+typedef uint32_t IoPinMask;
+
 #if defined(IOA_USE_MBED)
 # include "mbed/MbedDigitalIO.h"
 #elif defined(ESP32) && defined(IOA_USE_ESP32_EXTRAS)
@@ -40,7 +46,7 @@ private:
 #ifdef IOA_USE_MBED
     BtreeList<uint32_t, GpioWrapper> pinCache;
 
-    GpioWrapper *allocatePinIfNeedBe(uint8_t pinToAlloc);
+    GpioWrapper *allocatePinIfNeedBe(pinid_t pinToAlloc);
 #endif //IOA_USE_MBED
 public:
 	virtual ~BasicIoAbstraction() = default;
@@ -161,6 +167,70 @@ public:
 	 * @return the 8 bit value read from the port.
 	 */
 	virtual uint8_t readPort(pinid_t pin);
+
+	/**
+	 * Reads many pins at once, bit 0 of the returned mask is the state of `startPin`, bit 1 is `startPin + 1` and so
+	 * on. Only pins that are set in the mask are read, all other bits are returned as 0. On device pins the fastest
+	 * native method available is used, EG reading the port registers directly. On expanders and other serial devices
+	 * the value is built from the state cached during the last sync, so sync first as per readValue.
+	 * @param startPin the pin that is represented by bit 0 of the mask
+	 * @param mask the pins that should be read
+	 * @return the state of the requested pins in mask form
+	 */
+	virtual IoPinMask readPinMask(pinid_t startPin, IoPinMask mask);
+
+	/**
+	 * Writes many pins at once, bit 0 of the mask and value represent `startPin`, bit 1 `startPin + 1` and so on. Only
+	 * pins set in the mask are changed. On device pins this is done using the fastest native method available, which
+	 * unlike digitalWrite does not turn off any PWM timer associated with the pin. For serial devices, sync afterwards.
+	 * @param startPin the pin that is represented by bit 0 of the mask
+	 * @param mask the pins that should be written
+	 * @param values the new values for the pins in mask form
+	 */
+	virtual void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values);
+
+	/**
+	 * Sets the direction of many pins at once to the same mode, bit 0 of the mask represents `startPin`, bit 1
+	 * `startPin + 1` and so on. Where the platform can configure a group of pins in one call, such as gpio_config on
+	 * ESP32, it is used, otherwise this is the same as calling pinDirection for each pin in the mask.
+	 * @param startPin the pin that is represented by bit 0 of the mask
+	 * @param mask the pins that should have their direction set
+	 * @param mode the mode for all the pins, as per pinMode
+	 */
+	virtual void pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode);
+
+protected:
+    /**
+     * A pin by pin implementation of readPinMask that works with any abstraction, it calls readValue for each pin in
+     * the mask. Used when there is no better way to read more than one pin.
+     */
+    IoPinMask readPinMaskByPin(pinid_t startPin, IoPinMask mask) {
+        IoPinMask ret = 0;
+        for(uint8_t i = 0; mask != 0; i++, mask >>= 1U) {
+            if((mask & 1U) && readValue(pinid_t(startPin + i))) ret |= (IoPinMask(1U) << i);
+        }
+        return ret;
+    }
+
+    /**
+     * A pin by pin implementation of writePinMask that works with any abstraction, it calls writeValue for each pin in
+     * the mask. Used when there is no better way to write more than one pin.
+     */
+    void writePinMaskByPin(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+        for(uint8_t i = 0; mask != 0; i++, mask >>= 1U, values >>= 1U) {
+            if(mask & 1U) writeValue(pinid_t(startPin + i), (values & 1U) ? HIGH : LOW);
+        }
+    }
+
+    /**
+     * A pin by pin implementation of pinDirectionMask that works with any abstraction, it calls pinDirection for each
+     * pin in the mask.
+     */
+    void pinDirectionMaskByPin(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+        for(uint8_t i = 0; mask != 0; i++, mask >>= 1U) {
+            if(mask & 1U) pinDirection(pinid_t(startPin + i), mode);
+        }
+    }
 };
 
 /** 
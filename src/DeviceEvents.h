@@ -14,6 +14,7 @@
 #include "TaskManagerIO.h"
 #include "PlatformDetermination.h"
 #include "AnalogDeviceAbstraction.h"
+#include "InputWakeSchedule.h"
 
 /**
  * An event that triggers when a certain analog condition is reached, based on a made and a threshold. It can either
@@ -26,8 +27,15 @@
  * * ANALOGIN_EXCEEDS - the event is triggered when analog in exceeds threshold.
  * * ANALOGIN_BELOW - the event is triggered when analog in is below threshold.
  * * ANALOGIN_CHANGE - the event is triggered when analog in changes by more than threshold.
+ *
+ * The threshold is converted to raw counts of the device on the first check, after which each check reads the raw
+ * value and compares it as an integer, so no floating point is used while polling. The float `lastReading` is only
+ * calculated when the event triggers, use getLastReadingFixed for the value of the latest check.
+ *
+ * For ANALOGIN_EXCEEDS and ANALOGIN_BELOW, call useHardwareThreshold to have a device that supports it watch the pin
+ * with a comparator or ADC watchdog, the crossings then arrive by interrupt and nothing is polled.
  */
-class AnalogInEvent : public BaseEvent {
+class AnalogInEvent : public BaseEvent, public AnalogThresholdWatcher {
 public:
     /**
      * Describes the way in which the Analog event should trigger.
@@ -37,15 +45,25 @@ public:
         ANALOGIN_EXCEEDS,
         /** Trigger the event when it goes below the threshold */
         ANALOGIN_BELOW,
-        /** Trigger the event when it changes by more than threshold */
+        /** Trigger the event when it changes by more than threshold since it last triggered */
         ANALOGIN_CHANGE
     };
 private:
     AnalogDevice *analogDevice;
     AnalogEventMode mode;
     uint32_t pollInterval;
-    bool latched;
+    unsigned int thresholdCounts;
+    unsigned int lastCounts;
+    unsigned int referenceCounts;
+    unsigned int hysteresisCounts;
+    float hysteresis;
+    uint8_t bitDepth;
+    volatile bool latched;
+    volatile bool rearmPending;
+    bool grouped;
+    bool hardwareWatch;
     pinid_t analogPin;
+    WakeDeadline wakeDeadline;
 protected:
     float analogThreshold;
     float lastReading;
@@ -66,7 +84,13 @@ public:
         lastReading = 0;
         pollInterval = pollInterval_;
         analogDevice = &device;
+        thresholdCounts = lastCounts = referenceCounts = hysteresisCounts = 0;
+        hysteresis = 0.0F;
+        bitDepth = 0;
         latched = false;
+        rearmPending = false;
+        grouped = false;
+        hardwareWatch = false;
         mode = mode_;
     }
 
@@ -86,7 +110,13 @@ public:
         lastReading = 0;
         pollInterval = pollInterval_;
         analogDevice = device;
+        thresholdCounts = lastCounts = referenceCounts = hysteresisCounts = 0;
+        hysteresis = 0.0F;
+        bitDepth = 0;
         latched = false;
+        rearmPending = false;
+        grouped = false;
+        hardwareWatch = false;
         mode = mode_;
     }
 
@@ -98,23 +128,145 @@ public:
         pollInterval = micros;
     }
 
+    /**
+     * Change the threshold, it is converted to raw counts on the next check.
+     * @param threshold the new threshold between 0 and 1
+     */
+    void setThreshold(float threshold) {
+        analogThreshold = threshold;
+        bitDepth = 0;
+    }
+
+    /**
+     * Sets a band that the reading must move back through before the event unlatches, so that a noisy signal near the
+     * threshold does not trigger repeatedly. For ANALOGIN_EXCEEDS the reading must fall to threshold - hysteresis,
+     * and for ANALOGIN_BELOW rise to threshold + hysteresis. It has no effect on ANALOGIN_CHANGE.
+     * @param band the width of the band between 0 and 1, the default is 0
+     */
+    void setHysteresis(float band) {
+        hysteresis = band;
+        bitDepth = 0;
+    }
+
+    AnalogDevice* getAnalogDevice() { return analogDevice; }
+    pinid_t getAnalogPin() const { return analogPin; }
+
+    /**
+     * Marks the event as being sampled by an AnalogEventGroup, it then no longer reads the pin itself. Called by the
+     * group when the event is added.
+     * @param isGrouped true if the group now provides the readings
+     */
+    void setGrouped(bool isGrouped) { grouped = isGrouped; }
+
+    /**
+     * Asks the analog device to watch the threshold in hardware, when it can the event no longer polls at all, and
+     * each crossing is marshalled from the interrupt to task manager. Only ANALOGIN_EXCEEDS and ANALOGIN_BELOW can be
+     * watched. Hysteresis is whatever the hardware provides, but as the device is only rearmed after the event has
+     * run, a noisy signal cannot interrupt more often than that. When triggered this way lastReading holds the
+     * threshold, as the pin is not read.
+     * @return true if the hardware is watching, false if the event carries on polling
+     */
+    bool useHardwareThreshold() {
+        if(mode == ANALOGIN_CHANGE || grouped) return false;
+        bitDepth = analogDevice->getBitDepth(DIR_IN, analogPin);
+        thresholdCounts = analogFixedToCounts(analogFloatToFixed(analogThreshold), bitDepth);
+        hysteresisCounts = analogFixedToCounts(analogFloatToFixed(hysteresis), bitDepth);
+        hardwareWatch = analogDevice->startThresholdWatch(analogPin, thresholdCounts, this);
+        return hardwareWatch;
+    }
+
+    /**
+     * Stops the hardware watch, the event goes back to polling.
+     */
+    void stopHardwareThreshold() {
+        if(!hardwareWatch) return;
+        analogDevice->stopThresholdWatch(analogPin);
+        hardwareWatch = false;
+    }
+
+    /** @return true if the threshold is being watched in hardware */
+    bool isHardwareThreshold() const { return hardwareWatch; }
+
+    /**
+     * Called by the device from its interrupt on each crossing when watching in hardware, it latches and triggers in
+     * the same way as polling does. The device is asked to rearm its watch on the next check after the event has
+     * run, see AnalogDevice::rearmThresholdWatch.
+     * @param above true if the pin is now above the threshold
+     */
+    void thresholdCrossed(bool above) override {
+        rearmPending = true;
+        bool conditionMet = (mode == ANALOGIN_EXCEEDS) ? above : !above;
+        if(conditionMet && !latched) {
+            latched = true;
+            lastReading = analogThreshold;
+            markTriggeredAndNotify();
+            return;
+        }
+        if(!conditionMet) latched = false;
+        // not triggered, but the watch still needs to be rearmed soon.
+        readingAvailable();
+    }
+
+    /**
+     * Evaluates the condition against a reading, triggering the event if it is newly met. Normally called from
+     * timeOfNextCheck, and by AnalogEventGroup with the reading it took for the pin.
+     * @param counts the raw reading of the pin
+     * @return true if the event was triggered
+     */
+    bool evaluateReading(unsigned int counts) {
+        if(bitDepth == 0) {
+            // done once, so the threshold is compared in the counts of the device from then on.
+            bitDepth = analogDevice->getBitDepth(DIR_IN, analogPin);
+            thresholdCounts = analogFixedToCounts(analogFloatToFixed(analogThreshold), bitDepth);
+            hysteresisCounts = analogFixedToCounts(analogFloatToFixed(hysteresis), bitDepth);
+            if(!latched) referenceCounts = counts;
+        }
+        lastCounts = counts;
+        if(!latched) {
+            if(!isConditionTrue()) return false;
+            lastReading = analogFixedToFloat(getLastReadingFixed());
+            referenceCounts = lastCounts;
+            latched = true;
+            markTriggeredAndNotify();
+            return true;
+        }
+        if(isReleased()) latched = false;
+        return false;
+    }
+
+    /**
+     * @return the reading at the latest check as fixed point, see AnalogFixed
+     */
+    AnalogFixed getLastReadingFixed() const {
+        return analogCountsToFixed(lastCounts, bitDepth);
+    }
+
+    /**
+     * @return the raw reading at the latest check, in the range of the device
+     */
+    unsigned int getLastReadingCounts() const { return lastCounts; }
+
     /**
      * Implementation of the method that checks the analog reading against the condition for this instance. If the
      * condition is met, then it triggers the event, which stays latched until the condition  is no longer met, and
-     * then it is unlatched.
+     * then it is unlatched. When the event is in a group, the group reads the pin instead.
      * @return the configured poll interval.
      */
     uint32_t timeOfNextCheck() override {
-        lastReading = analogDevice->getCurrentFloat(analogPin);
-        auto analogTrigger = isConditionTrue();
-        if (analogTrigger && !latched) {
-            setTriggered(true);
-            latched = true;
+        if(hardwareWatch && rearmPending) {
+            // only once a triggered event has run is the watch rearmed, the flag is cleared first so that a crossing
+            // reported while rearming asks again.
+            if(isTriggered()) return wakeDeadline.nextRunIn(pollInterval);
+            rearmPending = false;
+            analogDevice->rearmThresholdWatch(analogPin);
         }
-        else if(!analogTrigger && latched) {
-            latched = false;
+        if(grouped || hardwareWatch) {
+            // the group or the hardware watch decides when this event runs.
+            wakeDeadline.waitingForInterrupt();
+            return secondsToMicros(1);
         }
-        return pollInterval;
+        evaluateReading(analogDevice->getCurrentValue(analogPin));
+        return wakeDeadline.nextRunIn(pollInterval);
     }
 
     /**
@@ -123,14 +275,30 @@ public:
      */
     bool isConditionTrue() {
         if (mode == ANALOGIN_BELOW) {
-            return lastReading < analogThreshold;
+            return lastCounts < thresholdCounts;
+        }
+        else if(mode == ANALOGIN_EXCEEDS) {
+            return lastCounts > thresholdCounts;
+        }
+        else {
+            auto change = (lastCounts > referenceCounts) ? (lastCounts - referenceCounts) : (referenceCounts - lastCounts);
+            return change > thresholdCounts;
+        }
+    }
+
+    /**
+     * Checks if a latched event should unlatch, the reading must have moved back through the hysteresis band.
+     * @return true if the event should unlatch
+     */
+    bool isReleased() {
+        if (mode == ANALOGIN_BELOW) {
+            return lastCounts >= thresholdCounts + hysteresisCounts;
         }
         else if(mode == ANALOGIN_EXCEEDS) {
-            return lastReading > analogThreshold;
+            return lastCounts + hysteresisCounts <= thresholdCounts;
         }
         else {
-            auto change = abs(analogThreshold - lastReading);
-            return change > analogThreshold;
+            return !isConditionTrue();
         }
     }
 
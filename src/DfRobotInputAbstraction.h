@@ -8,6 +8,7 @@
 
 #include "BasicIoAbstraction.h"
 #include "AnalogDeviceAbstraction.h"
+#include "IoaStaticAllocation.h"
 
 /**
  * @file DfRobotInputAbstraction.h
@@ -35,6 +36,8 @@ struct DfRobotAnalogRanges {
 #define ALLOWABLE_RANGE 0.01F
 #endif // ALLOWABLE_RANGE
 
+#define DF_ROBOT_KEY_COUNT 5
+
 #if defined(IOA_USE_MBED) || defined(BUILD_FOR_PICO_CMAKE)
 #define pgmAsFloat(x) ((float)(*x))
 #define A0 26
@@ -51,12 +54,18 @@ struct DfRobotAnalogRanges {
  * * pin2 = down (DF_KEY_DOWN)
  * * pin3 = left (DF_KEY_LEFT)
  * * pin4 = select (DF_KEY_SELECT)
+ *
+ * The ranges are converted once at construction into raw counts of the analog device, so each poll is one integer
+ * read and at most five integer compares, with no floating point or program memory reads. As decoding only uses that
+ * table, a raw reading can also be given to readingAvailable from an interrupt or an AnalogStream.
  */
 class DfRobotInputAbstraction : public BasicIoAbstraction {
 private:
     pinid_t analogPin;
-    uint8_t readCache;
-    float lastReading;
+    volatile uint8_t readCache;
+    unsigned int lastCounts;
+    unsigned int allowableCounts;
+    unsigned int upperCounts[DF_ROBOT_KEY_COUNT];
     const DfRobotAnalogRanges* analogRanges;
     AnalogDevice* device;
 
@@ -77,8 +86,18 @@ public:
 
     void initAbstraction() {
         device->initPin(analogPin, DIR_IN);
-        lastReading = device->getCurrentValue(analogPin);
-        readCache = mapAnalogToPin(lastReading);
+
+        // in the order of the ranges, which rise from right to select, each is the upper limit in counts of a key.
+        uint8_t bits = device->getBitDepth(DIR_IN, analogPin);
+        upperCounts[0] = analogFixedToCounts(analogFloatToFixed(pgmAsFloat(&analogRanges->right)), bits);
+        upperCounts[1] = analogFixedToCounts(analogFloatToFixed(pgmAsFloat(&analogRanges->up)), bits);
+        upperCounts[2] = analogFixedToCounts(analogFloatToFixed(pgmAsFloat(&analogRanges->down)), bits);
+        upperCounts[3] = analogFixedToCounts(analogFloatToFixed(pgmAsFloat(&analogRanges->left)), bits);
+        upperCounts[4] = analogFixedToCounts(analogFloatToFixed(pgmAsFloat(&analogRanges->select)), bits);
+        allowableCounts = analogFixedToCounts(analogFloatToFixed(ALLOWABLE_RANGE), bits);
+
+        lastCounts = device->getCurrentValue(analogPin);
+        readCache = decodeCounts(lastCounts);
     }
 
     /**
@@ -105,27 +124,47 @@ public:
         return readCache;
     }
 
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override {
+        return (startPin < 8) ? ((readCache >> startPin) & mask) : 0;
+    }
+
 	bool runLoop() override { 
-        auto newReading = device->getCurrentFloat(analogPin);
-        if(abs(newReading - lastReading) > ALLOWABLE_RANGE) {
-            readCache = mapAnalogToPin(newReading);
-        }
-        lastReading = newReading;
+        readingAvailable(device->getCurrentValue(analogPin));
         return true;
     }
 
+    /**
+     * Decodes a raw reading of the analog pin into the key state, safe to call from an interrupt, for example with
+     * readings from an AnalogStream or an ADC conversion complete interrupt. As with polling, a reading that moved no
+     * more than ALLOWABLE_RANGE since the last one is treated as noise and ignored.
+     * @param counts the raw reading in the range of the analog device
+     */
+    void readingAvailable(unsigned int counts) {
+        unsigned int change = (counts > lastCounts) ? (counts - lastCounts) : (lastCounts - counts);
+        if(change > allowableCounts) {
+            readCache = decodeCounts(counts);
+        }
+        lastCounts = counts;
+    }
+
+    /**
+     * @param counts a raw reading of the analog pin
+     * @return the key state for the reading, with the bit for the key pressed set
+     */
+    uint8_t decodeCounts(unsigned int counts) const {
+        const uint8_t keys[DF_ROBOT_KEY_COUNT] = { DF_KEY_RIGHT, DF_KEY_UP, DF_KEY_DOWN, DF_KEY_LEFT, DF_KEY_SELECT };
+        for(uint8_t i = 0; i < DF_ROBOT_KEY_COUNT; i++) {
+            if(counts < upperCounts[i]) return 1U << keys[i];
+        }
+        return 0;
+    }
+
+    /**
+     * @param reading a reading between 0 and 1
+     * @return the key state for the reading, with the bit for the key pressed set
+     */
     uint8_t mapAnalogToPin(float reading) {
-        uint8_t ret = 0xff;
-        if(reading < pgmAsFloat(&analogRanges->right)) ret =  DF_KEY_RIGHT;
-        else if(reading < pgmAsFloat(&analogRanges->up)) ret =  DF_KEY_UP;
-        else if(reading < pgmAsFloat(&analogRanges->down)) ret = DF_KEY_DOWN;
-        else if(reading < pgmAsFloat(&analogRanges->left)) ret = DF_KEY_LEFT;
-        else if(reading < pgmAsFloat(&analogRanges->select)) ret = DF_KEY_SELECT;
-
-        if(ret == 0xff) 
-            return 0;
-        else
-            return 1 << ret;
+        return decodeCounts(analogFixedToCounts(analogFloatToFixed(reading), device->getBitDepth(DIR_IN, analogPin)));
     }
 
     // we ignore all non-input methods, as this is input only
@@ -165,7 +204,7 @@ const PROGMEM DfRobotAnalogRanges dfRobotV1AvrRanges { 0.0488F, 0.1904F, 0.3710F
  */
 inline IoAbstractionRef inputFromDfRobotShield(uint8_t pin = A0, AnalogDevice* device = nullptr) {
     device = internalAnalogIo();
-    return new DfRobotInputAbstraction(&dfRobotAvrRanges, pin, device);
+    return ioaCreate<DfRobotInputAbstraction>(&dfRobotAvrRanges, pin, device);
 }
 
 /**
@@ -177,7 +216,7 @@ inline IoAbstractionRef inputFromDfRobotShield(uint8_t pin = A0, AnalogDevice* d
  */
 inline IoAbstractionRef inputFromDfRobotShieldV1(uint8_t pin = A0, AnalogDevice* device = nullptr) {
     device = internalAnalogIo();
-    return new DfRobotInputAbstraction(&dfRobotV1AvrRanges, pin, device);
+    return ioaCreate<DfRobotInputAbstraction>(&dfRobotV1AvrRanges, pin, device);
 }
 
 #endif
@@ -4,6 +4,16 @@
  */
 #include <EepromAbstraction.h>
 
+uint16_t eepromCrc16(const uint8_t* data, size_t len, uint16_t crc) {
+    while(len--) {
+        crc ^= uint16_t(*data++) << 8U;
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000U) ? uint16_t((crc << 1U) ^ 0x1021U) : uint16_t(crc << 1U);
+        }
+    }
+    return crc;
+}
+
 #ifdef __AVR__
 
 #include <avr/eeprom.h>
@@ -42,6 +52,10 @@ void AvrEeprom::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_
 	eeprom_read_block(memDest, (uint8_t*)romSrc, len);
 }
 
+void AvrEeprom::readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) {
+	eeprom_read_block(memDest, (uint8_t*)romSrc, len);
+}
+
 void AvrEeprom::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) {
 	bool changed = false;
 	for(uint8_t i = 0;i < len; ++i) {
@@ -93,8 +93,52 @@ public:
 	 * @param len the length of the array
 	 */
 	virtual void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) = 0;
+
+    /**
+     * Read a block of bytes of any length from EEPROM into memory. By default this is split into calls to
+     * readIntoMemArray, implementations that can transfer larger blocks directly override it.
+     * @param memDest the memory where the EEPROM data should be copied to
+     * @param romSrc the source position in EEPROM storage
+     * @param len the length of the block
+     */
+    virtual void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) {
+        while(len > 0) {
+            auto currentGo = (len > 0xffU) ? uint8_t(0xffU) : uint8_t(len);
+            readIntoMemArray(memDest, romSrc, currentGo);
+            memDest += currentGo;
+            romSrc += currentGo;
+            len -= currentGo;
+        }
+    }
+
+    /**
+     * Write a block of bytes of any length from memory to EEPROM storage. By default this is split into calls to
+     * writeArrayToRom, implementations that can transfer larger blocks directly override it.
+     * @param romDest the start position in eeprom storage that the block should be copied to
+     * @param memSrc the memory where the block should be copied from
+     * @param len the length of the block
+     */
+    virtual void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) {
+        while(len > 0) {
+            auto currentGo = (len > 0xffU) ? uint8_t(0xffU) : uint8_t(len);
+            writeArrayToRom(romDest, memSrc, currentGo);
+            memSrc += currentGo;
+            romDest += currentGo;
+            len -= currentGo;
+        }
+    }
 };
 
+/**
+ * Calculates a CRC-16/CCITT over a block of memory, as used to check records and blocks stored in EEPROM. Pass the
+ * result of one call as the starting value of the next to continue over several blocks.
+ * @param data the data to check
+ * @param len the length of the data
+ * @param crc the starting value, 0xffff for a new calculation
+ * @return the CRC
+ */
+uint16_t eepromCrc16(const uint8_t* data, size_t len, uint16_t crc = 0xffffU);
+
 // only include the atmel AVR support if it's available on this platform.
 #ifdef __AVR__
 
@@ -117,6 +161,7 @@ public:
 
 	virtual void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len);
 	virtual void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len);
+	void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override;
 };
 
 #endif
@@ -15,6 +15,12 @@
 
 #define READY_TRIES_COUNT 100
 
+// the interval between ready probes during an asynchronous flush, a page write cycle takes up to 5ms.
+#define ASYNC_PROBE_MICROS 500
+
+// the interval before a failed scheduled transfer is submitted again, READY_TRIES_COUNT of these cover a write cycle.
+#define SCHEDULED_RETRY_MICROS 50
+
 uint8_t at24PageFromRomSize(At24EepromType size) {
     switch (size) {
         case PAGESIZE_AT24C01:
@@ -49,12 +55,262 @@ size_t at24ActualSizeFromRomSize(At24EepromType size) {
     }
 }
 
-I2cAt24Eeprom::I2cAt24Eeprom(uint8_t address, At24EepromType ty, WireType wireImpl) {
+void At24AsyncFlushTask::exec() {
+    eeprom->asyncFlushStep();
+}
+
+bool At24ScheduledTransfer::start(WireType wire, uint8_t devAddr, const uint8_t* data, uint8_t len, uint8_t tries) {
+    if(inProgress || len > sizeof buffer) return false;
+    memcpy(buffer, data, len);
+    transaction.prepare(wire, devAddr, this, I2C_PRIORITY_BULK);
+    transaction.setWrite(buffer, len);
+    triesLeft = tries;
+    inProgress = true;
+    exec();
+    return true;
+}
+
+void At24ScheduledTransfer::exec() {
+    triesLeft--;
+    if(i2cTransactionScheduler.submit(&transaction)) return;
+
+    // the queue is full, which counts as a failed attempt.
+    i2cTransactionComplete(&transaction, false);
+}
+
+void At24ScheduledTransfer::i2cTransactionComplete(I2cTransaction* /*txn*/, bool success) {
+    if(!success && triesLeft != 0) {
+        taskManager.scheduleOnce(SCHEDULED_RETRY_MICROS, this, TIME_MICROS);
+        return;
+    }
+    if(!success) serlogF(SER_ERROR, "I2C was not ready after retries, failing");
+    inProgress = false;
+    eeprom->scheduledWriteComplete(success);
+}
+
+I2cAt24Eeprom::I2cAt24Eeprom(uint8_t address, At24EepromType ty, WireType wireImpl) : pendingTransfer(this), asyncFlushTask(this) {
 	this->wireImpl = wireImpl;
 	this->eepromAddr = address;
 	this->pageSize = at24PageFromRomSize(ty);
     this->eepromSize = at24ActualSizeFromRomSize(ty);
     this->errorOccurred = false;
+    this->scheduledTransfers = false;
+    this->cachePages = nullptr;
+    this->cacheData = nullptr;
+    this->idleFlushMillis = 0;
+    this->lastCacheWrite = 0;
+    this->cachePageCount = 0;
+    this->flushCompleteFn = nullptr;
+    this->nextEviction = 0;
+    this->asyncProbes = 0;
+    this->scheduledSlot = 0;
+    this->scheduledFrom = 0;
+    this->scheduledTo = 0;
+    this->scheduledPage = 0;
+    this->flushScheduled = false;
+    this->asyncWrites = false;
+    this->asyncFlushing = false;
+}
+
+I2cAt24Eeprom::~I2cAt24Eeprom() {
+    delete[] cachePages;
+    delete[] cacheData;
+}
+
+bool I2cAt24Eeprom::enablePageCache(uint8_t pages, uint32_t idleMillis) {
+    if(cachePages != nullptr || pages == 0) return false;
+    cachePages = new At24CachedPage[pages];
+    cacheData = new uint8_t[pages * pageSize];
+    for(uint8_t i = 0; i < pages; i++) {
+        cachePages[i].valid = false;
+        cachePages[i].dirtyFrom = 0;
+        cachePages[i].dirtyTo = 0;
+    }
+    cachePageCount = pages;
+    idleFlushMillis = idleMillis;
+    return true;
+}
+
+bool I2cAt24Eeprom::isCacheDirty() const {
+    for(uint8_t i = 0; i < cachePageCount; i++) {
+        if(cachePages[i].valid && cachePages[i].dirtyTo != 0) return true;
+    }
+    return false;
+}
+
+bool I2cAt24Eeprom::enableAsyncWrites(EepromFlushCompleteFn completeFn) {
+    if(cachePages == nullptr) return false;
+    flushCompleteFn = completeFn;
+    asyncWrites = true;
+    return true;
+}
+
+void I2cAt24Eeprom::flushCache() {
+    if(asyncWrites) {
+        if(!asyncFlushing) {
+            asyncFlushing = true;
+            asyncProbes = 0;
+            taskManager.scheduleOnce(0, &asyncFlushTask, TIME_MICROS);
+        }
+        return;
+    }
+    for(uint8_t i = 0; i < cachePageCount; i++) {
+        flushSlot(i);
+    }
+}
+
+bool I2cAt24Eeprom::flushSlot(uint8_t slot) {
+    auto& cached = cachePages[slot];
+    if(!cached.valid || cached.dirtyTo == 0) return true;
+    EepromPosition pageStart = cached.page * pageSize;
+
+    // an earlier error must not stop the page being written, so only this write decides the outcome.
+    bool hadError = errorOccurred;
+    errorOccurred = false;
+    romWrite(pageStart + cached.dirtyFrom, &cacheData[slot * pageSize] + cached.dirtyFrom, cached.dirtyTo - cached.dirtyFrom);
+    bool written = !errorOccurred;
+    errorOccurred = hadError || !written;
+    if(!written) return false; // left dirty, so that the next flush tries again
+
+    cached.dirtyFrom = 0;
+    cached.dirtyTo = 0;
+    return true;
+}
+
+int I2cAt24Eeprom::cacheSlotFor(EepromPosition position) {
+    if(position >= eepromSize) {
+        errorOccurred = true;
+        return -1;
+    }
+    uint16_t page = position / pageSize;
+    for(uint8_t i = 0; i < cachePageCount; i++) {
+        if(cachePages[i].valid && cachePages[i].page == page) return i;
+    }
+
+    // not held, so take the next slot in turn, writing it out first if it has changes.
+    uint8_t slot = nextEviction;
+    bool hadError = errorOccurred;
+    if(!flushSlot(slot)) {
+        // the page keeps its changes and stays cached, the caller instead makes this transfer directly to the device.
+        serlogF2(SER_WARNING, "Cache evict failed ", cachePages[slot].page);
+        errorOccurred = hadError;
+        return -1;
+    }
+    nextEviction = (nextEviction + 1) % cachePageCount;
+    cachePages[slot].valid = false;
+
+    // the last page of the device may be shorter than a full page, as the size given by the type is one less.
+    EepromPosition pageStart = page * pageSize;
+    uint8_t toLoad = (eepromSize - pageStart) < pageSize ? uint8_t(eepromSize - pageStart) : pageSize;
+    errorOccurred = false;
+    romRead(&cacheData[slot * pageSize], pageStart, toLoad);
+    if(errorOccurred) return -1;
+    errorOccurred = hadError;
+
+    cachePages[slot].page = page;
+    cachePages[slot].dirtyFrom = 0;
+    cachePages[slot].dirtyTo = 0;
+    cachePages[slot].valid = true;
+    return slot;
+}
+
+void I2cAt24Eeprom::asyncFlushStep() {
+    // scheduled writes wait out the write cycle by being submitted again, so only direct writes probe the device.
+    if(!scheduledTransfers && !ioaWireReady(wireImpl, eepromAddr)) {
+        // still in the write cycle of the last page, probe again shortly, unless it has stopped responding.
+        if(++asyncProbes > READY_TRIES_COUNT) {
+            serlogF(SER_ERROR, "EEPROM not ready, flush failed");
+            asyncFlushing = false;
+            if(flushCompleteFn) flushCompleteFn(this, false);
+            return;
+        }
+        taskManager.scheduleOnce(ASYNC_PROBE_MICROS, &asyncFlushTask, TIME_MICROS);
+        return;
+    }
+    asyncProbes = 0;
+
+    uint8_t slot = 0;
+    while(slot < cachePageCount && (!cachePages[slot].valid || cachePages[slot].dirtyTo == 0)) slot++;
+    if(slot == cachePageCount) {
+        asyncFlushing = false;
+        if(flushCompleteFn) flushCompleteFn(this, true);
+        return;
+    }
+
+    // write one page write of the dirty span, any later writes to the page widen the span again as usual.
+    auto& cached = cachePages[slot];
+    EepromPosition romDest = (cached.page * pageSize) + cached.dirtyFrom;
+    uint8_t currentGo = findMaximumInPage(romDest, cached.dirtyTo - cached.dirtyFrom);
+    if(scheduledTransfers) {
+        uint8_t ch[34];
+        uint8_t actualAddr;
+        uint8_t addrLen = buildAddress(romDest, ch, actualAddr);
+        memcpy(ch + addrLen, &cacheData[slot * pageSize] + cached.dirtyFrom, currentGo);
+        if(!pendingTransfer.start(wireImpl, actualAddr, ch, addrLen + currentGo, READY_TRIES_COUNT)) {
+            asyncFlushing = false;
+            if(flushCompleteFn) flushCompleteFn(this, false);
+            return;
+        }
+        // the span is taken out of the dirty range now, so later writes to it mark it dirty again, should this write
+        // fail it is put back, see scheduledWriteComplete.
+        scheduledSlot = slot;
+        scheduledPage = cached.page;
+        scheduledFrom = cached.dirtyFrom;
+        scheduledTo = cached.dirtyFrom + currentGo;
+        cached.dirtyFrom += currentGo;
+        if(cached.dirtyFrom >= cached.dirtyTo) {
+            cached.dirtyFrom = 0;
+            cached.dirtyTo = 0;
+        }
+        return;
+    }
+    writeAddressWire(romDest, &cacheData[slot * pageSize] + cached.dirtyFrom, currentGo);
+    if(errorOccurred) {
+        asyncFlushing = false;
+        if(flushCompleteFn) flushCompleteFn(this, false);
+        return;
+    }
+    cached.dirtyFrom += currentGo;
+    if(cached.dirtyFrom >= cached.dirtyTo) {
+        cached.dirtyFrom = 0;
+        cached.dirtyTo = 0;
+    }
+    taskManager.scheduleOnce(ASYNC_PROBE_MICROS, &asyncFlushTask, TIME_MICROS);
+}
+
+void I2cAt24Eeprom::scheduledWriteComplete(bool success) {
+    if(success) {
+        taskManager.scheduleOnce(0, &asyncFlushTask, TIME_MICROS);
+        return;
+    }
+
+    auto& cached = cachePages[scheduledSlot];
+    if(cached.valid && cached.page == scheduledPage) {
+        if(cached.dirtyTo == 0) {
+            cached.dirtyFrom = scheduledFrom;
+            cached.dirtyTo = scheduledTo;
+        } else {
+            if(scheduledFrom < cached.dirtyFrom) cached.dirtyFrom = scheduledFrom;
+            if(scheduledTo > cached.dirtyTo) cached.dirtyTo = scheduledTo;
+        }
+    }
+    else {
+        // the page has since been evicted, so the change never reached the device.
+        errorOccurred = true;
+    }
+    asyncFlushing = false;
+    if(flushCompleteFn) flushCompleteFn(this, false);
+}
+
+void I2cAt24Eeprom::exec() {
+    unsigned long idleFor = millis() - lastCacheWrite;
+    if(idleFor < idleFlushMillis) {
+        // written to since the flush was scheduled, so wait until the writes have been idle for long enough.
+        taskManager.scheduleOnce(idleFlushMillis - idleFor, this, TIME_MILLIS);
+        return;
+    }
+    flushScheduled = false;
+    flushCache();
 }
 
 bool I2cAt24Eeprom::hasErrorOccurred() {
@@ -84,6 +340,12 @@ void I2cAt24Eeprom::write8(EepromPosition position, uint8_t val) {
 }
 
 uint16_t I2cAt24Eeprom::read16(EepromPosition position) {
+    if(cachePages == nullptr) {
+        // a single addressed sequential read rather than an address write per byte.
+        uint8_t data[2] = {0};
+        romRead(data, position, sizeof data);
+        return ((uint16_t)data[0] << 8U) | data[1];
+    }
     uint16_t ret = ((uint16_t)readByte(position++) << 8U);
     ret |= readByte(position);
     return ret;
@@ -99,6 +361,11 @@ void I2cAt24Eeprom::write16(EepromPosition position, uint16_t val) {
 }
 
 uint32_t I2cAt24Eeprom::read32(EepromPosition position) {
+    if(cachePages == nullptr) {
+        uint8_t data[4] = {0};
+        romRead(data, position, sizeof data);
+        return ((uint32_t)data[0] << 24U) | ((uint32_t)data[1] << 16U) | ((uint32_t)data[2] << 8U) | data[3];
+    }
     uint32_t ret = ((uint32_t)readByte(position++)) << 24U;
     ret |= ((uint32_t)readByte(position++)) << 16U;
     ret |= ((uint32_t)readByte(position++)) << 8U;
@@ -116,8 +383,14 @@ void I2cAt24Eeprom::write32(EepromPosition position, uint32_t val) {
 }
 
 uint8_t I2cAt24Eeprom::readByte(EepromPosition position) {
-    writeAddressWire(position);
+    if(cachePages != nullptr) {
+        int slot = cacheSlotFor(position);
+        if(slot >= 0) return cacheData[(slot * pageSize) + (position % pageSize)];
+        // the page could not be cached, so read from the device instead.
+    }
+
     uint8_t data = 0;
+    writeAddressWire(position);
     errorOccurred = errorOccurred || !ioaWireRead(wireImpl, eepromAddr, &data, 1);
 
     // for debugging purposes
@@ -127,6 +400,29 @@ uint8_t I2cAt24Eeprom::readByte(EepromPosition position) {
 }
 
 void I2cAt24Eeprom::writeByte(EepromPosition position, uint8_t val) {
+    if(cachePages != nullptr) {
+        int slot = cacheSlotFor(position);
+        if(slot >= 0) {
+            uint8_t offset = position % pageSize;
+            cacheData[(slot * pageSize) + offset] = val;
+            auto& cached = cachePages[slot];
+            if(cached.dirtyTo == 0) {
+                cached.dirtyFrom = offset;
+                cached.dirtyTo = offset + 1;
+            } else {
+                if(offset < cached.dirtyFrom) cached.dirtyFrom = offset;
+                if(offset >= cached.dirtyTo) cached.dirtyTo = offset + 1;
+            }
+            lastCacheWrite = millis();
+            if(idleFlushMillis != 0 && !flushScheduled) {
+                flushScheduled = true;
+                taskManager.scheduleOnce(idleFlushMillis, this, TIME_MILLIS);
+            }
+            return;
+        }
+        // the page could not be cached, and as it is not held in the cache, writing to the device keeps the two coherent.
+    }
+
     uint8_t data[1];
     data[0] = (char)val;
     writeAddressWire(position, data, 1);
@@ -141,16 +437,8 @@ void I2cAt24Eeprom::writeAddressWire(EepromPosition memAddr, const uint8_t *data
         return;
     }
     uint8_t ch[34];
-    auto addrLen = 2;
-    auto actualAddr = eepromAddr;
-    if(pageSize > 16) {
-        ch[0] = memAddr >> 8U;
-        ch[1] = memAddr & 0xffU;
-    } else {
-        ch[0] = memAddr & 0xffU;
-        addrLen = 1;
-        actualAddr |= (memAddr >> 8U);
-    }
+    uint8_t actualAddr;
+    uint8_t addrLen = buildAddress(memAddr, ch, actualAddr);
     if(data != nullptr && len > 0) {
         memcpy(ch + addrLen, data, len);
     }
@@ -162,10 +450,78 @@ void I2cAt24Eeprom::writeAddressWire(EepromPosition memAddr, const uint8_t *data
     errorOccurred = errorOccurred || !ioaWireWriteWithRetry(wireImpl, actualAddr, ch, len + addrLen, READY_TRIES_COUNT);
 }
 
+uint8_t I2cAt24Eeprom::buildAddress(EepromPosition memAddr, uint8_t* ch, uint8_t& actualAddr) const {
+    actualAddr = eepromAddr;
+    if(pageSize > 16) {
+        ch[0] = memAddr >> 8U;
+        ch[1] = memAddr & 0xffU;
+        return 2;
+    } else {
+        // smaller devices take the upper address bits as part of the device address.
+        ch[0] = memAddr & 0xffU;
+        actualAddr |= (memAddr >> 8U);
+        return 1;
+    }
+}
+
 void I2cAt24Eeprom::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) {
-    int romOffset = 0;
+    readBlock(memDest, romSrc, len);
+}
+
+void I2cAt24Eeprom::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) {
+    writeBlock(romDest, memSrc, len);
+}
+
+void I2cAt24Eeprom::readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) {
+    if(cachePages == nullptr) {
+        romRead(memDest, romSrc, len);
+        return;
+    }
+    // copy a page at a time out of the cache.
+    while(len > 0) {
+        int slot = cacheSlotFor(romSrc);
+        uint8_t offset = romSrc % pageSize;
+        size_t currentGo = pageSize - offset;
+        if(currentGo > len) currentGo = len;
+        if(slot >= 0) {
+            memcpy(memDest, &cacheData[(slot * pageSize) + offset], currentGo);
+        }
+        else {
+            // the page could not be cached, so this part is read from the device instead.
+            romRead(memDest, romSrc, currentGo);
+            if(errorOccurred) return;
+        }
+        memDest += currentGo;
+        romSrc += currentGo;
+        len -= currentGo;
+    }
+}
+
+void I2cAt24Eeprom::writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) {
+    if(cachePages == nullptr) {
+        romWrite(romDest, memSrc, len);
+        return;
+    }
+    for(size_t i = 0; i < len; i++) {
+        if(readByte(romDest + i) != memSrc[i]) writeByte(romDest + i, memSrc[i]);
+    }
+}
+
+uint8_t I2cAt24Eeprom::findMaximumForRead(EepromPosition romSrc, size_t len) const {
+    // sequential reads carry on across pages, so only the wire buffer limits them, except that devices which take
+    // the upper address bits in the device address cannot cross into the next 256 byte block.
+    size_t currentGo = (len > MAX_BUFFER_SIZE_TO_USE) ? MAX_BUFFER_SIZE_TO_USE : len;
+    if(pageSize <= 16) {
+        size_t toBlockEnd = 0x100U - (romSrc & 0xffU);
+        if(currentGo > toBlockEnd) currentGo = toBlockEnd;
+    }
+    return uint8_t(currentGo);
+}
+
+void I2cAt24Eeprom::romRead(uint8_t* memDest, EepromPosition romSrc, size_t len) {
+    size_t romOffset = 0;
     while(len > 0 && !errorOccurred) {
-        int currentGo = findMaximumInPage(romSrc + romOffset, len);
+        int currentGo = findMaximumForRead(romSrc + romOffset, len);
 
         writeAddressWire(romSrc + romOffset);
         errorOccurred = errorOccurred || !ioaWireRead(wireImpl, eepromAddr, &memDest[romOffset], currentGo);
@@ -174,11 +530,11 @@ void I2cAt24Eeprom::readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, ui
     }
 }
 
-void I2cAt24Eeprom::writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t origLen) {
-    int romOffset = 0;
-    int leftToGo = origLen;
+void I2cAt24Eeprom::romWrite(EepromPosition romDest, const uint8_t* memSrc, size_t origLen) {
+    size_t romOffset = 0;
+    size_t leftToGo = origLen;
     while(leftToGo > 0 && !errorOccurred) {
-        int currentGo = findMaximumInPage(romDest + romOffset, leftToGo);
+        int currentGo = findMaximumInPage(romDest + romOffset, leftToGo > 0xffU ? 0xffU : uint8_t(leftToGo));
         writeAddressWire(romDest + romOffset, &memSrc[romOffset], currentGo);
         leftToGo -= currentGo;
         romOffset += currentGo;
@@ -13,6 +13,7 @@
 
 #include "PlatformDeterminationWire.h"
 #include "EepromAbstraction.h"
+#include "I2cTransactionScheduler.h"
 #include <TaskManager.h>
 
 /**
@@ -46,6 +47,70 @@ size_t at24ActualSizeFromRomSize(At24EepromType size);
  */
 uint8_t at24PageFromRomSize(At24EepromType size);
 
+class I2cAt24Eeprom;
+
+/**
+ * The callback used to report that an asynchronous flush of I2cAt24Eeprom has finished.
+ * @param eeprom the eeprom that finished flushing
+ * @param success true if every page was written, false if the device stopped responding
+ */
+typedef void (*EepromFlushCompleteFn)(I2cAt24Eeprom* eeprom, bool success);
+
+/**
+ * The task manager task that writes the pages of an asynchronous flush for I2cAt24Eeprom, kept separate from the idle
+ * flush task so that each is scheduled only once.
+ */
+class At24AsyncFlushTask : public Executable {
+private:
+    I2cAt24Eeprom* eeprom;
+public:
+    explicit At24AsyncFlushTask(I2cAt24Eeprom* eeprom) : eeprom(eeprom) {}
+    void exec() override;
+};
+
+/**
+ * A page write of an asynchronous flush of I2cAt24Eeprom made through the transaction queue as a bulk transaction.
+ * The data is copied into the transfer, so the cache can change while it is queued. The device does not acknowledge
+ * while it is writing the previous page, so when an attempt fails, the completion callback schedules it to be
+ * submitted again a short time later, until it succeeds or the tries run out, and the eeprom is then told the outcome.
+ */
+class At24ScheduledTransfer : public I2cTransactionListener, public Executable {
+private:
+    I2cAt24Eeprom* eeprom;
+    I2cTransaction transaction;
+    uint8_t buffer[34];
+    uint8_t triesLeft;
+    bool inProgress;
+public:
+    explicit At24ScheduledTransfer(I2cAt24Eeprom* eeprom) : eeprom(eeprom), transaction(), buffer{}, triesLeft(0),
+                                                            inProgress(false) {}
+
+    /**
+     * Copies the data and submits the first attempt of a write.
+     * @return true if submitted, false if the previous write is still in progress or the data is too long
+     */
+    bool start(WireType wire, uint8_t devAddr, const uint8_t* data, uint8_t len, uint8_t tries);
+
+    /** @return true from start until the eeprom has been told the outcome */
+    bool isInProgress() const { return inProgress; }
+
+    void i2cTransactionComplete(I2cTransaction* txn, bool success) override;
+
+    /** Called by task manager to submit the next attempt */
+    void exec() override;
+};
+
+/**
+ * The state of one page held in the optional page cache of I2cAt24Eeprom, the dirty span is the part of the page that
+ * has changed since it was read, dirtyTo is zero when the page is clean.
+ */
+struct At24CachedPage {
+    uint16_t page;
+    uint8_t dirtyFrom;
+    uint8_t dirtyTo;
+    bool valid;
+};
+
 /**
  * An implementation of eeprom that works with the very well known At24CXXX chips over i2c. Before
  * using this class you must first initialise the Wire library by calling Wire.begin(); If you
@@ -58,21 +123,50 @@ uint8_t at24PageFromRomSize(At24EepromType size);
  *
  * Thanks to https://github.com/cyberp/AT24Cx for some of the ideas I've used in this library,
  * although this is implemented differently.
+ *
+ * Optionally, a write back page cache can be enabled with enablePageCache, after which reads are served from RAM and
+ * writes only change the cached page and mark it dirty. Each dirty page is then written once, as page writes of only
+ * the part that changed, when flushCache is called, when the page has to make room for another, or after the writes
+ * have been idle for a while. This turns saving a block of scattered values from a write cycle per byte into one per
+ * page. Should writing out a page to make room fail, that page stays cached with its changes, and the access that
+ * needed the room goes directly to the device instead.
+ *
+ * With the cache enabled, asynchronous writes can also be turned on by enableAsyncWrites. Flushes then return straight
+ * away, and task manager writes one page at a time, waiting for the device to finish each write cycle by probing it
+ * with ioaWireReady on a schedule rather than spinning on the bus, so switches and displays keep running during a save.
  */
 
-class I2cAt24Eeprom : public EepromAbstraction {
+class I2cAt24Eeprom : public EepromAbstraction, public Executable {
 	WireType wireImpl;
 	uint8_t  eepromAddr;
 	bool     errorOccurred;
 	uint8_t  pageSize;
     size_t   eepromSize;
+    bool     scheduledTransfers;
+    At24ScheduledTransfer pendingTransfer;
+    At24AsyncFlushTask asyncFlushTask;
+    At24CachedPage* cachePages;
+    uint8_t* cacheData;
+    uint32_t idleFlushMillis;
+    unsigned long lastCacheWrite;
+    uint8_t  cachePageCount;
+    EepromFlushCompleteFn flushCompleteFn;
+    uint8_t  nextEviction;
+    uint8_t  asyncProbes;
+    uint8_t  scheduledSlot;
+    uint8_t  scheduledFrom;
+    uint8_t  scheduledTo;
+    uint16_t scheduledPage;
+    bool     flushScheduled;
+    bool     asyncWrites;
+    bool     asyncFlushing;
 public:
 	/**
 	 * Create an I2C EEPROM object giving it's address and the page size of the device.
 	 * Page sizes are defined in this header file.
 	 */
     I2cAt24Eeprom(uint8_t address, At24EepromType ty, WireType wireImpl = defaultWireTypePtr);
-	~I2cAt24Eeprom() override = default;
+	~I2cAt24Eeprom() override;
 
 	/** 
 	 * This indicates if an I2C error has ocrrued at any point since the last call to error.
@@ -80,6 +174,61 @@ public:
 	 */
 	bool hasErrorOccurred() override;
 
+	/**
+	 * Turns scheduled transfers on or off, they apply to asynchronous flushes, see enableAsyncWrites. When on, each
+	 * page write of the flush is submitted to `i2cTransactionScheduler` at bulk priority, and the wait while the page
+	 * is written is done by submitting it again from its completion callback rather than by probing the device. Other
+	 * reads and writes, and flushes that are not asynchronous, use the bus directly as they return their outcome.
+	 * Only where IOA_I2C_ASYNC_TRANSFERS is defined is the bus itself used asynchronously, with the
+	 * IOA_I2C_BLOCKING_FALLBACK each page write still blocks task manager while it is on the bus.
+	 * @param scheduled true to submit asynchronous flush writes to the transaction queue
+	 */
+	void setScheduledTransfers(bool scheduled) { scheduledTransfers = scheduled; }
+
+    /**
+     * Enables the write back page cache, holding the given number of pages in RAM, each the page size of the device.
+     * Once enabled, writes are not on the device until they are flushed, so call flushCache before power could be
+     * lost, for example after saving settings, or give an idle flush time so that task manager flushes them.
+     * @param pages the number of pages to hold, the RAM used is this times the page size
+     * @param idleMillis if not zero, dirty pages are flushed from task manager once no write has been made for this long
+     * @return true if the cache was enabled, false if it was already enabled
+     */
+    bool enablePageCache(uint8_t pages, uint32_t idleMillis = 0);
+
+    /**
+     * Writes every dirty page in the cache to the device, each as page writes of only the span that changed.
+     */
+    void flushCache();
+
+    /** @return true if the cache holds changes that are not yet written to the device */
+    bool isCacheDirty() const;
+
+    /**
+     * Turns on asynchronous writes, which requires the page cache. From then on flushCache, and the idle flush, only
+     * start the flush and return, task manager then writes each page once the device is ready, and the callback is
+     * called when all are written. Reads and writes can still be made during the flush, they use the cache, but a
+     * read of a page that is not cached waits for the current write cycle to finish.
+     * @param completeFn called when each flush completes, or nullptr for none
+     * @return true if enabled, false if the page cache is not enabled
+     */
+    bool enableAsyncWrites(EepromFlushCompleteFn completeFn);
+
+    /** @return true while an asynchronous flush is writing pages */
+    bool isFlushInProgress() const { return asyncFlushing; }
+
+    /** Called by task manager to flush the cache once the writes have been idle, see enablePageCache */
+    void exec() override;
+
+    /**
+     * internal method not for external use, called by task manager to write the next page of an asynchronous flush.
+     */
+    void asyncFlushStep();
+
+    /**
+     * internal method not for external use, called when the scheduled write of an asynchronous flush has completed.
+     */
+    void scheduledWriteComplete(bool success);
+
 	uint8_t read8(EepromPosition position) override;
 	void write8(EepromPosition position, uint8_t val) override;
 
@@ -91,11 +240,29 @@ public:
 
 	void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override;
 	void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override;
+
+    /**
+     * Reads a block of any length, without the cache this is one sequential read per wire buffer, as reads are not
+     * limited to a page.
+     */
+	void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override;
+	void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) override;
+protected:
+    /**
+     * Writes a block to the device as page writes, setting the error flag on failure. It is virtual so that a test can
+     * stand in for a device that fails its writes.
+     */
+    virtual void romWrite(EepromPosition romDest, const uint8_t* memSrc, size_t len);
 private:
 	uint8_t findMaximumInPage(uint16_t romDest, uint8_t len) const;
+    int cacheSlotFor(EepromPosition position);
+    bool flushSlot(uint8_t slot);
+    uint8_t findMaximumForRead(EepromPosition romSrc, size_t len) const;
+    void romRead(uint8_t* memDest, EepromPosition romSrc, size_t len);
 	void writeByte(EepromPosition position, uint8_t val);
 	uint8_t readByte(EepromPosition position);
     void writeAddressWire(uint16_t memAddr, const uint8_t* data = nullptr, int len = 0);
+    uint8_t buildAddress(EepromPosition memAddr, uint8_t* ch, uint8_t& actualAddr) const;
 };
 
 #endif /* IOABSTRACTION_EEPROMABSTRACTIONWIRE_H_ */
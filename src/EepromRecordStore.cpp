@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "EepromRecordStore.h"
+#include "IoLogging.h"
+
+// the layout of a record in its slot, the CRC follows the data.
+#define RECORD_SEQUENCE_POS 0
+#define RECORD_KEY_POS 4
+#define RECORD_LENGTH_POS 5
+#define RECORD_DATA_POS 6
+
+EepromRecordStore::EepromRecordStore(EepromAbstraction* rom, EepromPosition regionStart, uint16_t slotCount, uint8_t maxDataLen)
+        : rom(rom), index{}, lastSequence(0), regionStart(regionStart), slotCount(slotCount), head(0),
+          slotSize(uint8_t(EEPROM_RECORD_OVERHEAD + (maxDataLen > EEPROM_RECORD_MAX_DATA ? EEPROM_RECORD_MAX_DATA : maxDataLen))),
+          keyCount(0) {
+}
+
+bool EepromRecordStore::readSlot(uint16_t slot, uint8_t* buffer, uint32_t& sequence) {
+    rom->readBlock(buffer, slotPosition(slot), slotSize);
+    uint8_t len = buffer[RECORD_LENGTH_POS];
+    if(len > (slotSize - EEPROM_RECORD_OVERHEAD) || buffer[RECORD_KEY_POS] == 0xff) return false;
+
+    uint16_t crc = buffer[RECORD_DATA_POS + len] | (uint16_t(buffer[RECORD_DATA_POS + len + 1]) << 8U);
+    if(eepromCrc16(buffer, RECORD_DATA_POS + len) != crc) return false;
+
+    sequence = buffer[0] | (uint32_t(buffer[1]) << 8U) | (uint32_t(buffer[2]) << 16U) | (uint32_t(buffer[3]) << 24U);
+    return true;
+}
+
+bool EepromRecordStore::begin() {
+    keyCount = 0;
+    lastSequence = 0;
+    head = 0;
+    uint32_t keySequences[EEPROM_RECORD_MAX_KEYS];
+    uint8_t buffer[EEPROM_RECORD_OVERHEAD + EEPROM_RECORD_MAX_DATA];
+
+    for(uint16_t slot = 0; slot < slotCount; slot++) {
+        uint32_t sequence;
+        if(!readSlot(slot, buffer, sequence)) continue;
+
+        uint8_t key = buffer[RECORD_KEY_POS];
+        uint8_t i = 0;
+        while(i < keyCount && index[i].key != key) i++;
+        if(i == keyCount) {
+            if(keyCount == EEPROM_RECORD_MAX_KEYS) {
+                serlogF2(SER_WARNING, "Record index full, key ", key);
+                continue;
+            }
+            keyCount++;
+            index[i].key = key;
+            keySequences[i] = 0;
+        }
+        if(sequence >= keySequences[i]) {
+            keySequences[i] = sequence;
+            index[i].slot = slot;
+        }
+        if(sequence > lastSequence) {
+            lastSequence = sequence;
+            head = (slot + 1) % slotCount;
+        }
+    }
+
+    serlogF3(SER_IOA_INFO, "Record store keys, seq ", keyCount, lastSequence);
+    return !rom->hasErrorOccurred();
+}
+
+const EepromRecordIndex* EepromRecordStore::findKey(uint8_t key) const {
+    for(uint8_t i = 0; i < keyCount; i++) {
+        if(index[i].key == key) return &index[i];
+    }
+    return nullptr;
+}
+
+bool EepromRecordStore::isLive(uint16_t slot) const {
+    for(uint8_t i = 0; i < keyCount; i++) {
+        if(index[i].slot == slot) return true;
+    }
+    return false;
+}
+
+bool EepromRecordStore::read(uint8_t key, void* data, uint8_t len) {
+    auto entry = findKey(key);
+    if(entry == nullptr) return false;
+
+    uint8_t buffer[EEPROM_RECORD_OVERHEAD + EEPROM_RECORD_MAX_DATA];
+    uint32_t sequence;
+    if(!readSlot(entry->slot, buffer, sequence)) {
+        serlogF2(SER_WARNING, "Record failed check, key ", key);
+        return false;
+    }
+    uint8_t stored = buffer[RECORD_LENGTH_POS];
+    memcpy(data, &buffer[RECORD_DATA_POS], stored < len ? stored : len);
+    return true;
+}
+
+bool EepromRecordStore::write(uint8_t key, const void* data, uint8_t len) {
+    if(len > (slotSize - EEPROM_RECORD_OVERHEAD) || key == 0xff) {
+        serlogF2(SER_WARNING, "Record too long, key ", key);
+        return false;
+    }
+
+    uint8_t buffer[EEPROM_RECORD_OVERHEAD + EEPROM_RECORD_MAX_DATA];
+    auto entry = const_cast<EepromRecordIndex*>(findKey(key));
+    if(entry != nullptr) {
+        uint32_t sequence;
+        if(readSlot(entry->slot, buffer, sequence) && buffer[RECORD_LENGTH_POS] == len &&
+                memcmp(&buffer[RECORD_DATA_POS], data, len) == 0) {
+            return true; // unchanged, so save the write
+        }
+    } else if(keyCount == EEPROM_RECORD_MAX_KEYS) {
+        serlogF2(SER_WARNING, "Record index full, key ", key);
+        return false;
+    }
+
+    // step over the latest record of every key, the old record of this key is only superseded once this one is written.
+    uint16_t slot = head;
+    uint16_t tries = 0;
+    while(isLive(slot) && tries < slotCount) {
+        slot = (slot + 1) % slotCount;
+        tries++;
+    }
+    if(tries == slotCount) {
+        serlogF(SER_ERROR, "Record store has no free slot");
+        return false;
+    }
+
+    uint32_t sequence = lastSequence + 1;
+    buffer[RECORD_SEQUENCE_POS] = uint8_t(sequence);
+    buffer[RECORD_SEQUENCE_POS + 1] = uint8_t(sequence >> 8U);
+    buffer[RECORD_SEQUENCE_POS + 2] = uint8_t(sequence >> 16U);
+    buffer[RECORD_SEQUENCE_POS + 3] = uint8_t(sequence >> 24U);
+    buffer[RECORD_KEY_POS] = key;
+    buffer[RECORD_LENGTH_POS] = len;
+    memcpy(&buffer[RECORD_DATA_POS], data, len);
+    uint16_t crc = eepromCrc16(buffer, RECORD_DATA_POS + len);
+    buffer[RECORD_DATA_POS + len] = uint8_t(crc);
+    buffer[RECORD_DATA_POS + len + 1] = uint8_t(crc >> 8U);
+    rom->writeBlock(slotPosition(slot), buffer, RECORD_DATA_POS + len + 2);
+    if(rom->hasErrorOccurred()) return false;
+
+    lastSequence = sequence;
+    head = (slot + 1) % slotCount;
+    if(entry == nullptr) {
+        entry = &index[keyCount++];
+        entry->key = key;
+    }
+    entry->slot = slot;
+    return true;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_EEPROMRECORDSTORE_H
+#define IOABSTRACTION_EEPROMRECORDSTORE_H
+
+/**
+ * @file EepromRecordStore.h
+ * @brief A wear levelling store of small keyed records, appended round robin across a region of any EEPROM.
+ */
+
+#include "PlatformDetermination.h"
+#include "EepromAbstraction.h"
+
+// START user adjustable section
+
+/**
+ * The number of distinct keys that a record store can index, each takes a few bytes of RAM.
+ */
+#ifndef EEPROM_RECORD_MAX_KEYS
+#define EEPROM_RECORD_MAX_KEYS 8
+#endif
+
+/**
+ * The largest data length of a record, each slot in the region is this plus the record overhead.
+ */
+#ifndef EEPROM_RECORD_MAX_DATA
+#define EEPROM_RECORD_MAX_DATA 16
+#endif
+
+// END user adjustable section
+
+/**
+ * The bytes each record takes on top of its data, a 32 bit sequence number, the key, the length and a CRC-16.
+ */
+#define EEPROM_RECORD_OVERHEAD 8
+
+/**
+ * The RAM index entry for one key, the slot that holds its latest record.
+ */
+struct EepromRecordIndex {
+    uint16_t slot;
+    uint8_t key;
+};
+
+/**
+ * Stores small keyed values, such as counters and last states, in a reserved region of any EepromAbstraction without
+ * writing the same bytes every time. The region is divided into equal slots, and each write of a value appends a new
+ * record in the next slot round the region, with a sequence number and a CRC, so that the writes are spread evenly
+ * across the whole region rather than wearing out one location.
+ *
+ * At start up, call begin to scan the region once in sequence, which builds an index in RAM of the slot holding the
+ * latest record of each key, records that fail the CRC, such as one being written at power loss, are ignored so the
+ * previous value is used. Reads are then served by one block read of the indexed slot.
+ *
+ * Older records of a key are simply overwritten when the writes come round to them again. The latest record of each
+ * key is never overwritten, the next write steps over it, so a value that rarely changes stays where it is, and the
+ * region never needs a separate compaction pass. The region must therefore have more slots than keys, ideally many
+ * more as that is what spreads the wear. Writing a value that is unchanged does not write anything at all.
+ *
+ * On boards where EEPROM is emulated in flash, such as ESP32, commit the EEPROM as usual after writing.
+ */
+class EepromRecordStore {
+private:
+    EepromAbstraction* rom;
+    EepromRecordIndex index[EEPROM_RECORD_MAX_KEYS];
+    uint32_t lastSequence;
+    EepromPosition regionStart;
+    uint16_t slotCount;
+    uint16_t head;
+    uint8_t slotSize;
+    uint8_t keyCount;
+public:
+    /**
+     * Create a record store over a region of an eeprom, the region takes slotCount * (maxDataLen + 8) bytes.
+     * @param rom the eeprom that holds the region
+     * @param regionStart the first position of the region
+     * @param slotCount the number of records the region holds, must be more than the number of keys
+     * @param maxDataLen the largest data length of a record, at most EEPROM_RECORD_MAX_DATA
+     */
+    EepromRecordStore(EepromAbstraction* rom, EepromPosition regionStart, uint16_t slotCount, uint8_t maxDataLen = 4);
+
+    /**
+     * Scans the region once in sequence, building the index of the latest record of each key, call before any other
+     * method and after the eeprom is ready for use.
+     * @return true if the scan completed without an error from the eeprom
+     */
+    bool begin();
+
+    /**
+     * Writes a value for a key by appending a new record, unless the value is unchanged.
+     * @param key the key, any value other than 0xff
+     * @param data the value to store
+     * @param len the length of the value, at most the maximum data length
+     * @return true if stored, false if it is too long, all the keys are in use, or the eeprom reported an error
+     */
+    bool write(uint8_t key, const void* data, uint8_t len);
+
+    /**
+     * Reads the latest value of a key.
+     * @param key the key to read
+     * @param data where the value is copied to
+     * @param len the size of data, a shorter stored value only fills that many bytes
+     * @return true if the key has a value, otherwise false and data is unchanged
+     */
+    bool read(uint8_t key, void* data, uint8_t len);
+
+    /** Convenience to store a 32 bit value for a key, see write */
+    bool writeUint32(uint8_t key, uint32_t value) { return write(key, &value, sizeof value); }
+
+    /**
+     * Convenience to read a 32 bit value for a key
+     * @param key the key to read
+     * @param defaultValue returned when the key has no value
+     * @return the value or the default
+     */
+    uint32_t readUint32(uint8_t key, uint32_t defaultValue = 0) {
+        uint32_t value = defaultValue;
+        read(key, &value, sizeof value);
+        return value;
+    }
+
+    /** @return true if the key has a value */
+    bool hasKey(uint8_t key) const { return findKey(key) != nullptr; }
+
+    /** @return the sequence number of the latest record written, which is also the number of writes made */
+    uint32_t getLastSequence() const { return lastSequence; }
+
+    /** @return the slot that the next record will be written to if it is free */
+    uint16_t getHeadSlot() const { return head; }
+
+    /** @return the number of keys in the index */
+    uint8_t getKeyCount() const { return keyCount; }
+private:
+    const EepromRecordIndex* findKey(uint8_t key) const;
+    bool isLive(uint16_t slot) const;
+    EepromPosition slotPosition(uint16_t slot) const { return regionStart + (slot * slotSize); }
+    bool readSlot(uint16_t slot, uint8_t* buffer, uint32_t& sequence);
+};
+
+#endif //IOABSTRACTION_EEPROMRECORDSTORE_H
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "EepromSettingsBlob.h"
+#include "IoLogging.h"
+
+EepromSettingsBlob::EepromSettingsBlob(EepromAbstraction* rom, EepromPosition romStart, uint16_t size, uint16_t version)
+        : rom(rom), romStart(romStart), dataSize(size), version(version), loaded(false), valid(false), headerDirty(false) {
+    data = new uint8_t[size];
+    dirtyBits = new uint8_t[(size + 7) / 8];
+}
+
+EepromSettingsBlob::~EepromSettingsBlob() {
+    delete[] data;
+    delete[] dirtyBits;
+}
+
+uint16_t EepromSettingsBlob::calculateCrc() const {
+    uint8_t versionBytes[2] = { uint8_t(version), uint8_t(version >> 8U) };
+    return eepromCrc16(data, dataSize, eepromCrc16(versionBytes, sizeof versionBytes));
+}
+
+bool EepromSettingsBlob::load() {
+    loaded = true;
+    memset(dirtyBits, 0, (dataSize + 7) / 8);
+    headerDirty = false;
+
+    uint8_t header[EEPROM_SETTINGS_HEADER_SIZE];
+    rom->readBlock(header, romStart, sizeof header);
+    rom->readBlock(data, romStart + EEPROM_SETTINGS_HEADER_SIZE, dataSize);
+    uint16_t storedVersion = header[0] | (uint16_t(header[1]) << 8U);
+    uint16_t storedCrc = header[2] | (uint16_t(header[3]) << 8U);
+
+    valid = !rom->hasErrorOccurred() && storedVersion == version && storedCrc == calculateCrc();
+    if(!valid) {
+        serlogF3(SER_WARNING, "Settings invalid, version ", storedVersion, version);
+        // start from zero, and make sure the first save writes everything along with the new header.
+        memset(data, 0, dataSize);
+        memset(dirtyBits, 0xff, (dataSize + 7) / 8);
+        headerDirty = true;
+    }
+    return valid;
+}
+
+bool EepromSettingsBlob::save() {
+    ensureLoaded();
+    if(!headerDirty) return true;
+
+    // write each contiguous run of changed bytes, then the header that covers them.
+    uint16_t pos = 0;
+    while(pos < dataSize) {
+        if(!isDirtyByte(pos)) {
+            pos++;
+            continue;
+        }
+        uint16_t runStart = pos;
+        while(pos < dataSize && isDirtyByte(pos)) pos++;
+        rom->writeBlock(romStart + EEPROM_SETTINGS_HEADER_SIZE + runStart, &data[runStart], pos - runStart);
+    }
+
+    uint16_t crc = calculateCrc();
+    uint8_t header[EEPROM_SETTINGS_HEADER_SIZE] = { uint8_t(version), uint8_t(version >> 8U), uint8_t(crc), uint8_t(crc >> 8U) };
+    rom->writeBlock(romStart, header, sizeof header);
+
+    if(rom->hasErrorOccurred()) {
+        serlogF(SER_ERROR, "Settings save failed");
+        return false;
+    }
+    memset(dirtyBits, 0, (dataSize + 7) / 8);
+    headerDirty = false;
+    valid = true;
+    return true;
+}
+
+bool EepromSettingsBlob::inBounds(uint16_t offset, uint16_t len) const {
+    if(uint32_t(offset) + len > dataSize) {
+        serlogF2(SER_WARNING, "Settings field out of range ", offset);
+        return false;
+    }
+    return true;
+}
+
+void EepromSettingsBlob::getArray(uint16_t offset, uint8_t* dest, uint16_t len) {
+    ensureLoaded();
+    if(!inBounds(offset, len)) return;
+    memcpy(dest, &data[offset], len);
+}
+
+uint8_t EepromSettingsBlob::get8(uint16_t offset) {
+    uint8_t value = 0;
+    getArray(offset, &value, 1);
+    return value;
+}
+
+uint16_t EepromSettingsBlob::get16(uint16_t offset) {
+    uint8_t bytes[2] = {};
+    getArray(offset, bytes, sizeof bytes);
+    return bytes[0] | (uint16_t(bytes[1]) << 8U);
+}
+
+uint32_t EepromSettingsBlob::get32(uint16_t offset) {
+    uint8_t bytes[4] = {};
+    getArray(offset, bytes, sizeof bytes);
+    return bytes[0] | (uint32_t(bytes[1]) << 8U) | (uint32_t(bytes[2]) << 16U) | (uint32_t(bytes[3]) << 24U);
+}
+
+void EepromSettingsBlob::set16(uint16_t offset, uint16_t value) {
+    uint8_t bytes[2] = { uint8_t(value), uint8_t(value >> 8U) };
+    setArray(offset, bytes, sizeof bytes);
+}
+
+void EepromSettingsBlob::set32(uint16_t offset, uint32_t value) {
+    uint8_t bytes[4] = { uint8_t(value), uint8_t(value >> 8U), uint8_t(value >> 16U), uint8_t(value >> 24U) };
+    setArray(offset, bytes, sizeof bytes);
+}
+
+void EepromSettingsBlob::setArray(uint16_t offset, const uint8_t* src, uint16_t len) {
+    ensureLoaded();
+    if(!inBounds(offset, len)) return;
+    for(uint16_t i = 0; i < len; i++) {
+        uint16_t pos = offset + i;
+        if(data[pos] == src[i]) continue;
+        data[pos] = src[i];
+        dirtyBits[pos >> 3U] |= (1U << (pos & 7U));
+        headerDirty = true;
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_EEPROMSETTINGSBLOB_H
+#define IOABSTRACTION_EEPROMSETTINGSBLOB_H
+
+/**
+ * @file EepromSettingsBlob.h
+ * @brief A fixed layout block of settings that is loaded from EEPROM in one read, checked by one CRC, and then served
+ * from RAM, writing back only the fields that changed.
+ */
+
+#include "PlatformDetermination.h"
+#include "EepromAbstraction.h"
+
+/**
+ * The bytes in EEPROM before the settings, a 16 bit version followed by a CRC-16 of the version and the settings.
+ */
+#define EEPROM_SETTINGS_HEADER_SIZE 4
+
+/**
+ * Holds a fixed layout block of settings in RAM, so that rather than many individual read8, read16 and read32 calls at
+ * start up, each of which is a bus transaction on external EEPROM, the whole block is loaded with one block read and
+ * checked with one CRC. The fields are then read and changed in RAM through the typed accessors, each addressed by its
+ * offset within the block.
+ *
+ * The block is loaded lazily on the first access, or explicitly by calling load. When the version stored does not
+ * match, or the CRC fails, for example on first use or after the layout changed, the settings start as all zero, and
+ * isValid returns false so that defaults can be applied.
+ *
+ * Changes are only in RAM until save is called, which writes back only the bytes that changed, as contiguous runs,
+ * and then the header. On I2cAt24Eeprom enable the page cache to have these combined into one write per page.
+ */
+class EepromSettingsBlob {
+private:
+    EepromAbstraction* rom;
+    uint8_t* data;
+    uint8_t* dirtyBits;
+    EepromPosition romStart;
+    uint16_t dataSize;
+    uint16_t version;
+    bool loaded;
+    bool valid;
+    bool headerDirty;
+public:
+    /**
+     * Create a settings block at a position in an eeprom, the RAM for it is allocated once here.
+     * @param rom the eeprom holding the block
+     * @param romStart the position of the block, it takes size plus EEPROM_SETTINGS_HEADER_SIZE bytes
+     * @param size the size of the settings
+     * @param version the layout version, change it when the layout changes so older data is not used
+     */
+    EepromSettingsBlob(EepromAbstraction* rom, EepromPosition romStart, uint16_t size, uint16_t version);
+    ~EepromSettingsBlob();
+
+    /**
+     * Loads the settings with a single block read and checks the version and CRC, this is also done on first access.
+     * @return true if the stored settings were valid, otherwise they are all zero
+     */
+    bool load();
+
+    /**
+     * Writes back only the bytes changed since the last load or save, followed by the header.
+     * @return true if no error was reported by the eeprom
+     */
+    bool save();
+
+    /** @return true if the settings loaded were valid, or have since been saved */
+    bool isValid() { ensureLoaded(); return valid; }
+
+    /** @return true if there are changes that are not yet saved */
+    bool isDirty() const { return headerDirty; }
+
+    uint8_t get8(uint16_t offset);
+    uint16_t get16(uint16_t offset);
+    uint32_t get32(uint16_t offset);
+
+    /**
+     * Copies a field of any length out of the settings
+     * @param offset the offset of the field in the settings
+     * @param dest where to copy it
+     * @param len the length of the field
+     */
+    void getArray(uint16_t offset, uint8_t* dest, uint16_t len);
+
+    void set8(uint16_t offset, uint8_t value) { setArray(offset, &value, 1); }
+    void set16(uint16_t offset, uint16_t value);
+    void set32(uint16_t offset, uint32_t value);
+
+    /**
+     * Changes a field of any length in RAM, only the bytes that actually change are marked to be saved.
+     * @param offset the offset of the field in the settings
+     * @param src the new value
+     * @param len the length of the field
+     */
+    void setArray(uint16_t offset, const uint8_t* src, uint16_t len);
+
+    /** @return the size of the settings */
+    uint16_t getSize() const { return dataSize; }
+private:
+    void ensureLoaded() { if(!loaded) load(); }
+    bool inBounds(uint16_t offset, uint16_t len) const;
+    bool isDirtyByte(uint16_t offset) const { return (dirtyBits[offset >> 3U] & (1U << (offset & 7U))) != 0; }
+    uint16_t calculateCrc() const;
+};
+
+#endif //IOABSTRACTION_EEPROMSETTINGSBLOB_H
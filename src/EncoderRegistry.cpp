@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "EncoderRegistry.h"
+#include "IoLogging.h"
+
+// indexed by the previous state in the upper two bits and the new state in the lower two, each state being A:B. Gives
+// +1 or -1 for a valid quarter step, and 0 for no change or an invalid change where both pins moved.
+static const int8_t quadratureTransitionTable[16] = {
+         0, -1,  1,  0,
+         1,  0,  0, -1,
+        -1,  0,  0,  1,
+         0,  1, -1,  0
+};
+
+#define ENCODER_STATE_UNKNOWN 0xff
+
+// decode may be called from an interrupt, so task manager code that decodes or reads the counters does so with
+// interrupts masked, this stops both torn reads of the edge time and the decoder being entered twice.
+#if defined(__AVR__)
+# define ENCODER_GUARD_START uint8_t oldSreg = SREG; cli();
+# define ENCODER_GUARD_END SREG = oldSreg;
+#elif defined(BUILD_FOR_PICO_CMAKE)
+# include <hardware/sync.h>
+# define ENCODER_GUARD_START uint32_t oldIrq = save_and_disable_interrupts();
+# define ENCODER_GUARD_END restore_interrupts(oldIrq);
+#elif defined(IOA_USE_MBED)
+# define ENCODER_GUARD_START core_util_critical_section_enter();
+# define ENCODER_GUARD_END core_util_critical_section_exit();
+#else
+# define ENCODER_GUARD_START noInterrupts();
+# define ENCODER_GUARD_END interrupts();
+#endif
+
+SnapshotRotaryEncoder::SnapshotRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback,
+                                             HWAccelerationMode accelerationMode, EncoderType et)
+        : AbstractHwRotaryEncoder(callback), lastEdgeMicros(0), upCount(0), downCount(0), upDrained(0), downDrained(0),
+          lastState(ENCODER_STATE_UNKNOWN), restState(ENCODER_STATE_UNKNOWN), transitions(0) {
+    this->pinA = pinA;
+    this->pinB = pinB;
+    this->lastChange = micros();
+    this->accelerationMode = accelerationMode;
+    this->encoderType = et;
+}
+
+SnapshotRotaryEncoder::SnapshotRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderListener* listener,
+                                             HWAccelerationMode accelerationMode, EncoderType et)
+        : AbstractHwRotaryEncoder(listener), lastEdgeMicros(0), upCount(0), downCount(0), upDrained(0), downDrained(0),
+          lastState(ENCODER_STATE_UNKNOWN), restState(ENCODER_STATE_UNKNOWN), transitions(0) {
+    this->pinA = pinA;
+    this->pinB = pinB;
+    this->lastChange = micros();
+    this->accelerationMode = accelerationMode;
+    this->encoderType = et;
+}
+
+bool SnapshotRotaryEncoder::decode(bool a, bool b, unsigned long when) {
+    uint8_t state = (a ? 2 : 0) | (b ? 1 : 0);
+    if(lastState == ENCODER_STATE_UNKNOWN) {
+        lastState = restState = state;
+        return false;
+    }
+    if(state == lastState) return false;
+
+    transitions += quadratureTransitionTable[(lastState << 2U) | state];
+    lastState = state;
+
+    // a detent is counted on arriving at a rest position, needing at least half the expected steps in the same
+    // direction, so a single missed transition at speed does not lose the detent.
+    bool atDetent;
+    int8_t needed;
+    if(encoderType == QUARTER_CYCLE) {
+        atDetent = true;
+        needed = 1;
+    } else if(encoderType == HALF_CYCLE) {
+        atDetent = (state == 0 || state == 3);
+        needed = 1;
+    } else {
+        atDetent = (state == restState);
+        needed = 2;
+    }
+    if(!atDetent) return false;
+
+    bool counted = false;
+    if(transitions >= needed) {
+        upCount = upCount + 1;
+        counted = true;
+    } else if(transitions <= -needed) {
+        downCount = downCount + 1;
+        counted = true;
+    }
+    transitions = 0;
+    if(counted) lastEdgeMicros = when;
+    return counted;
+}
+
+bool SnapshotRotaryEncoder::drain() {
+    // the counters and edge time are written by decode, possibly in an interrupt, so they are copied together.
+    ENCODER_GUARD_START
+    uint8_t up = upCount;
+    uint8_t down = downCount;
+    unsigned long edgeTime = lastEdgeMicros;
+    ENCODER_GUARD_END
+    int steps = int(uint8_t(up - upDrained)) - int(uint8_t(down - downDrained));
+    upDrained = up;
+    downDrained = down;
+    if(steps == 0) return false;
+
+    // spread the time since the last change over the steps, so acceleration sees the rate they arrived at.
+    unsigned int count = abs(steps);
+    unsigned long perStep = (edgeTime - lastChange) / count;
+    unsigned long when = lastChange;
+    for(unsigned int i = 0; i < count; i++) {
+        when += perStep;
+        handleChangeRaw(steps > 0, when);
+    }
+    return true;
+}
+
+RotaryEncoderRegistry::RotaryEncoderRegistry(IoAbstractionRef device, uint8_t initialCapacity)
+        : device(device), encoders(nullptr), pollMicros(0), encoderCount(0), capacity(0), deviceReadNeeded(false),
+          inExec(false), started(false) {
+    if(initialCapacity != 0) {
+        encoders = new SnapshotRotaryEncoder*[initialCapacity];
+        capacity = (encoders != nullptr) ? initialCapacity : 0;
+    }
+}
+
+RotaryEncoderRegistry::~RotaryEncoderRegistry() {
+    delete[] encoders;
+}
+
+bool RotaryEncoderRegistry::addEncoder(SnapshotRotaryEncoder* encoder) {
+    if(encoderCount == capacity) {
+        if(capacity == 0xff) return false;
+        uint8_t newCapacity = (capacity < 0x80) ? (capacity == 0 ? 4 : capacity * 2) : 0xff;
+        auto replacement = new SnapshotRotaryEncoder*[newCapacity];
+        if(replacement == nullptr) {
+            serlogF(SER_ERROR, "Encoder registry full");
+            return false;
+        }
+        for(uint8_t i = 0; i < encoderCount; i++) replacement[i] = encoders[i];
+        delete[] encoders;
+        encoders = replacement;
+        capacity = newCapacity;
+    }
+
+    // kept in order of lowest pin, so that the encoders sharing a window of pins are next to each other.
+    uint8_t pos = encoderCount;
+    while(pos > 0 && encoders[pos - 1]->getLowestPin() > encoder->getLowestPin()) {
+        encoders[pos] = encoders[pos - 1];
+        pos--;
+    }
+    encoders[pos] = encoder;
+    encoderCount++;
+
+    device->pinMode(encoder->getPinA(), INPUT_PULLUP);
+    device->pinMode(encoder->getPinB(), INPUT_PULLUP);
+    return true;
+}
+
+void RotaryEncoderRegistry::start(uint32_t pollInterval) {
+    pollMicros = pollInterval;
+    if(!started) {
+        started = true;
+        taskManager.registerEvent(this);
+    }
+}
+
+void RotaryEncoderRegistry::decodeSnapshot(pinid_t startPin, IoPinMask snapshot) {
+    unsigned long now = micros();
+    bool counted = false;
+    for(uint8_t i = 0; i < encoderCount; i++) {
+        auto enc = encoders[i];
+        if(enc->getLowestPin() >= (startPin + 32)) break;
+        if(enc->getLowestPin() < startPin || enc->getHighestPin() >= (startPin + 32)) continue;
+        counted |= enc->decode((snapshot >> (enc->getPinA() - startPin)) & 1U, (snapshot >> (enc->getPinB() - startPin)) & 1U, now);
+    }
+    if(counted && !inExec) markTriggeredAndNotify();
+}
+
+bool RotaryEncoderRegistry::sampleDevice() {
+    bool ok = device->sync();
+
+    // each window starts at the lowest pin of the first encoder that did not fit in the one before. Should an encoder
+    // that fits in a window follow one that does not, it is decoded again in the next window, which is harmless as
+    // an unchanged state is ignored.
+    uint8_t i = 0;
+    while(i < encoderCount) {
+        pinid_t start = encoders[i]->getLowestPin();
+        if(encoders[i]->getHighestPin() >= (start + 32)) {
+            // an encoder with its pins more than 32 apart cannot be decoded from a snapshot.
+            serlogF2(SER_WARNING, "Encoder pins too far apart ", start);
+            i++;
+            continue;
+        }
+
+        IoPinMask mask = 0;
+        uint8_t next = encoderCount;
+        for(uint8_t j = i; j < encoderCount; j++) {
+            auto enc = encoders[j];
+            if(enc->getLowestPin() >= (start + 32)) {
+                if(next == encoderCount) next = j;
+                break;
+            }
+            if(enc->getHighestPin() < (start + 32)) {
+                mask |= (IoPinMask(1) << (enc->getPinA() - start)) | (IoPinMask(1) << (enc->getPinB() - start));
+            } else if(next == encoderCount) {
+                next = j;
+            }
+        }
+        IoPinMask snapshot = device->readPinMask(start, mask);
+        {
+            // an interrupt may also be decoding these encoders, so it must not run part way through.
+            ENCODER_GUARD_START
+            decodeSnapshot(start, snapshot);
+            ENCODER_GUARD_END
+        }
+        i = next;
+    }
+    return ok;
+}
+
+uint32_t RotaryEncoderRegistry::timeOfNextCheck() {
+    if(pollMicros != 0) {
+        setTriggered(true);
+        return pollMicros;
+    }
+    return secondsToMicros(1);
+}
+
+void RotaryEncoderRegistry::exec() {
+    inExec = true;
+    if(pollMicros != 0 || deviceReadNeeded) {
+        deviceReadNeeded = false;
+        sampleDevice();
+    }
+    for(uint8_t i = 0; i < encoderCount; i++) {
+        encoders[i]->drain();
+    }
+    inExec = false;
+}
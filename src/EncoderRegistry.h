@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_ENCODERREGISTRY_H
+#define IOABSTRACTION_ENCODERREGISTRY_H
+
+/**
+ * @file EncoderRegistry.h
+ * @brief A registry for any number of rotary encoders on one IoAbstraction, that decodes every encoder from a single
+ * snapshot of the pins, such as the captured port state of an MCP23017, and hands the steps to task manager.
+ */
+
+#include "PlatformDetermination.h"
+#include "SwitchInput.h"
+
+/**
+ * A rotary encoder decoded from snapshots of its two pins by a RotaryEncoderRegistry, rather than by reading the pins
+ * itself. Each snapshot is run through a transition table, and the detents counted are accumulated into counters
+ * that are only ever written by the decoder, then drained on task manager where the value is changed and the callback
+ * run. This means decoding can safely happen in an interrupt, and no step is lost if task manager is late.
+ *
+ * The direction is A leading B for an increase, swap the pins to reverse it. For FULL_CYCLE encoders the detent is
+ * taken to be the position seen in the first snapshot.
+ */
+class SnapshotRotaryEncoder : public AbstractHwRotaryEncoder {
+private:
+    volatile unsigned long lastEdgeMicros;
+    volatile uint8_t upCount;
+    volatile uint8_t downCount;
+    uint8_t upDrained;
+    uint8_t downDrained;
+    uint8_t lastState;
+    uint8_t restState;
+    int8_t transitions;
+public:
+    /**
+     * Create a snapshot decoded encoder, add it to a RotaryEncoderRegistry to use it.
+     * @param pinA the A pin of the encoder on the registry's device
+     * @param pinB the B pin of the encoder on the registry's device
+     * @param callback the function to call when the encoder changes
+     * @param accelerationMode the amount of acceleration to use
+     * @param et the type of encoder, which determines the steps per detent
+     */
+    SnapshotRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback, HWAccelerationMode accelerationMode = HWACCEL_REGULAR, EncoderType et = FULL_CYCLE);
+
+    /**
+     * Create a snapshot decoded encoder that notifies a listener, add it to a RotaryEncoderRegistry to use it.
+     * @param pinA the A pin of the encoder on the registry's device
+     * @param pinB the B pin of the encoder on the registry's device
+     * @param listener the listener to notify when the encoder changes
+     * @param accelerationMode the amount of acceleration to use
+     * @param et the type of encoder, which determines the steps per detent
+     */
+    SnapshotRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderListener* listener, HWAccelerationMode accelerationMode = HWACCEL_REGULAR, EncoderType et = FULL_CYCLE);
+
+    pinid_t getPinA() const { return pinA; }
+    pinid_t getPinB() const { return pinB; }
+    pinid_t getLowestPin() const { return min(pinA, pinB); }
+    pinid_t getHighestPin() const { return max(pinA, pinB); }
+
+    /**
+     * Decode a new state of the pins, safe to call from an interrupt, called by the registry. It is not reentrant, so
+     * when it is called from task manager code, interrupts must be masked around it, as sampleDevice does.
+     * @param a the level of pin A
+     * @param b the level of pin B
+     * @param when the time of the snapshot in micros
+     * @return true if a detent was counted
+     */
+    bool decode(bool a, bool b, unsigned long when);
+
+    /**
+     * Apply the detents counted since the last drain to the value and notify, called on task manager by the registry.
+     * @return true if anything was applied
+     */
+    bool drain();
+
+    /** @return the number of detents counted that are not yet drained, positive for up */
+    int getPendingSteps() const { return int(uint8_t(upCount - upDrained)) - int(uint8_t(downCount - downDrained)); }
+};
+
+/**
+ * Manages any number of SnapshotRotaryEncoder objects on one device, there is no compile time limit on how many can
+ * be added. Every encoder within a 32 pin window is decoded from the same snapshot, so a port is read once for all of
+ * its encoders rather than once per pin.
+ *
+ * Snapshots can come from three places:
+ * * Call `decodeSnapshot` from your own interrupt handler with a latched port value, for example read directly from
+ *   the GPIO registers, this is safe within an interrupt.
+ * * Call `interruptTriggered` from an interrupt handler, for example the one for an MCP23017 INTA line, the device is
+ *   then synced and read on task manager. With MCP23017IoAbstraction and interrupt gated reads, the state captured
+ *   in INTCAP at the time of the interrupt is used.
+ * * Give a poll interval to `start`, the device is synced and read on each poll.
+ *
+ * The registry is a task manager event, the counted steps are drained and callbacks run on task manager. Add all the
+ * encoders before any snapshots arrive from an interrupt, as adding one may move the list.
+ */
+class RotaryEncoderRegistry : public BaseEvent {
+private:
+    IoAbstractionRef device;
+    SnapshotRotaryEncoder** encoders;
+    uint32_t pollMicros;
+    uint8_t encoderCount;
+    uint8_t capacity;
+    volatile bool deviceReadNeeded;
+    bool inExec;
+    bool started;
+public:
+    /**
+     * Create a registry for the encoders on a device.
+     * @param device the device that the encoders are connected to
+     * @param initialCapacity the number of encoders to allocate space for, it grows as needed
+     */
+    explicit RotaryEncoderRegistry(IoAbstractionRef device, uint8_t initialCapacity = 4);
+    ~RotaryEncoderRegistry() override;
+
+    /**
+     * Adds an encoder, its pins are set to INPUT_PULLUP on the device. The registry does not take ownership.
+     * @param encoder the encoder to add
+     * @return true if added, false if memory could not be allocated
+     */
+    bool addEncoder(SnapshotRotaryEncoder* encoder);
+
+    uint8_t getEncoderCount() const { return encoderCount; }
+    SnapshotRotaryEncoder* getEncoder(uint8_t idx) { return idx < encoderCount ? encoders[idx] : nullptr; }
+
+    /**
+     * Registers with task manager, if pollInterval is not zero, the device is synced and read at that rate,
+     * otherwise only snapshots and interrupts cause work to be done.
+     * @param pollInterval the interval between reads of the device in micros, or 0 for none
+     */
+    void start(uint32_t pollInterval = 0);
+
+    /**
+     * Decode every encoder within the 32 pins from startPin from one snapshot, safe to call from an interrupt. When
+     * snapshots also arrive from an interrupt, mask interrupts around any call made outside of one.
+     * @param startPin the pin represented by bit 0 of the snapshot
+     * @param snapshot the state of the pins
+     */
+    void decodeSnapshot(pinid_t startPin, IoPinMask snapshot);
+
+    /**
+     * Call from an interrupt handler to have the device synced and read on task manager, safe in an interrupt.
+     */
+    void interruptTriggered() {
+        deviceReadNeeded = true;
+        markTriggeredAndNotify();
+    }
+
+    /**
+     * Sync the device then read each window of pins once and decode all the encoders, call only on task manager.
+     * @return the result of the device sync
+     */
+    bool sampleDevice();
+
+    uint32_t timeOfNextCheck() override;
+    void exec() override;
+};
+
+#endif //IOABSTRACTION_ENCODERREGISTRY_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_FASTDIGITALPIN_H
+#define IOABSTRACTION_FASTDIGITALPIN_H
+
+/**
+ * @file FastDigitalPin.h
+ * @brief Output pins on the device itself that are written without going through any virtual IoAbstraction call.
+ *
+ * These are for strobe, latch, clock and chip select lines that are toggled many times per refresh. They only work
+ * for the pins of `internalDigitalDevice()`, never for pins on expanders or shift registers.
+ */
+
+#include "PlatformDetermination.h"
+#include "BasicIoAbstraction.h"
+
+#if defined(ESP32)
+#include <soc/gpio_reg.h>
+#elif defined(ARDUINO_PICO_REVISION)
+#include <hardware/gpio.h>
+#endif
+
+/**
+ * An output pin on the device that resolves the hardware access once, when `begin` is called, after which writes
+ * go straight to the port register on AVR, ESP32 and Pico, and to a cached gpio_t on mbed. On any other board it
+ * falls back to the regular `digitalWrite`. Use this when the pin number is only known at runtime, for example when
+ * it is passed into a constructor, otherwise see `FastPin`.
+ *
+ * Note that on AVR writing in this way does not turn off any PWM running on the pin, unlike digitalWrite.
+ */
+class FastOutputPin {
+private:
+    pinid_t pin;
+#if defined(__AVR__)
+    volatile uint8_t* outReg;
+    uint8_t bitMask;
+#elif defined(ESP32)
+    volatile uint32_t* setReg;
+    volatile uint32_t* clearReg;
+    uint32_t bitMask;
+#elif defined(IOA_USE_MBED)
+    mutable gpio_t gpio;
+#endif
+public:
+    FastOutputPin() : pin(IO_PIN_NOT_DEFINED) {
+#if defined(__AVR__)
+        outReg = nullptr;
+        bitMask = 0;
+#elif defined(ESP32)
+        setReg = clearReg = nullptr;
+        bitMask = 0;
+#endif
+    }
+
+    /**
+     * Sets the pin up as an output on the device and resolves the hardware access for it. Call this once the
+     * hardware is ready, normally in an abstraction's initialisation, never in a global constructor.
+     * @param newPin the device pin to be used, IO_PIN_NOT_DEFINED leaves the pin unused and writes do nothing.
+     */
+    void begin(pinid_t newPin) {
+        pin = newPin;
+        if(pin == IO_PIN_NOT_DEFINED) return;
+        internalDigitalDevice().pinMode(pin, OUTPUT);
+#if defined(__AVR__)
+        uint8_t port = digitalPinToPort(pin);
+        if(port == NOT_A_PORT) {
+            pin = IO_PIN_NOT_DEFINED;
+            return;
+        }
+        outReg = portOutputRegister(port);
+        bitMask = digitalPinToBitMask(pin);
+#elif defined(ESP32)
+        bitMask = 1UL << (pin & 31U);
+# ifdef GPIO_OUT1_W1TS_REG
+        if(pin >= 32) {
+            setReg = (volatile uint32_t*)GPIO_OUT1_W1TS_REG;
+            clearReg = (volatile uint32_t*)GPIO_OUT1_W1TC_REG;
+            return;
+        }
+# endif
+        setReg = (volatile uint32_t*)GPIO_OUT_W1TS_REG;
+        clearReg = (volatile uint32_t*)GPIO_OUT_W1TC_REG;
+#elif defined(IOA_USE_MBED)
+        gpio_init_out(&gpio, (PinName)pin);
+#endif
+    }
+
+    /**
+     * @return true if begin has been called with a usable pin
+     */
+    bool isDefined() const { return pin != IO_PIN_NOT_DEFINED; }
+
+    /**
+     * @return the device pin this object writes to.
+     */
+    pinid_t getPin() const { return pin; }
+
+    /**
+     * Writes the pin directly, does nothing if the pin is not defined.
+     * @param value HIGH or LOW
+     */
+    void write(uint8_t value) const {
+        if(pin == IO_PIN_NOT_DEFINED) return;
+#if defined(__AVR__)
+        // the port register may be shared with pins written from interrupts, so the read modify write is protected.
+        uint8_t oldSREG = SREG;
+        cli();
+        if(value) *outReg |= bitMask; else *outReg &= ~bitMask;
+        SREG = oldSREG;
+#elif defined(ESP32)
+        // the set and clear registers only change the bits written as 1, no read modify write is needed
+        if(value) *setReg = bitMask; else *clearReg = bitMask;
+#elif defined(BUILD_FOR_PICO_CMAKE) || defined(ARDUINO_PICO_REVISION)
+        gpio_put(pin, value != 0);
+#elif defined(IOA_USE_MBED)
+        gpio_write(&gpio, value);
+#else
+        ::digitalWrite(pin, value);
+#endif
+    }
+
+    void high() const { write(HIGH); }
+    void low() const { write(LOW); }
+};
+
+/**
+ * A device output pin where the pin number is known at compile time, so that each write is a single static inline
+ * function with no virtual dispatch or lookup. On ESP32 and Pico the register and mask are constants, so a write
+ * compiles down to one store. On other boards the access is resolved once in `begin` and held statically.
+ *
+ * For example, to define a latch on pin 5: `typedef FastPin<5> LatchPin;` then `LatchPin::begin();` once and
+ * `LatchPin::low();` / `LatchPin::high();` as often as needed.
+ * @tparam PIN the device pin number
+ */
+template<pinid_t PIN> class FastPin {
+private:
+    static FastOutputPin outputPin;
+public:
+    /**
+     * Sets the pin to be an output and resolves any hardware access, call once before writing.
+     */
+    static void begin() { outputPin.begin(PIN); }
+
+    /**
+     * Writes the value to the pin directly.
+     * @param value HIGH or LOW
+     */
+    static inline void write(uint8_t value) {
+#if defined(ESP32)
+# ifdef GPIO_OUT1_W1TS_REG
+        if(PIN >= 32) {
+            REG_WRITE(value ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, 1UL << (PIN & 31U));
+            return;
+        }
+# endif
+        REG_WRITE(value ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1UL << (PIN & 31U));
+#elif defined(BUILD_FOR_PICO_CMAKE) || defined(ARDUINO_PICO_REVISION)
+        gpio_put(PIN, value != 0);
+#else
+        outputPin.write(value);
+#endif
+    }
+
+    static inline void high() { write(HIGH); }
+    static inline void low() { write(LOW); }
+};
+
+template<pinid_t PIN> FastOutputPin FastPin<PIN>::outputPin;
+
+#endif //IOABSTRACTION_FASTDIGITALPIN_H
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "FilteredAnalogDevice.h"
+#include "IoLogging.h"
+
+bool FilteredAnalogDevice::addFilter(pinid_t pin, uint8_t extraBits, uint8_t medianWindow, uint8_t emaShift) {
+    if(extraBits > ANALOG_FILTER_MAX_EXTRA_BITS || medianWindow > ANALOG_FILTER_MAX_MEDIAN || emaShift > 8) {
+        serlogF2(SER_WARNING, "Filter setting out of range ", pin);
+        return false;
+    }
+
+    auto state = findFilter(pin);
+    if(state == nullptr) {
+        if(filterCount == ANALOG_FILTER_MAX_PINS) {
+            serlogF2(SER_WARNING, "Filter pool full ", pin);
+            return false;
+        }
+        state = &filters[filterCount++];
+    }
+    state->pin = pin;
+    state->extraBits = extraBits;
+    state->medianWindow = (medianWindow > 1) ? medianWindow : 0;
+    state->emaShift = emaShift;
+    resetFilter(pin);
+    return true;
+}
+
+void FilteredAnalogDevice::resetFilter(pinid_t pin) {
+    auto state = findFilter(pin);
+    if(state == nullptr) return;
+    state->medianPosition = 0;
+    state->medianFilled = 0;
+    state->emaPrimed = false;
+    state->emaAccumulator = 0;
+}
+
+AnalogFilterState* FilteredAnalogDevice::findFilter(pinid_t pin) {
+    for(uint8_t i = 0; i < filterCount; i++) {
+        if(filters[i].pin == pin) return &filters[i];
+    }
+    return nullptr;
+}
+
+int FilteredAnalogDevice::getMaximumRange(AnalogDirection direction, pinid_t pin) {
+    auto range = device->getMaximumRange(direction, pin);
+    auto state = (direction == DIR_IN) ? findFilter(pin) : nullptr;
+    return state != nullptr ? (range << state->extraBits) : range;
+}
+
+int FilteredAnalogDevice::getBitDepth(AnalogDirection direction, pinid_t pin) {
+    auto depth = device->getBitDepth(direction, pin);
+    auto state = (direction == DIR_IN) ? findFilter(pin) : nullptr;
+    return state != nullptr ? (depth + state->extraBits) : depth;
+}
+
+unsigned int FilteredAnalogDevice::oversample(pinid_t pin, uint8_t extraBits) {
+    if(extraBits == 0) return device->getCurrentValue(pin);
+
+    // read in batches of the same pin, so devices that support it convert them back to back.
+    pinid_t pins[8];
+    unsigned int values[8];
+    for(uint8_t i = 0; i < 8; i++) pins[i] = pin;
+    uint32_t total = 0;
+    uint16_t remaining = 1U << (extraBits * 2);
+    while(remaining != 0) {
+        uint8_t batch = remaining > 8 ? 8 : uint8_t(remaining);
+        device->getCurrentValues(pins, values, batch);
+        for(uint8_t i = 0; i < batch; i++) total += values[i];
+        remaining -= batch;
+    }
+    return (unsigned int)(total >> extraBits);
+}
+
+unsigned int FilteredAnalogDevice::median(AnalogFilterState& state, unsigned int reading) {
+    state.medianHistory[state.medianPosition] = reading;
+    state.medianPosition = (state.medianPosition + 1) % state.medianWindow;
+    if(state.medianFilled < state.medianWindow) state.medianFilled++;
+
+    // insertion sort of a copy, the window is at most a handful of entries.
+    unsigned int sorted[ANALOG_FILTER_MAX_MEDIAN];
+    uint8_t count = state.medianFilled;
+    for(uint8_t i = 0; i < count; i++) {
+        unsigned int value = state.medianHistory[i];
+        uint8_t pos = i;
+        while(pos > 0 && sorted[pos - 1] > value) {
+            sorted[pos] = sorted[pos - 1];
+            pos--;
+        }
+        sorted[pos] = value;
+    }
+    return sorted[count / 2];
+}
+
+unsigned int FilteredAnalogDevice::getCurrentValue(pinid_t pin) {
+    auto state = findFilter(pin);
+    if(state == nullptr) return device->getCurrentValue(pin);
+
+    unsigned int reading = oversample(pin, state->extraBits);
+    if(state->medianWindow != 0) reading = median(*state, reading);
+    if(state->emaShift != 0) {
+        // the accumulator holds the average scaled up by 2^k, so no fraction is lost between reads.
+        if(!state->emaPrimed) {
+            state->emaAccumulator = uint32_t(reading) << state->emaShift;
+            state->emaPrimed = true;
+        } else {
+            state->emaAccumulator = state->emaAccumulator - (state->emaAccumulator >> state->emaShift) + reading;
+        }
+        reading = (unsigned int)(state->emaAccumulator >> state->emaShift);
+    }
+    return reading;
+}
+
+float FilteredAnalogDevice::getCurrentFloat(pinid_t pin) {
+    if(findFilter(pin) == nullptr) return device->getCurrentFloat(pin);
+    return float(getCurrentValue(pin)) / float(getMaximumRange(DIR_IN, pin));
+}
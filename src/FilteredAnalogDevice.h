@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_FILTEREDANALOGDEVICE_H
+#define IOABSTRACTION_FILTEREDANALOGDEVICE_H
+
+/**
+ * @file FilteredAnalogDevice.h
+ * @brief An analog device that wraps another and filters the readings of chosen pins, with oversampling for extra
+ * bits, a small median to remove spikes and an exponential moving average, all in integer maths.
+ */
+
+#include "PlatformDetermination.h"
+#include "AnalogDeviceAbstraction.h"
+
+// START user adjustable section
+
+/**
+ * The number of pins that can have filters, the state for each is held in a fixed pool within the device.
+ */
+#ifndef ANALOG_FILTER_MAX_PINS
+#define ANALOG_FILTER_MAX_PINS 4
+#endif
+
+/**
+ * The largest median window, each filtered pin holds this many readings.
+ */
+#ifndef ANALOG_FILTER_MAX_MEDIAN
+#define ANALOG_FILTER_MAX_MEDIAN 5
+#endif
+
+// END user adjustable section
+
+/**
+ * The largest number of extra bits that oversampling can add, each extra bit takes four times as many conversions.
+ */
+#define ANALOG_FILTER_MAX_EXTRA_BITS 4
+
+/**
+ * The filter settings and state for one pin, held in the pool of FilteredAnalogDevice.
+ */
+struct AnalogFilterState {
+    uint32_t emaAccumulator;
+    unsigned int medianHistory[ANALOG_FILTER_MAX_MEDIAN];
+    pinid_t pin;
+    uint8_t extraBits;
+    uint8_t emaShift;
+    uint8_t medianWindow;
+    uint8_t medianPosition;
+    uint8_t medianFilled;
+    bool emaPrimed;
+};
+
+/**
+ * Wraps another analog device and filters the input readings of the pins that have a filter added, every other pin
+ * and all output is passed straight through. Each read of a filtered pin runs the filter stages in this order:
+ *
+ * * Oversample and decimate - takes 4^n readings back to back, sums them and shifts right by n, which adds n bits of
+ *   resolution when there is some noise on the signal. The bit depth and range of the pin increase to match.
+ * * Median - the median of the last few decimated readings, an odd window of 3 or 5 removes single spikes.
+ * * Exponential moving average - each reading moves the output 1/2^k of the way toward it, for smoothing.
+ *
+ * A stage is skipped when not configured. As the stages keep history, read filtered pins at a steady rate, such as
+ * from a polling task, for the median and average to be meaningful. The state lives in a fixed pool of
+ * ANALOG_FILTER_MAX_PINS entries, so nothing is allocated.
+ */
+class FilteredAnalogDevice : public AnalogDevice {
+private:
+    AnalogDevice* device;
+    AnalogFilterState filters[ANALOG_FILTER_MAX_PINS];
+    uint8_t filterCount;
+public:
+    /**
+     * Create a filtering device around another device
+     * @param device the device that the readings come from
+     */
+    explicit FilteredAnalogDevice(AnalogDevice* device) : device(device), filters{}, filterCount(0) {}
+
+    /**
+     * Adds a filter for a pin, or replaces its settings if it already has one, which resets its history.
+     * @param pin the pin to filter
+     * @param extraBits the number of bits to add by oversampling, 0 for none, at most ANALOG_FILTER_MAX_EXTRA_BITS
+     * @param medianWindow the number of readings to take the median of, 0 or 1 for none, at most ANALOG_FILTER_MAX_MEDIAN
+     * @param emaShift the moving average weight as a power of two, 0 for none, 3 moves 1/8 of the way each read, at most 8
+     * @return true if the filter was added, false if the pool is full or a setting is out of range
+     */
+    bool addFilter(pinid_t pin, uint8_t extraBits, uint8_t medianWindow = 0, uint8_t emaShift = 0);
+
+    /**
+     * Clears the history of a pin's filter, so that the next read starts afresh, for example after a long pause.
+     * @param pin the filtered pin
+     */
+    void resetFilter(pinid_t pin);
+
+    /** @return the device that is being filtered */
+    AnalogDevice* getUnderlyingDevice() { return device; }
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override;
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override;
+    void initPin(pinid_t pin, AnalogDirection direction) override { device->initPin(pin, direction); }
+    unsigned int getCurrentValue(pinid_t pin) override;
+    float getCurrentFloat(pinid_t pin) override;
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override { device->setCurrentValue(pin, newValue); }
+    void setCurrentFloat(pinid_t pin, float newValue) override { device->setCurrentFloat(pin, newValue); }
+private:
+    AnalogFilterState* findFilter(pinid_t pin);
+    unsigned int oversample(pinid_t pin, uint8_t extraBits);
+    unsigned int median(AnalogFilterState& state, unsigned int reading);
+};
+
+#endif //IOABSTRACTION_FILTEREDANALOGDEVICE_H
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "I2cBusStatistics.h"
+
+I2cBusStatistics i2cBusStatistics;
+
+void I2cBusStatistics::recordTransaction(uint8_t address, size_t len, bool success, unsigned int retries, unsigned long timeTaken) {
+    // most traffic is repeated syncs of the same device, so check the last one used first.
+    uint8_t idx = lastIndex;
+    if(idx >= devicesUsed || devices[idx].address != address) {
+        idx = 0;
+        while(idx < devicesUsed && devices[idx].address != address) idx++;
+        if(idx == devicesUsed) {
+            if(devicesUsed == IOA_I2C_STATISTICS_DEVICES) {
+                overflowTransactions++;
+                return;
+            }
+            devices[idx] = I2cDeviceStatistics{};
+            devices[idx].address = address;
+            devicesUsed++;
+        }
+        lastIndex = idx;
+    }
+
+    auto& dev = devices[idx];
+    dev.transactions++;
+    dev.retries += retries;
+    if(success) dev.bytes += len;
+    else dev.nacks++;
+    dev.totalMicros += timeTaken;
+    if(timeTaken > dev.maxMicros) dev.maxMicros = timeTaken;
+}
+
+const I2cDeviceStatistics* I2cBusStatistics::getStatisticsFor(uint8_t address) const {
+    for(uint8_t i = 0; i < devicesUsed; i++) {
+        if(devices[i].address == address) return &devices[i];
+    }
+    return nullptr;
+}
+
+void I2cBusStatistics::reset() {
+    devicesUsed = 0;
+    lastIndex = 0;
+    overflowTransactions = 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_I2CBUSSTATISTICS_H
+#define IOABSTRACTION_I2CBUSSTATISTICS_H
+
+/**
+ * @file I2cBusStatistics.h
+ * @brief Optional per device counters for the I2C wire functions, so that a device that is slow, failing to
+ * acknowledge or being retried can be found at runtime. Turned on by defining IOA_I2C_INSTRUMENTATION, without it
+ * the wire functions are unchanged.
+ */
+
+#include "PlatformDetermination.h"
+
+// START user adjustable section
+
+// define this build flag, or uncomment the line below, to count transactions in the wire functions.
+//#define IOA_I2C_INSTRUMENTATION
+
+/**
+ * The number of device addresses that statistics are kept for, traffic to any further addresses is only counted in
+ * the overflow count. Each entry takes sizeof(I2cDeviceStatistics), 25 bytes on AVR and 28 on 32 bit boards.
+ */
+#ifndef IOA_I2C_STATISTICS_DEVICES
+#define IOA_I2C_STATISTICS_DEVICES 8
+#endif
+
+// END user adjustable section
+
+/**
+ * The statistics for one device address, all times are in microseconds and include any yielding while retrying.
+ */
+struct I2cDeviceStatistics {
+    /** the 7 bit device address */
+    uint8_t address;
+    /** the number of reads and writes, each call to a wire function counts once however many retries it takes */
+    uint32_t transactions;
+    /** the number of bytes transferred, only counting transactions that succeeded */
+    uint32_t bytes;
+    /** the number of times a write was retried because the device did not acknowledge */
+    uint32_t retries;
+    /** the number of transactions that failed, normally because the device did not acknowledge */
+    uint32_t nacks;
+    /** the total time spent in transactions */
+    uint32_t totalMicros;
+    /** the longest single transaction */
+    uint32_t maxMicros;
+};
+
+/**
+ * Holds the statistics for every device address seen by the wire functions, the global instance is
+ * `i2cBusStatistics`. Recording is a short search of a small table, so it is cheap enough to leave on. Addresses are
+ * counted together across buses. Only read or reset the statistics from task manager, not from an interrupt.
+ */
+class I2cBusStatistics {
+private:
+    I2cDeviceStatistics devices[IOA_I2C_STATISTICS_DEVICES];
+    uint32_t overflowTransactions;
+    uint8_t devicesUsed;
+    uint8_t lastIndex;
+public:
+    I2cBusStatistics() : devices{}, overflowTransactions(0), devicesUsed(0), lastIndex(0) {}
+
+    /**
+     * Record a transaction, called by the wire functions when IOA_I2C_INSTRUMENTATION is defined.
+     * @param address the device address
+     * @param len the number of bytes in the transaction
+     * @param success true if the transaction succeeded
+     * @param retries the number of retries that were needed
+     * @param timeTaken the time the transaction took in microseconds
+     */
+    void recordTransaction(uint8_t address, size_t len, bool success, unsigned int retries, unsigned long timeTaken);
+
+    /**
+     * @param address the device address
+     * @return the statistics for the address, or nullptr if nothing has been recorded for it
+     */
+    const I2cDeviceStatistics* getStatisticsFor(uint8_t address) const;
+
+    /** @return the number of addresses that have statistics */
+    uint8_t getDeviceCount() const { return devicesUsed; }
+
+    /**
+     * @param idx the index between 0 and getDeviceCount() - 1
+     * @return the statistics at that index
+     */
+    const I2cDeviceStatistics& getStatistics(uint8_t idx) const { return devices[idx]; }
+
+    /** @return the number of transactions to addresses that did not fit in the table */
+    uint32_t getOverflowTransactions() const { return overflowTransactions; }
+
+    /** Clears all statistics, for example to measure over a fixed period */
+    void reset();
+};
+
+/**
+ * The global statistics that the wire functions record into.
+ */
+extern I2cBusStatistics i2cBusStatistics;
+
+#ifdef IOA_I2C_INSTRUMENTATION
+# define IOA_I2C_STATS_START unsigned long ioaStatsStarted = micros();
+# define IOA_I2C_STATS_RECORD(addr, len, ok, retries) i2cBusStatistics.recordTransaction(addr, len, ok, retries, micros() - ioaStatsStarted);
+#else
+# define IOA_I2C_STATS_START
+# define IOA_I2C_STATS_RECORD(addr, len, ok, retries)
+#endif
+
+#endif //IOABSTRACTION_I2CBUSSTATISTICS_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "I2cTransactionScheduler.h"
+#include "IoLogging.h"
+#include "I2cBusStatistics.h"
+
+I2cTransactionScheduler i2cTransactionScheduler;
+
+bool I2cTransactionScheduler::submit(I2cTransaction* transaction) {
+    if(transaction == nullptr || transaction->status != I2C_TXN_IDLE) return false;
+    if(queueCount == IOA_I2C_QUEUE_SIZE) {
+        serlogF(SER_IOA_INFO, "I2C queue full");
+        return false;
+    }
+
+    transaction->status = I2C_TXN_QUEUED;
+    queue[queueCount] = transaction;
+    queueCount++;
+
+    if(!eventRegistered) {
+        eventRegistered = true;
+        taskManager.registerEvent(this);
+    }
+    else {
+        // make sure the event runs soon rather than waiting for its next idle check
+        setTriggered(true);
+    }
+    return true;
+}
+
+uint32_t I2cTransactionScheduler::timeOfNextCheck() {
+    I2cTransaction* txn = current;
+    if(txn == nullptr && queueCount == 0) return secondsToMicros(1);
+
+    if(txn == nullptr || txn->status == I2C_TXN_FINISHED) {
+        setTriggered(true);
+    }
+    // while a transfer is in progress on the hardware, poll often as its completion is the critical path.
+    return 100;
+}
+
+void I2cTransactionScheduler::exec() {
+    unsigned long started = micros();
+    do {
+        if(current == nullptr) {
+            if(queueCount == 0) break;
+            if(!i2cLock.tryLock()) break; // someone else is using the bus, try again on the next check
+            current = takeNextTransaction();
+            startTransaction(current);
+        }
+
+        I2cTransaction* txn = current;
+        if(txn->status != I2C_TXN_FINISHED) break; // still on the hardware, completes from its callback
+
+        i2cLock.unlock();
+        current = nullptr;
+        finishTransaction(txn);
+
+        // bulk transfers can be long, so give task manager a chance to run before any more.
+        if(txn->priority == I2C_PRIORITY_BULK) break;
+    } while((micros() - started) < IOA_I2C_BURST_MICROS);
+}
+
+I2cTransaction* I2cTransactionScheduler::takeNextTransaction() {
+    // the queue is in submission order, so the first entry of the highest priority is the oldest of that priority.
+    uint8_t best = 0;
+    for(uint8_t i = 1; i < queueCount; i++) {
+        if(queue[i]->priority < queue[best]->priority) best = i;
+    }
+
+    I2cTransaction* txn = queue[best];
+    queueCount--;
+    for(uint8_t i = best; i < queueCount; i++) {
+        queue[i] = queue[i + 1];
+    }
+    return txn;
+}
+
+void I2cTransactionScheduler::finishTransaction(I2cTransaction* txn) {
+#if defined(IOA_I2C_INSTRUMENTATION) && defined(IOA_I2C_ASYNC_TRANSFERS)
+    i2cBusStatistics.recordTransaction(txn->address >> 1, txn->writeLen + txn->readLen, txn->succeeded, 0, micros() - transferStarted);
+#endif
+    // the transaction is idle before the listener is called, so that it can be submitted again straight away.
+    txn->status = I2C_TXN_IDLE;
+    if(!txn->succeeded) {
+        serlogF2(SER_IOA_DEBUG, "I2C txn failed addr=", txn->address);
+    }
+    if(txn->listener) txn->listener->i2cTransactionComplete(txn, txn->succeeded);
+}
+
+#ifdef IOA_I2C_ASYNC_TRANSFERS
+
+void I2cTransactionScheduler::startTransaction(I2cTransaction* txn) {
+    txn->status = I2C_TXN_IN_PROGRESS;
+    transferStarted = micros();
+    int rc = txn->wire->transfer(txn->address, (const char*)txn->writeData, txn->writeLen, (char*)txn->readData,
+                                 txn->readLen, callback(this, &I2cTransactionScheduler::mbedTransferComplete),
+                                 I2C_EVENT_ALL, false);
+    if(rc != 0) {
+        txn->succeeded = false;
+        txn->status = I2C_TXN_FINISHED;
+    }
+}
+
+void I2cTransactionScheduler::mbedTransferComplete(int event) {
+    // called from interrupt context, only the status is updated, the listener is called on task manager.
+    I2cTransaction* txn = current;
+    if(txn == nullptr) return;
+    txn->succeeded = (event & I2C_EVENT_TRANSFER_COMPLETE) != 0 && (event & I2C_EVENT_ERROR) == 0;
+    txn->status = I2C_TXN_FINISHED;
+    markTriggeredAndNotify();
+}
+
+#else
+
+// without an asynchronous bus the transfer is made here and now, so the transaction is finished on return.
+void I2cTransactionScheduler::startTransaction(I2cTransaction* txn) {
+    txn->status = I2C_TXN_IN_PROGRESS;
+    bool ok = true;
+    if(txn->writeLen != 0) {
+        // when a read follows, no stop is sent so that the read follows with a repeated start
+        ok = ioaWireWriteWithRetry(txn->wire, txn->address, txn->writeData, txn->writeLen, 0, txn->readLen == 0);
+    }
+    if(ok && txn->readLen != 0) {
+        ok = ioaWireRead(txn->wire, txn->address, txn->readData, txn->readLen);
+    }
+    txn->succeeded = ok;
+    txn->status = I2C_TXN_FINISHED;
+}
+
+#endif
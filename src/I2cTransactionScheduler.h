@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_I2CTRANSACTIONSCHEDULER_H
+#define IOABSTRACTION_I2CTRANSACTIONSCHEDULER_H
+
+/**
+ * @file I2cTransactionScheduler.h
+ * @brief A prioritised queue of I2C transactions that are carried out on task manager. On mbed boards with
+ * DEVICE_I2C_ASYNCH the transfers are non-blocking, and the expanders can use it for asynchronous sync.
+ */
+
+#include "PlatformDetermination.h"
+#include "PlatformDeterminationWire.h"
+#include <TaskManagerIO.h>
+
+// START user adjustable section
+
+/**
+ * The number of transactions that can be queued at once, across all buses. Each entry is a single pointer.
+ */
+#ifndef IOA_I2C_QUEUE_SIZE
+#define IOA_I2C_QUEUE_SIZE 8
+#endif
+
+/**
+ * The longest time in microseconds that the scheduler keeps servicing queued transactions back to back before returning
+ * to task manager. Bulk transactions always return to task manager once complete.
+ */
+#ifndef IOA_I2C_BURST_MICROS
+#define IOA_I2C_BURST_MICROS 1000
+#endif
+
+// END user adjustable section
+
+/**
+ * Defined when the bus can be used asynchronously, at the moment only on mbed boards with DEVICE_I2C_ASYNCH. Only then
+ * do the expanders submit their syncs to the transaction queue, see setAsyncSync on each expander.
+ *
+ * On every other board IOA_I2C_BLOCKING_FALLBACK is defined instead. The queue still orders transactions by priority
+ * and calls the listener on task manager, but each transfer is made by the blocking ioaWire functions when its turn
+ * comes, so task manager is held for the length of the transfer.
+ */
+#if defined(IOA_USE_MBED_WIRE) && DEVICE_I2C_ASYNCH
+#define IOA_I2C_ASYNC_TRANSFERS
+#else
+#define IOA_I2C_BLOCKING_FALLBACK
+#endif
+
+class I2cTransaction;
+
+/**
+ * Implement this interface to be told when a transaction you submitted has completed, it is always called on task
+ * manager, never from an interrupt.
+ */
+class I2cTransactionListener {
+public:
+    virtual ~I2cTransactionListener() = default;
+    /**
+     * Called once a transaction has finished, successfully or not, after which it may be submitted again.
+     * @param transaction the transaction that completed
+     * @param success true if all parts of the transaction succeeded
+     */
+    virtual void i2cTransactionComplete(I2cTransaction* transaction, bool success) = 0;
+};
+
+/**
+ * The state of a transaction, set by the scheduler as it progresses.
+ */
+enum I2cTransactionStatus : uint8_t {
+    /** not queued, it can be set up and submitted */
+    I2C_TXN_IDLE,
+    /** waiting in the queue for the bus */
+    I2C_TXN_QUEUED,
+    /** started on the bus, waiting for the hardware to complete */
+    I2C_TXN_IN_PROGRESS,
+    /** the hardware has finished and the listener is about to be told */
+    I2C_TXN_FINISHED
+};
+
+/**
+ * The priority of a transaction, when the bus becomes free the queued transaction with the highest priority goes
+ * next, and those of the same priority go in the order submitted.
+ */
+enum I2cTransactionPriority : uint8_t {
+    /** reads that input latency depends on, such as an expander with switches attached */
+    I2C_PRIORITY_INPUT,
+    /** regular device traffic such as output writes, the default */
+    I2C_PRIORITY_OUTPUT,
+    /** bulk transfers such as EEPROM storage, that can wait for everything else */
+    I2C_PRIORITY_BULK
+};
+
+/**
+ * A single I2C transaction, an optional write followed by an optional read from the same device. When both are
+ * present the read follows a repeated start, which suits the usual pattern of writing a register address and reading
+ * back its value. The object and both buffers are owned by the caller and must remain valid until the listener is
+ * called, so they are normally members of the device that uses them. No memory is allocated by the scheduler.
+ */
+class I2cTransaction {
+private:
+    WireType wire;
+    I2cTransactionListener* listener;
+    const uint8_t* writeData;
+    uint8_t* readData;
+    uint8_t writeLen;
+    uint8_t readLen;
+    uint8_t address;
+    I2cTransactionPriority priority;
+    volatile I2cTransactionStatus status;
+    volatile bool succeeded;
+public:
+    I2cTransaction() : wire(nullptr), listener(nullptr), writeData(nullptr), readData(nullptr), writeLen(0), readLen(0),
+                       address(0), priority(I2C_PRIORITY_OUTPUT), status(I2C_TXN_IDLE), succeeded(false) {}
+
+    /**
+     * Set up the transaction, call only while it is idle.
+     * @param wireImpl the bus to use
+     * @param addr the device address
+     * @param txListener the listener to notify on completion, may be nullptr
+     * @param txPriority the priority of the transaction, defaults to I2C_PRIORITY_OUTPUT
+     */
+    void prepare(WireType wireImpl, uint8_t addr, I2cTransactionListener* txListener,
+                 I2cTransactionPriority txPriority = I2C_PRIORITY_OUTPUT) {
+        wire = wireImpl;
+        address = addr;
+        listener = txListener;
+        priority = txPriority;
+        writeData = readData = nullptr;
+        writeLen = readLen = 0;
+    }
+
+    /**
+     * Adds a write phase, sent before any read.
+     * @param data the data to write, it must remain valid until completion
+     * @param len the number of bytes to write
+     */
+    void setWrite(const uint8_t* data, uint8_t len) { writeData = data; writeLen = len; }
+
+    /**
+     * Adds a read phase, after any write.
+     * @param data where the data will be read into, it must remain valid until completion
+     * @param len the number of bytes to read
+     */
+    void setRead(uint8_t* data, uint8_t len) { readData = data; readLen = len; }
+
+    /** @return the current status of the transaction */
+    I2cTransactionStatus getStatus() const { return status; }
+
+    /** @return true if the transaction is neither queued nor in progress, so it can be prepared again */
+    bool isIdle() const { return status == I2C_TXN_IDLE; }
+
+    /** @return true if the transaction has a read phase */
+    bool hasRead() const { return readLen != 0; }
+
+    /** @return true if the most recently completed run of this transaction succeeded */
+    bool wasSuccessful() const { return succeeded; }
+
+    friend class I2cTransactionScheduler;
+};
+
+/**
+ * The queue that carries out I2C transactions for all devices, highest priority first. It is a task manager event,
+ * registered the first time something is submitted. Each time it runs it services queued transactions back to back
+ * until the queue is empty, IOA_I2C_BURST_MICROS has passed, or a bulk transaction has completed.
+ *
+ * When IOA_I2C_ASYNC_TRANSFERS is defined (mbed with DEVICE_I2C_ASYNCH), the transfer is handed to the asynchronous
+ * I2C API and completes from its callback, so task manager runs other tasks while it is on the bus. On all other
+ * boards, where IOA_I2C_BLOCKING_FALLBACK is defined, each transaction is carried out by the blocking ioaWire
+ * functions within the event, holding task manager for the length of the transfer just as a direct call would, so
+ * there the expanders do not use it. The `i2cLock` is taken
+ * for each transaction, when code elsewhere holds it, the queue waits until it is free.
+ */
+class I2cTransactionScheduler : public BaseEvent {
+private:
+    // queued transactions in the order submitted, the one on the bus is held separately in current.
+    I2cTransaction* queue[IOA_I2C_QUEUE_SIZE];
+    I2cTransaction* volatile current;
+    uint8_t queueCount;
+    bool eventRegistered;
+public:
+    I2cTransactionScheduler() : queue{}, current(nullptr), queueCount(0), eventRegistered(false) {}
+
+    /**
+     * Queue a transaction to be carried out on task manager, call only from task manager, never from an interrupt.
+     * Submitting never waits for the bus, but with IOA_I2C_BLOCKING_FALLBACK the transfer blocks task manager when
+     * it is carried out, see isBusAsynchronous.
+     * @param transaction the transaction, which must be idle
+     * @return true if queued, false if the queue is full or the transaction is already queued or in progress
+     */
+    bool submit(I2cTransaction* transaction);
+
+    /** @return true when transfers are asynchronous on the bus, false for the blocking fallback on this board */
+    static constexpr bool isBusAsynchronous() {
+#ifdef IOA_I2C_ASYNC_TRANSFERS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /** @return the number of transactions waiting or in progress */
+    uint8_t getQueuedCount() const { return queueCount + (current != nullptr ? 1 : 0); }
+
+    uint32_t timeOfNextCheck() override;
+    void exec() override;
+
+#ifdef IOA_I2C_ASYNC_TRANSFERS
+private:
+    // asynchronous transfers bypass the wire functions, so are recorded into the bus statistics here.
+    unsigned long transferStarted = 0;
+    void mbedTransferComplete(int event);
+#endif
+private:
+    I2cTransaction* takeNextTransaction();
+    void startTransaction(I2cTransaction* txn);
+    void finishTransaction(I2cTransaction* txn);
+};
+
+/**
+ * The global I2C transaction queue, that the expanders submit to in asynchronous sync mode.
+ */
+extern I2cTransactionScheduler i2cTransactionScheduler;
+
+#endif //IOABSTRACTION_I2CTRANSACTIONSCHEDULER_H
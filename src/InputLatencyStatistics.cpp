@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "InputLatencyStatistics.h"
+
+#ifdef IOA_INPUT_INSTRUMENTATION
+InputLatencyStatistics inputLatencyStatistics;
+#endif
+
+void InputLatencyStatistics::record(InputLatencyKind kind, uint16_t id, unsigned long timeTaken) {
+    uint8_t idx = 0;
+    while(idx < sourcesUsed && (sources[idx].kind != kind || sources[idx].id != id)) idx++;
+    if(idx == sourcesUsed) {
+        if(sourcesUsed == IOA_LATENCY_SOURCES) {
+            overflowSamples++;
+            return;
+        }
+        sources[idx] = InputLatencySourceStatistics{};
+        sources[idx].kind = kind;
+        sources[idx].id = id;
+        sources[idx].minMicros = 0xffffffffUL;
+        sourcesUsed++;
+    }
+
+    auto& src = sources[idx];
+    src.samples++;
+    src.totalMicros += timeTaken;
+    if(timeTaken < src.minMicros) src.minMicros = timeTaken;
+    if(timeTaken > src.maxMicros) src.maxMicros = timeTaken;
+
+    uint8_t bucket = 0;
+    while(bucket < (IOA_LATENCY_BUCKETS - 1) && timeTaken >= getBucketLimitMicros(bucket)) bucket++;
+    if(src.histogram[bucket] != 0xffff) src.histogram[bucket]++;
+}
+
+const InputLatencySourceStatistics* InputLatencyStatistics::getStatisticsFor(InputLatencyKind kind, uint16_t id) const {
+    for(uint8_t i = 0; i < sourcesUsed; i++) {
+        if(sources[i].kind == kind && sources[i].id == id) return &sources[i];
+    }
+    return nullptr;
+}
+
+uint32_t InputLatencyStatistics::getBucketLimitMicros(uint8_t bucket) {
+    if(bucket >= (IOA_LATENCY_BUCKETS - 1)) return 0xffffffffUL;
+    return uint32_t(IOA_LATENCY_FIRST_BUCKET_MICROS) << bucket;
+}
+
+void InputLatencyStatistics::dumpToLog(__attribute__((unused)) SerLoggingLevel level) const {
+    for(uint8_t i = 0; i < sourcesUsed; i++) {
+        auto& src = sources[i];
+        serlogF4(level, "Latency kind/id/n ", (int)src.kind, (unsigned int)src.id, src.samples);
+        if(src.samples == 0) continue;
+        serlogF4(level, "  min/avg/max ", src.minMicros, src.totalMicros / src.samples, src.maxMicros);
+        for(uint8_t b = 0; b < IOA_LATENCY_BUCKETS; b++) {
+            if(src.histogram[b] == 0) continue;
+            serlogF3(level, "  below/n ", getBucketLimitMicros(b), src.histogram[b]);
+        }
+    }
+    if(overflowSamples != 0) {
+        serlogF2(level, "Latency overflow ", overflowSamples);
+    }
+}
+
+void InputLatencyStatistics::reset() {
+    sourcesUsed = 0;
+    overflowSamples = 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_INPUTLATENCYSTATISTICS_H
+#define IOABSTRACTION_INPUTLATENCYSTATISTICS_H
+
+/**
+ * @file InputLatencyStatistics.h
+ * @brief Optional measurement of the time from an input changing to its callback being called, for switches, rotary
+ * encoders and matrix keyboards, along with the time spent in their polling loops. Turned on by defining
+ * IOA_INPUT_INSTRUMENTATION, without it nothing is recorded and the input classes are unchanged.
+ */
+
+#include "PlatformDetermination.h"
+#include "IoLogging.h"
+
+// START user adjustable section
+
+// define this build flag, or uncomment the line below, to record input latency.
+//#define IOA_INPUT_INSTRUMENTATION
+
+/**
+ * The number of input sources that statistics are kept for, samples from any further sources are only counted in
+ * the overflow count. Each entry takes 36 bytes.
+ */
+#ifndef IOA_LATENCY_SOURCES
+#define IOA_LATENCY_SOURCES 8
+#endif
+
+/**
+ * The upper limit of the first histogram bucket in microseconds, each bucket after it is twice as wide as the one
+ * before, and the last bucket holds everything longer. With the default of 1ms the buckets end at 1, 2, 4, 8, 16, 32
+ * and 64ms.
+ */
+#ifndef IOA_LATENCY_FIRST_BUCKET_MICROS
+#define IOA_LATENCY_FIRST_BUCKET_MICROS 1000
+#endif
+
+// END user adjustable section
+
+#define IOA_LATENCY_BUCKETS 8
+
+/**
+ * The kind of input that a latency was recorded for, together with an id it identifies the source.
+ */
+enum InputLatencyKind : uint8_t {
+    /** edge to press or release callback of a switch, the id is the pin */
+    INPUT_LATENCY_SWITCH,
+    /** edge to callback of a rotary encoder, the id is the A pin, or the key pin for up down buttons */
+    INPUT_LATENCY_ENCODER,
+    /** edge to keyPressed or keyReleased of a matrix keyboard, the id is the key character */
+    INPUT_LATENCY_MATRIX_KEY,
+    /** the time taken by each SwitchInput::runLoop, the id is 0 */
+    INPUT_LATENCY_SWITCH_LOOP,
+    /** the time taken by each complete scan of MatrixKeyboardManager, including column settle times, the id is 0 */
+    INPUT_LATENCY_MATRIX_SCAN
+};
+
+/**
+ * The statistics for one input source, all times are in microseconds.
+ */
+struct InputLatencySourceStatistics {
+    /** the kind of input */
+    InputLatencyKind kind;
+    /** the id of the source within its kind */
+    uint16_t id;
+    /** the number of samples recorded */
+    uint32_t samples;
+    /** the shortest sample */
+    uint32_t minMicros;
+    /** the longest sample */
+    uint32_t maxMicros;
+    /** the total of all the samples, divide by samples for the average */
+    uint32_t totalMicros;
+    /** the number of samples in each bucket, see IOA_LATENCY_FIRST_BUCKET_MICROS, each stops counting at 65535 */
+    uint16_t histogram[IOA_LATENCY_BUCKETS];
+};
+
+/**
+ * Holds the latency statistics for every input source that has been recorded, the global instance is
+ * `inputLatencyStatistics`, and only exists when IOA_INPUT_INSTRUMENTATION is defined. Latency is measured from the
+ * interrupt that reported the change when there is one, otherwise from the read in which the change was first seen,
+ * so in polling mode up to one poll interval before that first read is not included. It then includes debouncing and
+ * any time waiting for queued delivery. Only record, read or reset the statistics from task manager.
+ */
+class InputLatencyStatistics {
+private:
+    InputLatencySourceStatistics sources[IOA_LATENCY_SOURCES];
+    uint32_t overflowSamples;
+    uint8_t sourcesUsed;
+public:
+    InputLatencyStatistics() : sources{}, overflowSamples(0), sourcesUsed(0) {}
+
+    /**
+     * Record a sample for a source, called by the input classes when IOA_INPUT_INSTRUMENTATION is defined.
+     * @param kind the kind of input
+     * @param id the id of the source within its kind
+     * @param timeTaken the latency or loop time in microseconds
+     */
+    void record(InputLatencyKind kind, uint16_t id, unsigned long timeTaken);
+
+    /**
+     * @param kind the kind of input
+     * @param id the id of the source within its kind
+     * @return the statistics for the source, or nullptr if nothing has been recorded for it
+     */
+    const InputLatencySourceStatistics* getStatisticsFor(InputLatencyKind kind, uint16_t id) const;
+
+    /** @return the number of sources that have statistics */
+    uint8_t getSourceCount() const { return sourcesUsed; }
+
+    /**
+     * @param idx the index between 0 and getSourceCount() - 1
+     * @return the statistics at that index
+     */
+    const InputLatencySourceStatistics& getStatistics(uint8_t idx) const { return sources[idx]; }
+
+    /** @return the number of samples from sources that did not fit in the table */
+    uint32_t getOverflowSamples() const { return overflowSamples; }
+
+    /**
+     * @param bucket the histogram bucket
+     * @return the upper limit of the bucket in microseconds, the last bucket has no limit and returns 0xffffffff
+     */
+    static uint32_t getBucketLimitMicros(uint8_t bucket);
+
+    /**
+     * Writes the statistics of every source to the log, a line with the count and a line with the min, average and
+     * max for each source, followed by a line for each histogram bucket that has samples.
+     * @param level the logging level to write at
+     */
+    void dumpToLog(SerLoggingLevel level = SER_IOA_INFO) const;
+
+    /** Clears all statistics, for example to measure over a fixed period */
+    void reset();
+};
+
+#ifdef IOA_INPUT_INSTRUMENTATION
+/**
+ * The global statistics that the input classes record into.
+ */
+extern InputLatencyStatistics inputLatencyStatistics;
+
+# define IOA_LATENCY_RECORD(kind, id, since) inputLatencyStatistics.record(kind, id, micros() - (since));
+# define IOA_LATENCY_TIMER_START unsigned long ioaLatencyStarted = micros();
+# define IOA_LATENCY_TIMER_RECORD(kind) inputLatencyStatistics.record(kind, 0, micros() - ioaLatencyStarted);
+#else
+# define IOA_LATENCY_RECORD(kind, id, since)
+# define IOA_LATENCY_TIMER_START
+# define IOA_LATENCY_TIMER_RECORD(kind)
+#endif
+
+#endif //IOABSTRACTION_INPUTLATENCYSTATISTICS_H
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "InputWakeSchedule.h"
+
+InputWakeSchedule inputWakeSchedule;
+
+WakeDeadline::~WakeDeadline() {
+    if(linked) inputWakeSchedule.remove(this);
+}
+
+uint32_t WakeDeadline::nextRunIn(uint32_t delayMicros, bool align) {
+    if(!linked) {
+        linked = true;
+        inputWakeSchedule.add(this);
+    }
+    if(align) delayMicros = inputWakeSchedule.alignDelay(delayMicros);
+    deadline = micros() + delayMicros;
+    pending = true;
+    return delayMicros;
+}
+
+uint32_t InputWakeSchedule::alignDelay(uint32_t delayMicros) const {
+    if(tickMicros == 0) return delayMicros;
+    uint32_t remainder = uint32_t(micros() + delayMicros) % tickMicros;
+    return remainder == 0 ? delayMicros : delayMicros + (tickMicros - remainder);
+}
+
+uint32_t InputWakeSchedule::microsToNextDeadline() const {
+    unsigned long now = micros();
+    uint32_t earliest = IOA_NO_WAKE_DEADLINE;
+    for(auto item = first; item != nullptr; item = item->next) {
+        if(!item->pending) continue;
+        // the difference as signed, so a deadline that has just passed shows as overdue rather than far away.
+        long remaining = long(item->deadline - now);
+        if(remaining <= 0) return 0;
+        if(uint32_t(remaining) < earliest) earliest = uint32_t(remaining);
+    }
+    return earliest;
+}
+
+void InputWakeSchedule::add(WakeDeadline* deadline) {
+    deadline->next = first;
+    first = deadline;
+}
+
+void InputWakeSchedule::remove(WakeDeadline* deadline) {
+    for(WakeDeadline** link = &first; *link != nullptr; link = &(*link)->next) {
+        if(*link == deadline) {
+            *link = deadline->next;
+            deadline->next = nullptr;
+            deadline->linked = false;
+            return;
+        }
+    }
+}
+
+bool InputWakeSchedule::contains(const WakeDeadline* deadline) const {
+    for(auto item = first; item != nullptr; item = item->next) {
+        if(item == deadline) return true;
+    }
+    return false;
+}
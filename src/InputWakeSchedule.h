@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_INPUTWAKESCHEDULE_H
+#define IOABSTRACTION_INPUTWAKESCHEDULE_H
+
+/**
+ * @file InputWakeSchedule.h
+ * @brief Lets the input managers report when they next need to run, and line their polls up on a shared tick, so
+ * that a board can sleep until the earliest of them and run everything that is due in one wake up.
+ */
+
+#include "PlatformDetermination.h"
+
+// START user adjustable section
+
+/**
+ * The default shared tick in microseconds that polls are aligned to, 0 leaves every poll at its own phase, which is
+ * how the input managers have always worked. It can be changed at runtime, see InputWakeSchedule::setTickMicros.
+ */
+#ifndef IOA_WAKE_TICK_MICROS
+#define IOA_WAKE_TICK_MICROS 0
+#endif
+
+// END user adjustable section
+
+/** Returned by InputWakeSchedule::microsToNextDeadline when nothing is due, everything is waiting on an interrupt */
+#define IOA_NO_WAKE_DEADLINE 0xffffffffUL
+
+/**
+ * The next time that an input manager needs to run, each manager holds one of these and updates it every time that
+ * it schedules itself. It joins the schedule the first time it is used, and leaves it when destroyed, so it can be
+ * held by objects of any lifetime. A copy starts off the schedule and joins it on its own first use.
+ */
+class WakeDeadline {
+private:
+    unsigned long deadline;
+    WakeDeadline* next;
+    bool pending;
+    bool linked;
+public:
+    WakeDeadline() : deadline(0), next(nullptr), pending(false), linked(false) {}
+    WakeDeadline(const WakeDeadline& other) : deadline(other.deadline), next(nullptr), pending(other.pending), linked(false) {}
+    ~WakeDeadline();
+
+    /** Copies the deadline only, each object keeps its own place in the schedule. */
+    WakeDeadline& operator=(const WakeDeadline& other) {
+        deadline = other.deadline;
+        pending = other.pending;
+        return *this;
+    }
+
+    /**
+     * Records that the owner next needs to run after a delay, moved later to the next shared tick when alignment is
+     * on, so that polls from different managers fall on the same tick.
+     * @param delayMicros the delay that the owner would like
+     * @param align false for short waits within a sequence, such as settling a column, that must not be delayed
+     * @return the delay to schedule with, in microseconds
+     */
+    uint32_t nextRunIn(uint32_t delayMicros, bool align = true);
+
+    /** Records that the owner has nothing scheduled and only runs again on an interrupt */
+    void waitingForInterrupt() { pending = false; }
+
+    /** @return true if the owner has a deadline */
+    bool isPending() const { return pending; }
+
+    /** @return the value of micros() at which the owner next runs, only valid when pending */
+    unsigned long getDeadline() const { return deadline; }
+
+    friend class InputWakeSchedule;
+};
+
+/**
+ * The schedule that all the wake deadlines join, switches, the matrix keyboard, touch screens, analog events and
+ * joysticks all report to it. A board that sleeps between task manager runs asks for microsToNextDeadline, and sleeps
+ * for no longer than that unless an interrupt comes first.
+ *
+ * With a tick set, every poll that would become due part way through a tick waits until the end of it, so all the
+ * polls due in the same tick run back to back in one wake up, and each poll is late by at most one tick. The tick is
+ * counted from micros() so its phase jumps once each time micros() wraps.
+ */
+class InputWakeSchedule {
+private:
+    WakeDeadline* first;
+    uint32_t tickMicros;
+public:
+    InputWakeSchedule() : first(nullptr), tickMicros(IOA_WAKE_TICK_MICROS) {}
+
+    /** @param micros the shared tick to align polls to, 0 to turn alignment off */
+    void setTickMicros(uint32_t micros) { tickMicros = micros; }
+    uint32_t getTickMicros() const { return tickMicros; }
+
+    /**
+     * Moves a delay later so that it ends on the next shared tick, the delay is unchanged when it already does or
+     * when alignment is off.
+     * @param delayMicros the delay from now
+     * @return the aligned delay from now
+     */
+    uint32_t alignDelay(uint32_t delayMicros) const;
+
+    /**
+     * @return the micros until the earliest deadline of any input manager, 0 when one is overdue, or
+     * IOA_NO_WAKE_DEADLINE when they are all waiting for an interrupt
+     */
+    uint32_t microsToNextDeadline() const;
+
+    /** internal, adds a deadline to the schedule, called on its first use */
+    void add(WakeDeadline* deadline);
+
+    /** internal, takes a deadline off the schedule, called when it is destroyed */
+    void remove(WakeDeadline* deadline);
+
+    /** @return true if the deadline is on the schedule */
+    bool contains(const WakeDeadline* deadline) const;
+};
+
+/**
+ * The global wake schedule that all input managers report to.
+ */
+extern InputWakeSchedule inputWakeSchedule;
+
+#endif //IOABSTRACTION_INPUTWAKESCHEDULE_H
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "InterruptEventRing.h"
+#include <TaskManagerIO.h>
+#include "IoLogging.h"
+
+static_assert((IOA_INTERRUPT_RING_SIZE & (IOA_INTERRUPT_RING_SIZE - 1)) == 0 && IOA_INTERRUPT_RING_SIZE <= 128,
+              "IOA_INTERRUPT_RING_SIZE must be a power of two no larger than 128");
+static_assert(IOA_INTERRUPT_RING_MAX_PINS <= 8, "IOA_INTERRUPT_RING_MAX_PINS can be at most 8");
+
+// On AVR there is only one core and interrupts do not nest, so stopping the compiler reordering is enough. Elsewhere
+// a full barrier makes sure the event is visible before the index that publishes it.
+#ifdef __AVR__
+# define IOA_RING_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+# define IOA_RING_BARRIER() __sync_synchronize()
+#endif
+
+#define RING_MASK (IOA_INTERRUPT_RING_SIZE - 1)
+
+InterruptEventRing ioInterruptRing;
+
+bool InterruptEventRing::pushFromIsr(pinid_t pin, uint8_t level, unsigned long timestamp, uint8_t pairedLevel) {
+    uint8_t h = head;
+    if((uint8_t)(h - tail) >= IOA_INTERRUPT_RING_SIZE) {
+        droppedEvents = droppedEvents + 1;
+        return false;
+    }
+    IoInterruptEvent& ev = events[h & RING_MASK];
+    ev.timestamp = timestamp;
+    ev.pin = pin;
+    ev.level = level;
+    ev.pairedLevel = pairedLevel;
+    IOA_RING_BARRIER();
+    head = h + 1;
+    return true;
+}
+
+bool InterruptEventRing::pop(IoInterruptEvent& event) {
+    uint8_t t = tail;
+    if(t == head) return false;
+    IOA_RING_BARRIER();
+    event = events[t & RING_MASK];
+    IOA_RING_BARRIER();
+    tail = t + 1;
+    return true;
+}
+
+uint8_t InterruptEventRing::popBatch(IoInterruptEvent* buffer, uint8_t maxEvents) {
+    uint8_t t = tail;
+    uint8_t count = (uint8_t)(head - t);
+    if(count > maxEvents) count = maxEvents;
+    IOA_RING_BARRIER();
+    for(uint8_t i = 0; i < count; i++) {
+        buffer[i] = events[(uint8_t)(t + i) & RING_MASK];
+    }
+    IOA_RING_BARRIER();
+    tail = t + count;
+    return count;
+}
+
+struct RecordedInterruptSlot {
+    IoAbstractionRef device;
+    pinid_t pin;
+    pinid_t pairedPin;
+};
+
+static RecordedInterruptSlot recordedSlots[IOA_INTERRUPT_RING_MAX_PINS];
+
+// raw interrupt handlers take no parameters, so each slot needs its own handler to know which pin it belongs to.
+template<uint8_t SLOT> ISR_ATTR void recordedInterruptHandler() {
+    RecordedInterruptSlot& slot = recordedSlots[SLOT];
+    if(slot.device == nullptr) return;
+    uint8_t level = IOA_INTERRUPT_LEVEL_UNKNOWN;
+    uint8_t pairedLevel = IOA_INTERRUPT_LEVEL_UNKNOWN;
+#ifndef IOA_USE_MBED
+    // reading a pin on mbed may have to look it up or allocate it, so there the levels are read on task manager.
+    if(slot.pin != IOA_INTERRUPT_PIN_UNKNOWN) {
+        level = internalDigitalDevice().digitalRead(slot.pin);
+        if(slot.pairedPin != IOA_INTERRUPT_PIN_UNKNOWN) pairedLevel = internalDigitalDevice().digitalRead(slot.pairedPin);
+    }
+#endif
+    ioInterruptRing.pushFromIsr(slot.pin, level, micros(), pairedLevel);
+    taskManager.markInterrupted(slot.pin);
+}
+
+static const RawIntHandler recordedHandlers[] = {
+        recordedInterruptHandler<0>, recordedInterruptHandler<1>, recordedInterruptHandler<2>, recordedInterruptHandler<3>,
+        recordedInterruptHandler<4>, recordedInterruptHandler<5>, recordedInterruptHandler<6>, recordedInterruptHandler<7>
+};
+
+bool attachRecordedInterrupt(IoAbstractionRef device, pinid_t pin, uint8_t mode, pinid_t pairedPin) {
+    // only board pins have an interrupt each, the pins of any other device share its one handler, which fans out.
+    bool boardPin = (device == &internalIoAbstraction);
+    pinid_t slotPin = boardPin ? pin : IOA_INTERRUPT_PIN_UNKNOWN;
+    if(!boardPin) pairedPin = IOA_INTERRUPT_PIN_UNKNOWN;
+
+    int freeSlot = -1;
+    for(int i = 0; i < IOA_INTERRUPT_RING_MAX_PINS; i++) {
+        if(recordedSlots[i].device == device && recordedSlots[i].pin == slotPin) {
+            recordedSlots[i].pairedPin = pairedPin;
+            device->attachInterrupt(pin, recordedHandlers[i], mode);
+            return true;
+        }
+        if(freeSlot == -1 && recordedSlots[i].device == nullptr) freeSlot = i;
+    }
+
+    if(freeSlot == -1) {
+        serlogF2(SER_IOA_INFO, "Interrupt ring slots full, pin ", pin);
+        return false;
+    }
+
+    // the pins must be in place before the device is set, as the handler uses the device to decide the slot is in use.
+    recordedSlots[freeSlot].pin = slotPin;
+    recordedSlots[freeSlot].pairedPin = pairedPin;
+    recordedSlots[freeSlot].device = device;
+    device->attachInterrupt(pin, recordedHandlers[freeSlot], mode);
+    return true;
+}
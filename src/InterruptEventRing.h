@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_INTERRUPTEVENTRING_H
+#define IOABSTRACTION_INTERRUPTEVENTRING_H
+
+/**
+ * @file InterruptEventRing.h
+ * @brief A lock free ring buffer that records each interrupt edge with its pin, level and time, so that the task
+ * manager side can process every edge in order, even when several arrive before task manager gets to run.
+ */
+
+#include "PlatformDetermination.h"
+#include "BasicIoAbstraction.h"
+
+// START user adjustable section
+
+/**
+ * The number of events the ring can hold before new events are dropped, it must be a power of two no larger than 128.
+ */
+#ifndef IOA_INTERRUPT_RING_SIZE
+#define IOA_INTERRUPT_RING_SIZE 16
+#endif
+
+/**
+ * The number of pins that can be attached to the ring at once, at most 8. Once these are used up, attaching falls
+ * back to the regular task manager interrupt handling.
+ */
+#ifndef IOA_INTERRUPT_RING_MAX_PINS
+#define IOA_INTERRUPT_RING_MAX_PINS 8
+#endif
+
+// END user adjustable section
+
+/** The level recorded for pins where it cannot be read from within an interrupt, such as pins on an I2C expander */
+#define IOA_INTERRUPT_LEVEL_UNKNOWN 0xff
+
+/**
+ * The pin recorded for an interrupt that is shared by all the pins of a device, such as the INT line of an I2C
+ * expander, any of its pins may have changed. Also used to mean no paired pin, see attachRecordedInterrupt.
+ */
+#define IOA_INTERRUPT_PIN_UNKNOWN ((pinid_t)-1)
+
+/**
+ * A single recorded interrupt edge.
+ */
+struct IoInterruptEvent {
+    /** the value of micros() when the interrupt was raised */
+    unsigned long timestamp;
+    /** the pin that raised the interrupt, or IOA_INTERRUPT_PIN_UNKNOWN when it is shared by the pins of a device */
+    pinid_t pin;
+    /** the level of the pin at the time, or IOA_INTERRUPT_LEVEL_UNKNOWN when it could not be read */
+    uint8_t level;
+    /** the level of the paired pin read in the same interrupt, or IOA_INTERRUPT_LEVEL_UNKNOWN when there is none */
+    uint8_t pairedLevel;
+};
+
+/**
+ * A single producer, single consumer ring of interrupt events. The producer is the interrupt handler and the
+ * consumer is code running on task manager, neither side ever blocks or disables interrupts. If the ring is full
+ * the newest event is dropped and counted, see `getDroppedCount`.
+ */
+class InterruptEventRing {
+private:
+    IoInterruptEvent events[IOA_INTERRUPT_RING_SIZE];
+    volatile uint8_t head; // only written by the producer
+    volatile uint8_t tail; // only written by the consumer
+    volatile uint16_t droppedEvents;
+public:
+    InterruptEventRing() : events{}, head(0), tail(0), droppedEvents(0) {}
+
+    /**
+     * Record an event, call only from the interrupt handler (the producer side).
+     * @param pin the pin that raised the interrupt
+     * @param level the level of the pin, or IOA_INTERRUPT_LEVEL_UNKNOWN
+     * @param timestamp the micros() value when the interrupt was raised
+     * @param pairedLevel the level of the paired pin, or IOA_INTERRUPT_LEVEL_UNKNOWN
+     * @return true if recorded, false if the ring was full and the event was dropped
+     */
+    bool pushFromIsr(pinid_t pin, uint8_t level, unsigned long timestamp, uint8_t pairedLevel = IOA_INTERRUPT_LEVEL_UNKNOWN);
+
+    /**
+     * Take the oldest event from the ring, call only from the consumer side.
+     * @param event filled in with the oldest event if there is one
+     * @return true if an event was taken, otherwise false
+     */
+    bool pop(IoInterruptEvent& event);
+
+    /**
+     * Take as many events as are available, up to a maximum, in the order they were recorded.
+     * @param buffer where to copy the events to
+     * @param maxEvents the size of the buffer
+     * @return the number of events copied
+     */
+    uint8_t popBatch(IoInterruptEvent* buffer, uint8_t maxEvents);
+
+    /** @return the number of events waiting to be taken */
+    uint8_t available() const { return (uint8_t)(head - tail); }
+
+    /** @return true if there are no events waiting */
+    bool isEmpty() const { return head == tail; }
+
+    /** @return the number of events lost because the ring was full */
+    uint16_t getDroppedCount() const { return droppedEvents; }
+};
+
+/**
+ * The ring used by switches for all the interrupts that are attached through `attachRecordedInterrupt`.
+ */
+extern InterruptEventRing ioInterruptRing;
+
+/**
+ * Attaches an interrupt on the device and pin such that every edge is recorded into `ioInterruptRing` and then
+ * task manager is told about the interrupt as usual, so the task manager interrupt callback should drain the ring.
+ *
+ * For pins of the board itself each pin has its own slot, and its level, along with that of any paired pin, is read
+ * within the interrupt, so that both pins of an encoder are sampled at the same edge. On mbed the levels are not read
+ * in the interrupt, they are IOA_INTERRUPT_LEVEL_UNKNOWN. Any other device, such as an I2C expander, raises all its
+ * pins on the same physical interrupt line, so every pin of that device shares one slot and the events it records
+ * have the pin IOA_INTERRUPT_PIN_UNKNOWN, telling the consumer to read all of them.
+ * @param device the IoAbstraction the pin belongs to
+ * @param pin the pin to attach to
+ * @param mode the interrupt mode such as CHANGE
+ * @param pairedPin a second board pin to read in the same interrupt, or IOA_INTERRUPT_PIN_UNKNOWN for none
+ * @return true if attached, false if all the slots are in use, in which case nothing was attached.
+ */
+bool attachRecordedInterrupt(IoAbstractionRef device, pinid_t pin, uint8_t mode,
+                             pinid_t pairedPin = IOA_INTERRUPT_PIN_UNKNOWN);
+
+#endif //IOABSTRACTION_INTERRUPTEVENTRING_H
@@ -48,17 +48,52 @@ void shiftOut(pinid_t dataPin, pinid_t clockPin, ShiftBitOrder bitOrder, uint8_t
 #endif
 
 
-ShiftRegisterIoAbstraction::ShiftRegisterIoAbstraction(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig) {
-    this->readClockPin = readConfig.clock;
-    this->readDataPin = readConfig.data;
-    this->readLatchPin = readConfig.latch;
-    this->numOfDevicesRead = readConfig.numDevices;
-    this->writeClockPin = writeConfig.clock;
-    this->writeDataPin = writeConfig.data;
-    this->writeLatchPin = writeConfig.latch;
-    this->numOfDevicesWrite = writeConfig.numDevices;
-    this->lastRead = toWrite = 0;
-    needsInit = true;
+IoPinMask shiftRegBufferRead(const uint8_t* buffer, uint8_t len, unsigned int startBit) {
+    unsigned int byteIdx = startBit / 8;
+    uint8_t bitOffset = startBit % 8;
+
+    // take up to five bytes, as a 32 bit window that is not byte aligned spans five bytes.
+    uint64_t window = 0;
+    for(uint8_t i = 0; i < 5 && (byteIdx + i) < len; i++) {
+        window |= uint64_t(buffer[byteIdx + i]) << (i * 8);
+    }
+    return (IoPinMask)(window >> bitOffset);
+}
+
+bool shiftRegBufferWrite(uint8_t* buffer, uint8_t len, unsigned int startBit, IoPinMask mask, IoPinMask values) {
+    unsigned int byteIdx = startBit / 8;
+    uint8_t bitOffset = startBit % 8;
+    uint64_t wideMask = uint64_t(mask) << bitOffset;
+    uint64_t wideValues = uint64_t(values & mask) << bitOffset;
+
+    bool changed = false;
+    for(uint8_t i = 0; i < 5 && (byteIdx + i) < len && wideMask != 0; i++) {
+        uint8_t byteMask = wideMask & 0xff;
+        uint8_t& current = buffer[byteIdx + i];
+        uint8_t newVal = (current & ~byteMask) | (wideValues & byteMask);
+        if(newVal != current) {
+            current = newVal;
+            changed = true;
+        }
+        wideMask >>= 8;
+        wideValues >>= 8;
+    }
+    return changed;
+}
+
+// the largest number of 595 devices whose pins can all be addressed by pinid_t.
+#define MAX_SHIFT_REG_WRITE_DEVICES ((unsigned long)((pinid_t)~0U - SHIFT_REGISTER_OUTPUT_CUTOVER + 1U) / 8U)
+
+static uint8_t* allocateShiftRegBuffer(uint8_t len) {
+    if(len == 0) return nullptr;
+    auto* buffer = new uint8_t[len];
+    memset(buffer, 0, len);
+    return buffer;
+}
+
+ShiftRegisterIoAbstraction::ShiftRegisterIoAbstraction(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig)
+        : ShiftRegisterIoAbstraction(readConfig.clock, readConfig.data, readConfig.latch, writeConfig.clock, writeConfig.data,
+                                     writeConfig.latch, readConfig.numDevices, writeConfig.numDevices) {
 }
 
 ShiftRegisterIoAbstraction::ShiftRegisterIoAbstraction(pinid_t readClockPin, pinid_t readDataPin, pinid_t readLatchPin, pinid_t writeClockPin, pinid_t writeDataPin,
@@ -66,30 +101,44 @@ ShiftRegisterIoAbstraction::ShiftRegisterIoAbstraction(pinid_t readClockPin, pin
 	this->readClockPin = readClockPin;
 	this->readDataPin = readDataPin;
 	this->readLatchPin = readLatchPin;
-	this->numOfDevicesRead = noReadDevices;
+	// inputs must stay below the output cutover, so at most four input devices are supported.
+	this->numOfDevicesRead = min(noReadDevices, uint8_t(SHIFT_REGISTER_OUTPUT_CUTOVER / 8));
 	this->writeLatchPin = writeLatchPin;
 	this->writeDataPin = writeDataPin;
 	this->writeClockPin = writeClockPin;
-	this->numOfDevicesWrite = noWriteDevices;
-	this->lastRead = toWrite = 0;
+	this->numOfDevicesWrite = (noWriteDevices > MAX_SHIFT_REG_WRITE_DEVICES) ? uint8_t(MAX_SHIFT_REG_WRITE_DEVICES) : noWriteDevices;
+	this->lastRead = allocateShiftRegBuffer(numOfDevicesRead);
+	this->toWrite = allocateShiftRegBuffer(numOfDevicesWrite);
+	this->pendingRead = nullptr;
+	this->syncCompleteFn = nullptr;
+	this->completedSyncs = 0;
+	this->syncStep = SHIFTREG_SYNC_IDLE;
+	this->asyncSync = false;
+    needsWrite = true;
     needsInit = true;
 }
 
+ShiftRegisterIoAbstraction::~ShiftRegisterIoAbstraction() {
+    delete[] lastRead;
+    delete[] toWrite;
+    delete[] pendingRead;
+}
+
 void ShiftRegisterIoAbstraction::initDevice() {
     needsWrite = true;
 
     if (writeDataPin != 0xff) {
-        internalDigitalDevice().pinMode(writeLatchPin, OUTPUT);
-        internalDigitalDevice().pinMode(writeDataPin, OUTPUT);
-        internalDigitalDevice().pinMode(writeClockPin, OUTPUT);
-        internalDigitalDevice().digitalWrite(writeLatchPin, LOW);
+        writeLatch.begin(writeLatchPin);
+        writeData.begin(writeDataPin);
+        writeClock.begin(writeClockPin);
+        writeLatch.low();
     }
 
     if (readLatchPin != 0xff) {
-        internalDigitalDevice().pinMode(readLatchPin, OUTPUT);
+        readLatch.begin(readLatchPin);
         internalDigitalDevice().pinMode(readDataPin, INPUT);
-        internalDigitalDevice().pinMode(readClockPin, OUTPUT);
-        internalDigitalDevice().digitalWrite(readLatchPin, HIGH);
+        readClock.begin(readClockPin);
+        readLatch.high();
     }
 
     needsInit = false;
@@ -102,113 +151,202 @@ void ShiftRegisterIoAbstraction::pinDirection(__attribute((unused)) pinid_t pin,
 void ShiftRegisterIoAbstraction::writeValue(pinid_t pin, uint8_t value) {
 	if (pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
 	pin = pin - SHIFT_REGISTER_OUTPUT_CUTOVER;
+	if ((pin / 8) >= numOfDevicesWrite) return;
 
-	bitWrite(toWrite, pin, value);
-	needsWrite = true;
+	uint8_t& current = toWrite[pin / 8];
+	uint8_t newVal = value ? (current | (1U << (pin % 8))) : (current & ~(1U << (pin % 8)));
+	if (newVal != current) {
+		current = newVal;
+		needsWrite = true;
+	}
 }
 
-void ShiftRegisterIoAbstraction::writePort(pinid_t pin, uint8_t portV) {
-	uint32_t portVal = portV;
+void ShiftRegisterIoAbstraction::writePort(pinid_t pin, uint8_t portVal) {
 	if(pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
-	pin = pin - SHIFT_REGISTER_OUTPUT_CUTOVER;
-	if(pin < 8) {
-		toWrite &= 0xffffff00;
-		toWrite |= portVal;
-	}
-	else if(pin < 16) {
-		toWrite &= 0xffff00ff;
-		toWrite |= (portVal << 8);
+	pinid_t device = (pin - SHIFT_REGISTER_OUTPUT_CUTOVER) / 8;
+	if(device >= numOfDevicesWrite) return;
+	if(toWrite[device] != portVal) {
+		toWrite[device] = portVal;
+		needsWrite = true;
 	}
-	else if(pin < 24) {
-		toWrite &= 0xff00ffff;
-		toWrite |= (portVal << 16);
-	}
-	else {
-		toWrite &= 0x00ffffff;
-		toWrite |= (portVal << 24);
-	}
-	needsWrite = true;
 }
 
 uint8_t ShiftRegisterIoAbstraction::readPort(pinid_t pin) {
-    if(pin < 8) {
-		return lastRead & 0xff;
-	}
-	else if(pin < 16) {
-		return (lastRead >> 8) & 0xff;
-	}
-	else if(pin < 24) {
-		return (lastRead >> 16) & 0xff;
-	}
-	else {
-		return (lastRead >> 24) & 0xff;
-	}
+	pinid_t device = pin / 8;
+	return (device < numOfDevicesRead) ? lastRead[device] : 0;
+}
+
+IoPinMask ShiftRegisterIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(startPin >= SHIFT_REGISTER_OUTPUT_CUTOVER) return 0;
+    return shiftRegBufferRead(lastRead, numOfDevicesRead, startPin) & mask;
+}
+
+void ShiftRegisterIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(startPin < SHIFT_REGISTER_OUTPUT_CUTOVER) {
+        // skip over any input pins at the start of the mask.
+        uint8_t toSkip = SHIFT_REGISTER_OUTPUT_CUTOVER - startPin;
+        if(toSkip >= 32) return;
+        mask >>= toSkip;
+        values >>= toSkip;
+        startPin = SHIFT_REGISTER_OUTPUT_CUTOVER;
+    }
+    if(mask == 0) return;
+
+    if(shiftRegBufferWrite(toWrite, numOfDevicesWrite, startPin - SHIFT_REGISTER_OUTPUT_CUTOVER, mask, values)) {
+        needsWrite = true;
+    }
 }
 
 uint8_t ShiftRegisterIoAbstraction::readValue(pinid_t pin) {
-    return ((lastRead & (1 << pin)) != 0) ? HIGH : LOW;
+    if((pin / 8) >= numOfDevicesRead) return LOW;
+    return ((lastRead[pin / 8] & (1U << (pin % 8))) != 0) ? HIGH : LOW;
 }
 
 bool ShiftRegisterIoAbstraction::runLoop() {
     if(needsInit) initDevice();
 
+    if(asyncSync) {
+        startAsyncSync();
+        return true;
+    }
+
 	uint8_t i;
 	if (readDataPin != 0xff) {
-		internalDigitalDevice().digitalWriteS(readLatchPin, LOW);
+		readLatch.low();
         taskManager.yieldForMicros(LATCH_TIME);
-        internalDigitalDevice().digitalWriteS(readLatchPin, HIGH);
+        readLatch.high();
 
-		lastRead = 0;
-		for(i = 0; i < numOfDevicesRead; ++i) {
-			lastRead = lastRead << 8;
-			lastRead |= (shiftIn(readDataPin, readClockPin, MSBFIRST) & 0xff);
+		// the device furthest along the chain arrives first, it holds the highest numbered pins.
+		for(i = numOfDevicesRead; i > 0; --i) {
+			lastRead[i - 1] = fastShiftIn();
 		}
 	}
 	
 	if (writeDataPin != 0xff && needsWrite) {
-        internalDigitalDevice().digitalWriteS(writeLatchPin, LOW);
+        writeLatch.low();
         taskManager.yieldForMicros(LATCH_TIME);
 		
-		uint32_t shiftLocal = toWrite;
 		for(i = 0; i < numOfDevicesWrite; ++i) {
-			uint8_t regVal = (shiftLocal & 0xff);
-			shiftOut(writeDataPin, writeClockPin, MSBFIRST, regVal);
-			shiftLocal = shiftLocal >> 8;
+			fastShiftOut(toWrite[i]);
 		}
 		needsWrite = false;
-        internalDigitalDevice().digitalWriteS(writeLatchPin, HIGH);
+        writeLatch.high();
 	}
 	return true;
 }
 
+void ShiftRegisterIoAbstraction::setAsyncSync(bool async, ShiftRegSyncCompleteFn onComplete) {
+    if(async && pendingRead == nullptr) pendingRead = allocateShiftRegBuffer(numOfDevicesRead);
+    syncCompleteFn = onComplete;
+    asyncSync = async;
+}
+
+void ShiftRegisterIoAbstraction::startAsyncSync() {
+    if(syncStep != SHIFTREG_SYNC_IDLE) return;
+
+    if (readDataPin != 0xff) {
+        readLatch.low();
+        scheduleSyncStep(SHIFTREG_SYNC_INPUT_LOADING);
+    }
+    else if (writeDataPin != 0xff && needsWrite) {
+        writeLatch.low();
+        scheduleSyncStep(SHIFTREG_SYNC_OUTPUT_LATCHING);
+    }
+    else {
+        // nothing to transfer, but the caller is still told that the sync has completed.
+        completeAsyncSync();
+    }
+}
+
+void ShiftRegisterIoAbstraction::exec() {
+    if(syncStep == SHIFTREG_SYNC_INPUT_LOADING) {
+        readLatch.high();
+        for(uint8_t i = numOfDevicesRead; i > 0; --i) {
+            pendingRead[i - 1] = fastShiftIn();
+        }
+
+        if (writeDataPin != 0xff && needsWrite) {
+            writeLatch.low();
+            scheduleSyncStep(SHIFTREG_SYNC_OUTPUT_LATCHING);
+            return;
+        }
+    }
+    else if(syncStep == SHIFTREG_SYNC_OUTPUT_LATCHING) {
+        // any writes made after this point set needsWrite again, and are picked up by the next sync.
+        needsWrite = false;
+        for(uint8_t i = 0; i < numOfDevicesWrite; ++i) {
+            fastShiftOut(toWrite[i]);
+        }
+        writeLatch.high();
+    }
+    else return;
+
+    completeAsyncSync();
+}
+
+void ShiftRegisterIoAbstraction::scheduleSyncStep(ShiftRegSyncStep step) {
+    syncStep = step;
+    if(taskManager.scheduleOnce(LATCH_TIME, this, TIME_MICROS) == TASKMGR_INVALIDID) {
+        // no task slot is free, so the rest of this sync runs straight away, waiting for the latch as a blocking
+        // sync does, and it completes as usual, leaving the sync idle again.
+        serlogF(SER_WARNING, "Shift reg sync step not scheduled");
+        taskManager.yieldForMicros(LATCH_TIME);
+        exec();
+    }
+}
+
+void ShiftRegisterIoAbstraction::completeAsyncSync() {
+    if (readDataPin != 0xff && numOfDevicesRead != 0) {
+        memcpy(lastRead, pendingRead, numOfDevicesRead);
+    }
+    syncStep = SHIFTREG_SYNC_IDLE;
+    completedSyncs++;
+    if(syncCompleteFn) syncCompleteFn(this);
+}
+
+uint8_t ShiftRegisterIoAbstraction::fastShiftIn() {
+    // same timing as the Arduino shiftIn with MSBFIRST, read each bit while the clock is high.
+    uint8_t value = 0;
+    for(int8_t i = 7; i >= 0; --i) {
+        readClock.high();
+        value |= (internalDigitalDevice().digitalRead(readDataPin) << i);
+        readClock.low();
+    }
+    return value;
+}
+
+void ShiftRegisterIoAbstraction::fastShiftOut(uint8_t val) {
+    // same as the Arduino shiftOut with MSBFIRST, the data is clocked in on the rising edge.
+    for(int8_t i = 7; i >= 0; --i) {
+        writeData.write((val >> i) & 0x01);
+        writeClock.high();
+        writeClock.low();
+    }
+}
+
 // helper functions to create the abstractions.
 
 IoAbstractionRef outputOnlyFromShiftRegister(uint8_t writeClkPin, uint8_t dataPin, uint8_t latchPin, uint8_t numOfDevices) {
-    return new ShiftRegisterIoAbstraction(0xff, 0xff, 0xff, writeClkPin, dataPin, latchPin, 1, numOfDevices);
+    return ioaCreate<ShiftRegisterIoAbstraction>(0xff, 0xff, 0xff, writeClkPin, dataPin, latchPin, 1, numOfDevices);
 }
 
 IoAbstractionRef inputOnlyFromShiftRegister(uint8_t readClkPin, uint8_t dataPin, uint8_t latchPin, uint8_t numOfDevices) {
-    return new ShiftRegisterIoAbstraction(readClkPin, dataPin, latchPin, 0xff, 0xff, 0xff, numOfDevices, 1);
+    return ioaCreate<ShiftRegisterIoAbstraction>(readClkPin, dataPin, latchPin, 0xff, 0xff, 0xff, numOfDevices, 1);
 }
 
 IoAbstractionRef inputOutputFromShiftRegister(uint8_t readClockPin, uint8_t readDataPin, uint8_t readLatchPin, uint8_t numOfReadDevices,
                                               uint8_t writeClockPin, uint8_t writeDataPin, uint8_t writeLatchPin, uint8_t numOfWriteDevices) {
-    return new ShiftRegisterIoAbstraction(readClockPin, readDataPin, readLatchPin, writeClockPin, writeDataPin, writeLatchPin, numOfReadDevices, numOfWriteDevices);
+    return ioaCreate<ShiftRegisterIoAbstraction>(readClockPin, readDataPin, readLatchPin, writeClockPin, writeDataPin, writeLatchPin, numOfReadDevices, numOfWriteDevices);
 }
 
 IoAbstractionRef inputOutputFromShiftRegister(uint8_t readClockPin, uint8_t readDataPin, uint8_t readLatchPin,
                                               uint8_t writeClockPin, uint8_t writeDataPin, uint8_t writeLatchPin) {
-    return new ShiftRegisterIoAbstraction(readClockPin, readDataPin, readLatchPin, writeClockPin, writeDataPin, writeLatchPin, 1, 1);
+    return ioaCreate<ShiftRegisterIoAbstraction>(readClockPin, readDataPin, readLatchPin, writeClockPin, writeDataPin, writeLatchPin, 1, 1);
 }
 
 
-ShiftRegisterIoAbstraction165In::ShiftRegisterIoAbstraction165In(ShiftRegConfig config) {
-    this->readLatchPin = config.latch;
-    this->readClockPin = config.clock;
-    this->readDataPin = config.data;
-    this->numOfDevicesRead = config.numDevices;
-    needsInit = true;
-    lastRead = 0;
+ShiftRegisterIoAbstraction165In::ShiftRegisterIoAbstraction165In(ShiftRegConfig config)
+        : ShiftRegisterIoAbstraction165In(config.clock, config.data, config.latch, config.numDevices) {
 }
 
 ShiftRegisterIoAbstraction165In::ShiftRegisterIoAbstraction165In(pinid_t readClockPin, pinid_t readDataPin,
@@ -216,17 +354,26 @@ ShiftRegisterIoAbstraction165In::ShiftRegisterIoAbstraction165In(pinid_t readClo
     this->readClockPin = readClockPin;
     this->readDataPin = readDataPin;
     this->readLatchPin = readLatchPin;
-    this->lastRead = 0;
-    this->numOfDevicesRead = numRead;
+    this->numOfDevicesRead = (numRead > 255) ? 255 : numRead;
     this->needsInit = true;
-    this->lastRead = 0;
+    this->lastRead = allocateShiftRegBuffer(numOfDevicesRead);
+    this->pendingRead = nullptr;
+    this->syncCompleteFn = nullptr;
+    this->completedSyncs = 0;
+    this->syncStep = SHIFTREG_SYNC_IDLE;
+    this->asyncSync = false;
+}
+
+ShiftRegisterIoAbstraction165In::~ShiftRegisterIoAbstraction165In() {
+    delete[] lastRead;
+    delete[] pendingRead;
 }
 
 void ShiftRegisterIoAbstraction165In::initDevice() {
-    internalDigitalDevice().pinMode(readLatchPin, OUTPUT);
+    readLatch.begin(readLatchPin);
     internalDigitalDevice().pinMode(readDataPin, INPUT);
-    internalDigitalDevice().pinMode(readClockPin, OUTPUT);
-    internalDigitalDevice().digitalWrite(readLatchPin, HIGH);
+    readClock.begin(readClockPin);
+    readLatch.high();
 
     needsInit = false;
 }
@@ -235,150 +382,412 @@ void ShiftRegisterIoAbstraction165In::initDevice() {
 uint8_t ShiftRegisterIoAbstraction165In::readPort(pinid_t pin) {
     if(needsInit) initDevice();
 
-    if(pin < 8) {
-        return lastRead & 0xff;
-    }
-    else if(pin < 16) {
-        return (lastRead >> 8) & 0xff;
-    }
-    else if(pin < 24) {
-        return (lastRead >> 16) & 0xff;
-    }
-    else {
-        return (lastRead >> 24) & 0xff;
-    }
+    pinid_t device = pin / 8;
+    return (device < numOfDevicesRead) ? lastRead[device] : 0;
+}
+
+IoPinMask ShiftRegisterIoAbstraction165In::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(needsInit) initDevice();
+
+    return shiftRegBufferRead(lastRead, numOfDevicesRead, startPin) & mask;
 }
 
 uint8_t ShiftRegisterIoAbstraction165In::readValue(pinid_t pin) {
     if(needsInit) initDevice();
 
-    return ((lastRead & (1 << pin)) != 0) ? HIGH : LOW;
+    if((pin / 8) >= numOfDevicesRead) return LOW;
+    return ((lastRead[pin / 8] & (1U << (pin % 8))) != 0) ? HIGH : LOW;
 }
 
 bool ShiftRegisterIoAbstraction165In::runLoop() {
     if(needsInit) initDevice();
 
-    uint8_t i;
-    internalDigitalDevice().digitalWriteS(readLatchPin, LOW);
+    if(asyncSync) {
+        // start a sync unless one is in progress, the inputs are read once the load pin has settled, in exec.
+        if(syncStep == SHIFTREG_SYNC_IDLE) {
+            readLatch.low();
+            syncStep = SHIFTREG_SYNC_INPUT_LOADING;
+            if(taskManager.scheduleOnce(LATCH_TIME, this, TIME_MICROS) == TASKMGR_INVALIDID) {
+                // no task slot is free, so this sync completes straight away, as a blocking sync would.
+                serlogF(SER_WARNING, "Shift reg sync step not scheduled");
+                taskManager.yieldForMicros(LATCH_TIME);
+                exec();
+            }
+        }
+        return true;
+    }
+
+    readLatch.low();
     taskManager.yieldForMicros(LATCH_TIME);
-    internalDigitalDevice().digitalWriteS(readLatchPin, HIGH);
+    readLatch.high();
 
-    lastRead = 0;
-    for(i = 0; i < numOfDevicesRead; ++i) {
-        lastRead = lastRead << 8;
-        lastRead |= (shiftInFor165() & 0xff);
+    // the device furthest along the chain arrives first, it holds the highest numbered pins.
+    for(uint8_t i = numOfDevicesRead; i > 0; --i) {
+        lastRead[i - 1] = shiftInFor165();
     }
 
     return true;
 }
 
+void ShiftRegisterIoAbstraction165In::setAsyncSync(bool async, ShiftRegSyncCompleteFn onComplete) {
+    if(async && pendingRead == nullptr) pendingRead = allocateShiftRegBuffer(numOfDevicesRead);
+    syncCompleteFn = onComplete;
+    asyncSync = async;
+}
+
+void ShiftRegisterIoAbstraction165In::exec() {
+    if(syncStep != SHIFTREG_SYNC_INPUT_LOADING) return;
+
+    readLatch.high();
+    for(uint8_t i = numOfDevicesRead; i > 0; --i) {
+        pendingRead[i - 1] = shiftInFor165();
+    }
+    if(numOfDevicesRead != 0) memcpy(lastRead, pendingRead, numOfDevicesRead);
+
+    syncStep = SHIFTREG_SYNC_IDLE;
+    completedSyncs++;
+    if(syncCompleteFn) syncCompleteFn(this);
+}
+
 uint8_t ShiftRegisterIoAbstraction165In::shiftInFor165() const {
     uint8_t value = 0;
 
     for (int8_t i = 7; i >= 0; --i) {
-        internalDigitalDevice().digitalWriteS(readClockPin, LOW);
+        readClock.low();
         value |= (internalDigitalDevice().digitalRead(readDataPin) << i);
-        internalDigitalDevice().digitalWriteS(readClockPin, HIGH);
+        readClock.high();
     }
     return value;
 }
 
 IoAbstractionRef inputFrom74HC165ShiftRegister(pinid_t readClkPin, pinid_t dataPin, pinid_t latchPin, pinid_t numOfDevices) {
-    return new ShiftRegisterIoAbstraction165In(readClkPin, dataPin, latchPin, numOfDevices);
+    return ioaCreate<ShiftRegisterIoAbstraction165In>(readClkPin, dataPin, latchPin, numOfDevices);
 }
 
 MultiIoAbstraction::MultiIoAbstraction(pinid_t arduinoPinsNeeded) {
+	delegateCapacity = MAX_ALLOWABLE_DELEGATES;
+	delegates = new IoAbstractionRef[delegateCapacity];
+	limits = new pinid_t[delegateCapacity];
+	delegateFlags = new uint8_t[delegateCapacity];
 	limits[0] = arduinoPinsNeeded;
 	delegates[0] = internalDigitalIo();
+	delegateFlags[0] = MULTIIO_DELEGATE_WRITE_PENDING;
 	numDelegates = 1;
+	routeTable = nullptr;
+	routeTableSize = 0;
+	frameInputs = nullptr;
+	frameBuffers[0] = frameBuffers[1] = nullptr;
+	frameTimestamp = 0;
+	frameNumber = 0;
+	frameBytes = 0;
+	frontFrame = 0;
+	frameMode = MULTIIO_FRAME_OFF;
+	frameValid = false;
+	rebuildRouteTable();
+	allocateFrameBuffers();
 }
 
 MultiIoAbstraction::~MultiIoAbstraction() {
-	// delegates added are our responsibility to clean up
-	for(uint8_t i=0; i<numDelegates; ++i) {
-		delete delegates[i];
+	// delegates added are our responsibility to clean up, but the first is always the device pins, which is global.
+	for(uint8_t i=1; i<numDelegates; ++i) {
+		ioaDestroy(delegates[i]);
 	}
+	delete[] delegates;
+	delete[] limits;
+	delete[] delegateFlags;
+	delete[] routeTable;
+	delete[] frameInputs;
+	delete[] frameBuffers[0];
+	delete[] frameBuffers[1];
 }
 
 void MultiIoAbstraction::addIoExpander(IoAbstractionRef expander, pinid_t numOfPinsNeeded) {
+	if(numDelegates == 255) {
+		serlogF2(SER_ERROR, "MultiIo full, pins lost ", numOfPinsNeeded);
+		return;
+	}
+
+	if(numDelegates == delegateCapacity) {
+		uint8_t newCapacity = (delegateCapacity > 127) ? 255 : delegateCapacity * 2;
+		auto* newDelegates = new IoAbstractionRef[newCapacity];
+		auto* newLimits = new pinid_t[newCapacity];
+		auto* newFlags = new uint8_t[newCapacity];
+		for(uint8_t i=0; i<numDelegates; ++i) {
+			newDelegates[i] = delegates[i];
+			newLimits[i] = limits[i];
+			newFlags[i] = delegateFlags[i];
+		}
+		delete[] delegates;
+		delete[] limits;
+		delete[] delegateFlags;
+		delegates = newDelegates;
+		limits = newLimits;
+		delegateFlags = newFlags;
+		delegateCapacity = newCapacity;
+	}
+
 	limits[numDelegates]= limits[numDelegates - 1] + numOfPinsNeeded;
 	delegates[numDelegates] = expander;
+	// every expander is synced at least once, so that it gets initialised.
+	delegateFlags[numDelegates] = MULTIIO_DELEGATE_WRITE_PENDING;
 
 	numDelegates++;
-}
+	rebuildRouteTable();
+	allocateFrameBuffers();
+}
+
+void MultiIoAbstraction::rebuildRouteTable() {
+	// one entry per block of pins, holding the delegate that owns the first pin of that block.
+	pinid_t totalPins = limits[numDelegates - 1];
+	pinid_t newSize = (totalPins + (1U << MULTIIO_ROUTE_SHIFT) - 1U) >> MULTIIO_ROUTE_SHIFT;
+	if(newSize != routeTableSize) {
+		delete[] routeTable;
+		routeTable = (newSize != 0) ? new uint8_t[newSize] : nullptr;
+		routeTableSize = newSize;
+	}
 
-uint8_t MultiIoAbstraction::doExpanderOp(pinid_t pin, uint8_t aVal, ExpanderOpFn fn) {
-	uint8_t ret = -1;
-	for(uint8_t i=0; i<numDelegates; ++i) {
-		// when we are on the first expander, the "previous" last pin is 0.
-		uint8_t last = (i==0) ? 0 : limits[i-1];
+	uint8_t idx = 0;
+	for(pinid_t block = 0; block < routeTableSize; ++block) {
+		pinid_t firstPin = block << MULTIIO_ROUTE_SHIFT;
+		while(idx < (numDelegates - 1) && firstPin >= limits[idx]) idx++;
+		routeTable[block] = idx;
+	}
+}
 
-		// then we find the limit of the expander we are on
-		uint8_t currLimit = limits[i];
+bool MultiIoAbstraction::delegateForPin(pinid_t pin, uint8_t& idx) const {
+	pinid_t block = pin >> MULTIIO_ROUTE_SHIFT;
+	if(block >= routeTableSize) return false;
 
-		// and check if we have a match!
-		if(pin >= last && pin < currLimit) {
-			ret = fn(delegates[i], pin - last, aVal);
-			break;
-		}
+	// the block gives the owner of its first pin, only when a delegate starts part way into the block do we
+	// need to move on, so this is at most a few steps.
+	idx = routeTable[block];
+	while(pin >= limits[idx]) {
+		if(++idx >= numDelegates) return false;
 	}
-	return ret;
+	return true;
+}
+
+uint8_t MultiIoAbstraction::doExpanderOp(pinid_t pin, uint8_t aVal, ExpanderOpFn fn, uint8_t flagsToSet) {
+	uint8_t idx;
+	if(!delegateForPin(pin, idx)) return -1;
+	delegateFlags[idx] |= flagsToSet;
+
+	// when we are on the first expander, the "previous" last pin is 0.
+	pinid_t last = (idx==0) ? 0 : limits[idx-1];
+	return fn(delegates[idx], pin - last, aVal);
+}
+
+// pin modes may need writing out to the device on the next sync, and inputs need syncing from then on.
+static uint8_t delegateFlagsForMode(uint8_t mode) {
+	return (mode == OUTPUT) ? MULTIIO_DELEGATE_WRITE_PENDING : (MULTIIO_DELEGATE_WRITE_PENDING | MULTIIO_DELEGATE_HAS_INPUTS);
 }
 
 void MultiIoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
+	markFrameInputs(pin, 1, mode);
 	doExpanderOp(pin, mode, [](IoAbstractionRef a, uint8_t p, uint8_t v) {
 		a->pinDirection(p, v);
 		return (uint8_t)0;
-	});
+	}, delegateFlagsForMode(mode));
 }
 
 void MultiIoAbstraction::writeValue(pinid_t pin, uint8_t value) {
 	doExpanderOp(pin, value, [](IoAbstractionRef a, uint8_t p, uint8_t v) {
 		a->writeValue(p, v);
 		return (uint8_t)0;
-	});
+	}, MULTIIO_DELEGATE_WRITE_PENDING);
 }
 
 uint8_t MultiIoAbstraction::readValue(pinid_t pin) {
+	if(isFramePin(pin)) return bitRead(frameBuffers[frontFrame][pin / 8], pin % 8);
 	return doExpanderOp(pin, 0, [](IoAbstractionRef a, uint8_t p, uint8_t) {
 		uint8_t retn = a->readValue(p);
 		return retn;
-	});
+	}, MULTIIO_DELEGATE_HAS_INPUTS);
 }
 
 void MultiIoAbstraction::writePort(pinid_t pin, uint8_t val) {
 	doExpanderOp(pin, val, [](IoAbstractionRef a, uint8_t p, uint8_t v) {
 		a->writePort(p, v);
 		return (uint8_t)0;
-	});
+	}, MULTIIO_DELEGATE_WRITE_PENDING);
 }
 
 uint8_t MultiIoAbstraction::readPort(pinid_t pin) {
 	return doExpanderOp(pin, 0, [](IoAbstractionRef a, uint8_t p, uint8_t) {
 		return a->readPort(p);
-	});
+	}, MULTIIO_DELEGATE_HAS_INPUTS);
 }
 
-void MultiIoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
-	for(uint8_t i=0; i<numDelegates; ++i) {
-		// when we are on the first expander, the "previous" last pin is 0.
-		uint8_t last = (i==0) ? 0 : limits[i-1];
+IoPinMask MultiIoAbstraction::maskForDelegate(uint8_t idx, pinid_t startPin, IoPinMask mask, pinid_t& delegatePin, uint8_t& maskOffset) {
+	int last = (idx==0) ? 0 : limits[idx-1];
+	int currLimit = limits[idx];
+
+	// find the first pin in the mask that this delegate owns, and how far into the mask it is.
+	int first = (startPin > last) ? startPin : last;
+	if(first >= currLimit || (first - startPin) >= 32) return 0;
+	maskOffset = first - startPin;
+	delegatePin = first - last;
+
+	// then remove any bits that belong to delegates after this one.
+	IoPinMask delegateMask = mask >> maskOffset;
+	int pinsInDelegate = currLimit - first;
+	if(pinsInDelegate < 32) delegateMask &= (IoPinMask(1U) << pinsInDelegate) - 1U;
+	return delegateMask;
+}
+
+IoPinMask MultiIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+	if(!frameValid) return readDelegatePins(startPin, mask);
 
-		// then we find the limit of the expander we are on
-		uint8_t currLimit = limits[i];
+	// the input pins come from the frame, anything else in the mask is read from its abstraction as usual.
+	IoPinMask inFrame = shiftRegBufferRead(frameInputs, frameBytes, startPin) & mask;
+	IoPinMask ret = shiftRegBufferRead(frameBuffers[frontFrame], frameBytes, startPin) & inFrame;
+	IoPinMask liveMask = mask & ~inFrame;
+	if(liveMask != 0) ret |= readDelegatePins(startPin, liveMask);
+	return ret;
+}
+
+IoPinMask MultiIoAbstraction::readDelegatePins(pinid_t startPin, IoPinMask mask) {
+	IoPinMask ret = 0;
+	uint8_t first;
+	if(!delegateForPin(startPin, first)) return 0;
+	for(uint8_t i=first; i<numDelegates; ++i) {
+		if(i != first && (limits[i-1] - startPin) >= 32) break;
+		pinid_t delegatePin = 0;
+		uint8_t offset = 0;
+		IoPinMask delegateMask = maskForDelegate(i, startPin, mask, delegatePin, offset);
+		if(delegateMask != 0) {
+			ret |= delegates[i]->readPinMask(delegatePin, delegateMask) << offset;
+			delegateFlags[i] |= MULTIIO_DELEGATE_HAS_INPUTS;
+		}
+	}
+	return ret;
+}
 
-		// and check if we have a match!
-		if(pin >= last && pin < currLimit) {
-			delegates[i]->attachInterrupt(pin - last, intHandler, mode);
-			break;
+void MultiIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+	uint8_t first;
+	if(!delegateForPin(startPin, first)) return;
+	for(uint8_t i=first; i<numDelegates; ++i) {
+		if(i != first && (limits[i-1] - startPin) >= 32) break;
+		pinid_t delegatePin = 0;
+		uint8_t offset = 0;
+		IoPinMask delegateMask = maskForDelegate(i, startPin, mask, delegatePin, offset);
+		if(delegateMask != 0) {
+			delegates[i]->writePinMask(delegatePin, delegateMask, values >> offset);
+			delegateFlags[i] |= MULTIIO_DELEGATE_WRITE_PENDING;
 		}
 	}
 }
 
+void MultiIoAbstraction::pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+	markFrameInputs(startPin, mask, mode);
+	uint8_t first;
+	if(!delegateForPin(startPin, first)) return;
+	for(uint8_t i=first; i<numDelegates; ++i) {
+		if(i != first && (limits[i-1] - startPin) >= 32) break;
+		pinid_t delegatePin = 0;
+		uint8_t offset = 0;
+		IoPinMask delegateMask = maskForDelegate(i, startPin, mask, delegatePin, offset);
+		if(delegateMask != 0) {
+			delegates[i]->pinDirectionMask(delegatePin, delegateMask, mode);
+			delegateFlags[i] |= delegateFlagsForMode(mode);
+		}
+	}
+}
+
+void MultiIoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
+	uint8_t idx;
+	if(!delegateForPin(pin, idx)) return;
+
+	pinid_t last = (idx==0) ? 0 : limits[idx-1];
+	delegates[idx]->attachInterrupt(pin - last, intHandler, mode);
+	delegateFlags[idx] |= MULTIIO_DELEGATE_HAS_INPUTS;
+}
+
 bool MultiIoAbstraction::runLoop() {
 	bool runStatus = true;
 	for(uint8_t i=0; i<numDelegates; ++i) {
-		runStatus = runStatus && delegates[i]->runLoop();
+		uint8_t flags = delegateFlags[i];
+		if((flags & (MULTIIO_DELEGATE_WRITE_PENDING | MULTIIO_DELEGATE_HAS_INPUTS)) == 0) continue;
+
+		// every delegate is synced even when an earlier one fails, a failed sync keeps its writes pending for retry.
+		if(delegates[i]->runLoop()) {
+			flags &= ~(MULTIIO_DELEGATE_WRITE_PENDING | MULTIIO_DELEGATE_SYNC_FAILED);
+		}
+		else {
+			flags |= MULTIIO_DELEGATE_SYNC_FAILED;
+			runStatus = false;
+		}
+		delegateFlags[i] = flags;
+	}
+
+	// a double buffered frame is only published when it is complete, so a failed sync keeps the previous frame.
+	if(frameMode == MULTIIO_FRAME_SINGLE || (frameMode == MULTIIO_FRAME_DOUBLE && runStatus)) {
+		captureFrame();
 	}
 	return runStatus;
 }
+
+void MultiIoAbstraction::setFrameCapture(MultiIoFrameMode mode) {
+	frameMode = mode;
+	allocateFrameBuffers();
+}
+
+void MultiIoAbstraction::allocateFrameBuffers() {
+	// the buffer helpers take a byte length, which limits frames to the first 2040 pins.
+	pinid_t totalPins = limits[numDelegates - 1];
+	uint8_t needed = (totalPins >= 2040U) ? 255 : uint8_t((totalPins + 7U) / 8U);
+	bool capturing = frameMode != MULTIIO_FRAME_OFF;
+	bool doubleBuffered = frameMode == MULTIIO_FRAME_DOUBLE;
+	if(needed == frameBytes && capturing == (frameBuffers[0] != nullptr) && doubleBuffered == (frameBuffers[1] != nullptr)) return;
+
+	// the input map is kept whatever the mode, so pins set up before frame capture was turned on are still captured.
+	if(needed != frameBytes) {
+		auto* newInputs = (needed != 0) ? new uint8_t[needed]() : nullptr;
+		for(uint8_t i=0; i<needed && i<frameBytes; ++i) {
+			newInputs[i] = frameInputs[i];
+		}
+		delete[] frameInputs;
+		frameInputs = newInputs;
+	}
+
+	// reads go to the abstractions until the next capture.
+	delete[] frameBuffers[0];
+	delete[] frameBuffers[1];
+	frameBuffers[0] = (needed != 0 && capturing) ? new uint8_t[needed]() : nullptr;
+	frameBuffers[1] = (needed != 0 && doubleBuffered) ? new uint8_t[needed]() : nullptr;
+	frameBytes = needed;
+	frontFrame = 0;
+	frameValid = false;
+}
+
+void MultiIoAbstraction::markFrameInputs(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+	if(frameInputs == nullptr || startPin >= (pinid_t(frameBytes) * 8U)) return;
+	bool input = mode != OUTPUT;
+	// a pin that becomes an input is not in the frame yet, so reads go to the abstractions until the next capture.
+	if(input && (shiftRegBufferRead(frameInputs, frameBytes, startPin) & mask) != mask) frameValid = false;
+	shiftRegBufferWrite(frameInputs, frameBytes, startPin, mask, input ? mask : 0);
+}
+
+bool MultiIoAbstraction::isFramePin(pinid_t pin) const {
+	return frameValid && pin < (pinid_t(frameBytes) * 8U) && bitRead(frameInputs[pin / 8], pin % 8);
+}
+
+bool MultiIoAbstraction::captureFrame() {
+	if(frameBuffers[0] == nullptr) return false;
+	uint8_t target = (frameBuffers[1] != nullptr) ? uint8_t(1U - frontFrame) : frontFrame;
+	unsigned int framePins = frameBytes * 8U;
+	pinid_t totalPins = limits[numDelegates - 1];
+	if(totalPins < framePins) framePins = totalPins;
+
+	// each block of 32 pins is read in one go, each abstraction reading its own part of the block as efficiently as it can.
+	for(unsigned int pin = 0; pin < framePins; pin += 32) {
+		IoPinMask inputs = shiftRegBufferRead(frameInputs, frameBytes, pin);
+		if(inputs == 0) continue;
+		shiftRegBufferWrite(frameBuffers[target], frameBytes, pin, inputs, readDelegatePins(pin, inputs));
+	}
+	frameTimestamp = micros();
+	frameNumber++;
+	frontFrame = target;
+	frameValid = true;
+	return true;
+}
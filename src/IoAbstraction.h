@@ -15,6 +15,8 @@
  */
 #include "PlatformDetermination.h"
 #include "BasicIoAbstraction.h"
+#include "FastDigitalPin.h"
+#include "IoaStaticAllocation.h"
 
 #define SHIFT_REGISTER_OUTPUT_CUTOVER 32
 
@@ -38,18 +40,63 @@ struct ShiftRegConfig {
     ShiftRegConfig() : clock(IO_PIN_NOT_DEFINED), data(IO_PIN_NOT_DEFINED), latch(IO_PIN_NOT_DEFINED), numDevices(0) {}
 };
 
+/**
+ * Reads up to 32 bits from a shift register byte buffer, where byte 0 holds bits 0..7, byte 1 bits 8..15 and so on.
+ * Any bits beyond the end of the buffer are read as 0.
+ * @param buffer the byte buffer
+ * @param len the length of the buffer in bytes
+ * @param startBit the bit that is returned in bit 0 of the result
+ * @return the bits from startBit onwards
+ */
+IoPinMask shiftRegBufferRead(const uint8_t* buffer, uint8_t len, unsigned int startBit);
+
+/**
+ * Writes up to 32 bits into a shift register byte buffer laid out as for shiftRegBufferRead, only the bits in the
+ * mask are changed and any that fall beyond the end of the buffer are ignored.
+ * @param buffer the byte buffer
+ * @param len the length of the buffer in bytes
+ * @param startBit the bit that bit 0 of the mask and values refers to
+ * @param mask the bits to be written
+ * @param values the values for the bits
+ * @return true if any bit in the buffer actually changed
+ */
+bool shiftRegBufferWrite(uint8_t* buffer, uint8_t len, unsigned int startBit, IoPinMask mask, IoPinMask values);
+
+/**
+ * Called on task manager when an asynchronous shift register sync has completed, see setAsyncSync on the shift
+ * register abstractions. At this point the input snapshot has been updated and the outputs latched.
+ */
+typedef void (*ShiftRegSyncCompleteFn)(BasicIoAbstraction* device);
+
+/**
+ * The steps of an asynchronous shift register sync, each step after idle is run as a separate task manager task.
+ */
+enum ShiftRegSyncStep : uint8_t {
+    /** no sync is in progress */
+    SHIFTREG_SYNC_IDLE,
+    /** the input load pin is low, waiting for the inputs to be captured */
+    SHIFTREG_SYNC_INPUT_LOADING,
+    /** the output latch is low, waiting to shift out the outputs */
+    SHIFTREG_SYNC_OUTPUT_LATCHING
+};
+
 /**
  * Notice that the output range has been moved from 24 to 32 onwards , this is to allow support for
  * up to 4 devices chained together, this is a breaking change from the 1.0.x versions.
  * 
  * An implementation of BasicIoFacilities that supports the ubiquitous shift
- * register, using 74HC165 for input (pins 0 to 23) and a 74HC595 for output (32 onwards).
- * It supports up to three registers in each direction at the moment.
+ * register, using 74HC165 for input (pins 0 to 31) and a 74HC595 for output (32 onwards).
+ * It supports up to four input registers, and output chains of any length, each 595 adds another 8 output pins,
+ * limited only by the range of pinid_t. The state of each chain is held in a byte buffer allocated at construction,
+ * and outputs are only shifted out when a value has actually changed.
+ *
+ * By default sync blocks while the latch settles and the chains are shifted, see setAsyncSync to instead run each
+ * step as a task manager task.
  */
-class ShiftRegisterIoAbstraction : public BasicIoAbstraction {
+class ShiftRegisterIoAbstraction : public BasicIoAbstraction, public Executable {
 private:
-	uint32_t toWrite;
-	uint32_t lastRead;
+	uint8_t* toWrite;
+	uint8_t* lastRead;
 	bool needsWrite;
 
 	uint8_t numOfDevicesRead;
@@ -62,6 +109,26 @@ private:
 	pinid_t writeLatchPin;
 	pinid_t writeClockPin;
     bool needsInit;
+
+    // the clock, data and latch lines are toggled many times per sync, so they are written directly to the device.
+    FastOutputPin readLatch;
+    FastOutputPin readClock;
+    FastOutputPin writeLatch;
+    FastOutputPin writeClock;
+    FastOutputPin writeData;
+
+    // asynchronous sync, inputs are shifted into pendingRead and copied to lastRead once the sync completes.
+    uint8_t* pendingRead;
+    ShiftRegSyncCompleteFn syncCompleteFn;
+    uint16_t completedSyncs;
+    ShiftRegSyncStep syncStep;
+    bool asyncSync;
+
+    uint8_t fastShiftIn();
+    void fastShiftOut(uint8_t val);
+    void startAsyncSync();
+    void scheduleSyncStep(ShiftRegSyncStep step);
+    void completeAsyncSync();
 public:
 	/** 
 	 * Normally use the shift register helper functions to create an instance.
@@ -72,7 +139,7 @@ public:
 	ShiftRegisterIoAbstraction(pinid_t readClockPin, pinid_t readDataPin, pinid_t readLatchPin,
 	                           pinid_t writeClockPin, pinid_t writeDataPin, pinid_t writeLatchPin, uint8_t numRead, uint8_t numWrite);
     ShiftRegisterIoAbstraction(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig);
-	~ShiftRegisterIoAbstraction() override { }
+	~ShiftRegisterIoAbstraction() override;
     void initDevice();
 
 	void pinDirection(pinid_t pin, uint8_t mode) override;
@@ -82,27 +149,76 @@ public:
 	 * Interrupts are not supported on shift registers
 	 */
 	void attachInterrupt(pinid_t, RawIntHandler, uint8_t) override {;}
+	/**
+	 * Syncs the chains, in blocking mode the inputs are read and any changed outputs written before returning. In
+	 * asynchronous mode it starts a sync unless one is already in progress, and returns straight away.
+	 */
 	bool runLoop() override;
+
+	/**
+	 * Turns asynchronous sync on or off. When on, each sync is split into steps that run as task manager tasks, so
+	 * the latch settling time no longer blocks the caller and there are no nested yields. Reads always see the inputs
+	 * from the last completed sync, so a caller such as SwitchInput reads a coherent snapshot even while a sync is
+	 * in progress. Should task manager have no free slot for a step, that sync instead completes before returning,
+	 * as a blocking sync does. Only change this when no sync is in progress, and do not delete the object while one is.
+	 * @param async true to turn on asynchronous sync, false for the default blocking sync
+	 * @param onComplete optionally, called on task manager each time a sync completes
+	 */
+	void setAsyncSync(bool async, ShiftRegSyncCompleteFn onComplete = nullptr);
+
+	/** @return true if an asynchronous sync has been started and not yet completed */
+	bool isSyncInProgress() const { return syncStep != SHIFTREG_SYNC_IDLE; }
+
+	/** @return the number of asynchronous syncs completed, it wraps around, so compare for changes only */
+	uint16_t getCompletedSyncCount() const { return completedSyncs; }
+
+	/** Runs the next step of an asynchronous sync, it is called by task manager and should not be called directly. */
+	void exec() override;
 	
 	/**
-	 * writes to the output shift register - currently always port 0
+	 * writes a whole output device at once, the device is the one that holds the pin, so pins 32..39 are the first
+	 * 595 on the chain, 40..47 the second and so on.
 	 */
 	void writePort(pinid_t port, uint8_t portVal) override;
 
 	/**
-	 * reads from the input shift register - currently always port 3
+	 * reads a whole input device at once from the state cached during the last sync, the device is the one that
+	 * holds the pin, so pins 0..7 are the first 165 on the chain, 8..15 the second and so on.
 	 */
 	uint8_t readPort(pinid_t port) override;
+
+	/**
+	 * reads many input pins at once from the state cached during the last sync, input pins are 0 to 31.
+	 */
+	IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+
+	/**
+	 * writes many output pins at once, output pins start at 32, any input pins in the mask are ignored.
+	 */
+	void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
 };
 
-class ShiftRegisterIoAbstraction165In : public BasicIoAbstraction {
+/**
+ * An input only implementation of BasicIoAbstraction for chains of 74HC165 shift registers, the input pins start
+ * at 0 and each device adds another 8 pins. As there are no outputs, chains can be of any length up to the range of
+ * pinid_t. The state is held in a byte buffer allocated at construction. As with ShiftRegisterIoAbstraction, syncing
+ * can be made asynchronous using setAsyncSync.
+ */
+class ShiftRegisterIoAbstraction165In : public BasicIoAbstraction, public Executable {
 private:
-    uint32_t lastRead;
+    uint8_t* lastRead;
     uint8_t numOfDevicesRead;
     pinid_t readDataPin;
     pinid_t readLatchPin;
     pinid_t readClockPin;
     bool needsInit;
+    FastOutputPin readLatch;
+    FastOutputPin readClock;
+    uint8_t* pendingRead;
+    ShiftRegSyncCompleteFn syncCompleteFn;
+    uint16_t completedSyncs;
+    ShiftRegSyncStep syncStep;
+    bool asyncSync;
 
 public:
     /**
@@ -113,7 +229,7 @@ public:
      */
     ShiftRegisterIoAbstraction165In(pinid_t readClockPin, pinid_t readDataPin, pinid_t readLatchPin, pinid_t numRead);
     ShiftRegisterIoAbstraction165In(ShiftRegConfig config);
-    ~ShiftRegisterIoAbstraction165In() override = default;
+    ~ShiftRegisterIoAbstraction165In() override;
     void initDevice();
 
     /** Input only abstraction, does nothing because only input is supported */
@@ -122,11 +238,26 @@ public:
     uint8_t readValue(pinid_t pin) override;
     bool runLoop() override;
     uint8_t readPort(pinid_t port) override;
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+
+    /**
+     * Turns asynchronous sync on or off, see ShiftRegisterIoAbstraction::setAsyncSync for details.
+     * @param async true to turn on asynchronous sync, false for the default blocking sync
+     * @param onComplete optionally, called on task manager each time a sync completes
+     */
+    void setAsyncSync(bool async, ShiftRegSyncCompleteFn onComplete = nullptr);
+    /** @return true if an asynchronous sync has been started and not yet completed */
+    bool isSyncInProgress() const { return syncStep != SHIFTREG_SYNC_IDLE; }
+    /** @return the number of asynchronous syncs completed, it wraps around, so compare for changes only */
+    uint16_t getCompletedSyncCount() const { return completedSyncs; }
+    /** Runs the next step of an asynchronous sync, it is called by task manager and should not be called directly. */
+    void exec() override;
 
     //
     // Features not implemented on this abstaction
     //
     void writePort(pinid_t port, uint8_t portVal) override { }
+    void writePinMask(pinid_t, IoPinMask, IoPinMask) override { }
     void writeValue(pinid_t pin, uint8_t value) override { }
     void attachInterrupt(pinid_t, RawIntHandler, uint8_t) override { }
 
@@ -136,7 +267,7 @@ public:
 /**
  * performs both input and output functions using two or more shift registers, for both reading and writing.  As shift registers have a fixed direction
  * input and output are handled by different devices, and therefore fixed at the time of building the circuit. This function supports chaining of
- * up to 4 devices for both directions.
+ * up to 4 devices for reading, and any number of devices for writing.
  *
  * This abstraction works as follows:
  *
@@ -192,23 +323,45 @@ IoAbstractionRef inputOnlyFromShiftRegister(uint8_t readClockPin, uint8_t dataPi
 IoAbstractionRef outputOnlyFromShiftRegister(uint8_t writeClockPin, uint8_t writeDataPin, uint8_t writeLatchPin, uint8_t numOfDevicesWrite = 1);
 
 /**
- * Performs input only functions using a 74x165 plugin, the input pins start at 0 up to a maximum of 31, each device
- * adds another 8 pins.
+ * Performs input only functions using a 74x165 plugin, the input pins start at 0, each device adds another 8 pins.
  * @param readClkPin the clock pin of the shift register, used as OUTPUT
  * @param dataPin the data pin of the shift register, used as INPUT
  * @param latchPin the latch pin of the shift register, used as OUTPUT
- * @param numOfDevices the number of devices that are chained together in the usual fashion, range is 1..4
+ * @param numOfDevices the number of devices that are chained together in the usual fashion
  * @return a shift register abstraction as an IoAbstraction ref.
  */
 IoAbstractionRef inputFrom74HC165ShiftRegister(pinid_t readClkPin, pinid_t dataPin, pinid_t latchPin, pinid_t numOfDevices = 1);
 
-// this defines the number of IOExpanders can be put into a multi IO expander.
+// this defines the number of IOExpanders space is initially allocated for in a multi IO expander, it grows as
+// more are added, up to 255 in total.
 #ifndef MAX_ALLOWABLE_DELEGATES
 #define MAX_ALLOWABLE_DELEGATES 8
 #endif // defined MAX_ALLOWABLE_DELEGATES
 
+// pins are routed to delegates in blocks of 2^MULTIIO_ROUTE_SHIFT pins, the routing table needs one byte per block.
+#ifndef MULTIIO_ROUTE_SHIFT
+#define MULTIIO_ROUTE_SHIFT 3
+#endif // defined MULTIIO_ROUTE_SHIFT
+
 typedef uint8_t (*ExpanderOpFn)(IoAbstractionRef ref, uint8_t pin, uint8_t val);
 
+// per delegate flags within MultiIoAbstraction, used to decide which delegates need syncing.
+#define MULTIIO_DELEGATE_WRITE_PENDING 0x01
+#define MULTIIO_DELEGATE_HAS_INPUTS 0x02
+#define MULTIIO_DELEGATE_SYNC_FAILED 0x04
+
+/**
+ * How MultiIoAbstraction presents its input pins to readers, see MultiIoAbstraction::setFrameCapture.
+ */
+enum MultiIoFrameMode : uint8_t {
+	/** every read goes to the owning abstraction, the default */
+	MULTIIO_FRAME_OFF,
+	/** each sync captures all the input pins into one frame that reads are answered from */
+	MULTIIO_FRAME_SINGLE,
+	/** as single, but the capture goes into a second frame that is only published once it is complete */
+	MULTIIO_FRAME_DOUBLE
+};
+
 /** 
  * An implementation of the BasicIoAbstraction that provides support for more than one IOExpander
  * in a single abstraction, along with a single set of Arduino pins.
@@ -219,12 +372,38 @@ typedef uint8_t (*ExpanderOpFn)(IoAbstractionRef ref, uint8_t pin, uint8_t val);
  * and append the additional IO devices during setup. In order to pass such a varable to
  * the ioDevice functions, such as ioDeviceDigitalRead you must put an ampersand in front
  * of the variable to make it into a pointer.
+ *
+ * Pins are routed to the owning abstraction through a table built as each expander is added, with one entry per block
+ * of 2^MULTIIO_ROUTE_SHIFT pins, so finding the owner of a pin does not depend on how many expanders there are.
+ *
+ * On sync, only the abstractions that have pending writes or pin changes, or that have been read from or had input
+ * or interrupt pins configured, are synced. Each is synced regardless of whether the others succeed, see getDelegateSyncStatus.
+ * Every abstraction is synced once after it is added, but after that, only changes made through this multi IO are
+ * seen. Writes made directly on an expander added here are not synced by this multi IO, so either write through the
+ * multi IO, or sync that expander yourself.
+ *
+ * By default each read goes to the owning abstraction when it is made, so pins on different expanders are read at
+ * slightly different times. Where pins on more than one expander must be seen together, such as a chord of keys or an
+ * encoder split across two devices, turn on frame capture with setFrameCapture, see MultiIoFrameMode.
  */
 class MultiIoAbstraction : public BasicIoAbstraction {
 private:
-	IoAbstractionRef delegates[MAX_ALLOWABLE_DELEGATES];
-	pinid_t limits[MAX_ALLOWABLE_DELEGATES];
+	IoAbstractionRef* delegates;
+	pinid_t* limits;
+	uint8_t* routeTable;
+	uint8_t* delegateFlags;
+	pinid_t routeTableSize;
 	uint8_t numDelegates;
+	uint8_t delegateCapacity;
+	// frame capture, a bit per pin for the pins set as inputs, always kept, and one or two frames of captured values.
+	uint8_t* frameInputs;
+	uint8_t* frameBuffers[2];
+	unsigned long frameTimestamp;
+	uint16_t frameNumber;
+	uint8_t frameBytes;
+	uint8_t frontFrame;
+	MultiIoFrameMode frameMode;
+	bool frameValid;
 public:
 	explicit MultiIoAbstraction(pinid_t arduinoPinsNeeded = 100);
 	~MultiIoAbstraction() override;
@@ -268,6 +447,32 @@ public:
 	 */
 	uint8_t readPort(pinid_t port) override;
 
+	/**
+	 * splits the mask up between the abstractions that own each range of pins, each of those is then asked to read
+	 * its part of the mask in its most efficient way.
+	 * @param startPin the pin represented by bit 0 of the mask
+	 * @param mask the pins to be read
+	 */
+	IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+
+	/**
+	 * splits the mask up between the abstractions that own each range of pins, each of those is then asked to write
+	 * its part of the mask in its most efficient way.
+	 * @param startPin the pin represented by bit 0 of the mask
+	 * @param mask the pins to be written
+	 * @param values the values to be written
+	 */
+	void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
+
+	/**
+	 * splits the mask up between the abstractions that own each range of pins, so each one can configure its part
+	 * of the mask in one go where it is able to.
+	 * @param startPin the pin represented by bit 0 of the mask
+	 * @param mask the pins to be configured
+	 * @param mode the mode for all the pins
+	 */
+	void pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) override;
+
 	/**
 	 * delegates attaching an interrupt to the abstraction that owns the pin, see each abstraction
 	 * for more information about how interrupts work with the given device.
@@ -278,11 +483,62 @@ public:
 	void attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) override;
 
 	/**
-	 * will run through all delegate abstractions and sync them
+	 * will run through the delegate abstractions that have pending writes or configured inputs and sync them, a
+	 * delegate that fails does not stop the others being synced, and its writes are retried on the next sync.
+	 * @return true if every delegate synced was successful
 	 */
 	bool runLoop() override;
+
+	/** @return the number of abstractions in this multi IO, including the device pins at index 0 */
+	uint8_t getDelegateCount() const { return numDelegates; }
+
+	/**
+	 * Check how the given abstraction fared on its most recent sync, so that a failing expander can be found.
+	 * @param idx the index of the abstraction, 0 is the device pins, then each expander in the order added
+	 * @return true if the last sync of that abstraction succeeded or it has not been synced yet, false if it failed
+	 */
+	bool getDelegateSyncStatus(uint8_t idx) const { return idx < numDelegates && (delegateFlags[idx] & MULTIIO_DELEGATE_SYNC_FAILED) == 0; }
+
+	/**
+	 * Turns on frame capture, where each sync, after syncing the abstractions, reads every pin that has been set as
+	 * an input through this multi IO into a single frame stamped with one time. Until the next sync, readValue and
+	 * readPinMask answer from that frame for those pins, so everything read in one poll, across all the expanders, is
+	 * from the same capture. Output pins, pins not set as inputs, and readPort are always read from the abstraction.
+	 *
+	 * With MULTIIO_FRAME_DOUBLE, the capture is made into a second frame, and only published when it is complete
+	 * and every abstraction synced, so readers never see a partial frame; should any fail, the previous frame is
+	 * kept, and getFrameNumber does not move on. A capture may also be taken outside of sync with captureFrame.
+	 *
+	 * Pins set as inputs before frame capture is turned on are included, as the input map is kept in every mode.
+	 * Frames cover up to the first 2040 pins. Needs one byte per 8 pins for the input map, and for each frame.
+	 * @param mode the frame mode
+	 */
+	void setFrameCapture(MultiIoFrameMode mode);
+
+	/** @return the frame capture mode */
+	MultiIoFrameMode getFrameCapture() const { return frameMode; }
+
+	/**
+	 * Reads all the input pins into a frame now, without syncing the abstractions first. Sync calls this when frame
+	 * capture is on, so it only needs calling directly to capture at some other time.
+	 * @return true if a frame was captured
+	 */
+	bool captureFrame();
+
+	/** @return the time in micros that the current frame was captured */
+	unsigned long getFrameTimestamp() const { return frameTimestamp; }
+
+	/** @return the number of frames captured, it wraps around so compare for changes only */
+	uint16_t getFrameNumber() const { return frameNumber; }
 private:
-	uint8_t doExpanderOp(pinid_t pin, uint8_t aVal, ExpanderOpFn fn);
+	uint8_t doExpanderOp(pinid_t pin, uint8_t aVal, ExpanderOpFn fn, uint8_t flagsToSet = 0);
+	IoPinMask maskForDelegate(uint8_t idx, pinid_t startPin, IoPinMask mask, pinid_t& delegatePin, uint8_t& maskOffset);
+	bool delegateForPin(pinid_t pin, uint8_t& idx) const;
+	void rebuildRouteTable();
+	IoPinMask readDelegatePins(pinid_t startPin, IoPinMask mask);
+	void allocateFrameBuffers();
+	void markFrameInputs(pinid_t startPin, IoPinMask mask, uint8_t mode);
+	bool isFramePin(pinid_t pin) const;
 };
 
 /**
@@ -295,7 +551,7 @@ typedef MultiIoAbstraction* MultiIoAbstractionRef;
  * Create a multiIoExpander by adding together more than one IoAbstraction, for example Arduino pins plus a few 8574 devices.
  * @param arduinoPinRange the number of pins to assign to Arduino.
  */ 
-inline MultiIoAbstractionRef multiIoExpander(pinid_t arduinoPinRange) { return new MultiIoAbstraction(arduinoPinRange); }
+inline MultiIoAbstractionRef multiIoExpander(pinid_t arduinoPinRange) { return ioaCreate<MultiIoAbstraction>(arduinoPinRange); }
 
 /**
  * Add an additional expander to an existing multiIoExpander.
@@ -14,6 +14,8 @@ PCF8574IoAbstraction::PCF8574IoAbstraction(uint8_t addr, uint8_t interruptPin, W
     bitWrite(flags, NEEDS_WRITE_FLAG, true);
     bitWrite(flags, PCF8575_16BIT_FLAG, mode16Bit);
     bitWrite(flags, INVERTED_LOGIC, invertedLogic);
+    bitWrite(flags, ASYNC_LAST_OK_FLAG, true);
+    bitWrite(flags, FORCE_READ_FLAG, true);
 }
 
 void PCF8574IoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
@@ -56,11 +58,55 @@ void PCF8574IoAbstraction::writePort(pinid_t pin, uint8_t value) {
     bitWrite(flags, NEEDS_WRITE_FLAG, true);
 }
 
+IoPinMask PCF8574IoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(startPin > 15) return 0;
+    IoPinMask allPins = lastRead[0] | ((IoPinMask)lastRead[1] << 8U);
+    return (allPins >> startPin) & mask;
+}
+
+void PCF8574IoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(startPin > 15) return;
+    IoPinMask allPins = toWrite[0] | ((IoPinMask)toWrite[1] << 8U);
+    allPins = (allPins & ~(mask << startPin)) | ((values & mask) << startPin);
+    toWrite[0] = allPins & 0xffU;
+    toWrite[1] = (allPins >> 8U) & 0xffU;
+    bitWrite(flags, NEEDS_WRITE_FLAG, true);
+}
+
 bool PCF8574IoAbstraction::runLoop(){
     bool writeOk = true;
     size_t bytesToTransfer = bitRead(flags, PCF8575_16BIT_FLAG) ? 2 : 1;
     bool invertedLogic = bitRead(flags, INVERTED_LOGIC);
 
+    if(bitRead(flags, ASYNC_SYNC_FLAG)) {
+        // while a transfer is still in progress, any changes since are left flagged for the next one.
+        if(!syncTxn.isIdle()) return bitRead(flags, ASYNC_LAST_OK_FLAG);
+
+        bool needsWrite = bitRead(flags, NEEDS_WRITE_FLAG);
+        if(needsWrite) bitWrite(flags, FORCE_READ_FLAG, true);
+        bool needsRead = isReadNeeded();
+        if(!needsWrite && !needsRead) return true;
+
+        syncTxn.prepare(wireImpl, address, this, needsRead ? I2C_PRIORITY_INPUT : I2C_PRIORITY_OUTPUT);
+        if(needsWrite) {
+            bitWrite(flags, NEEDS_WRITE_FLAG, false);
+            txnWrite[0] = invertedLogic ? ~toWrite[0] : toWrite[0];
+            txnWrite[1] = invertedLogic ? ~toWrite[1] : toWrite[1];
+            syncTxn.setWrite(txnWrite, bytesToTransfer);
+        }
+        if(needsRead) {
+            bitWrite(flags, FORCE_READ_FLAG, false);
+            syncTxn.setRead(txnRead, bytesToTransfer);
+        }
+
+        if(!i2cTransactionScheduler.submit(&syncTxn)) {
+            if(needsWrite) bitWrite(flags, NEEDS_WRITE_FLAG, true);
+            if(needsRead) bitWrite(flags, FORCE_READ_FLAG, true);
+            return false;
+        }
+        return bitRead(flags, ASYNC_LAST_OK_FLAG);
+    }
+
     if (bitRead(flags, NEEDS_WRITE_FLAG)) {
         bitWrite(flags, NEEDS_WRITE_FLAG, false);
 
@@ -69,9 +115,12 @@ bool PCF8574IoAbstraction::runLoop(){
         dataToWrite[1] = invertedLogic ? ~toWrite[1] : toWrite[1];
 
         writeOk = ioaWireWriteWithRetry(wireImpl, address, dataToWrite, bytesToTransfer);
+        // writing clears any pending interrupt on this device, so the inputs must be read now.
+        bitWrite(flags, FORCE_READ_FLAG, true);
     }
 
-    if(bitRead(flags, PINS_CONFIGURED_READ_FLAG)) {
+    if(isReadNeeded()) {
+        bitWrite(flags, FORCE_READ_FLAG, false);
         writeOk = writeOk && ioaWireRead(wireImpl, address, lastRead, bytesToTransfer);
 
         if (invertedLogic) {
@@ -83,6 +132,37 @@ bool PCF8574IoAbstraction::runLoop(){
 }
 
 
+void PCF8574IoAbstraction::i2cTransactionComplete(I2cTransaction* transaction, bool success) {
+    bitWrite(flags, ASYNC_LAST_OK_FLAG, success);
+    if(!success) {
+        // the write may not have reached the device, so it is sent again on the next sync, along with a read.
+        bitWrite(flags, NEEDS_WRITE_FLAG, true);
+        bitWrite(flags, FORCE_READ_FLAG, true);
+        return;
+    }
+
+    if(transaction->hasRead()) {
+        bool invertedLogic = bitRead(flags, INVERTED_LOGIC);
+        lastRead[0] = invertedLogic ? ~txnRead[0] : txnRead[0];
+        lastRead[1] = invertedLogic ? ~txnRead[1] : txnRead[1];
+    }
+}
+
+bool PCF8574IoAbstraction::isReadNeeded() {
+    if(!bitRead(flags, PINS_CONFIGURED_READ_FLAG)) return false;
+    if(!bitRead(flags, INTERRUPT_GATED_FLAG) || bitRead(flags, FORCE_READ_FLAG)) return true;
+
+    // the interrupt line is active low, and stays asserted until the port is read.
+    return internalDigitalDevice().digitalRead(interruptPin) == LOW;
+}
+
+void PCF8574IoAbstraction::setInterruptGatedReads(bool gated) {
+    if(interruptPin == 0xff) gated = false;
+    if(gated) internalDigitalDevice().pinDirection(interruptPin, INPUT_PULLUP);
+    bitWrite(flags, INTERRUPT_GATED_FLAG, gated);
+    bitWrite(flags, FORCE_READ_FLAG, true);
+}
+
 void PCF8574IoAbstraction::attachInterrupt(pinid_t /*pin*/, RawIntHandler intHandler, uint8_t /*mode*/) {
 	// if there's an interrupt pin set
 	if(interruptPin == 0xff) return;
@@ -93,11 +173,11 @@ void PCF8574IoAbstraction::attachInterrupt(pinid_t /*pin*/, RawIntHandler intHan
 }
 
 BasicIoAbstraction* ioFrom8574(uint8_t addr, pinid_t interruptPin, WireType wireImpl, bool invertedLogic) {
-	return new PCF8574IoAbstraction(addr, interruptPin, wireImpl, invertedLogic);
+	return ioaCreate<PCF8574IoAbstraction>(addr, interruptPin, wireImpl, invertedLogic);
 }
 
 BasicIoAbstraction* ioFrom8575(uint8_t addr, pinid_t interruptPin, WireType wireImpl, bool invertedLogic) {
-    return new PCF8574IoAbstraction(addr, interruptPin, wireImpl, true, invertedLogic);
+    return ioaCreate<PCF8574IoAbstraction>(addr, interruptPin, wireImpl, true, invertedLogic);
 }
 
 //
@@ -118,6 +198,9 @@ BasicIoAbstraction* ioFrom8575(uint8_t addr, pinid_t interruptPin, WireType wire
 #define GPIO_ADDR        0x12
 #define OUTLAT_ADDR      0x14
 
+// marks an asynchronous read of INTF and INTCAP, rather than of the GPIO ports
+#define MCP_ASYNC_READ_CAPTURED 0x80
+
 // definitions for the IO control register
 
 #define IOCON_HAEN_BIT  3
@@ -132,6 +215,12 @@ MCP23017IoAbstraction::MCP23017IoAbstraction(uint8_t address, Mcp23xInterruptMod
 	this->intPinA = intPinA;
 	this->intPinB = intPinB;
 	this->intMode = intMode;
+	this->asyncSync = false;
+	this->asyncLastOk = true;
+	this->asyncPortsRead = 0;
+	this->gatedReads = false;
+	this->forceRead = true;
+	this->configShadow = nullptr;
 }
 
 MCP23017IoAbstraction::MCP23017IoAbstraction(uint8_t address, Mcp23xInterruptMode intMode, pinid_t intPinA, WireType wireImpl) :
@@ -141,6 +230,12 @@ MCP23017IoAbstraction::MCP23017IoAbstraction(uint8_t address, Mcp23xInterruptMod
     this->intPinA = intPinA;
     this->intPinB = IO_PIN_NOT_DEFINED;
     this->intMode = intMode;
+    this->asyncSync = false;
+    this->asyncLastOk = true;
+    this->asyncPortsRead = 0;
+    this->gatedReads = false;
+    this->forceRead = true;
+    this->configShadow = nullptr;
 }
 
 MCP23017IoAbstraction::MCP23017IoAbstraction(uint8_t address, WireType wireImpl) :
@@ -149,9 +244,37 @@ MCP23017IoAbstraction::MCP23017IoAbstraction(uint8_t address, WireType wireImpl)
     this->address = address;
     this->intPinA = this->intPinB = IO_PIN_NOT_DEFINED;
     this->intMode = NOT_ENABLED;
+    this->asyncSync = false;
+    this->asyncLastOk = true;
+    this->asyncPortsRead = 0;
+    this->gatedReads = false;
+    this->forceRead = true;
+    this->configShadow = nullptr;
+}
+
+MCP23017IoAbstraction::~MCP23017IoAbstraction() {
+	delete configShadow;
+}
+
+void MCP23017IoAbstraction::setRegisterShadowing(bool shadowed) {
+	if(shadowed && configShadow == nullptr) {
+		// IODIR through to GPPU are all plain configuration registers, INTF onwards are changed by the device.
+		configShadow = new WireRegisterShadow(IODIR_ADDR, GPPU_ADDR + 2 - IODIR_ADDR);
+	}
+	else if(!shadowed && configShadow != nullptr) {
+		configShadow->flush(wireImpl, address);
+		delete configShadow;
+		configShadow = nullptr;
+	}
 }
 
 void MCP23017IoAbstraction::initDevice() {
+	// as always, a failure here is not retried, only the init pipeline retries.
+	initStep(0);
+	markInitialised();
+}
+
+IoDeviceInitState MCP23017IoAbstraction::initStep(uint8_t /*step*/) {
 	uint8_t controlReg = (wireReadReg16(wireImpl, address, IOCON_ADDR) & 0xff);
 	
 	if(intPinB == 0xff && intPinA != 0xff) {
@@ -165,38 +288,62 @@ void MCP23017IoAbstraction::initDevice() {
 	bitClear(controlReg, IOCON_SEQOP_BIT);
 
 	uint16_t regToWrite = controlReg | (((uint16_t)controlReg) << 8U);
-    wireWriteReg16(wireImpl, address, IOCON_ADDR, regToWrite);
+	if(!wireWriteReg16(wireImpl, address, IOCON_ADDR, regToWrite)) return IOINIT_FAILED;
+	if(configShadow) {
+		configShadow->setKnownValue(IOCON_ADDR, controlReg);
+		configShadow->setKnownValue(IOCON_ADDR + 1, controlReg);
+	}
 
-    markInitialised();
+	markInitialised();
+	return IOINIT_READY;
 }
 
 void MCP23017IoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
 	if(isInitNeeded()) initDevice();
 
-	toggleBitInRegister16(wireImpl, address, IODIR_ADDR, pin, (mode == INPUT || mode == INPUT_PULLUP));
-	toggleBitInRegister16(wireImpl, address, GPPU_ADDR, pin, mode == INPUT_PULLUP);
+	toggleBitInRegister16(wireImpl, address, IODIR_ADDR, pin, (mode == INPUT || mode == INPUT_PULLUP), configShadow);
+	toggleBitInRegister16(wireImpl, address, GPPU_ADDR, pin, mode == INPUT_PULLUP, configShadow);
 
     setReadPort((pin < 8) ? 0 : 1);
 }
 
 bool MCP23017IoAbstraction::runLoop() {
+	// nothing is synced until the init pipeline has set the device up.
+	if(isInitDeferred()) return true;
 	if(isInitNeeded()) initDevice();
 
-	bool writeOk = true;
+	// configuration goes first, so that pins are in the right mode before outputs are written or inputs read.
+	bool writeOk = (configShadow == nullptr) || configShadow->flush(wireImpl, address);
+
+	if(asyncSync) return startAsyncSync() && writeOk;
 
 	bool flagA = isWritePortSet(0);
 	bool flagB = isWritePortSet(1);
 	if(flagA && flagB) // write on both ports
-		writeOk = wireWriteReg16(wireImpl, address, OUTLAT_ADDR, toWrite);
+		writeOk = wireWriteReg16(wireImpl, address, OUTLAT_ADDR, toWrite) && writeOk;
 	else if(flagA) 
-		writeOk = wireWriteReg8(wireImpl, address, OUTLAT_ADDR, toWrite);
+		writeOk = wireWriteReg8(wireImpl, address, OUTLAT_ADDR, toWrite) && writeOk;
 	else if(flagB)
-		writeOk = wireWriteReg8(wireImpl, address, OUTLAT_ADDR + 1, toWrite >> 8);
+		writeOk = wireWriteReg8(wireImpl, address, OUTLAT_ADDR + 1, toWrite >> 8) && writeOk;
 
 	clearChangeFlags();
 
 	flagA = isReadPortSet(0);
 	flagB = isReadPortSet(1);
+	if(gatedReads && (flagA || flagB) && !forceRead) {
+		// nothing has changed unless the interrupt line is asserted, in which case report the captured state.
+		if(isInterruptAsserted()) {
+			uint8_t reg = INTF_ADDR;
+			uint8_t captured[4];
+			if(ioaWireWriteWithRetry(wireImpl, address, &reg, 1, 0, false) && ioaWireRead(wireImpl, address, captured, sizeof captured)) {
+				applyCapturedInterrupts(captured);
+			}
+			else writeOk = false;
+		}
+		return writeOk;
+	}
+	forceRead = false;
+
 	if(flagA && flagB)
 		lastRead = wireReadReg16(wireImpl, address, GPIO_ADDR);
 	else if(flagA)
@@ -207,6 +354,102 @@ bool MCP23017IoAbstraction::runLoop() {
 	return writeOk;
 }
 
+bool MCP23017IoAbstraction::isInterruptAsserted() {
+	uint8_t activeLevel = (intMode == ACTIVE_HIGH || intMode == ACTIVE_HIGH_OPEN) ? HIGH : LOW;
+	if(internalDigitalDevice().digitalRead(intPinA) == activeLevel) return true;
+	return intPinB != 0xff && internalDigitalDevice().digitalRead(intPinB) == activeLevel;
+}
+
+void MCP23017IoAbstraction::applyCapturedInterrupts(const uint8_t* intfAndIntcap) {
+	// INTF says which pins raised the interrupt, and INTCAP holds their state at that time. Reading INTCAP clears
+	// the interrupt, so the captured state is reported now and the current state is read from GPIO on the next sync.
+	uint16_t intf = intfAndIntcap[0] | ((uint16_t)intfAndIntcap[1] << 8U);
+	uint16_t intcap = intfAndIntcap[2] | ((uint16_t)intfAndIntcap[3] << 8U);
+	lastRead = (lastRead & ~intf) | (intcap & intf);
+	forceRead = true;
+}
+
+void MCP23017IoAbstraction::setInterruptGatedReads(bool gated) {
+	if(intPinA == 0xff || intMode == NOT_ENABLED) gated = false;
+	if(gated) {
+		uint8_t pm = (intMode == ACTIVE_HIGH_OPEN || intMode == ACTIVE_LOW_OPEN) ? INPUT_PULLUP : INPUT;
+		internalDigitalDevice().pinMode(intPinA, pm);
+		if(intPinB != 0xff) internalDigitalDevice().pinMode(intPinB, pm);
+	}
+	gatedReads = gated;
+	forceRead = true;
+}
+
+bool MCP23017IoAbstraction::startAsyncSync() {
+	bool ok = asyncLastOk;
+
+	// the output latch can only be written when the previous output transaction has finished, otherwise the change
+	// flags are left set and it is picked up by a later sync.
+	bool flagA = isWritePortSet(0);
+	bool flagB = isWritePortSet(1);
+	if((flagA || flagB) && outputTxn.isIdle()) {
+		outputTxn.prepare(wireImpl, address, this);
+		outputBuffer[0] = flagA ? OUTLAT_ADDR : OUTLAT_ADDR + 1;
+		outputBuffer[1] = flagA ? (uint8_t)toWrite : (uint8_t)(toWrite >> 8U);
+		outputBuffer[2] = (uint8_t)(toWrite >> 8U);
+		outputTxn.setWrite(outputBuffer, (flagA && flagB) ? 3 : 2);
+		if(i2cTransactionScheduler.submit(&outputTxn)) {
+			clearChangeFlags();
+		}
+		else ok = false;
+	}
+
+	flagA = isReadPortSet(0);
+	flagB = isReadPortSet(1);
+	if((flagA || flagB) && inputTxn.isIdle()) {
+		inputTxn.prepare(wireImpl, address, this, I2C_PRIORITY_INPUT);
+		if(gatedReads && !forceRead) {
+			if(!isInterruptAsserted()) return ok;
+			// read INTF and INTCAP together, see applyCapturedInterrupts
+			inputRegister = INTF_ADDR;
+			asyncPortsRead = MCP_ASYNC_READ_CAPTURED;
+			inputTxn.setRead(inputBuffer, 4);
+		}
+		else {
+			forceRead = false;
+			inputRegister = flagA ? GPIO_ADDR : GPIO_ADDR + 1;
+			asyncPortsRead = (flagA ? 0x01 : 0) | (flagB ? 0x02 : 0);
+			inputTxn.setRead(inputBuffer, (flagA && flagB) ? 2 : 1);
+		}
+		inputTxn.setWrite(&inputRegister, 1);
+		if(!i2cTransactionScheduler.submit(&inputTxn)) {
+			forceRead = true;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+void MCP23017IoAbstraction::i2cTransactionComplete(I2cTransaction* transaction, bool success) {
+	asyncLastOk = success;
+	if(transaction == &outputTxn) {
+		// the latch write failed, so flag both ports with their latest values to be written on the next sync.
+		if(!success) {
+			writePort(0, toWrite & 0xffU);
+			writePort(8, toWrite >> 8U);
+		}
+		return;
+	}
+
+	if(!success) {
+		forceRead = true;
+		return;
+	}
+	if(asyncPortsRead == MCP_ASYNC_READ_CAPTURED)
+		applyCapturedInterrupts(inputBuffer);
+	else if(asyncPortsRead == 0x03)
+		lastRead = inputBuffer[0] | ((uint16_t)inputBuffer[1] << 8U);
+	else if(asyncPortsRead == 0x01)
+		lastRead = inputBuffer[0];
+	else if(asyncPortsRead == 0x02)
+		lastRead = (uint16_t)inputBuffer[0] << 8U;
+}
+
 void MCP23017IoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
 	// only if there's an interrupt pin set
 	if(intPinA == 0xff) return;
@@ -225,13 +468,13 @@ void MCP23017IoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandle
         inbuiltIo.attachInterrupt(intPinB, intHandler, im);
     }
 
-	toggleBitInRegister16(wireImpl, address, GPINTENA_ADDR, pin, true);
-	toggleBitInRegister16(wireImpl, address, INTCON_ADDR, pin, mode != CHANGE);
-	toggleBitInRegister16(wireImpl, address, DEFVAL_ADDR, pin, mode == FALLING);
+	toggleBitInRegister16(wireImpl, address, GPINTENA_ADDR, pin, true, configShadow);
+	toggleBitInRegister16(wireImpl, address, INTCON_ADDR, pin, mode != CHANGE, configShadow);
+	toggleBitInRegister16(wireImpl, address, DEFVAL_ADDR, pin, mode == FALLING, configShadow);
 }
 
 void MCP23017IoAbstraction::setInvertInputPin(pinid_t pin, bool shouldInvert) {
-    toggleBitInRegister16(wireImpl, address, IPOL_ADDR, pin, shouldInvert);
+    toggleBitInRegister16(wireImpl, address, IPOL_ADDR, pin, shouldInvert, configShadow);
 }
 
 void MCP23017IoAbstraction::resetDevice(int resetPin) {
@@ -239,6 +482,8 @@ void MCP23017IoAbstraction::resetDevice(int resetPin) {
     internalDigitalDevice().digitalWriteS(resetPin, LOW);
     taskManager.yieldForMicros(100);
     internalDigitalDevice().digitalWriteS(resetPin, HIGH);
+    // the device is back to its power on state, so the shadow no longer reflects it.
+    if(configShadow) configShadow->invalidate();
 }
 
 IoAbstractionRef ioFrom23017(pinid_t addr, WireType wireImpl) {
@@ -250,7 +495,7 @@ IoAbstractionRef ioFrom23017(uint8_t addr, Mcp23xInterruptMode intMode, pinid_t
 }
 
 IoAbstractionRef ioFrom23017IntPerPort(pinid_t addr, Mcp23xInterruptMode intMode, pinid_t intPinA, pinid_t intPinB, WireType wireImpl) {
-	return new MCP23017IoAbstraction(addr, intMode, intPinA, intPinB, wireImpl);
+	return ioaCreate<MCP23017IoAbstraction>(addr, intMode, intPinA, intPinB, wireImpl);
 }
 
 //
@@ -263,6 +508,182 @@ IoAbstractionRef ioFrom23017IntPerPort(pinid_t addr, Mcp23xInterruptMode intMode
 #define STD16_READER_PORTB_BIT 3
 #define STD16_NEEDS_INIT 4
 
+//
+// StandardMultiPortDevice
+//
+
+StandardMultiPortDevice::StandardMultiPortDevice(uint8_t ports) : lastRead{}, toWrite{}, changedPorts(0), portsToRead(0),
+        numPorts(ports < STD_MULTIPORT_MAX_PORTS ? ports : STD_MULTIPORT_MAX_PORTS), needsInit(true) {
+}
+
+void StandardMultiPortDevice::writeValue(pinid_t pin, uint8_t value) {
+    if(needsInit) initDevice();
+    uint8_t port = pin / 8;
+    if(port >= numPorts) return;
+    bitWrite(toWrite[port], pin % 8, value);
+    bitSet(changedPorts, port);
+}
+
+uint8_t StandardMultiPortDevice::readValue(pinid_t pin) {
+    uint8_t port = pin / 8;
+    return (port < numPorts) ? bitRead(lastRead[port], pin % 8) : 0;
+}
+
+void StandardMultiPortDevice::writePort(pinid_t pin, uint8_t value) {
+    uint8_t port = pin / 8;
+    if(port >= numPorts) return;
+    toWrite[port] = value;
+    bitSet(changedPorts, port);
+}
+
+uint8_t StandardMultiPortDevice::readPort(pinid_t pin) {
+    uint8_t port = pin / 8;
+    return (port < numPorts) ? lastRead[port] : 0;
+}
+
+IoPinMask StandardMultiPortDevice::readPinMask(pinid_t startPin, IoPinMask mask) {
+    // gather the bytes covering the 32 pin window, then shift into place.
+    uint8_t port = startPin / 8;
+    uint8_t shift = startPin % 8;
+    uint64_t window = 0;
+    for(uint8_t i = 0; i < 5 && (port + i) < numPorts; i++) {
+        window |= (uint64_t)lastRead[port + i] << (i * 8U);
+    }
+    return (IoPinMask)(window >> shift) & mask;
+}
+
+void StandardMultiPortDevice::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(needsInit) initDevice();
+    uint8_t port = startPin / 8;
+    uint8_t shift = startPin % 8;
+    uint64_t maskBits = (uint64_t)mask << shift;
+    uint64_t valueBits = (uint64_t)values << shift;
+    for(uint8_t i = 0; i < 5 && (port + i) < numPorts; i++) {
+        auto portMask = (uint8_t)(maskBits >> (i * 8U));
+        if(portMask == 0) continue;
+        auto portValues = (uint8_t)(valueBits >> (i * 8U));
+        toWrite[port + i] = (toWrite[port + i] & ~portMask) | (portValues & portMask);
+        bitSet(changedPorts, port + i);
+    }
+}
+
+bool StandardMultiPortDevice::writePortBlock(WireType wire, uint8_t addr, uint8_t firstReg, const uint8_t* values, uint8_t portMask) {
+    if(portMask == 0) return true;
+    uint8_t first = 0;
+    while(!bitRead(portMask, first)) first++;
+    uint8_t last = numPorts - 1;
+    while(!bitRead(portMask, last)) last--;
+
+    uint8_t data[STD_MULTIPORT_MAX_PORTS + 1];
+    uint8_t len = last - first + 1;
+    data[0] = firstReg + first;
+    memcpy(&data[1], &values[first], len);
+    return ioaWireWriteWithRetry(wire, addr, data, len + 1);
+}
+
+bool StandardMultiPortDevice::readPortBlock(WireType wire, uint8_t addr, uint8_t firstReg, uint8_t* values, uint8_t portMask) {
+    if(portMask == 0) return true;
+    uint8_t first = 0;
+    while(!bitRead(portMask, first)) first++;
+    uint8_t last = numPorts - 1;
+    while(!bitRead(portMask, last)) last--;
+
+    uint8_t reg = firstReg + first;
+    return ioaWireWriteWithRetry(wire, addr, &reg, 1, 0, false) && ioaWireRead(wire, addr, &values[first], last - first + 1);
+}
+
+//
+// MultiPortIoExpander, TCA6424 and PCA9506
+//
+
+const MultiPortRegisterLayout tca6424RegisterLayout = { 3, 0x00, 0x04, 0x08, 0x0C, 0xFF, 0x80 };
+const MultiPortRegisterLayout pca9506RegisterLayout = { 5, 0x00, 0x08, 0x10, 0x18, 0x20, 0x80 };
+
+MultiPortIoExpander::MultiPortIoExpander(const MultiPortRegisterLayout& regLayout, uint8_t addr, pinid_t intPin, WireType wirePtr)
+        : StandardMultiPortDevice(regLayout.numPorts), layout(regLayout), address(addr), interruptPin(intPin),
+          configuration{}, polarity{}, interruptMask{}, configChanged(0), polarityChanged(0), maskChanged(0) {
+    wireImpl = (wirePtr != nullptr) ? wirePtr : defaultWireTypePtr;
+}
+
+void MultiPortIoExpander::initDevice() {
+    markInitialised();
+
+    // start from the state already on the device, so that a restart of the board does not glitch the outputs.
+    uint8_t all = (1U << numPorts) - 1U;
+    uint8_t outputs[STD_MULTIPORT_MAX_PORTS] = {};
+    bool ok = readPortBlock(wireImpl, address, layout.outputReg | layout.autoIncrementFlag, outputs, all);
+    ok = ok && readPortBlock(wireImpl, address, layout.configReg | layout.autoIncrementFlag, configuration, all);
+    ok = ok && readPortBlock(wireImpl, address, layout.polarityReg | layout.autoIncrementFlag, polarity, all);
+    if(ok && layout.interruptMaskReg != 0xFF) {
+        ok = readPortBlock(wireImpl, address, layout.interruptMaskReg | layout.autoIncrementFlag, interruptMask, all);
+    }
+    if(!ok) {
+        serlogF2(SER_ERROR, "MultiPort init fail ", address);
+        // fall back to the power on state of these devices, all inputs, not inverted and interrupts masked.
+        memset(outputs, 0, sizeof outputs);
+        memset(configuration, 0xFF, sizeof configuration);
+        memset(polarity, 0, sizeof polarity);
+        memset(interruptMask, 0xFF, sizeof interruptMask);
+    }
+
+    // a port written before the first sync keeps that value, it is still pending.
+    for(uint8_t port = 0; port < numPorts; port++) {
+        if(!bitRead(changedPorts, port)) toWrite[port] = outputs[port];
+    }
+}
+
+void MultiPortIoExpander::pinDirection(pinid_t pin, uint8_t mode) {
+    if(isInitNeeded()) initDevice();
+    uint8_t port = pin / 8;
+    if(port >= numPorts) return;
+
+    bool input = (mode == INPUT || mode == INPUT_PULLUP);
+    if(bitRead(configuration[port], pin % 8) != input) {
+        bitWrite(configuration[port], pin % 8, input);
+        bitSet(configChanged, port);
+    }
+    if(input) setReadPort(port);
+}
+
+void MultiPortIoExpander::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
+    if(interruptPin == IO_PIN_NOT_DEFINED) return;
+    if(isInitNeeded()) initDevice();
+
+    internalDigitalDevice().pinMode(interruptPin, INPUT_PULLUP);
+    internalDigitalDevice().attachInterrupt(interruptPin, intHandler, CHANGE);
+
+    uint8_t port = pin / 8;
+    if(layout.interruptMaskReg != 0xFF && port < numPorts) {
+        bitClear(interruptMask[port], pin % 8);
+        bitSet(maskChanged, port);
+    }
+}
+
+void MultiPortIoExpander::setInvertInputPin(pinid_t pin, bool shouldInvert) {
+    if(isInitNeeded()) initDevice();
+    uint8_t port = pin / 8;
+    if(port >= numPorts) return;
+    bitWrite(polarity[port], pin % 8, shouldInvert);
+    bitSet(polarityChanged, port);
+}
+
+bool MultiPortIoExpander::runLoop() {
+    if(isInitNeeded()) initDevice();
+    uint8_t ai = layout.autoIncrementFlag;
+
+    // outputs are written before the direction changes, so that a pin becoming an output starts at the right level.
+    bool ok = writePortBlock(wireImpl, address, layout.outputReg | ai, toWrite, changedPorts);
+    if(ok) clearChangeFlags();
+
+    if(configChanged && writePortBlock(wireImpl, address, layout.configReg | ai, configuration, configChanged)) configChanged = 0;
+    if(polarityChanged && writePortBlock(wireImpl, address, layout.polarityReg | ai, polarity, polarityChanged)) polarityChanged = 0;
+    if(maskChanged && writePortBlock(wireImpl, address, layout.interruptMaskReg | ai, interruptMask, maskChanged)) maskChanged = 0;
+    ok = ok && (configChanged | polarityChanged | maskChanged) == 0;
+
+    // the input registers reflect the pin level whatever the direction, but only ports with inputs are read.
+    return readPortBlock(wireImpl, address, layout.inputReg | ai, lastRead, portsToRead) && ok;
+}
+
 //
 // AW9523IoAbstraction implementation
 //
@@ -302,6 +723,21 @@ void Standard16BitDevice::writePort(pinid_t pin, uint8_t value) {
     }
 }
 
+IoPinMask Standard16BitDevice::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(startPin > 15) return 0;
+    return ((IoPinMask)lastRead >> startPin) & mask;
+}
+
+void Standard16BitDevice::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(bitRead(flags, STD16_NEEDS_INIT)) initDevice();
+    if(startPin > 15) return;
+
+    auto pinsToChange = (uint16_t)(mask << startPin);
+    toWrite = (toWrite & ~pinsToChange) | ((uint16_t)(values << startPin) & pinsToChange);
+    if(pinsToChange & 0x00ffU) bitSet(flags, STD16_CHANGE_PORTA_BIT);
+    if(pinsToChange & 0xff00U) bitSet(flags, STD16_CHANGE_PORTB_BIT);
+}
+
 void Standard16BitDevice::clearChangeFlags() {
     bitClear(flags, STD16_CHANGE_PORTA_BIT);
     bitClear(flags, STD16_CHANGE_PORTB_BIT);
@@ -346,25 +782,40 @@ inline uint8_t getAw9523LedDimRegister(pinid_t pin) {
     else return AW9523_LED_DIM_START + pin;
 }
 
+// when batching LED updates, a gap of this many unchanged registers or fewer is written as part of the same burst,
+// as it costs less than starting another transaction.
+#define AW9523_LED_BURST_MAX_GAP 3
+
 AW9523IoAbstraction::AW9523IoAbstraction(uint8_t addr, pinid_t intPin, WireType wirePtr) : Standard16BitDevice(),
-        i2cAddress(addr), interruptPin(intPin) {
+        i2cAddress(addr), interruptPin(intPin), ledCurrent{}, ledChanged(0), batchLedUpdates(false) {
     wireImpl = (wirePtr != nullptr) ? wirePtr : defaultWireTypePtr;
 }
 
 void AW9523IoAbstraction::initDevice() {
+    // as always, a failure here is not retried, only the init pipeline retries.
+    runAllInitSteps();
     markInitialised();
+}
 
-    // reset the device
-    softwareReset();
-
-    // turn off all interrupts
-    wireWriteReg16(wireImpl, i2cAddress, AW9523_INTERRUPT_CTRL_16, 0xFFFF);
-
-    // set everything to output, low
-    wireWriteReg16(wireImpl, i2cAddress, AW9523_PORT_DIRECTION_16, 0x0);
-
-    // full current, push/pull port 0.
-    writeGlobalControl(true);
+IoDeviceInitState AW9523IoAbstraction::initStep(uint8_t step) {
+    bool ok;
+    switch(step) {
+    case 0:
+        ok = softwareReset();
+        break;
+    case 1: {
+        // set everything to output, and turn off all interrupts, the registers are adjacent so go in one burst.
+        const uint8_t directionAndInterrupts[] = { 0x00, 0x00, 0xFF, 0xFF };
+        ok = wireWriteRegBlock(wireImpl, i2cAddress, AW9523_PORT_DIRECTION_16, directionAndInterrupts, sizeof directionAndInterrupts);
+        break;
+    }
+    default:
+        // full current, push/pull port 0.
+        if(!writeGlobalControl(true)) return IOINIT_FAILED;
+        markInitialised();
+        return IOINIT_READY;
+    }
+    return ok ? IOINIT_IN_PROGRESS : IOINIT_FAILED;
 }
 
 void AW9523IoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
@@ -404,6 +855,7 @@ void AW9523IoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
 }
 
 bool AW9523IoAbstraction::runLoop() {
+    if(isInitDeferred()) return true;
     if(isInitNeeded()) initDevice();
 
     bool writeOk = true;
@@ -418,6 +870,8 @@ bool AW9523IoAbstraction::runLoop() {
 
     clearChangeFlags();
 
+    if(ledChanged != 0) writeOk = flushLedCurrents() && writeOk;
+
     port0 = isReadPortSet(0);
     port1 = isReadPortSet(1);
     if(port0 && port1) {
@@ -432,24 +886,84 @@ bool AW9523IoAbstraction::runLoop() {
 
 void AW9523IoAbstraction::setPinLedCurrent(pinid_t pin, uint8_t pwr) {
     if(isInitNeeded()) initDevice();
-    wireWriteReg8(wireImpl, i2cAddress, getAw9523LedDimRegister(pin), pwr);
+    if(pin > 15) return;
+
+    uint8_t reg = getAw9523LedDimRegister(pin);
+    if(batchLedUpdates) {
+        uint8_t idx = reg - AW9523_LED_DIM_START;
+        if(ledCurrent[idx] != pwr) {
+            ledCurrent[idx] = pwr;
+            bitSet(ledChanged, idx);
+        }
+        if(bitRead(toWrite, pin) == 0 && pwr != 0) {
+            digitalWrite(pin, true);
+        }
+        return;
+    }
+
+    ledCurrent[reg - AW9523_LED_DIM_START] = pwr;
+    wireWriteReg8(wireImpl, i2cAddress, reg, pwr);
     if(bitRead(toWrite, pin) == 0 && pwr != 0) {
         digitalWriteS(pin, true);
     }
 }
 
-void AW9523IoAbstraction::softwareReset() {
-    wireWriteReg8(wireImpl, i2cAddress, AW9523_SW_RESET_REG, 0);
+void AW9523IoAbstraction::setBatchedLedUpdates(bool batched) {
+    if(!batched && ledChanged != 0) flushLedCurrents();
+    batchLedUpdates = batched;
+}
+
+bool AW9523IoAbstraction::flushLedCurrents() {
+    // the dimming registers are contiguous, so each run of changes, allowing for short gaps, is one burst write.
+    bool ok = true;
+    uint8_t idx = 0;
+    while(idx < 16) {
+        if(!bitRead(ledChanged, idx)) {
+            idx++;
+            continue;
+        }
+        uint8_t end = idx;
+        uint8_t gap = 0;
+        for(uint8_t i = idx + 1; i < 16 && gap <= AW9523_LED_BURST_MAX_GAP; i++) {
+            if(bitRead(ledChanged, i)) {
+                end = i;
+                gap = 0;
+            }
+            else gap++;
+        }
+
+        uint8_t data[17];
+        uint8_t len = end - idx + 1;
+        data[0] = AW9523_LED_DIM_START + idx;
+        memcpy(&data[1], &ledCurrent[idx], len);
+        if(ioaWireWriteWithRetry(wireImpl, i2cAddress, data, len + 1)) {
+            for(uint8_t i = idx; i <= end; i++) bitClear(ledChanged, i);
+        }
+        else {
+            // left changed so that it is tried again on the next sync
+            ok = false;
+        }
+        idx = end + 1;
+    }
+    return ok;
+}
+
+bool AW9523IoAbstraction::softwareReset() {
+    if(!wireWriteReg8(wireImpl, i2cAddress, AW9523_SW_RESET_REG, 0)) return false;
+    // all the dimming registers are zero after a reset
+    memset(ledCurrent, 0, sizeof ledCurrent);
+    ledChanged = 0;
+    return true;
 }
 
 uint8_t AW9523IoAbstraction::deviceId() {
     return wireReadReg8(wireImpl, i2cAddress, AW9523_CHIP_IDENTIFIER);
 }
 
-void AW9523IoAbstraction::writeGlobalControl(bool pushPullP0, AW9523CurrentControl maxCurrentMode) {
+bool AW9523IoAbstraction::writeGlobalControl(bool pushPullP0, AW9523CurrentControl maxCurrentMode) {
     uint8_t params = maxCurrentMode & 0x03;
     bitWrite(params, 4, pushPullP0);
-    wireWriteReg8(wireImpl, i2cAddress, AW9523_GLOBAL_CONTROL, params);
+    return wireWriteReg8(wireImpl, i2cAddress, AW9523_GLOBAL_CONTROL, params);
 }
 
 void AW9523AnalogAbstraction::initPin(pinid_t pin, AnalogDirection direction) {
@@ -465,10 +979,60 @@ MPR121IoAbstraction::MPR121IoAbstraction(uint8_t addr, pinid_t intPin, WireType
     wireImpl = (wirePtr != nullptr) ? wirePtr : defaultWireTypePtr;
 }
 
+MPR121IoAbstraction::~MPR121IoAbstraction() {
+    delete gpioShadow;
+    delete[] electrodeData;
+}
+
+void MPR121IoAbstraction::setElectrodeDataCaching(bool cached, bool includeBaselines, bool onInterrupt) {
+    delete[] electrodeData;
+    electrodeData = nullptr;
+    cacheBaselines = includeBaselines;
+    refreshOnInterrupt = onInterrupt && interruptPin != IO_PIN_NOT_DEFINED;
+    if(!cached) return;
+
+    uint8_t len = MPR121_ELECTRODE_DATA_SIZE + (includeBaselines ? MPR121_TOTAL_PINS : 0);
+    electrodeData = new uint8_t[len];
+    memset(electrodeData, 0, len);
+    if(refreshOnInterrupt) internalDigitalDevice().pinMode(interruptPin, INPUT_PULLUP);
+
+    // start with current values, rather than waiting for the first interrupt
+    refreshElectrodeData();
+}
+
+bool MPR121IoAbstraction::refreshElectrodeData() {
+    if(electrodeData == nullptr) return false;
+
+    // the device auto increments the register address, so each block is one transaction. The baselines are read
+    // separately, as both together would exceed the 32 byte buffer of many wire libraries.
+    uint8_t reg = MPR121_ELECTRODE_DATA_2ND;
+    bool ok = ioaWireWriteWithRetry(wireImpl, i2cAddress, &reg, 1, 0, false) &&
+              ioaWireRead(wireImpl, i2cAddress, electrodeData, MPR121_ELECTRODE_DATA_SIZE);
+    if(ok && cacheBaselines) {
+        reg = MPR121_BASELINE_DATA_3RD;
+        ok = ioaWireWriteWithRetry(wireImpl, i2cAddress, &reg, 1, 0, false) &&
+             ioaWireRead(wireImpl, i2cAddress, &electrodeData[MPR121_ELECTRODE_DATA_SIZE], MPR121_TOTAL_PINS);
+    }
+    return ok;
+}
+
+void MPR121IoAbstraction::setRegisterShadowing(bool shadowed) {
+    if(shadowed && gpioShadow == nullptr) {
+        // control 0 through to enable, the data register within the range is kept up to date by runLoop.
+        gpioShadow = new WireRegisterShadow(MPR121_GPIO_CONTROL_0, MPR121_GPIO_ENABLE + 1 - MPR121_GPIO_CONTROL_0);
+    }
+    else if(!shadowed && gpioShadow != nullptr) {
+        gpioShadow->flush(wireImpl, i2cAddress);
+        delete gpioShadow;
+        gpioShadow = nullptr;
+    }
+}
+
 void MPR121IoAbstraction::softwareReset() {
     // perform a reset and stop the chip.
     wireWriteReg8(wireImpl, i2cAddress, MPR121_SOFT_RESET, MPR121_SOFT_RESET_VALUE);
     wireWriteReg8(wireImpl, i2cAddress, MPR121_ELECTRODE_CONFIG, 0);
+    if(gpioShadow) gpioShadow->invalidate();
 }
 
 void MPR121IoAbstraction::setPinLedCurrent(pinid_t pin, uint8_t pwr) {
@@ -513,9 +1077,21 @@ void MPR121IoAbstraction::electrodeSettingsForPin(pinid_t pin, uint8_t touchThre
 }
 
 uint16_t MPR121IoAbstraction::read2ndFilteredData(uint8_t pin) {
+    if(electrodeData != nullptr) {
+        if(pin >= MPR121_TOTAL_PINS) return 0;
+        return electrodeData[pin * 2] | ((uint16_t)electrodeData[(pin * 2) + 1] << 8U);
+    }
     return wireReadReg16(wireImpl, i2cAddress, MPR121_ELECTRODE_DATA_2ND + (pin * 2));
 }
 
+uint16_t MPR121IoAbstraction::readBaselineData(uint8_t pin) {
+    if(pin >= MPR121_TOTAL_PINS) return 0;
+    if(electrodeData != nullptr && cacheBaselines) {
+        return (uint16_t)electrodeData[MPR121_ELECTRODE_DATA_SIZE + pin] << 2U;
+    }
+    return (uint16_t)wireReadReg8(wireImpl, i2cAddress, MPR121_BASELINE_DATA_3RD + pin) << 2U;
+}
+
 uint16_t MPR121IoAbstraction::getOutOfRangeRegister() {
     return wireReadReg16(wireImpl, i2cAddress, MPR121_OOR_STATUS_16);
 }
@@ -524,63 +1100,85 @@ void MPR121IoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
     if(mode == LED_CURRENT_OUTPUT || mode == OUTPUT) {
         if(pin < 4) return;
         int gpioPinNo = pin - 4;
-        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_ENABLE, gpioPinNo, true);
-        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_DIRECTION_0, gpioPinNo, true);
-        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_0, gpioPinNo, mode == LED_CURRENT_OUTPUT);
-        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_1, gpioPinNo, mode == LED_CURRENT_OUTPUT);
+        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_ENABLE, gpioPinNo, true, gpioShadow);
+        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_DIRECTION_0, gpioPinNo, true, gpioShadow);
+        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_0, gpioPinNo, mode == LED_CURRENT_OUTPUT, gpioShadow);
+        toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_1, gpioPinNo, mode == LED_CURRENT_OUTPUT, gpioShadow);
     } else if(mode == INPUT || mode == INPUT_PULLUP){
         // if the touch support has already been prepared for our pin, there is nothing to do here. It is assumed that
         // in this case you have already configured the touch parameters. 
         if(maximumTouchPin < pin  && pin > 4) {
             int gpioPinNo = pin - 4;
-            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_ENABLE, gpioPinNo, true);
-            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_DIRECTION_0, gpioPinNo, false);
-            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_0, gpioPinNo, mode == INPUT_PULLUP);
-            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_1, gpioPinNo, mode == INPUT_PULLUP);
+            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_ENABLE, gpioPinNo, true, gpioShadow);
+            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_DIRECTION_0, gpioPinNo, false, gpioShadow);
+            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_0, gpioPinNo, mode == INPUT_PULLUP, gpioShadow);
+            toggleBitInRegister8(wireImpl, i2cAddress, MPR121_GPIO_CONTROL_1, gpioPinNo, mode == INPUT_PULLUP, gpioShadow);
         }
     }
 }
 
 void MPR121IoAbstraction::begin(int maxTouchPin, MPR121ConfigType configType, uint8_t configReg1, uint8_t configReg2) {
-    // go into stop mode before init.
-    writeReg8(MPR121_ELECTRODE_CONFIG, 0);
-
-    // set up the basic touch configuration
-    writeReg8(MPR121_MHD_RISING, 0x01);
-    writeReg8(MPR121_NHD_RISING, 0x01);
-    writeReg8(MPR121_NCL_RISING, 0x0E);
-    writeReg8(MPR121_FDL_RISING, 0x00);
-
-    writeReg8(MPR121_FDL_FALLING, 0x01);
-    writeReg8(MPR121_FDL_FALLING, 0x05);
-    writeReg8(MPR121_FDL_FALLING, 0x01);
-    writeReg8(MPR121_FDL_FALLING, 0x00);
-
-    writeReg8(MPR121_FDL_TOUCHED, 0x00);
-    writeReg8(MPR121_FDL_TOUCHED, 0x00);
-    writeReg8(MPR121_FDL_TOUCHED, 0x00);
+    prepareBegin(maxTouchPin, configType, configReg1, configReg2);
+    runAllInitSteps();
+}
 
-    // write the general configuration registers.
-    writeReg8(MPR121_AFE_CONFIG_1, configReg1);
-    writeReg8(MPR121_AFE_CONFIG_2, configReg2);
+void MPR121IoAbstraction::prepareBegin(int maxTouchPin, MPR121ConfigType configType, uint8_t configReg1, uint8_t configReg2) {
+    beginMaxTouchPin = maxTouchPin;
+    beginConfigType = configType;
+    beginConfigReg1 = configReg1;
+    beginConfigReg2 = configReg2;
+}
 
-    if(configType == MPR121_AUTO_CONFIG) {
+IoDeviceInitState MPR121IoAbstraction::initStep(uint8_t step) {
+    bool ok = true;
+    switch(step) {
+    case 0:
+        // go into stop mode before init.
+        ok = wireWriteReg8(wireImpl, i2cAddress, MPR121_ELECTRODE_CONFIG, 0);
+        break;
+    case 1: {
+        // the basic touch configuration, the rising, falling and touched filter registers from MHD rising onwards.
+        const uint8_t filters[] = { 0x01, 0x01, 0x0E, 0x00, 0x01, 0x05, 0x01, 0x00, 0x00, 0x00, 0x00 };
+        ok = wireWriteRegBlock(wireImpl, i2cAddress, MPR121_MHD_RISING, filters, sizeof filters);
+        break;
+    }
+    case 2: {
+        // write the general configuration registers.
+        const uint8_t afeConfig[] = { beginConfigReg1, beginConfigReg2 };
+        ok = wireWriteRegBlock(wireImpl, i2cAddress, MPR121_AFE_CONFIG_1, afeConfig, sizeof afeConfig);
+        break;
+    }
+    case 3:
         // These values are as per Adafruit library https://github.com/adafruit/Adafruit_MPR121/blob/master/Adafruit_MPR121.h
         // as most users will be using that board or a clone thereof.
-        writeReg8(MPR121_AUTO_CONFIG_0, 0x0B);
-
-        // correct values for Vdd = 3.3V
-        writeReg8(MPR121_UPPER_LIMIT, 200);  // ((Vdd - 0.7)/Vdd) * 256
-        writeReg8(MPR121_TARGET_LIMIT, 180); // UPLIMIT * 0.9
-        writeReg8(MPR121_LOWER_LIMIT, 130);  // UPLIMIT * 0.65
+        if(beginConfigType == MPR121_AUTO_CONFIG) ok = wireWriteReg8(wireImpl, i2cAddress, MPR121_AUTO_CONFIG_0, 0x0B);
+        break;
+    case 4:
+        if(beginConfigType == MPR121_AUTO_CONFIG) {
+            // correct values for Vdd = 3.3V, upper ((Vdd - 0.7)/Vdd) * 256, lower UPLIMIT * 0.65, target UPLIMIT * 0.9
+            const uint8_t limits[] = { 200, 130, 180 };
+            ok = wireWriteRegBlock(wireImpl, i2cAddress, MPR121_UPPER_LIMIT, limits, sizeof limits);
+        }
+        break;
+    default: {
+        uint8_t ecrSetting = 0b10000000 | (beginMaxTouchPin + 1);
+        if(!wireWriteReg8(wireImpl, i2cAddress, MPR121_ELECTRODE_CONFIG, ecrSetting)) return IOINIT_FAILED;
+        maximumTouchPin = beginMaxTouchPin;
+        return IOINIT_READY;
     }
-
-    uint8_t ecrSetting = 0b10000000 | (maxTouchPin + 1);
-    writeReg8(MPR121_ELECTRODE_CONFIG, ecrSetting);
-    maximumTouchPin = maxTouchPin;
+    }
+    return ok ? IOINIT_IN_PROGRESS : IOINIT_FAILED;
 }
 
 bool MPR121IoAbstraction::runLoop() {
+    if(isInitDeferred()) return true;
+    bool ok = (gpioShadow == nullptr) || gpioShadow->flush(wireImpl, i2cAddress);
+
+    // the electrode data goes first, reading the touch status below clears the interrupt.
+    if(electrodeData != nullptr && (!refreshOnInterrupt || internalDigitalDevice().digitalRead(interruptPin) == LOW)) {
+        ok = refreshElectrodeData() && ok;
+    }
+
     // is GPIO or touch on GPIO pins
     if(maximumTouchPin != 0 && !isReadPortSet(0)) {
         lastRead = readReg16(MPR121_TOUCH_STATUS_16);
@@ -596,10 +1194,11 @@ bool MPR121IoAbstraction::runLoop() {
     
     if(isWritePortSet(0) || isWritePortSet(1)) {
         writeReg8(MPR121_GPIO_DATA, (toWrite >> 4));
+        if(gpioShadow) gpioShadow->setKnownValue(MPR121_GPIO_DATA, toWrite >> 4);
     }
     clearChangeFlags();
 
-    return true;
+    return ok;
 }
 
 void MPR121IoAbstraction::attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) {
@@ -21,6 +21,10 @@
 #include "PlatformDeterminationWire.h"
 #include "IoAbstraction.h"
 #include "AnalogDeviceAbstraction.h"
+#include "I2cTransactionScheduler.h"
+#include "IoDeviceInitPipeline.h"
+
+class WireRegisterShadow;
 
 /**
  * An implementation of BasicIoAbstraction that supports the PCF8574/PCF8575 i2c IO chip. Providing all possible capabilities
@@ -28,9 +32,10 @@
  * @see ioFrom8574 for how to create an instance
  * @see ioDevicePinMode for setting pin modes
  */
-class PCF8574IoAbstraction : public BasicIoAbstraction {
+class PCF8574IoAbstraction : public BasicIoAbstraction, public I2cTransactionListener {
 public:
-    enum { NEEDS_WRITE_FLAG, PINS_CONFIGURED_READ_FLAG, PCF8575_16BIT_FLAG, INVERTED_LOGIC };
+    enum { NEEDS_WRITE_FLAG, PINS_CONFIGURED_READ_FLAG, PCF8575_16BIT_FLAG, INVERTED_LOGIC, ASYNC_SYNC_FLAG, ASYNC_LAST_OK_FLAG,
+           INTERRUPT_GATED_FLAG, FORCE_READ_FLAG };
 private:
 	WireType wireImpl;
 	uint8_t address;
@@ -38,6 +43,9 @@ private:
 	uint8_t toWrite[2];
 	uint8_t flags;
 	uint8_t interruptPin;
+	I2cTransaction syncTxn;
+	uint8_t txnWrite[2];
+	uint8_t txnRead[2];
 public:
 	/** 
 	 * Construct a 8574 expander on i2c address and with interrupts connected to a given pin (0xff no interrupts) 
@@ -79,6 +87,16 @@ public:
 	 */ 
 	uint8_t readPort(pinid_t pin) override;
 
+	/**
+	 * Reads many pins at once from the last cached state, that is updated each sync.
+	 */
+	IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+
+	/**
+	 * Writes many pins at once, the values are updated to the device each sync.
+	 */
+	void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
+
 	/** 
 	 * attaches an interrupt handler for this device. Notice for this device, all pin changes will be notified
 	 * on any pin of the port, it is not configurable at the device level, the type of interrupt will also
@@ -87,9 +105,42 @@ public:
 	void attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) override;
 
 	/** 
-	 * updates settings on the board after changes 
+	 * updates settings on the board after changes, in asynchronous mode this queues the transfer and returns straight
+	 * away, returning the status of the previous asynchronous sync.
 	 */
 	bool runLoop() override;
+
+	/**
+	 * Turns asynchronous sync on or off, this is only available where the bus can be used asynchronously, that is when
+	 * IOA_I2C_ASYNC_TRANSFERS is defined on mbed boards, elsewhere sync stays blocking. When on, each sync is
+	 * submitted to `i2cTransactionScheduler` instead of waiting on the bus, the read cache is updated once the
+	 * transaction completes, so values read lag by one transfer. A sync made while the previous one is still in
+	 * progress is folded into the next one.
+	 * @param async true for asynchronous sync, false for the default blocking sync
+	 * @return true if the mode was set, false if asynchronous sync is not available on this board
+	 */
+	bool setAsyncSync(bool async) {
+#ifdef IOA_I2C_ASYNC_TRANSFERS
+		bitWrite(flags, ASYNC_SYNC_FLAG, async);
+		return true;
+#else
+		return !async;
+#endif
+	}
+
+	/** called by the transaction scheduler when an asynchronous sync is complete */
+	void i2cTransactionComplete(I2cTransaction* transaction, bool success) override;
+
+	/**
+	 * Turns interrupt gated reads on or off, it needs the interrupt pin to have been provided. When on, sync only
+	 * reads the device when its interrupt line is asserted, otherwise the cached state is still current, as the
+	 * device raises the line on any input change. The device is always read on the first sync, and after each write,
+	 * because a write clears any pending interrupt on this device.
+	 * @param gated true to only read when the interrupt line is asserted
+	 */
+	void setInterruptGatedReads(bool gated);
+private:
+	bool isReadNeeded();
 };
 
 class Standard16BitDevice : public BasicIoAbstraction {
@@ -106,6 +157,8 @@ public:
     uint8_t readValue(pinid_t pin) override;
     void writePort(pinid_t pin, uint8_t port) override;
     uint8_t readPort(pinid_t pin) override;
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
     void clearChangeFlags();
     void setReadPort(int port);
     bool isReadPortSet(int port) const;
@@ -114,6 +167,73 @@ public:
     void markInitialised();
 };
 
+/**
+ * The largest number of 8 bit ports that a StandardMultiPortDevice can have, 5 ports covers 40 bit devices.
+ */
+#ifndef STD_MULTIPORT_MAX_PORTS
+#define STD_MULTIPORT_MAX_PORTS 5
+#endif
+
+/**
+ * The N port equivalent of Standard16BitDevice for the denser expanders with three or more 8 bit ports. It keeps the
+ * output and read cache per port, with a bit per port for those that have changed and those that are read, and
+ * provides the burst transfers that write or read a range of ports in one transaction on devices that auto
+ * increment the register address. Pin 0 is bit 0 of port 0, pin 8 is bit 0 of port 1 and so on.
+ */
+class StandardMultiPortDevice : public BasicIoAbstraction {
+protected:
+    uint8_t lastRead[STD_MULTIPORT_MAX_PORTS];
+    uint8_t toWrite[STD_MULTIPORT_MAX_PORTS];
+    uint8_t changedPorts;
+    uint8_t portsToRead;
+    uint8_t numPorts;
+    bool needsInit;
+    virtual void initDevice()=0;
+public:
+    explicit StandardMultiPortDevice(uint8_t ports);
+    ~StandardMultiPortDevice() override = default;
+
+    void writeValue(pinid_t pin, uint8_t value) override;
+    uint8_t readValue(pinid_t pin) override;
+    void writePort(pinid_t pin, uint8_t port) override;
+    uint8_t readPort(pinid_t pin) override;
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
+
+    /** @return the number of 8 bit ports on this device */
+    uint8_t getPortCount() const { return numPorts; }
+    void setReadPort(uint8_t port) { bitSet(portsToRead, port); }
+    bool isReadPortSet(uint8_t port) const { return bitRead(portsToRead, port); }
+    bool isWritePortSet(uint8_t port) const { return bitRead(changedPorts, port); }
+    void clearChangeFlags() { changedPorts = 0; }
+    bool isInitNeeded() const { return needsInit; }
+    void markInitialised() { needsInit = false; }
+
+protected:
+    /**
+     * Writes the registers for every port from the first to the last with a bit set in portMask in one transaction,
+     * ports in between are written with their current value.
+     * @param wire the wire implementation
+     * @param addr the device address
+     * @param firstReg the register for port 0, including any auto increment flag
+     * @param values the value for each port
+     * @param portMask a bit for each port that must be written
+     * @return true if there was nothing to write or the write succeeded
+     */
+    bool writePortBlock(WireType wire, uint8_t addr, uint8_t firstReg, const uint8_t* values, uint8_t portMask);
+
+    /**
+     * Reads the registers for every port from the first to the last with a bit set in portMask in one transaction.
+     * @param wire the wire implementation
+     * @param addr the device address
+     * @param firstReg the register for port 0, including any auto increment flag
+     * @param values where each port value is stored
+     * @param portMask a bit for each port that must be read
+     * @return true if there was nothing to read or the read succeeded
+     */
+    bool readPortBlock(WireType wire, uint8_t addr, uint8_t firstReg, uint8_t* values, uint8_t portMask);
+};
+
 /**
  * The interrupt mode in which the 23x17 device is going to operate. See the device datasheet for more information.
  * Using the ACTIVE_LOW_OPEN the library will ensure INPUT_PULLUP is used on the Arduino side.
@@ -127,13 +247,27 @@ enum Mcp23xInterruptMode {
  * of the GPIO functions and nearly all of the interrupt modes, and is therefore very close to Arduino pins in
  * terms of functionality.
  */
-class MCP23017IoAbstraction : public Standard16BitDevice {
+class MCP23017IoAbstraction : public Standard16BitDevice, public I2cTransactionListener, public DeferredInitDevice {
 private:
 	WireType wireImpl;
 	uint8_t  address;
 	pinid_t  intPinA;
 	pinid_t  intPinB;
 	uint8_t  intMode;
+	// asynchronous sync, the output latch write and the GPIO read are separate transactions.
+	I2cTransaction outputTxn;
+	I2cTransaction inputTxn;
+	uint8_t outputBuffer[3];
+	uint8_t inputRegister;
+	uint8_t inputBuffer[4];
+	uint8_t asyncPortsRead;
+	bool asyncSync;
+	bool asyncLastOk;
+	// interrupt gated reads, forceRead makes the next sync read GPIO regardless of the interrupt line.
+	bool gatedReads;
+	bool forceRead;
+	// when register shadowing is on, pin configuration is made to this and flushed on the next sync.
+	WireRegisterShadow* configShadow;
 public:
 	/**
 	 * Most complete constructor, allows for either single or dual interrupt mode and all capabilities
@@ -155,7 +289,7 @@ public:
     MCP23017IoAbstraction(uint8_t address, Mcp23xInterruptMode intMode, pinid_t intPinA, WireType wireImpl = nullptr);
 
 
-	~MCP23017IoAbstraction() override = default;
+	~MCP23017IoAbstraction() override;
 
 	/**
 	 * Sets the pin direction similar to pinMode, pin direction on this device supports INPUT_PULLUP, INPUT and OUTPUT.
@@ -171,9 +305,58 @@ public:
 	void attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) override;
 	
 	/** 
-	 * updates settings on the board after changes 
+	 * updates settings on the board after changes, in asynchronous mode this queues the transfers and returns
+	 * straight away, returning the status of the previous asynchronous sync.
 	 */
 	bool runLoop() override;
+
+	/**
+	 * Turns asynchronous sync on or off, this is only available where the bus can be used asynchronously, that is when
+	 * IOA_I2C_ASYNC_TRANSFERS is defined on mbed boards, elsewhere sync stays blocking. When on, the output and input
+	 * transfers of each sync are submitted to `i2cTransactionScheduler` instead of waiting on the bus, the read cache
+	 * is updated once the input transaction completes. Device initialisation and pin configuration are still carried
+	 * out directly.
+	 * @param async true for asynchronous sync, false for the default blocking sync
+	 * @return true if the mode was set, false if asynchronous sync is not available on this board
+	 */
+	bool setAsyncSync(bool async) {
+#ifdef IOA_I2C_ASYNC_TRANSFERS
+		asyncSync = async;
+		return true;
+#else
+		return !async;
+#endif
+	}
+
+	/**
+	 * Turns interrupt gated reads on or off, it needs an interrupt mode and pin to have been provided. When on, sync
+	 * only reads the device while its interrupt line is asserted, and then it reads INTF and INTCAP so that the state
+	 * captured at the time of the interrupt is reported even if the pin has changed back since. The following sync
+	 * then reads GPIO for the current state. Only pins that have an interrupt attached raise the line, so every input
+	 * that is read should have one, as is the case for switches in interrupt mode.
+	 * @param gated true to only read when the interrupt line is asserted
+	 */
+	void setInterruptGatedReads(bool gated);
+
+	/**
+	 * Turns register shadowing on or off. When on, pin direction, pull up, inversion and interrupt configuration are
+	 * made to a shadow of the configuration registers, which is read once in a single transfer, and all the changes
+	 * are written in one burst on the next sync. Without it, each change reads and writes its register straight away,
+	 * so configuring 16 pins costs well over 32 transactions. Turning it off flushes any pending changes.
+	 * @param shadowed true to shadow the configuration registers
+	 */
+	void setRegisterShadowing(bool shadowed);
+
+	/** called by the transaction scheduler when an asynchronous transfer is complete */
+	void i2cTransactionComplete(I2cTransaction* transaction, bool success) override;
+
+	/**
+	 * Initialisation for IoDeviceInitPipeline, it is a single step that sets up the control register for both
+	 * ports in one write. To have the pin configuration written in one burst too, turn on register shadowing before
+	 * configuring the pins in the ready callback.
+	 */
+	IoDeviceInitState initStep(uint8_t step) override;
+	const void* getInitBus() const override { return wireImpl; }
 	
     /**
      * This MCP23017 only function inverts the meaning of a given input pin. The pins for this
@@ -197,6 +380,9 @@ public:
 
 private:
 	void initDevice() override;
+	bool startAsyncSync();
+	bool isInterruptAsserted();
+	void applyCapturedInterrupts(const uint8_t* intfAndIntcap);
 };
 
 /**
@@ -205,11 +391,15 @@ private:
  * LCD units, switches, rotary encoders and matrix keyboards in the regular way. The LED current control facilities are
  * also exposed using an extension.
  */
-class AW9523IoAbstraction : public Standard16BitDevice {
+class AW9523IoAbstraction : public Standard16BitDevice, public DeferredInitDevice {
 private:
     WireType wireImpl;
     uint8_t i2cAddress;
     pinid_t interruptPin;
+    // batched LED current values, indexed by dimming register, with a bit per register that needs writing.
+    uint8_t ledCurrent[16];
+    uint16_t ledChanged;
+    bool batchLedUpdates;
 public:
     enum AW9523CurrentControl: uint8_t { FULL_CURRENT = 0, CURRENT_THREE_QUARTER = 1, CURRENT_HALF = 2, CURRENT_QUARTER = 3 };
 
@@ -254,27 +444,45 @@ public:
 
     /**
      * Enable or disable the LED controller mode of the pin, the power parameter is a value between 0 and 255 that
-     * represents the dimming level for that pin.
+     * represents the dimming level for that pin. With batched LED updates on, the value is written on the next sync.
      * @param pin the pin to control
      * @param pwr the current to provide, based on the global control setting, default 0..37mA.
      */
     void setPinLedCurrent(pinid_t pin, uint8_t pwr);
 
+    /**
+     * Turns batching of LED current updates on or off. When on, setPinLedCurrent only records the value, and the next
+     * sync writes all the dimming registers that changed in as few burst writes as possible, so updating every LED
+     * for an animation frame costs one or two transactions instead of sixteen.
+     * @param batched true to write LED current changes on sync
+     */
+    void setBatchedLedUpdates(bool batched);
+
     /**
      * You can change the global control register using this function, setting P0 either as push pull or open drain,
      * you can also change the max-current range setting for the chip. This is as per datasheet. Make sure you've called
      * sync at least once before calling.
      * @param pushPullP0 true - enable push pull, false - open drain
      * @param maxCurrentMode - see the AW9523CurrentControl enumeration for appropriate values
+     * @return true if the register was written
      */
-    void writeGlobalControl(bool pushPullP0, AW9523CurrentControl maxCurrentMode = FULL_CURRENT);
+    bool writeGlobalControl(bool pushPullP0, AW9523CurrentControl maxCurrentMode = FULL_CURRENT);
 
     /**
      * Perform a software reset of the device. Make sure you've called sync at least once before calling.
+     * @return true if the reset was sent
      */
-    void softwareReset();
+    bool softwareReset();
+
+    /**
+     * Initialisation for IoDeviceInitPipeline in three steps, the software reset, then the direction and interrupt
+     * registers of both ports in one burst, and lastly the global control.
+     */
+    IoDeviceInitState initStep(uint8_t step) override;
+    const void* getInitBus() const override { return wireImpl; }
 private:
     void initDevice() override;
+    bool flushLedCurrents();
 };
 
 /**
@@ -317,6 +525,7 @@ public:
 #define MPR121_OOR_STATUS_16 0x02
 #define MPR121_ELECTRODE_DATA_2ND 0x04
 #define MPR121_BASELINE_DATA_3RD 0x1E
+#define MPR121_ELECTRODE_DATA_SIZE (MPR121_TOTAL_PINS * 2)
 #define MPR121_MHD_RISING 0x2B
 #define MPR121_NHD_RISING 0x2C
 #define MPR121_NCL_RISING 0x2D
@@ -370,12 +579,22 @@ enum MPR121ConfigType: uint8_t { MPR121_MANUAL_CONFIG, MPR121_AUTO_CONFIG };
  * helper functions to do some of the legwork, but given the shear number of possible configurations many of the
  * touch registers need to be set up manually.
  */
-class MPR121IoAbstraction : public Standard16BitDevice {
+class MPR121IoAbstraction : public Standard16BitDevice, public DeferredInitDevice {
 private:
     WireType wireImpl;
     uint8_t i2cAddress;
     pinid_t interruptPin;
     pinid_t maximumTouchPin = 0;
+    WireRegisterShadow* gpioShadow = nullptr;
+    // when electrode caching is on, the raw filtered data registers followed by the baseline registers if cached.
+    uint8_t* electrodeData = nullptr;
+    bool cacheBaselines = false;
+    bool refreshOnInterrupt = false;
+    // the configuration that begin, or the init pipeline, sets up.
+    uint8_t beginMaxTouchPin = 0;
+    uint8_t beginConfigReg1 = 0x10;
+    uint8_t beginConfigReg2 = 0x20;
+    MPR121ConfigType beginConfigType = MPR121_AUTO_CONFIG;
 public:
     /**
      * create an instance of the abstraction that communicates with the device and extends Arduino like functions
@@ -387,7 +606,7 @@ public:
      * @param wirePtr optionally an alternative wire implementation, EG Wire1, or other non standard I2C device.
      */
     explicit MPR121IoAbstraction(uint8_t addr, pinid_t intPin = IO_PIN_NOT_DEFINED, WireType wirePtr = nullptr);
-    ~MPR121IoAbstraction() override = default;
+    ~MPR121IoAbstraction() override;
 
     /**
      * Call this to start the device, it will initialise the touch sensor up to maxTouchPin, and set basic configuration
@@ -401,6 +620,20 @@ public:
      */
     void begin(int maxTouchPin, MPR121ConfigType configType, uint8_t configReg1 = 0x10, uint8_t configReg2 = 0x20);
 
+    /**
+     * Records the configuration that begin would set up, without talking to the device, for when the device is
+     * started by IoDeviceInitPipeline instead, the parameters are as per begin. Sync never initialises this device,
+     * so should the pipeline report it as failed, call begin to try again.
+     */
+    void prepareBegin(int maxTouchPin, MPR121ConfigType configType, uint8_t configReg1 = 0x10, uint8_t configReg2 = 0x20);
+
+    /**
+     * The steps that begin carries out, with each group of adjacent registers written in one burst, so that the
+     * device can be started by IoDeviceInitPipeline after prepareBegin.
+     */
+    IoDeviceInitState initStep(uint8_t step) override;
+    const void* getInitBus() const override { return wireImpl; }
+
     /**
      * Sets the pin direction similar to pinMode, pin direction on this device supports INPUT, OUTPUT and
      * LED_CURRENT_OUTPUT which enables the onboard LED controller, and then you use the setPinLedCurrent to control
@@ -450,12 +683,39 @@ public:
 
     /**
      * Read the electrode filtered data, which is after the 2nd filter from the datasheet. This reads Electrode Data
-     * Registers 0x04-0x1D. See datasheet for more detail.
+     * Registers 0x04-0x1D. When electrode data caching is on, this returns the value from the last refresh without
+     * any bus traffic. See datasheet for more detail.
      * @param pin the pin number
      * @return the value from the registers
      */
     uint16_t read2ndFilteredData(uint8_t pin);
 
+    /**
+     * Read the electrode baseline value, which is after the 3rd filter from the datasheet. The register holds the
+     * upper 8 bits of the 10 bit value, so the value is returned shifted to be comparable with read2ndFilteredData.
+     * When electrode data caching is on with baselines, this returns the value from the last refresh.
+     * @param pin the pin number
+     * @return the baseline value
+     */
+    uint16_t readBaselineData(uint8_t pin);
+
+    /**
+     * Turns caching of the electrode data on or off. When on, each sync reads the filtered data of all electrodes
+     * in one burst, and optionally the baselines in a second, then per pin reads, including those through
+     * MPR121AnalogAbstraction, come from the cache. When refreshing on interrupt, the burst is only read while the
+     * interrupt line is asserted, which the device does when the touch status changes.
+     * @param cached true to cache the electrode data
+     * @param includeBaselines true to also cache the baseline values
+     * @param onInterrupt true to only refresh while the interrupt line is asserted, needs the interrupt pin
+     */
+    void setElectrodeDataCaching(bool cached, bool includeBaselines = false, bool onInterrupt = false);
+
+    /**
+     * Reads the electrode data into the cache straight away, normally it is called during sync.
+     * @return true if the read succeeded, false if it failed or caching is off
+     */
+    bool refreshElectrodeData();
+
     /**
      * Enable or disable the LED controller mode of the pin, the power parameter is a value between 0 and 255 that
      * represents the dimming level for that pin.
@@ -464,6 +724,15 @@ public:
      */
     void setPinLedCurrent(pinid_t pin, uint8_t pwr);
 
+    /**
+     * Turns register shadowing of the GPIO configuration registers on or off. When on, GPIO pin direction changes are
+     * made to a shadow that is read once, and all changes are written in one burst on the next sync. The electrode
+     * configuration is not shadowed, as the device only accepts it in stop mode. Turning it off flushes any pending
+     * changes.
+     * @param shadowed true to shadow the GPIO configuration registers
+     */
+    void setRegisterShadowing(bool shadowed);
+
     /**
      * Perform a software reset of the device. Make sure you've called sync at least once before calling.
      */
@@ -504,6 +773,104 @@ public:
     void setCurrentFloat(pinid_t pin, float newValue) override { theAbstraction.setPinLedCurrent(pin, (uint8_t)(newValue * 15.0F)); }
 };
 
+/**
+ * Describes the register layout of an expander that keeps one register per port in consecutive banks, which covers
+ * the TCA6424, TCA9535 family and PCA9505/6. Each value is the register for port 0 of that bank.
+ */
+struct MultiPortRegisterLayout {
+    uint8_t numPorts;
+    uint8_t inputReg;
+    uint8_t outputReg;
+    uint8_t polarityReg;
+    uint8_t configReg;
+    /** the interrupt mask bank, where 1 masks the pin, or 0xff if the device has none */
+    uint8_t interruptMaskReg;
+    /** the bit or'd into the register address to make the device auto increment */
+    uint8_t autoIncrementFlag;
+};
+
+/**
+ * An implementation of BasicIoAbstraction for N port I2C expanders that have a bank of input, output, polarity and
+ * configuration registers with one register per port, such as the 24 bit TCA6424 and the 40 bit PCA9506. The output,
+ * configuration and mask registers are held locally, so pin configuration only changes the local copy, and each sync
+ * writes the changed output ports, then any changed configuration, then reads the input ports, each of them as a
+ * single auto increment transfer. Outputs go first so that a pin becoming an output starts at the right level. Inputs are pulled up externally on these devices, INPUT_PULLUP is treated as INPUT.
+ * @see TCA6424IoAbstraction
+ * @see PCA9506IoAbstraction
+ */
+class MultiPortIoExpander : public StandardMultiPortDevice {
+private:
+    WireType wireImpl;
+    const MultiPortRegisterLayout& layout;
+    uint8_t address;
+    pinid_t interruptPin;
+    uint8_t configuration[STD_MULTIPORT_MAX_PORTS];
+    uint8_t polarity[STD_MULTIPORT_MAX_PORTS];
+    uint8_t interruptMask[STD_MULTIPORT_MAX_PORTS];
+    uint8_t configChanged;
+    uint8_t polarityChanged;
+    uint8_t maskChanged;
+public:
+    /**
+     * Create an N port expander with a given register layout, normally use one of the device classes instead.
+     * @param regLayout the register layout of the device, it must remain valid for the life of this object
+     * @param addr the I2C address
+     * @param intPin the board pin the interrupt line is connected to, or IO_PIN_NOT_DEFINED
+     * @param wirePtr optionally the wire implementation, defaults to the standard one
+     */
+    MultiPortIoExpander(const MultiPortRegisterLayout& regLayout, uint8_t addr, pinid_t intPin = IO_PIN_NOT_DEFINED,
+                        WireType wirePtr = nullptr);
+    ~MultiPortIoExpander() override = default;
+
+    /**
+     * Sets the pin direction, INPUT, INPUT_PULLUP (pulled up externally) and OUTPUT are supported, the change is
+     * written on the next sync.
+     */
+    void pinDirection(pinid_t pin, uint8_t mode) override;
+
+    /**
+     * Attaches the interrupt to the board pin, these devices raise the interrupt on any change of an input pin, so
+     * the mode is always CHANGE. On devices with an interrupt mask, the pin is unmasked.
+     */
+    void attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) override;
+
+    /**
+     * Inverts the meaning of an input pin, written on the next sync.
+     * @param pin the input pin
+     * @param shouldInvert true to invert the pin
+     */
+    void setInvertInputPin(pinid_t pin, bool shouldInvert);
+
+    /** writes changed outputs and configuration, then reads inputs, see the class description. */
+    bool runLoop() override;
+private:
+    void initDevice() override;
+};
+
+/** The register layout of the TCA6424 24 bit expander */
+extern const MultiPortRegisterLayout tca6424RegisterLayout;
+
+/** The register layout of the PCA9506 40 bit expander */
+extern const MultiPortRegisterLayout pca9506RegisterLayout;
+
+/**
+ * The TCA6424 is a 24 bit I2C expander at address 0x22 or 0x23, pins 0..23 are P00..P27.
+ */
+class TCA6424IoAbstraction : public MultiPortIoExpander {
+public:
+    explicit TCA6424IoAbstraction(uint8_t addr, pinid_t intPin = IO_PIN_NOT_DEFINED, WireType wirePtr = nullptr)
+            : MultiPortIoExpander(tca6424RegisterLayout, addr, intPin, wirePtr) {}
+};
+
+/**
+ * The PCA9506 is a 40 bit I2C expander at addresses 0x20 to 0x27, pins 0..39 are IO0_0..IO4_7.
+ */
+class PCA9506IoAbstraction : public MultiPortIoExpander {
+public:
+    explicit PCA9506IoAbstraction(uint8_t addr, pinid_t intPin = IO_PIN_NOT_DEFINED, WireType wirePtr = nullptr)
+            : MultiPortIoExpander(pca9506RegisterLayout, addr, intPin, wirePtr) {}
+};
+
 // to remain compatible with old code
 #define ioFrom8754 ioFrom8575
 
@@ -587,6 +954,28 @@ inline IoAbstractionRef ioFrom23017(uint8_t addr, Mcp23xInterruptMode intMode, p
     return ioFrom23017(addr, intMode, interruptPin, defaultWireTypePtr);
 }
 
+/**
+ * Creates an instance of an IoAbstraction that works with a TCA6424 24 bit expander.
+ * @param addr the i2c address of the device
+ * @param interruptPin optionally the board pin the interrupt line is connected to
+ * @param wireImpl optionally the wire implementation, defaults to the standard one
+ * @return an IoAbstactionRef for the device
+ */
+inline IoAbstractionRef ioFromTca6424(uint8_t addr, pinid_t interruptPin = IO_PIN_NOT_DEFINED, WireType wireImpl = nullptr) {
+    return ioaCreate<TCA6424IoAbstraction>(addr, interruptPin, wireImpl);
+}
+
+/**
+ * Creates an instance of an IoAbstraction that works with a PCA9506 40 bit expander.
+ * @param addr the i2c address of the device
+ * @param interruptPin optionally the board pin the interrupt line is connected to
+ * @param wireImpl optionally the wire implementation, defaults to the standard one
+ * @return an IoAbstactionRef for the device
+ */
+inline IoAbstractionRef ioFromPca9506(uint8_t addr, pinid_t interruptPin = IO_PIN_NOT_DEFINED, WireType wireImpl = nullptr) {
+    return ioaCreate<PCA9506IoAbstraction>(addr, interruptPin, wireImpl);
+}
+
 inline IoAbstractionRef ioFrom23017(pinid_t addr) {
     return ioFrom23017(addr, defaultWireTypePtr);
 }
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "IoDeviceInitPipeline.h"
+#include "IoLogging.h"
+
+bool DeferredInitDevice::runAllInitSteps() {
+    uint8_t step = 0;
+    IoDeviceInitState state;
+    while((state = initStep(step)) == IOINIT_IN_PROGRESS) {
+        step++;
+    }
+    return state == IOINIT_READY;
+}
+
+IoDeviceInitPipeline::IoDeviceInitPipeline() : devices{}, nextStep{}, retries{}, states{}, readyFn(nullptr),
+                                               lastBus(nullptr), passMicros(IOA_INIT_PASS_MICROS), numDevices(0),
+                                               firstInPass(0), running(false) {
+}
+
+bool IoDeviceInitPipeline::addDevice(DeferredInitDevice* device) {
+    if(running || numDevices >= IOA_INIT_PIPELINE_SIZE) {
+        serlogF2(SER_ERROR, "Init pipeline full or started ", numDevices);
+        return false;
+    }
+    devices[numDevices] = device;
+    nextStep[numDevices] = 0;
+    retries[numDevices] = 0;
+    states[numDevices] = IOINIT_PENDING;
+    device->setInitDeferred(true);
+    numDevices++;
+    return true;
+}
+
+void IoDeviceInitPipeline::start(IoDeviceReadyFn onReady, uint32_t intervalMicros) {
+    readyFn = onReady;
+    passMicros = intervalMicros;
+    if(running) return;
+    running = true;
+    taskManager.scheduleOnce(0, this, TIME_MICROS);
+}
+
+bool IoDeviceInitPipeline::runToCompletion() {
+    running = true;
+    while(runPass());
+    running = false;
+
+    for(uint8_t i = 0; i < numDevices; i++) {
+        if(states[i] != IOINIT_READY) return false;
+    }
+    return true;
+}
+
+void IoDeviceInitPipeline::exec() {
+    if(runPass()) {
+        taskManager.scheduleOnce(passMicros, this, TIME_MICROS);
+    }
+    else {
+        running = false;
+    }
+}
+
+bool IoDeviceInitPipeline::isComplete() const {
+    for(uint8_t i = 0; i < numDevices; i++) {
+        if(isPending(i)) return false;
+    }
+    return true;
+}
+
+bool IoDeviceInitPipeline::runPass() {
+    uint32_t steppedThisPass = 0;
+    uint8_t toStep = 0;
+    for(uint8_t i = 0; i < numDevices; i++) {
+        if(isPending(i)) toStep++;
+    }
+
+    // each device gets one step per pass, starting from a different device each time, and where there is a choice,
+    // the next step is for a device on a different bus to the last, so that no one bus or device is hammered.
+    while(toStep != 0) {
+        uint8_t chosen = 0xff;
+        for(uint8_t n = 0; n < numDevices; n++) {
+            uint8_t idx = (firstInPass + n) % numDevices;
+            if(!isPending(idx) || bitRead(steppedThisPass, idx)) continue;
+            if(chosen == 0xff) chosen = idx;
+            if(devices[idx]->getInitBus() != lastBus) {
+                chosen = idx;
+                break;
+            }
+        }
+        bitSet(steppedThisPass, chosen);
+        lastBus = devices[chosen]->getInitBus();
+        stepDevice(chosen);
+        toStep--;
+    }
+
+    if(numDevices != 0) firstInPass = (firstInPass + 1) % numDevices;
+    return !isComplete();
+}
+
+void IoDeviceInitPipeline::stepDevice(uint8_t idx) {
+    IoDeviceInitState state = devices[idx]->initStep(nextStep[idx]);
+    if(state == IOINIT_IN_PROGRESS) {
+        states[idx] = IOINIT_IN_PROGRESS;
+        nextStep[idx]++;
+        // the retry limit is for each step, so the next step starts afresh.
+        retries[idx] = 0;
+        return;
+    }
+
+    if(state == IOINIT_FAILED && retries[idx] < IOA_INIT_STEP_RETRIES) {
+        // the same step is tried again on the next pass.
+        retries[idx]++;
+        serlogF3(SER_WARNING, "Init step retry ", idx, nextStep[idx]);
+        return;
+    }
+
+    states[idx] = state;
+    devices[idx]->setInitDeferred(false);
+    serlogF3(SER_IOA_INFO, "Init device done ", idx, state == IOINIT_READY);
+    if(readyFn) readyFn(idx, state == IOINIT_READY);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_IODEVICEINITPIPELINE_H
+#define IOABSTRACTION_IODEVICEINITPIPELINE_H
+
+/**
+ * @file IoDeviceInitPipeline.h
+ * @brief Initialises expanders in short steps on task manager, interleaved across the devices and buses, so that a
+ * board with many devices can bring up its UI while the slower devices are still being set up.
+ */
+
+#include "PlatformDetermination.h"
+#include <TaskManagerIO.h>
+
+// START user adjustable section
+
+/**
+ * The largest number of devices that one pipeline can initialise, up to 32.
+ */
+#ifndef IOA_INIT_PIPELINE_SIZE
+#define IOA_INIT_PIPELINE_SIZE 8
+#endif
+
+/**
+ * The number of times a failed step is tried again on later passes before the device is reported as failed.
+ */
+#ifndef IOA_INIT_STEP_RETRIES
+#define IOA_INIT_STEP_RETRIES 2
+#endif
+
+/**
+ * The default interval in microseconds between passes of the pipeline, where each device not yet ready has one step.
+ */
+#ifndef IOA_INIT_PASS_MICROS
+#define IOA_INIT_PASS_MICROS 500
+#endif
+
+// END user adjustable section
+
+/**
+ * The state of a device within the init pipeline, also returned by each init step.
+ */
+enum IoDeviceInitState : uint8_t {
+    /** no step has been carried out yet */
+    IOINIT_PENDING,
+    /** some steps have been carried out, there are more to do */
+    IOINIT_IN_PROGRESS,
+    /** all the steps are done and the device can be used */
+    IOINIT_READY,
+    /**
+     * a step failed after its retries, an expander then tries its usual initialisation on its next sync, but an
+     * MPR121 does no initialisation in sync, so begin has to be called on it again
+     */
+    IOINIT_FAILED
+};
+
+/**
+ * Implemented by devices whose initialisation can be broken down into steps, each a single transaction or register
+ * burst, so that IoDeviceInitPipeline can interleave the steps of several devices. Such a device added to a pipeline
+ * defers its initialisation, its sync does nothing until the pipeline reports it as ready, and it should not be
+ * configured until then, so do the pin configuration for the device in the ready callback.
+ */
+class DeferredInitDevice {
+private:
+    bool initDeferred = false;
+public:
+    virtual ~DeferredInitDevice() = default;
+
+    /**
+     * Carries out one step of initialising the device.
+     * @param step the step to carry out, starting at 0, a failed step is retried with the same number
+     * @return IOINIT_IN_PROGRESS when there are more steps, IOINIT_READY after the last, or IOINIT_FAILED
+     */
+    virtual IoDeviceInitState initStep(uint8_t step) = 0;
+
+    /** @return the bus that the device is on, so that the pipeline can alternate between buses, or nullptr */
+    virtual const void* getInitBus() const { return nullptr; }
+
+    /**
+     * Carries out all the steps straight away, as the device does in its first sync when not in a pipeline.
+     * @return true if every step succeeded
+     */
+    bool runAllInitSteps();
+
+    /** Called by the pipeline, while deferred the device leaves its initialisation to the pipeline. */
+    void setInitDeferred(bool deferred) { initDeferred = deferred; }
+
+    /** @return true while the device is waiting on a pipeline to initialise it */
+    bool isInitDeferred() const { return initDeferred; }
+};
+
+/**
+ * Called as each device in a pipeline completes.
+ * @param deviceIdx the index of the device, in the order it was added
+ * @param ok true if the device is ready, false if it failed
+ */
+typedef void (*IoDeviceReadyFn)(uint8_t deviceIdx, bool ok);
+
+/**
+ * Initialises a group of devices at boot without holding up the rest of the sketch. Without it, each expander is
+ * initialised in full by its first sync, one after another, so a board with several expanders spends a long time in
+ * setup before anything else runs. The pipeline instead runs on task manager in passes, and in each pass carries
+ * out one step for each device not yet ready, taking devices on different buses in turn where it can. Each step is a
+ * single transaction or register burst, so task manager and the UI keep running between them, and a device that
+ * needs time after a reset step gets it while the others are stepped.
+ *
+ * ```
+ * IoDeviceInitPipeline initPipeline;
+ * initPipeline.addDevice(&expander1);
+ * initPipeline.addDevice(&touchSensor);
+ * initPipeline.start([](uint8_t idx, bool ok) { ... configure the pins of device idx ... });
+ * ```
+ */
+class IoDeviceInitPipeline : public Executable {
+private:
+    DeferredInitDevice* devices[IOA_INIT_PIPELINE_SIZE];
+    uint8_t nextStep[IOA_INIT_PIPELINE_SIZE];
+    uint8_t retries[IOA_INIT_PIPELINE_SIZE];
+    IoDeviceInitState states[IOA_INIT_PIPELINE_SIZE];
+    IoDeviceReadyFn readyFn;
+    const void* lastBus;
+    uint32_t passMicros;
+    uint8_t numDevices;
+    uint8_t firstInPass;
+    bool running;
+public:
+    IoDeviceInitPipeline();
+
+    /**
+     * Adds a device to the pipeline, its initialisation is deferred from now until the pipeline completes it.
+     * @param device the device to initialise
+     * @return true if added, false if the pipeline is full or already started
+     */
+    bool addDevice(DeferredInitDevice* device);
+
+    /**
+     * Starts the passes on task manager, returning straight away.
+     * @param onReady optionally called as each device completes
+     * @param intervalMicros the time between passes
+     */
+    void start(IoDeviceReadyFn onReady = nullptr, uint32_t intervalMicros = IOA_INIT_PASS_MICROS);
+
+    /**
+     * Carries out the passes straight away until every device is complete, for when the sketch cannot continue
+     * without the devices. The steps are still interleaved.
+     * @return true if every device is ready
+     */
+    bool runToCompletion();
+
+    /**
+     * Carries out one pass, one step for each device not yet complete, normally called on task manager.
+     * @return true if there is more to do
+     */
+    bool runPass();
+
+    /** @return the state of the device at the given index */
+    IoDeviceInitState getState(uint8_t idx) const { return idx < numDevices ? states[idx] : IOINIT_FAILED; }
+
+    /** @return true if the device at the given index is ready to use */
+    bool isReady(uint8_t idx) const { return getState(idx) == IOINIT_READY; }
+
+    /** @return true once every device is either ready or failed */
+    bool isComplete() const;
+
+    /** @return the number of devices added */
+    uint8_t getDeviceCount() const { return numDevices; }
+
+    void exec() override;
+private:
+    bool isPending(uint8_t idx) const { return states[idx] == IOINIT_PENDING || states[idx] == IOINIT_IN_PROGRESS; }
+    void stepDevice(uint8_t idx);
+};
+
+#endif //IOABSTRACTION_IODEVICEINITPIPELINE_H
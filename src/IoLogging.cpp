@@ -13,23 +13,47 @@
 
 unsigned int enabledLevels = IO_LOGGING_DEFAULT_LEVEL;
 
+static const char hexChar[] = { "0123456789ABCDEF" };
+
+#define HEX_DUMP_PER_LINE 8
+
+/**
+ * Fills a line buffer with up to HEX_DUMP_PER_LINE bytes in hex, each followed by a space, apart from the last on a
+ * whole line, which is followed by a new line. The buffer must hold HEX_DUMP_PER_LINE * 3 + 1 characters.
+ */
+static void hexDumpLine(char* line, const uint8_t* data, size_t len) {
+    size_t pos = 0;
+    for(size_t i = 0; i < len; i++) {
+        line[pos++] = hexChar[data[i] >> 4];
+        line[pos++] = hexChar[data[i] & 0x0f];
+        line[pos++] = (i == (HEX_DUMP_PER_LINE - 1)) ? '\n' : ' ';
+    }
+    line[pos] = 0;
+}
+
+#ifdef IO_LOGGING_DEFERRED
+static void deferHexDump(SerLoggingLevel level, const char *title, const uint8_t* data, size_t len);
+#endif
+
 void serlogHexDump(SerLoggingLevel level, const char *title, const void* data, size_t strlen) {
     if(!serLevelEnabled(level)) return;
 
+    const auto str = (const uint8_t *) data;
+#ifdef IO_LOGGING_DEFERRED
+    deferHexDump(level, title, str, strlen);
+#else
     logTimeAndLevel(title, level);
     LoggingPort.println();
 
-    const auto str = (const uint8_t *) data;
-    static const  char hexChar[] = { "0123456789ABCDEF" };
-    for (size_t ii = 0; ii < strlen; ii++) {
-        char sz[4];
-        sz[0] = hexChar[str[ii] >> 4];
-        sz[1] = hexChar[str[ii] & 0x0f];
-        sz[2] = ((ii % 8) == 7) ? '\n' : ' ';
-        sz[3] = 0;
-        LoggingPort.print(sz);
-    };
+    // each line is built on the stack and written in one go.
+    char line[(HEX_DUMP_PER_LINE * 3) + 1];
+    for (size_t ii = 0; ii < strlen; ii += HEX_DUMP_PER_LINE) {
+        size_t remaining = strlen - ii;
+        hexDumpLine(line, &str[ii], remaining > HEX_DUMP_PER_LINE ? HEX_DUMP_PER_LINE : remaining);
+        LoggingPort.print(line);
+    }
     LoggingPort.println();
+#endif
 }
 
 const char* prettyLevel(SerLoggingLevel level) {
@@ -81,4 +105,191 @@ void startTaskManagerLogDelegate() {
 PrintfLogger LoggingPort;
 #endif
 
+#ifdef IO_LOGGING_DEFERRED
+
+#include <TaskManagerIO.h>
+
+static_assert((IO_LOGGING_DEFERRED_SIZE & (IO_LOGGING_DEFERRED_SIZE - 1)) == 0, "IO_LOGGING_DEFERRED_SIZE must be a power of two");
+
+#define LOG_RING_MASK (IO_LOGGING_DEFERRED_SIZE - 1)
+
+// producers may be interrupts that preempt other producers, so a slot is claimed with a compare and swap where the
+// platform has one, otherwise with interrupts masked for the few instructions that claiming takes.
+#if defined(__AVR__)
+# define IOLOG_CLAIM_START uint8_t oldSreg = SREG; cli();
+# define IOLOG_CLAIM_END SREG = oldSreg;
+#elif defined(BUILD_FOR_PICO_CMAKE)
+# include <hardware/sync.h>
+# define IOLOG_CLAIM_START uint32_t oldIrq = save_and_disable_interrupts();
+# define IOLOG_CLAIM_END restore_interrupts(oldIrq);
+#elif defined(IOA_USE_MBED)
+# define IOLOG_CLAIM_START core_util_critical_section_enter();
+# define IOLOG_CLAIM_END core_util_critical_section_exit();
+#elif __GCC_ATOMIC_INT_LOCK_FREE == 2
+# define IOLOG_CLAIM_CAS
+#else
+# define IOLOG_CLAIM_START noInterrupts();
+# define IOLOG_CLAIM_END interrupts();
+#endif
+
+static IoLogRecord logRing[IO_LOGGING_DEFERRED_SIZE];
+static volatile unsigned int logHead = 0; // claimed by producers
+static volatile unsigned int logTail = 0; // only written by the drain
+static volatile unsigned long logDropped = 0;
+static unsigned long logDroppedReported = 0;
+
+static bool claimLogSlot(unsigned int& slot) {
+#ifdef IOLOG_CLAIM_CAS
+    unsigned int head;
+    do {
+        head = logHead;
+        if((head - logTail) >= IO_LOGGING_DEFERRED_SIZE) return false;
+    } while(!__sync_bool_compare_and_swap(&logHead, head, head + 1));
+    slot = head;
+    return true;
+#else
+    bool claimed = false;
+    IOLOG_CLAIM_START
+    if((logHead - logTail) < IO_LOGGING_DEFERRED_SIZE) {
+        slot = logHead;
+        logHead = slot + 1;
+        claimed = true;
+    }
+    IOLOG_CLAIM_END
+    return claimed;
+#endif
+}
+
+void ioLogDeferred(SerLoggingLevel level, IoLogTitle title, char separator, IoLogArg a1, IoLogArg a2, IoLogArg a3) {
+    unsigned int slot;
+    if(!claimLogSlot(slot)) {
+        logDropped = logDropped + 1;
+        return;
+    }
+    IoLogRecord& rec = logRing[slot & LOG_RING_MASK];
+    rec.timestamp = millis();
+    rec.title = title;
+    rec.level = level;
+    rec.separator = separator;
+    rec.args[0] = a1;
+    rec.args[1] = a2;
+    rec.args[2] = a3;
+
+    // the strings may be temporary, so they are copied into the record now, cut short if there is no more room.
+    uint8_t textPos = 0;
+    for(auto& arg : rec.args) {
+        if(arg.type != IOLOG_ARG_STRING) continue;
+        const char* str = arg.stringValue != nullptr ? arg.stringValue : "";
+        arg.length = textPos;
+        while(*str && textPos < (IO_LOGGING_DEFERRED_TEXT - 1)) rec.text[textPos++] = *str++;
+        rec.text[textPos] = 0;
+        if(textPos < (IO_LOGGING_DEFERRED_TEXT - 1)) textPos++;
+    }
+    __sync_synchronize();
+    rec.ready = true;
+}
+
+static void deferHexDump(SerLoggingLevel level, const char *title, const uint8_t* data, size_t len) {
+    static_assert(HEX_DUMP_PER_LINE <= (IOLOG_BYTES_PER_ARG * 3), "a hex dump line must fit in one record");
+    // a record for the title, then a record for each line with the bytes held in the arguments, the separator of the
+    // last line is a new line, as the direct dump ends with one.
+    ioLogDeferred(level, nullptr, ' ', ioLogArg(title));
+    size_t i = 0;
+    do {
+        IoLogArg args[3] = {};
+        args[0].type = IOLOG_ARG_BYTES;
+        size_t lineLen = (len - i) > HEX_DUMP_PER_LINE ? HEX_DUMP_PER_LINE : (len - i);
+        for(size_t b = 0; b < lineLen; b++) {
+            IoLogArg& arg = args[b / IOLOG_BYTES_PER_ARG];
+            arg.type = IOLOG_ARG_BYTES;
+            arg.bytes[arg.length++] = data[i + b];
+        }
+        i += lineLen;
+        ioLogDeferred(level, nullptr, (i < len) ? ' ' : '\n', args[0], args[1], args[2]);
+    } while(i < len);
+}
+
+static void printHexDumpRecord(const IoLogRecord& rec) {
+    // the bytes are put back together and formatted by hexDumpLine, so the output is the same as a direct dump.
+    uint8_t bytes[HEX_DUMP_PER_LINE];
+    size_t len = 0;
+    for(uint8_t i = 0; i < 3 && rec.args[i].type == IOLOG_ARG_BYTES; i++) {
+        for(uint8_t b = 0; b < rec.args[i].length && len < HEX_DUMP_PER_LINE; b++) bytes[len++] = rec.args[i].bytes[b];
+    }
+    char line[(HEX_DUMP_PER_LINE * 3) + 1];
+    hexDumpLine(line, bytes, len);
+    LoggingPort.print(line);
+    if(rec.separator == '\n') LoggingPort.println();
+}
+
+static void printLogArg(const IoLogRecord& rec, const IoLogArg& arg) {
+    switch(arg.type) {
+        case IOLOG_ARG_SIGNED: LoggingPort.print(arg.signedValue); break;
+        case IOLOG_ARG_UNSIGNED: LoggingPort.print(arg.unsignedValue); break;
+        case IOLOG_ARG_HEX: LoggingPort.print(arg.unsignedValue, HEX); break;
+        case IOLOG_ARG_FLOAT: LoggingPort.print(arg.floatValue); break;
+        case IOLOG_ARG_CHAR: LoggingPort.print((char)arg.signedValue); break;
+        case IOLOG_ARG_STRING: LoggingPort.print(&rec.text[arg.length]); break;
+        case IOLOG_ARG_FLASH: LoggingPort.print(arg.flashValue); break;
+        default: break;
+    }
+}
+
+uint8_t serlogDeferredDrain(uint8_t maxRecords) {
+    uint8_t printed = 0;
+    while(printed < maxRecords && logTail != logHead) {
+        // a record that is claimed but not yet filled in stops the drain until the next time.
+        IoLogRecord& rec = logRing[logTail & LOG_RING_MASK];
+        if(!rec.ready) break;
+        __sync_synchronize();
+        if(rec.args[0].type == IOLOG_ARG_BYTES) {
+            printHexDumpRecord(rec);
+        } else {
+            LoggingPort.print(rec.timestamp);
+            LoggingPort.print('-');
+            LoggingPort.print(prettyLevel(SerLoggingLevel(rec.level)));
+            LoggingPort.print(':');
+            if(rec.title != nullptr) LoggingPort.print(rec.title);
+            for(uint8_t i = 0; i < 3 && rec.args[i].type != IOLOG_ARG_NONE; i++) {
+                if(i != 0) LoggingPort.print(rec.separator);
+                printLogArg(rec, rec.args[i]);
+            }
+            LoggingPort.println();
+        }
+        rec.ready = false;
+        __sync_synchronize();
+        logTail = logTail + 1;
+        printed++;
+    }
+
+    unsigned long dropped = logDropped;
+    if(dropped != logDroppedReported) {
+        LoggingPort.print(F("Log records dropped "));
+        LoggingPort.println(dropped - logDroppedReported);
+        logDroppedReported = dropped;
+    }
+    return printed;
+}
+
+unsigned long serlogDeferredDropped() {
+    return logDropped;
+}
+
+class DeferredLogDrain : public Executable {
+private:
+    uint8_t maxPerRun = 4;
+public:
+    void setMaxPerRun(uint8_t maxRecords) { maxPerRun = maxRecords; }
+    void exec() override { serlogDeferredDrain(maxPerRun); }
+};
+
+static DeferredLogDrain deferredLogDrain;
+
+void startDeferredLogging(uint32_t intervalMillis, uint8_t maxPerRun) {
+    deferredLogDrain.setMaxPerRun(maxPerRun);
+    taskManager.scheduleFixedRate(intervalMillis, &deferredLogDrain, TIME_MILLIS);
+}
+
+#endif // IO_LOGGING_DEFERRED
+
 #endif
@@ -15,12 +15,35 @@
 // or uncommenting the line below.
 //#define IO_LOGGING_DEBUG
 
+// define this as well to defer the formatting of serlogF* calls, they are recorded into a ring buffer and printed later
+// by a task manager task, see startDeferredLogging.
+//#define IO_LOGGING_DEFERRED
+
+// The number of records the deferred logging ring can hold, it must be a power of two.
+#ifndef IO_LOGGING_DEFERRED_SIZE
+#define IO_LOGGING_DEFERRED_SIZE 16
+#endif
+
+// The space in each deferred record for copies of its string arguments, including their terminators, longer strings
+// are cut short.
+#ifndef IO_LOGGING_DEFERRED_TEXT
+#define IO_LOGGING_DEFERRED_TEXT 16
+#endif
+
 // These are the default levels that will be enabled when logging starts, you can add them at
 // runtime using serEnableLevel(level, true/false)
 #ifndef IO_LOGGING_DEFAULT_LEVEL
 #define IO_LOGGING_DEFAULT_LEVEL (SER_WARNING|SER_ERROR|SER_IOA_INFO|SER_TCMENU_INFO|SER_NETWORK_INFO|SER_DEBUG|SER_USER_1)
 #endif
 
+// These are the levels that are compiled in at all, a serlog call for any other level is removed completely by the
+// compiler, including its arguments and the string constant, so it costs nothing in flash or time. Levels that are
+// compiled in are then checked against the runtime levels above. For example, to only keep warnings and errors in
+// a production build, define IO_LOGGING_COMPILED_LEVELS=(SER_WARNING|SER_ERROR)
+#ifndef IO_LOGGING_COMPILED_LEVELS
+#define IO_LOGGING_COMPILED_LEVELS SER_LOG_EVERYTHING
+#endif
+
 // END user adjustable section.
 
 /**
@@ -136,12 +159,18 @@ unsigned long millis(); // available from task manager
 const char* prettyLevel(SerLoggingLevel level);
 #define logTimeAndLevel(title, lvl) LoggingPort.print(millis());LoggingPort.print('-');LoggingPort.print(prettyLevel(lvl));LoggingPort.print(':');LoggingPort.print(title)
 
+/**
+ * Check if a level is compiled in, when the level is a constant this is worked out by the compiler, so that any
+ * logging for a level that is not compiled in is removed, see IO_LOGGING_COMPILED_LEVELS.
+ */
+#define serLevelCompiled(lvl) (((IO_LOGGING_COMPILED_LEVELS) & (lvl)) != 0)
+
 /**
  * Check if a level is enabled
  * @param level the level to check
  * @return true if enabled, otherwise false
  */
-inline bool serLevelEnabled(SerLoggingLevel level) { return (enabledLevels & level) != 0; }
+inline bool serLevelEnabled(SerLoggingLevel level) { return serLevelCompiled(level) && (enabledLevels & level) != 0; }
 
 /**
  * Turn on or off logging for a particular level
@@ -156,16 +185,129 @@ inline void serEnableLevel(SerLoggingLevel level, bool active) {
     }
 }
 
-#define serlogF(lvl, x) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x), lvl); LoggingPort.println(); }
-#define serlogF2(lvl, x1, x2) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2);LoggingPort.println(); }
-#define serlogF3(lvl, x1, x2, x3) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3);LoggingPort.println(); }
-#define serlogF4(lvl, x1, x2, x3, x4) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3); LoggingPort.print(' '); LoggingPort.print(x4);LoggingPort.println(); }
-#define serlogFHex(lvl, x1, x2) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2, HEX);LoggingPort.println(); }
-#define serlogFHex2(lvl, x1, x2, x3) if(serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2, HEX); LoggingPort.print(','); LoggingPort.print(x3, HEX);LoggingPort.println(); }
-#define serlog(lvl, x) if(serLevelEnabled(lvl)) { logTimeAndLevel(x, lvl);LoggingPort.println(); }
-#define serlog2(lvl, x1, x2) if(serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2);LoggingPort.println(); }
-#define serlog3(lvl, x1, x2, x3) if(serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3);LoggingPort.println(); }
-#define serlogHex(lvl, x1, x2) if(serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2, HEX);LoggingPort.println(); }
+#ifdef IO_LOGGING_DEFERRED
+
+#ifdef IOA_USE_ARDUINO
+typedef const __FlashStringHelper* IoLogTitle;
+#else
+typedef const char* IoLogTitle;
+#endif
+// the cast is for cores that define F() without the flash string type
+#define IOLOG_TITLE(x) ((IoLogTitle)F(x))
+
+/** The types of argument that can be held in a deferred log record */
+enum IoLogArgType : uint8_t { IOLOG_ARG_NONE, IOLOG_ARG_SIGNED, IOLOG_ARG_UNSIGNED, IOLOG_ARG_HEX, IOLOG_ARG_FLOAT, IOLOG_ARG_STRING, IOLOG_ARG_BYTES, IOLOG_ARG_CHAR, IOLOG_ARG_FLASH };
+
+/** the number of raw bytes of a hex dump that one argument holds */
+#define IOLOG_BYTES_PER_ARG sizeof(unsigned long)
+
+/**
+ * One raw argument of a deferred log record. Strings are copied into the text of the record as it is made, so
+ * temporary buffers can be logged, up to IO_LOGGING_DEFERRED_TEXT characters across the arguments, and length is then
+ * where the copy starts. Flash strings are held by pointer, as they always exist.
+ */
+struct IoLogArg {
+    union {
+        long signedValue;
+        unsigned long unsignedValue;
+        float floatValue;
+        const char* stringValue;
+        IoLogTitle flashValue;
+        uint8_t bytes[IOLOG_BYTES_PER_ARG];
+    };
+    IoLogArgType type;
+    uint8_t length;
+};
+
+/**
+ * A deferred log record as held in the ring, the title is a flash pointer where the platform has one, and the text
+ * holds the copies of any string arguments.
+ */
+struct IoLogRecord {
+    unsigned long timestamp;
+    IoLogTitle title;
+    IoLogArg args[3];
+    uint16_t level;
+    char separator;
+    volatile bool ready;
+    char text[IO_LOGGING_DEFERRED_TEXT];
+};
+
+// conversions of each argument into its raw form, other pointers are held as their address in hex, and anything else
+// such as an enum is held as a signed value.
+inline IoLogArg ioLogSigned(long v) { IoLogArg a; a.signedValue = v; a.type = IOLOG_ARG_SIGNED; return a; }
+inline IoLogArg ioLogUnsigned(unsigned long v) { IoLogArg a; a.unsignedValue = v; a.type = IOLOG_ARG_UNSIGNED; return a; }
+inline IoLogArg ioLogArgHex(unsigned long v) { IoLogArg a; a.unsignedValue = v; a.type = IOLOG_ARG_HEX; return a; }
+inline IoLogArg ioLogArg(bool v) { return ioLogUnsigned(v); }
+inline IoLogArg ioLogArg(char v) { IoLogArg a; a.signedValue = v; a.type = IOLOG_ARG_CHAR; return a; }
+inline IoLogArg ioLogArg(signed char v) { return ioLogSigned(v); }
+inline IoLogArg ioLogArg(unsigned char v) { return ioLogUnsigned(v); }
+inline IoLogArg ioLogArg(short v) { return ioLogSigned(v); }
+inline IoLogArg ioLogArg(unsigned short v) { return ioLogUnsigned(v); }
+inline IoLogArg ioLogArg(int v) { return ioLogSigned(v); }
+inline IoLogArg ioLogArg(unsigned int v) { return ioLogUnsigned(v); }
+inline IoLogArg ioLogArg(long v) { return ioLogSigned(v); }
+inline IoLogArg ioLogArg(unsigned long v) { return ioLogUnsigned(v); }
+inline IoLogArg ioLogArg(float v) { IoLogArg a; a.floatValue = v; a.type = IOLOG_ARG_FLOAT; return a; }
+inline IoLogArg ioLogArg(double v) { return ioLogArg(float(v)); }
+inline IoLogArg ioLogArg(const char* v) { IoLogArg a; a.stringValue = v; a.type = IOLOG_ARG_STRING; return a; }
+inline IoLogArg ioLogArg(char* v) { return ioLogArg((const char*)v); }
+#ifdef IOA_USE_ARDUINO
+inline IoLogArg ioLogArg(IoLogTitle v) { IoLogArg a; a.flashValue = v; a.type = IOLOG_ARG_FLASH; return a; }
+#endif
+template<typename T> inline IoLogArg ioLogArg(T* v) { return ioLogArgHex((unsigned long)(uintptr_t)v); }
+template<typename T> inline IoLogArg ioLogArg(T v) { return ioLogSigned(long(v)); }
+
+/**
+ * Records a log entry into the deferred ring without formatting it, safe to call from interrupts. When the ring is
+ * full the record is dropped and counted rather than waiting.
+ */
+void ioLogDeferred(SerLoggingLevel level, IoLogTitle title, char separator = ' ', IoLogArg a1 = IoLogArg(),
+                   IoLogArg a2 = IoLogArg(), IoLogArg a3 = IoLogArg());
+
+/**
+ * Starts the task that formats and prints the deferred records, a few at a time so that it does not hold up other
+ * tasks for long.
+ * @param intervalMillis how often to drain the ring
+ * @param maxPerRun the most records to print each time
+ */
+void startDeferredLogging(uint32_t intervalMillis = 20, uint8_t maxPerRun = 4);
+
+/**
+ * Prints deferred records now, for example before going to sleep or on a fatal error.
+ * @param maxRecords the most records to print
+ * @return the number that were printed
+ */
+uint8_t serlogDeferredDrain(uint8_t maxRecords = 0xff);
+
+/** @return the number of records lost because the ring was full */
+unsigned long serlogDeferredDropped();
+
+#define serlogF(lvl, x) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x)); }
+#define serlogF2(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x1), ' ', ioLogArg(x2)); }
+#define serlogF3(lvl, x1, x2, x3) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x1), ' ', ioLogArg(x2), ioLogArg(x3)); }
+#define serlogF4(lvl, x1, x2, x3, x4) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x1), ' ', ioLogArg(x2), ioLogArg(x3), ioLogArg(x4)); }
+#define serlogFHex(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x1), ',', ioLogArgHex(x2)); }
+#define serlogFHex2(lvl, x1, x2, x3) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { ioLogDeferred(lvl, IOLOG_TITLE(x1), ',', ioLogArgHex(x2), ioLogArgHex(x3)); }
+
+#else
+
+#define startDeferredLogging(...)
+
+#define serlogF(lvl, x) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x), lvl); LoggingPort.println(); }
+#define serlogF2(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2);LoggingPort.println(); }
+#define serlogF3(lvl, x1, x2, x3) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3);LoggingPort.println(); }
+#define serlogF4(lvl, x1, x2, x3, x4) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3); LoggingPort.print(' '); LoggingPort.print(x4);LoggingPort.println(); }
+#define serlogFHex(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2, HEX);LoggingPort.println(); }
+#define serlogFHex2(lvl, x1, x2, x3) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(F(x1), lvl); LoggingPort.print(x2, HEX); LoggingPort.print(','); LoggingPort.print(x3, HEX);LoggingPort.println(); }
+
+#endif // IO_LOGGING_DEFERRED
+
+// the below are not deferred, as the title may not be a constant.
+#define serlog(lvl, x) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(x, lvl);LoggingPort.println(); }
+#define serlog2(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2);LoggingPort.println(); }
+#define serlog3(lvl, x1, x2, x3) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2); LoggingPort.print(' '); LoggingPort.print(x3);LoggingPort.println(); }
+#define serlogHex(lvl, x1, x2) if(serLevelCompiled(lvl) && serLevelEnabled(lvl)) { logTimeAndLevel(x1, lvl); LoggingPort.print(x2, HEX);LoggingPort.println(); }
 
 void serlogHexDump(SerLoggingLevel level, const char *title, const void* data, size_t strlen);
 inline void serdebugHexDump(const char *title, const void* data, size_t len) { serlogHexDump(SER_DEBUG, title, data, len);}
@@ -209,12 +351,14 @@ void startTaskManagerLogDelegate();
 #define serlogHex(lvl, x1, x2)
 
 #define startTaskManagerLogDelegate()
+#define startDeferredLogging(...)
 
 #define IOLOG_START_SERIAL
 #define IOLOG_MBED_PORT_IF_NEEDED(tx, rx)
 
 #define serEnableLevel(l, a)
 #define serLevelEnabled(l) false
+#define serLevelCompiled(l) false
 #endif // IO_LOGGING_DEBUG
 
 #endif // _IO_LOGGING_H_
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "IoaStaticAllocation.h"
+#include "IoLogging.h"
+
+#if IOA_STATIC_POOL_SIZE > 0
+
+namespace {
+    alignas(8) uint8_t ioaPool[IOA_STATIC_POOL_SIZE];
+    size_t ioaPoolPosition = 0;
+}
+
+void* ioaPoolAllocate(size_t size, size_t align) {
+    size_t start = (ioaPoolPosition + (align - 1)) & ~(align - 1);
+    if(start + size > IOA_STATIC_POOL_SIZE) {
+        serlogF3(SER_ERROR, "IoA pool full ", (unsigned int)size, (unsigned int)ioaPoolRemaining());
+        return nullptr;
+    }
+    ioaPoolPosition = start + size;
+    return &ioaPool[start];
+}
+
+bool ioaPoolOwns(const void* ptr) {
+    auto bytes = static_cast<const uint8_t*>(ptr);
+    return bytes >= ioaPool && bytes < (ioaPool + IOA_STATIC_POOL_SIZE);
+}
+
+size_t ioaPoolUsed() { return ioaPoolPosition; }
+
+size_t ioaPoolRemaining() { return IOA_STATIC_POOL_SIZE - ioaPoolPosition; }
+
+#else
+
+void* ioaPoolAllocate(size_t, size_t) { return nullptr; }
+
+bool ioaPoolOwns(const void*) { return false; }
+
+size_t ioaPoolUsed() { return 0; }
+
+size_t ioaPoolRemaining() { return 0; }
+
+#endif
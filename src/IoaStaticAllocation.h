@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_IOASTATICALLOCATION_H
+#define IOABSTRACTION_IOASTATICALLOCATION_H
+
+/**
+ * @file IoaStaticAllocation.h
+ * @brief Lets the helper factories such as ioFrom23017 or outputOnlyFromShiftRegister build their objects in a
+ * fixed static pool instead of on the heap, and gives a way to check the RAM taken by an I/O graph at compile time.
+ */
+
+#include "PlatformDetermination.h"
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __AVR__
+#include <new.h>
+#else
+#include <new>
+#endif
+
+// START user adjustable section
+
+/**
+ * The number of bytes in the static pool that the helper factories construct into. When 0, the default, there is no
+ * pool and the factories use new as they always have. Set it as a build flag rather than in the sketch, so that every
+ * file sees the same value. Once the pool is full, factories return nullptr and log an error rather than fall back
+ * to the heap, size it with IoaRamFootprint and check it using ioaPoolUsed during development.
+ */
+#ifndef IOA_STATIC_POOL_SIZE
+#define IOA_STATIC_POOL_SIZE 0
+#endif
+
+// END user adjustable section
+
+/**
+ * Takes the next size bytes from the static pool with the given alignment, it is never given back.
+ * @param size the number of bytes needed
+ * @param align the alignment needed, a power of two
+ * @return the memory, or nullptr when there is no pool or it does not have room
+ */
+void* ioaPoolAllocate(size_t size, size_t align);
+
+/** @return true if the pointer is within the static pool, IE it was made by ioaCreate with the pool turned on. */
+bool ioaPoolOwns(const void* ptr);
+
+/** @return the number of bytes of the static pool in use, including padding for alignment */
+size_t ioaPoolUsed();
+
+/** @return the number of bytes of the static pool that are still free */
+size_t ioaPoolRemaining();
+
+/**
+ * Constructs an object either in the static pool when IOA_STATIC_POOL_SIZE is set, or on the heap otherwise. All the
+ * helper factories in the library use this, so setting the pool size is all that is needed to take them off the heap.
+ * Objects made this way must be released with ioaDestroy and never with delete.
+ * @tparam T the type to construct
+ * @param args the arguments to pass to the constructor
+ * @return the new object, or nullptr if the pool is full
+ */
+template<class T, class... Args> T* ioaCreate(Args&&... args) {
+#if IOA_STATIC_POOL_SIZE > 0
+    void* mem = ioaPoolAllocate(sizeof(T), alignof(T));
+    return (mem != nullptr) ? new(mem) T(static_cast<Args&&>(args)...) : nullptr;
+#else
+    return new T(static_cast<Args&&>(args)...);
+#endif
+}
+
+/**
+ * Releases an object made by ioaCreate. Objects in the pool are destructed but their memory is not reused, objects on
+ * the heap are deleted.
+ * @param obj the object to release, may be nullptr
+ */
+template<class T> void ioaDestroy(T* obj) {
+    if(obj == nullptr) return;
+    if(ioaPoolOwns(obj)) {
+        obj->~T();
+    } else {
+        delete obj;
+    }
+}
+
+/**
+ * Room for exactly one object of type T, for when you want to place a particular object yourself, for example as a
+ * global, without either the heap or the shared pool. The object is constructed by calling create.
+ *
+ * ```
+ * IoaStaticStorage<MCP23017IoAbstraction> expanderStorage;
+ * auto expander = expanderStorage.create(0x20, ACTIVE_LOW_OPEN, 2, 3, &Wire);
+ * ```
+ *
+ * Note that most abstractions can also simply be declared as globals, this is for when the factory style is wanted.
+ * For a fully static multi io see StaticMultiIo in StaticIoAbstraction.h.
+ */
+template<class T> class IoaStaticStorage {
+private:
+    alignas(T) uint8_t storage[sizeof(T)];
+    bool constructed = false;
+public:
+    /**
+     * Constructs the object in place, only the first call constructs, later calls return the same object.
+     * @param args the arguments to pass to the constructor
+     * @return the object
+     */
+    template<class... Args> T* create(Args&&... args) {
+        if(!constructed) {
+            new(storage) T(static_cast<Args&&>(args)...);
+            constructed = true;
+        }
+        return get();
+    }
+
+    /** @return the object, only valid once create has been called */
+    T* get() { return reinterpret_cast<T*>(storage); }
+
+    bool isConstructed() const { return constructed; }
+};
+
+/**
+ * The total size of a list of types, so that the RAM needed by an I/O graph can be checked at compile time. For
+ * example, to make sure a pool is large enough for the objects the sketch creates with the factories:
+ *
+ * ```
+ * static_assert(IoaRamFootprint<MCP23017IoAbstraction, PCF8574IoAbstraction>::bytes <= IOA_STATIC_POOL_SIZE, "pool");
+ * ```
+ *
+ * The size does not include padding between objects in the pool, so leave a few bytes spare for each object.
+ */
+template<class... T> struct IoaRamFootprint;
+
+template<> struct IoaRamFootprint<> {
+    static constexpr size_t bytes = 0;
+};
+
+template<class T, class... Rest> struct IoaRamFootprint<T, Rest...> {
+    static constexpr size_t bytes = sizeof(T) + IoaRamFootprint<Rest...>::bytes;
+};
+
+/**
+ * Fails the build when the static pool plus the given statically declared types would take more than a budget of
+ * RAM, for example `IOA_ASSERT_RAM_BUDGET(1024, SwitchInput, MultiIoAbstraction);` at global scope.
+ */
+#define IOA_ASSERT_RAM_BUDGET(budget, ...) static_assert(IoaRamFootprint<__VA_ARGS__>::bytes + IOA_STATIC_POOL_SIZE <= (budget), \
+                                                        "IoAbstraction I/O graph is over its RAM budget")
+
+#endif //IOABSTRACTION_IOASTATICALLOCATION_H
@@ -34,6 +34,7 @@ private:
     float accelerationFactor = 1000.0F;
     float initialDelay = 750.0F;
     float delayAcceleration = 3.0F;
+    WakeDeadline wakeDeadline;
 public:
     /** 
      * Constructor that initialises the class for use, prefer to use the set up method setupAnalogJoystickEncoder
@@ -103,22 +104,23 @@ public:
 
         bool scrolling = intent == SCROLL_THROUGH_ITEMS || intent == SCROLL_THROUGH_SIDEWAYS;
 
+        int amt = (hasAccelerationProfile() && (readVal > tolerance || readVal < -tolerance)) ? acceleratedAmount(micros()) : 1;
         if(readVal > tolerance) {
-            int dir = (scrolling) ? -1 : 1;
+            int dir = (scrolling) ? -amt : amt;
             increment(dir);
         }
         else if(readVal < (-tolerance)) {
-            int dir = (scrolling) ? 1 : -1;
+            int dir = (scrolling) ? amt : -amt;
             increment(dir);
         }
         else {
             accelerationFactor = initialDelay;
-            taskManager.scheduleOnce(250, this);
+            taskManager.scheduleOnce(wakeDeadline.nextRunIn(millisToMicros(250)), this, TIME_MICROS);
             return;
         }
 
         auto delay = nextInterval(abs(readVal * MAX_JOYSTICK_ACCEL)) + accelerationFactor;
-        taskManager.scheduleOnce(delay, this);
+        taskManager.scheduleOnce(wakeDeadline.nextRunIn(uint32_t(delay * 1000.0F)), this, TIME_MICROS);
         if(accelerationFactor > 1.0F) {
             accelerationFactor /= delayAcceleration;
         }
@@ -212,13 +214,191 @@ public:
  * @param callback the callback that will receive changes in value
  */
 inline void setupAnalogJoystickEncoder(AnalogDevice* analogDevice, pinid_t analogPin, EncoderCallbackFn callback) {
-    auto joystickEncoder = new JoystickSwitchInput(analogDevice, analogPin, callback);
+    auto joystickEncoder = ioaCreate<JoystickSwitchInput>(analogDevice, analogPin, callback);
+    if(joystickEncoder == nullptr) {
+        serlogF(SER_ERROR, "No memory for joystick");
+        return;
+    }
     switches.setEncoder(joystickEncoder);
     taskManager.scheduleOnce(250, joystickEncoder);
 }
 
+#define JOYSTICK_XY_LEFT 0
+#define JOYSTICK_XY_RIGHT 1
+#define JOYSTICK_XY_UP 2
+#define JOYSTICK_XY_DOWN 3
+
+/**
+ * A two axis joystick sampled by one task, both axes are read together in a single batch read, and the deadzone and
+ * repeat acceleration are worked out in integer maths. It can be used in either or both of two ways:
+ *
+ * * As a four direction button expander, pins JOYSTICK_XY_LEFT, RIGHT, UP and DOWN read high while the stick is
+ *   pushed that way, so add them to switches like any other button. Switches can poll every pin of it cheaply, as
+ *   the state is only updated by the sampling task.
+ * * To drive a RotaryEncoder for each axis, see attachEncoders, each axis repeats faster the further it is pushed and
+ *   the longer it is held, in the same way as JoystickSwitchInput.
+ *
+ * Call start to schedule the sampling task.
+ */
+class TwoAxisJoystick : public BasicIoAbstraction, public Executable {
+private:
+    struct AxisState {
+        RotaryEncoder* encoder;
+        unsigned long nextRepeat;
+        unsigned int accelerationDelay;
+        bool inverted;
+    };
+    AnalogDevice* analogDevice;
+    pinid_t axisPins[2];
+    AxisState axes[2];
+    unsigned int midCounts;
+    unsigned int toleranceCounts;
+    AnalogFixed midPoint;
+    AnalogFixed tolerance;
+    uint16_t initialDelay;
+    uint8_t delayDivisor;
+    uint8_t bitDepth;
+    uint8_t directions;
+public:
+    /**
+     * Create a two axis joystick, the pins are initialised as analog inputs.
+     * @param device the analog device the joystick is on
+     * @param xPin the pin of the X axis, pushing right increases the reading
+     * @param yPin the pin of the Y axis, pushing up increases the reading
+     */
+    TwoAxisJoystick(AnalogDevice* device, pinid_t xPin, pinid_t yPin) : analogDevice(device), axisPins{xPin, yPin},
+            axes{}, midCounts(0), toleranceCounts(0), midPoint(analogFloatToFixed(0.5F)),
+            tolerance(analogFloatToFixed(0.03F)), initialDelay(750), delayDivisor(3), bitDepth(0), directions(0) {
+        for(auto& axis : axes) axis.accelerationDelay = initialDelay;
+        analogDevice->initPin(xPin, DIR_IN);
+        analogDevice->initPin(yPin, DIR_IN);
+    }
+
+    ~TwoAxisJoystick() override = default;
+
+    /**
+     * Sets the encoders that the axes drive, either can be nullptr for none.
+     * @param xEncoder the encoder for the X axis, moving right increments it
+     * @param yEncoder the encoder for the Y axis, moving up increments it
+     */
+    void attachEncoders(RotaryEncoder* xEncoder, RotaryEncoder* yEncoder) {
+        axes[0].encoder = xEncoder;
+        axes[1].encoder = yEncoder;
+    }
+
+    /**
+     * Reverse the direction of an axis, for joysticks mounted the other way around.
+     * @param axis 0 for X, 1 for Y
+     * @param inverted true to reverse it
+     */
+    void setAxisInverted(uint8_t axis, bool inverted) { axes[axis & 1U].inverted = inverted; }
+
+    /**
+     * Set the centre point and the deadzone around it, as fractions of full scale, converted to counts once.
+     * @param midPoint_ the reading at rest, normally 0.5
+     * @param tolerance_ the amount each side of the centre to ignore
+     */
+    void setTolerance(float midPoint_, float tolerance_) {
+        midPoint = analogFloatToFixed(midPoint_);
+        tolerance = analogFloatToFixed(tolerance_);
+        bitDepth = 0;
+    }
+
+    /**
+     * Set the repeat acceleration for the encoders, the first repeat waits initialDelayMillis on top of the interval
+     * for the amount pushed, and that extra wait is divided by the divisor on each repeat.
+     * @param initialDelayMillis the extra delay before the first repeat
+     * @param divisor the amount the extra delay is divided by on each repeat, at least 2
+     */
+    void setAccelerationParameters(uint16_t initialDelayMillis, uint8_t divisor) {
+        initialDelay = initialDelayMillis;
+        delayDivisor = divisor < 2 ? 2 : divisor;
+        for(auto& axis : axes) axis.accelerationDelay = initialDelay;
+    }
+
+    /**
+     * Schedules the sampling task.
+     * @param sampleMillis the interval between samples
+     */
+    void start(uint16_t sampleMillis = 20) {
+        taskManager.scheduleFixedRate(sampleMillis, this);
+    }
+
+    /**
+     * @param force how far the stick is pushed from 0 at the deadzone to 5 at the end
+     * @return the interval in millis for that deflection before the extra acceleration delay
+     */
+    static unsigned int nextInterval(unsigned int force) {
+        static const uint8_t intervals[] = { 250, 250, 200, 150, 100, 50 };
+        return intervals[force > 5 ? 5 : force];
+    }
+
+    /** @return the state of the four directions, with the bit for each JOYSTICK_XY direction set while pushed */
+    uint8_t getDirections() const { return directions; }
+
+    /**
+     * Samples both axes together, updates the four directions and drives the encoders, called by task manager.
+     */
+    void exec() override {
+        if(bitDepth == 0) {
+            bitDepth = analogDevice->getBitDepth(DIR_IN, axisPins[0]);
+            midCounts = analogFixedToCounts(midPoint, bitDepth);
+            toleranceCounts = analogFixedToCounts(tolerance, bitDepth);
+        }
+        unsigned int readings[2];
+        analogDevice->getCurrentValues(axisPins, readings, 2);
+
+        unsigned long now = millis();
+        uint8_t newDirections = 0;
+        for(uint8_t i = 0; i < 2; i++) {
+            int direction = 0;
+            unsigned int deflection = 0;
+            if(readings[i] > midCounts + toleranceCounts) {
+                direction = 1;
+                deflection = readings[i] - midCounts;
+            } else if(readings[i] + toleranceCounts < midCounts) {
+                direction = -1;
+                deflection = midCounts - readings[i];
+            }
+            if(axes[i].inverted) direction = -direction;
+            if(direction != 0) {
+                newDirections |= 1U << ((i == 0 ? JOYSTICK_XY_LEFT : JOYSTICK_XY_DOWN) ^ (direction > 0 ? 1 : 0));
+            }
+            driveAxis(axes[i], direction, deflection, now);
+        }
+        directions = newDirections;
+    }
+
+    uint8_t readValue(pinid_t pin) override { return (directions >> pin) & 1U; }
+    uint8_t readPort(pinid_t pin) override { return directions; }
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override {
+        return (startPin < 4) ? ((directions >> startPin) & mask) : 0;
+    }
+    bool runLoop() override { return true; }
+    void pinDirection(pinid_t pin, uint8_t mode) override { }
+    void writeValue(pinid_t pin, uint8_t value) override { }
+    void writePort(pinid_t pin, uint8_t portVal) override { }
+private:
+    void driveAxis(AxisState& axis, int direction, unsigned int deflection, unsigned long now) {
+        if(direction == 0) {
+            // back in the deadzone, the next push moves straight away with the full acceleration delay.
+            axis.accelerationDelay = initialDelay;
+            axis.nextRepeat = now;
+            return;
+        }
+        if(axis.encoder == nullptr || (long)(now - axis.nextRepeat) < 0) return;
+
+        int amount = axis.encoder->hasAccelerationProfile() ? axis.encoder->acceleratedAmount(micros()) : 1;
+        axis.encoder->increment(direction * amount);
+        // the force is the deflection as a fraction of full scale times ten, so 0 to 5 from centre to end.
+        unsigned int force = (unsigned int)((uint32_t(deflection) * 10U) >> bitDepth);
+        axis.nextRepeat = now + nextInterval(force) + axis.accelerationDelay;
+        if(axis.accelerationDelay > 1) axis.accelerationDelay /= delayDivisor;
+    }
+};
+
 inline IoAbstractionRef joystickTwoButtonExpander(AnalogDevice* analogDevice, pinid_t analogPin, float centrePoint) {
-    return new AnalogJoystickToButtons(analogDevice, analogPin, centrePoint);
+    return ioaCreate<AnalogJoystickToButtons>(analogDevice, analogPin, centrePoint);
 }
 
 #endif // _JOYSTICK_SWITCH_INPUT_H_
@@ -13,8 +13,11 @@ MatrixKeyboardManager* MatrixKeyboardManager::INSTANCE = nullptr;
 
 ISR_ATTR void rawKeyboardInterrupt() {
     auto kbMgr = MatrixKeyboardManager::INSTANCE;
-    if(kbMgr->keyMode == KEYMODE_NOT_PRESSED) {
+    if(kbMgr != nullptr && kbMgr->keyMode == KEYMODE_NOT_PRESSED) {
         // we only need to be notified when not pressed. As in other states we are polling
+#ifdef IOA_INPUT_INSTRUMENTATION
+        if(kbMgr->latencyInterruptMicros == 0) kbMgr->latencyInterruptMicros = micros();
+#endif
         kbMgr->markTriggeredAndNotify();
     }
 }
@@ -27,21 +30,66 @@ MatrixKeyboardManager::MatrixKeyboardManager() {
     keyMode = KEYMODE_NOT_PRESSED;
     interruptMode = false;
     counter = 0;
+    fastColumns = nullptr;
+    scanColumn = KEYBOARD_SCAN_IDLE;
+    scanPressed = 0;
+    columnSettleMicros = KEYBOARD_COLUMN_SETTLE_MICROS;
+    columnDrivenAt = 0;
+    scanStartedAt = 0;
+    lastScanMicros = 0;
+    rowStartPin = 0;
+    rowPinMask = 0;
+    multiKeyState = nullptr;
+    ghostedScans = 0;
+    multiKeyMode = false;
     INSTANCE = this;
 }
 
+MatrixKeyboardManager::~MatrixKeyboardManager() {
+    delete[] multiKeyState;
+    delete[] fastColumns;
+    if(INSTANCE == this) INSTANCE = nullptr;
+}
+
 void MatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* layout_, KeyboardListener* listener_, bool interruptMode_) {
     this->ioRef = ref;
     this->layout = layout_;
     this->listener = listener_;
     this->interruptMode = interruptMode_;
 
+    setPinModes(false, OUTPUT);
     for(int i=0; i<layout->numColumns(); i++) {
-        ioRef->pinMode(layout->getColPin(i), OUTPUT);
         ioRef->digitalWrite(layout->getColPin(i), LOW);
     }
+
+    delete[] fastColumns;
+    fastColumns = nullptr;
+    if(ioRef == internalDigitalIo()) {
+        fastColumns = new FastOutputPin[layout->numColumns()];
+        for(int i=0; i<layout->numColumns(); i++) {
+            fastColumns[i].begin(layout->getColPin(i));
+        }
+    }
+
+    setPinModes(true, INPUT_PULLUP);
+
+    // when the rows are within 32 pins of each other, each column's rows are read with a single call.
+    rowPinMask = 0;
+    rowStartPin = layout->getRowPin(0);
+    pinid_t rowHighestPin = rowStartPin;
+    for(int i=1; i<layout->numRows(); i++) {
+        pinid_t pin = layout->getRowPin(i);
+        if(pin < rowStartPin) rowStartPin = pin;
+        if(pin > rowHighestPin) rowHighestPin = pin;
+    }
+    if((rowHighestPin - rowStartPin) < 32) {
+        for(int i=0; i<layout->numRows(); i++) {
+            rowPinMask |= IoPinMask(1) << (layout->getRowPin(i) - rowStartPin);
+        }
+    }
+    if(multiKeyMode) allocateMultiKeyState();
+
     for(int i=0; i<layout->numRows(); i++) {
-        ioRef->pinMode(layout->getRowPin(i), INPUT_PULLUP);
         if(interruptMode && INSTANCE) {
             ioRef->attachInterrupt(layout->getRowPin(i), rawKeyboardInterrupt, CHANGE);
         }
@@ -49,15 +97,94 @@ void MatrixKeyboardManager::initialise(IoAbstractionRef ref, KeyboardLayout* lay
 
     ioRef->sync();
     currentKey = 0;
+    scanColumn = KEYBOARD_SCAN_IDLE;
     taskManager.registerEvent(this);
 }
 
+void MatrixKeyboardManager::setPinModes(bool rows, uint8_t mode) {
+    int count = rows ? layout->numRows() : layout->numColumns();
+    if(count == 0) return;
+
+    // find the range of pins, if they fit within 32 pins they are all configured in one go.
+    pinid_t lowest = rows ? layout->getRowPin(0) : layout->getColPin(0);
+    pinid_t highest = lowest;
+    for(int i=1; i<count; i++) {
+        pinid_t pin = rows ? layout->getRowPin(i) : layout->getColPin(i);
+        if(pin < lowest) lowest = pin;
+        if(pin > highest) highest = pin;
+    }
+
+    if((highest - lowest) < 32) {
+        IoPinMask mask = 0;
+        for(int i=0; i<count; i++) {
+            pinid_t pin = rows ? layout->getRowPin(i) : layout->getColPin(i);
+            mask |= IoPinMask(1) << (pin - lowest);
+        }
+        ioRef->pinDirectionMask(lowest, mask, mode);
+    }
+    else {
+        for(int i=0; i<count; i++) {
+            ioRef->pinMode(rows ? layout->getRowPin(i) : layout->getColPin(i), mode);
+        }
+    }
+}
+
 void MatrixKeyboardManager::setToOutput(int col) {
+    if(fastColumns != nullptr) {
+        for(int i=0; i<layout->numColumns(); i++) {
+            fastColumns[i].write(col != i);
+        }
+        return;
+    }
+
     for(int i=0; i<layout->numColumns(); i++) {
         ioRef->digitalWrite(layout->getColPin(i), col != i);
     }
 }
 
+void MatrixKeyboardManager::setMultiKeyMode(bool multiKey) {
+    multiKeyMode = multiKey;
+    delete[] multiKeyState;
+    multiKeyState = nullptr;
+    if(multiKey && layout != nullptr) allocateMultiKeyState();
+}
+
+void MatrixKeyboardManager::allocateMultiKeyState() {
+    delete[] multiKeyState;
+    int size = layout->numColumns() * 3;
+    multiKeyState = new IoPinMask[size];
+    if(multiKeyState == nullptr) {
+        serlogF(SER_ERROR, "No memory for multi key");
+        multiKeyMode = false;
+        return;
+    }
+    for(int i = 0; i < size; i++) multiKeyState[i] = 0;
+    currentKey = 0;
+    keyMode = KEYMODE_NOT_PRESSED;
+}
+
+bool MatrixKeyboardManager::isKeyPressed(uint8_t row, uint8_t col) const {
+    if(multiKeyState == nullptr || col >= layout->numColumns()) return false;
+    return bitRead(multiKeyState[layout->numColumns() + col], row);
+}
+
+IoPinMask MatrixKeyboardManager::readRows() {
+    // bit n of the result is set when row n is pulled low by the driven column.
+    IoPinMask rows = 0;
+    if(rowPinMask != 0) {
+        IoPinMask low = ~ioRef->readPinMask(rowStartPin, rowPinMask) & rowPinMask;
+        for(int r=0; r<layout->numRows(); r++) {
+            if(bitRead(low, layout->getRowPin(r) - rowStartPin)) rows |= IoPinMask(1) << r;
+        }
+    }
+    else {
+        for(int r=0; r<layout->numRows(); r++) {
+            if(!ioRef->digitalRead(layout->getRowPin(r))) rows |= IoPinMask(1) << r;
+        }
+    }
+    return rows;
+}
+
 void MatrixKeyboardManager::setRepeatKeyMillis(int startAfterMillis, int repeatMillis) {
     repeatStartTicks = startAfterMillis / KEYBOARD_TASK_MILLIS; 
     repeatTicks = repeatMillis / KEYBOARD_TASK_MILLIS; 
@@ -73,30 +200,120 @@ void MatrixKeyboardManager::exec() {
         return;
     }
 
-    char pressThisTime = 0;
-
+    if(scanColumn == KEYBOARD_SCAN_IDLE) {
+        // start a new scan by driving the first column, its rows are read on the next step once it has settled.
+        scanStartedAt = micros();
+#ifdef IOA_INPUT_INSTRUMENTATION
+        latencyPreviousScanMicros = latencyScanMicros;
+        latencyScanMicros = (latencyInterruptMicros != 0) ? latencyInterruptMicros : scanStartedAt;
+        latencyInterruptMicros = 0;
+#endif
+        scanPressed = 0;
+        driveColumn(0);
+        return;
+    }
 
-    // then we read back the right state
-    for(int c=0;c<layout->numColumns();c++) {
-        setToOutput(c);
-        ioRef->sync(); // first we set the right column low.
-        taskManager.yieldForMicros(500); // let things settle while other tasks run.
-        ioRef->sync(); // then we read the latest row states back
+    // when woken early, such as by an interrupt, wait for the next check, which is scheduled for when it has settled.
+    if((micros() - columnDrivenAt) < columnSettleMicros) return;
 
+    ioRef->sync(); // read the latest row states back
+    IoPinMask rows = readRows();
+    if(multiKeyState != nullptr) {
+        multiKeyState[scanColumn] = rows;
+    }
+    else if(rows != 0) {
         for(int r=0; r<layout->numRows(); r++) {
-            if(!ioRef->digitalRead(layout->getRowPin(r))) {
-                pressThisTime = layout->keyFor(r, c);
-                serlogF4(SER_IOA_DEBUG, "Pressed: ", r, c, (int)pressThisTime);
+            if(bitRead(rows, r)) {
+                scanPressed = layout->keyFor(r, scanColumn);
+                serlogF4(SER_IOA_DEBUG, "Pressed: ", r, scanColumn, (int)scanPressed);
+            }
+        }
+    }
+
+    if((scanColumn + 1) < layout->numColumns()) {
+        driveColumn(scanColumn + 1);
+        return;
+    }
+
+    scanColumn = KEYBOARD_SCAN_IDLE;
+    lastScanMicros = micros() - scanStartedAt;
+    IOA_LATENCY_RECORD(INPUT_LATENCY_MATRIX_SCAN, 0, scanStartedAt)
+    if(multiKeyState != nullptr) multiKeyScanComplete();
+    else scanComplete(scanPressed);
+}
+
+void MatrixKeyboardManager::multiKeyScanComplete() {
+    int cols = layout->numColumns();
+    IoPinMask* scanned = multiKeyState;
+    IoPinMask* debounced = multiKeyState + cols;
+    IoPinMask* changing = multiKeyState + (cols * 2);
+
+    // two columns sharing two or more pressed rows may include a ghost key, so nothing in this scan can be trusted.
+    for(int a = 0; a < cols; a++) {
+        for(int b = a + 1; b < cols; b++) {
+            IoPinMask common = scanned[a] & scanned[b];
+            if(common & (common - 1)) {
+                ghostedScans++;
+                serlogF(SER_IOA_DEBUG, "Keyboard ghosting");
+                enableAllOutputsForInterrupt();
+                return;
+            }
+        }
+    }
+
+    // a key that differs from its debounced state for two scans in a row changes state, all keys in parallel.
+    bool anyActive = false;
+    bool newPress = false;
+    for(int c = 0; c < cols; c++) {
+        IoPinMask delta = scanned[c] ^ debounced[c];
+        IoPinMask toggled = delta & changing[c];
+        changing[c] = delta & ~toggled;
+        debounced[c] ^= toggled;
+        anyActive |= (debounced[c] | changing[c]) != 0;
+
+        for(int r = 0; toggled != 0; r++, toggled >>= 1U) {
+            if((toggled & 1U) == 0) continue;
+            char key = layout->keyFor(r, c);
+            // the change was first seen in the scan before this one.
+            IOA_LATENCY_RECORD(INPUT_LATENCY_MATRIX_KEY, (uint8_t)key, latencyPreviousScanMicros)
+            if(bitRead(debounced[c], r)) {
+                currentKey = key;
+                counter = repeatStartTicks;
+                newPress = true;
+                listener->keyPressed(key, false);
+            }
+            else {
+                if(key == currentKey) currentKey = 0;
+                listener->keyReleased(key);
             }
         }
     }
 
+    // the most recently pressed key repeats while it is held.
+    if(!newPress && currentKey != 0 && counter-- == 0) {
+        counter = repeatTicks;
+        listener->keyPressed(currentKey, true);
+    }
+
+    keyMode = anyActive ? KEYMODE_PRESSED : KEYMODE_NOT_PRESSED;
+    enableAllOutputsForInterrupt();
+}
+
+void MatrixKeyboardManager::driveColumn(uint8_t col) {
+    scanColumn = col;
+    setToOutput(col);
+    ioRef->sync(); // set the column low, it then settles while other tasks run.
+    columnDrivenAt = micros();
+}
+
+void MatrixKeyboardManager::scanComplete(char pressThisTime) {
     // if the key is the same as last time and not zero
     if(pressThisTime == currentKey && pressThisTime) {
         // then we either have finished debouncing or are repeating
         if(isDebouncing(keyMode)) {
             keyMode = KEYMODE_PRESSED;
             counter = repeatStartTicks;
+            IOA_LATENCY_RECORD(INPUT_LATENCY_MATRIX_KEY, (uint8_t)currentKey, latencyEdgeMicros)
             listener->keyPressed(currentKey, false);
         }
         else if(keyMode == KEYMODE_PRESSED) {
@@ -111,6 +328,7 @@ void MatrixKeyboardManager::exec() {
         if(keyMode == KEYMODE_PRESSED) {
             keyMode = KEYMODE_NOT_PRESSED;
             counter = 0;
+            IOA_LATENCY_RECORD(INPUT_LATENCY_MATRIX_KEY, (uint8_t)currentKey, latencyScanMicros)
             listener->keyReleased(currentKey);
             currentKey = 0;
         }
@@ -121,13 +339,32 @@ void MatrixKeyboardManager::exec() {
 }
 
 uint32_t MatrixKeyboardManager::timeOfNextCheck() {
+    if(scanColumn != KEYBOARD_SCAN_IDLE) {
+        // part way through a scan, the next step runs once the driven column has settled, the step that reads the
+        // last column ends the scan, and the next scan is a poll later.
+        unsigned long settledFor = micros() - columnDrivenAt;
+        if(settledFor < columnSettleMicros) {
+            return wakeDeadline.nextRunIn(columnSettleMicros - settledFor, false);
+        }
+        setTriggered(true);
+        bool lastColumn = (scanColumn + 1) >= layout->numColumns();
+        return lastColumn ? wakeDeadline.nextRunIn(millisToMicros(KEYBOARD_TASK_MILLIS))
+                          : wakeDeadline.nextRunIn(columnSettleMicros, false);
+    }
 
     if(interruptMode && (keyMode == KEYMODE_NOT_PRESSED)) {
+        wakeDeadline.waitingForInterrupt();
         return secondsToMicros(1);
-    } else {
-        setTriggered(true);
-        return millisToMicros(KEYBOARD_TASK_MILLIS);
     }
+
+    // polling, or a key is held in interrupt mode, so a new scan starts once a poll interval has passed since the last.
+    unsigned long sinceScan = micros() - scanStartedAt;
+    uint32_t pollMicros = millisToMicros(KEYBOARD_TASK_MILLIS);
+    if(sinceScan < pollMicros) {
+        return wakeDeadline.nextRunIn(pollMicros - sinceScan);
+    }
+    setTriggered(true);
+    return wakeDeadline.nextRunIn(columnSettleMicros, false);
 }
 
 void MatrixKeyboardManager::enableAllOutputsForInterrupt() {
@@ -152,6 +389,9 @@ void MatrixKeyboardManager::doDebounce(char pressedNow) {
     if(pressedNow && keyMode == KEYMODE_NOT_PRESSED) {
         currentKey = pressedNow;
         keyMode = KEYMODE_DEBOUNCE;
+#ifdef IOA_INPUT_INSTRUMENTATION
+        latencyEdgeMicros = latencyScanMicros;
+#endif
     } else if(keyMode == KEYMODE_DEBOUNCE) {
         keyMode = KEYMODE_DEBOUNCE1;
     } else if(keyMode == KEYMODE_DEBOUNCE1) {
@@ -7,6 +7,8 @@
 #define _KEYBOARD_MANGER_H_
 
 #include "IoAbstraction.h"
+#include "InputLatencyStatistics.h"
+#include "InputWakeSchedule.h"
 
 /**
  * @file KeyboardManager.h
@@ -105,6 +107,14 @@ enum KeyMode: uint8_t {
 
 #define KEYBOARD_TASK_MILLIS 50
 
+/**
+ * The default time in microseconds that each column is given to settle after it is driven, before its rows are read.
+ */
+#define KEYBOARD_COLUMN_SETTLE_MICROS 500
+
+/** The value of the scan column when no scan is in progress */
+#define KEYBOARD_SCAN_IDLE 0xff
+
 /**
  * A keyboard manager that can determine if a key is pressed or released for a given layout of keyboard. It is configured
  * during initialisation with an IoAbstraction that is used to access hardware, a specific keyboard layout and a listener
@@ -114,6 +124,18 @@ enum KeyMode: uint8_t {
  * You can decide between polling operation and interrupt operation, if interrupt operation is chosen then all the row
  * pins must be on interrupt capable pins, which on many boards is best achieved by using an MCP23017 for all the pins.
  * Do not enable interrupt mode on a PCF8574 as the changing of the output pins will trigger the interrupt.
+ *
+ * Scanning never holds up task manager, each column is a separate step, the column is driven and the event returns
+ * to task manager while it settles, then on the next step its rows are read and the next column driven. The settle
+ * time can be changed with setColumnSettleMicros, and the time the last full scan took is given by getLastScanMicros,
+ * which helps tune the settle time for slower devices such as I2C expanders. When the row pins are within 32 pins of
+ * each other, they are all read with one readPinMask call for each column.
+ *
+ * By default a single key is tracked and when several are pressed the last one found wins. In multi key mode, see
+ * setMultiKeyMode, every key of the matrix is debounced in parallel using a bitmap of rows for each column, and a
+ * press and release is notified for each key. The most recently pressed key repeats while held. A matrix without
+ * diodes cannot tell three keys on the corners of a rectangle from all four, so any scan where two columns share two
+ * or more pressed rows is treated as ghosted and ignored, these scans are counted by getGhostedScans.
  */
 class MatrixKeyboardManager : public BaseEvent {
 private:
@@ -127,17 +149,80 @@ private:
     volatile KeyMode keyMode;
     uint8_t counter;
     bool interruptMode;
+    // the column being driven and settling, or KEYBOARD_SCAN_IDLE, and the key found so far in this scan.
+    uint8_t scanColumn;
+    char scanPressed;
+    uint16_t columnSettleMicros;
+    unsigned long columnDrivenAt;
+    unsigned long scanStartedAt;
+    unsigned long lastScanMicros;
+    // the row pins as a mask relative to rowStartPin, 0 when they cannot be read in one readPinMask call.
+    pinid_t rowStartPin;
+    IoPinMask rowPinMask;
+    // in multi key mode, for each column the rows read this scan, the debounced rows, then the rows changing.
+    IoPinMask* multiKeyState;
+    uint32_t ghostedScans;
+    bool multiKeyMode;
+    // when the columns are on the device pins they are written directly, otherwise this is nullptr.
+    FastOutputPin* fastColumns;
+    WakeDeadline wakeDeadline;
+#ifdef IOA_INPUT_INSTRUMENTATION
+    // the time of the current and previous scans, when the key being debounced was first seen, and of any interrupt
+    // since the last scan.
+    unsigned long latencyScanMicros = 0;
+    unsigned long latencyPreviousScanMicros = 0;
+    unsigned long latencyEdgeMicros = 0;
+    volatile unsigned long latencyInterruptMicros = 0;
+#endif
 public:
     MatrixKeyboardManager();
+    ~MatrixKeyboardManager() override;
     void initialise(IoAbstractionRef ref, KeyboardLayout* layout, KeyboardListener* listener, bool interruptMode = false);
     void setRepeatKeyMillis(int startAfterMillis, int repeatMillis);
 
+    /**
+     * Sets the time each column is given to settle after it is driven low before its rows are read, the default is
+     * KEYBOARD_COLUMN_SETTLE_MICROS. Devices on slow buses and long cables may need more.
+     * @param settleMicros the settle time in microseconds
+     */
+    void setColumnSettleMicros(uint16_t settleMicros) { columnSettleMicros = settleMicros; }
+
+    /** @return the time in microseconds that the last complete scan of all columns took */
+    unsigned long getLastScanMicros() const { return lastScanMicros; }
+
+    /** @return true while a scan is part way through its columns */
+    bool isScanning() const { return scanColumn != KEYBOARD_SCAN_IDLE; }
+
+    /**
+     * Turns on or off multi key mode, where every key is debounced and notified separately, a layout of up to 32 rows
+     * is supported. This allocates three masks per column, and can be called before or after initialise.
+     * @param multiKey true for multi key (n-key rollover) mode, false to track a single key
+     */
+    void setMultiKeyMode(bool multiKey);
+
+    /**
+     * Only available in multi key mode, gives the debounced state of a single key of the matrix.
+     * @param row the row of the key
+     * @param col the column of the key
+     * @return true if the key is pressed
+     */
+    bool isKeyPressed(uint8_t row, uint8_t col) const;
+
+    /** @return the number of scans in multi key mode that were ignored as the pressed keys make a ghosting pattern */
+    uint32_t getGhostedScans() const { return ghostedScans; }
+
     uint32_t timeOfNextCheck() override;
     void exec() override;
 
     friend void rawKeyboardInterrupt();
 private:
     void setToOutput(int i);
+    void driveColumn(uint8_t col);
+    void scanComplete(char pressThisTime);
+    void multiKeyScanComplete();
+    void allocateMultiKeyState();
+    IoPinMask readRows();
+    void setPinModes(bool rows, uint8_t mode);
     void enableAllOutputsForInterrupt();
 
     void doDebounce(char time);
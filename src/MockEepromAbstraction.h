@@ -89,6 +89,23 @@ public:
 		memcpy(&data[romDest], memSrc, len);
 	}
 
+	void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override {
+		// blocks can be larger than the rom, so do not copy at all when out of bounds.
+		if(size_t(romSrc) + len > memSize) {
+			errorFlag = true;
+			return;
+		}
+		memcpy(memDest, &data[romSrc], len);
+	}
+
+	void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) override {
+		if(size_t(romDest) + len > memSize) {
+			errorFlag = true;
+			return;
+		}
+		memcpy(&data[romDest], memSrc, len);
+	}
+
 	void serPrintContents(int start, int len) {
         if(len >= 63) {
             serlogF(SER_DEBUG, "Mock rom debug - len too big");
@@ -108,4 +125,172 @@ public:
     }
 };
 
+/**
+ * The costs that CostModelEepromAbstraction charges, in simulated microseconds. The defaults are roughly those of an
+ * AT24C256 on a 400KHz I2C bus.
+ */
+struct EepromCostModel {
+    /** the cost of starting each transaction, such as sending the device and memory address */
+    uint32_t transactionMicros = 75;
+    /** the cost of each byte transferred */
+    uint32_t byteMicros = 23;
+    /** the cost of the internal write cycle after each page write, 0 for devices such as FRAM */
+    uint32_t writeCycleMicros = 5000;
+    /** the page size, a write that crosses pages is charged as a transaction per page, 0 for no pages */
+    uint16_t pageSize = 64;
+};
+
+/**
+ * The statistics gathered by CostModelEepromAbstraction since creation or the last reset.
+ */
+struct EepromCostStatistics {
+    uint32_t transactions;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    uint32_t pageWrites;
+    uint32_t simulatedMicros;
+};
+
+/**
+ * An in memory eeprom for storage benchmarks and tests, that works as MockEepromAbstraction but also charges each call
+ * against a cost model, counting the transactions, bytes and page writes, the simulated time they would take on a real
+ * device, and how many times each byte has been written. Tests can then assert that a change does not add bus traffic
+ * or wear. Each call to the eeprom is one transaction, except that writes are split at page boundaries as a real
+ * device would need.
+ */
+class CostModelEepromAbstraction : public MockEepromAbstraction {
+private:
+    EepromCostModel model;
+    EepromCostStatistics stats;
+    uint16_t* cellWrites;
+    unsigned int size;
+    uint8_t depth;
+public:
+    explicit CostModelEepromAbstraction(unsigned int size = 128, const EepromCostModel& costModel = EepromCostModel())
+            : MockEepromAbstraction(size), model(costModel), stats{}, size(size), depth(0) {
+        cellWrites = new uint16_t[size];
+        memset(cellWrites, 0, size * sizeof(uint16_t));
+    }
+    ~CostModelEepromAbstraction() override {
+        delete[] cellWrites;
+    }
+
+    const EepromCostStatistics& getStatistics() const { return stats; }
+    void setCostModel(const EepromCostModel& costModel) { model = costModel; }
+
+    /** Clears the statistics, the write count of each byte is kept unless clearWear is true */
+    void resetStatistics(bool clearWear = false) {
+        stats = EepromCostStatistics{};
+        if(clearWear) memset(cellWrites, 0, size * sizeof(uint16_t));
+    }
+
+    /** @return the number of times that the byte at a position has been written */
+    uint16_t getCellWrites(EepromPosition position) const { return position < size ? cellWrites[position] : 0; }
+
+    /** @return the largest number of times any one byte has been written */
+    uint16_t getMaxCellWear() const {
+        uint16_t most = 0;
+        for(unsigned int i = 0; i < size; i++) {
+            if(cellWrites[i] > most) most = cellWrites[i];
+        }
+        return most;
+    }
+
+    uint8_t read8(EepromPosition position) override {
+        chargeRead(1);
+        depth++;
+        auto ret = MockEepromAbstraction::read8(position);
+        depth--;
+        return ret;
+    }
+
+    void write8(EepromPosition position, uint8_t val) override {
+        chargeWrite(position, 1);
+        depth++;
+        MockEepromAbstraction::write8(position, val);
+        depth--;
+    }
+
+    uint16_t read16(EepromPosition position) override {
+        chargeRead(2);
+        depth++;
+        auto ret = MockEepromAbstraction::read16(position);
+        depth--;
+        return ret;
+    }
+
+    void write16(EepromPosition position, uint16_t val) override {
+        chargeWrite(position, 2);
+        depth++;
+        MockEepromAbstraction::write16(position, val);
+        depth--;
+    }
+
+    uint32_t read32(EepromPosition position) override {
+        chargeRead(4);
+        depth++;
+        auto ret = MockEepromAbstraction::read32(position);
+        depth--;
+        return ret;
+    }
+
+    void write32(EepromPosition position, uint32_t val) override {
+        chargeWrite(position, 4);
+        depth++;
+        MockEepromAbstraction::write32(position, val);
+        depth--;
+    }
+
+    void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override {
+        readBlock(memDest, romSrc, len);
+    }
+
+    void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override {
+        writeBlock(romDest, memSrc, len);
+    }
+
+    void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override {
+        chargeRead(len);
+        depth++;
+        MockEepromAbstraction::readBlock(memDest, romSrc, len);
+        depth--;
+    }
+
+    void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) override {
+        chargeWrite(romDest, len);
+        depth++;
+        MockEepromAbstraction::writeBlock(romDest, memSrc, len);
+        depth--;
+    }
+private:
+    // calls made by the mock to itself while carrying out a call are not charged again.
+    void chargeRead(size_t len) {
+        if(depth != 0) return;
+        stats.transactions++;
+        stats.bytesRead += len;
+        stats.simulatedMicros += model.transactionMicros + (model.byteMicros * len);
+    }
+
+    void chargeWrite(EepromPosition position, size_t len) {
+        if(depth != 0) return;
+        for(size_t i = 0; i < len; i++) {
+            if(size_t(position) + i < size) cellWrites[position + i]++;
+        }
+        stats.bytesWritten += len;
+        stats.simulatedMicros += model.byteMicros * len;
+        while(len > 0) {
+            size_t inPage = len;
+            if(model.pageSize != 0) {
+                size_t toPageEnd = model.pageSize - (position % model.pageSize);
+                if(inPage > toPageEnd) inPage = toPageEnd;
+            }
+            stats.transactions++;
+            stats.pageWrites++;
+            stats.simulatedMicros += model.transactionMicros + model.writeCycleMicros;
+            position += inPage;
+            len -= inPage;
+        }
+    }
+};
+
 #endif
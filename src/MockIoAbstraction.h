@@ -191,6 +191,104 @@ private:
     }
 };
 
+/**
+ * The bus that CostModelIoAbstraction simulates. The defaults are a 16 pin expander such as the MCP23017 register
+ * pair or two PCF8575 bytes, on a 100KHz bus.
+ */
+struct MockBusCostModel {
+    /** the bus clock in Hz, each byte takes 9 clocks with its acknowledge */
+    uint32_t clockHz = 100000;
+    /** the bytes read or written for the port data in each sync */
+    uint8_t portBytes = 2;
+    /** the register address bytes sent before the data, 0 for devices without registers such as the PCF8574 */
+    uint8_t registerBytes = 0;
+};
+
+/**
+ * The traffic simulated by CostModelIoAbstraction since creation or the last reset.
+ */
+struct MockBusStatistics {
+    uint32_t syncs;
+    uint32_t transactions;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    uint32_t simulatedMicros;
+};
+
+/**
+ * A mock expander for benchmarks and tests, that works as MockedIoAbstraction but also charges each sync with the bus
+ * traffic a real I2C expander would need, counting transactions and bytes and accumulating the simulated bus time at
+ * the configured clock. As with the real expanders, a sync writes the outputs only when they have changed since the
+ * last sync, and reads the inputs only once an input pin has been set up. Tests can then assert the I/O cost of each
+ * sync, for example that polling a number of switches is one read per poll rather than one per key.
+ */
+class CostModelIoAbstraction : public MockedIoAbstraction {
+private:
+    MockBusCostModel model;
+    MockBusStatistics stats;
+    bool writePending = false;
+    bool inputsUsed = false;
+public:
+    explicit CostModelIoAbstraction(int numberOfCycles = 6, const MockBusCostModel& costModel = MockBusCostModel())
+            : MockedIoAbstraction(numberOfCycles), model(costModel), stats{} {}
+
+    void pinDirection(pinid_t pin, uint8_t mode) override {
+        MockedIoAbstraction::pinDirection(pin, mode);
+        if(mode == INPUT || mode == INPUT_PULLUP) inputsUsed = true;
+        writePending = true;
+    }
+
+    void writeValue(pinid_t pin, uint8_t value) override {
+        MockedIoAbstraction::writeValue(pin, value);
+        writePending = true;
+    }
+
+    void writePort(pinid_t pin, uint8_t portVal) override {
+        MockedIoAbstraction::writePort(pin, portVal);
+        writePending = true;
+    }
+
+    bool runLoop() override {
+        stats.syncs++;
+        if(writePending) {
+            charge(model.registerBytes + model.portBytes);
+            stats.bytesWritten += model.registerBytes + model.portBytes;
+            writePending = false;
+        }
+        if(inputsUsed) {
+            // the register address is a write of its own, followed by the read after a repeated start.
+            if(model.registerBytes != 0) {
+                charge(model.registerBytes);
+                stats.bytesWritten += model.registerBytes;
+            }
+            charge(model.portBytes);
+            stats.bytesRead += model.portBytes;
+        }
+        return MockedIoAbstraction::runLoop();
+    }
+
+    /**
+     * @param bytes the data bytes in a transaction
+     * @return the simulated time it takes, the address byte and data bytes at 9 clocks each plus start and stop
+     */
+    uint32_t transactionMicros(uint8_t bytes) const {
+        return uint32_t(((9UL * (1UL + bytes)) + 2UL) * 1000000UL / model.clockHz);
+    }
+
+    const MockBusStatistics& getStatistics() const { return stats; }
+
+    /** Clears the statistics, for example after set up so that only the code being measured is counted */
+    void resetStatistics() { stats = MockBusStatistics{}; }
+
+    /** @param costModel the new bus to simulate */
+    void setCostModel(const MockBusCostModel& costModel) { model = costModel; }
+private:
+    void charge(uint8_t bytes) {
+        stats.transactions++;
+        stats.simulatedMicros += transactionMicros(bytes);
+    }
+};
+
 /**
  * This wraps any other IOAbstraction by delegation and logs every sync to the serial port.
  * 
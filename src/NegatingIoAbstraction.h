@@ -13,26 +13,81 @@
  */
 
 /**
- * This implementation of IoAbstraction negates all the pin operations on the given abstraction, both for read and write.
+ * This implementation of IoAbstraction negates the pin operations on the given abstraction, both for read and write.
  * Useful when there is a need to invert the meaning such as when dealing with both PULL UP and PULL DOWN switches at the
  * same time on different IO devices.
+ *
+ * By default every pin is inverted. Alternatively give it a mask of the pins to invert, covering 32 pins from a start
+ * pin, then only those pins are inverted, so active low and active high inputs can share one device. Either way, the
+ * inversion is applied with a single XOR to each port and mask operation, which go straight through to the delegate,
+ * and SwitchInput can fold the mask into its own inversion with SwitchInput::foldInversionOf. Ports are taken to be
+ * 8 pins that start on a multiple of 8, as they are on the expanders.
  */
 class NegatingIoAbstraction : public BasicIoAbstraction {
 private:
     IoAbstractionRef delegate;
+    IoPinMask inversionMask;
+    pinid_t maskStart;
+    bool invertAll;
 public:
-    NegatingIoAbstraction(IoAbstractionRef toInvert) { delegate = toInvert; }
-   	
+    /**
+     * Create an abstraction that inverts every pin of the delegate.
+     * @param toInvert the abstraction to invert
+     */
+    NegatingIoAbstraction(IoAbstractionRef toInvert) : delegate(toInvert), inversionMask(0), maskStart(0), invertAll(true) { }
+
+    /**
+     * Create an abstraction that inverts only the pins given in a mask.
+     * @param delegate the abstraction to invert
+     * @param invertedPins the pins to invert, bit 0 is startPin, pins outside of the mask are not inverted
+     * @param startPin the pin of bit 0 of the mask
+     */
+    NegatingIoAbstraction(IoAbstractionRef delegate, IoPinMask invertedPins, pinid_t startPin = 0)
+            : delegate(delegate), inversionMask(invertedPins), maskStart(startPin), invertAll(false) { }
+
+    /**
+     * Changes the pins that are inverted to only those in the mask.
+     * @param invertedPins the pins to invert, bit 0 is startPin
+     * @param startPin the pin of bit 0 of the mask
+     */
+    void setInversionMask(IoPinMask invertedPins, pinid_t startPin = 0) {
+        inversionMask = invertedPins;
+        maskStart = startPin;
+        invertAll = false;
+    }
+
+    /**
+     * Gets the inversion of up to 32 pins as a mask, suitable for XOR with a readPinMask of the delegate.
+     * @param startPin the pin of bit 0 of the result
+     * @return a bit set for each inverted pin
+     */
+    IoPinMask getInversion(pinid_t startPin) const {
+        if(invertAll) return ~IoPinMask(0);
+        if(startPin >= maskStart) {
+            pinid_t offset = startPin - maskStart;
+            return (offset < 32) ? (inversionMask >> offset) : 0;
+        }
+        pinid_t offset = maskStart - startPin;
+        return (offset < 32) ? (inversionMask << offset) : 0;
+    }
+
+    /** @return true if the pin is inverted */
+    bool isPinInverted(pinid_t pin) const { return (getInversion(pin) & 1U) != 0; }
+
+    /** @return the abstraction that is being inverted */
+    IoAbstractionRef getDelegate() const { return delegate; }
+
     void pinDirection(pinid_t pin, uint8_t mode) override {
         delegate->pinDirection(pin, mode); 
     }
 	
     void writeValue(pinid_t pin, uint8_t value) override {
-        delegate->writeValue(pin, !value); 
+        delegate->writeValue(pin, isPinInverted(pin) ? !value : value);
     }
 	
     uint8_t readValue(pinid_t pin) override {
-        return !delegate->readValue(pin);
+        uint8_t value = delegate->readValue(pin);
+        return isPinInverted(pin) ? !value : value;
     }
 	
     void attachInterrupt(pinid_t pin, RawIntHandler interruptHandler, uint8_t mode) override {
@@ -44,11 +99,23 @@ public:
     }
 
     void writePort(pinid_t pin, uint8_t portVal) override {
-        delegate->writePort(pin, ~portVal);
+        delegate->writePort(pin, portVal ^ uint8_t(getInversion(pin & ~pinid_t(7))));
     }
 
     uint8_t readPort(pinid_t pin) override {
-        return ~(delegate->readPort(pin));
+        return delegate->readPort(pin) ^ uint8_t(getInversion(pin & ~pinid_t(7)));
+    }
+
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override {
+        return (delegate->readPinMask(startPin, mask) ^ getInversion(startPin)) & mask;
+    }
+
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override {
+        delegate->writePinMask(startPin, mask, values ^ getInversion(startPin));
+    }
+
+    void pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) override {
+        delegate->pinDirectionMask(startPin, mask, mode);
     }
 };
 
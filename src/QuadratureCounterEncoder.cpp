@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "QuadratureCounterEncoder.h"
+#include "IoLogging.h"
+
+QuadratureCounterEncoder::QuadratureCounterEncoder(QuadratureCounter* counter, pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback,
+                                                   HWAccelerationMode accelerationMode, EncoderType encoderType)
+        : AbstractHwRotaryEncoder(callback), counter(counter), lastCount(0), residual(0), lastPoll(0),
+          pollTask(TASKMGR_INVALIDID), counterOk(false) {
+    this->pinA = pinA;
+    this->pinB = pinB;
+    this->accelerationMode = accelerationMode;
+    this->encoderType = encoderType;
+    this->lastChange = micros();
+}
+
+QuadratureCounterEncoder::QuadratureCounterEncoder(QuadratureCounter* counter, pinid_t pinA, pinid_t pinB, EncoderListener* listener,
+                                                   HWAccelerationMode accelerationMode, EncoderType encoderType)
+        : AbstractHwRotaryEncoder(listener), counter(counter), lastCount(0), residual(0), lastPoll(0),
+          pollTask(TASKMGR_INVALIDID), counterOk(false) {
+    this->pinA = pinA;
+    this->pinB = pinB;
+    this->accelerationMode = accelerationMode;
+    this->encoderType = encoderType;
+    this->lastChange = micros();
+}
+
+QuadratureCounterEncoder::~QuadratureCounterEncoder() {
+    if(pollTask != TASKMGR_INVALIDID) taskManager.cancelTask(pollTask);
+}
+
+bool QuadratureCounterEncoder::start(uint32_t pollMicros) {
+    counterOk = counter->begin(pinA, pinB);
+    if(!counterOk) {
+        serlogF3(SER_ERROR, "Quadrature counter failed ", pinA, pinB);
+        return false;
+    }
+    lastCount = counter->readCount();
+    lastPoll = lastChange = micros();
+    if(pollTask == TASKMGR_INVALIDID) {
+        pollTask = taskManager.scheduleFixedRate(pollMicros, this, TIME_MICROS);
+    }
+    return true;
+}
+
+int QuadratureCounterEncoder::countsPerDetent() const {
+    switch(encoderType) {
+        case QUARTER_CYCLE: return 1;
+        case HALF_CYCLE: return 2;
+        default: return 4;
+    }
+}
+
+void QuadratureCounterEncoder::pollCounter() {
+    if(!counterOk) return;
+    int32_t count = counter->readCount();
+    residual += count - lastCount;
+    lastCount = count;
+
+    unsigned long now = micros();
+    int perDetent = countsPerDetent();
+    int32_t detents = residual / perDetent;
+    if(detents == 0) {
+        lastPoll = now;
+        return;
+    }
+    residual -= detents * perDetent;
+
+    // the detents could have happened at any time since the last poll, so they are spread evenly over it for the
+    // acceleration, which then sees about the same rate as if each had been an interrupt.
+    bool increase = detents > 0;
+    auto steps = (unsigned long)(increase ? detents : -detents);
+    unsigned long span = now - lastPoll;
+    int32_t amount = 0;
+    for(unsigned long i = 1; i <= steps; i++) {
+        unsigned long when = lastPoll + ((span * i) / steps);
+        amount += hasAccelerationProfile() ? acceleratedAmount(when) : amountFromChange(when - lastChange);
+        lastChange = when;
+    }
+    markLatencyEdge(lastPoll, pinA);
+    lastPoll = now;
+
+    bitWrite(flags, LAST_ENCODER_DIRECTION_UP, increase);
+    increment(increase ? int(amount) : -int(amount));
+}
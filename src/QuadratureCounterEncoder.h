@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_QUADRATURECOUNTERENCODER_H
+#define IOABSTRACTION_QUADRATURECOUNTERENCODER_H
+
+/**
+ * @file QuadratureCounterEncoder.h
+ * @brief A rotary encoder that is decoded by a hardware quadrature counter, such as a PIO state machine on RP2040,
+ * the PCNT unit on ESP32 or a timer in encoder mode on STM32, and only read on each poll.
+ */
+
+#include "PlatformDetermination.h"
+#include "SwitchInput.h"
+
+// START user adjustable section
+
+/**
+ * The default interval in millis between reads of the counter.
+ */
+#ifndef QUADRATURE_ENCODER_POLL_MILLIS
+#define QUADRATURE_ENCODER_POLL_MILLIS 10
+#endif
+
+// END user adjustable section
+
+/**
+ * A hardware counter that decodes the two quadrature signals of an encoder, counting every edge of both signals, so
+ * that a full cycle of the signals counts four. Implementations are provided for each platform that has one, see
+ * PicoPioQuadratureCounter, ESP32PcntQuadratureCounter and HalStm32QuadratureCounter.
+ */
+class QuadratureCounter {
+public:
+    virtual ~QuadratureCounter() = default;
+
+    /**
+     * Sets up the counter hardware for the two pins, which are native GPIO pins and not on any IoAbstraction.
+     * @param pinA the A signal
+     * @param pinB the B signal
+     * @return true if the hardware was available and set up
+     */
+    virtual bool begin(pinid_t pinA, pinid_t pinB) = 0;
+
+    /**
+     * @return the count since begin, it may wrap around, so only the difference between two reads is meaningful
+     */
+    virtual int32_t readCount() = 0;
+};
+
+/**
+ * A rotary encoder where the decoding is done entirely by a QuadratureCounter, so no steps are lost to interrupt
+ * latency or contact bounce, and there is no interrupt load however fast it is turned. On each poll the change in the
+ * count since the last poll is turned into detents using the encoder type, and the detents are passed through the
+ * usual acceleration, spread evenly over the time since the last poll, and added to the encoder in one step.
+ *
+ * Call start to claim the counter and schedule the polling task, then register it with switches as usual using
+ * setEncoder. It does not use switches for its pins, so it works whatever mode switches is in. As the counter
+ * already filters out bounce, the direction change rejection of the interrupt encoders is not applied.
+ */
+class QuadratureCounterEncoder : public AbstractHwRotaryEncoder, public Executable {
+private:
+    QuadratureCounter* counter;
+    int32_t lastCount;
+    int32_t residual;
+    unsigned long lastPoll;
+    taskid_t pollTask;
+    bool counterOk;
+public:
+    /**
+     * Create an encoder that reads a hardware counter, call start before use.
+     * @param counter the counter for the platform, which must outlive the encoder
+     * @param pinA the A signal pin
+     * @param pinB the B signal pin
+     * @param callback the callback to be notified of changes
+     * @param accelerationMode the acceleration to apply
+     * @param encoderType how the detents relate to the signals, full cycle encoders are four counts per detent
+     */
+    QuadratureCounterEncoder(QuadratureCounter* counter, pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback,
+                             HWAccelerationMode accelerationMode = HWACCEL_REGULAR, EncoderType encoderType = FULL_CYCLE);
+
+    /**
+     * Create an encoder that reads a hardware counter with a listener, call start before use.
+     * @see QuadratureCounterEncoder
+     */
+    QuadratureCounterEncoder(QuadratureCounter* counter, pinid_t pinA, pinid_t pinB, EncoderListener* listener,
+                             HWAccelerationMode accelerationMode = HWACCEL_REGULAR, EncoderType encoderType = FULL_CYCLE);
+
+    ~QuadratureCounterEncoder() override;
+
+    /**
+     * Sets up the counter and schedules the task that reads it.
+     * @param pollMicros the interval between reads of the counter
+     * @return true if the counter was set up
+     */
+    bool start(uint32_t pollMicros = millisToMicros(QUADRATURE_ENCODER_POLL_MILLIS));
+
+    /** Reads the counter and applies any change, called by the poll task and by switches when it polls encoders. */
+    void encoderChanged() override { pollCounter(); }
+
+    void exec() override { pollCounter(); }
+
+    /** The pins are native pins read by the counter and not switches pins, so never match an interrupt. */
+    bool isEncoderPin(pinid_t) override { return false; }
+
+    /** @return false if the counter could not be set up */
+    bool isCounterOk() const { return counterOk; }
+
+    /** @return the number of counts per detent for the encoder type */
+    int countsPerDetent() const;
+
+    /**
+     * Reads the change in the counter since the last call, and moves the encoder by the detents that it makes up,
+     * keeping any part of a detent for next time.
+     */
+    void pollCounter();
+};
+
+#endif //IOABSTRACTION_QUADRATURECOUNTERENCODER_H
@@ -3,6 +3,29 @@
 
 namespace iotouch {
 
+    TouchScreenManager* TouchScreenManager::INTERRUPT_INSTANCE = nullptr;
+
+    ISR_ATTR void rawTouchInterrupt() {
+        auto manager = TouchScreenManager::INTERRUPT_INSTANCE;
+        if(manager != nullptr) manager->touchInterruptRaised();
+    }
+
+    void TouchWakeEvent::exec() {
+        // start sampling straight away, the manager then schedules itself until the touch is released.
+        manager->exec();
+    }
+
+    void TouchScreenManager::enableInterruptWake(bool enabled) {
+        interruptWake = enabled;
+        if(enabled) {
+            INTERRUPT_INSTANCE = this;
+            if(!wakeRegistered) {
+                wakeRegistered = true;
+                taskManager.registerEvent(&wakeEvent);
+            }
+        }
+    }
+
     bool AccelerationHandler::tick() {
         if (mode == WAITING) {
             mode = ACCELERATING;
@@ -38,6 +61,73 @@ namespace iotouch {
         return isInverted ? 1.0F - y : y;
     }
 
+    bool CalibrationHandler::storeAffine(const float coefficients[6]) {
+        // the coefficients that multiply must be below 4 for the products to fit in 32 bits with 12 bit inputs.
+        int32_t converted[6];
+        for(int i = 0; i < 6; i++) {
+            bool multiplier = (i % 3) != 2;
+            float limit = multiplier ? 3.99F : 32767.0F;
+            if(coefficients[i] > limit || coefficients[i] < -limit) {
+                serlogF2(SER_WARNING, "Touch affine out of range ", i);
+                return false;
+            }
+            float scaled = coefficients[i] * float(1UL << TOUCH_AFFINE_SHIFT);
+            converted[i] = int32_t(scaled < 0 ? scaled - 0.5F : scaled + 0.5F);
+        }
+        memcpy(affine, converted, sizeof affine);
+        affineOn = true;
+        return true;
+    }
+
+    bool CalibrationHandler::buildAffineFromMinMax(const TouchOrientationSettings& orientation) {
+        float xMin = calibrationOn ? minX : 0.0F;
+        float xMax = calibrationOn ? maxX : 1.0F;
+        float yMin = calibrationOn ? minY : 0.0F;
+        float yMax = calibrationOn ? maxY : 1.0F;
+        if(xMax == xMin || yMax == yMin) return false;
+
+        // each axis is scale * raw + offset, inverting makes it 1 - that.
+        float scaleX = 1.0F / (xMax - xMin);
+        float offsetX = -xMin * scaleX;
+        if(orientation.isXInverted()) {
+            scaleX = -scaleX;
+            offsetX = 1.0F - offsetX;
+        }
+        float scaleY = 1.0F / (yMax - yMin);
+        float offsetY = -yMin * scaleY;
+        if(orientation.isYInverted()) {
+            scaleY = -scaleY;
+            offsetY = 1.0F - offsetY;
+        }
+
+        if(orientation.isOrientationSwapped()) {
+            float coefficients[6] = { 0.0F, scaleY, offsetY, scaleX, 0.0F, offsetX };
+            return storeAffine(coefficients);
+        }
+        float coefficients[6] = { scaleX, 0.0F, offsetX, 0.0F, scaleY, offsetY };
+        return storeAffine(coefficients);
+    }
+
+    bool CalibrationHandler::calibrateThreePoint(const float rawX[3], const float rawY[3], const float displayX[3], const float displayY[3]) {
+        // solve the two sets of three equations out = a * rawX + b * rawY + c by Cramer's rule, once at setup.
+        float det = rawX[0] * (rawY[1] - rawY[2]) - rawX[1] * (rawY[0] - rawY[2]) + rawX[2] * (rawY[0] - rawY[1]);
+        if(portableFloatAbs(det) < 0.0001F) {
+            serlogF(SER_WARNING, "Touch calibration points in a line");
+            return false;
+        }
+
+        float coefficients[6];
+        const float* targets[2] = { displayX, displayY };
+        for(int axis = 0; axis < 2; axis++) {
+            const float* t = targets[axis];
+            coefficients[(axis * 3) + 0] = (t[0] * (rawY[1] - rawY[2]) - t[1] * (rawY[0] - rawY[2]) + t[2] * (rawY[0] - rawY[1])) / det;
+            coefficients[(axis * 3) + 1] = (rawX[0] * (t[1] - t[2]) - rawX[1] * (t[0] - t[2]) + rawX[2] * (t[0] - t[1])) / det;
+            coefficients[(axis * 3) + 2] = (rawX[0] * (rawY[1] * t[2] - rawY[2] * t[1]) - rawX[1] * (rawY[0] * t[2] - rawY[2] * t[0]) +
+                                            rawX[2] * (rawY[0] * t[1] - rawY[1] * t[0])) / det;
+        }
+        return storeAffine(coefficients);
+    }
+
     void CalibrationHandler::setXPosition(float x, bool isMax) {
         if(isMax) {
             maxX = x;
@@ -70,36 +160,188 @@ namespace iotouch {
                 touchMode = (oldTouchMode == TOUCHED || oldTouchMode == HELD) ? HELD : TOUCHED;
                 break;
             case TOUCH_DEBOUNCE:
-                taskManager.scheduleOnce(5, this, TIME_MILLIS);
+                taskManager.scheduleOnce(wakeDeadline.nextRunIn(millisToMicros(5), false), this, TIME_MICROS);
                 return;
         }
 
         // we are in a repeated not touch situation, we can slow down the polling slightly now. No update needed
         // even at 1/10th of a second, we'll still wake up pretty quick when they select something.
         if (oldTouchMode == NOT_TOUCHED && touchMode == NOT_TOUCHED) {
-            taskManager.scheduleOnce(100, this, TIME_MILLIS);
             accelerationHandler.reset();
+            if (interruptWake && touchInterrogator->startIdleWait(rawTouchInterrupt)) {
+                // nothing is scheduled now until the interrupt, unless a touch came before it was ready.
+                waitingForTouch = true;
+                wakeDeadline.waitingForInterrupt();
+                if (touchInterrogator->isIdleTouchPresent()) {
+                    waitingForTouch = false;
+                    taskManager.scheduleOnce(wakeDeadline.nextRunIn(0, false), this, TIME_MICROS);
+                }
+                return;
+            }
+            taskManager.scheduleOnce(wakeDeadline.nextRunIn(millisToMicros(100)), this, TIME_MICROS);
             return;
         }
 
-        // only the held  state is subject to acceleration control
-        if (touchMode != HELD || usedForScrolling || accelerationHandler.tick()) {
-            if (orientation.isOrientationSwapped()) {
-                sendEvent(y, x, touch, touchMode);
+        // the affine calibration already includes the swap.
+        if (orientation.isOrientationSwapped() && !calibrator.isAffine()) {
+            float swapped = x;
+            x = y;
+            y = swapped;
+        }
+
+        if (gesturesEnabled) {
+            // held events are only sent on movement, paced by the touch velocity when scrolling, so acceleration is not needed.
+            bool sendIt = gestureHandler.process(x, y, touchMode, millis(), usedForScrolling);
+            if (gestureHandler.getGesture() != GESTURE_NONE) {
+                sendGesture(gestureHandler.getGesture(), x, y, gestureHandler.getVelocityX(), gestureHandler.getVelocityY());
+            }
+            if (sendIt) sendEvent(x, y, touch, touchMode);
+        } else if (touchMode != HELD || usedForScrolling || accelerationHandler.tick()) {
+            // only the held  state is subject to acceleration control
+            sendEvent(x, y, touch, touchMode);
+        }
+        taskManager.scheduleOnce(wakeDeadline.nextRunIn(millisToMicros(20)), this, TIME_MICROS);
+    }
+
+    float TouchGestureHandler::reportingThreshold(bool scrolling) const {
+        float speed = portableFloatAbs(velocityX) > portableFloatAbs(velocityY) ? portableFloatAbs(velocityX) : portableFloatAbs(velocityY);
+        if (!scrolling || speed <= swipeVelocity) return moveThreshold;
+        float scaled = moveThreshold * (swipeVelocity / speed);
+        return scaled > (moveThreshold / 4.0F) ? scaled : (moveThreshold / 4.0F);
+    }
+
+    bool TouchGestureHandler::process(float& x, float& y, TouchState mode, unsigned long now, bool scrolling) {
+        gesture = GESTURE_NONE;
+        if (mode == TOUCHED) {
+            anchorX = lastX = currentX = x;
+            anchorY = lastY = currentY = y;
+            downMillis = currentMillis = now;
+            velocityX = velocityY = 0.0F;
+            moving = false;
+            longPressSent = false;
+            return true;
+        }
+
+        if (mode == HELD) {
+            // a moving average of the velocity between readings, halving the noise of each one.
+            unsigned long elapsed = now - currentMillis;
+            if (elapsed != 0) {
+                float seconds = float(elapsed) / 1000.0F;
+                velocityX += (((x - currentX) / seconds) - velocityX) / 2.0F;
+                velocityY += (((y - currentY) / seconds) - velocityY) / 2.0F;
+            }
+            currentX = x;
+            currentY = y;
+            currentMillis = now;
+
+            if (moving) {
+                if (distance(x, y, lastX, lastY) <= reportingThreshold(scrolling)) return false;
+            } else if (distance(x, y, anchorX, anchorY) > startThreshold) {
+                moving = true;
             } else {
-                sendEvent(x, y, touch, touchMode);
+                if (!longPressSent && (now - downMillis) >= longPressMillis) {
+                    longPressSent = true;
+                    gesture = GESTURE_LONG_PRESS;
+                }
+                return false;
             }
+            lastX = x;
+            lastY = y;
+            return true;
+        }
+
+        // released, the reading is no longer valid, so report where the touch was last.
+        x = currentX;
+        y = currentY;
+        if (longPressSent) return true;
+        unsigned long duration = currentMillis - downMillis;
+        float travel = distance(currentX, currentY, anchorX, anchorY);
+        if (moving && travel >= swipeDistance && duration != 0) {
+            float seconds = float(duration) / 1000.0F;
+            velocityX = (currentX - anchorX) / seconds;
+            velocityY = (currentY - anchorY) / seconds;
+            if ((travel / seconds) >= swipeVelocity) gesture = GESTURE_SWIPE;
+        } else if (!moving && (now - downMillis) <= tapMillis) {
+            gesture = GESTURE_TAP;
         }
-        taskManager.scheduleOnce(20, this, TIME_MILLIS);
+        return true;
     }
 
     TouchOrientationSettings TouchScreenManager::changeOrientation(const TouchOrientationSettings &newOrientation) {
         auto old = orientation;
         orientation = newOrientation;
+        if (affineMinMax) calibrator.buildAffineFromMinMax(orientation);
         serlogF4(SER_TCMENU_INFO, "Touch orientation (SW,XI,YI) ", orientation.isOrientationSwapped(), orientation.isXInverted(), orientation.isYInverted());
         return old;
     }
 
+    bool ResistiveTouchInterrogator::startIdleWait(RawIntHandler onTouch) {
+        auto *device = internalDigitalIo();
+        device->pinMode(xnPinAdc, INPUT);
+        device->pinMode(ypPinAdc, INPUT);
+        device->pinMode(ynPin, OUTPUT);
+        device->digitalWriteS(ynPin, LOW);
+        device->pinMode(xpPin, INPUT_PULLUP);
+        if (!interruptAttached) {
+            // while sampling the pin changes are ignored, as the manager is only waiting when idle.
+            interruptAttached = true;
+            device->attachInterrupt(xpPin, onTouch, FALLING);
+        }
+        return true;
+    }
+
+    bool ResistiveTouchInterrogator::isIdleTouchPresent() {
+        return internalDigitalIo()->digitalReadS(xpPin) == LOW;
+    }
+
+    void ResistiveTouchInterrogator::setSampling(uint8_t samples, TouchSampleFilter filter, float tolerance) {
+        samplesPerAxis = samples < 2 ? 2 : (samples > TOUCH_MAX_SAMPLES ? TOUCH_MAX_SAMPLES : samples);
+        sampleFilter = filter;
+        spreadTolerance = tolerance;
+        maxRange = 0; // work out the tolerance in counts again on the next pass.
+    }
+
+    bool ResistiveTouchInterrogator::sampleAxis(pinid_t pin, unsigned int& reading) {
+        auto *analogDevice = internalAnalogIo();
+        if(maxRange == 0) {
+            maxRange = analogDevice->getMaximumRange(DIR_IN, pin);
+            bitDepth = uint8_t(analogDevice->getBitDepth(DIR_IN, pin));
+            spreadToleranceCounts = (unsigned int)(spreadTolerance * float(maxRange));
+        }
+
+        // the burst is taken in one batch, so the samples are converted back to back.
+        pinid_t pins[TOUCH_MAX_SAMPLES];
+        unsigned int samples[TOUCH_MAX_SAMPLES];
+        for(uint8_t i = 0; i < samplesPerAxis; i++) pins[i] = pin;
+        analogDevice->getCurrentValues(pins, samples, samplesPerAxis);
+
+        // insertion sort, the burst is at most a handful of samples.
+        for(uint8_t i = 1; i < samplesPerAxis; i++) {
+            unsigned int value = samples[i];
+            uint8_t pos = i;
+            while(pos > 0 && samples[pos - 1] > value) {
+                samples[pos] = samples[pos - 1];
+                pos--;
+            }
+            samples[pos] = value;
+        }
+
+        // both filters drop the highest and lowest quarter of the sorted burst, and check that what is kept agrees.
+        uint8_t trim = samplesPerAxis / 4;
+        uint8_t first = trim;
+        uint8_t last = samplesPerAxis - 1 - trim;
+        if((samples[last] - samples[first]) > spreadToleranceCounts) return false;
+
+        if(sampleFilter == TOUCH_FILTER_MEDIAN) {
+            reading = samples[samplesPerAxis / 2];
+        } else {
+            uint32_t total = 0;
+            for(uint8_t i = first; i <= last; i++) total += samples[i];
+            reading = (unsigned int)(total / (last - first + 1));
+        }
+        return true;
+    }
+
     TouchState ResistiveTouchInterrogator::internalProcessTouch(float *ptrX, float *ptrY, const TouchOrientationSettings& orientation,
                                                                 const CalibrationHandler &calibrator) {
         auto *analogDevice = internalAnalogIo();
@@ -112,14 +354,12 @@ namespace iotouch {
         device->digitalWrite(xpPin, HIGH);
         device->digitalWriteS(xnPinAdc, LOW);
 
-        taskManager.yieldForMicros(20);
-        float firstSample = analogDevice->getCurrentFloat(ypPinAdc);
-        float secondSample = analogDevice->getCurrentFloat(ypPinAdc);
-
-        if (portableFloatAbs(firstSample - secondSample) > 0.007) {
+        taskManager.yieldForMicros(settleMicros);
+        unsigned int reading;
+        if (!sampleAxis(ypPinAdc, reading)) {
             return TOUCH_DEBOUNCE;
         }
-        float x = calibrator.calibrateX((firstSample + secondSample) / 2.0F, orientation.isXInverted());
+        unsigned int readingX = reading;
 
         // now we calculate everything in the Y dimension.
         analogDevice->initPin(xnPinAdc, DIR_IN);
@@ -129,14 +369,21 @@ namespace iotouch {
         device->digitalWrite(ypPinAdc, HIGH);
         device->digitalWriteS(ynPin, LOW);
 
-        taskManager.yieldForMicros(20);
-        firstSample = analogDevice->getCurrentFloat(xnPinAdc);
-        secondSample = analogDevice->getCurrentFloat(xnPinAdc);
-
-        if (portableFloatAbs(firstSample - secondSample) > 0.007) {
+        taskManager.yieldForMicros(settleMicros);
+        if (!sampleAxis(xnPinAdc, reading)) {
             return TOUCH_DEBOUNCE;
         }
-        float y = calibrator.calibrateY((firstSample + secondSample) / 2.0F, orientation.isYInverted());
+        float x, y;
+        if (calibrator.isAffine()) {
+            // calibration, inversion and orientation in one pass of integer maths.
+            AnalogFixed fixedX, fixedY;
+            calibrator.transform(analogCountsToFixed(readingX, bitDepth), analogCountsToFixed(reading, bitDepth), fixedX, fixedY);
+            x = analogFixedToFloat(fixedX);
+            y = analogFixedToFloat(fixedY);
+        } else {
+            x = calibrator.calibrateX(float(readingX) / float(maxRange), orientation.isXInverted());
+            y = calibrator.calibrateY(float(reading) / float(maxRange), orientation.isYInverted());
+        }
 
         // and finally the Z dimension
         device->pinMode(xpPin, OUTPUT);
@@ -144,13 +391,14 @@ namespace iotouch {
         device->digitalWrite(xpPin, LOW);
         device->digitalWriteS(ynPin, HIGH);
 
-        taskManager.yieldForMicros(20);
+        taskManager.yieldForMicros(settleMicros);
 
-        firstSample = analogDevice->getCurrentFloat(xnPinAdc);
-        secondSample = analogDevice->getCurrentFloat(ypPinAdc);
+        float samples[2];
+        pinid_t samplePins[2] = { xnPinAdc, ypPinAdc };
+        analogDevice->getCurrentFloats(samplePins, samples, 2);
 
         //float touch = ((z2 / z1) * -1.0) * x * resistanceX;
-        float touch = 1.0F - (secondSample - firstSample);
+        float touch = 1.0F - (samples[1] - samples[0]);
         *ptrX = x;
         *ptrY = y;
         return (touch > TOUCH_THRESHOLD) ? TOUCHED : NOT_TOUCHED;
@@ -4,7 +4,9 @@
 
 #include "PlatformDetermination.h"
 #include "AnalogDeviceAbstraction.h"
+#include "BasicIoAbstraction.h"
 #include <TaskManagerIO.h>
+#include "InputWakeSchedule.h"
 
 /**
  * @file ResistiveTouchScreen.h A
@@ -15,6 +17,13 @@
 #define TOUCH_THRESHOLD 0.05F
 #endif
 
+/**
+ * The largest number of samples that ResistiveTouchInterrogator can take per axis on each pass.
+ */
+#ifndef TOUCH_MAX_SAMPLES
+#define TOUCH_MAX_SAMPLES 9
+#endif
+
 #define TOUCH_ORIENTATION_BIT_SWAP  0
 #define TOUCH_ORIENTATION_BIT_INV_X 1
 #define TOUCH_ORIENTATION_BIT_INV_Y 2
@@ -79,15 +88,27 @@ namespace iotouch {
         bool tick();
     };
 
+/** the number of fractional bits in the coefficients of the affine calibration */
+#define TOUCH_AFFINE_SHIFT 16
+/** the number of bits the inputs to the affine calibration are reduced to, so the multiply-adds fit in 32 bits */
+#define TOUCH_AFFINE_INPUT_BITS 12
+
     /**
      * Provides calibration for IoAbstraction based touch facilities, it does so by recording the minimum and maximum
-     * values in the X and Y dimension and then correction values to fall within those ranges
+     * values in the X and Y dimension and then correction values to fall within those ranges.
+     *
+     * Optionally, a precomputed affine transform can be used instead, in which the calibration, the inversion of each
+     * axis and the swapping of the axes are all folded into one 2x3 matrix held in fixed point. Each point is then
+     * transformed with integer multiply-adds, with no float maths. Build it from the minimum and maximum values with
+     * buildAffineFromMinMax, or from three touched points with calibrateThreePoint, which also corrects skewed panels.
      */
     class CalibrationHandler {
     private:
         float minX, maxX;
         float minY, maxY;
+        int32_t affine[6];
         bool calibrationOn;
+        bool affineOn = false;
 
     public:
         CalibrationHandler() = default;
@@ -110,6 +131,51 @@ namespace iotouch {
         float getMaxY() const { return maxY;}
         void setXPosition(float x, bool isMax);
         void setYPosition(float y, bool isMax);
+
+        /**
+         * Builds the affine transform from the minimum and maximum values, or the full range if calibration is off,
+         * folding in the inversion of each axis and the swap of the axes, then turns it on.
+         * @param orientation the orientation to fold in
+         * @return true if built, false if the coefficients would be too large to hold
+         */
+        bool buildAffineFromMinMax(const TouchOrientationSettings& orientation);
+
+        /**
+         * Builds the affine transform from three points, the raw reading of each and where it is on the display, both
+         * as fractions between 0 and 1, then turns it on. Choose three points well apart and not in a line, such as
+         * near three corners. As the display positions are given, orientation and inversion are already included.
+         * @param rawX the raw X reading of each point
+         * @param rawY the raw Y reading of each point
+         * @param displayX the X position on the display of each point
+         * @param displayY the Y position on the display of each point
+         * @return true if built, false if the points are in a line or the coefficients would be too large
+         */
+        bool calibrateThreePoint(const float rawX[3], const float rawY[3], const float displayX[3], const float displayY[3]);
+
+        /** Turns off the affine transform, going back to the minimum and maximum calibration */
+        void disableAffine() { affineOn = false; }
+
+        /** @return true if the affine transform is used, in which case orientation is already included */
+        bool isAffine() const { return affineOn; }
+
+        /**
+         * Applies the affine transform to a raw point, in AnalogFixed fractions of full scale.
+         * @param rawX the raw X reading
+         * @param rawY the raw Y reading
+         * @param outX the calibrated X position, clamped to the display
+         * @param outY the calibrated Y position, clamped to the display
+         */
+        void transform(AnalogFixed rawX, AnalogFixed rawY, AnalogFixed& outX, AnalogFixed& outY) const {
+            int32_t x = rawX >> (ANALOG_FIXED_BITS - TOUCH_AFFINE_INPUT_BITS);
+            int32_t y = rawY >> (ANALOG_FIXED_BITS - TOUCH_AFFINE_INPUT_BITS);
+            outX = clampFixed(((affine[0] * x + affine[1] * y) >> TOUCH_AFFINE_INPUT_BITS) + affine[2]);
+            outY = clampFixed(((affine[3] * x + affine[4] * y) >> TOUCH_AFFINE_INPUT_BITS) + affine[5]);
+        }
+    private:
+        static AnalogFixed clampFixed(int32_t value) {
+            return value < 0 ? 0 : (value > int32_t(ANALOG_FIXED_MAX) ? ANALOG_FIXED_MAX : AnalogFixed(value));
+        }
+        bool storeAffine(const float coefficients[6]);
     };
 
     /** records the current state of the touch panel, IE not touched, touched, held or debouncing. */
@@ -126,6 +192,104 @@ namespace iotouch {
 
 #define portableFloatAbs(x) ((x)<0.0F?-(x):(x))
 
+    /** the gestures that can be recognised by the TouchGestureHandler */
+    enum TouchGesture : uint8_t {
+        /** no gesture was recognised */
+        GESTURE_NONE,
+        /** a short touch and release without moving */
+        GESTURE_TAP,
+        /** a touch held still for the long press time, sent while still held */
+        GESTURE_LONG_PRESS,
+        /** a quick movement in one direction before release, sent with its velocity */
+        GESTURE_SWIPE
+    };
+
+    /**
+     * The stage between reading the touch panel and sending the event, used by TouchScreenManager when gestures are
+     * enabled. While the panel is held, events are only reported when the point moves beyond a threshold, with
+     * hysteresis: a larger movement from where the touch started is needed to start moving, after that a smaller
+     * movement from the last reported point. Held events that do not move are coalesced away. It also tracks the
+     * velocity, and on release recognises taps and swipes, and while held still, a long press. Positions are fractions
+     * of the display between 0 and 1, after calibration and orientation, velocity is in display fractions per second.
+     */
+    class TouchGestureHandler {
+    private:
+        float startThreshold = 0.02F;
+        float moveThreshold = 0.008F;
+        float swipeDistance = 0.15F;
+        float swipeVelocity = 0.5F;
+        float anchorX = 0.0F, anchorY = 0.0F;
+        float lastX = 0.0F, lastY = 0.0F;
+        float currentX = 0.0F, currentY = 0.0F;
+        float velocityX = 0.0F, velocityY = 0.0F;
+        unsigned long downMillis = 0;
+        unsigned long currentMillis = 0;
+        uint16_t tapMillis = 250;
+        uint16_t longPressMillis = 800;
+        TouchGesture gesture = GESTURE_NONE;
+        bool moving = false;
+        bool longPressSent = false;
+    public:
+        /**
+         * @param toStart the movement from the start of a touch that must be exceeded before it is moving
+         * @param whileMoving once moving, the movement from the last reported point that must be exceeded to report again
+         */
+        void setMovementThreshold(float toStart, float whileMoving) {
+            startThreshold = toStart;
+            moveThreshold = whileMoving;
+        }
+
+        /**
+         * @param tapMaximum the longest touch in milliseconds that is a tap
+         * @param longPress the time held still in milliseconds before a long press
+         */
+        void setGestureTimes(uint16_t tapMaximum, uint16_t longPress) {
+            tapMillis = tapMaximum;
+            longPressMillis = longPress;
+        }
+
+        /**
+         * @param minimumDistance the distance in display fractions a touch must travel to be a swipe
+         * @param minimumVelocity the average velocity of the touch in display fractions per second to be a swipe
+         */
+        void setSwipe(float minimumDistance, float minimumVelocity) {
+            swipeDistance = minimumDistance;
+            swipeVelocity = minimumVelocity;
+        }
+
+        /**
+         * Processes one reading, on release the position is changed to the last point that was touched. When
+         * scrolling, a touch moving faster than the swipe velocity is reported in proportionally finer steps, down to
+         * a quarter of the movement threshold, so that the scroll accelerates with the touch.
+         * @param x the X position, updated on release
+         * @param y the Y position, updated on release
+         * @param mode the touch state this reading
+         * @param now the time in milliseconds
+         * @param scrolling true when the events are used for scrolling
+         * @return true if the event should be sent, false if it is coalesced
+         */
+        bool process(float& x, float& y, TouchState mode, unsigned long now, bool scrolling = false);
+
+        /** @return the gesture recognised by the last call to process, or GESTURE_NONE */
+        TouchGesture getGesture() const { return gesture; }
+
+        /** @return the velocity in the X dimension while held, or of the whole swipe on release */
+        float getVelocityX() const { return velocityX; }
+        /** @return the velocity in the Y dimension while held, or of the whole swipe on release */
+        float getVelocityY() const { return velocityY; }
+
+        /** @return true once the current touch has moved beyond the starting threshold */
+        bool isMoving() const { return moving; }
+    private:
+        float reportingThreshold(bool scrolling) const;
+
+        static float distance(float x1, float y1, float x2, float y2) {
+            float dx = portableFloatAbs(x1 - x2);
+            float dy = portableFloatAbs(y1 - y2);
+            return dx > dy ? dx : dy;
+        }
+    };
+
     /**
      * A touch integrator is a class that is capable of receiving touch events from a touch panel and reporting those
      * said events to the touch screen manager. It is a pull API in that `internalProcessTouch` will be called to pull
@@ -142,23 +306,61 @@ namespace iotouch {
          * @return the touch state after this call
          */
         virtual TouchState internalProcessTouch(float* ptrX, float* ptrY, const TouchOrientationSettings& settings, const CalibrationHandler& calib)=0;
+
+        /**
+         * Called by the touch screen manager when it has interrupt wake enabled and the panel is not touched. An
+         * interrogator that supports it sets the panel up so that a touch raises an interrupt that calls the handler,
+         * by default this is not supported and the manager polls as usual.
+         * @param onTouch the interrupt handler to attach
+         * @return true if the panel is now waiting for a touch interrupt
+         */
+        virtual bool startIdleWait(RawIntHandler onTouch) { return false; }
+
+        /**
+         * Called after startIdleWait to check if the panel was touched already, before the interrupt was ready.
+         * @return true if the panel is touched
+         */
+        virtual bool isIdleTouchPresent() { return false; }
     };
 
     class TouchInterrogator;
+    class TouchScreenManager;
+
+    /**
+     * The event that wakes the touch screen manager from an interrupt, internal to TouchScreenManager.
+     */
+    class TouchWakeEvent : public BaseEvent {
+    private:
+        TouchScreenManager* manager;
+    public:
+        explicit TouchWakeEvent(TouchScreenManager* manager) : manager(manager) {}
+        uint32_t timeOfNextCheck() override { return secondsToMicros(60); }
+        void exec() override;
+    };
 
     class TouchScreenManager : public Executable {
     public:
+        /** the manager that touch interrupts are delivered to, only one can use interrupt wake */
+        static TouchScreenManager* INTERRUPT_INSTANCE;
     private:
         AccelerationHandler accelerationHandler;
         CalibrationHandler calibrator;
+        TouchGestureHandler gestureHandler;
         TouchInterrogator* touchInterrogator;
         TouchState touchMode;
         TouchOrientationSettings orientation;
+        TouchWakeEvent wakeEvent;
+        WakeDeadline wakeDeadline;
         bool usedForScrolling = false;
+        bool affineMinMax = false;
+        bool gesturesEnabled = false;
+        bool interruptWake = false;
+        bool wakeRegistered = false;
+        volatile bool waitingForTouch = false;
     public:
         explicit TouchScreenManager(TouchInterrogator* interrogator, const TouchOrientationSettings& orientationSettings) :
                 accelerationHandler(10, true), calibrator(),
-                touchInterrogator(interrogator), touchMode(NOT_TOUCHED), orientation(orientationSettings) {}
+                touchInterrogator(interrogator), touchMode(NOT_TOUCHED), orientation(orientationSettings), wakeEvent(this) {}
 
         void start() {
             touchMode = NOT_TOUCHED;
@@ -169,14 +371,78 @@ namespace iotouch {
             usedForScrolling = scrolling;
         }
 
+        /**
+         * Turns on the gesture stage, so that held events are only sent when the touch moves, rather than every 20ms,
+         * and gestures are sent to sendGesture. As held events that do not move are not sent, acceleration is not used,
+         * a long press takes the place of repeating while held. When used for scrolling, the velocity of the touch sets
+         * how often held events are sent instead. See TouchGestureHandler, which can be configured using
+         * getGestureHandler.
+         * @param enabled true to turn on the gesture stage
+         */
+        void enableGestures(bool enabled) { gesturesEnabled = enabled; }
+
+        /** @return the gesture handler, to change its thresholds and times */
+        TouchGestureHandler& getGestureHandler() { return gestureHandler; }
+
+        /**
+         * Turns on interrupt wake, so that while the panel is not touched, instead of polling every 100ms the manager
+         * waits for the interrupt raised by a touch, and only samples the panel while it is touched, returning to
+         * waiting after it is released. The interrogator must support it, see ResistiveTouchInterrogator, otherwise
+         * polling carries on as usual. Only one touch screen manager can use interrupt wake.
+         * @param enabled true to wait for a touch interrupt when idle
+         */
+        void enableInterruptWake(bool enabled);
+
+        /** @return true while the manager is waiting for a touch interrupt rather than polling */
+        bool isWaitingForTouch() const { return waitingForTouch; }
+
+        /**
+         * internal method not for external use, called from the touch interrupt.
+         */
+        void touchInterruptRaised() {
+            if(waitingForTouch) {
+                waitingForTouch = false;
+                wakeEvent.markTriggeredAndNotify();
+            }
+        }
+
         void calibrateMinMaxValues(float xmin, float xmax, float ymin, float ymax) {
             calibrator.setCalibrationValues(xmin, xmax, ymin, ymax);
+            if(affineMinMax) calibrator.buildAffineFromMinMax(orientation);
         }
 
-        void setCalibration(const CalibrationHandler& other) { calibrator = other; }
+        void setCalibration(const CalibrationHandler& other) {
+            calibrator = other;
+            affineMinMax = false;
+        }
 
         void enableCalibration(bool ena) {
             calibrator.enableCalibration(ena);
+            if(affineMinMax) calibrator.buildAffineFromMinMax(orientation);
+        }
+
+        /**
+         * Uses a precomputed fixed point affine transform for calibration, orientation and inversion, built from the
+         * minimum and maximum values and rebuilt when they or the orientation change, see CalibrationHandler.
+         * @param ena true to use the affine transform
+         * @return true if the transform could be built
+         */
+        bool enableAffineCalibration(bool ena) {
+            affineMinMax = ena;
+            if(!ena) {
+                calibrator.disableAffine();
+                return true;
+            }
+            return calibrator.buildAffineFromMinMax(orientation);
+        }
+
+        /**
+         * Calibrates from three points using an affine transform, which also corrects skew, see CalibrationHandler.
+         * @return true if the transform could be built
+         */
+        bool calibrateThreePoint(const float rawX[3], const float rawY[3], const float displayX[3], const float displayY[3]) {
+            affineMinMax = false;
+            return calibrator.calibrateThreePoint(rawX, rawY, displayX, displayY);
         }
 
         TouchOrientationSettings changeOrientation(const TouchOrientationSettings& newOrientation);
@@ -194,6 +460,25 @@ namespace iotouch {
          * @param touched if the panel is current touched
          */
         virtual void sendEvent(float locationX, float locationY, float touchPressure, TouchState touched) = 0;
+
+        /**
+         * Called when gestures are enabled and one is recognised, override to handle gestures, by default they are
+         * ignored. It is called before the event that it relates to is sent.
+         * @param gesture the gesture that was recognised
+         * @param locationX the location between 0 and 1 in the X domain, where the touch was last
+         * @param locationY the location between 0 and 1 in the Y domain, where the touch was last
+         * @param velocityX for a swipe, the average velocity in the X domain in display fractions per second
+         * @param velocityY for a swipe, the average velocity in the Y domain in display fractions per second
+         */
+        virtual void sendGesture(TouchGesture gesture, float locationX, float locationY, float velocityX, float velocityY) { }
+    };
+
+    /** How ResistiveTouchInterrogator combines the burst of samples taken for each axis */
+    enum TouchSampleFilter : uint8_t {
+        /** the median sample, which ignores up to half the samples being spikes */
+        TOUCH_FILTER_MEDIAN,
+        /** the mean of the samples after dropping the highest and lowest quarter */
+        TOUCH_FILTER_TRIMMED_MEAN
     };
 
     /**
@@ -207,17 +492,54 @@ namespace iotouch {
      * * all the GPIOs used must be OUTPUT capable, this matters on some boards such as ESP32
      * * Y+ and X- must be connected to ADC (analog input capable) pins.
      * * it uses taskManager and takes readings at the millisecond interval provided.
+     *
+     * Each axis is read as a burst of samples in one batch read, which are combined in integer ADC counts by a median
+     * or trimmed mean, see setSampling. By default two samples are averaged, and the pass is debounced when they differ
+     * by more than 0.007 of full scale, on a noisy panel take five or more with the median so that spikes are discarded
+     * and a valid coordinate comes out of one pass.
      */
     class ResistiveTouchInterrogator : public TouchInterrogator {
     private:
         pinid_t xpPin, xnPinAdc, ypPinAdc, ynPin;
+        uint16_t settleMicros = 20;
+        float spreadTolerance = 0.007F;
+        unsigned int spreadToleranceCounts = 0;
+        unsigned int maxRange = 0;
+        uint8_t bitDepth = 0;
+        uint8_t samplesPerAxis = 2;
+        TouchSampleFilter sampleFilter = TOUCH_FILTER_TRIMMED_MEAN;
+        bool interruptAttached = false;
     public:
 
         ResistiveTouchInterrogator(pinid_t xpPin, pinid_t xnPin, pinid_t ypPin, pinid_t ynPin)
                 : xpPin(xpPin), xnPinAdc(xnPin), ypPinAdc(ypPin), ynPin(ynPin) {}
 
+        /**
+         * Configures the burst of samples taken for each axis on each pass.
+         * @param samples the number of samples per axis, between 2 and TOUCH_MAX_SAMPLES
+         * @param filter how the samples are combined, median or trimmed mean
+         * @param tolerance if the samples spread by more than this fraction of full scale the pass is debounced, the
+         *        highest and lowest quarter of the samples are not checked
+         */
+        void setSampling(uint8_t samples, TouchSampleFilter filter, float tolerance = 0.007F);
+
+        /**
+         * Sets the time allowed for the panel to settle after the plates are driven, before sampling each axis.
+         * @param micros the settle time in microseconds, by default 20
+         */
+        void setSettleMicros(uint16_t micros) { settleMicros = micros; }
+
         TouchState internalProcessTouch(float* ptrX, float* ptrY, const TouchOrientationSettings& rotation, const CalibrationHandler& calibrator) override;
 
+        /**
+         * Biases the panel for touch detection, Y- is driven low and X+ is an input with pull up, the other two pins
+         * float, so a touch pulls X+ low and raises the interrupt. X+ must therefore be interrupt capable.
+         */
+        bool startIdleWait(RawIntHandler onTouch) override;
+        bool isIdleTouchPresent() override;
+
+    private:
+        bool sampleAxis(pinid_t pin, unsigned int& reading);
     };
 
     /**
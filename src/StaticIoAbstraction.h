@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_STATICIOABSTRACTION_H
+#define IOABSTRACTION_STATICIOABSTRACTION_H
+
+/**
+ * @file StaticIoAbstraction.h
+ * @brief Compile time composition of IoAbstractions, for when the set of devices is fixed at build time.
+ *
+ * `MultiIoAbstraction` and `NegatingIoAbstraction` work through `IoAbstractionRef`, so each pin operation goes
+ * through a virtual call on every layer. The templates here hold the concrete device type instead, and call it with
+ * a qualified name, so each operation is bound at compile time and normally inlines down to the device's own code.
+ *
+ * For example, device pins 0..19 followed by an inverted PCF8574 could be built as:
+ *
+ * ```
+ * PCF8574IoAbstraction pcf(0x20, IO_PIN_NOT_DEFINED);
+ * StaticNegatingIo<PCF8574IoAbstraction> invertedPcf(pcf);
+ * StaticMultiIo<BasicIoAbstraction, 20, StaticNegatingIo<PCF8574IoAbstraction>> allPins(internalDigitalDevice(), invertedPcf);
+ * StaticIoAdapter<decltype(allPins)> allPinsRef(allPins); // when an IoAbstractionRef is needed
+ * ```
+ */
+
+#include "PlatformDetermination.h"
+#include "BasicIoAbstraction.h"
+
+/**
+ * Provides the same convenience functions as BasicIoAbstraction, such as digitalRead and digitalWriteS, for the
+ * static abstractions, calling the derived type directly rather than through a virtual call.
+ * @tparam TDerived the static abstraction type extending this class
+ */
+template<class TDerived> class StaticIoOperations {
+private:
+    TDerived& self() { return *static_cast<TDerived*>(this); }
+public:
+    uint8_t digitalRead(pinid_t p) { return self().readValue(p); }
+    void digitalWrite(pinid_t p, uint8_t v) { self().writeValue(p, v); }
+    uint8_t digitalReadS(pinid_t p) { self().runLoop(); return self().readValue(p); }
+    void digitalWriteS(pinid_t p, uint8_t v) { self().writeValue(p, v); self().runLoop(); }
+    void pinMode(pinid_t pin, uint8_t mode) { self().pinDirection(pin, mode); }
+    bool sync() { return self().runLoop(); }
+};
+
+/**
+ * The compile time equivalent of NegatingIoAbstraction, it inverts every read and write on the device it wraps.
+ * @tparam TDevice the concrete type of the device being inverted
+ */
+template<class TDevice> class StaticNegatingIo : public StaticIoOperations<StaticNegatingIo<TDevice>> {
+private:
+    TDevice& delegate;
+public:
+    explicit StaticNegatingIo(TDevice& toInvert) : delegate(toInvert) {}
+
+    void pinDirection(pinid_t pin, uint8_t mode) { delegate.TDevice::pinDirection(pin, mode); }
+    void writeValue(pinid_t pin, uint8_t value) { delegate.TDevice::writeValue(pin, !value); }
+    uint8_t readValue(pinid_t pin) { return !delegate.TDevice::readValue(pin); }
+    void attachInterrupt(pinid_t pin, RawIntHandler handler, uint8_t mode) { delegate.TDevice::attachInterrupt(pin, handler, mode); }
+    bool runLoop() { return delegate.TDevice::runLoop(); }
+    void writePort(pinid_t pin, uint8_t portVal) { delegate.TDevice::writePort(pin, ~portVal); }
+    uint8_t readPort(pinid_t pin) { return ~(delegate.TDevice::readPort(pin)); }
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) { return ~(delegate.TDevice::readPinMask(startPin, mask)) & mask; }
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) { delegate.TDevice::writePinMask(startPin, mask, ~values); }
+};
+
+/**
+ * The compile time equivalent of MultiIoAbstraction for two devices, pins below FIRST_PINS belong to the first
+ * device, then the second device's pins start at FIRST_PINS. For more than two devices, nest another StaticMultiIo
+ * as the second device.
+ * @tparam TFirst the concrete type of the first device
+ * @tparam FIRST_PINS the number of pins allocated to the first device
+ * @tparam TSecond the concrete type of the second device
+ */
+template<class TFirst, pinid_t FIRST_PINS, class TSecond> class StaticMultiIo : public StaticIoOperations<StaticMultiIo<TFirst, FIRST_PINS, TSecond>> {
+private:
+    TFirst& first;
+    TSecond& second;
+public:
+    StaticMultiIo(TFirst& first, TSecond& second) : first(first), second(second) {}
+
+    void pinDirection(pinid_t pin, uint8_t mode) {
+        if(pin < FIRST_PINS) first.TFirst::pinDirection(pin, mode);
+        else second.TSecond::pinDirection(pin - FIRST_PINS, mode);
+    }
+
+    void writeValue(pinid_t pin, uint8_t value) {
+        if(pin < FIRST_PINS) first.TFirst::writeValue(pin, value);
+        else second.TSecond::writeValue(pin - FIRST_PINS, value);
+    }
+
+    uint8_t readValue(pinid_t pin) {
+        if(pin < FIRST_PINS) return first.TFirst::readValue(pin);
+        else return second.TSecond::readValue(pin - FIRST_PINS);
+    }
+
+    void attachInterrupt(pinid_t pin, RawIntHandler handler, uint8_t mode) {
+        if(pin < FIRST_PINS) first.TFirst::attachInterrupt(pin, handler, mode);
+        else second.TSecond::attachInterrupt(pin - FIRST_PINS, handler, mode);
+    }
+
+    bool runLoop() {
+        // both devices are always synced, even if the first fails.
+        bool firstOk = first.TFirst::runLoop();
+        bool secondOk = second.TSecond::runLoop();
+        return firstOk && secondOk;
+    }
+
+    void writePort(pinid_t pin, uint8_t portVal) {
+        if(pin < FIRST_PINS) first.TFirst::writePort(pin, portVal);
+        else second.TSecond::writePort(pin - FIRST_PINS, portVal);
+    }
+
+    uint8_t readPort(pinid_t pin) {
+        if(pin < FIRST_PINS) return first.TFirst::readPort(pin);
+        else return second.TSecond::readPort(pin - FIRST_PINS);
+    }
+
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) {
+        if(startPin >= FIRST_PINS) return second.TSecond::readPinMask(startPin - FIRST_PINS, mask);
+
+        unsigned int inFirst = FIRST_PINS - startPin;
+        if(inFirst >= 32) return first.TFirst::readPinMask(startPin, mask);
+        IoPinMask ret = 0;
+        IoPinMask firstMask = mask & ((IoPinMask(1) << inFirst) - 1);
+        if(firstMask) ret = first.TFirst::readPinMask(startPin, firstMask);
+        if(mask >> inFirst) ret |= second.TSecond::readPinMask(0, mask >> inFirst) << inFirst;
+        return ret;
+    }
+
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+        if(startPin >= FIRST_PINS) {
+            second.TSecond::writePinMask(startPin - FIRST_PINS, mask, values);
+            return;
+        }
+
+        unsigned int inFirst = FIRST_PINS - startPin;
+        if(inFirst >= 32) {
+            first.TFirst::writePinMask(startPin, mask, values);
+            return;
+        }
+        IoPinMask firstMask = mask & ((IoPinMask(1) << inFirst) - 1);
+        if(firstMask) first.TFirst::writePinMask(startPin, firstMask, values);
+        if(mask >> inFirst) second.TSecond::writePinMask(0, mask >> inFirst, values >> inFirst);
+    }
+};
+
+/**
+ * Wraps any static abstraction so that it can be used through the regular `IoAbstractionRef` interface, for example
+ * with switches or the keyboard manager. Only this outer layer is virtual, everything within it is bound at compile
+ * time. Pass the address of the adapter wherever an IoAbstractionRef is needed.
+ * @tparam TStatic the static abstraction type being adapted
+ */
+template<class TStatic> class StaticIoAdapter : public BasicIoAbstraction {
+private:
+    TStatic& target;
+public:
+    explicit StaticIoAdapter(TStatic& target) : target(target) {}
+
+    void pinDirection(pinid_t pin, uint8_t mode) override { target.TStatic::pinDirection(pin, mode); }
+    void writeValue(pinid_t pin, uint8_t value) override { target.TStatic::writeValue(pin, value); }
+    uint8_t readValue(pinid_t pin) override { return target.TStatic::readValue(pin); }
+    void attachInterrupt(pinid_t pin, RawIntHandler handler, uint8_t mode) override { target.TStatic::attachInterrupt(pin, handler, mode); }
+    bool runLoop() override { return target.TStatic::runLoop(); }
+    void writePort(pinid_t pin, uint8_t portVal) override { target.TStatic::writePort(pin, portVal); }
+    uint8_t readPort(pinid_t pin) override { return target.TStatic::readPort(pin); }
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override { return target.TStatic::readPinMask(startPin, mask); }
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override { target.TStatic::writePinMask(startPin, mask, values); }
+};
+
+#endif //IOABSTRACTION_STATICIOABSTRACTION_H
@@ -5,15 +5,16 @@
 
 #include <inttypes.h>
 #include "SwitchInput.h"
+#include "NegatingIoAbstraction.h"
 
 #define ONE_TURN_OF_ENCODER 32
 
 SwitchInput switches;
 
-void registerInterrupt(pinid_t pin);
+void registerInterrupt(pinid_t pin, pinid_t pairedPin = IOA_INTERRUPT_PIN_UNKNOWN);
 void onSwitchesInterrupt(__attribute__((unused)) pinid_t pin);
 
-KeyboardItem::KeyboardItem() : stateFlags(NOT_PRESSED), previousState(NOT_PRESSED), pin(-1), counter(0), acceleration(0),
+KeyboardItem::KeyboardItem() : stateFlags(NOT_PRESSED), pin(-1), counter(0), acceleration(0),
                                repeatInterval(NO_REPEAT), notify{}, callbackOnRelease{} {}
 
 KeyboardItem::KeyboardItem(pinid_t pin, KeyCallbackFn callback, uint8_t repeatInterval, bool keyLogicIsInverted) : notify{} {
@@ -21,7 +22,6 @@ KeyboardItem::KeyboardItem(pinid_t pin, KeyCallbackFn callback, uint8_t repeatIn
     this->pin = pin;
 	this->counter = 0;
     this->notify.callback = callback;
-	previousState = NOT_PRESSED;
 	stateFlags = NOT_PRESSED;
 	callbackOnRelease = nullptr;
 	acceleration = 0;
@@ -34,7 +34,6 @@ KeyboardItem::KeyboardItem(pinid_t pin, SwitchListener* switchListener, uint8_t
 	this->repeatInterval = repeatInterval;
     this->notify.listener = switchListener;
     this->counter = 0;
-    previousState = NOT_PRESSED;
 	stateFlags = NOT_PRESSED;
 	callbackOnRelease = nullptr;
 	acceleration = 0;
@@ -50,13 +49,43 @@ void KeyboardItem::onRelease(KeyCallbackFn cb) {
 }
 
 void KeyboardItem::trigger(bool held) {
+	if (!notify.callback) {
+		clearLatencyEdge();
+		return;
+	}
+	if (switches.queueKeyEvent(pin, held, false)) return;
+	notifyPressed(held);
+}
+
+void KeyboardItem::triggerRelease(bool held) {
+	if (!isUsingListener() && !callbackOnRelease) {
+		clearLatencyEdge();
+		return;
+	}
+	if (switches.queueKeyEvent(pin, held, true)) return;
+	notifyReleased(held);
+}
+
+void KeyboardItem::notifyPressed(bool held) {
 	if (!notify.callback) return;
+#ifdef IOA_INPUT_INSTRUMENTATION
+	if (edgeMicros != 0) {
+		IOA_LATENCY_RECORD(INPUT_LATENCY_SWITCH, pin, edgeMicros)
+		edgeMicros = 0;
+	}
+#endif
 
 	if (isUsingListener()) notify.listener->onPressed(pin, held);
 	else notify.callback(pin, held);
 }
 
-void KeyboardItem::triggerRelease(bool held) {
+void KeyboardItem::notifyReleased(bool held) {
+#ifdef IOA_INPUT_INSTRUMENTATION
+	if (edgeMicros != 0) {
+		IOA_LATENCY_RECORD(INPUT_LATENCY_SWITCH, pin, edgeMicros)
+		edgeMicros = 0;
+	}
+#endif
 	if (isUsingListener()) notify.listener->onReleased(pin, held);
 	else if(callbackOnRelease) callbackOnRelease(pin, held);
 }
@@ -72,61 +101,146 @@ void KeyboardItem::changeListener(SwitchListener* listener) {
 }
 
 
+void KeyboardItem::debouncedPress() {
+	setState(PRESSED);
+	setPreviousState(PRESSED);
+	counter = 0;
+	acceleration = 1;
+	trigger(false);
+}
+
+void KeyboardItem::debouncedHeld() {
+	setState(BUTTON_HELD);
+	setPreviousState(BUTTON_HELD);
+	trigger(true);
+	counter = 0;
+	acceleration = 1;
+}
+
+void KeyboardItem::debouncedRelease() {
+	setState(NOT_PRESSED);
+	markLatencyEdge(switches.getLatencySampleMicros());
+	KeyPressState previous = getPreviousState();
+	setPreviousState(NOT_PRESSED);
+	if (previous == PRESSED) {
+		triggerRelease(false);
+	} else if (previous == BUTTON_HELD){
+		triggerRelease(true);
+	} else {
+		// a bounce that never became a press
+		clearLatencyEdge();
+	}
+}
+
+void KeyboardItem::repeatIfHeld() {
+	if (getState() != BUTTON_HELD || repeatInterval == NO_REPEAT || notify.callback == nullptr) return;
+	counter = counter + (acceleration >> SWITCHES_ACCELERATION_DIVISOR) + 1;
+	if (counter > repeatInterval) {
+		acceleration = min(255, acceleration + 1);
+		trigger(true);
+		counter = 0;
+	}
+}
+
 void KeyboardItem::checkAndTrigger(uint8_t buttonState){
 	if (notify.callback == nullptr && callbackOnRelease == nullptr) return;
 
 	if (buttonState == HIGH) {
 		if (getState() == NOT_PRESSED) {
 			setState(DEBOUNCING1);
+			markLatencyEdge(switches.getLatencySampleMicros());
 		}
 		else if (isDebouncing()) {
-			setState(PRESSED);
-			previousState = PRESSED;
-			counter = 0; 
-			acceleration = 1;
-			trigger(false);
-				
+			debouncedPress();
 		}
 		else if (getState() == PRESSED) {
 			counter++;
 			if (counter > HOLD_THRESHOLD) {
-				setState(BUTTON_HELD);
-				previousState = BUTTON_HELD;
-				trigger(true);
-				counter = 0;
-				acceleration = 1;
+				debouncedHeld();
 			}
 		}
-		else if (getState() == BUTTON_HELD && repeatInterval != NO_REPEAT && notify.callback != nullptr) {
-			counter = counter + (acceleration >> SWITCHES_ACCELERATION_DIVISOR) + 1;
-			if (counter > repeatInterval) {
-				acceleration = min(255, acceleration + 1);
-				trigger(true);
-				counter = 0;
-			}
+		else {
+			repeatIfHeld();
 		}
 	}
 	else if(getState() == DEBOUNCING1) {
 		setState(DEBOUNCING2);
 	}
 	else {
-		setState(NOT_PRESSED);
-		if (previousState == PRESSED) {
-			previousState = NOT_PRESSED;
-			triggerRelease(false);
-		} else if (previousState == BUTTON_HELD){
-			previousState = NOT_PRESSED;
-			triggerRelease(true);
-		}
+		debouncedRelease();
 	}
 }
 
-SwitchInput::SwitchInput() : encoder{}, keys(MAX_KEYS) {
+void SwitchInputGroup::addPin(pinid_t pin, bool invert, bool pressed, bool held) {
+    IoPinMask bit = IoPinMask(1) << (pin - startPin);
+    keyCount++;
+    pins |= bit;
+    if(invert) inversion |= bit;
+    if(pressed) debounced |= bit;
+    if(held) heldDown |= bit;
+}
+
+bool SwitchInputGroup::sample(IoPinMask active, IoPinMask& pressedEdges, IoPinMask& releasedEdges, IoPinMask& heldEdges) {
+    // a switch that differs from its debounced state for two samples in a row changes state.
+    IoPinMask delta = active ^ debounced;
+    IoPinMask toggled = delta & changing;
+    changing = delta & ~toggled;
+    debounced ^= toggled;
+    pressedEdges = toggled & debounced;
+    releasedEdges = toggled & ~debounced;
+    heldDown &= debounced;
+
+    // the hold counters are incremented in parallel for the pressed switches that are not yet held, as a ripple
+    // carry across the bit planes, and cleared for everything else.
+    IoPinMask counting = debounced & ~heldDown & ~pressedEdges;
+    IoPinMask carry = counting;
+    IoPinMask atThreshold = counting;
+    for(uint8_t plane = 0; plane < SWITCH_HOLD_PLANES; plane++) {
+        holdPlane[plane] &= counting;
+        IoPinMask nextCarry = holdPlane[plane] & carry;
+        holdPlane[plane] ^= carry;
+        carry = nextCarry;
+        atThreshold &= bitRead(uint32_t(HOLD_THRESHOLD + 1), plane) ? holdPlane[plane] : ~holdPlane[plane];
+    }
+    heldEdges = atThreshold;
+    heldDown |= atThreshold;
+
+    return (debounced | changing) != 0;
+}
+
+#ifdef SWITCHES_FIXED_CAPACITY
+SwitchInput::SwitchInput() : encoder{}, keys(MAX_KEYS, GROW_NEVER), inputGroups(SWITCH_MAX_INPUT_GROUPS, GROW_NEVER) {
+#else
+SwitchInput::SwitchInput() : encoder{}, keys(MAX_KEYS), inputGroups(2) {
+#endif
 	this->ioDevice = nullptr;
+	this->foldedInversion = nullptr;
 	this->swFlags = 0;
     this->lastSyncStatus = true;
+    this->debounceEngine = SWITCH_DEBOUNCE_STATE_MACHINE;
+    this->groupsNeedRebuild = true;
+    this->backoffTaskId = TASKMGR_INVALIDID;
+    this->backoffInterval = 0;
+    this->keyEventCount = 0;
+    this->pendingEncoderCount = 0;
+    this->queuedDelivery = false;
+    this->deliveryScheduled = false;
+    this->delivering = false;
+    this->deliveringEncoders = nullptr;
+    this->deliveringEncoderCount = 0;
+    this->pollEverythingCount = 0;
+    this->droppedEventCount = 0;
+    this->crossThreadLock = nullptr;
+    this->pinIndex = nullptr;
+    this->pinIndexStart = 0;
+    this->pinIndexSize = 0;
+    this->pendingModeStart = 0;
+    this->pendingPullUpPins = 0;
+    this->pendingInputPins = 0;
+    this->pinModesDeferred = false;
 }
 
+
 void SwitchInput::initialiseInterrupt(IoAbstractionRef device, bool usePullUpSwitching) {
 	this->init(device, SWITCHES_NO_POLLING, usePullUpSwitching);
 }
@@ -136,29 +250,41 @@ void SwitchInput::initialise(IoAbstractionRef device, bool usePullUpSwitching) {
 }
 
 void SwitchInput::init(IoAbstractionRef device, SwitchInterruptMode mode, bool defaultIsPullUp) {
+    // anything still waiting belongs to the previous device.
+    applyPendingPinModes();
 	this->ioDevice = device;
+	this->foldedInversion = nullptr;
+	this->groupsNeedRebuild = true;
 
 	// set up the flags
 	this->swFlags = 0;
 	bitWrite(swFlags, SW_FLAG_PULLUP_LOGIC, defaultIsPullUp);
 	bitWrite(swFlags, SW_FLAG_INTERRUPT_DRIVEN, (mode == SWITCHES_NO_POLLING));
-	bitWrite(swFlags, SW_FLAG_ENCODER_IS_POLLING, (mode == SWITCHES_POLL_EVERYTHING));
+	bitWrite(swFlags, SW_FLAG_ENCODER_IS_POLLING, (mode == SWITCHES_POLL_EVERYTHING || mode == SWITCHES_POLL_EXTERNALLY));
+	bitWrite(swFlags, SW_FLAG_IDLE_BACKOFF, (mode == SWITCHES_POLL_KEYS_WITH_BACKOFF));
+	bitWrite(swFlags, SW_FLAG_EXTERNAL_POLL, (mode == SWITCHES_POLL_EXTERNALLY));
+    // a backoff poll from an earlier init would otherwise keep running alongside the new mode.
+    if(backoffTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(backoffTaskId);
+    backoffTaskId = TASKMGR_INVALIDID;
+    backoffInterval = 0;
 
 	if(mode == SWITCHES_POLL_KEYS_ONLY) {
 		serlogF(SER_IOA_INFO, "Switches polling for keys");
 		taskManager.scheduleFixedRate(SWITCH_POLL_INTERVAL, [] {
+            switches.getWakeDeadline().nextRunIn(millisToMicros(SWITCH_POLL_INTERVAL), false);
 			switches.runLoop();
 		});
 	} else if(mode == SWITCHES_POLL_EVERYTHING) {
         serlogF(SER_IOA_INFO, "Switches polling for everything");
 		taskManager.scheduleFixedRate(SWITCH_POLL_INTERVAL / 8, [] {
-            static uint8_t counter = 0;
-            if(++counter % 8 == 7) {
-                switches.runLoop();
-            }
-			onSwitchesInterrupt(-1);
+            switches.pollEverything();
 		});
-	}
+	} else if(mode == SWITCHES_POLL_KEYS_WITH_BACKOFF) {
+        serlogF(SER_IOA_INFO, "Switches polling with idle backoff");
+        scheduleBackoffPoll(SWITCH_POLL_INTERVAL);
+    } else if(mode == SWITCHES_POLL_EXTERNALLY) {
+        serlogF(SER_IOA_INFO, "Switches polled externally");
+    }
 
 	serlogF4(SER_IOA_INFO, "Switches initialized (pull-up, int, encPoll)", bitRead(swFlags, SW_FLAG_PULLUP_LOGIC), bitRead(swFlags, SW_FLAG_INTERRUPT_DRIVEN),
 			   bitRead(swFlags, SW_FLAG_ENCODER_IS_POLLING));
@@ -166,30 +292,73 @@ void SwitchInput::init(IoAbstractionRef device, SwitchInterruptMode mode, bool d
 
 bool SwitchInput::addSwitch(pinid_t pin, KeyCallbackFn callback,uint8_t repeat, bool invertLogic) {
 	internalAddSwitch(pin, invertLogic);
-    return keys.add(KeyboardItem(pin, callback, repeat, invertLogic));
+    return addKey(KeyboardItem(pin, callback, repeat, invertLogic));
 }
 
 bool SwitchInput::addSwitchListener(pinid_t pin, SwitchListener* listener, uint8_t repeat, bool invertLogic) {
 	internalAddSwitch(pin, invertLogic);
-    return keys.add(KeyboardItem(pin, listener, repeat, invertLogic));
+    return addKey(KeyboardItem(pin, listener, repeat, invertLogic));
+}
+
+bool SwitchInput::addKey(const KeyboardItem& item) {
+    if(keys.add(item)) return true;
+    serlogF2(SER_WARNING, "Switches full, not added ", item.getPin());
+    return false;
 }
 
 bool SwitchInput::internalAddSwitch(pinid_t pin, bool invertLogic) {
 	if (ioDevice == nullptr) initialise(internalDigitalIo(), true);
+    groupsNeedRebuild = true;
 
-	ioDevice->pinMode(pin, isPullupLogic(invertLogic) ? INPUT_PULLUP : INPUT);
-
-    if (isInterruptDriven()) {
+    if (isInterruptDriven() || isIdleBackoff()) {
+        // the pin must be fully configured before the interrupt is attached.
+        applyPendingPinModes();
+        ioDevice->pinMode(pin, isPullupLogic(invertLogic) ? INPUT_PULLUP : INPUT);
 		registerInterrupt(pin);
-	}
+	} else if (pinModesDeferred) {
+        queuePinMode(pin, isPullupLogic(invertLogic));
+    } else {
+        ioDevice->pinMode(pin, isPullupLogic(invertLogic) ? INPUT_PULLUP : INPUT);
+    }
 
     return true;
 }
 
+void SwitchInput::queuePinMode(pinid_t pin, bool pullUp) {
+    // a pin that will not fit into the current group of 32 pins starts a new group.
+    if((pendingPullUpPins | pendingInputPins) == 0) {
+        pendingModeStart = pin;
+    } else if(pin < pendingModeStart || pin >= (pendingModeStart + 32)) {
+        applyPendingPinModes();
+        pendingModeStart = pin;
+    }
+
+    IoPinMask bit = IoPinMask(1) << (pin - pendingModeStart);
+    if(pullUp) {
+        pendingPullUpPins |= bit;
+        pendingInputPins &= ~bit;
+    } else {
+        pendingInputPins |= bit;
+        pendingPullUpPins &= ~bit;
+    }
+}
+
+void SwitchInput::deferPinModes(bool defer) {
+    pinModesDeferred = defer;
+    if(!defer) applyPendingPinModes();
+}
+
+void SwitchInput::applyPendingPinModes() {
+    if(ioDevice == nullptr) return;
+    if(pendingPullUpPins) ioDevice->pinDirectionMask(pendingModeStart, pendingPullUpPins, INPUT_PULLUP);
+    if(pendingInputPins) ioDevice->pinDirectionMask(pendingModeStart, pendingInputPins, INPUT);
+    pendingPullUpPins = pendingInputPins = 0;
+}
+
 void SwitchInput::onRelease(pinid_t pin, KeyCallbackFn callbackOnRelease) {
 	if (ioDevice == nullptr) initialise(internalDigitalIo(), true);
 
-	auto keyItem = keys.getByKey(pin);
+	auto keyItem = findKey(pin);
 	if(keyItem) {
 	    // already initialised, just add the release callback
 	    keyItem->onRelease(callbackOnRelease);
@@ -199,30 +368,87 @@ void SwitchInput::onRelease(pinid_t pin, KeyCallbackFn callbackOnRelease) {
 	    // not yet added, we will do a best efforts standard initialisation.
         KeyboardItem newItem(pin, (KeyCallbackFn) nullptr, NO_REPEAT, false);
         newItem.onRelease(callbackOnRelease);
-        keys.add(newItem);
+        addKey(newItem);
     }
 }
 
 void SwitchInput::replaceOnPressed(pinid_t pin, KeyCallbackFn callbackOnPressed) {
-    auto keyItem = keys.getByKey(pin);
+    auto keyItem = findKey(pin);
     if(keyItem) {
         keyItem->changeOnPressed(callbackOnPressed);
     }
 }
 
 void SwitchInput::replaceSwitchListener(pinid_t pin, SwitchListener* newListener) {
-    auto keyItem = keys.getByKey(pin);
+    auto keyItem = findKey(pin);
     if(keyItem) {
         keyItem->changeListener(newListener);
     }
 }
 
 bool SwitchInput::isSwitchPressed(pinid_t pin) {
-    return keys.getByKey(pin)->isPressed();
+    auto keyItem = findKey(pin);
+    return keyItem != nullptr && keyItem->isPressed();
 }
 
 void SwitchInput::pushSwitch(pinid_t pin, bool held) {
-    keys.getByKey(pin)->trigger(held);
+    auto keyItem = findKey(pin);
+    if(keyItem) keyItem->trigger(held);
+}
+
+static uint8_t countPinBits(uint8_t bits) {
+    uint8_t count = 0;
+    for(; bits != 0; bits &= uint8_t(bits - 1U)) count++;
+    return count;
+}
+
+KeyboardItem* SwitchInput::findKey(pinid_t pin) {
+    // the index is out of date as soon as a key is added or removed, until the groups are next rebuilt.
+    if(groupsNeedRebuild || pinIndex == nullptr) return keys.getByKey(pin);
+    if(pin < pinIndexStart || pin >= (pinIndexStart + pinIndexSize)) return nullptr;
+    unsigned int offset = pin - pinIndexStart;
+    uint8_t lastByte = pinIndex[offset / 8];
+    if(!bitRead(lastByte, offset % 8)) return nullptr;
+
+    // the index of the key is the number of key pins before it.
+    uint8_t idx = countPinBits(lastByte & uint8_t((1U << (offset % 8)) - 1U));
+    for(unsigned int i = 0; i < offset / 8; i++) {
+        idx += countPinBits(pinIndex[i]);
+    }
+    return keys.itemAtIndex(idx);
+}
+
+void SwitchInput::releasePinIndex() {
+#ifndef SWITCHES_FIXED_CAPACITY
+    delete[] pinIndex;
+#endif
+    pinIndex = nullptr;
+    pinIndexSize = 0;
+}
+
+void SwitchInput::rebuildPinIndex() {
+    releasePinIndex();
+    if(keys.count() == 0 || keys.count() >= 0xff) return;
+
+    // keys are held in pin order, so the first and last give the span of pins.
+    pinid_t first = keys.itemAtIndex(0)->getPin();
+    unsigned int span = (keys.itemAtIndex(keys.count() - 1)->getPin() - first) + 1;
+    if(span > SWITCH_PIN_INDEX_MAX_SPAN) return;
+
+    unsigned int bytes = (span + 7) / 8;
+#ifdef SWITCHES_FIXED_CAPACITY
+    pinIndex = pinIndexStore;
+#else
+    pinIndex = new uint8_t[bytes];
+    if(pinIndex == nullptr) return;
+#endif
+    memset(pinIndex, 0, bytes);
+    for (bsize_t i = 0; i < keys.count(); ++i) {
+        unsigned int offset = keys.itemAtIndex(i)->getPin() - first;
+        bitSet(pinIndex[offset / 8], offset % 8);
+    }
+    pinIndexStart = first;
+    pinIndexSize = span;
 }
 
 void SwitchInput::changeEncoderPrecision(uint8_t slot, uint16_t precision, uint16_t currentValue, bool rollover, int step) {
@@ -233,46 +459,168 @@ void SwitchInput::changeEncoderPrecision(uint8_t slot, uint16_t precision, uint1
 
 void SwitchInput::setEncoder(uint8_t slot, RotaryEncoder* enc) {
 	if (slot < MAX_ROTARY_ENCODERS) {
+		if(this->encoder[slot] != nullptr && this->encoder[slot] != enc) removeQueuedEncoder(this->encoder[slot]);
 		this->encoder[slot] = enc;
 	}
 }
 
 bool SwitchInput::runLoop() {
 	bool needAnotherGo = false;
+    IOA_LATENCY_TIMER_START
 
-	lastSyncStatus = ioDevice->sync();
+    if(pendingPullUpPins | pendingInputPins) applyPendingPinModes();
+    if(queuedDelivery) retryStalledDelivery();
 
-	for (bsize_t i = 0; i < keys.count(); ++i) {
-		// get the pins current state
-		auto key = keys.itemAtIndex(i);
-		uint8_t pinState = ioDevice->digitalRead(key->getPin());
-		if(isPullupLogic(key->isLogicInverted())) {
-			pinState = !pinState;
-		}
-		// and pass to the key handler.
-		key->checkAndTrigger(pinState);
+	lastSyncStatus = ioDevice->sync();
+#ifdef IOA_INPUT_INSTRUMENTATION
+    latencySampleMicros = (latencyInterruptMicros != 0) ? latencyInterruptMicros : ioaLatencyStarted;
+    latencyInterruptMicros = 0;
+#endif
+
+    if(groupsNeedRebuild) rebuildInputGroups();
+    if(debounceEngine == SWITCH_DEBOUNCE_VERTICAL) {
+        needAnotherGo = runVerticalDebounce();
+        IOA_LATENCY_TIMER_RECORD(INPUT_LATENCY_SWITCH_LOOP)
+        return needAnotherGo;
+    }
 
-		// we need to call into here again if we are debouncing or anything is pressed.
-		needAnotherGo |= (key->isDebouncing() || key->isPressed());
-	}
+    // each group of keys is read in one go, then its keys are passed their state in pin order.
+    IoAbstractionRef groupDevice = groupReadDevice();
+    for (bsize_t g = 0; g < inputGroups.count(); ++g) {
+        auto group = inputGroups.itemAtIndex(g);
+        IoPinMask active = group->readActive(groupDevice);
+        bsize_t last = group->getFirstKey() + group->getKeyCount();
+        for (bsize_t i = group->getFirstKey(); i < last; ++i) {
+            auto key = keys.itemAtIndex(i);
+            key->checkAndTrigger(bitRead(active, key->getPin() - group->getStartPin()) ? HIGH : LOW);
+
+            // we need to call into here again if we are debouncing or anything is pressed.
+            needAnotherGo |= (key->isDebouncing() || key->isPressed());
+        }
+    }
 
+    IOA_LATENCY_TIMER_RECORD(INPUT_LATENCY_SWITCH_LOOP)
 	return needAnotherGo;
 }
 
+void SwitchInput::setDebounceEngine(SwitchDebounceEngine engine) {
+    debounceEngine = engine;
+    groupsNeedRebuild = true;
+}
+
+void SwitchInput::rebuildInputGroups() {
+    groupsNeedRebuild = false;
+    inputGroups.clear();
+
+    // keys are held in pin order, so each group starts at the first key that does not fit in the one before.
+    SwitchInputGroup group;
+    bool groupStarted = false;
+    for (bsize_t i = 0; i < keys.count(); ++i) {
+        auto key = keys.itemAtIndex(i);
+        pinid_t pin = key->getPin();
+        if(groupStarted && pin >= (group.getStartPin() + 32)) {
+            addInputGroup(group);
+            groupStarted = false;
+        }
+        if(!groupStarted) {
+            group = SwitchInputGroup(pin, i);
+            groupStarted = true;
+        }
+        bool invert = isPullupLogic(key->isLogicInverted());
+        if(foldedInversion != nullptr && foldedInversion->isPinInverted(pin)) invert = !invert;
+        group.addPin(pin, invert, key->isPressed(), key->isHeld());
+    }
+    if(groupStarted) addInputGroup(group);
+    rebuildPinIndex();
+}
+
+void SwitchInput::foldInversionOf(NegatingIoAbstraction* device) {
+    if(device != nullptr && device != ioDevice) {
+        serlogF(SER_ERROR, "Fold needs switches device");
+        return;
+    }
+    foldedInversion = device;
+    groupsNeedRebuild = true;
+}
+
+IoAbstractionRef SwitchInput::groupReadDevice() const {
+    return (foldedInversion != nullptr) ? foldedInversion->getDelegate() : ioDevice;
+}
+
+void SwitchInput::addInputGroup(const SwitchInputGroup& group) {
+    if(!inputGroups.add(group)) {
+        serlogF2(SER_WARNING, "Switch groups full, not read from ", group.getStartPin());
+    }
+}
+
+void SwitchInput::notifyGroupEdges(pinid_t startPin, IoPinMask edges, void (KeyboardItem::*action)()) {
+    for(uint8_t bit = 0; edges != 0; bit++, edges >>= 1U) {
+        if((edges & 1U) == 0) continue;
+        auto key = findKey(startPin + bit);
+        if(key) (key->*action)();
+    }
+}
+
+#ifdef IOA_INPUT_INSTRUMENTATION
+void SwitchInput::markGroupLatency(SwitchInputGroup* group, IoPinMask moving, IoPinMask debouncedEdges) {
+    // switches that bounced back before debouncing are forgotten, those that just started changing are noted.
+    IoPinMask fresh = moving & ~group->latencyEdges;
+    IoPinMask abandoned = group->latencyEdges & ~moving;
+    group->latencyEdges = moving & ~debouncedEdges;
+    pinid_t start = group->getStartPin();
+    for(uint8_t bit = 0; (fresh | abandoned) != 0; bit++, fresh >>= 1U, abandoned >>= 1U) {
+        if(((fresh | abandoned) & 1U) == 0) continue;
+        auto key = findKey(start + bit);
+        if(key == nullptr) continue;
+        if(abandoned & 1U) key->clearLatencyEdge();
+        else key->markLatencyEdge(latencySampleMicros);
+    }
+}
+#endif
+
+bool SwitchInput::runVerticalDebounce() {
+    bool needAnotherGo = false;
+    IoAbstractionRef groupDevice = groupReadDevice();
+    for (bsize_t i = 0; i < inputGroups.count(); ++i) {
+        auto group = inputGroups.itemAtIndex(i);
+        IoPinMask pressedEdges, releasedEdges, heldEdges;
+        IoPinMask active = group->readActive(groupDevice);
+#ifdef IOA_INPUT_INSTRUMENTATION
+        IoPinMask moving = active ^ group->getPressed();
+#endif
+        needAnotherGo |= group->sample(active, pressedEdges, releasedEdges, heldEdges);
+#ifdef IOA_INPUT_INSTRUMENTATION
+        markGroupLatency(group, moving, pressedEdges | releasedEdges);
+#endif
+
+        // only the keys that changed are visited, along with held keys that may repeat.
+        pinid_t start = group->getStartPin();
+        if(releasedEdges) notifyGroupEdges(start, releasedEdges, &KeyboardItem::debouncedRelease);
+        if(pressedEdges) notifyGroupEdges(start, pressedEdges, &KeyboardItem::debouncedPress);
+        IoPinMask repeating = group->getHeld() & ~heldEdges;
+        if(repeating) notifyGroupEdges(start, repeating, &KeyboardItem::repeatIfHeld);
+        if(heldEdges) notifyGroupEdges(start, heldEdges, &KeyboardItem::debouncedHeld);
+    }
+    return needAnotherGo;
+}
+
 
 /******ROTARY ENCODERS *****/
 
 
-RotaryEncoder::RotaryEncoder(EncoderCallbackFn callback) : notify{} {
+RotaryEncoder::RotaryEncoder(EncoderCallbackFn callback) : notify{}, accelerationProfile(nullptr), lastVelocityEvent(0), velocity(0),
+                                                             pendingDirection(0) {
     this->notify.callback = callback;
 	this->currentReading = 0;
 	this->maximumValue = 0;
+    this->stepSize = 1;
     this->flags = 0U;
     bitWrite(flags, LAST_SYNC_STATUS, 1);
     this->intent = CHANGE_VALUE;
 }
 
-RotaryEncoder::RotaryEncoder(EncoderListener* listener) : notify{} {
+RotaryEncoder::RotaryEncoder(EncoderListener* listener) : notify{}, accelerationProfile(nullptr), lastVelocityEvent(0), velocity(0),
+                                                            pendingDirection(0) {
 	this->notify.encoderListener = listener;
 	this->currentReading = 0;
 	this->maximumValue = 0;
@@ -283,6 +631,10 @@ RotaryEncoder::RotaryEncoder(EncoderListener* listener) : notify{} {
     this->intent = CHANGE_VALUE;
 }
 
+RotaryEncoder::~RotaryEncoder() {
+    switches.removeQueuedEncoder(this);
+}
+
 void RotaryEncoder::changePrecision(uint16_t maxValue, int currentValue, bool rolloverOnMax, int step) {
 	this->maximumValue = maxValue;
 	this->currentReading = currentValue;
@@ -313,7 +665,75 @@ void RotaryEncoder::setUserIntention(EncoderUserIntention intention) {
 // this abs accounts for some boards where abs is a double precision function
 #define safeAbs(x) ((x) < 0 ? -(x) : (x))
 
-void RotaryEncoder::increment(int8_t incVal) {
+void RotaryEncoder::runCallback(int newVal) {
+    bool directionOnly = (maximumValue == 0 && intent == DIRECTION_ONLY);
+    // read on another core or thread, the value goes in the queue so that nothing here is shared with task manager.
+    if(switches.queueEncoderValue(this, newVal, directionOnly)) return;
+
+    if(directionOnly) pendingDirection += newVal;
+    if(switches.queueEncoderChange(this)) {
+        bitSet(flags, CALLBACK_PENDING);
+        return;
+    }
+
+    // not queued, anything previously pending is combined into this notification.
+    bitClear(flags, CALLBACK_PENDING);
+#ifdef IOA_INPUT_INSTRUMENTATION
+    if(latencyEdgeMicros != 0) {
+        IOA_LATENCY_RECORD(INPUT_LATENCY_ENCODER, latencyId, latencyEdgeMicros)
+        latencyEdgeMicros = 0;
+    }
+#endif
+    if(directionOnly) {
+        newVal = pendingDirection;
+        pendingDirection = 0;
+    }
+    if(bitRead(flags, OO_LISTENER_CALLBACK)) {
+        notify.encoderListener->encoderHasChanged(newVal);
+    } else {
+        notify.callback(newVal);
+    }
+}
+
+void RotaryEncoder::deliverPendingCallback() {
+    if(!bitRead(flags, CALLBACK_PENDING)) return;
+    bitClear(flags, CALLBACK_PENDING);
+#ifdef IOA_INPUT_INSTRUMENTATION
+    if(latencyEdgeMicros != 0) {
+        IOA_LATENCY_RECORD(INPUT_LATENCY_ENCODER, latencyId, latencyEdgeMicros)
+        latencyEdgeMicros = 0;
+    }
+#endif
+    int value = currentReading;
+    if(maximumValue == 0 && intent == DIRECTION_ONLY) {
+        value = pendingDirection;
+        pendingDirection = 0;
+    }
+    deliverValue(value);
+}
+
+void RotaryEncoder::deliverValue(int value) {
+    if(bitRead(flags, OO_LISTENER_CALLBACK)) {
+        notify.encoderListener->encoderHasChanged(value);
+    } else {
+        notify.callback(value);
+    }
+}
+
+int RotaryEncoder::acceleratedAmount(unsigned long when) {
+    // an exponential moving average of the instantaneous rate, which starts again from rest after a pause.
+    unsigned long gap = when - lastVelocityEvent;
+    lastVelocityEvent = when;
+    if(gap >= ENCODER_VELOCITY_IDLE_MICROS) {
+        velocity = 0;
+    } else {
+        auto rate = (int32_t)(1000000UL / max(gap, 500UL));
+        velocity = (uint16_t)((int32_t)velocity + ((rate - (int32_t)velocity) / 4));
+    }
+    return stepSize * accelerationProfile->stepsForVelocity(velocity, maximumValue);
+}
+
+void RotaryEncoder::increment(int incVal) {
     if(maximumValue == 0 && intent == DIRECTION_ONLY) {
 		// first check if we are in direction only mode (max = 0)
 		 runCallback(incVal);
@@ -322,14 +742,16 @@ void RotaryEncoder::increment(int8_t incVal) {
 
     bool rollover = bitRead(flags, WRAP_AROUND_MODE) != 0;
     if(incVal >= 0) {
+        // worked out wider than the reading, so that a large accelerated step cannot overflow.
+        int32_t next = (int32_t)currentReading + incVal;
         if(rollover) {
-			currentReading = (currentReading + incVal);
-			if (currentReading > maximumValue) currentReading = currentReading - maximumValue - 1;
-        } else {
-			currentReading = min((uint16_t)(currentReading + incVal), maximumValue);
+			if (next > maximumValue) next = next - maximumValue - 1;
+        } else if(next > maximumValue) {
+			next = maximumValue;
 		}
-	} else if(currentReading < abs(incVal)) {
-		currentReading = rollover? maximumValue - safeAbs(incVal) + 1 : 0;
+        currentReading = (uint16_t)next;
+	} else if(currentReading < safeAbs(incVal)) {
+		currentReading = rollover? maximumValue + 1 - (safeAbs(incVal) - currentReading) : 0;
 	} else if(currentReading != 0) {
 		currentReading += incVal;
     }
@@ -362,8 +784,9 @@ void AbstractHwRotaryEncoder::initialiseBase(pinid_t pinA, pinid_t pinB, HWAccel
 	bitWrite(flags, LAST_SYNC_STATUS, lastSyncOK);
 
 	if(!switches.isEncoderPollingEnabled()) {
-		registerInterrupt(pinA);
-		registerInterrupt(pinB);
+		// each edge samples both pins, so that the decoding does not depend on a level read at an earlier edge.
+		registerInterrupt(pinA, pinB);
+		registerInterrupt(pinB, pinA);
 	}
 }
 
@@ -375,31 +798,298 @@ void checkRunLoopAndRepeat() {
 	// is still in a debouncing state. Otherwise we wait for an interrupt.
 	// switches.runLoop returns true when it needs to run again.
 	if(switches.runLoop() && switches.isInterruptDriven()) {
-		taskManager.scheduleOnce(20, [] {
+		taskManager.scheduleOnce(switches.getWakeDeadline().nextRunIn(millisToMicros(20)), [] {
 			checkRunLoopAndRepeat();
-		});
+		}, TIME_MICROS);
 	}
 	else {
 		// back to normal now - interrupt only
 		switches.setInterruptDebouncing(false);
+		if(switches.isInterruptDriven()) switches.getWakeDeadline().waitingForInterrupt();
 	}
 }
 
+// the number of recorded interrupt events taken from the ring at once
+#define SWITCH_EVENT_BATCH_SIZE 8
+
+// set once any pin falls back to task manager's own interrupt handling, its edges are not in the ring.
+static bool switchesHasUnrecordedInterrupts = false;
+
 void onSwitchesInterrupt(__attribute__((unused)) pinid_t pin) {
-	if(switches.isInterruptDriven() && !switches.isInterruptDebouncing()) {
-		checkRunLoopAndRepeat();
-	}
+    // either polling, or an interrupt that is not recorded in the ring, needs the state of everything read directly.
+    bool readEverything = ioInterruptRing.isEmpty() || switchesHasUnrecordedInterrupts;
+#ifdef IOA_INPUT_INSTRUMENTATION
+    if(readEverything && (switches.isInterruptDriven() || switches.isIdleBackoff()) && switches.latencyInterruptMicros == 0) {
+        switches.latencyInterruptMicros = micros();
+    }
+#endif
+
+    // hand each recorded edge to the encoder that owns it in the order they happened, any other edge is for a key.
+    IoInterruptEvent events[SWITCH_EVENT_BATCH_SIZE];
+    bool keyChanged = readEverything;
+    uint8_t count;
+    while((count = ioInterruptRing.popBatch(events, SWITCH_EVENT_BATCH_SIZE)) != 0) {
+        for(uint8_t e = 0; e < count; e++) {
+            if(events[e].pin == IOA_INTERRUPT_PIN_UNKNOWN) {
+                // the shared interrupt of a device, any of its pins may have changed.
+#ifdef IOA_INPUT_INSTRUMENTATION
+                if(switches.latencyInterruptMicros == 0) switches.latencyInterruptMicros = events[e].timestamp;
+#endif
+                readEverything = keyChanged = true;
+                continue;
+            }
+            bool handled = false;
+            for(int i = 0; i < MAX_ROTARY_ENCODERS; ++i) {
+                if(switches.encoder[i] && switches.encoder[i]->isEncoderPin(events[e].pin)) {
+                    switches.encoder[i]->encoderChangedFromEvent(events[e]);
+                    handled = true;
+                }
+            }
+            keyChanged |= !handled;
+#ifdef IOA_INPUT_INSTRUMENTATION
+            if(!handled && switches.latencyInterruptMicros == 0) switches.latencyInterruptMicros = events[e].timestamp;
+#endif
+        }
+    }
 
-  for(int i = 0; i < MAX_ROTARY_ENCODERS; ++i) {
-		if(switches.encoder[i]) {
-			switches.encoder[i]->encoderChanged();
-		}
-	}
+    if(keyChanged && switches.isInterruptDriven() && !switches.isInterruptDebouncing()) {
+        checkRunLoopAndRepeat();
+    }
+    if(keyChanged && switches.isIdleBackoff()) {
+        switches.wakeFromIdle();
+    }
+
+    if(readEverything) {
+        for(int i = 0; i < MAX_ROTARY_ENCODERS; ++i) {
+            if(switches.encoder[i]) {
+                switches.encoder[i]->encoderChanged();
+            }
+        }
+    }
+}
+
+void SwitchInput::setQueuedDelivery(bool queued) {
+    // anything already waiting goes out before the mode changes.
+    if(!queued) deliverQueuedEvents();
+    queuedDelivery = queued;
+}
+
+void SwitchInput::setCrossThreadDelivery(SwitchEventQueueLock* lock) {
+    // anything already waiting goes out in the form it was queued in.
+    deliverQueuedEvents();
+    crossThreadLock = lock;
+    if(lock != nullptr) queuedDelivery = true;
+}
+
+bool SwitchInput::queueKeyEvent(pinid_t pin, bool held, bool release) {
+    if(!queuedDelivery || (delivering && crossThreadLock == nullptr)) return false;
+    lockEventQueue();
+    bool queued = keyEventCount < SWITCH_EVENT_QUEUE_SIZE;
+    if(queued) {
+        keyEventQueue[keyEventCount].pin = pin;
+        keyEventQueue[keyEventCount].type = (release ? 2 : 0) | (held ? 1 : 0);
+        keyEventCount++;
+    } else if(crossThreadLock != nullptr) {
+        droppedEventCount++;
+    }
+    unlockEventQueue();
+
+    if(!queued) {
+        // on another thread the event cannot be delivered here, it is dropped instead, and delivery of the full queue
+        // is made sure of, in case scheduling it failed before.
+        if(crossThreadLock != nullptr) {
+            scheduleDelivery();
+            return true;
+        }
+        // the caller delivers this event straight away, so what is already queued must go out ahead of it.
+        serlogF(SER_IOA_DEBUG, "Key queue full");
+        deliverQueuedEvents();
+        return false;
+    }
+    scheduleDelivery();
+    return true;
+}
+
+bool SwitchInput::queueEncoderChange(RotaryEncoder* enc) {
+    if(!queuedDelivery || delivering) return false;
+
+    // an encoder already waiting just has its changes combined.
+    for(uint8_t i = 0; i < pendingEncoderCount; i++) {
+        if(pendingEncoders[i] == enc) return true;
+    }
+    if(pendingEncoderCount == SWITCH_EVENT_QUEUE_SIZE) {
+        serlogF(SER_IOA_DEBUG, "Encoder queue full");
+        return false;
+    }
+    pendingEncoders[pendingEncoderCount] = enc;
+    pendingEncoderCount++;
+    scheduleDelivery();
+    return true;
+}
+
+bool SwitchInput::queueEncoderValue(RotaryEncoder* enc, int value, bool accumulate) {
+    if(crossThreadLock == nullptr) return false;
+    lockEventQueue();
+    uint8_t idx = 0;
+    while(idx < pendingEncoderCount && pendingEncoders[idx] != enc) idx++;
+    if(idx < pendingEncoderCount) {
+        pendingEncoderValues[idx] = accumulate ? pendingEncoderValues[idx] + value : value;
+    } else if(idx < SWITCH_EVENT_QUEUE_SIZE) {
+        pendingEncoders[idx] = enc;
+        pendingEncoderValues[idx] = value;
+        pendingEncoderCount++;
+    } else {
+        droppedEventCount++;
+    }
+    unlockEventQueue();
+    scheduleDelivery();
+    return true;
+}
+
+void SwitchInput::scheduleDelivery() {
+    lockEventQueue();
+    bool alreadyScheduled = deliveryScheduled;
+    deliveryScheduled = true;
+    unlockEventQueue();
+    if(alreadyScheduled) return;
+    auto taskId = taskManager.execute([] {
+        switches.deliverQueuedEvents();
+    });
+    if(taskId == TASKMGR_INVALIDID) {
+        // no task slot is free, the events stay queued and the next loop of switches tries to schedule delivery again.
+        serlogF(SER_WARNING, "Switch delivery not scheduled");
+        lockEventQueue();
+        deliveryScheduled = false;
+        unlockEventQueue();
+    }
+}
+
+void SwitchInput::retryStalledDelivery() {
+    lockEventQueue();
+    bool stalled = !deliveryScheduled && (keyEventCount != 0 || pendingEncoderCount != 0);
+    unlockEventQueue();
+    if(stalled) scheduleDelivery();
+}
+
+void SwitchInput::deliverQueuedEvents() {
+    // the queue is copied out under the lock, so that switches read elsewhere can keep queueing during delivery.
+    QueuedKeyEvent keyEvents[SWITCH_EVENT_QUEUE_SIZE];
+    RotaryEncoder* encoders[SWITCH_EVENT_QUEUE_SIZE];
+    int encoderValues[SWITCH_EVENT_QUEUE_SIZE];
+    lockEventQueue();
+    deliveryScheduled = false;
+    uint8_t keyCount = keyEventCount;
+    uint8_t encoderCount = pendingEncoderCount;
+    memcpy(keyEvents, keyEventQueue, keyCount * sizeof(QueuedKeyEvent));
+    memcpy(encoders, pendingEncoders, encoderCount * sizeof(RotaryEncoder*));
+    memcpy(encoderValues, pendingEncoderValues, encoderCount * sizeof(int));
+    keyEventCount = 0;
+    pendingEncoderCount = 0;
+    bool valuesCaptured = crossThreadLock != nullptr;
+    unlockEventQueue();
+
+    delivering = true;
+    deliveringEncoders = encoders;
+    deliveringEncoderCount = encoderCount;
+    for(uint8_t i = 0; i < keyCount; i++) {
+        auto key = findKey(keyEvents[i].pin);
+        if(key == nullptr) continue;
+        bool held = keyEvents[i].type & 1;
+        if(keyEvents[i].type & 2) key->notifyReleased(held);
+        else key->notifyPressed(held);
+    }
+
+    for(uint8_t i = 0; i < encoderCount; i++) {
+        if(encoders[i] == nullptr) continue;
+        if(valuesCaptured) encoders[i]->deliverValue(encoderValues[i]);
+        else encoders[i]->deliverPendingCallback();
+    }
+    deliveringEncoders = nullptr;
+    deliveringEncoderCount = 0;
+    delivering = false;
+}
+
+void SwitchInput::removeQueuedEncoder(RotaryEncoder* enc) {
+    lockEventQueue();
+    uint8_t kept = 0;
+    for(uint8_t i = 0; i < pendingEncoderCount; i++) {
+        if(pendingEncoders[i] == enc) continue;
+        pendingEncoders[kept] = pendingEncoders[i];
+        pendingEncoderValues[kept] = pendingEncoderValues[i];
+        kept++;
+    }
+    pendingEncoderCount = kept;
+    for(uint8_t i = 0; i < deliveringEncoderCount; i++) {
+        if(deliveringEncoders[i] == enc) deliveringEncoders[i] = nullptr;
+    }
+    unlockEventQueue();
+}
+
+void SwitchInput::pollEverything() {
+    // when polled from elsewhere, such as another core, task manager has nothing to wake up for.
+    if(!isExternallyPolled()) wakeDeadline.nextRunIn(millisToMicros(SWITCH_POLL_INTERVAL) / 8, false);
+    if(++pollEverythingCount % 8 == 7) {
+        runLoop();
+    }
+    onSwitchesInterrupt(-1);
+}
+
+void SwitchInput::scheduleBackoffPoll(uint16_t interval) {
+    backoffInterval = interval;
+    backoffTaskId = taskManager.scheduleOnce(wakeDeadline.nextRunIn(millisToMicros(interval)), [] {
+        switches.backoffPoll();
+    }, TIME_MICROS);
+}
+
+void SwitchInput::backoffPoll() {
+    backoffTaskId = TASKMGR_INVALIDID;
+    if(runLoop()) {
+        scheduleBackoffPoll(SWITCH_POLL_INTERVAL);
+        return;
+    }
+
+    if(SWITCH_IDLE_MAX_POLL_INTERVAL == 0) {
+        // from here on only an interrupt wakes switches up.
+        backoffInterval = 0;
+        wakeDeadline.waitingForInterrupt();
+        return;
+    }
+
+    // nothing is happening, so each idle poll doubles the interval, up to the maximum.
+    uint16_t next = backoffInterval * 2;
+    if(next > SWITCH_IDLE_MAX_POLL_INTERVAL) next = SWITCH_IDLE_MAX_POLL_INTERVAL;
+    scheduleBackoffPoll(next);
+}
+
+void SwitchInput::wakeFromIdle() {
+    // already polling quickly, the next poll will see the change.
+    if(backoffInterval == SWITCH_POLL_INTERVAL && backoffTaskId != TASKMGR_INVALIDID) return;
+
+    if(backoffTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(backoffTaskId);
+    backoffInterval = SWITCH_POLL_INTERVAL;
+    backoffTaskId = taskManager.scheduleOnce(wakeDeadline.nextRunIn(0, false), [] {
+        switches.backoffPoll();
+    }, TIME_MICROS);
 }
 
 void SwitchInput::resetAllSwitches() {
     keys.clear();
+    inputGroups.clear();
+    releasePinIndex();
+    groupsNeedRebuild = true;
+    debounceEngine = SWITCH_DEBOUNCE_STATE_MACHINE;
+    keyEventCount = pendingEncoderCount = 0;
+    queuedDelivery = deliveryScheduled = false;
+    crossThreadLock = nullptr;
+    droppedEventCount = 0;
+    wakeDeadline.waitingForInterrupt();
+    if(backoffTaskId != TASKMGR_INVALIDID) taskManager.cancelTask(backoffTaskId);
+    backoffTaskId = TASKMGR_INVALIDID;
+    backoffInterval = 0;
+    pendingPullUpPins = pendingInputPins = 0;
+    pinModesDeferred = false;
     ioDevice = internalDigitalIo();
+    foldedInversion = nullptr;
     for(int i=0;i<MAX_ROTARY_ENCODERS;i++) {
         encoder[i] = nullptr;
     }
@@ -429,16 +1119,33 @@ void HardwareRotaryEncoder::encoderChanged() {
 	bool lastSyncStatus = switches.getIoAbstraction()->sync();
     bitWrite(flags, LAST_SYNC_STATUS, lastSyncStatus);
 
-	uint8_t a = switches.getIoAbstraction()->digitalRead(pinA);
-	uint8_t b = switches.getIoAbstraction()->digitalRead(pinB);
+	levelA = switches.getIoAbstraction()->digitalRead(pinA);
+	levelB = switches.getIoAbstraction()->digitalRead(pinB);
+    processLevels(levelA, levelB, micros());
+}
 
+void HardwareRotaryEncoder::encoderChangedFromEvent(const IoInterruptEvent& event) {
+    if(event.level == IOA_INTERRUPT_LEVEL_UNKNOWN) {
+        encoderChanged();
+        return;
+    }
+
+    // both pins are normally read in the interrupt, if the other pin was not, it keeps its last known level.
+    uint8_t& edgeLevel = (event.pin == pinA) ? levelA : levelB;
+    uint8_t& otherLevel = (event.pin == pinA) ? levelB : levelA;
+    edgeLevel = event.level;
+    if(event.pairedLevel != IOA_INTERRUPT_LEVEL_UNKNOWN) otherLevel = event.pairedLevel;
+    processLevels(levelA, levelB, event.timestamp);
+}
+
+void HardwareRotaryEncoder::processLevels(uint8_t a, uint8_t b, unsigned long when) {
 	if(encoderType == QUARTER_CYCLE){
 		if((a != aLast) || (b != cleanFromB)) {
 			aLast = a;
 			if((a != aLast) || (b != cleanFromB)) {
 				cleanFromB = b;
 				if((a || cleanFromB) || (a == 0 && b == 0)) {
-                    handleChangeRaw(a && b);
+                    handleChangeRaw(a && b, when);
                 }
 			}
 		}		
@@ -449,7 +1156,7 @@ void HardwareRotaryEncoder::encoderChanged() {
 			if(b != cleanFromB) {
 				cleanFromB = b;
 				if(a) {
-                    handleChangeRaw(b);
+                    handleChangeRaw(b, when);
 				}
 			}
 		}	
@@ -459,17 +1166,18 @@ void HardwareRotaryEncoder::encoderChanged() {
 void HardwareRotaryEncoder::initialise(pinid_t pinA, pinid_t pinB, HWAccelerationMode accelerationMode, EncoderType et) {
     this->aLast = switches.getIoAbstraction()->digitalRead(pinA);
     this->cleanFromB = switches.getIoAbstraction()->digitalRead(pinB);
+    this->levelA = aLast;
+    this->levelB = cleanFromB;
     initialiseBase(pinA, pinB, accelerationMode, et);
 }
 
-void AbstractHwRotaryEncoder::handleChangeRaw(bool increase) {
+void AbstractHwRotaryEncoder::handleChangeRaw(bool increase, unsigned long timeNow) {
     // was the last direction up?
     bool lastDirectionUp = bitRead(flags, LAST_ENCODER_DIRECTION_UP);
 
-    // get the amount of change and direction. Also keep a copy of the time until later for acceleration purposes
-    unsigned long timeNow = micros();
+    // get the amount of change and direction. The time is when the change happened, for acceleration purposes
     unsigned long deltaMillis = timeNow - lastChange;
-    int amt = amountFromChange(deltaMillis);
+    int amt = hasAccelerationProfile() ? acceleratedAmount(timeNow) : amountFromChange(deltaMillis);
 
     // update the last change time now to ensure always set
     lastChange = timeNow;
@@ -480,7 +1188,8 @@ void AbstractHwRotaryEncoder::handleChangeRaw(bool increase) {
     if(deltaMillis < REJECT_DIRECTION_CHANGE_THRESHOLD && increase != lastDirectionUp) return;
 
     // now we make the change and register the last change direction (as we accepted it)
-    increment((int8_t) (increase ? amt : -amt));
+    markLatencyEdge(timeNow, pinA);
+    increment(increase ? amt : -amt);
     bitWrite(flags, LAST_ENCODER_DIRECTION_UP, increase);
 }
 
@@ -520,12 +1229,11 @@ EncoderUpDownButtons::EncoderUpDownButtons(pinid_t pinUp, pinid_t pinDown, pinid
 
 void EncoderUpDownButtons::onPressed(pinid_t pin, bool held) {
     bool invert = intent == SCROLL_THROUGH_ITEMS;
-    if (pin == getIncrementPin()) {
-        int8_t dir = invert ? -stepSize : stepSize;
-        increment(dir);
-    } else if (pin == getDecrementPin()) {
-        int8_t dir = invert ? stepSize : -stepSize;
-        increment(dir);
+    if (pin == getIncrementPin() || pin == getDecrementPin()) {
+        int amt = hasAccelerationProfile() ? acceleratedAmount(micros()) : stepSize;
+        bool up = (pin == getIncrementPin()) != invert;
+        markLatencyEdge(switches.getLatencySampleMicros(), pin);
+        increment(up ? amt : -amt);
     } else if(backPin != -1 && passThroughListener && pin == getBackPin()) {
         passThroughListener->onPressed(backPin, held);
     } else if(nextPin != -1 && passThroughListener && pin == getNextPin()) {
@@ -642,52 +1350,57 @@ HwStateRotaryEncoder::HwStateRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderLi
 void setupUpDownButtonEncoder(pinid_t pinUp, pinid_t pinDown, EncoderCallbackFn callback, int speed) {
 	if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
 
-	auto* enc = new EncoderUpDownButtons(pinUp, pinDown, callback, speed);
+	auto* enc = ioaCreate<EncoderUpDownButtons>(pinUp, pinDown, callback, speed);
 	switches.setEncoder(enc);
 }
 
 void setupUpDownButtonEncoder(pinid_t pinUp, pinid_t pinDown, EncoderListener* listener, int speed) {
     if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
 
-    auto* enc = new EncoderUpDownButtons(pinUp, pinDown, listener, speed);
+    auto* enc = ioaCreate<EncoderUpDownButtons>(pinUp, pinDown, listener, speed);
     switches.setEncoder(enc);
 }
 
 void setupUpDownButtonEncoder(pinid_t pinUp, pinid_t pinDown, pinid_t pinLeft, pinid_t pinRight, SwitchListener* passThroughListener, EncoderListener* listener, int speed) {
     if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
 
-    auto* enc = new EncoderUpDownButtons(pinUp, pinDown, pinLeft, pinRight, passThroughListener, listener, speed);
+    auto* enc = ioaCreate<EncoderUpDownButtons>(pinUp, pinDown, pinLeft, pinRight, passThroughListener, listener, speed);
     switches.setEncoder(enc);
 }
 void setupUpDownButtonEncoder(pinid_t pinUp, pinid_t pinDown, pinid_t pinLeft, pinid_t pinRight, SwitchListener* passThroughListener, EncoderCallbackFn cb, int speed) {
     if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
 
-    auto* enc = new EncoderUpDownButtons(pinUp, pinDown, pinLeft, pinRight, passThroughListener, cb, speed);
+    auto* enc = ioaCreate<EncoderUpDownButtons>(pinUp, pinDown, pinLeft, pinRight, passThroughListener, cb, speed);
     switches.setEncoder(enc);
 }
 
-void registerInterrupt(pinid_t pin) {
+void registerInterrupt(pinid_t pin, pinid_t pairedPin) {
 	taskManager.setInterruptCallback(onSwitchesInterrupt);
-	taskManager.addInterrupt(switches.getIoAbstraction(), pin, CHANGE);
+    // prefer the ring so that every edge is seen in order, when all its slots are in use task manager handles it, and
+    // as those edges are not recorded, from then on every interrupt reads all the inputs.
+    if(!attachRecordedInterrupt(switches.getIoAbstraction(), pin, CHANGE, pairedPin)) {
+        switchesHasUnrecordedInterrupts = true;
+        taskManager.addInterrupt(switches.getIoAbstraction(), pin, CHANGE);
+    }
 }
 
 void setupRotaryEncoderWithInterrupt(pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback, HWAccelerationMode accelerationMode, EncoderType encoderType) {
 	if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
-    switches.setEncoder(new HardwareRotaryEncoder(pinA, pinB, callback, accelerationMode, encoderType));
+    switches.setEncoder(ioaCreate<HardwareRotaryEncoder>(pinA, pinB, callback, accelerationMode, encoderType));
 }
 
 void setupRotaryEncoderWithInterrupt(pinid_t pinA, pinid_t pinB, EncoderListener* listener, HWAccelerationMode accelerationMode, EncoderType encoderType) {
 	if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
-    switches.setEncoder(new HardwareRotaryEncoder(pinA, pinB, listener, accelerationMode, encoderType));
+    switches.setEncoder(ioaCreate<HardwareRotaryEncoder>(pinA, pinB, listener, accelerationMode, encoderType));
 }
 
 void setupStateMachineRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderCallbackFn callback, HWAccelerationMode accelerationMode, EncoderType encoderType) {
     if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
-    switches.setEncoder(new HwStateRotaryEncoder(pinA, pinB, callback, accelerationMode, encoderType));
+    switches.setEncoder(ioaCreate<HwStateRotaryEncoder>(pinA, pinB, callback, accelerationMode, encoderType));
 }
 
 void setupStateMachineRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderListener* listener, HWAccelerationMode accelerationMode, EncoderType encoderType) {
     if (switches.getIoAbstraction() == nullptr) switches.init(internalDigitalIo(), SWITCHES_POLL_EVERYTHING, true);
-    switches.setEncoder(new HwStateRotaryEncoder(pinA, pinB, listener, accelerationMode, encoderType));
+    switches.setEncoder(ioaCreate<HwStateRotaryEncoder>(pinA, pinB, listener, accelerationMode, encoderType));
 }
 
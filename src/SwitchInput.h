@@ -16,8 +16,13 @@
 
 #include <IoAbstraction.h>
 #include <TaskManager.h>
+#include "InterruptEventRing.h"
+#include "InputLatencyStatistics.h"
+#include "InputWakeSchedule.h"
 #include <SimpleCollections.h>
 
+class NegatingIoAbstraction;
+
 // START user adjustable section
 
 // The threshold for an item becoming held down or for it to repeat, this is about half a second by default
@@ -54,6 +59,41 @@
 #define SWITCH_POLL_INTERVAL 20
 #endif // SWITCH_POLL_INTERVAL
 
+/*
+ * In SWITCHES_POLL_KEYS_WITH_BACKOFF mode, the poll interval doubles on each poll where nothing is pressed or
+ * debouncing, until it reaches this many millis. Set it to 0 to stop polling altogether once idle, so that only the
+ * key interrupts wake switches up.
+ */
+#ifndef SWITCH_IDLE_MAX_POLL_INTERVAL
+#define SWITCH_IDLE_MAX_POLL_INTERVAL 640
+#endif // SWITCH_IDLE_MAX_POLL_INTERVAL
+
+/*
+ * Switches keeps a bitmap of the pins that have a key, so that a key is found by its pin by counting the bits before
+ * it rather than by binary search. This takes one bit for each pin between the lowest and highest switch pin, so 8
+ * bytes at most by default. When the switches span more pins than this, no bitmap is kept and keys are found by binary
+ * search instead. Set to 0 to never keep the bitmap.
+ */
+#ifndef SWITCH_PIN_INDEX_MAX_SPAN
+#define SWITCH_PIN_INDEX_MAX_SPAN 64
+#endif // SWITCH_PIN_INDEX_MAX_SPAN
+
+/*
+ * Define SWITCHES_FIXED_CAPACITY to stop switches allocating memory once it is constructed, for builds that must not
+ * use the heap at runtime. Switches then holds at most MAX_KEYS keys and SWITCH_MAX_INPUT_GROUPS groups of 32 pins,
+ * adding more fails with a warning, and the pin table is held inside switches rather than allocated. With it defined,
+ * switchesRamFootprint() gives the RAM that switches takes for a compile time check.
+ */
+//#define SWITCHES_FIXED_CAPACITY
+
+/*
+ * With SWITCHES_FIXED_CAPACITY, the number of groups of up to 32 pins that switches can read, each group holds the
+ * keys that are within 32 pins of the first key in it.
+ */
+#ifndef SWITCH_MAX_INPUT_GROUPS
+#define SWITCH_MAX_INPUT_GROUPS 4
+#endif // SWITCH_MAX_INPUT_GROUPS
+
 /*
  * This parameter defines the time threshold for which the rotary encoder should reject a direction change as
  * part of the debouncing. IE if there is a spike that would represent a "valid" direction change this would prevent
@@ -64,6 +104,14 @@
 #define REJECT_DIRECTION_CHANGE_THRESHOLD 100000
 #endif //REJECT_DIRECTION_CHANGE_THRESHOLD
 
+/*
+ * In queued delivery mode, this is the number of key events, and separately the number of encoders with a pending
+ * change, that can wait for delivery. Should either fill, further events are delivered straight away.
+ */
+#ifndef SWITCH_EVENT_QUEUE_SIZE
+#define SWITCH_EVENT_QUEUE_SIZE 8
+#endif // SWITCH_EVENT_QUEUE_SIZE
+
 // END user adjustable section
 
 /** For buttons that should not repeat, and instead just indicate they are HELD down */
@@ -77,7 +125,9 @@ enum KeyPressState : uint8_t {
 	BUTTON_HELD
 };
 
-#define KEY_PRESS_STATE_MASK 0x0f
+#define KEY_PRESS_STATE_MASK 0x07
+#define KEY_PREVIOUS_STATE_SHIFT 3
+#define KEY_PREVIOUS_STATE_MASK 0x38
 #define KEY_LISTENER_MODE_BIT 7
 #define KEY_LOGIC_IS_INVERTED 6
 
@@ -120,12 +170,12 @@ typedef void(*KeyCallbackFn)(pinid_t key, bool heldDown);
 typedef void(*EncoderCallbackFn)(int newValue);
 
 /**
- * An internal class that represents the state of a single key being managed by switches.
+ * An internal class that represents the state of a single key being managed by switches. The current and previous
+ * states, and the listener and inversion flags, are packed into a single byte.
  */
 class KeyboardItem {
 private:
 	uint8_t stateFlags;
-	KeyPressState previousState;
 	pinid_t pin;
 	uint8_t counter;
 	uint8_t acceleration;
@@ -135,6 +185,10 @@ private:
 		SwitchListener* listener;
     } notify;
 	KeyCallbackFn callbackOnRelease;
+#ifdef IOA_INPUT_INSTRUMENTATION
+	// when the change being debounced was first seen, zero when there is none.
+	unsigned long edgeMicros = 0;
+#endif
 public:
     KeyboardItem();
     KeyboardItem(pinid_t pin, KeyCallbackFn callback, uint8_t repeatInterval = NO_REPEAT, bool keyLogicIsInverted = false);
@@ -152,17 +206,138 @@ public:
 	
 	void trigger(bool held);
 	void triggerRelease(bool held);
+	/** internal, calls the press callback or listener straight away, even in queued delivery mode */
+	void notifyPressed(bool held);
+	/** internal, calls the release callback or listener straight away, even in queued delivery mode */
+	void notifyReleased(bool held);
 
 	KeyPressState getState() const { return (KeyPressState)(stateFlags & KEY_PRESS_STATE_MASK); }
 	void setState(KeyPressState state) { 
 		stateFlags &= ~KEY_PRESS_STATE_MASK; 
 		stateFlags |= (state & KEY_PRESS_STATE_MASK);
 	}
+	KeyPressState getPreviousState() const { return (KeyPressState)((stateFlags & KEY_PREVIOUS_STATE_MASK) >> KEY_PREVIOUS_STATE_SHIFT); }
+	void setPreviousState(KeyPressState state) {
+		stateFlags &= ~KEY_PREVIOUS_STATE_MASK;
+		stateFlags |= (state << KEY_PREVIOUS_STATE_SHIFT) & KEY_PREVIOUS_STATE_MASK;
+	}
 	bool isUsingListener() { return bitRead(stateFlags, KEY_LISTENER_MODE_BIT); }
 	bool isLogicInverted() { return bitRead(stateFlags, KEY_LOGIC_IS_INVERTED); }
 
 	void changeOnPressed(KeyCallbackFn pFunction);
 	void changeListener(SwitchListener* listener);
+
+	/** internal, the debounced press of the key has been detected, moves to PRESSED and notifies */
+	void debouncedPress();
+	/** internal, the key has been pressed long enough to be held, moves to BUTTON_HELD and notifies */
+	void debouncedHeld();
+	/** internal, the debounced release of the key has been detected, moves to NOT_PRESSED and notifies */
+	void debouncedRelease();
+	/** internal, called each poll while held down, repeats the key press when a repeat interval is set */
+	void repeatIfHeld();
+
+	/** internal, for latency instrumentation, notes when a change of the key was first seen unless already noted */
+	void markLatencyEdge(__attribute__((unused)) unsigned long when) {
+#ifdef IOA_INPUT_INSTRUMENTATION
+		if(edgeMicros == 0) edgeMicros = when;
+#endif
+	}
+
+	/** internal, for latency instrumentation, forgets a change that bounced back or will not be notified */
+	void clearLatencyEdge() {
+#ifdef IOA_INPUT_INSTRUMENTATION
+		edgeMicros = 0;
+#endif
+	}
+};
+
+/**
+ * Gives the number of bits needed to count up to value, used to size the vertical hold counters below.
+ */
+constexpr uint8_t switchBitsNeededFor(uint32_t value) { return value == 0 ? 0 : 1 + switchBitsNeededFor(value >> 1U); }
+
+/** The number of bit planes in the vertical hold counter, enough to count to HOLD_THRESHOLD + 1 polls */
+#define SWITCH_HOLD_PLANES switchBitsNeededFor(HOLD_THRESHOLD + 1)
+
+/**
+ * A group of up to 32 switches with pin numbers within 32 of the first, that switches reads from the device with one
+ * readPinMask call on each poll, with the pull up inversion of every key in the group applied as a single mask. The
+ * keys of a group are consecutive in the key list, so they are visited without looking each one up.
+ *
+ * With the vertical counter debounce engine, the group also debounces its switches. Each bit across the words is one
+ * switch, its debounce and hold counters are held as bit planes, so that one set of bitwise operations updates every
+ * switch in the group at once.
+ */
+class SwitchInputGroup {
+private:
+    pinid_t startPin;
+    bsize_t firstKey;
+    uint8_t keyCount;
+    IoPinMask pins;
+    IoPinMask inversion;
+    IoPinMask debounced;
+    IoPinMask changing;
+    IoPinMask heldDown;
+    IoPinMask holdPlane[SWITCH_HOLD_PLANES];
+public:
+#ifdef IOA_INPUT_INSTRUMENTATION
+    // the switches that were changing but not yet debounced at the last sample, for latency instrumentation.
+    IoPinMask latencyEdges = 0;
+#endif
+    SwitchInputGroup() : startPin(0), firstKey(0), keyCount(0), pins(0), inversion(0), debounced(0), changing(0),
+                         heldDown(0), holdPlane{} {}
+    SwitchInputGroup(pinid_t start, bsize_t firstKeyIndex) : startPin(start), firstKey(firstKeyIndex), keyCount(0),
+                         pins(0), inversion(0), debounced(0), changing(0), heldDown(0), holdPlane{} {}
+
+    pinid_t getKey() const { return startPin; }
+    pinid_t getStartPin() const { return startPin; }
+    /** @return the index of the first key of this group in the key list */
+    bsize_t getFirstKey() const { return firstKey; }
+    uint8_t getKeyCount() const { return keyCount; }
+    IoPinMask getPins() const { return pins; }
+
+    /**
+     * Reads the switches of this group in one call and applies the inversion for pull up switches.
+     * @param device the device the switches are on
+     * @return the switches that are active, bit 0 is the start pin
+     */
+    IoPinMask readActive(IoAbstractionRef device) const { return (device->readPinMask(startPin, pins) ^ inversion) & pins; }
+    IoPinMask getPressed() const { return debounced; }
+    IoPinMask getHeld() const { return heldDown; }
+
+    /**
+     * Adds a switch to the group, the caller ensures it is within 32 pins of the start.
+     * @param pin the pin of the switch
+     * @param invert true if the pin reads LOW when pressed
+     * @param pressed the current state of the key, so that regrouping does not lose a press
+     * @param held if the key is currently held
+     */
+    void addPin(pinid_t pin, bool invert, bool pressed, bool held);
+
+    /**
+     * Takes a new sample of the group, a switch must read the same for two samples in a row to change state, and
+     * when pressed for more than HOLD_THRESHOLD samples it becomes held.
+     * @param active the active switches as returned by readActive
+     * @param pressedEdges set to the switches that became pressed
+     * @param releasedEdges set to the switches that were released
+     * @param heldEdges set to the switches that became held
+     * @return true if any switch is pressed or debouncing
+     */
+    bool sample(IoPinMask active, IoPinMask& pressedEdges, IoPinMask& releasedEdges, IoPinMask& heldEdges);
+};
+
+/**
+ * The debounce engines that can be used by switches, the regular engine runs the state machine in KeyboardItem for
+ * every switch, the vertical engine debounces each group of up to 32 switches with bitwise operations. Either way,
+ * each group is read with a single readPinMask call, see SwitchInputGroup. The vertical engine suits larger numbers
+ * of keys. In both, a press is reported after two equal samples, but with the vertical engine a release is also
+ * debounced over two samples. Both work with the same addSwitch, addSwitchListener and onRelease functions.
+ */
+enum SwitchDebounceEngine : uint8_t {
+    /** The state machine per key, the default */
+    SWITCH_DEBOUNCE_STATE_MACHINE,
+    /** The bitwise parallel vertical counter engine */
+    SWITCH_DEBOUNCE_VERTICAL
 };
 
 /**
@@ -195,6 +370,58 @@ public:
     virtual void encoderHasChanged(int newValue)=0;
 };
 
+/**
+ * For encoders with an acceleration profile, a gap between events longer than this many micros resets the velocity
+ * estimate, so that the next event starts from rest.
+ */
+#ifndef ENCODER_VELOCITY_IDLE_MICROS
+#define ENCODER_VELOCITY_IDLE_MICROS 250000UL
+#endif // ENCODER_VELOCITY_IDLE_MICROS
+
+/**
+ * A pluggable acceleration profile for encoders, it turns the running velocity estimate of an encoder into the number
+ * of steps that one event should move by. The same profile works for hardware encoders, up down buttons and the
+ * joystick encoder, and one profile can be shared by many encoders as it holds no state.
+ * @see QuadraticAccelerationProfile
+ */
+class EncoderAccelerationProfile {
+public:
+    virtual ~EncoderAccelerationProfile() = default;
+
+    /**
+     * Gives the steps that one event should move by at a given velocity.
+     * @param velocity the running estimate of the events per second
+     * @param maximumValue the maximum value of the encoder, so that the profile can scale with the range
+     * @return the number of steps that the event represents, at least 1
+     */
+    virtual uint16_t stepsForVelocity(uint16_t velocity, uint16_t maximumValue) const = 0;
+};
+
+/**
+ * An acceleration profile where the step grows with the square of the velocity above a threshold, scaled by the range
+ * of the encoder, so that large ranges can be crossed in a few quick turns while slow turns still give single steps.
+ * At most an eighth of the range is moved per event. Everything is integer maths.
+ */
+class QuadraticAccelerationProfile : public EncoderAccelerationProfile {
+private:
+    uint8_t minimumVelocity;
+    uint8_t scaleShift;
+public:
+    /**
+     * @param minVelocity at or below this many events per second, events are always a single step
+     * @param shift the amount the squared velocity times the range is shifted down by, lower accelerates harder
+     */
+    explicit QuadraticAccelerationProfile(uint8_t minVelocity = 4, uint8_t shift = 16) : minimumVelocity(minVelocity), scaleShift(shift) {}
+
+    uint16_t stepsForVelocity(uint16_t velocity, uint16_t maximumValue) const override {
+        if(velocity <= minimumVelocity) return 1;
+        uint32_t over = min(uint16_t(velocity - minimumVelocity), uint16_t(255));
+        uint32_t steps = 1 + ((over * over * maximumValue) >> scaleShift);
+        uint32_t limit = max(uint16_t(maximumValue >> 3U), uint16_t(1));
+        return (uint16_t)min(steps, limit);
+    }
+};
+
 /**
  * Rotary encoder is the base class of both the hardware rotary encoder and the up / down button version. 
  * It handles storing the current value, setting and managing the range of allowed values and calling
@@ -202,7 +429,7 @@ public:
  */
 class RotaryEncoder {
 protected:
-    enum EncoderFlagBits { LAST_SYNC_STATUS=0, WRAP_AROUND_MODE, OO_LISTENER_CALLBACK, LAST_ENCODER_DIRECTION_UP };
+    enum EncoderFlagBits { LAST_SYNC_STATUS=0, WRAP_AROUND_MODE, OO_LISTENER_CALLBACK, LAST_ENCODER_DIRECTION_UP, CALLBACK_PENDING };
 	uint16_t maximumValue;
 	uint16_t currentReading;
     uint8_t stepSize;
@@ -212,10 +439,30 @@ protected:
     } notify;
     uint8_t flags;
     EncoderUserIntention intent;
+    const EncoderAccelerationProfile* accelerationProfile;
+    unsigned long lastVelocityEvent;
+    uint16_t velocity;
+    // in queued delivery mode, the direction only changes that are waiting for delivery.
+    int16_t pendingDirection;
+#ifdef IOA_INPUT_INSTRUMENTATION
+    // the first change since the last callback, and the id it is recorded against.
+    unsigned long latencyEdgeMicros = 0;
+    pinid_t latencyId = 0;
+#endif
+
+    /** for latency instrumentation, notes when the first change since the last callback happened */
+    void markLatencyEdge(__attribute__((unused)) unsigned long when, __attribute__((unused)) pinid_t id) {
+#ifdef IOA_INPUT_INSTRUMENTATION
+        if(latencyEdgeMicros == 0) {
+            latencyEdgeMicros = when;
+            latencyId = id;
+        }
+#endif
+    }
 public:
 	explicit RotaryEncoder(EncoderCallbackFn callback);
     explicit RotaryEncoder(EncoderListener* listener);
-    virtual ~RotaryEncoder() {;}
+    virtual ~RotaryEncoder();
 
 	/**
 	 * Change the precision of the rotary encoder, setting the maximum allowable value and the current value. If you set the maximum value
@@ -253,13 +500,47 @@ public:
 	 * Change the value represented by the encoder by incVal. Normally called internally.
 	 * @param incVal the amount by which to change the encoder.
 	 */
-	void increment(int8_t incVal);
+	void increment(int incVal);
+
+    /**
+     * Sets an acceleration profile that is used in place of the built in acceleration of this encoder, calculated
+     * from a running estimate of the velocity that is updated on each event, see EncoderAccelerationProfile.
+     * @param profile the profile, which must outlive the encoder, or nullptr to go back to the built in acceleration
+     */
+    void setAccelerationProfile(const EncoderAccelerationProfile* profile) { accelerationProfile = profile; velocity = 0; }
+
+    /** @return true if an acceleration profile has been set */
+    bool hasAccelerationProfile() const { return accelerationProfile != nullptr; }
+
+    /** @return the running estimate of events per second, only kept while a profile is set */
+    uint16_t getVelocity() const { return velocity; }
+
+    /**
+     * Updates the velocity estimate with an event at the given time, and gives the steps that it is worth using the
+     * acceleration profile, times the step size. Normally called internally.
+     * @param when the time of the event in micros
+     * @return the amount to change the encoder by, always positive
+     */
+    int acceleratedAmount(unsigned long when);
 
 	/**
 	 * internal method not for external use..
 	 */
 	virtual void encoderChanged() {;}
 
+    /**
+     * internal method not for external use, called with each interrupt edge recorded for the encoder in the order they
+     * occurred. By default it just calls encoderChanged, which reads the current state of the pins.
+     * @param event the recorded interrupt edge
+     */
+    virtual void encoderChangedFromEvent(const IoInterruptEvent& event) { encoderChanged(); }
+
+    /**
+     * @param pin the pin to check
+     * @return true if the pin is used by this encoder, those that do not use pins return false.
+     */
+    virtual bool isEncoderPin(pinid_t pin) { return false; }
+
     /**
      * Used to get the last sync status of the underlying IoAbstraction. Useful when working
      * with devices over i2c to check if the comms worked.
@@ -277,13 +558,23 @@ public:
 
     EncoderUserIntention getUserIntention() { return intent; }
 
-    void runCallback(int newVal) {
-        if(bitRead(flags, OO_LISTENER_CALLBACK)) {
-            notify.encoderListener->encoderHasChanged(newVal);
-        } else {
-            notify.callback(newVal);
-        }
-    }
+    /**
+     * Notifies of a new value, in queued delivery mode this is deferred until the queue is delivered, and all the
+     * changes since the last delivery are combined into one notification.
+     * @param newVal the new value, or the direction in direction only mode
+     */
+    void runCallback(int newVal);
+
+    /**
+     * internal, delivers any notification that is pending from queued delivery mode.
+     */
+    void deliverPendingCallback();
+
+    /**
+     * internal, delivers a value that was captured when the change was queued from another core or thread.
+     * @param value the new value, or the combined direction in direction only mode
+     */
+    void deliverValue(int value);
 
     /**
      * @return the maximum value that this encoder can be set to.
@@ -341,10 +632,13 @@ public:
      */
     void setEncoderType(EncoderType et) { encoderType =  et; }
 
+    bool isEncoderPin(pinid_t pin) override { return pin == pinA || pin == pinB; }
+
 protected:
     void initialiseBase(pinid_t pinA, pinid_t pinB, HWAccelerationMode accelerationMode, EncoderType);
     int amountFromChange(unsigned long change);
-    void handleChangeRaw(bool increase);
+    void handleChangeRaw(bool increase) { handleChangeRaw(increase, micros()); }
+    void handleChangeRaw(bool increase, unsigned long timeNow);
 };
 
 /**
@@ -358,6 +652,9 @@ class HardwareRotaryEncoder : public AbstractHwRotaryEncoder {
 private:
 	uint8_t aLast;
 	uint8_t cleanFromB;
+    // the levels of the A and B pins as last read or recorded by an interrupt
+    uint8_t levelA;
+    uint8_t levelB;
 public:
     /**
      * Create an instance of a hardware rotary encoder specifying the A and B pin, the acceleration parameters and encoder type.
@@ -380,8 +677,16 @@ public:
      */
 	HardwareRotaryEncoder(pinid_t pinA, pinid_t pinB, EncoderListener* listener, HWAccelerationMode accelerationMode = HWACCEL_REGULAR, EncoderType = FULL_CYCLE);
 	void encoderChanged() override;
+
+    /**
+     * Processes a recorded edge using its level and timestamp where available, so that edges are handled in order
+     * even if several arrived before task manager ran. Falls back to reading the pins when the level is unknown.
+     * @param event the recorded interrupt edge
+     */
+    void encoderChangedFromEvent(const IoInterruptEvent& event) override;
 private:
     void initialise(pinid_t pinA, pinid_t pinB, HWAccelerationMode accelerationMode, EncoderType et);
+    void processLevels(uint8_t a, uint8_t b, unsigned long when);
 };
 
 /**
@@ -499,6 +804,8 @@ protected:
 #define SW_FLAG_INTERRUPT_DRIVEN 1
 #define SW_FLAG_INTERRUPT_DEBOUNCE 2
 #define SW_FLAG_ENCODER_IS_POLLING 3
+#define SW_FLAG_IDLE_BACKOFF 4
+#define SW_FLAG_EXTERNAL_POLL 5
 
 /**
  * An enumeration of values, one of which is used when calling switches.init to tell switches what to poll for, or
@@ -510,7 +817,30 @@ enum SwitchInterruptMode {
     /** Poll for keys but the rotary encoder is managed by interrupt */
     SWITCHES_POLL_KEYS_ONLY,
     /** Poll for everything, there are no interrupts defined in this mode. Halves the switch poll interval.  */
-    SWITCHES_POLL_EVERYTHING
+    SWITCHES_POLL_EVERYTHING,
+    /**
+     * Poll for keys every SWITCH_POLL_INTERVAL while any key is pressed or debouncing, backing off when idle up to
+     * SWITCH_IDLE_MAX_POLL_INTERVAL. The keys also have interrupts registered, so a key press wakes switches straight
+     * away, and the encoder is managed by interrupt. Suits battery powered devices where polling dominates idle current.
+     */
+    SWITCHES_POLL_KEYS_WITH_BACKOFF,
+    /**
+     * Poll for everything as SWITCHES_POLL_EVERYTHING does, but from code outside of task manager that calls
+     * switches.pollEverything, such as another core, see PicoCoreOneInput. Nothing is scheduled and no interrupts used.
+     */
+    SWITCHES_POLL_EXTERNALLY
+};
+
+/**
+ * A lock around the events that switches hands over to task manager, needed when the switches are read on another
+ * core or thread to the one running task manager, see SwitchInput::setCrossThreadDelivery. Both functions are called
+ * on either side, and the lock is only held while events are copied in or out of the queue.
+ */
+class SwitchEventQueueLock {
+public:
+    virtual ~SwitchEventQueueLock() = default;
+    virtual void lock() = 0;
+    virtual void unlock() = 0;
 };
 
 
@@ -529,9 +859,56 @@ class SwitchInput {
 private:
 	RotaryEncoder* encoder[MAX_ROTARY_ENCODERS];
 	IoAbstractionRef ioDevice;
+	// when set, groups are read from its delegate with its inversion folded into that of each group.
+	NegatingIoAbstraction* foldedInversion;
 	BtreeList<pinid_t, KeyboardItem> keys;
+    BtreeList<pinid_t, SwitchInputGroup> inputGroups;
 	volatile uint8_t swFlags;
     bool lastSyncStatus;
+    SwitchDebounceEngine debounceEngine;
+    bool groupsNeedRebuild;
+    // the scheduled poll and its current interval in SWITCHES_POLL_KEYS_WITH_BACKOFF mode.
+    taskid_t backoffTaskId;
+    uint16_t backoffInterval;
+    // key events and encoders with changes waiting to be delivered in queued delivery mode.
+    struct QueuedKeyEvent {
+        pinid_t pin;
+        uint8_t type;
+    };
+    QueuedKeyEvent keyEventQueue[SWITCH_EVENT_QUEUE_SIZE];
+    RotaryEncoder* pendingEncoders[SWITCH_EVENT_QUEUE_SIZE];
+    // the values of queued encoder changes, captured when queued, only used with cross thread delivery.
+    int pendingEncoderValues[SWITCH_EVENT_QUEUE_SIZE];
+    uint8_t keyEventCount;
+    uint8_t pendingEncoderCount;
+    bool queuedDelivery;
+    bool deliveryScheduled;
+    bool delivering;
+    // the encoders copied out of the queue while delivery is calling them, so that one removed meanwhile is skipped.
+    RotaryEncoder** deliveringEncoders;
+    uint8_t deliveringEncoderCount;
+    uint8_t pollEverythingCount;
+    uint16_t droppedEventCount;
+    SwitchEventQueueLock* crossThreadLock;
+    WakeDeadline wakeDeadline;
+#ifdef IOA_INPUT_INSTRUMENTATION
+    // the time of the current sample for latency instrumentation, and of any interrupt that the next one follows.
+    unsigned long latencySampleMicros = 0;
+    unsigned long latencyInterruptMicros = 0;
+#endif
+    // a bit for each pin from pinIndexStart that has a key, as keys are in pin order, the index of a key is the number
+    // of bits set before it. Only valid when the groups do not need rebuilding.
+    uint8_t* pinIndex;
+    pinid_t pinIndexStart;
+    uint16_t pinIndexSize;
+#ifdef SWITCHES_FIXED_CAPACITY
+    uint8_t pinIndexStore[SWITCH_PIN_INDEX_MAX_SPAN > 0 ? (SWITCH_PIN_INDEX_MAX_SPAN + 7) / 8 : 1];
+#endif
+    // while deferred, switches added one after another have their pin modes set together, relative to pendingModeStart.
+    pinid_t pendingModeStart;
+    IoPinMask pendingPullUpPins;
+    IoPinMask pendingInputPins;
+    bool pinModesDeferred;
 public:
 	/**
 	 * always use the global switches instance.
@@ -623,7 +1000,7 @@ public:
 	 * @see setupRotaryEncoderWithInterrupt
 	 * @see setupUpDownButtonEncoder
 	 */
-	void setEncoder(RotaryEncoder* encoder) { this->encoder[0] = encoder; };
+	void setEncoder(RotaryEncoder* encoder) { setEncoder(0, encoder); };
 
 	/**
 * Use this method if you want to work with serveral encoders. This lib defaults to 4 (value of MAX_ROTARY_ENCODERS)
@@ -703,6 +1080,12 @@ public:
 
 	bool isInterruptDriven() {return bitRead(swFlags, SW_FLAG_INTERRUPT_DRIVEN);}
 
+    /** @return true if polling backs off when the keys are idle, see SWITCHES_POLL_KEYS_WITH_BACKOFF */
+    bool isIdleBackoff() {return bitRead(swFlags, SW_FLAG_IDLE_BACKOFF);}
+
+    /** @return the interval in millis until the next poll when backing off, 0 when polling has stopped while idle */
+    uint16_t getBackoffInterval() const { return backoffInterval; }
+
     /** @return if interrupt debouncing is in progress */
 	bool isInterruptDebouncing() {return bitRead(swFlags, SW_FLAG_INTERRUPT_DEBOUNCE);}
 
@@ -737,11 +1120,159 @@ public:
      * @return true if removed, otherwise false.
      */
     bool removeSwitch(pinid_t pin) {
+        groupsNeedRebuild = true;
         return keys.removeByKey(pin);
     }
 
+    /**
+     * Choose the debounce engine that switches uses to process keys, see SwitchDebounceEngine. It can be changed at
+     * any time, the state of each switch is kept.
+     * @param engine the engine to use
+     */
+    void setDebounceEngine(SwitchDebounceEngine engine);
+
+    /** @return the debounce engine in use */
+    SwitchDebounceEngine getDebounceEngine() const { return debounceEngine; }
+
+    /**
+     * When the switches are on a NegatingIoAbstraction, call this with that same device to fold its inversion mask
+     * into the inversion that switches already applies per key, so that each group is read straight from the device
+     * it wraps with one XOR for both. Encoders and pin modes still go through the negating device. Call again after
+     * changing its inversion mask.
+     * @param device the negating device that switches was initialised with, or nullptr to stop folding
+     */
+    void foldInversionOf(NegatingIoAbstraction* device);
+
+    /**
+     * Turns on queued delivery, where instead of key callbacks, listeners and encoder callbacks being called as each
+     * change is found, the changes are queued and delivered together in one task manager callback shortly after. The
+     * changes of each encoder are combined, so that however many steps it moved, its callback is called once with the
+     * latest value, which suits expensive handlers such as a menu redraw.
+     * @param queued true to queue events, false to deliver them straight away
+     */
+    void setQueuedDelivery(bool queued);
+
+    /**
+     * For latency instrumentation, gives the time that changes seen in the current read of the switches are taken to
+     * have happened, which is the interrupt that caused the read when there is one, otherwise the time of the read.
+     * @return the time in micros, or 0 when IOA_INPUT_INSTRUMENTATION is not defined
+     */
+    unsigned long getLatencySampleMicros() const {
+#ifdef IOA_INPUT_INSTRUMENTATION
+        return latencySampleMicros;
+#else
+        return 0;
+#endif
+    }
+
+    /**
+     * Defers the pin mode of polled switches added from now on, so that a group added together is configured with one
+     * pinDirectionMask call per 32 pins, which is much quicker on ESP32 for example. The modes are applied when this
+     * is turned off again, or before the next read of the switches at the latest, so do not read the pins yourself in
+     * between. By default each switch is configured as it is added, and interrupt driven switches always are.
+     * @param defer true to defer the pin modes, false to apply any waiting and configure each switch as it is added
+     */
+    void deferPinModes(bool defer);
+
+    /** @return true if queued delivery is on */
+    bool isQueuedDelivery() const { return queuedDelivery; }
+
+    /**
+     * For when the switches are read on a core or thread other than the one running task manager. It turns on queued
+     * delivery with the queue protected by the lock, so callbacks and listeners are still called on task manager,
+     * and encoder values are captured as they are queued. When the queue is full events are dropped rather than
+     * delivered on the other core, see getDroppedEventCount. Set everything up before starting the other side, and
+     * only use the devices the switches are on from that side from then on.
+     * @param lock the lock around the queue, or nullptr to go back to delivering on the thread that reads them
+     */
+    void setCrossThreadDelivery(SwitchEventQueueLock* lock);
+
+    /** @return the number of events dropped because the queue was full during cross thread delivery */
+    uint16_t getDroppedEventCount() const { return droppedEventCount; }
+
+    /**
+     * Gives the next time switches needs to run on task manager, as reported to inputWakeSchedule. Polls in
+     * SWITCHES_POLL_KEYS_WITH_BACKOFF mode and the repeats while interrupt driven keys debounce are aligned to the
+     * shared tick, the fixed rate polling modes keep the phase they started with.
+     */
+    WakeDeadline& getWakeDeadline() { return wakeDeadline; }
+
+    /** @return true if switches was initialised with SWITCHES_POLL_EXTERNALLY */
+    bool isExternallyPolled() {return bitRead(swFlags, SW_FLAG_EXTERNAL_POLL);}
+
+    /**
+     * Carries out one poll as in SWITCHES_POLL_EVERYTHING, the encoders are read each call and the keys on every
+     * eighth, so call this every SWITCH_POLL_INTERVAL / 8 millis. Used by task manager in that mode, and by the code
+     * that polls switches in SWITCHES_POLL_EXTERNALLY mode.
+     */
+    void pollEverything();
+
+    /**
+     * Delivers every queued key event and encoder change now, normally done on task manager soon after they queue.
+     */
+    void deliverQueuedEvents();
+
+    /**
+     * Takes an encoder out of the queue of changes waiting to be delivered, so that delivery never calls an encoder
+     * that is no longer in use. It is called when an encoder is replaced by setEncoder, or destroyed.
+     * @param enc the encoder to remove
+     */
+    void removeQueuedEncoder(RotaryEncoder* enc);
+
+    /**
+     * internal, queues a key event for delivery.
+     * @param pin the key
+     * @param held if the key is held
+     * @param release true for a release, otherwise a press
+     * @return true if queued, false if it needs to be delivered straight away
+     */
+    bool queueKeyEvent(pinid_t pin, bool held, bool release);
+
+    /**
+     * internal, marks an encoder as having a change to deliver.
+     * @param encoder the encoder
+     * @return true if queued, false if it needs to be delivered straight away
+     */
+    bool queueEncoderChange(RotaryEncoder* encoder);
+
+    /**
+     * internal, queues an encoder value during cross thread delivery, combining it with any already queued.
+     * @param encoder the encoder
+     * @param value the new value, or the change of direction in direction only mode
+     * @param accumulate true if the value is a change to be added to any already queued
+     * @return true if handled, false when cross thread delivery is not on
+     */
+    bool queueEncoderValue(RotaryEncoder* encoder, int value, bool accumulate);
+
+    /**
+     * Pin modes for switches that are not interrupt driven are set in groups when switches next reads the pins, so
+     * that devices able to set many pins at once can do so. This applies any that are waiting straight away.
+     */
+    void applyPendingPinModes();
+
 private:
     bool internalAddSwitch(pinid_t pin, bool invertLogic);
+    void queuePinMode(pinid_t pin, bool pullUp);
+    void rebuildInputGroups();
+    void scheduleBackoffPoll(uint16_t interval);
+    void backoffPoll();
+    void wakeFromIdle();
+    void scheduleDelivery();
+    // events left queued when delivery could not be scheduled are scheduled again from runLoop.
+    void retryStalledDelivery();
+    void lockEventQueue() { if(crossThreadLock) crossThreadLock->lock(); }
+    void unlockEventQueue() { if(crossThreadLock) crossThreadLock->unlock(); }
+    bool runVerticalDebounce();
+    void notifyGroupEdges(pinid_t startPin, IoPinMask edges, void (KeyboardItem::*action)());
+    void rebuildPinIndex();
+    void releasePinIndex();
+    bool addKey(const KeyboardItem& item);
+    void addInputGroup(const SwitchInputGroup& group);
+    IoAbstractionRef groupReadDevice() const;
+    KeyboardItem* findKey(pinid_t pin);
+#ifdef IOA_INPUT_INSTRUMENTATION
+    void markGroupLatency(SwitchInputGroup* group, IoPinMask moving, IoPinMask debouncedEdges);
+#endif
 
 	friend void onSwitchesInterrupt(pinid_t);
 };
@@ -751,6 +1282,16 @@ private:
  */
 extern SwitchInput switches;
 
+#ifdef SWITCHES_FIXED_CAPACITY
+/**
+ * @return the RAM taken by switches with SWITCHES_FIXED_CAPACITY, including its key and group storage but not any
+ * encoders, for use in a static_assert or with IoaRamFootprint.
+ */
+constexpr size_t switchesRamFootprint() {
+    return sizeof(SwitchInput) + (MAX_KEYS * sizeof(KeyboardItem)) + (SWITCH_MAX_INPUT_GROUPS * sizeof(SwitchInputGroup));
+}
+#endif // SWITCHES_FIXED_CAPACITY
+
 /**
  * Initialise a hardware rotary encoder on the pins passed in, when the value changes the callback function
  * will be called. This library will set pinA and pinB to INPUT_PULLUP, and debounces internally. In most
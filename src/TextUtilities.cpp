@@ -52,6 +52,77 @@ void fastltoa(char* str, long val, uint8_t dp, char padChar, int len) {
     fastltoa_mv(str, val, dpToDivisor(dp), padChar, len);
 }
 
+// every pair of digits from 00 to 99, so that two digits are produced for each division by 100.
+static const char twoDigitTable[] PROGMEM =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+static inline void putTwoDigits(char* where, uint8_t value) {
+    where[0] = (char)pgm_read_byte_near(&twoDigitTable[value * 2]);
+    where[1] = (char)pgm_read_byte_near(&twoDigitTable[(value * 2) + 1]);
+}
+
+/**
+ * Writes the digits of a value backwards, ending just before end, and returns the number written. While the value is
+ * above 16 bits, four digits are taken per 32 bit division, the rest is done in 16 bit maths.
+ */
+static uint8_t digitsBackwards(char* end, unsigned long val) {
+    char* p = end;
+    while(val > 0xffffUL) {
+        unsigned long upper = val / 10000UL;
+        auto lower = uint16_t(val - (upper * 10000UL));
+        auto hundreds = uint8_t(lower / 100U);
+        putTwoDigits(p - 2, uint8_t(lower - (hundreds * 100U)));
+        putTwoDigits(p - 4, hundreds);
+        p -= 4;
+        val = upper;
+    }
+    auto small = uint16_t(val);
+    while(small >= 100U) {
+        auto upper = uint16_t(small / 100U);
+        putTwoDigits(p - 2, uint8_t(small - (upper * 100U)));
+        p -= 2;
+        small = upper;
+    }
+    if(small >= 10U) {
+        putTwoDigits(p - 2, uint8_t(small));
+        p -= 2;
+    } else {
+        *(--p) = char('0' + small);
+    }
+    return uint8_t(end - p);
+}
+
+/**
+ * Writes an unsigned value from position i, following exactly the rules of the original fastltoa_mv: the width is
+ * the number of zeros in the divisor, leading zeros are either padded or skipped, and once the limit is reached
+ * only the last digit is written.
+ */
+static int writeDigits(char* str, int i, unsigned long val, long divisor, char padChar, int limit) {
+    if(divisor > 0 && val >= (unsigned long)divisor) val %= (unsigned long)divisor;
+    int width = 1;
+    for(long d = divisor / 10; d > 9; d /= 10) width++;
+
+    char digits[21];
+    char* end = &digits[sizeof digits];
+    int count = digitsBackwards(end, val);
+    if(count > width) width = count;
+    int leading = width - count;
+    const char* start = end - width;
+
+    for(int j = 0; j < (width - 1) && i < limit; j++) {
+        if(j >= leading) {
+            str[i++] = start[j];
+        } else if(padChar != NOT_PADDED) {
+            str[i++] = padChar;
+        }
+    }
+    str[i++] = end[-1];
+    str[i] = (char)0;
+    return i;
+}
+
 void fastltoa_mv(char* str, long val, long divisor, char padChar, int len) {
     int i=0;
     len -=2;
@@ -61,24 +132,51 @@ void fastltoa_mv(char* str, long val, long divisor, char padChar, int len) {
         appendChar(str, '-', len);
     }
 
-    val %= divisor;
-    divisor /= 10;
-
     while(str[i] && i < len) ++i;
 
-    bool hadNonZeroChar = false;
-    bool zeroPad = padChar != 0;
+    writeDigits(str, i, (unsigned long)val, divisor, padChar, len);
+}
+
+int fastltoaAt(char* str, int pos, long val, long divisor, char padChar, int len) {
+    int limit = len - 2;
+    if(pos > limit) pos = limit;
+    if (val < 0) {
+        val = abs(val);
+        if(pos < limit) str[pos++] = '-';
+    }
+    return writeDigits(str, pos, (unsigned long)val, divisor, padChar, limit);
+}
 
-    while(divisor > 9 && i < len) {
-        str[i] = (char)((val / divisor) + '0');
-        hadNonZeroChar |= (str[i] != '0');
-        if(zeroPad && !hadNonZeroChar) str[i] = padChar;
-        if(zeroPad || hadNonZeroChar) ++i;
-        val %= divisor;
-        divisor /= 10;
+int fastDecimalToaAt(char* str, int pos, long value, uint8_t dp, int len) {
+    int limit = len - 2;
+    if(pos > limit) pos = limit;
+    unsigned long absolute = value < 0 ? (0UL - (unsigned long)value) : (unsigned long)value;
+    if(value < 0 && pos < limit) str[pos++] = '-';
+
+    auto divisor = (unsigned long)dpToDivisor(dp);
+    unsigned long whole = absolute / divisor;
+    pos = writeDigits(str, pos, whole, 1000000000L, NOT_PADDED, limit);
+    if(pos < limit) str[pos++] = '.';
+    return writeDigits(str, pos, absolute - (whole * divisor), long(divisor), '0', limit);
+}
+
+int fastftoaAt(char* str, int pos, float fl, int dp, int len) {
+    int limit = len - 2;
+    if(pos > limit) pos = limit;
+    if(fl < 0.0F) {
+        fl = fl * -1.0F;
+        if(pos < limit) str[pos++] = '-';
     }
-    str[i++] = '0' + (val % 10);
-    str[i] = (char)0;
+
+    // here we get the whole and fractonal parts, knowing its always positive, lastly, we
+    // multiply it up by decimal places to turn it into an int, then we can present it as "[-]whole.fraction"
+    auto whole = (int32_t)fl;
+    fl = fl - float(whole);
+    auto fraction = int32_t(fl * (float)dpToDivisor(dp));
+
+    pos = writeDigits(str, pos, (unsigned long)whole, 1000000000L, NOT_PADDED, limit);
+    if(pos < limit) str[pos++] = '.';
+    return writeDigits(str, pos, (unsigned long)fraction, dpToDivisor(dp), '0', limit);
 }
 
 void fastftoa(char* sz, float fl, int dp, int strSize) {
@@ -79,6 +79,47 @@ void fastltoa(char* str, long val, uint8_t dp, char padChar, int len);
  */
 void fastftoa(char* sz, float fl, int dp, int strSize);
 
+/**
+ * The same conversion as fastltoa_mv, with identical results, but written at a given position in the buffer instead
+ * of appending, so the string is not scanned for its end first. As each call returns the new position, several
+ * values can be built into one buffer without any rescanning. The digits are generated two at a time from a table,
+ * with at most one 32 bit division for every four digits, which is much faster on 8 bit parts.
+ *
+ * @param str the buffer to write to
+ * @param pos the position in the buffer to start at
+ * @param val the value to be converted
+ * @param divisor the power of 10 largest value (eg 10000, 1000000L etc)
+ * @param padChar the character to pad with (or NOT_PADDED which is 0)
+ * @param len the length of the buffer passed in, it will not be exceeded.
+ * @return the position of the terminator, where the next value can be written
+ */
+int fastltoaAt(char* str, int pos, long val, long divisor, char padChar, int len);
+
+/**
+ * The same conversion as fastftoa, with identical results, but written at a given position in the buffer instead of
+ * appending, see fastltoaAt.
+ * @param str the buffer to write to
+ * @param pos the position in the buffer to start at
+ * @param fl the float to convert
+ * @param dp the numer of decimal places (max 9)
+ * @param len the length of the buffer passed in, it will not be exceeded.
+ * @return the position of the terminator, where the next value can be written
+ */
+int fastftoaAt(char* str, int pos, float fl, int dp, int len);
+
+/**
+ * Converts a fixed point decimal value into text without any float maths, the value holds the given number of
+ * decimal places, for example 12345 with 2 decimal places is "123.45". The result is the same as for fastftoa with
+ * the equivalent float, but with no float rounding errors.
+ * @param str the buffer to write to
+ * @param pos the position in the buffer to start at
+ * @param value the value scaled up by 10 to the power of dp
+ * @param dp the number of decimal places in the value (max 9)
+ * @param len the length of the buffer passed in, it will not be exceeded.
+ * @return the position of the terminator, where the next value can be written
+ */
+int fastDecimalToaAt(char* str, int pos, long value, uint8_t dp, int len);
+
 /**
  * converts decimal places into a suitable divisor, eg: 2 -> 100, 4 -> 10000
  */
@@ -50,6 +50,60 @@ float ArduinoAnalogDevice::getCurrentFloat(pinid_t pin) {
     return float(analogRead(pin)) / maxValue;
 }
 
+#ifdef IOA_AVR_COMPARATOR_PIN
+
+static AnalogThresholdWatcher* volatile avrComparatorWatcher = nullptr;
+
+ISR(ANALOG_COMP_vect) {
+    // the interrupt stays off until the crossing has been processed, see rearmThresholdWatch.
+    ACSR &= ~_BV(ACIE);
+    // ACO is set when AIN0, the reference, is above AIN1, the watched pin.
+    auto watcher = avrComparatorWatcher;
+    if(watcher != nullptr) watcher->thresholdCrossed((ACSR & _BV(ACO)) == 0);
+}
+
+bool ArduinoAnalogDevice::startThresholdWatch(pinid_t pin, unsigned int thresholdCounts, AnalogThresholdWatcher* watcher) {
+    if(pin != IOA_AVR_COMPARATOR_ADC_PIN || avrComparatorWatcher != nullptr || comparatorReferenceCounts == 0xffff) return false;
+
+    // the comparator can only compare against the reference on AIN0, allow a count either side for rounding.
+    int difference = int(thresholdCounts) - int(comparatorReferenceCounts);
+    if(difference > 1 || difference < -1) {
+        serlogF2(SER_IOA_INFO, "Threshold is not the comparator reference ", thresholdCounts);
+        return false;
+    }
+
+    pinMode(IOA_AVR_COMPARATOR_PIN, INPUT);
+#ifdef IOA_AVR_COMPARATOR_REF_PIN
+    pinMode(IOA_AVR_COMPARATOR_REF_PIN, INPUT);
+#endif
+    // AIN1 as the negative input, digital input buffers off, toggle mode, and clear any pending interrupt.
+    ADCSRB &= ~_BV(ACME);
+    DIDR1 |= _BV(AIN0D) | _BV(AIN1D);
+    ACSR = _BV(ACI);
+    avrComparatorWatcher = watcher;
+    watcher->thresholdCrossed((ACSR & _BV(ACO)) == 0);
+    ACSR = _BV(ACI) | _BV(ACIE);
+    return true;
+}
+
+void ArduinoAnalogDevice::stopThresholdWatch(pinid_t pin) {
+    if(pin != IOA_AVR_COMPARATOR_ADC_PIN) return;
+    ACSR = _BV(ACD) | _BV(ACI);
+    DIDR1 &= ~(_BV(AIN0D) | _BV(AIN1D));
+    avrComparatorWatcher = nullptr;
+}
+
+void ArduinoAnalogDevice::rearmThresholdWatch(pinid_t pin) {
+    auto watcher = avrComparatorWatcher;
+    if(pin != IOA_AVR_COMPARATOR_ADC_PIN || watcher == nullptr || (ACSR & _BV(ACIE))) return;
+    // any crossing while the interrupt was off is caught up with by reporting the current state first.
+    ACSR = _BV(ACI);
+    watcher->thresholdCrossed((ACSR & _BV(ACO)) == 0);
+    ACSR = _BV(ACI) | _BV(ACIE);
+}
+
+#endif // IOA_AVR_COMPARATOR_PIN
+
 void ArduinoAnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
     pinMode(pin, (direction == DIR_IN) ? INPUT : OUTPUT);
 }
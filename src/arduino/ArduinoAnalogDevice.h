@@ -10,6 +10,31 @@
 
 #include "../AnalogDeviceAbstraction.h"
 
+// START user adjustable section
+
+// define this build flag, or uncomment the line below, to let AnalogInEvent use the AVR analog comparator. It takes
+// over the ANALOG_COMP interrupt vector, so only define it when nothing else uses the comparator.
+//#define IOA_AVR_ANALOG_COMPARATOR
+
+// the analog pin that AnalogInEvent is created on when watched by the comparator, the signal must be wired both to
+// this pin and to AIN1, as AIN1 is not an ADC channel. The event reads this pin whenever it is not watched.
+#ifndef IOA_AVR_COMPARATOR_ADC_PIN
+#define IOA_AVR_COMPARATOR_ADC_PIN A0
+#endif
+
+// END user adjustable section
+
+#if defined(IOA_AVR_ANALOG_COMPARATOR) && defined(__AVR__)
+# if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega168__)
+/** the digital pin that is AIN1, the comparator input that is watched */
+#  define IOA_AVR_COMPARATOR_PIN 7
+/** the digital pin that is AIN0, which must have the reference voltage */
+#  define IOA_AVR_COMPARATOR_REF_PIN 6
+# elif defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#  define IOA_AVR_COMPARATOR_PIN 5
+# endif
+#endif
+
 /**
  * Creates an analog device that uses the core Arduino analog capabilities of ADC for reading
  * values and PWM or the inbuilt DAC if available for writing values. Generally speaking one
@@ -20,6 +45,12 @@
  * as these abstract away the absolute ranges, to 0 being GND and 1 being maximum voltage.
  *
  * Get an instance by calling internalAnalogIO() rather than creating one
+ *
+ * On AVR with IOA_AVR_ANALOG_COMPARATOR defined, an AnalogInEvent on IOA_AVR_COMPARATOR_ADC_PIN can be watched by
+ * the analog comparator, see setComparatorReference. The comparator watches AIN1 (IOA_AVR_COMPARATOR_PIN), so the
+ * signal must be wired to both. It has no programmable threshold, it compares AIN1 with a reference voltage on AIN0,
+ * so the event's threshold must match the level of that reference. The interrupt is turned off on each crossing and
+ * only turned back on once the event has run, so a signal sitting at the reference cannot flood it.
  */
 class ArduinoAnalogDevice : public AnalogDevice {
 private:
@@ -27,6 +58,9 @@ private:
     uint8_t writeBitResolution;
     uint16_t readResolution;
     uint16_t writeResolution;
+#ifdef IOA_AVR_COMPARATOR_PIN
+    uint16_t comparatorReferenceCounts = 0xffff;
+#endif
 public:
     /**
 	 * Initialise the Arduino analog device with a given read and write bit resolution, on AVR and
@@ -52,6 +86,23 @@ public:
     unsigned int getCurrentValue(pinid_t pin) override { return analogRead(pin); }
 
     void setCurrentValue(pinid_t pin, unsigned int newVal) override { analogWrite(pin, newVal); }
+
+#ifdef IOA_AVR_COMPARATOR_PIN
+    /**
+     * Tells the device the level of the reference voltage wired to AIN0, as a fraction of the ADC reference, events
+     * on IOA_AVR_COMPARATOR_ADC_PIN with a threshold at this level can then be watched by the comparator.
+     * @param level the reference level between 0 and 1
+     */
+    void setComparatorReference(float level) {
+        comparatorReferenceCounts = analogFixedToCounts(analogFloatToFixed(level), readBitResolution);
+    }
+
+    bool startThresholdWatch(pinid_t pin, unsigned int thresholdCounts, AnalogThresholdWatcher* watcher) override;
+
+    void stopThresholdWatch(pinid_t pin) override;
+
+    void rearmThresholdWatch(pinid_t pin) override;
+#endif
 };
 
 ArduinoAnalogDevice& internalAnalogDevice();
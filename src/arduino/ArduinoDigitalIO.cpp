@@ -45,8 +45,91 @@ uint8_t BasicIoAbstraction::readPort(pinid_t port) {
 #endif
 }
 
-
 BasicIoAbstraction internalIoAbstraction;
+
+#ifdef __AVR__
+
+// applies all the changes for a single port with interrupts off, so that the read modify write cannot be interleaved
+// with an interrupt handler that also writes to the same port.
+static void avrApplyPortChanges(uint8_t port, uint8_t setBits, uint8_t clearBits) {
+    if(port == NOT_A_PORT || (setBits == 0 && clearBits == 0)) return;
+    volatile uint8_t* outReg = portOutputRegister(port);
+    uint8_t oldSREG = SREG;
+    cli();
+    *outReg = (*outReg & ~clearBits) | setBits;
+    SREG = oldSREG;
+}
+
+IoPinMask BasicIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    // only the device pins can go direct to the port registers, anything extending us must use its own readValue.
+    if(this != &internalIoAbstraction) return readPinMaskByPin(startPin, mask);
+
+    IoPinMask ret = 0;
+    uint8_t lastPort = NOT_A_PORT;
+    uint8_t portVal = 0;
+    for(uint8_t i = 0; mask != 0; i++, mask >>= 1U) {
+        if((mask & 1U) == 0) continue;
+        pinid_t pin = startPin + i;
+        uint8_t port = digitalPinToPort(pin);
+        if(port == NOT_A_PORT) continue;
+
+        // consecutive pins are usually on the same port, so each port register is only read once per change.
+        if(port != lastPort) {
+            portVal = *portInputRegister(port);
+            lastPort = port;
+        }
+        if(portVal & digitalPinToBitMask(pin)) ret |= (IoPinMask(1U) << i);
+    }
+    return ret;
+}
+
+void BasicIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(this != &internalIoAbstraction) {
+        writePinMaskByPin(startPin, mask, values);
+        return;
+    }
+
+    uint8_t lastPort = NOT_A_PORT;
+    uint8_t setBits = 0;
+    uint8_t clearBits = 0;
+    for(uint8_t i = 0; mask != 0; i++, mask >>= 1U, values >>= 1U) {
+        if((mask & 1U) == 0) continue;
+        pinid_t pin = startPin + i;
+        uint8_t port = digitalPinToPort(pin);
+        if(port == NOT_A_PORT) continue;
+
+        if(port != lastPort) {
+            avrApplyPortChanges(lastPort, setBits, clearBits);
+            lastPort = port;
+            setBits = clearBits = 0;
+        }
+        if(values & 1U) {
+            setBits |= digitalPinToBitMask(pin);
+        } else {
+            clearBits |= digitalPinToBitMask(pin);
+        }
+    }
+    avrApplyPortChanges(lastPort, setBits, clearBits);
+}
+
+#else
+
+IoPinMask BasicIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    // port layout is not consistent across the other Arduino cores, pin by pin is the only portable option.
+    return readPinMaskByPin(startPin, mask);
+}
+
+void BasicIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    writePinMaskByPin(startPin, mask, values);
+}
+
+#endif // __AVR__
+
+void BasicIoAbstraction::pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+    // the Arduino API only configures a single pin at a time.
+    pinDirectionMaskByPin(startPin, mask, mode);
+}
+
 IoAbstractionRef ioUsingArduino() {
     return &internalIoAbstraction;
 }
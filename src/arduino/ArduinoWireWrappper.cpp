@@ -6,6 +6,7 @@
 #include <TaskManagerIO.h>
 #include <IoLogging.h>
 #include "PlatformDeterminationWire.h"
+#include "I2cBusStatistics.h"
 
 SimpleSpinLock i2cLock;
 
@@ -25,23 +26,29 @@ void ioaWireSetSpeed(WireType wireType, long frequency) {
 }
 
 bool ioaWireRead(WireType pI2c, int addr, uint8_t* buffer, size_t len) {
+    IOA_I2C_STATS_START
+    bool ok = false;
     if(pI2c->requestFrom(uint8_t(addr), len)) {
         uint8_t idx = 0;
         while(pI2c->available() && idx < len) {
             buffer[idx] = pI2c->read();
             idx++;
         }
-        return idx == len;
+        ok = idx == len;
     }
-    return false;
+    IOA_I2C_STATS_RECORD(addr, len, ok, 0)
+    return ok;
 }
 
 bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
+    IOA_I2C_STATS_START
     bool firstTime = true;
     bool i2cReady = retriesAllowed == 0;
+    unsigned int retries = 0;
     while(retriesAllowed && !i2cReady) {
         if(!firstTime) {
             taskManager.yieldForMicros(50);
+            retries++;
         }
         firstTime = false;
         pI2c->beginTransmission(address);
@@ -51,6 +58,7 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
 
     if(!i2cReady) {
         serlogF(SER_ERROR, "I2C was not ready after retries, failing");
+        IOA_I2C_STATS_RECORD(address, len, false, retries)
         return false;
     }
 
@@ -58,7 +66,13 @@ bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, si
     pI2c->write(buffer, len);
     auto writeOk = pI2c->endTransmission(sendStop) == 0;
 
+    IOA_I2C_STATS_RECORD(address, len, writeOk, retries)
     return writeOk;
 }
 
+bool ioaWireReady(WireType pI2c, int address) {
+    pI2c->beginTransmission(address);
+    return pI2c->endTransmission() == 0;
+}
+
 #endif
@@ -12,6 +12,7 @@
 #if defined(IOA_USE_AVR_TWI_DIRECT) && defined(IOA_DEVELOPMENT_EXPERIMENTAL)
 #include <TaskManagerIO.h>
 #include <IoLogging.h>
+#include "I2cBusStatistics.h"
 
 #ifndef DEF_TWI_FREQ
 #define DEF_TWI_FREQ 100000UL
@@ -330,19 +331,32 @@ void ioaWireSetSpeed(WireType wireType, long frequency) {
 }
 
 bool ioaWireRead(WireType pI2c, int addr, uint8_t* buffer, size_t len) {
-    return IoaTwi.receiveData(addr, buffer, len);
+    IOA_I2C_STATS_START
+    bool ok = IoaTwi.receiveData(addr, buffer, len);
+    IOA_I2C_STATS_RECORD(addr, len, ok, 0)
+    return ok;
 }
 
 bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
+    IOA_I2C_STATS_START
     bool ready = retriesAllowed == 0;
+    unsigned int retries = 0;
     while(retriesAllowed != 0 && !ready) {
         ready = IoaTwi.isReady(retriesAllowed);
-        if(!ready) taskManager.yieldForMicros(50);
+        if(!ready) {
+            taskManager.yieldForMicros(50);
+            retries++;
+        }
         retriesAllowed--;
     }
-    if(!ready) return false;
+    if(!ready) {
+        IOA_I2C_STATS_RECORD(address, len, false, retries)
+        return false;
+    }
 
-    return IoaTwi.sendData(address, buffer, len, sendStop);
+    bool ok = IoaTwi.sendData(address, buffer, len, sendStop);
+    IOA_I2C_STATS_RECORD(address, len, ok, retries)
+    return ok;
 }
 
 #endif
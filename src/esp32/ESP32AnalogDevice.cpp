@@ -70,13 +70,20 @@ uint16_t EspAnalogInputMode::getCurrentReading() {
         dac_output_disable(pin == DAC1 ? DAC_CHANNEL_1 : DAC_CHANNEL_2);
     }
 #endif
+    // the attenuation is held per channel by the ADC, so it only needs setting when it changes.
     if(onAdc1) {
-        adc1_config_channel_atten(static_cast<adc1_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+        if(!attenuationApplied) {
+            adc1_config_channel_atten(static_cast<adc1_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+            attenuationApplied = true;
+        }
         return adc1_get_raw(static_cast<adc1_channel_t>(adcChannelNum));
     }
     else {
         int adcVal;
-        adc2_config_channel_atten(static_cast<adc2_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+        if(!attenuationApplied) {
+            adc2_config_channel_atten(static_cast<adc2_channel_t>(adcChannelNum), static_cast<adc_atten_t>(attenuation));
+            attenuationApplied = true;
+        }
         if(adc2_get_raw(static_cast<adc2_channel_t>(adcChannelNum), IOA_ESP_BIT_SELECTION, &adcVal) == ESP_OK) {
             lastCached = adcVal;
             return adcVal;
@@ -118,6 +125,22 @@ void EspAnalogOutputMode::write(unsigned int newVal) const {
 
 ESP32AnalogDevice::ESP32AnalogDevice() {
     adc1_config_width(IOA_ESP_BIT_SELECTION);
+    memset(inputSlots, IOA_ESP32_NO_SLOT, sizeof inputSlots);
+    memset(outputSlots, IOA_ESP32_NO_SLOT, sizeof outputSlots);
+}
+
+void ESP32AnalogDevice::rebuildSlots() {
+    // adding to a list can move the entries after it, so every position is taken again.
+    memset(inputSlots, IOA_ESP32_NO_SLOT, sizeof inputSlots);
+    memset(outputSlots, IOA_ESP32_NO_SLOT, sizeof outputSlots);
+    for(bsize_t i = 0; i < gpioToInputKey.count(); i++) {
+        pinid_t pin = gpioToInputKey.itemAtIndex(i)->getKey();
+        if(pin < IOA_ESP32_GPIO_COUNT) inputSlots[pin] = i;
+    }
+    for(bsize_t i = 0; i < gpioToPwmKey.count(); i++) {
+        pinid_t pin = gpioToPwmKey.itemAtIndex(i)->getKey();
+        if(pin < IOA_ESP32_GPIO_COUNT) outputSlots[pin] = i;
+    }
 }
 
 void ESP32AnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
@@ -128,6 +151,7 @@ void ESP32AnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
             gpioToPwmKey.add(outputMode);
             gpio = gpioToPwmKey.getByKey(pin);
             gpio->setPwmChannel(gpioToPwmKey.count());
+            rebuildSlots();
         }
         gpio->pinSetup();
     }
@@ -137,11 +161,26 @@ void ESP32AnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
             EspAnalogInputMode inputMode(pin);
             gpioToInputKey.add(inputMode);
             gpio = gpioToInputKey.getByKey(pin);
+            rebuildSlots();
         }
         gpio->pinSetup();
     }
 }
 
+void ESP32AnalogDevice::getCurrentValues(const pinid_t* pins, unsigned int* values, uint8_t count) {
+    for(uint8_t i = 0; i < count; i++) {
+        auto input = inputFor(pins[i]);
+        values[i] = input != nullptr ? input->getCurrentReading() : 0;
+    }
+}
+
+void ESP32AnalogDevice::getCurrentFloats(const pinid_t* pins, float* values, uint8_t count) {
+    for(uint8_t i = 0; i < count; i++) {
+        auto input = inputFor(pins[i]);
+        values[i] = input != nullptr ? float(input->getCurrentReading()) * (1.0F / float(IOA_ADC_MAX)) : 0.0F;
+    }
+}
+
 void ESP32AnalogDevice::setCurrentFloat(pinid_t pin, float value) {
     if(value < 0.0F) value = 0.0F;
     auto compVal = (int)(value * 255.0F);
@@ -150,6 +189,114 @@ void ESP32AnalogDevice::setCurrentFloat(pinid_t pin, float value) {
     serlogF3(SER_IOA_DEBUG, "Flt set ", value, compVal);
 }
 
+#ifdef IOA_ESP32_ADC_STREAMING
+
+#define ESP32_ADC_READ_CHUNK 64
+
+bool ESP32AnalogDevice::startStreaming(AnalogStream& stream) {
+    if(activeStream != nullptr) return false;
+
+    uint32_t channelMask = 0;
+    adc_digi_pattern_config_t pattern[ANALOG_STREAM_MAX_CHANNELS];
+    for(uint8_t i = 0; i < stream.getChannelCount(); i++) {
+        auto input = inputFor(stream.getChannelPin(i));
+        if(input == nullptr || !input->isOnDAC1()) {
+            serlogF2(SER_WARNING, "Stream needs ADC1 pin ", stream.getChannelPin(i));
+            return false;
+        }
+        streamChannels[i] = input->getChannel();
+        channelMask |= 1UL << input->getChannel();
+        pattern[i].atten = ADC_ATTEN_DB_11;
+        pattern[i].channel = input->getChannel();
+        pattern[i].unit = 0;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    // the driver buffer holds both blocks, so a late drain does not lose samples.
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = stream.getSamplesPerBlock() * SOC_ADC_DIGI_RESULT_BYTES * 2;
+    initConfig.conv_num_each_intr = ESP32_ADC_READ_CHUNK;
+    initConfig.adc1_chan_mask = channelMask;
+    initConfig.adc2_chan_mask = 0;
+    if(adc_digi_initialize(&initConfig) != ESP_OK) {
+        serlogF(SER_WARNING, "ADC digi init failed");
+        return false;
+    }
+
+    adc_digi_configuration_t config = {};
+    config.conv_limit_en = false;
+    config.conv_limit_num = 250;
+    config.pattern_num = stream.getChannelCount();
+    config.adc_pattern = pattern;
+    config.sample_freq_hz = stream.getSampleRate() * stream.getChannelCount();
+    config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+#if SOC_ADC_DIGI_RESULT_BYTES == 2
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+#else
+    config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+#endif
+    if(adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK) {
+        serlogF(SER_WARNING, "ADC digi start failed");
+        adc_digi_deinitialize();
+        return false;
+    }
+
+    activeStream = &stream;
+    streamFill = stream.getFillingBuffer();
+    streamPosition = 0;
+    stream.setServiceInterval(ESP32_ADC_STREAM_SERVICE_MICROS);
+    return true;
+}
+
+void ESP32AnalogDevice::stopStreaming(AnalogStream& stream) {
+    if(activeStream != &stream) return;
+    adc_digi_stop();
+    adc_digi_deinitialize();
+    activeStream = nullptr;
+    streamFill = nullptr;
+}
+
+void ESP32AnalogDevice::serviceStreaming(AnalogStream& stream) {
+    if(activeStream != &stream) return;
+    uint8_t raw[ESP32_ADC_READ_CHUNK * SOC_ADC_DIGI_RESULT_BYTES];
+    uint32_t length = 0;
+    uint8_t channels = stream.getChannelCount();
+    uint16_t blockSamples = stream.getSamplesPerBlock();
+
+    // read until the driver has nothing more, each result has its channel, which keeps the frames aligned even if
+    // the driver dropped samples when its buffer was full.
+    while(adc_digi_read_bytes(raw, sizeof raw, &length, 0) == ESP_OK && length != 0) {
+        for(uint32_t i = 0; i < length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+            auto result = reinterpret_cast<adc_digi_output_data_t*>(&raw[i]);
+#if SOC_ADC_DIGI_RESULT_BYTES == 2
+            uint8_t channel = result->type1.channel;
+            uint16_t value = result->type1.data;
+#else
+            if(result->type2.unit != 0) continue;
+            uint8_t channel = result->type2.channel;
+            uint16_t value = result->type2.data;
+#endif
+            uint8_t slot = streamPosition % channels;
+            if(streamChannels[slot] != channel) {
+                // out of step, skip to the start of the next frame
+                if(channel != streamChannels[0]) continue;
+                streamPosition = streamPosition - slot + (slot ? channels : 0);
+                if(streamPosition >= blockSamples) {
+                    streamFill = stream.blockComplete();
+                    streamPosition = 0;
+                }
+            }
+            streamFill[streamPosition++] = value;
+            if(streamPosition == blockSamples) {
+                streamFill = stream.blockComplete();
+                streamPosition = 0;
+            }
+        }
+    }
+}
+
+#endif // IOA_ESP32_ADC_STREAMING
+
 ESP32AnalogDevice esp32AnalogDevice;
 AnalogDevice* internalAnalogIo() {
     return &esp32AnalogDevice;
@@ -8,7 +8,21 @@
 
 #include <SimpleCollections.h>
 #include <AnalogDeviceAbstraction.h>
+#include <AnalogStream.h>
 #include <driver/adc.h>
+#include <esp_idf_version.h>
+
+// continuous sampling through the digital controller DMA is supported with the 4.4 driver, see startStreaming.
+#if ESP_IDF_VERSION_MAJOR == 4 && ESP_IDF_VERSION_MINOR >= 4
+#define IOA_ESP32_ADC_STREAMING
+#endif
+
+/**
+ * The interval in microseconds at which the driver buffer is drained into a stream while streaming in hardware.
+ */
+#ifndef ESP32_ADC_STREAM_SERVICE_MICROS
+#define ESP32_ADC_STREAM_SERVICE_MICROS 2000
+#endif
 
 // although in some environments a bit width default is available it's not everywhere
 #if defined(SOC_ADC_MAX_BITWIDTH) && SOC_ADC_MAX_BITWIDTH == 13
@@ -25,6 +39,18 @@
 #define ESP32_DAC1 25
 #define ESP32_DAC2 26
 
+/**
+ * The number of GPIO covered by the direct pin to slot table of ESP32AnalogDevice, pins beyond it are not analog.
+ */
+#ifndef IOA_ESP32_GPIO_COUNT
+# ifdef SOC_GPIO_PIN_COUNT
+#  define IOA_ESP32_GPIO_COUNT SOC_GPIO_PIN_COUNT
+# else
+#  define IOA_ESP32_GPIO_COUNT 40
+# endif
+#endif
+#define IOA_ESP32_NO_SLOT 0xff
+
 class EspAnalogOutputMode {
 private:
     pinid_t pin;
@@ -48,6 +74,7 @@ private:
     uint8_t adcChannelNum;
     pinid_t pin;
     uint8_t attenuation;
+    bool attenuationApplied = false;
     uint16_t lastCached = 0;
 public:
     pinid_t getKey() const { return pin; }
@@ -55,7 +82,10 @@ public:
     EspAnalogInputMode(const EspAnalogInputMode& other);
 
     void pinSetup();
-    void alterPinAttenuation(uint8_t atten) { attenuation = atten; }
+    void alterPinAttenuation(uint8_t atten) {
+        attenuation = atten;
+        attenuationApplied = false;
+    }
 
     bool isOnDAC1() const { return onAdc1;}
     uint8_t getChannel() const { return adcChannelNum;}
@@ -63,10 +93,24 @@ public:
     uint16_t getCurrentReading();
 };
 
+/**
+ * The internal analog device on ESP32 boards. With the 4.4 driver it supports hardware streaming, see AnalogStream,
+ * where the digital controller samples the channels by DMA into the driver buffer, which is drained into the stream
+ * on task manager. Only ADC1 channels can be streamed, and only one stream at a time.
+ */
 class ESP32AnalogDevice : public AnalogDevice {
 private:
     BtreeList<pinid_t,EspAnalogOutputMode> gpioToPwmKey;
     BtreeList<pinid_t,EspAnalogInputMode> gpioToInputKey;
+    // the position of each pin in the lists above, rebuilt by initPin, so that reads and writes need no search.
+    uint8_t inputSlots[IOA_ESP32_GPIO_COUNT];
+    uint8_t outputSlots[IOA_ESP32_GPIO_COUNT];
+#ifdef IOA_ESP32_ADC_STREAMING
+    AnalogStream* activeStream = nullptr;
+    uint16_t* streamFill = nullptr;
+    uint16_t streamPosition = 0;
+    uint8_t streamChannels[ANALOG_STREAM_MAX_CHANNELS] = {};
+#endif
 public:
     /**
 	 * Initialise the ESP32 device with a given read and write bit resolution, on AVR and
@@ -79,13 +123,12 @@ public:
     int getBitDepth(AnalogDirection direction, pinid_t /*pin*/) override { return (direction == DIR_OUT) ? 8 : IOA_ADC_BITS; }
 
 	unsigned int getCurrentValue(pinid_t pin) override {
-	    auto input = gpioToInputKey.getByKey(pin);
+	    auto input = inputFor(pin);
 	    return input != nullptr ? input->getCurrentReading() : 0;
 	}
 
 	float getCurrentFloat(pinid_t pin) override {
-        auto maxValue = (float)getMaximumRange(DIR_IN, pin);
-        return float(getCurrentValue(pin)) / maxValue;
+        return float(getCurrentValue(pin)) * (1.0F / float(IOA_ADC_MAX));
 	}
 
 	void setCurrentFloat(pinid_t pin, float value) override;
@@ -93,17 +136,30 @@ public:
     void initPin(pinid_t pin, AnalogDirection direction) override;
 
 	void setCurrentValue(pinid_t pin, unsigned int newVal) override {
-	    auto output = gpioToPwmKey.getByKey(pin);
+	    auto output = outputFor(pin);
 	    if(output != nullptr) output->write(newVal);
     }
 
+    /**
+     * Reads the pins in order.
+     */
+    void getCurrentValues(const pinid_t* pins, unsigned int* values, uint8_t count) override;
+
+    void getCurrentFloats(const pinid_t* pins, float* values, uint8_t count) override;
+
+#ifdef IOA_ESP32_ADC_STREAMING
+    bool startStreaming(AnalogStream& stream) override;
+    void stopStreaming(AnalogStream& stream) override;
+    void serviceStreaming(AnalogStream& stream) override;
+#endif
+
     /**
      * Allows you to get access to the extended led controller parameters if it is a PWM configured pin.
      * @param pin the pin to get the configuration for
      * @return either null if not set up, or an output object
      */
     EspAnalogOutputMode* getEspOutputMode(pinid_t pin) {
-	    return gpioToPwmKey.getByKey(pin);
+	    return outputFor(pin);
 	}
 
     /**
@@ -112,8 +168,20 @@ public:
      * @return either null if not set up, or an input object
      */
 	EspAnalogInputMode* getEspInputMode(pinid_t pin) {
-	    return gpioToInputKey.getByKey(pin);
+	    return inputFor(pin);
 	}
+private:
+    EspAnalogInputMode* inputFor(pinid_t pin) {
+        if(pin >= IOA_ESP32_GPIO_COUNT || inputSlots[pin] == IOA_ESP32_NO_SLOT) return nullptr;
+        return gpioToInputKey.itemAtIndex(inputSlots[pin]);
+    }
+
+    EspAnalogOutputMode* outputFor(pinid_t pin) {
+        if(pin >= IOA_ESP32_GPIO_COUNT || outputSlots[pin] == IOA_ESP32_NO_SLOT) return nullptr;
+        return gpioToPwmKey.itemAtIndex(outputSlots[pin]);
+    }
+
+    void rebuildSlots();
 };
 
 // for older code, mimic the name as ArduinoAnalogDevice so that code still compiles
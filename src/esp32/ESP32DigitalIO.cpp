@@ -9,6 +9,8 @@
 
 #if defined(IOA_USE_ARDUINO) && defined(ESP32) && defined(IOA_USE_ESP32_EXTRAS)
 
+#include <soc/gpio_reg.h>
+
 
 BasicIoAbstraction internalIoAbstraction;
 
@@ -23,23 +25,45 @@ gpio_mode_t toEsp32Mode(uint8_t mode) {
     else return GPIO_MODE_OUTPUT;
 }
 
-void BasicIoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
-    // pins 32 onwards are input only and do not have pull functions
-    if(pin >= 32 && (mode == INPUT_PULLDOWN || mode == INPUT_PULLUP)) {
-        mode = INPUT;
-    }
-
+// configures every pin in the 64 bit mask to the same mode with a single gpio_config call
+static void esp32ConfigurePins(uint64_t pinMask, uint8_t mode) {
     gpio_config_t config;
-    config.pin_bit_mask = uint64_t(1U) << uint64_t(pin);
+    config.pin_bit_mask = pinMask;
     config.mode = toEsp32Mode(mode);
     config.pull_up_en = (mode == INPUT_PULLUP) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
     config.pull_down_en = (mode == INPUT_PULLDOWN) ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
     config.intr_type = GPIO_INTR_DISABLE;
     if(ESP_OK != gpio_config(&config)) {
-        serlogF3(SER_ERROR, "ESP digital config error on ", pin, mode);
+        serlogF3(SER_ERROR, "ESP digital config error on ", (unsigned long)(pinMask & 0xffffffffUL), mode);
     }
 }
 
+void BasicIoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
+    // pins 32 onwards are input only and do not have pull functions
+    if(pin >= 32 && (mode == INPUT_PULLDOWN || mode == INPUT_PULLUP)) {
+        mode = INPUT;
+    }
+
+    esp32ConfigurePins(uint64_t(1U) << uint64_t(pin), mode);
+}
+
+void BasicIoAbstraction::pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+    if(this != &internalIoAbstraction) {
+        pinDirectionMaskByPin(startPin, mask, mode);
+        return;
+    }
+    if(startPin >= 64 || mask == 0) return;
+
+    uint64_t allPins = uint64_t(mask) << startPin;
+    if(mode == INPUT_PULLDOWN || mode == INPUT_PULLUP) {
+        // pins 32 onwards are input only and do not have pull functions, so they are configured as a separate group
+        uint64_t noPullPins = allPins & 0xffffffff00000000ULL;
+        allPins &= 0xffffffffULL;
+        if(noPullPins) esp32ConfigurePins(noPullPins, INPUT);
+    }
+    if(allPins) esp32ConfigurePins(allPins, mode);
+}
+
 void BasicIoAbstraction::writeValue(pinid_t pin, uint8_t value) {
     gpio_set_level(static_cast<gpio_num_t>(pin), value);
 }
@@ -83,4 +107,35 @@ uint8_t BasicIoAbstraction::readPort(pinid_t port) {
     return 0;
 }
 
+IoPinMask BasicIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    // only the device pins can go direct to the GPIO registers, anything extending us must use its own readValue.
+    if(this != &internalIoAbstraction) return readPinMaskByPin(startPin, mask);
+    if(startPin >= 64) return 0;
+
+    // read the input registers once, pins 0..31 are in the first register, and any higher pins in the second.
+    uint64_t allPins = REG_READ(GPIO_IN_REG);
+#ifdef GPIO_IN1_REG
+    allPins |= uint64_t(REG_READ(GPIO_IN1_REG)) << 32U;
+#endif
+    return IoPinMask(allPins >> startPin) & mask;
+}
+
+void BasicIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(this != &internalIoAbstraction) {
+        writePinMaskByPin(startPin, mask, values);
+        return;
+    }
+    if(startPin >= 64) return;
+
+    // the set and clear registers only change the bits that are written as 1, so no read modify write is needed.
+    uint64_t toSet = uint64_t(values & mask) << startPin;
+    uint64_t toClear = uint64_t(~values & mask) << startPin;
+    if(uint32_t(toSet)) REG_WRITE(GPIO_OUT_W1TS_REG, uint32_t(toSet));
+    if(uint32_t(toClear)) REG_WRITE(GPIO_OUT_W1TC_REG, uint32_t(toClear));
+#ifdef GPIO_OUT1_W1TS_REG
+    if(toSet >> 32U) REG_WRITE(GPIO_OUT1_W1TS_REG, uint32_t(toSet >> 32U));
+    if(toClear >> 32U) REG_WRITE(GPIO_OUT1_W1TC_REG, uint32_t(toClear >> 32U));
+#endif
+}
+
 #endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "ESP32InputTask.h"
+#include <IoLogging.h>
+
+#if defined(ESP32)
+
+ESP32InputTask esp32InputTask;
+
+bool ESP32InputTask::start(BaseType_t core, UBaseType_t priority, uint32_t intervalMillis) {
+    if(taskHandle != nullptr) return false;
+    if(!switches.isExternallyPolled()) {
+        serlogF(SER_WARNING, "Input task needs SWITCHES_POLL_EXTERNALLY");
+        return false;
+    }
+
+    pollMillis = intervalMillis;
+    stopRequested = false;
+    switches.setCrossThreadDelivery(this);
+    TaskHandle_t created = nullptr;
+    if(xTaskCreatePinnedToCore(taskEntry, "ioaInput", ESP32_INPUT_TASK_STACK, this, priority, &created, core) != pdPASS) {
+        serlogF(SER_ERROR, "Input task not created");
+        switches.setCrossThreadDelivery(nullptr);
+        return false;
+    }
+    taskHandle = created;
+    serlogF3(SER_IOA_INFO, "Input task started core, pri ", (int)core, (int)priority);
+    return true;
+}
+
+void ESP32InputTask::stop() {
+    if(taskHandle == nullptr) return;
+    stopRequested = true;
+    xTaskNotifyGive(taskHandle);
+    while(taskHandle != nullptr) {
+        vTaskDelay(1);
+    }
+
+    // anything the task queued is delivered before switches goes back to delivering on the thread that reads them.
+    switches.setCrossThreadDelivery(nullptr);
+}
+
+void ESP32InputTask::addWakePin(pinid_t pin) {
+    internalDigitalIo()->attachInterrupt(pin, wakeFromInterrupt, CHANGE);
+}
+
+void IRAM_ATTR ESP32InputTask::wakeFromInterrupt() {
+    TaskHandle_t handle = esp32InputTask.taskHandle;
+    if(handle == nullptr) return;
+    BaseType_t higherPriorityWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(handle, &higherPriorityWoken);
+    if(higherPriorityWoken) portYIELD_FROM_ISR();
+}
+
+void ESP32InputTask::taskEntry(void* param) {
+    reinterpret_cast<ESP32InputTask*>(param)->pollLoop();
+}
+
+void ESP32InputTask::pollLoop() {
+    InputPollCadence cadence(pdMS_TO_TICKS(pollMillis), xTaskGetTickCount());
+    while(!stopRequested) {
+        // the notification only ends the wait early, the polls stay at the interval from the last one.
+        uint32_t wait = cadence.waitBeforePoll(xTaskGetTickCount());
+        if(wait != 0 && ulTaskNotifyTake(pdTRUE, wait) != 0) {
+            // an interrupt on a wake pin, so the keys are read now rather than waiting for their turn.
+            if(!stopRequested) switches.runLoop();
+            continue;
+        }
+
+        cadence.pollMade(xTaskGetTickCount());
+        switches.pollEverything();
+    }
+    taskHandle = nullptr;
+    vTaskDelete(nullptr);
+}
+
+#endif // ESP32
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_ESP32_INPUT_TASK_H
+#define IOABSTRACTION_ESP32_INPUT_TASK_H
+
+/**
+ * @file ESP32InputTask.h
+ * @brief Runs the device sync, debounce and encoder decode of switches in a FreeRTOS task pinned to one core of the
+ * ESP32, with the callbacks still delivered on task manager.
+ */
+
+#include "../PlatformDetermination.h"
+
+/**
+ * The timing of the input task polls in ticks, kept apart from FreeRTOS so that it can be tested on any board. A wake
+ * from an interrupt only ends the wait early, the polls stay at the interval from the previous one, moving on by one
+ * interval each time as vTaskDelayUntil does, unless the task falls two intervals behind, when it starts again from now.
+ */
+class InputPollCadence {
+private:
+    uint32_t interval;
+    uint32_t lastPoll;
+public:
+    InputPollCadence(uint32_t intervalTicks, uint32_t now) : interval(intervalTicks != 0 ? intervalTicks : 1), lastPoll(now) {}
+
+    /**
+     * @param now the tick count now
+     * @return the ticks to wait before the next poll is due, or 0 when it is due now
+     */
+    uint32_t waitBeforePoll(uint32_t now) const {
+        uint32_t elapsed = now - lastPoll;
+        return (elapsed < interval) ? interval - elapsed : 0;
+    }
+
+    /**
+     * Records that the poll that was due has been made.
+     * @param now the tick count now
+     */
+    void pollMade(uint32_t now) {
+        lastPoll = ((now - lastPoll) >= interval * 2) ? now : lastPoll + interval;
+    }
+};
+
+#if defined(ESP32)
+
+#include "../SwitchInput.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// START user adjustable section
+
+/**
+ * The default FreeRTOS priority of the input task, the Arduino loop task runs at priority 1.
+ */
+#ifndef ESP32_INPUT_TASK_PRIORITY
+#define ESP32_INPUT_TASK_PRIORITY 3
+#endif
+
+/**
+ * The stack size of the input task in bytes, it needs to cover the device sync, including any I2C, and logging.
+ */
+#ifndef ESP32_INPUT_TASK_STACK
+#define ESP32_INPUT_TASK_STACK 4096
+#endif
+
+// END user adjustable section
+
+/**
+ * Moves switches into a FreeRTOS task of its own, pinned to a chosen core at a chosen priority, so that blocking I2C
+ * and analog reads elsewhere in the application, or heavy work on the other core, no longer delay reading the
+ * inputs. The task calls switches.pollEverything at a fixed interval, and sleeps on a task notification in between,
+ * so any pin registered with addWakePin wakes it straight away from its interrupt for an immediate read of the keys.
+ * Such a wake only reads the keys, the polls stay at the interval measured from the previous poll.
+ * Each event found is queued under a spin lock and task manager is given a task to deliver them, so every callback
+ * and listener is still called on task manager.
+ *
+ * To use it, initialise switches with SWITCHES_POLL_EXTERNALLY, add all the switches and encoders, then call start.
+ * From then on the device that the switches are on belongs to the input task, so it must not be used elsewhere, and
+ * the switches should not be changed without stopping first. Only one instance, esp32InputTask, can be used.
+ */
+class ESP32InputTask : public SwitchEventQueueLock {
+private:
+    portMUX_TYPE queueMux;
+    TaskHandle_t volatile taskHandle;
+    uint32_t pollMillis;
+    volatile bool stopRequested;
+public:
+    ESP32InputTask() : queueMux(portMUX_INITIALIZER_UNLOCKED), taskHandle(nullptr), pollMillis(1), stopRequested(false) {}
+
+    /**
+     * Creates the input task and starts polling.
+     * @param core the core to pin the task to, usually the core that the application is not using
+     * @param priority the FreeRTOS priority of the task
+     * @param intervalMillis the interval between polls, the keys are read every eighth poll
+     * @return true if started, false if already running, switches is not in SWITCHES_POLL_EXTERNALLY mode, or the
+     * task could not be created
+     */
+    bool start(BaseType_t core = 0, UBaseType_t priority = ESP32_INPUT_TASK_PRIORITY,
+               uint32_t intervalMillis = (SWITCH_POLL_INTERVAL / 8 > 0) ? SWITCH_POLL_INTERVAL / 8 : 1);
+
+    /** Stops the input task, waiting for the current poll to finish */
+    void stop();
+
+    /** @return true while the input task exists */
+    bool isRunning() const { return taskHandle != nullptr; }
+
+    /**
+     * Registers a change interrupt on a device pin, that wakes the input task with a task notification, so that a
+     * key press is read straight away instead of on the next poll. Only pins of internalDigitalIo() can be used.
+     * @param pin the device pin, usually a key or the interrupt output of an expander
+     */
+    void addWakePin(pinid_t pin);
+
+    void lock() override { portENTER_CRITICAL(&queueMux); }
+    void unlock() override { portEXIT_CRITICAL(&queueMux); }
+
+private:
+    static void taskEntry(void* param);
+    static void wakeFromInterrupt();
+    void pollLoop();
+};
+
+/**
+ * The instance that runs switches in its own task, see ESP32InputTask.
+ */
+extern ESP32InputTask esp32InputTask;
+
+#endif // ESP32
+#endif //IOABSTRACTION_ESP32_INPUT_TASK_H
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#include "ESP32PcntQuadratureCounter.h"
+#include <IoLogging.h>
+
+#ifdef IOA_ESP32_HAS_PCNT
+
+// the counter goes back to 0 on reaching either limit, so every value is the same modulo the limit.
+#define PCNT_QUAD_LIMIT 30000
+
+ESP32PcntQuadratureCounter::~ESP32PcntQuadratureCounter() {
+    if(started) pcnt_counter_pause(unit);
+}
+
+bool ESP32PcntQuadratureCounter::begin(pinid_t pinA, pinid_t pinB) {
+    if(started) return true;
+
+    // channel 0 counts the edges of A in the direction given by B, and channel 1 the edges of B the other way round,
+    // between them every edge of both signals is counted.
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pinA;
+    config.ctrl_gpio_num = pinB;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = unit;
+    config.pos_mode = PCNT_COUNT_DEC;
+    config.neg_mode = PCNT_COUNT_INC;
+    config.lctrl_mode = PCNT_MODE_REVERSE;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = PCNT_QUAD_LIMIT;
+    config.counter_l_lim = -PCNT_QUAD_LIMIT;
+    if(pcnt_unit_config(&config) != ESP_OK) return false;
+
+    config.pulse_gpio_num = pinB;
+    config.ctrl_gpio_num = pinA;
+    config.channel = PCNT_CHANNEL_1;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DEC;
+    if(pcnt_unit_config(&config) != ESP_OK) return false;
+
+    if(ESP32_PCNT_FILTER_CYCLES != 0) {
+        pcnt_set_filter_value(unit, ESP32_PCNT_FILTER_CYCLES);
+        pcnt_filter_enable(unit);
+    }
+
+    pcnt_counter_pause(unit);
+    pcnt_counter_clear(unit);
+    count = 0;
+    lastValue = 0;
+    pcnt_counter_resume(unit);
+    started = true;
+    serlogF2(SER_IOA_INFO, "PCNT quadrature started ", (int)unit);
+    return true;
+}
+
+int32_t ESP32PcntQuadratureCounter::readCount() {
+    if(!started) return count;
+    int16_t value;
+    if(pcnt_get_counter_value(unit, &value) != ESP_OK) return count;
+
+    // take the change as the shortest way round modulo the limit, which is right across a reset to 0.
+    int32_t delta = int32_t(value) - int32_t(lastValue);
+    if(delta > PCNT_QUAD_LIMIT / 2) delta -= PCNT_QUAD_LIMIT;
+    else if(delta < -(PCNT_QUAD_LIMIT / 2)) delta += PCNT_QUAD_LIMIT;
+    lastValue = value;
+    count += delta;
+    return count;
+}
+
+#endif // IOA_ESP32_HAS_PCNT
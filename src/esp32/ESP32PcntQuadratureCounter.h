@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_ESP32_PCNT_QUADRATURE_COUNTER_H
+#define IOABSTRACTION_ESP32_PCNT_QUADRATURE_COUNTER_H
+
+/**
+ * @file ESP32PcntQuadratureCounter.h
+ * @brief Counts the edges of a rotary encoder with a PCNT pulse counter unit on the ESP32.
+ */
+
+#include "../PlatformDetermination.h"
+
+// the C2 and C3 have no pulse counter.
+#if defined(ESP32) && !defined(CONFIG_IDF_TARGET_ESP32C3) && !defined(CONFIG_IDF_TARGET_ESP32C2)
+#define IOA_ESP32_HAS_PCNT
+
+#include "../QuadratureCounterEncoder.h"
+#include <driver/pcnt.h>
+
+// START user adjustable section
+
+/**
+ * The glitch filter applied to the encoder signals, in APB clock cycles of 12.5ns, pulses shorter than this are
+ * ignored, 0 turns the filter off. The maximum is 1023.
+ */
+#ifndef ESP32_PCNT_FILTER_CYCLES
+#define ESP32_PCNT_FILTER_CYCLES 1000
+#endif
+
+// END user adjustable section
+
+/**
+ * A QuadratureCounter using one of the PCNT units of the ESP32, with its two channels set up to count every edge of
+ * both signals. The hardware counter is only 16 bits and goes back to 0 at its limits, so each read adds the change
+ * since the last read to a wider count, which needs no interrupt as long as it is read before it moves by half its
+ * range, at the default poll rate that is over a million counts per second.
+ */
+class ESP32PcntQuadratureCounter : public QuadratureCounter {
+private:
+    pcnt_unit_t unit;
+    int32_t count;
+    int16_t lastValue;
+    bool started;
+public:
+    /**
+     * @param unit the PCNT unit to use, each encoder needs its own
+     */
+    explicit ESP32PcntQuadratureCounter(pcnt_unit_t unit = PCNT_UNIT_0) : unit(unit), count(0), lastValue(0), started(false) {}
+    ~ESP32PcntQuadratureCounter() override;
+
+    bool begin(pinid_t pinA, pinid_t pinB) override;
+    int32_t readCount() override;
+};
+
+#endif // IOA_ESP32_HAS_PCNT
+#endif //IOABSTRACTION_ESP32_PCNT_QUADRATURE_COUNTER_H
@@ -26,6 +26,21 @@
 #define DEFAULT_TOUCHKEY_FILTER_FREQ 10
 #endif
 
+/**
+ * In batched mode, how far in percent a pad must move from its baseline to count as touched, when calibrating.
+ */
+#ifndef DEFAULT_TOUCHKEY_THRESHOLD_PERCENT
+#define DEFAULT_TOUCHKEY_THRESHOLD_PERCENT 20
+#endif
+
+/**
+ * In batched mode, how slowly the baseline of an untouched pad follows its reading, each refresh moves it by
+ * 1/2^shift of the difference, so larger values adapt more slowly.
+ */
+#ifndef TOUCHKEY_BASELINE_SHIFT
+#define TOUCHKEY_BASELINE_SHIFT 4
+#endif
+
 // forward reference to interrupt handler.
 void esp32TouchKeyInterruptHandler(void* touchAbsAsVoid);
 extern volatile int espTouchIntCount;
@@ -43,6 +58,67 @@ private:
     bool allOk;
     bool interruptCodeNeeded;
     bool startedUp;
+    // batched mode state, the pads set up by pinDirection and the snapshot of them taken by runLoop.
+    bool batchedReads = false;
+    uint8_t thresholdPercent = 0;
+    uint32_t configuredPads = 0;
+    uint32_t touchedPads = 0;
+    volatile uint32_t latchedPads = 0;
+    portMUX_TYPE latchLock = portMUX_INITIALIZER_UNLOCKED;
+    uint16_t filtered[TOUCH_PAD_MAX] = {};
+    uint16_t baseline[TOUCH_PAD_MAX] = {};
+    uint16_t thresholds[TOUCH_PAD_MAX] = {};
+
+    static void latchedTouchInterrupt(void* touchAbsAsVoid) {
+        auto touchAbs = reinterpret_cast<ESP32TouchKeysAbstraction*>(touchAbsAsVoid);
+        uint32_t status = touch_pad_get_status();
+        touch_pad_clear_status();
+        portENTER_CRITICAL_ISR(&touchAbs->latchLock);
+        touchAbs->latchedPads |= status;
+        portEXIT_CRITICAL_ISR(&touchAbs->latchLock);
+        espTouchIntCount++;
+        TaskManager::markInterrupted(0);
+    }
+
+    bool isTouchedReading(uint16_t val, uint16_t threshold) const {
+        return (triggerMode == TOUCH_TRIGGER_ABOVE) ? val > threshold : val < threshold;
+    }
+
+    uint16_t calibratePad(int pad, uint16_t val) {
+        if(baseline[pad] == 0) baseline[pad] = val;
+        int32_t diff = int32_t(val) - int32_t(baseline[pad]);
+        bool touched = isTouchedReading(val, thresholds[pad] ? thresholds[pad] : pinThreshold);
+        // only an untouched pad moves the baseline, otherwise a long touch would slowly become the new baseline.
+        if(!touched) baseline[pad] = uint16_t(int32_t(baseline[pad]) + (diff / (1 << TOUCHKEY_BASELINE_SHIFT)));
+        uint32_t offset = (uint32_t(baseline[pad]) * thresholdPercent) / 100U;
+        return (triggerMode == TOUCH_TRIGGER_ABOVE) ? uint16_t(baseline[pad] + offset) : uint16_t(baseline[pad] - offset);
+    }
+
+    void refreshAllPads() {
+        uint32_t touched = 0;
+        for(int pad = 0; pad < TOUCH_PAD_MAX; pad++) {
+            if(!bitRead(configuredPads, pad)) continue;
+            uint16_t val;
+            if(touch_pad_read_filtered((touch_pad_t)pad, &val) != ESP_OK) continue;
+            filtered[pad] = val;
+            if(thresholdPercent != 0) {
+                uint16_t newThreshold = calibratePad(pad, val);
+                if(newThreshold != thresholds[pad]) {
+                    // keep the interrupt in step with the calibrated threshold, only when it changes.
+                    thresholds[pad] = newThreshold;
+                    touch_pad_set_thresh((touch_pad_t)pad, newThreshold);
+                }
+            }
+            if(isTouchedReading(val, thresholds[pad] ? thresholds[pad] : pinThreshold)) touched |= (1UL << pad);
+        }
+
+        // a touch seen by the interrupt since the last refresh counts even if it has gone, so short taps are not lost.
+        portENTER_CRITICAL(&latchLock);
+        touched |= latchedPads & configuredPads;
+        latchedPads = 0;
+        portEXIT_CRITICAL(&latchLock);
+        touchedPads = touched;
+    }
 public:
     /**
      * Create an instance of the touch abstraction configuring the IDF touch sensor with the settings you need. Most
@@ -79,7 +155,7 @@ public:
 
         if(interruptCodeNeeded) {
             interruptCodeNeeded = false;
-            touch_pad_isr_register(esp32TouchKeyInterruptHandler, this);
+            touch_pad_isr_register(batchedReads ? latchedTouchInterrupt : esp32TouchKeyInterruptHandler, this);
             allOk = touch_pad_intr_enable() == ESP_OK;
             serlogF2(SER_IOA_INFO, "Enabled interrupts for touch sensor ok=", allOk);
         }
@@ -101,6 +177,35 @@ public:
         triggerMode = theMode;
     }
 
+    /**
+     * Turns on batched reads, where runLoop reads every configured pad once and readValue, readPort and readPinMask
+     * then all answer from that snapshot instead of each querying the driver. In interrupt mode, the interrupt also
+     * latches which pads were touched, so that a touch shorter than the poll interval is still seen. Must be called
+     * before ensureInterruptRegistered.
+     * @param batched true to turn on batched reads
+     * @param calibratePercent when not 0, each pad keeps a baseline of its untouched reading and is touched once it
+     *          moves this many percent from it, in place of the fixed threshold. When 0, the fixed threshold is used.
+     */
+    void setBatchedReads(bool batched, uint8_t calibratePercent = DEFAULT_TOUCHKEY_THRESHOLD_PERCENT) {
+        batchedReads = batched;
+        thresholdPercent = calibratePercent;
+    }
+
+    /**
+     * @param pad the touch pad number
+     * @return in batched mode the last filtered reading of the pad taken by runLoop
+     */
+    uint16_t getFilteredValue(pinid_t pad) const { return pad < TOUCH_PAD_MAX ? filtered[pad] : 0; }
+
+    /**
+     * @param pad the touch pad number
+     * @return in batched mode with calibration, the current baseline of the pad
+     */
+    uint16_t getBaseline(pinid_t pad) const { return pad < TOUCH_PAD_MAX ? baseline[pad] : 0; }
+
+    /** @return in batched mode the pads that were touched at the last refresh, one bit per pad */
+    uint32_t getTouchedPads() const { return touchedPads; }
+
     /**
      * Sets the direction, but direction is always input for this abstraction. Must still be called to initialise the
      * touch interface for that pin.
@@ -112,6 +217,7 @@ public:
         serlogF2(SER_IOA_INFO, "Pin Direction ", pin);
         touch_pad_config((touch_pad_t) pin, pinThreshold);
         touch_pad_set_trigger_mode(triggerMode);
+        if(pin < TOUCH_PAD_MAX) bitSet(configuredPads, pin);
     }
 
     uint8_t readValue(pinid_t pin) override {
@@ -122,6 +228,9 @@ public:
 
         ensureInterruptRegistered();
 
+        // touched always reads as LOW, IE it works as a pull up switch.
+        if(batchedReads) return !bitRead(touchedPads, pin);
+
         uint16_t val;
         touch_pad_read_filtered((touch_pad_t)pin, &val);
 #ifdef TOUCH_DEBUG_MODE
@@ -141,15 +250,35 @@ public:
     }
 
     bool runLoop() override {
+        if(allOk && batchedReads) {
+            ensureInterruptRegistered();
+            refreshAllPads();
+        }
         return allOk;
     }
 
+    /**
+     * In batched mode, reads the 8 pads in the port that holds pin from the snapshot, touched pads read LOW.
+     */
+    uint8_t readPort(pinid_t pin) override {
+        if(!batchedReads) return 0;
+        return uint8_t(~touchedPads >> (pin & ~7U));
+    }
+
+    /**
+     * In batched mode, reads the requested pads from the snapshot, touched pads read as 0.
+     */
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override {
+        if(!batchedReads) return BasicIoAbstraction::readPinMask(startPin, mask);
+        if(startPin >= 32) return mask;
+        return IoPinMask(~touchedPads >> startPin) & mask;
+    }
+
     //
     // Unimplemented functions
     //
     void writePort(pinid_t pin, uint8_t portVal) override { }
     void writeValue(pinid_t pin, uint8_t value) override { }
-    uint8_t readPort(pinid_t pin) override { return 0; }
 };
 
 #endif //IOABSTRACTION_ESP32TOUCHKEYSABSTRACTION_H
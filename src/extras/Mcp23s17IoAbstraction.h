@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_MCP23S17IOABSTRACTION_H
+#define IOABSTRACTION_MCP23S17IOABSTRACTION_H
+
+#include "../PlatformDetermination.h"
+#include "../IoAbstraction.h"
+#include "../IoAbstractionWire.h"
+#include "SPIHelper.h"
+
+/**
+ * @file Mcp23s17IoAbstraction.h
+ * @brief An IoAbstraction for the MCP23S17, the SPI version of the MCP23017, which runs at up to 10MHz and is therefore
+ * much faster to sync than the I2C device.
+ *
+ * This class is in the extras package, it means it is not part of the core of IoAbstraction.
+ */
+
+// register addresses in the default IOCON.BANK=0 layout, where the A and B registers of each pair are adjacent.
+#define MCP23S17_IODIR      0x00
+#define MCP23S17_IPOL       0x02
+#define MCP23S17_GPINTEN    0x04
+#define MCP23S17_DEFVAL     0x06
+#define MCP23S17_INTCON     0x08
+#define MCP23S17_IOCON      0x0a
+#define MCP23S17_GPPU       0x0c
+#define MCP23S17_GPIO       0x12
+#define MCP23S17_OLAT       0x14
+
+#define MCP23S17_IOCON_HAEN_BIT   3
+#define MCP23S17_IOCON_MIRROR_BIT 6
+#define MCP23S17_IOCON_INT_MASK   0x06
+
+// the opcode is 0100 A2 A1 A0 R/W, where R/W is 1 for read.
+#define MCP23S17_OPCODE_WRITE 0x40
+#define MCP23S17_OPCODE_READ  0x41
+
+/**
+ * An implementation of BasicIoAbstraction for the MCP23S17 SPI IO expander, it supports the same pin modes and
+ * interrupt modes as MCP23017IoAbstraction, and pins 0..15 are GPA0..GPB7. Each register transfer is a single SPI
+ * transaction that covers both ports using sequential addressing, so a sync is at most one write of both output
+ * latches and one read of both GPIO ports.
+ *
+ * Up to eight devices can share one chip select by giving each a different hardware address, set by the A0..A2 pins.
+ * Hardware addressing is turned on when each device is first initialised. Until then every device on the chip select
+ * accepts writes, so each one is configured at its own address straight after.
+ */
+class Mcp23s17IoAbstraction : public Standard16BitDevice {
+private:
+    SPIWithSettings& spiBus;
+    uint8_t hwAddress;
+    pinid_t intPinA;
+    pinid_t intPinB;
+    uint8_t intMode;
+    uint8_t buffer[4];
+public:
+    /**
+     * Create an MCP23S17 device, normally use the ioFrom23s17 helper instead.
+     * @param spi the SPI bus and chip select the device is on
+     * @param hwAddr the hardware address between 0 and 7, as set by the A0..A2 pins
+     * @param mode the interrupt mode, or NOT_ENABLED
+     * @param interruptPinA the board pin that INTA is connected to, or IO_PIN_NOT_DEFINED
+     * @param interruptPinB the board pin that INTB is connected to, or IO_PIN_NOT_DEFINED for INTA to cover both ports
+     */
+    explicit Mcp23s17IoAbstraction(SPIWithSettings& spi, uint8_t hwAddr = 0, Mcp23xInterruptMode mode = NOT_ENABLED,
+                                   pinid_t interruptPinA = IO_PIN_NOT_DEFINED, pinid_t interruptPinB = IO_PIN_NOT_DEFINED)
+            : Standard16BitDevice(), spiBus(spi), hwAddress(hwAddr & 0x07), intPinA(interruptPinA),
+              intPinB(interruptPinB), intMode(mode), buffer{} { }
+
+    ~Mcp23s17IoAbstraction() override = default;
+
+    /**
+     * Sets the pin direction similar to pinMode, this device supports INPUT_PULLUP, INPUT and OUTPUT.
+     * @param pin the pin to set direction for on this device
+     * @param mode the mode such as INPUT, INPUT_PULLUP, OUTPUT
+     */
+    void pinDirection(pinid_t pin, uint8_t mode) override {
+        if(isInitNeeded()) initDevice();
+
+        toggleBitInRegister(MCP23S17_IODIR, pin, (mode == INPUT || mode == INPUT_PULLUP));
+        toggleBitInRegister(MCP23S17_GPPU, pin, mode == INPUT_PULLUP);
+
+        setReadPort((pin < 8) ? 0 : 1);
+    }
+
+    /**
+     * Attaches an interrupt to the device and links it to the board pin, the same modes as MCP23017IoAbstraction
+     * are supported, CHANGE, RISING and FALLING, selectable by pin.
+     */
+    void attachInterrupt(pinid_t pin, RawIntHandler intHandler, uint8_t mode) override {
+        if(intPinA == IO_PIN_NOT_DEFINED) return;
+        if(isInitNeeded()) initDevice();
+
+        uint8_t pm = (intMode == ACTIVE_HIGH_OPEN || intMode == ACTIVE_LOW_OPEN) ? INPUT_PULLUP : INPUT;
+        uint8_t im = (intMode == ACTIVE_HIGH || intMode == ACTIVE_HIGH_OPEN) ? RISING : FALLING;
+        internalDigitalDevice().pinMode(intPinA, pm);
+        internalDigitalDevice().attachInterrupt(intPinA, intHandler, im);
+        if(intPinB != IO_PIN_NOT_DEFINED) {
+            internalDigitalDevice().pinMode(intPinB, pm);
+            internalDigitalDevice().attachInterrupt(intPinB, intHandler, im);
+        }
+
+        toggleBitInRegister(MCP23S17_GPINTEN, pin, true);
+        toggleBitInRegister(MCP23S17_INTCON, pin, mode != CHANGE);
+        toggleBitInRegister(MCP23S17_DEFVAL, pin, mode == FALLING);
+    }
+
+    /**
+     * Inverts the meaning of an input pin, as MCP23017IoAbstraction::setInvertInputPin.
+     * @param pin the input pin between 0..15
+     * @param shouldInvert true to invert the given pin, otherwise false.
+     */
+    void setInvertInputPin(pinid_t pin, bool shouldInvert) {
+        if(isInitNeeded()) initDevice();
+        toggleBitInRegister(MCP23S17_IPOL, pin, shouldInvert);
+    }
+
+    /**
+     * Writes both output latches if either port has changed, then reads both GPIO ports if any pin is an input.
+     * @return true if the transfers succeeded
+     */
+    bool runLoop() override {
+        if(isInitNeeded()) initDevice();
+
+        bool ok = true;
+        if(isWritePortSet(0) || isWritePortSet(1)) {
+            ok = writeReg16(MCP23S17_OLAT, toWrite);
+        }
+        clearChangeFlags();
+
+        if(isReadPortSet(0) || isReadPortSet(1)) {
+            uint16_t value;
+            if(readReg16(MCP23S17_GPIO, value)) lastRead = value;
+            else ok = false;
+        }
+        return ok;
+    }
+
+    /**
+     * Reads a pair of registers in one transfer, the A register first.
+     * @param reg the A register of the pair
+     * @param value the A register in the low byte and B register in the high byte
+     * @return the result of the SPI transfer
+     */
+    bool readReg16(uint8_t reg, uint16_t& value) {
+        buffer[0] = MCP23S17_OPCODE_READ | (hwAddress << 1U);
+        buffer[1] = reg;
+        buffer[2] = buffer[3] = 0;
+        bool ok = transfer(buffer, 4);
+        value = buffer[2] | ((uint16_t)buffer[3] << 8U);
+        return ok;
+    }
+
+    /**
+     * Writes a pair of registers in one transfer, the A register first.
+     * @param reg the A register of the pair
+     * @param value the A register in the low byte and B register in the high byte
+     * @return the result of the SPI transfer
+     */
+    bool writeReg16(uint8_t reg, uint16_t value) {
+        buffer[0] = MCP23S17_OPCODE_WRITE | (hwAddress << 1U);
+        buffer[1] = reg;
+        buffer[2] = (uint8_t)value;
+        buffer[3] = (uint8_t)(value >> 8U);
+        return transfer(buffer, 4);
+    }
+
+protected:
+    /**
+     * Carries out one SPI transaction on the device, every register access goes through here, so a test can stand
+     * in for the bus by overriding it.
+     * @param data the bytes to send, replaced by the bytes received
+     * @param len the number of bytes
+     * @return the result of the SPI transfer
+     */
+    virtual bool transfer(uint8_t* data, size_t len) { return spiBus.transferSPI(data, len); }
+
+private:
+    void initDevice() override {
+        spiBus.init();
+
+        // written without reading first, as before hardware addressing is on every device on the chip select answers.
+        uint8_t controlReg = (1U << MCP23S17_IOCON_HAEN_BIT) | (intMode & MCP23S17_IOCON_INT_MASK);
+        if(intPinA != IO_PIN_NOT_DEFINED && intPinB == IO_PIN_NOT_DEFINED) {
+            bitSet(controlReg, MCP23S17_IOCON_MIRROR_BIT);
+        }
+        writeReg16(MCP23S17_IOCON, controlReg | ((uint16_t)controlReg << 8U));
+
+        markInitialised();
+    }
+
+    void toggleBitInRegister(uint8_t reg, pinid_t pin, bool value) {
+        uint16_t regVal;
+        if(!readReg16(reg, regVal)) return;
+        bitWrite(regVal, pin, value);
+        writeReg16(reg, regVal);
+    }
+};
+
+/**
+ * Create an MCP23S17 SPI IO expander abstraction, see Mcp23s17IoAbstraction for details.
+ * @param spi the SPI bus and chip select the device is on
+ * @param hwAddress the hardware address between 0 and 7, as set by the A0..A2 pins
+ * @return the abstraction as an IoAbstractionRef
+ */
+inline IoAbstractionRef ioFrom23s17(SPIWithSettings& spi, uint8_t hwAddress = 0) {
+    return ioaCreate<Mcp23s17IoAbstraction>(spi, hwAddress);
+}
+
+/**
+ * Create an MCP23S17 SPI IO expander abstraction with interrupt support, see Mcp23s17IoAbstraction for details.
+ * @param spi the SPI bus and chip select the device is on
+ * @param hwAddress the hardware address between 0 and 7, as set by the A0..A2 pins
+ * @param intMode the interrupt mode the device will operate in
+ * @param interruptPinA the board pin that INTA is connected to
+ * @param interruptPinB optionally the board pin that INTB is connected to, otherwise INTA covers both ports
+ * @return the abstraction as an IoAbstractionRef
+ */
+inline IoAbstractionRef ioFrom23s17(SPIWithSettings& spi, uint8_t hwAddress, Mcp23xInterruptMode intMode,
+                                    pinid_t interruptPinA, pinid_t interruptPinB = IO_PIN_NOT_DEFINED) {
+    return ioaCreate<Mcp23s17IoAbstraction>(spi, hwAddress, intMode, interruptPinA, interruptPinB);
+}
+
+#endif //IOABSTRACTION_MCP23S17IOABSTRACTION_H
@@ -10,6 +10,18 @@
 #include "../PlatformDetermination.h"
 #include "../AnalogDeviceAbstraction.h"
 #include "SPIHelper.h"
+#include <TaskManagerIO.h>
+
+// START user adjustable section
+
+/**
+ * The default interval in milliseconds between writes to the device in deferred mode, and between the steps of a ramp.
+ */
+#ifndef PGA2310_DEFAULT_TICK_MILLIS
+#define PGA2310_DEFAULT_TICK_MILLIS 10
+#endif
+
+// END user adjustable section
 
 /**
  * @file Pga2310VolumeControl.h
@@ -18,12 +30,31 @@
  * provided as either a float between 0 and 1, or a direct value between 0 and 255. The volume control is actually
  * between -95.5dB and +31.5dB in half steps.
  *
+ * Both channels are always written together, so a write is only made when either has changed. In deferred mode, see
+ * enableDeferredWrites, setting a value only records it, and the changes made within a tick are written with one
+ * transfer on task manager. Volume can also be ramped to a new level over a time period with rampTo, where each tick
+ * moves the level a step closer, instead of calling setCurrentValue in a loop.
+ *
  * This class is in the extras package, it means it is not part of the core of IoAbstraction.
  */
-class Pga2310VolumeControl : public AnalogDevice {
+class Pga2310VolumeControl : public AnalogDevice, public Executable {
 private:
+    struct VolumeRamp {
+        unsigned long startMillis;
+        uint32_t durationMillis;
+        uint8_t from;
+        uint8_t to;
+        bool active;
+    };
     uint8_t leftCache = 0;
     uint8_t rightCache = 0;
+    uint8_t writtenLeft = 0;
+    uint8_t writtenRight = 0;
+    bool writtenValid = false;
+    bool deferred = false;
+    bool tickScheduled = false;
+    uint16_t tickMillis = PGA2310_DEFAULT_TICK_MILLIS;
+    VolumeRamp ramps[2] = {};
     SPIWithSettings& spiBus;
 public:
     explicit Pga2310VolumeControl(SPIWithSettings& spi) : spiBus(spi) {}
@@ -35,15 +66,122 @@ public:
     unsigned int getCurrentValue(pinid_t pin) override { return pin == 0 ? leftCache : rightCache; }
     float getCurrentFloat(pinid_t pin) override { return float(getCurrentValue(pin)) / 255.0F; }
     void setCurrentValue(pinid_t pin, unsigned int newValue) override {
-        if(pin == 0) {
-            leftCache = newValue;
+        // setting a value directly takes over from any ramp on that channel.
+        ramps[pin == 0 ? 0 : 1].active = false;
+        setLevel(pin, newValue);
+        if(deferred) {
+            scheduleTick();
         } else {
-            rightCache = newValue;
+            flush();
         }
-        uint8_t dataToWrite[2] = { rightCache, leftCache };
-        spiBus.transferSPI(dataToWrite, 2);
     }
     void setCurrentFloat(pinid_t pin, float newValue) override { setCurrentValue(pin, (unsigned int)(newValue * 255.0F)); }
+
+    /**
+     * In deferred mode setting a value only records it, and changes are written to the device once per tick on task
+     * manager, so that both channels changing, or a value changing many times within a tick, needs only one write.
+     * @param enable true to defer writes, false to write on each change, which also writes any pending change now
+     * @param millisPerTick the interval between writes, also used for the steps of ramps
+     */
+    void enableDeferredWrites(bool enable, uint16_t millisPerTick = PGA2310_DEFAULT_TICK_MILLIS) {
+        deferred = enable;
+        tickMillis = millisPerTick;
+        if(!deferred) flush();
+    }
+
+    /**
+     * Moves the level of a channel from its current value to a new one over a period of time, a step each tick on
+     * task manager, without any other calls needed. Setting a value on the channel stops the ramp.
+     * @param pin the channel, 0 for left and 1 for right
+     * @param target the level to reach, between 0 and 255
+     * @param durationMillis the time the ramp should take, 0 goes straight to the target on the next tick
+     */
+    void rampTo(pinid_t pin, uint8_t target, uint32_t durationMillis) {
+        auto& ramp = ramps[pin == 0 ? 0 : 1];
+        ramp.from = uint8_t(getCurrentValue(pin));
+        ramp.to = target;
+        ramp.startMillis = millis();
+        ramp.durationMillis = durationMillis;
+        ramp.active = true;
+        scheduleTick();
+    }
+
+    /** @return true while the channel is ramping towards a target */
+    bool isRamping(pinid_t pin) const { return ramps[pin == 0 ? 0 : 1].active; }
+
+    /** Stops a ramp, leaving the channel at the level it has reached */
+    void cancelRamp(pinid_t pin) { ramps[pin == 0 ? 0 : 1].active = false; }
+
+    /**
+     * Works out the level of a ramp part way through, the elapsed time must be less than the duration.
+     * @param from the level at the start of the ramp
+     * @param to the level at the end of the ramp
+     * @param elapsedMillis the time since the ramp started
+     * @param durationMillis the time the ramp takes
+     * @return the level at that time
+     */
+    static uint8_t rampLevelAt(uint8_t from, uint8_t to, uint32_t elapsedMillis, uint32_t durationMillis) {
+        // 64 bit, as the change multiplied by the elapsed time overflows 32 bits on ramps of a few hours.
+        int64_t change = int64_t(to) - int64_t(from);
+        return uint8_t(int64_t(from) + (change * int64_t(elapsedMillis)) / int64_t(durationMillis));
+    }
+
+    /**
+     * Writes both channels to the device now if either has changed since the last write.
+     * @return true if nothing needed writing or the write succeeded
+     */
+    bool flush() {
+        if(writtenValid && writtenLeft == leftCache && writtenRight == rightCache) return true;
+        uint8_t dataToWrite[2] = { rightCache, leftCache };
+        if(!spiBus.transferSPI(dataToWrite, 2)) {
+            // the bus is busy, try again on the next tick
+            scheduleTick();
+            return false;
+        }
+        writtenLeft = leftCache;
+        writtenRight = rightCache;
+        writtenValid = true;
+        return true;
+    }
+
+    /** Carries out the tick, advancing any ramps and writing what has changed, called by task manager. */
+    void exec() override {
+        tickScheduled = false;
+        bool ramping = false;
+        for(pinid_t pin = 0; pin < 2; pin++) {
+            if(ramps[pin].active) {
+                setLevel(pin, rampLevel(ramps[pin]));
+                ramping = ramping || ramps[pin].active;
+            }
+        }
+        flush();
+        if(ramping) scheduleTick();
+    }
+
+private:
+    void setLevel(pinid_t pin, unsigned int newValue) {
+        uint8_t level = newValue > 255 ? 255 : uint8_t(newValue);
+        if(pin == 0) {
+            leftCache = level;
+        } else {
+            rightCache = level;
+        }
+    }
+
+    uint8_t rampLevel(VolumeRamp& ramp) {
+        unsigned long elapsed = millis() - ramp.startMillis;
+        if(elapsed >= ramp.durationMillis) {
+            ramp.active = false;
+            return ramp.to;
+        }
+        return rampLevelAt(ramp.from, ramp.to, elapsed, ramp.durationMillis);
+    }
+
+    void scheduleTick() {
+        if(tickScheduled) return;
+        // when task manager is full, the next change or ramp tries again.
+        tickScheduled = taskManager.scheduleOnce(tickMillis, this, TIME_MILLIS) != TASKMGR_INVALIDID;
+    }
 };
 
 
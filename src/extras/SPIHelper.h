@@ -8,58 +8,325 @@
 
 #include "../PlatformDetermination.h"
 #include "../IoAbstraction.h"
+#include "../FastDigitalPin.h"
+#include <TaskManagerIO.h>
 
 #define SPI_TEN_MHZ (10 * 1000000)
 
+/**
+ * One part of a batch of transfers that are sent under a single bus transaction, with the device selected
+ * throughout. Each part is transferred in place, so after completion the buffer holds what was read back.
+ */
+struct SpiTransferPart {
+    uint8_t* data;
+    size_t len;
+};
+
+/**
+ * Implement this interface to be told when an asynchronous SPI transfer has completed, it is always called on task
+ * manager, never from an interrupt.
+ */
+class SpiTransferListener {
+public:
+    virtual ~SpiTransferListener() = default;
+    /**
+     * Called once all the parts of an asynchronous transfer have finished, after which another may be started.
+     * @param parts the parts that were transferred, each now holding the data read back
+     * @param count the number of parts
+     * @param success true if every part was transferred
+     */
+    virtual void spiTransferComplete(SpiTransferPart* parts, uint8_t count, bool success) = 0;
+};
+
+/**
+ * The lock that is held while any SPIWithSettings has a device selected, so that devices sharing a bus cannot select
+ * themselves part way through another transfer. An asynchronous transfer holds it from start until completion, across
+ * task manager runs. As with i2cLock, there is one lock for all buses.
+ */
+inline SimpleSpinLock& spiBusLock() {
+    static SimpleSpinLock lock;
+    return lock;
+}
+
+/**
+ * The part of SPIWithSettings that is common to all boards, it carries out asynchronous transfers as a task manager
+ * event, registered the first time an asynchronous transfer is started. Each board starts a part on the hardware and
+ * reports when it completes, either from an interrupt or by being polled, and the event then moves on to the next
+ * part, and finally deselects the device and calls the listener on task manager.
+ *
+ * An asynchronous transfer holds spiBusLock until it completes, so while it is in progress any other transfer, on
+ * this or another device, fails rather than selecting its device part way through. It cannot be copied, as it is
+ * registered with task manager.
+ */
+class SpiAsyncTransfers : public BaseEvent {
+private:
+    SpiTransferPart singlePart;
+    SpiTransferPart* parts;
+    SpiTransferListener* listener;
+    uint8_t partCount;
+    uint8_t nextPart;
+    volatile bool partDone;
+    volatile bool partSucceeded;
+    bool inProgress;
+    bool eventRegistered;
+protected:
+    /** Selects the device and begins the bus transaction, before the first part, spiBusLock is already held */
+    virtual void beginAsyncTransaction() = 0;
+
+    /**
+     * Starts a part on the hardware, when it finishes it must call asyncPartComplete, from an interrupt if need be.
+     * @return false if the part could not be started
+     */
+    virtual bool startAsyncPart(uint8_t* data, size_t len) = 0;
+
+    /** For hardware that is polled rather than interrupting on completion, calls asyncPartComplete once done */
+    virtual void pollAsyncPart() { }
+
+    /** Ends the bus transaction and deselects the device, after the last part */
+    virtual void endAsyncTransaction() = 0;
+
+    /**
+     * Takes spiBusLock for a transfer. As the lock may let the task that holds it take it again, an asynchronous
+     * transfer in progress on any device is also checked for.
+     * @return true if the bus was taken, false if it is in use
+     */
+    static bool acquireBus() {
+        if(!spiBusLock().tryLock()) return false;
+        if(asyncBusHeld()) {
+            spiBusLock().unlock();
+            return false;
+        }
+        return true;
+    }
+
+    /** Releases the bus taken with acquireBus */
+    static void releaseBus() { spiBusLock().unlock(); }
+
+    /** Called by the board implementation when the part on the hardware has finished, safe from an interrupt */
+    void asyncPartComplete(bool ok) {
+        partSucceeded = ok;
+        partDone = true;
+        markTriggeredAndNotify();
+    }
+public:
+    SpiAsyncTransfers() : singlePart{nullptr, 0}, parts(nullptr), listener(nullptr), partCount(0), nextPart(0),
+                          partDone(false), partSucceeded(false), inProgress(false), eventRegistered(false) {}
+    SpiAsyncTransfers(const SpiAsyncTransfers&) = delete;
+    SpiAsyncTransfers& operator=(const SpiAsyncTransfers&) = delete;
+
+    /**
+     * Starts a transfer that completes in the background, where the board supports it by DMA or an asynchronous
+     * driver, on other boards it is carried out before returning. In either case the listener is called on task
+     * manager once complete.
+     * @param rdwr the data to write, it is replaced by what is read back, and must remain valid until completion
+     * @param len the number of bytes to transfer
+     * @param txListener the listener to notify on completion, may be nullptr
+     * @return true if started, false if a transfer is already in progress or the bus is in use
+     */
+    bool transferAsync(uint8_t* rdwr, size_t len, SpiTransferListener* txListener) {
+        if(inProgress) return false;
+        singlePart.data = rdwr;
+        singlePart.len = len;
+        return transferBatchAsync(&singlePart, 1, txListener);
+    }
+
+    /**
+     * Starts a batch of transfers that are all sent under one bus transaction with the device selected throughout,
+     * completing in the background in the same way as transferAsync.
+     * @param batch the parts to transfer, the array and each buffer must remain valid until completion
+     * @param count the number of parts
+     * @param txListener the listener to notify on completion, may be nullptr
+     * @return true if started, false if a transfer is already in progress, the bus is in use, or there are no parts
+     */
+    bool transferBatchAsync(SpiTransferPart* batch, uint8_t count, SpiTransferListener* txListener) {
+        if(inProgress || count == 0 || !acquireBus()) return false;
+        asyncBusHeld() = true;
+        parts = batch;
+        partCount = count;
+        nextPart = 0;
+        listener = txListener;
+        inProgress = true;
+
+        if(!eventRegistered) {
+            eventRegistered = true;
+            taskManager.registerEvent(this);
+        }
+        beginAsyncTransaction();
+        startNextPart();
+        return true;
+    }
+
+    /** @return true from starting an asynchronous transfer until just before its listener is called */
+    bool isTransferInProgress() const { return inProgress; }
+
+    uint32_t timeOfNextCheck() override {
+        if(!inProgress) return secondsToMicros(1);
+        if(!partDone) pollAsyncPart();
+        if(partDone) setTriggered(true);
+        // while a transfer is in progress on the hardware, poll often as its completion is the critical path.
+        return 100;
+    }
+
+    void exec() override {
+        if(!inProgress || !partDone) return;
+        if(partSucceeded && nextPart < partCount) {
+            startNextPart();
+            return;
+        }
+
+        endAsyncTransaction();
+        asyncBusHeld() = false;
+        releaseBus();
+        // no longer in progress before the listener is called, so that it can start another transfer straight away.
+        inProgress = false;
+        if(!partSucceeded) {
+            serlogF2(SER_IOA_DEBUG, "SPI async failed part=", nextPart);
+        }
+        if(listener) listener->spiTransferComplete(parts, partCount, partSucceeded);
+    }
+
+private:
+    static volatile bool& asyncBusHeld() {
+        static volatile bool held = false;
+        return held;
+    }
+
+    void startNextPart() {
+        partDone = false;
+        auto& part = parts[nextPart];
+        nextPart++;
+        if(!startAsyncPart(part.data, part.len)) {
+            asyncPartComplete(false);
+        }
+    }
+};
+
 #ifdef IOA_USE_ARDUINO
 #include <SPI.h>
-class SPIWithSettings {
+
+/**
+ * An SPI device on Arduino, made up of the bus, its settings and the chip select pin. The Arduino SPI API has no
+ * asynchronous transfer, so transferAsync is carried out before returning, and only the listener is deferred.
+ */
+class SPIWithSettings : public SpiAsyncTransfers {
 private:
     HardwareSPI* spiBus;
     SPISettings settings;
     pinid_t csPin = 0;
     bool initializedYet = false;
+    FastOutputPin csLine;
 public:
     SPIWithSettings(HardwareSPI* bus, pinid_t cs) : spiBus(bus), csPin(cs) {}
     SPIWithSettings(HardwareSPI* bus, pinid_t cs, const SPISettings& settings) : spiBus(bus), settings(settings), csPin(cs) {}
-    SPIWithSettings(const SPIWithSettings&) = default;
-    SPIWithSettings& operator=(const SPIWithSettings&)=default;
 
     void init() {
-        internalDigitalDevice().pinMode(cs, OUTPUT);
-        internalDigitalDevice().digitalWrite(cs, HIGH);
+        csLine.begin(csPin);
+        csLine.high();
+        initializedYet = true;
     }
 
     bool transferSPI(uint8_t* rdwr, size_t len) {
+        if(!beginTransfer()) return false;
+        spiBus->transfer(rdwr, len);
+        endTransfer();
+        return true;
+    }
+
+    /**
+     * Selects the device and starts a transfer that is made of several parts, for a command followed by a block of
+     * data of any length, each part is sent with transferPart or writePart and then the transfer ended.
+     * @return true if the device is selected, false if another transfer holds the bus, see spiBusLock
+     */
+    bool beginTransfer() {
+        if(!acquireBus()) return false;
+        selectDevice();
+        return true;
+    }
+
+    /** Transfers part of a transfer in place, see beginTransfer */
+    bool transferPart(uint8_t* rdwr, size_t len) {
+        spiBus->transfer(rdwr, len);
+        return true;
+    }
+
+    /** Writes part of a transfer, ignoring what is read back, see beginTransfer */
+    bool writePart(const uint8_t* data, size_t len) {
+        for(size_t i = 0; i < len; i++) {
+            spiBus->transfer(data[i]);
+        }
+        return true;
+    }
+
+    /** Ends a transfer started with beginTransfer and deselects the device */
+    void endTransfer() {
+        deselectDevice();
+        releaseBus();
+    }
+
+    /**
+     * Transfers several parts in place under one bus transaction, with the device selected throughout.
+     * @return true if all parts were transferred, false if another transfer holds the bus
+     */
+    bool transferBatch(SpiTransferPart* batch, uint8_t count) {
+        if(!beginTransfer()) return false;
+        for(uint8_t i = 0; i < count; i++) {
+            spiBus->transfer(batch[i].data, batch[i].len);
+        }
+        endTransfer();
+        return true;
+    }
+
+protected:
+    void beginAsyncTransaction() override { selectDevice(); }
+
+    bool startAsyncPart(uint8_t* data, size_t len) override {
+        spiBus->transfer(data, len);
+        asyncPartComplete(true);
+        return true;
+    }
+
+    void endAsyncTransaction() override { deselectDevice(); }
+
+private:
+    void selectDevice() {
         if(!initializedYet) {
             init();
         }
-        internalDigitalDevice().digitalWrite(csPin, LOW);
+        csLine.low();
         spiBus->beginTransaction(settings);
-        spiBus->transfer(rdwr, len);
+    }
+
+    void deselectDevice() {
         spiBus->endTransaction();
-        internalDigitalDevice().digitalWrite(csPin, HIGH);
-        return true;
+        csLine.high();
     }
 };
 #elif BUILD_FOR_PICO_CMAKE
 #include "hardware/spi.h"
+#include "hardware/dma.h"
 #define TC_SPI_WRITE_AVAILABLE
-class SPIWithSettings {
+
+/**
+ * An SPI device on the Pico SDK, made up of the bus, its speed and the chip select pin. Asynchronous transfers use
+ * a pair of DMA channels, claimed on the first asynchronous transfer and kept from then on, when no channels are free
+ * the transfer is carried out before returning instead.
+ */
+class SPIWithSettings : public SpiAsyncTransfers {
 private:
     spi_inst_t* spiBus;
     uint32_t speed;
     pinid_t csPin = 0;
     bool initializedYet = false;
+    int txDma = -1;
+    int rxDma = -1;
+    FastOutputPin csLine;
 public:
     SPIWithSettings(spi_inst_t* bus, pinid_t cs) : spiBus(bus), csPin(cs), speed(10000000) {}
     SPIWithSettings(spi_inst_t* bus, pinid_t cs, uint32_t speed) : spiBus(bus), speed(speed), csPin(cs) {}
-    SPIWithSettings(const SPIWithSettings&) = default;
-    SPIWithSettings& operator=(const SPIWithSettings&)=default;
 
     void init() {
-        internalDigitalDevice().pinMode(csPin, OUTPUT);
-        internalDigitalDevice().digitalWrite(csPin, HIGH);
+        csLine.begin(csPin);
+        csLine.high();
         initializedYet=true;
     }
 
@@ -74,35 +341,241 @@ public:
         int retries = 50;
         while(spi_is_busy(spiBus) && retries > 0) {
             retries--;
-            serlogF2(SER_IOA_DEBUG, "SPI busy retries=", retries);
+        }
+        if(retries == 0) {
+            serlogF(SER_IOA_DEBUG, "SPI still busy");
         }
 
-        internalDigitalDevice().digitalWrite(csPin, LOW);
+        csLine.low();
         waitABit();
     }
 
     void waitAndDeactivateCS() {
         waitABit();
-        internalDigitalDevice().digitalWrite(csPin, HIGH);
+        csLine.high();
         waitABit();
     }
 
     bool write(const uint8_t* data, size_t size) {
-        waitAndActiveCS();
+        if(!beginTransfer()) return false;
         int written = spi_write_blocking(spiBus, data, size);
-        waitAndDeactivateCS();
+        endTransfer();
         return written == size;
     }
 
     bool transferSPI(uint8_t* rdwr, size_t len) {
-        waitAndActiveCS();
+        if(!beginTransfer()) return false;
         int written = spi_write_read_blocking(spiBus, rdwr, rdwr, len);
-        waitAndDeactivateCS();
+        endTransfer();
         return written == len;
     }
+
+    /**
+     * Selects the device and starts a transfer that is made of several parts, for a command followed by a block of
+     * data of any length, each part is sent with transferPart or writePart and then the transfer ended.
+     * @return true if the device is selected, false if another transfer holds the bus, see spiBusLock
+     */
+    bool beginTransfer() {
+        if(!acquireBus()) return false;
+        waitAndActiveCS();
+        return true;
+    }
+
+    /** Transfers part of a transfer in place, see beginTransfer */
+    bool transferPart(uint8_t* rdwr, size_t len) {
+        return spi_write_read_blocking(spiBus, rdwr, rdwr, len) == int(len);
+    }
+
+    /** Writes part of a transfer, ignoring what is read back, see beginTransfer */
+    bool writePart(const uint8_t* data, size_t len) {
+        return spi_write_blocking(spiBus, data, len) == int(len);
+    }
+
+    /** Ends a transfer started with beginTransfer and deselects the device */
+    void endTransfer() {
+        waitAndDeactivateCS();
+        releaseBus();
+    }
+
+    /**
+     * Transfers several parts in place under one bus transaction, with the device selected throughout.
+     * @return true if all parts were transferred, false if another transfer holds the bus
+     */
+    bool transferBatch(SpiTransferPart* batch, uint8_t count) {
+        if(!beginTransfer()) return false;
+        bool ok = true;
+        for(uint8_t i = 0; i < count && ok; i++) {
+            ok = transferPart(batch[i].data, batch[i].len);
+        }
+        endTransfer();
+        return ok;
+    }
+
+protected:
+    void beginAsyncTransaction() override { waitAndActiveCS(); }
+
+    bool startAsyncPart(uint8_t* data, size_t len) override {
+        if(!claimDma()) {
+            asyncPartComplete(transferPart(data, len));
+            return true;
+        }
+
+        // the receive channel trails the transmit channel by the FIFO depth, so both can work on the same buffer.
+        dma_channel_config txConfig = dma_channel_get_default_config(txDma);
+        channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_8);
+        channel_config_set_dreq(&txConfig, spi_get_dreq(spiBus, true));
+        channel_config_set_read_increment(&txConfig, true);
+        channel_config_set_write_increment(&txConfig, false);
+        dma_channel_configure(txDma, &txConfig, &spi_get_hw(spiBus)->dr, data, len, false);
+
+        dma_channel_config rxConfig = dma_channel_get_default_config(rxDma);
+        channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+        channel_config_set_dreq(&rxConfig, spi_get_dreq(spiBus, false));
+        channel_config_set_read_increment(&rxConfig, false);
+        channel_config_set_write_increment(&rxConfig, true);
+        dma_channel_configure(rxDma, &rxConfig, data, &spi_get_hw(spiBus)->dr, len, false);
+
+        dma_start_channel_mask((1U << txDma) | (1U << rxDma));
+        return true;
+    }
+
+    void pollAsyncPart() override {
+        // every byte sent has been read back once the receive channel is done, so the bus is idle by then.
+        if(rxDma >= 0 && !dma_channel_is_busy(rxDma)) asyncPartComplete(true);
+    }
+
+    void endAsyncTransaction() override { waitAndDeactivateCS(); }
+
+private:
+    bool claimDma() {
+        if(rxDma >= 0) return true;
+        txDma = dma_claim_unused_channel(false);
+        rxDma = dma_claim_unused_channel(false);
+        if(txDma < 0 || rxDma < 0) {
+            if(txDma >= 0) dma_channel_unclaim(txDma);
+            if(rxDma >= 0) dma_channel_unclaim(rxDma);
+            txDma = rxDma = -1;
+            serlogF(SER_IOA_INFO, "No DMA for SPI, blocking");
+            return false;
+        }
+        return true;
+    }
+};
+#elif defined(IOA_USE_MBED)
+
+/**
+ * An SPI device on mbed, made up of the bus, its speed and mode, and the chip select pin. The bus is locked for each
+ * transaction, and its format and frequency set, so several devices with different settings can share an SPI
+ * object. When the target has DEVICE_SPI_ASYNCH, asynchronous transfers use the mbed asynchronous SPI API, usually
+ * backed by DMA, otherwise they are carried out before returning.
+ */
+class SPIWithSettings : public SpiAsyncTransfers {
+private:
+    SPI* spiBus;
+    uint32_t speed;
+    uint8_t mode;
+    pinid_t csPin = 0;
+    bool initializedYet = false;
+    FastOutputPin csLine;
+public:
+    SPIWithSettings(SPI* bus, pinid_t cs) : spiBus(bus), speed(SPI_TEN_MHZ), mode(0), csPin(cs) {}
+    SPIWithSettings(SPI* bus, pinid_t cs, uint32_t speed, uint8_t mode = 0) : spiBus(bus), speed(speed), mode(mode), csPin(cs) {}
+
+    void init() {
+        csLine.begin(csPin);
+        csLine.high();
+        initializedYet = true;
+    }
+
+    bool transferSPI(uint8_t* rdwr, size_t len) {
+        if(!beginTransfer()) return false;
+        bool ok = transferPart(rdwr, len);
+        endTransfer();
+        return ok;
+    }
+
+    /**
+     * Selects the device and starts a transfer that is made of several parts, for a command followed by a block of
+     * data of any length, each part is sent with transferPart or writePart and then the transfer ended.
+     * @return true if the device is selected, false if another transfer holds the bus, see spiBusLock
+     */
+    bool beginTransfer() {
+        if(!acquireBus()) return false;
+        selectDevice();
+        return true;
+    }
+
+    /** Transfers part of a transfer in place, see beginTransfer */
+    bool transferPart(uint8_t* rdwr, size_t len) {
+        return spiBus->write((const char*)rdwr, int(len), (char*)rdwr, int(len)) == int(len);
+    }
+
+    /** Writes part of a transfer, ignoring what is read back, see beginTransfer */
+    bool writePart(const uint8_t* data, size_t len) {
+        return spiBus->write((const char*)data, int(len), nullptr, 0) == int(len);
+    }
+
+    /** Ends a transfer started with beginTransfer and deselects the device */
+    void endTransfer() {
+        deselectDevice();
+        releaseBus();
+    }
+
+    /**
+     * Transfers several parts in place under one bus transaction, with the device selected throughout.
+     * @return true if all parts were transferred, false if another transfer holds the bus
+     */
+    bool transferBatch(SpiTransferPart* batch, uint8_t count) {
+        if(!beginTransfer()) return false;
+        bool ok = true;
+        for(uint8_t i = 0; i < count && ok; i++) {
+            ok = transferPart(batch[i].data, batch[i].len);
+        }
+        endTransfer();
+        return ok;
+    }
+
+protected:
+    void beginAsyncTransaction() override { selectDevice(); }
+
+    bool startAsyncPart(uint8_t* data, size_t len) override {
+#if DEVICE_SPI_ASYNCH
+        return spiBus->transfer((const uint8_t*)data, int(len), data, int(len),
+                                callback(this, &SPIWithSettings::mbedTransferComplete),
+                                SPI_EVENT_COMPLETE | SPI_EVENT_ERROR) == 0;
+#else
+        asyncPartComplete(transferPart(data, len));
+        return true;
+#endif
+    }
+
+    void endAsyncTransaction() override { deselectDevice(); }
+
+private:
+    void selectDevice() {
+        if(!initializedYet) {
+            init();
+        }
+        spiBus->lock();
+        spiBus->format(8, mode);
+        spiBus->frequency(int(speed));
+        csLine.low();
+    }
+
+    void deselectDevice() {
+        csLine.high();
+        spiBus->unlock();
+    }
+
+#if DEVICE_SPI_ASYNCH
+    void mbedTransferComplete(int event) {
+        // called from interrupt context, the next part or the listener follows on task manager.
+        asyncPartComplete((event & SPI_EVENT_ERROR) == 0);
+    }
+#endif
 };
 #else
-#error "Not implemented yet for mbed"
+#error "SPIWithSettings is not implemented for this board"
 #endif
 
 #endif //IOABSTRACTION_SPIHELPER_H
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_SPIFRAMEEPROM_H
+#define IOABSTRACTION_SPIFRAMEEPROM_H
+
+#include "../PlatformDetermination.h"
+#include "../EepromAbstraction.h"
+#include "SPIHelper.h"
+
+/**
+ * @file SpiFramEeprom.h
+ * @brief An EepromAbstraction implementation for SPI FRAM such as the MB85RS series, which has no write cycle time,
+ * so every read and write of any length is a single continuous SPI transfer.
+ *
+ * This class is in the extras package, it means it is not part of the core of IoAbstraction.
+ */
+
+#define FRAM_OPCODE_WREN 0x06
+#define FRAM_OPCODE_READ 0x03
+#define FRAM_OPCODE_WRITE 0x02
+#define FRAM_OPCODE_RDID 0x9f
+
+/**
+ * An EepromAbstraction for SPI FRAM chips, such as the MB85RS64V, MB85RS256 and similar, that take a two byte address.
+ * Unlike AT24 EEPROM there are no pages and no write cycle to wait for, so a block read or write of any length is sent
+ * as one transfer, the command and address followed by the data, and the write enable latch is set once for each
+ * write rather than per byte. Values of 16 and 32 bits are stored most significant byte first, as with I2cAt24Eeprom.
+ */
+class SpiFramEeprom : public EepromAbstraction {
+private:
+    SPIWithSettings& spiBus;
+    size_t romSize;
+    bool errorOccurred = false;
+public:
+    /**
+     * Create an FRAM eeprom on a SPI bus and chip select
+     * @param spi the SPI bus and chip select for the device
+     * @param romSize the size of the device in bytes, accesses beyond it set the error flag
+     */
+    SpiFramEeprom(SPIWithSettings& spi, size_t romSize) : spiBus(spi), romSize(romSize) {}
+
+    /**
+     * Reads the device ID, the manufacturer is in the top byte, 0x04 for Fujitsu, and can be used to check the device
+     * is present before use.
+     * @return the four byte device ID
+     */
+    uint32_t readDeviceId() {
+        uint8_t data[5] = { FRAM_OPCODE_RDID, 0, 0, 0, 0 };
+        spiBus.transferSPI(data, sizeof data);
+        return ((uint32_t)data[1] << 24U) | ((uint32_t)data[2] << 16U) | ((uint32_t)data[3] << 8U) | data[4];
+    }
+
+    bool hasErrorOccurred() override {
+        bool ret = errorOccurred;
+        errorOccurred = false;
+        return ret;
+    }
+
+    uint8_t read8(EepromPosition position) override {
+        uint8_t data = 0;
+        readBlock(&data, position, 1);
+        return data;
+    }
+
+    void write8(EepromPosition position, uint8_t val) override {
+        writeBlock(position, &val, 1);
+    }
+
+    uint16_t read16(EepromPosition position) override {
+        uint8_t data[2] = {};
+        readBlock(data, position, sizeof data);
+        return ((uint16_t)data[0] << 8U) | data[1];
+    }
+
+    void write16(EepromPosition position, uint16_t val) override {
+        uint8_t data[2] = { uint8_t(val >> 8U), uint8_t(val) };
+        writeBlock(position, data, sizeof data);
+    }
+
+    uint32_t read32(EepromPosition position) override {
+        uint8_t data[4] = {};
+        readBlock(data, position, sizeof data);
+        return ((uint32_t)data[0] << 24U) | ((uint32_t)data[1] << 16U) | ((uint32_t)data[2] << 8U) | data[3];
+    }
+
+    void write32(EepromPosition position, uint32_t val) override {
+        uint8_t data[4] = { uint8_t(val >> 24U), uint8_t(val >> 16U), uint8_t(val >> 8U), uint8_t(val) };
+        writeBlock(position, data, sizeof data);
+    }
+
+    void readIntoMemArray(uint8_t* memDest, EepromPosition romSrc, uint8_t len) override {
+        readBlock(memDest, romSrc, len);
+    }
+
+    void writeArrayToRom(EepromPosition romDest, const uint8_t* memSrc, uint8_t len) override {
+        writeBlock(romDest, memSrc, len);
+    }
+
+    void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override {
+        if(!inBounds(romSrc, len)) return;
+        uint8_t command[3] = { FRAM_OPCODE_READ, uint8_t(romSrc >> 8U), uint8_t(romSrc) };
+        if(!spiBus.beginTransfer()) {
+            errorOccurred = true;
+            return;
+        }
+        bool ok = spiBus.writePart(command, sizeof command) && spiBus.transferPart(memDest, len);
+        spiBus.endTransfer();
+        errorOccurred = errorOccurred || !ok;
+    }
+
+    void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) override {
+        if(!inBounds(romDest, len)) return;
+        // the write enable latch must be set in its own transfer, and is cleared by the device when the write ends.
+        uint8_t writeEnable = FRAM_OPCODE_WREN;
+        uint8_t command[3] = { FRAM_OPCODE_WRITE, uint8_t(romDest >> 8U), uint8_t(romDest) };
+        if(!spiBus.transferSPI(&writeEnable, 1) || !spiBus.beginTransfer()) {
+            errorOccurred = true;
+            return;
+        }
+        bool ok = spiBus.writePart(command, sizeof command) && spiBus.writePart(memSrc, len);
+        spiBus.endTransfer();
+        errorOccurred = errorOccurred || !ok;
+    }
+private:
+    bool inBounds(EepromPosition position, size_t len) {
+        if((size_t(position) + len) > romSize) {
+            errorOccurred = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif //IOABSTRACTION_SPIFRAMEEPROM_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifndef IOABSTRACTION_SPISHIFTREGISTER_H
+#define IOABSTRACTION_SPISHIFTREGISTER_H
+
+#include "../PlatformDetermination.h"
+#include "../IoAbstraction.h"
+#include "../FastDigitalPin.h"
+#include "SPIHelper.h"
+
+/**
+ * @file SpiShiftRegister.h
+ * @brief A shift register IoAbstraction where the clock and data lines are driven by the hardware SPI peripheral
+ * instead of being bit banged, which is many times faster for long chains.
+ *
+ * This class is in the extras package, it means it is not part of the core of IoAbstraction.
+ */
+
+/**
+ * The time in microseconds that the 165 load pin is held low before each transfer, as with the latch time of the bit
+ * banged shift registers.
+ */
+#ifndef SPI_SHIFTREG_LOAD_MICROS
+#define SPI_SHIFTREG_LOAD_MICROS 5
+#endif
+
+/**
+ * An implementation of BasicIoAbstraction that drives 74HC595 output and 74HC165 input shift registers from the SPI
+ * bus, with the same pin layout as ShiftRegisterIoAbstraction, inputs are pins 0 to 31 and outputs from 32 onwards.
+ *
+ * Wiring is as follows, SCK goes to the clock of both chains, MOSI to the serial input of the first 595 and MISO to
+ * the serial output of the last 165. The chip select of the SPIWithSettings object is used as the 595 latch (RCLK),
+ * which latches the outputs as it rises at the end of each transfer. The 165 load pin is a separate GPIO that is
+ * pulsed before each transfer. When both chains are present, the inputs are read and the outputs written in the same
+ * transfer. SPI mode 0 is normally correct for both devices.
+ *
+ * Up to four input devices are supported, output chains can be any length within the range of pinid_t. The chain
+ * state is held in byte buffers allocated at construction.
+ */
+class SpiShiftRegisterIoAbstraction : public BasicIoAbstraction {
+private:
+    SPIWithSettings& spiBus;
+    FastOutputPin readLatch;
+    pinid_t readLatchPin;
+    uint8_t numOfDevicesRead;
+    uint8_t numOfDevicesWrite;
+    uint8_t* toWrite;
+    uint8_t* lastRead;
+    uint8_t* transferBuffer;
+    bool needsWrite;
+    bool needsInit;
+public:
+    /**
+     * Normally use the helper functions to create an instance.
+     * @param spi the SPI bus, its chip select pin is the 595 latch, or IO_PIN_NOT_DEFINED if there are no outputs
+     * @param readLatchPin the 165 load pin, or IO_PIN_NOT_DEFINED if there are no inputs
+     * @param numRead the number of 165 devices chained for reading, up to 4
+     * @param numWrite the number of 595 devices chained for writing
+     * @see inputOnlyFromSpiShiftRegister
+     * @see outputOnlyFromSpiShiftRegister
+     * @see inputOutputFromSpiShiftRegister
+     */
+    SpiShiftRegisterIoAbstraction(SPIWithSettings& spi, pinid_t readLatchPin, uint8_t numRead, uint8_t numWrite)
+            : spiBus(spi), readLatch(), readLatchPin(readLatchPin), numOfDevicesRead(min(numRead, uint8_t(SHIFT_REGISTER_OUTPUT_CUTOVER / 8))),
+              numOfDevicesWrite(numWrite), needsWrite(true), needsInit(true) {
+        unsigned long maxWrite = ((unsigned long)((pinid_t)~0U - SHIFT_REGISTER_OUTPUT_CUTOVER + 1U)) / 8U;
+        if(numOfDevicesWrite > maxWrite) numOfDevicesWrite = uint8_t(maxWrite);
+        uint8_t len = max(numOfDevicesRead, numOfDevicesWrite);
+        toWrite = new uint8_t[numOfDevicesWrite];
+        lastRead = new uint8_t[numOfDevicesRead];
+        transferBuffer = new uint8_t[len];
+        memset(toWrite, 0, numOfDevicesWrite);
+        memset(lastRead, 0, numOfDevicesRead);
+    }
+
+    ~SpiShiftRegisterIoAbstraction() override {
+        delete[] toWrite;
+        delete[] lastRead;
+        delete[] transferBuffer;
+    }
+
+    void initDevice() {
+        spiBus.init();
+        if(numOfDevicesRead != 0) {
+            readLatch.begin(readLatchPin);
+            readLatch.high();
+        }
+        needsInit = false;
+    }
+
+    /** ignored, the inputs and outputs are fixed by the hardware, 0 to 31 are inputs and 32 onwards outputs */
+    void pinDirection(pinid_t, uint8_t) override { }
+
+    void writeValue(pinid_t pin, uint8_t value) override {
+        if(pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
+        if(shiftRegBufferWrite(toWrite, numOfDevicesWrite, pin - SHIFT_REGISTER_OUTPUT_CUTOVER, 1, value ? 1 : 0)) {
+            needsWrite = true;
+        }
+    }
+
+    uint8_t readValue(pinid_t pin) override {
+        if(pin >= SHIFT_REGISTER_OUTPUT_CUTOVER) return LOW;
+        return (shiftRegBufferRead(lastRead, numOfDevicesRead, pin) & 1U) ? HIGH : LOW;
+    }
+
+    void writePort(pinid_t pin, uint8_t portVal) override {
+        if(pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
+        pinid_t device = (pin - SHIFT_REGISTER_OUTPUT_CUTOVER) / 8;
+        if(device >= numOfDevicesWrite || toWrite[device] == portVal) return;
+        toWrite[device] = portVal;
+        needsWrite = true;
+    }
+
+    uint8_t readPort(pinid_t pin) override {
+        pinid_t device = pin / 8;
+        return (device < numOfDevicesRead) ? lastRead[device] : 0;
+    }
+
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override {
+        if(startPin >= SHIFT_REGISTER_OUTPUT_CUTOVER) return 0;
+        return shiftRegBufferRead(lastRead, numOfDevicesRead, startPin) & mask;
+    }
+
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override {
+        if(startPin < SHIFT_REGISTER_OUTPUT_CUTOVER) {
+            uint8_t toSkip = SHIFT_REGISTER_OUTPUT_CUTOVER - startPin;
+            if(toSkip >= 32) return;
+            mask >>= toSkip;
+            values >>= toSkip;
+            startPin = SHIFT_REGISTER_OUTPUT_CUTOVER;
+        }
+        if(shiftRegBufferWrite(toWrite, numOfDevicesWrite, startPin - SHIFT_REGISTER_OUTPUT_CUTOVER, mask, values)) {
+            needsWrite = true;
+        }
+    }
+
+    /** Interrupts are not supported on shift registers */
+    void attachInterrupt(pinid_t, RawIntHandler, uint8_t) override { }
+
+    /**
+     * Loads the inputs and transfers both chains over SPI, the outputs are only latched when something has changed.
+     * Should the transfer fail, the inputs are left as they were and the outputs are sent again on the next sync.
+     * @return the result of the SPI transfer
+     */
+    bool runLoop() override {
+        if(needsInit) initDevice();
+        if(numOfDevicesRead == 0 && !needsWrite) return true;
+
+        // the transfer length covers the longer chain. Output bytes are placed at the end so that any extra bytes
+        // flow out of the end of the 595 chain, and input bytes arrive first from the 165 chain. As with
+        // ShiftRegisterIoAbstraction, pins 32..39 are sent first, so they end up furthest along the chain.
+        uint8_t len = max(numOfDevicesRead, numOfDevicesWrite);
+        uint8_t writeStart = len - numOfDevicesWrite;
+        for(uint8_t i = 0; i < len; i++) {
+            transferBuffer[i] = (i < writeStart) ? 0 : toWrite[i - writeStart];
+        }
+
+        if(numOfDevicesRead != 0) {
+            // the 165 captures its parallel inputs while the load pin is low.
+            readLatch.low();
+            taskManager.yieldForMicros(SPI_SHIFTREG_LOAD_MICROS);
+            readLatch.high();
+        }
+
+        // the bus may be held by another device's transfer, in which case nothing was sent or received.
+        if(!spiBus.transferSPI(transferBuffer, len)) return false;
+        needsWrite = false;
+
+        // again as with ShiftRegisterIoAbstraction, the first byte received holds the highest numbered input pins.
+        for(uint8_t i = 0; i < numOfDevicesRead; i++) {
+            lastRead[numOfDevicesRead - 1 - i] = transferBuffer[i];
+        }
+        return true;
+    }
+};
+
+/**
+ * Create an output only shift register abstraction on the SPI bus, see SpiShiftRegisterIoAbstraction for wiring.
+ * Output pins start at 32.
+ * @param spi the SPI bus, its chip select is the 595 latch pin
+ * @param numOfDevices the number of chained 595 devices
+ * @return the abstraction as an IoAbstractionRef
+ */
+inline IoAbstractionRef outputOnlyFromSpiShiftRegister(SPIWithSettings& spi, uint8_t numOfDevices = 1) {
+    return ioaCreate<SpiShiftRegisterIoAbstraction>(spi, IO_PIN_NOT_DEFINED, 0, numOfDevices);
+}
+
+/**
+ * Create an input only shift register abstraction on the SPI bus, see SpiShiftRegisterIoAbstraction for wiring.
+ * Input pins start at 0.
+ * @param spi the SPI bus, normally with IO_PIN_NOT_DEFINED as chip select
+ * @param readLatchPin the 165 load pin
+ * @param numOfDevices the number of chained 165 devices
+ * @return the abstraction as an IoAbstractionRef
+ */
+inline IoAbstractionRef inputOnlyFromSpiShiftRegister(SPIWithSettings& spi, pinid_t readLatchPin, uint8_t numOfDevices = 1) {
+    return ioaCreate<SpiShiftRegisterIoAbstraction>(spi, readLatchPin, numOfDevices, 0);
+}
+
+/**
+ * Create a full duplex shift register abstraction on the SPI bus that reads the 165 chain and writes the 595 chain
+ * in the same transfer. Inputs are pins 0 to 31 and outputs 32 onwards.
+ * @param spi the SPI bus, its chip select is the 595 latch pin
+ * @param readLatchPin the 165 load pin
+ * @param numOfReadDevices the number of chained 165 devices
+ * @param numOfWriteDevices the number of chained 595 devices
+ * @return the abstraction as an IoAbstractionRef
+ */
+inline IoAbstractionRef inputOutputFromSpiShiftRegister(SPIWithSettings& spi, pinid_t readLatchPin, uint8_t numOfReadDevices, uint8_t numOfWriteDevices) {
+    return ioaCreate<SpiShiftRegisterIoAbstraction>(spi, readLatchPin, numOfReadDevices, numOfWriteDevices);
+}
+
+#endif //IOABSTRACTION_SPISHIFTREGISTER_H
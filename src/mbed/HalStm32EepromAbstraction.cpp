@@ -26,17 +26,53 @@ void HalStm32EepromAbstraction::initialise(int baseOffs) {
     halReadFromCache();
 }
 
+bool HalStm32EepromAbstraction::isDirty() const {
+    for(auto bits : dirtyWords) {
+        if(bits != 0) return true;
+    }
+    return false;
+}
+
+void HalStm32EepromAbstraction::storeBytes(EepromPosition position, const uint8_t* data, size_t len) {
+    // only mark the words that actually change, so rewriting the same values costs nothing at commit.
+    for(size_t i = 0; i < len; i++) {
+        auto pos = position + i;
+        if(eepromBuffer[pos] == (char)data[i]) continue;
+        eepromBuffer[pos] = (char)data[i];
+        auto word = pos >> 2U;
+        dirtyWords[word >> 5U] |= (1UL << (word & 31U));
+    }
+}
+
 void HalStm32EepromAbstraction::halWriteToCache() {
+    if(!isDirty()) return;
+
     __HAL_RCC_BKPSRAM_CLK_ENABLE(); // turn on back up ram clock
 
     auto* dataCache = reinterpret_cast<uint32_t*>(eepromBuffer);
-    for(uint32_t i=0; i<EEPROM_WORD_SIZE; i++) {
-        *(uint32_t*)(BKPSRAM_BASE + romBase + (i<<2)) = dataCache[i];
+    uint32_t wordsWritten = 0;
+    uint32_t word = 0;
+    while(word < EEPROM_WORD_SIZE) {
+        uint32_t bits = dirtyWords[word >> 5U] >> (word & 31U);
+        if(bits == 0) {
+            // nothing more dirty in this bitmap entry, move to the start of the next.
+            word = (word | 31U) + 1;
+            continue;
+        }
+        word += __builtin_ctz(bits);
+
+        // copy the contiguous run of dirty words starting here.
+        while(word < EEPROM_WORD_SIZE && (dirtyWords[word >> 5U] & (1UL << (word & 31U)))) {
+            *(uint32_t*)(BKPSRAM_BASE + romBase + (word<<2)) = dataCache[word];
+            wordsWritten++;
+            word++;
+        }
     }
+    memset(dirtyWords, 0, sizeof dirtyWords);
 
     __HAL_RCC_BKPSRAM_CLK_DISABLE(); // turn off backup ram clock
 
-    serlogF(SER_IOA_DEBUG, "Completed write to cache of present data: ");
+    serlogF2(SER_IOA_DEBUG, "Completed write to cache of changed words: ", wordsWritten);
 }
 
 void HalStm32EepromAbstraction::halReadFromCache() {
@@ -46,6 +82,7 @@ void HalStm32EepromAbstraction::halReadFromCache() {
     for(uint32_t i=0; i<EEPROM_WORD_SIZE; i++) {
         dataCache[i] = *(uint32_t*)(BKPSRAM_BASE + romBase + (i<<2));
     }
+    memset(dirtyWords, 0, sizeof dirtyWords);
 
     __HAL_RCC_BKPSRAM_CLK_DISABLE();
 
@@ -65,7 +102,7 @@ void HalStm32EepromAbstraction::write8(EepromPosition position, uint8_t val) {
         errorOccurred = true;
     }
     else {
-        eepromBuffer[position] = (char)val;
+        storeBytes(position, &val, 1);
     }
 }
 
@@ -81,8 +118,8 @@ void HalStm32EepromAbstraction::write16(EepromPosition position, uint16_t val) {
     if (position + 2 >= EEPROM_SIZE) {
         errorOccurred = true;
     } else {
-        eepromBuffer[position] = char(val & 0xffU);
-        eepromBuffer[position + 1] = char(val >> 8U);
+        uint8_t data[2] = { uint8_t(val & 0xffU), uint8_t(val >> 8U) };
+        storeBytes(position, data, sizeof data);
     }
 }
 
@@ -96,14 +133,12 @@ uint32_t HalStm32EepromAbstraction::read32(EepromPosition position) {
 }
 
 void HalStm32EepromAbstraction::write32(EepromPosition position, uint32_t val) {
-    if(position + 2 >= EEPROM_SIZE) {
+    if(position + 4 >= EEPROM_SIZE) {
         errorOccurred = true;
     }
     else {
-        eepromBuffer[position] = char(val & 0xff);
-        eepromBuffer[position + 1] = char((val >> 8U) & 0xffU);
-        eepromBuffer[position + 2] = char((val >> 16U) & 0xffU);
-        eepromBuffer[position + 3] = char((val >> 24U));
+        uint8_t data[4] = { uint8_t(val & 0xffU), uint8_t((val >> 8U) & 0xffU), uint8_t((val >> 16U) & 0xffU), uint8_t(val >> 24U) };
+        storeBytes(position, data, sizeof data);
     }
 }
 
@@ -122,7 +157,7 @@ void HalStm32EepromAbstraction::writeArrayToRom(EepromPosition romDest, const ui
         errorOccurred = true;
     }
     else {
-        memcpy(eepromBuffer + romDest, memSrc, len);
+        storeBytes(romDest, memSrc, len);
     }
 }
 
@@ -31,7 +31,9 @@
  * the internal battery backed memory. This has been tested with STM32F4 boards and is known to work with mbed 6.
  *
  * This implementation caches the data from the battery backed memory into regular RAM, to avoid having to manage
- * the RAMs clock frequently. After making adjustments on the object you call commit to push it into ROM.
+ * the RAMs clock frequently. After making adjustments on the object you call commit to push it into ROM. Each write
+ * marks the 32-bit words that it actually changed in a dirty bitmap, and commit only copies those words, as contiguous
+ * runs, so the time taken depends on how much changed rather than on the size of the cache.
  *
  * Regular usage is to globally create an instance of the class and then call `initialise(offset)` where offset is
  * the zero based offset from the start of memory at which to start writing.
@@ -39,6 +41,7 @@
 class HalStm32EepromAbstraction : public EepromAbstraction {
 private:
     char eepromBuffer[EEPROM_SIZE];
+    uint32_t dirtyWords[(EEPROM_WORD_SIZE + 31) / 32];
     uint16_t romBase;
     bool errorOccurred;
 public:
@@ -56,7 +59,7 @@ public:
     void refresh() { halReadFromCache(); }
 
     /**
-     * Commit the values now in cache to backup
+     * Commit the values now in cache to backup, only the words changed since the last commit are written.
      */
     void commit() { halWriteToCache(); }
 
@@ -118,6 +121,9 @@ public:
      */
     void writeArrayToRom(EepromPosition romDest, const uint8_t *memSrc, uint8_t len) override;
 
+    /** @return true if there are changes in the cache that are not yet committed */
+    bool isDirty() const;
+
     /**
      * Indicates if an error has occurred. IE if the regulator failed to enable or a write was outside of bounds
      * @return true if there has been an error, otherwise false.
@@ -128,6 +134,7 @@ private:
     void halReadFromCache();
     void halWriteToCache();
     void enableBackupRam();
+    void storeBytes(EepromPosition position, const uint8_t* data, size_t len);
 };
 
 #endif //IOA_HALSTM32EEPROMABSTRACTION_H or STM32 check
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+#ifdef IOA_ENABLE_STM32_HAL_EXTRAS
+
+#include <IoLogging.h>
+#include "HalStm32QuadratureCounter.h"
+#include <pinmap.h>
+#include <PeripheralPins.h>
+#include <pwmout_api.h>
+
+HalStm32QuadratureCounter::~HalStm32QuadratureCounter() {
+    if(started) HAL_TIM_Encoder_Stop(&timerHandle, TIM_CHANNEL_ALL);
+}
+
+bool HalStm32QuadratureCounter::begin(pinid_t pinA, pinid_t pinB) {
+    if(started) return true;
+
+    // both pins need to be the first two channels of the same timer, and not complementary outputs.
+    auto timerA = pinmap_peripheral((PinName)pinA, PinMap_PWM);
+    auto timerB = pinmap_peripheral((PinName)pinB, PinMap_PWM);
+    int functionA = pinmap_function((PinName)pinA, PinMap_PWM);
+    int functionB = pinmap_function((PinName)pinB, PinMap_PWM);
+    if(timerA == (uint32_t)NC || timerA != timerB || STM_PIN_CHANNEL(functionA) != 1 || STM_PIN_CHANNEL(functionB) != 2 ||
+       STM_PIN_INVERTED(functionA) || STM_PIN_INVERTED(functionB)) {
+        serlogF3(SER_ERROR, "Quadrature pins not CH1/CH2 of a timer ", pinA, pinB);
+        return false;
+    }
+
+    // the PWM set up enables the timer clock and puts the pins on the timer, the timer is then put into encoder mode.
+    pwmout_t pwmA, pwmB;
+    pwmout_init(&pwmA, (PinName)pinA);
+    pwmout_init(&pwmB, (PinName)pinB);
+    pin_mode((PinName)pinA, PullUp);
+    pin_mode((PinName)pinB, PullUp);
+
+    timerHandle.Instance = (TIM_TypeDef*)timerA;
+    timerHandle.Init.Prescaler = 0;
+    timerHandle.Init.CounterMode = TIM_COUNTERMODE_UP;
+    timerHandle.Init.Period = 0xFFFF;
+    timerHandle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    timerHandle.Init.RepetitionCounter = 0;
+
+    TIM_Encoder_InitTypeDef encoderConfig = {};
+    encoderConfig.EncoderMode = TIM_ENCODERMODE_TI12;
+    encoderConfig.IC1Polarity = TIM_ICPOLARITY_RISING;
+    encoderConfig.IC1Selection = TIM_ICSELECTION_DIRECTTI;
+    encoderConfig.IC1Prescaler = TIM_ICPSC_DIV1;
+    encoderConfig.IC1Filter = STM32_QUADRATURE_FILTER;
+    encoderConfig.IC2Polarity = TIM_ICPOLARITY_RISING;
+    encoderConfig.IC2Selection = TIM_ICSELECTION_DIRECTTI;
+    encoderConfig.IC2Prescaler = TIM_ICPSC_DIV1;
+    encoderConfig.IC2Filter = STM32_QUADRATURE_FILTER;
+
+    if(HAL_TIM_Encoder_Init(&timerHandle, &encoderConfig) != HAL_OK) return false;
+    if(HAL_TIM_Encoder_Start(&timerHandle, TIM_CHANNEL_ALL) != HAL_OK) return false;
+
+    lastValue = uint16_t(__HAL_TIM_GET_COUNTER(&timerHandle));
+    count = 0;
+    started = true;
+    serlogF3(SER_IOA_INFO, "STM32 quadrature started ", pinA, pinB);
+    return true;
+}
+
+int32_t HalStm32QuadratureCounter::readCount() {
+    if(!started) return count;
+    auto value = uint16_t(__HAL_TIM_GET_COUNTER(&timerHandle));
+    // the 16 bit difference is right across the counter wrapping, in either direction.
+    count += int16_t(uint16_t(value - lastValue));
+    lastValue = value;
+    return count;
+}
+
+#endif // IOA_ENABLE_STM32_HAL_EXTRAS
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2018 https://www.thecoderscorner.com (Dave Cherry).
+ * This product is licensed under an Apache license, see the LICENSE file in the top-level directory.
+ */
+
+/**
+ * Support for counting rotary encoders with an STM32 timer in encoder mode, where the timer counts every edge of both
+ * signals in hardware.
+ *
+ * Part of IoAbstraction extras for mbed on STM32, requires definition of IOA_ENABLE_STM32_HAL_EXTRAS to be included
+ *
+ * @file HalStm32QuadratureCounter.h
+ */
+#if !defined(IOA_HALSTM32QUADRATURECOUNTER_H) && defined(IOA_ENABLE_STM32_HAL_EXTRAS)
+#define IOA_HALSTM32QUADRATURECOUNTER_H
+
+#include <mbed.h>
+#include "../QuadratureCounterEncoder.h"
+
+// START user adjustable section
+
+/**
+ * The input filter applied to both encoder signals by the timer, from 0 for none up to 15, larger values need the
+ * signal to be stable for longer, see the input capture filter in the reference manual for the timer.
+ */
+#ifndef STM32_QUADRATURE_FILTER
+#define STM32_QUADRATURE_FILTER 10
+#endif
+
+// END user adjustable section
+
+/**
+ * A QuadratureCounter using an STM32 timer in encoder mode. The two pins must be channel 1 and channel 2 of the same
+ * timer, as given in the PWM pin map of the board, the timer is found from the pins and cannot then be used for PWM.
+ * The counter is read as 16 bits even on 32 bit timers, and each read adds the change since the last read to a wider
+ * count, so it must be read before it moves by 32767 counts, which at the default poll rate is millions of counts per
+ * second.
+ */
+class HalStm32QuadratureCounter : public QuadratureCounter {
+private:
+    TIM_HandleTypeDef timerHandle;
+    int32_t count;
+    uint16_t lastValue;
+    bool started;
+public:
+    HalStm32QuadratureCounter() : timerHandle{}, count(0), lastValue(0), started(false) {}
+    ~HalStm32QuadratureCounter() override;
+
+    bool begin(pinid_t pinA, pinid_t pinB) override;
+    int32_t readCount() override;
+};
+
+#endif //IOA_HALSTM32QUADRATURECOUNTER_H
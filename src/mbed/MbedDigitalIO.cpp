@@ -63,7 +63,64 @@ uint8_t BasicIoAbstraction::readPort(pinid_t port) {
     return 0xff;
 }
 
-GpioWrapper *BasicIoAbstraction::allocatePinIfNeedBe(uint8_t pinToAlloc) {
+IoPinMask BasicIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(this != &internalIoAbstraction) return readPinMaskByPin(startPin, mask);
+
+    // there is no portable port mapping on mbed, but we can at least avoid the virtual call per pin.
+    IoPinMask ret = 0;
+    for(uint8_t i = 0; mask != 0; i++, mask >>= 1U) {
+        if((mask & 1U) == 0) continue;
+        GpioWrapper* theGpio = allocatePinIfNeedBe(startPin + i);
+        if(theGpio != NULL && gpio_read(theGpio->getGpio())) ret |= (IoPinMask(1U) << i);
+    }
+    return ret;
+}
+
+void BasicIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(this != &internalIoAbstraction) {
+        writePinMaskByPin(startPin, mask, values);
+        return;
+    }
+
+    for(uint8_t i = 0; mask != 0; i++, mask >>= 1U, values >>= 1U) {
+        if((mask & 1U) == 0) continue;
+        GpioWrapper* theGpio = allocatePinIfNeedBe(startPin + i);
+        if(theGpio != NULL) gpio_write(theGpio->getGpio(), values & 1U);
+    }
+}
+
+#if IOA_MBED_PIN_TABLE_SIZE > 0
+
+static_assert(IOA_MBED_PIN_POOL_SIZE < 255, "IOA_MBED_PIN_POOL_SIZE must fit in the uint8_t table entries");
+
+// the direct index table holds the pool position plus one for each pin, zero meaning the pin is not in the pool yet.
+// Only the device itself uses allocatePinIfNeedBe, so a single table shared at file level is enough.
+static uint8_t pinToPoolIndex[IOA_MBED_PIN_TABLE_SIZE];
+static GpioWrapper pinPool[IOA_MBED_PIN_POOL_SIZE];
+static uint8_t pinPoolUsed = 0;
+
+#endif // IOA_MBED_PIN_TABLE_SIZE
+
+void BasicIoAbstraction::pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+    // each gpio_t is configured separately on mbed.
+    pinDirectionMaskByPin(startPin, mask, mode);
+}
+
+GpioWrapper *BasicIoAbstraction::allocatePinIfNeedBe(pinid_t pinToAlloc) {
+#if IOA_MBED_PIN_TABLE_SIZE > 0
+    if(pinToAlloc < IOA_MBED_PIN_TABLE_SIZE) {
+        uint8_t idx = pinToPoolIndex[pinToAlloc];
+        if(idx != 0) return &pinPool[idx - 1];
+        if(pinPoolUsed < IOA_MBED_PIN_POOL_SIZE) {
+            pinPool[pinPoolUsed] = GpioWrapper(pinToAlloc);
+            pinPoolUsed++;
+            pinToPoolIndex[pinToAlloc] = pinPoolUsed;
+            return &pinPool[pinPoolUsed - 1];
+        }
+        // the pool is full, drop through to the sparse list.
+    }
+#endif // IOA_MBED_PIN_TABLE_SIZE
+
     GpioWrapper* gpioWrapper = pinCache.getByKey(pinToAlloc);
     if(gpioWrapper == NULL) {
         pinCache.add(GpioWrapper(pinToAlloc));
@@ -22,6 +22,20 @@
 #define HIGH 1
 #define LOW 0
 
+/**
+ * On mbed the device pins are normally held in a BtreeList that is searched for every read and write. To make each
+ * lookup a direct index instead, define IOA_MBED_PIN_TABLE_SIZE as one more than the highest PinName value you use,
+ * (for example 0x80 on most STM32 boards), then up to IOA_MBED_PIN_POOL_SIZE pins are held in a fixed pool with no
+ * heap allocation at all. Pins outside the table, or once the pool is full, are still stored in the BtreeList.
+ */
+#ifndef IOA_MBED_PIN_TABLE_SIZE
+#define IOA_MBED_PIN_TABLE_SIZE 0
+#endif
+
+#ifndef IOA_MBED_PIN_POOL_SIZE
+#define IOA_MBED_PIN_POOL_SIZE 32
+#endif
+
 #define bitRead(value, bit) (((value) & (1 << (bit))) != 0)
 #define bitSet(value, bit) ((value) |= (1UL << (bit)))
 #define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
@@ -5,6 +5,7 @@
 
 #include <TaskManagerIO.h>
 #include "PlatformDeterminationWire.h"
+#include "I2cBusStatistics.h"
 
 #ifdef IOA_USE_MBED_WIRE
 
@@ -20,17 +21,30 @@ void ioaWireSetSpeed(WireType i2c, long frequency) {
 }
 
 bool ioaWireRead(WireType pI2c, int address, uint8_t* buffer, size_t len) {
-    return pI2c->read(address, (char*)buffer, len, false) == 0;
+    IOA_I2C_STATS_START
+    bool ok = pI2c->read(address, (char*)buffer, len, false) == 0;
+    // mbed takes the 8 bit address, the statistics are by 7 bit address as on other boards.
+    IOA_I2C_STATS_RECORD(address >> 1, len, ok, 0)
+    return ok;
 }
 
 bool ioaWireWriteWithRetry(WireType pI2c, int address, const uint8_t* buffer, size_t len, int retriesAllowed, bool sendStop) {
+    IOA_I2C_STATS_START
     int tries = 0;
     while(pI2c->write(address, (const char*)buffer, len, !sendStop) !=0) {
-        if(tries > retriesAllowed) return false;
+        if(tries > retriesAllowed) {
+            IOA_I2C_STATS_RECORD(address >> 1, len, false, tries)
+            return false;
+        }
         taskManager.yieldForMicros(50);
         tries++;
     }
+    IOA_I2C_STATS_RECORD(address >> 1, len, true, tries)
     return true;
 }
 
+bool ioaWireReady(WireType pI2c, int address) {
+    return pI2c->write(address, nullptr, 0, false) == 0;
+}
+
 #endif
@@ -0,0 +1,57 @@
+#include "PicoCoreOneInput.h"
+#include "IoLogging.h"
+
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+#include <pico/multicore.h>
+
+PicoCoreOneInput picoCoreOneInput;
+
+bool PicoCoreOneInput::start(uint32_t intervalMicros) {
+    if(running) return false;
+    if(!switches.isExternallyPolled()) {
+        serlogF(SER_WARNING, "Core 1 input needs SWITCHES_POLL_EXTERNALLY");
+        return false;
+    }
+    if(!sectionInitialised) {
+        critical_section_init(&queueSection);
+        sectionInitialised = true;
+    }
+
+    pollMicros = intervalMicros;
+    switches.setCrossThreadDelivery(this);
+    stopRequested = false;
+    running = true;
+    multicore_launch_core1(coreOneEntry);
+    serlogF2(SER_IOA_INFO, "Switches on core 1, poll us=", intervalMicros);
+    return true;
+}
+
+void PicoCoreOneInput::stop() {
+    if(!running) return;
+    stopRequested = true;
+    while(running) {
+        tight_loop_contents();
+    }
+    multicore_reset_core1();
+
+    // anything core 1 queued is delivered before switches goes back to delivering on the thread that reads them.
+    switches.setCrossThreadDelivery(nullptr);
+}
+
+void PicoCoreOneInput::coreOneEntry() {
+    picoCoreOneInput.pollLoop();
+}
+
+void PicoCoreOneInput::pollLoop() {
+    // each poll is timed from the start of the last, so that the interval does not drift with the time a poll takes.
+    absolute_time_t nextPoll = get_absolute_time();
+    while(!stopRequested) {
+        switches.pollEverything();
+        nextPoll = delayed_by_us(nextPoll, pollMicros);
+        sleep_until(nextPoll);
+    }
+    running = false;
+}
+
+#endif // BUILD_FOR_PICO_CMAKE
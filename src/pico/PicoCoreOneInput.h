@@ -0,0 +1,62 @@
+#ifndef IOABSTRACTION_PICO_CORE_ONE_INPUT_H
+#define IOABSTRACTION_PICO_CORE_ONE_INPUT_H
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+/**
+ * @file PicoCoreOneInput.h
+ * @brief Runs the polling, sync and debounce of switches and encoders on the second core of the RP2040, with the
+ * callbacks still delivered on task manager on core 0.
+ */
+
+#include "../SwitchInput.h"
+#include <pico/critical_section.h>
+
+/**
+ * Moves switches onto core 1 of the RP2040, so that rendering a display or networking on core 0 no longer delays
+ * the reading of inputs. Core 1 calls switches.pollEverything at a fixed interval, which syncs the device, debounces
+ * the keys and decodes the encoders, each event found is queued under a hardware spin lock and task manager on core
+ * 0 is given a task to deliver them, so every callback and listener is still called on core 0.
+ *
+ * To use it, initialise switches with SWITCHES_POLL_EXTERNALLY, add all the switches and encoders, then call start.
+ * From then on the device that the switches are on belongs to core 1, so it must not be used from core 0, and the
+ * switches should not be changed without stopping first. Only one instance, picoCoreOneInput, can be used, and
+ * core 1 cannot be used for anything else while it runs.
+ */
+class PicoCoreOneInput : public SwitchEventQueueLock {
+private:
+    critical_section_t queueSection;
+    uint32_t pollMicros;
+    volatile bool running;
+    volatile bool stopRequested;
+    bool sectionInitialised;
+public:
+    PicoCoreOneInput() : queueSection{}, pollMicros(0), running(false), stopRequested(false), sectionInitialised(false) {}
+
+    /**
+     * Launches the polling loop on core 1.
+     * @param intervalMicros the interval between polls, the keys are read every eighth poll
+     * @return true if started, false if already running or switches is not in SWITCHES_POLL_EXTERNALLY mode
+     */
+    bool start(uint32_t intervalMicros = millisToMicros(SWITCH_POLL_INTERVAL) / 8);
+
+    /** Stops the polling loop, waiting for the current poll to finish, then resets core 1 */
+    void stop();
+
+    /** @return true while core 1 is polling */
+    bool isRunning() const { return running; }
+
+    void lock() override { critical_section_enter_blocking(&queueSection); }
+    void unlock() override { critical_section_exit(&queueSection); }
+
+private:
+    static void coreOneEntry();
+    void pollLoop();
+};
+
+/**
+ * The instance that runs switches on core 1, see PicoCoreOneInput.
+ */
+extern PicoCoreOneInput picoCoreOneInput;
+
+#endif // BUILD_FOR_PICO_CMAKE
+#endif //IOABSTRACTION_PICO_CORE_ONE_INPUT_H
@@ -7,14 +7,42 @@
 
 void BasicIoAbstraction::pinDirection(pinid_t pin, uint8_t mode) {
     gpio_init(pin);
-    if(mode == INPUT || mode == INPUT_PULLUP) {
+    if(mode == INPUT || mode == INPUT_PULLUP || mode == INPUT_PULLDOWN) {
         gpio_set_dir(pin, GPIO_IN);
         if(mode == INPUT_PULLUP) gpio_pull_up(pin);
+        else if(mode == INPUT_PULLDOWN) gpio_pull_down(pin);
     } else {
         gpio_set_dir(pin, GPIO_OUT);
     }
 }
 
+void BasicIoAbstraction::pinDirectionMask(pinid_t startPin, IoPinMask mask, uint8_t mode) {
+    if(this != &internalIoAbstraction) {
+        pinDirectionMaskByPin(startPin, mask, mode);
+        return;
+    }
+    if(startPin >= 32) return;
+
+    // the SIO block sets the direction of many pins in one access, only pins not already on SIO are initialised, so
+    // that the output state of pins already set up is kept, and the pulls remain per pin.
+    uint32_t pins = mask << startPin;
+    uint32_t needInit = 0;
+    for(uint8_t pin = 0; pin < 32; pin++) {
+        if((pins & (1UL << pin)) && gpio_get_function(pin) != GPIO_FUNC_SIO) needInit |= (1UL << pin);
+    }
+    if(needInit) gpio_init_mask(needInit);
+    if(mode == INPUT || mode == INPUT_PULLUP || mode == INPUT_PULLDOWN) {
+        gpio_set_dir_in_masked(pins);
+        if(mode != INPUT) {
+            for(uint8_t pin = 0; pin < 32; pin++) {
+                if(pins & (1UL << pin)) gpio_set_pulls(pin, mode == INPUT_PULLUP, mode == INPUT_PULLDOWN);
+            }
+        }
+    } else {
+        gpio_set_dir_out_masked(pins);
+    }
+}
+
 void BasicIoAbstraction::writeValue(pinid_t pin, uint8_t value) {
     gpio_put(pin, value != 0);
 }
@@ -73,6 +101,22 @@ uint8_t BasicIoAbstraction::readPort(pinid_t port) {
 
 BasicIoAbstraction internalIoAbstraction;
 
+IoPinMask BasicIoAbstraction::readPinMask(pinid_t startPin, IoPinMask mask) {
+    // only the device pins can go direct to the SIO registers, anything extending us must use its own readValue.
+    if(this != &internalIoAbstraction) return readPinMaskByPin(startPin, mask);
+    if(startPin >= 32) return 0;
+    return (gpio_get_all() >> startPin) & mask;
+}
+
+void BasicIoAbstraction::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(this != &internalIoAbstraction) {
+        writePinMaskByPin(startPin, mask, values);
+        return;
+    }
+    if(startPin >= 32) return;
+    gpio_put_masked(mask << startPin, (values & mask) << startPin);
+}
+
 IoAbstractionRef internalDigitalIo() {
     return &internalIoAbstraction;
 }
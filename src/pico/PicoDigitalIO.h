@@ -7,6 +7,7 @@
 
 #define INPUT 0x01
 #define INPUT_PULLUP 0x02
+#define INPUT_PULLDOWN 0x03
 #define OUTPUT 0xff
 #define RISING 0x01
 #define FALLING 0x02
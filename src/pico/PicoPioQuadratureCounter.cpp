@@ -0,0 +1,109 @@
+#include "PicoPioQuadratureCounter.h"
+#include "IoLogging.h"
+
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+#include <hardware/gpio.h>
+#include <hardware/pio_instructions.h>
+
+namespace {
+    // the labels within the program, which must be loaded at address 0 as the jump table is entered with mov pc.
+    const uint QUAD_DECREMENT = 14;
+    const uint QUAD_UPDATE = 15;
+    const uint QUAD_INCREMENT = 21;
+    const uint QUAD_INCREMENT_CONT = 23;
+    const uint QUAD_LENGTH = 24;
+
+    // Y holds the count. OSR holds the previous and current pin states, the current state is shifted into ISR, then
+    // the new pins after it, and the four bits select an entry in the jump table of transitions. The last two entries
+    // of the table are the first instructions of decrement and update, so the table fits in 16 instructions.
+    uint16_t quadInstructions[QUAD_LENGTH] = {
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 00 to 00
+            uint16_t(pio_encode_jmp(QUAD_DECREMENT)),      // 00 to 01
+            uint16_t(pio_encode_jmp(QUAD_INCREMENT)),      // 00 to 10
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 00 to 11
+            uint16_t(pio_encode_jmp(QUAD_INCREMENT)),      // 01 to 00
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 01 to 01
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 01 to 10
+            uint16_t(pio_encode_jmp(QUAD_DECREMENT)),      // 01 to 11
+            uint16_t(pio_encode_jmp(QUAD_DECREMENT)),      // 10 to 00
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 10 to 01
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 10 to 10
+            uint16_t(pio_encode_jmp(QUAD_INCREMENT)),      // 10 to 11
+            uint16_t(pio_encode_jmp(QUAD_UPDATE)),         // 11 to 00
+            uint16_t(pio_encode_jmp(QUAD_INCREMENT)),      // 11 to 01
+            // decrement, 11 to 10
+            uint16_t(pio_encode_jmp_y_dec(QUAD_UPDATE)),
+            // update, 11 to 11, the wrap target
+            uint16_t(pio_encode_mov(pio_isr, pio_y)),
+            uint16_t(pio_encode_push(false, false)),
+            uint16_t(pio_encode_out(pio_isr, 2)),
+            uint16_t(pio_encode_in(pio_pins, 2)),
+            uint16_t(pio_encode_mov(pio_osr, pio_isr)),
+            uint16_t(pio_encode_mov(pio_pc, pio_isr)),
+            // increment, Y is inverted, decremented and inverted back, the jump is taken or not to the same place.
+            uint16_t(pio_encode_mov_not(pio_y, pio_y)),
+            uint16_t(pio_encode_jmp_y_dec(QUAD_INCREMENT_CONT)),
+            uint16_t(pio_encode_mov_not(pio_y, pio_y)),
+    };
+    const pio_program_t quadProgram = { quadInstructions, QUAD_LENGTH, 0 };
+
+    bool quadProgramLoaded[NUM_PIOS] = {};
+}
+
+PicoPioQuadratureCounter::~PicoPioQuadratureCounter() {
+    if(sm >= 0) {
+        pio_sm_set_enabled(pio, sm, false);
+        pio_sm_unclaim(pio, sm);
+    }
+}
+
+bool PicoPioQuadratureCounter::begin(pinid_t pinA, pinid_t pinB) {
+    if(sm >= 0) return true;
+    if(pinB != pinA + 1) {
+        serlogF(SER_ERROR, "PIO quadrature needs B = A + 1");
+        return false;
+    }
+
+    uint pioIndex = pio_get_index(pio);
+    if(!quadProgramLoaded[pioIndex]) {
+        if(!pio_can_add_program_at_offset(pio, &quadProgram, 0)) return false;
+        pio_add_program_at_offset(pio, &quadProgram, 0);
+        quadProgramLoaded[pioIndex] = true;
+    }
+    sm = pio_claim_unused_sm(pio, false);
+    if(sm < 0) return false;
+
+    pio_gpio_init(pio, pinA);
+    pio_gpio_init(pio, pinB);
+    gpio_pull_up(pinA);
+    gpio_pull_up(pinB);
+    pio_sm_set_consecutive_pindirs(pio, sm, pinA, 2, false);
+
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, QUAD_UPDATE, QUAD_LENGTH - 1);
+    sm_config_set_in_pins(&c, pinA);
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_out_shift(&c, true, false, 32);
+    // only the RX FIFO is used, joining them gives the newest count more room before it is dropped.
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&c, 1.0F);
+
+    pio_sm_init(pio, sm, 0, &c);
+    pio_sm_set_enabled(pio, sm, true);
+    return true;
+}
+
+int32_t PicoPioQuadratureCounter::readCount() {
+    if(sm < 0) return lastCount;
+    // the count is pushed all the time, so drain the FIFO and keep the newest, when it is full new counts are dropped.
+    uint level = pio_sm_get_rx_fifo_level(pio, sm);
+    while(level--) {
+        lastCount = int32_t(pio_sm_get(pio, sm));
+    }
+    // the FIFO could have filled straight back up with older counts, so wait for the one pushed after the drain.
+    lastCount = int32_t(pio_sm_get_blocking(pio, sm));
+    return lastCount;
+}
+
+#endif // BUILD_FOR_PICO_CMAKE
@@ -0,0 +1,39 @@
+#ifndef IOABSTRACTION_PICO_PIO_QUADRATURE_COUNTER_H
+#define IOABSTRACTION_PICO_PIO_QUADRATURE_COUNTER_H
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+/**
+ * @file PicoPioQuadratureCounter.h
+ * @brief Counts the edges of a rotary encoder in a PIO state machine on the RP2040.
+ */
+
+#include "../QuadratureCounterEncoder.h"
+#include <hardware/pio.h>
+
+/**
+ * A QuadratureCounter that decodes the encoder in a PIO state machine running at the full system clock, so it can
+ * follow millions of steps per second. The state machine keeps the count and pushes it to its FIFO continuously,
+ * reading the count just takes the newest value from the FIFO.
+ *
+ * The B pin must be the GPIO straight after the A pin. The program takes the whole of the PIO instruction memory
+ * from address 0 onwards that it needs, so it is loaded once per PIO and shared by all the counters on that PIO, and
+ * other programs on the same PIO must fit after it.
+ */
+class PicoPioQuadratureCounter : public QuadratureCounter {
+private:
+    PIO pio;
+    int sm;
+    int32_t lastCount;
+public:
+    /**
+     * @param pio the PIO block to use, defaults to pio1 so that pio0 is free for other programs
+     */
+    explicit PicoPioQuadratureCounter(PIO pio = pio1) : pio(pio), sm(-1), lastCount(0) {}
+    ~PicoPioQuadratureCounter() override;
+
+    bool begin(pinid_t pinA, pinid_t pinB) override;
+    int32_t readCount() override;
+};
+
+#endif // BUILD_FOR_PICO_CMAKE
+#endif //IOABSTRACTION_PICO_PIO_QUADRATURE_COUNTER_H
@@ -0,0 +1,347 @@
+#include "PicoPioShiftRegister.h"
+#include "IoLogging.h"
+
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+#include <hardware/dma.h>
+#include <hardware/clocks.h>
+#include <hardware/pio_instructions.h>
+#include <string.h>
+
+// the clock is the one side set pin, leaving 4 bits of each instruction for the delay.
+#define SHIFTREG_SIDE(v) pio_encode_sideset(1, v)
+
+namespace {
+    // the 595 output program, the clock is side set, the data is the out pin and the latch the set pin. Each frame
+    // starts with the bit count less one, the pull discards any unused bits left from the last frame, then the chain
+    // is clocked out MSB first with autopull, and the latch rises to update the outputs once all bits are in.
+    uint16_t outInstructions[] = {
+            uint16_t(pio_encode_pull(false, true) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_out(pio_x, 32) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_set(pio_pins, 0) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_out(pio_pins, 1) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_jmp_x_dec(3) | SHIFTREG_SIDE(1)),
+            uint16_t(pio_encode_set(pio_pins, 1) | SHIFTREG_SIDE(0)),
+    };
+    const pio_program_t outProgram = { outInstructions, sizeof(outInstructions) / sizeof(uint16_t), -1 };
+
+    // the 165 input program, the clock is side set, the data is the in pin and the load the set pin. Each capture is
+    // started by writing the bit count less one, the load pulse captures every input at once and presents the first
+    // bit, so each bit is sampled while the clock is low and the rising edge then shifts the next bit out. Autopush
+    // hands each byte to the RX FIFO.
+    uint16_t inInstructions[] = {
+            uint16_t(pio_encode_pull(false, true) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_out(pio_x, 32) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_set(pio_pins, 0) | SHIFTREG_SIDE(0) | pio_encode_delay(15)),
+            uint16_t(pio_encode_set(pio_pins, 1) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_in(pio_pins, 1) | SHIFTREG_SIDE(0)),
+            uint16_t(pio_encode_jmp_x_dec(4) | SHIFTREG_SIDE(1)),
+    };
+    const pio_program_t inProgram = { inInstructions, sizeof(inInstructions) / sizeof(uint16_t), -1 };
+
+    bool startStateMachine(PIO pio, int sm, const pio_program_t* program, const ShiftRegConfig& config, uint32_t bitRate,
+                           bool input, int& loadedAt) {
+        if(!pio_can_add_program(pio, program)) return false;
+        uint offset = pio_add_program(pio, program);
+        loadedAt = int(offset);
+
+        pio_sm_config c = pio_get_default_sm_config();
+        sm_config_set_wrap(&c, offset, offset + program->length - 1);
+        sm_config_set_sideset(&c, 1, false, false);
+        sm_config_set_sideset_pins(&c, config.clock);
+        sm_config_set_set_pins(&c, config.latch, 1);
+        if(input) {
+            sm_config_set_in_pins(&c, config.data);
+            sm_config_set_in_shift(&c, false, true, 8);
+            sm_config_set_out_shift(&c, false, false, 32);
+        } else {
+            sm_config_set_out_pins(&c, config.data, 1);
+            sm_config_set_out_shift(&c, false, true, 32);
+            sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+        }
+        // each output and input bit takes two instructions, one with the clock low and one with it high.
+        sm_config_set_clkdiv(&c, float(clock_get_hz(clk_sys)) / (2.0F * float(bitRate)));
+
+        pio_gpio_init(pio, config.clock);
+        pio_gpio_init(pio, config.latch);
+        pio_gpio_init(pio, config.data);
+        pio_sm_set_pins_with_mask(pio, sm, 1U << config.latch, (1U << config.latch) | (1U << config.clock));
+        pio_sm_set_consecutive_pindirs(pio, sm, config.clock, 1, true);
+        pio_sm_set_consecutive_pindirs(pio, sm, config.latch, 1, true);
+        pio_sm_set_consecutive_pindirs(pio, sm, config.data, 1, !input);
+
+        pio_sm_init(pio, sm, offset, &c);
+        pio_sm_set_enabled(pio, sm, true);
+        return true;
+    }
+}
+
+PicoPioShiftRegister::PicoPioShiftRegister(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig, PIO pio)
+        : pio(pio), readConfig(readConfig), writeConfig(writeConfig), bitRate(PICO_SHIFTREG_BIT_RATE), outSm(-1), inSm(-1),
+          outDma(-1), outControlDma(-1), inDma(-1), outOffset(-1), inOffset(-1), outFrame(nullptr), outFrameAddress(nullptr), outFrameWords(0),
+          toWrite(nullptr), lastRead(nullptr), captureBuffer(nullptr), completedCaptures(0), needsInit(true),
+          initOk(false), needsWrite(true), backgroundRefresh(false), blockingCapture(true), captureInProgress(false) {
+    if(this->readConfig.numDevices > 4) this->readConfig.numDevices = 4;
+    if(this->readConfig.numDevices) {
+        lastRead = new uint8_t[this->readConfig.numDevices];
+        captureBuffer = new uint8_t[this->readConfig.numDevices];
+        memset(lastRead, 0, this->readConfig.numDevices);
+    }
+    if(this->writeConfig.numDevices) {
+        toWrite = new uint8_t[this->writeConfig.numDevices];
+        memset(toWrite, 0, this->writeConfig.numDevices);
+        outFrameWords = 1 + ((this->writeConfig.numDevices + 3) / 4);
+        outFrame = new uint32_t[outFrameWords * 2];
+        packFrame();
+    }
+}
+
+PicoPioShiftRegister::~PicoPioShiftRegister() {
+    stopBackgroundRefresh();
+    if(inDma >= 0) {
+        dma_channel_abort(inDma);
+        dma_channel_unclaim(inDma);
+    }
+    if(outSm >= 0) {
+        pio_sm_set_enabled(pio, outSm, false);
+        pio_sm_unclaim(pio, outSm);
+    }
+    if(inSm >= 0) {
+        pio_sm_set_enabled(pio, inSm, false);
+        pio_sm_unclaim(pio, inSm);
+    }
+    if(outOffset >= 0) pio_remove_program(pio, &outProgram, outOffset);
+    if(inOffset >= 0) pio_remove_program(pio, &inProgram, inOffset);
+    delete[] lastRead;
+    delete[] captureBuffer;
+    delete[] toWrite;
+    delete[] outFrame;
+}
+
+bool PicoPioShiftRegister::initDevice() {
+    if(!needsInit) return initOk;
+    needsInit = false;
+    initOk = (writeConfig.numDevices == 0 || initOutputs()) && (readConfig.numDevices == 0 || initInputs());
+    serlogF2(initOk ? SER_IOA_INFO : SER_ERROR, "PIO shift register init ", initOk);
+    if(initOk && backgroundRefresh) startBackgroundRefresh();
+    return initOk;
+}
+
+bool PicoPioShiftRegister::initOutputs() {
+    outSm = pio_claim_unused_sm(pio, false);
+    if(outSm < 0) return false;
+    return startStateMachine(pio, outSm, &outProgram, writeConfig, bitRate, false, outOffset);
+}
+
+bool PicoPioShiftRegister::initInputs() {
+    inSm = pio_claim_unused_sm(pio, false);
+    if(inSm < 0) return false;
+    inDma = dma_claim_unused_channel(false);
+    if(inDma < 0) {
+        // give the state machine back, as the object may live on with init failed.
+        pio_sm_unclaim(pio, inSm);
+        inSm = -1;
+        return false;
+    }
+    return startStateMachine(pio, inSm, &inProgram, readConfig, bitRate, true, inOffset);
+}
+
+bool PicoPioShiftRegister::packFrame() {
+    // the frame is built in the buffer that is not being sent and then published, so the DMA never reads a partly
+    // built frame. Should the DMA still be finishing a pass of that buffer, the change waits for the next sync.
+    uint32_t* frame = (outFrameAddress == outFrame) ? outFrame + outFrameWords : outFrame;
+    if(outDma >= 0) {
+        uintptr_t readAt = dma_hw->ch[outDma].read_addr;
+        if(readAt >= uintptr_t(frame) && readAt <= uintptr_t(frame + outFrameWords)) return false;
+    }
+
+    frame[0] = (uint32_t(writeConfig.numDevices) * 8U) - 1U;
+    // each word of the frame holds the next four bytes of the chain, the first byte in the top bits.
+    for(uint16_t w = 1; w < outFrameWords; w++) {
+        uint32_t word = 0;
+        for(uint8_t b = 0; b < 4; b++) {
+            unsigned int idx = ((w - 1) * 4) + b;
+            uint8_t val = (idx < writeConfig.numDevices) ? toWrite[idx] : 0;
+            word |= uint32_t(val) << (24 - (b * 8));
+        }
+        frame[w] = word;
+    }
+    outFrameAddress = frame;
+    return true;
+}
+
+void PicoPioShiftRegister::setBackgroundRefresh(bool refresh) {
+    if(refresh == backgroundRefresh) return;
+    backgroundRefresh = refresh;
+    if(needsInit || !initOk) return;
+    if(refresh) {
+        startBackgroundRefresh();
+    } else {
+        stopBackgroundRefresh();
+    }
+}
+
+void PicoPioShiftRegister::startBackgroundRefresh() {
+    if(outSm < 0 || outDma >= 0) return;
+    outDma = dma_claim_unused_channel(false);
+    outControlDma = dma_claim_unused_channel(false);
+    if(outDma < 0 || outControlDma < 0) {
+        serlogF(SER_ERROR, "No DMA for PIO background refresh");
+        stopBackgroundRefresh();
+        backgroundRefresh = false;
+        return;
+    }
+
+    // the data channel sends the frame then chains to the control channel, which points it back at the start of
+    // the frame and so triggers it again, the chain is refreshed for ever without the CPU.
+    dma_channel_config dataConfig = dma_channel_get_default_config(outDma);
+    channel_config_set_transfer_data_size(&dataConfig, DMA_SIZE_32);
+    channel_config_set_read_increment(&dataConfig, true);
+    channel_config_set_write_increment(&dataConfig, false);
+    channel_config_set_dreq(&dataConfig, pio_get_dreq(pio, outSm, true));
+    channel_config_set_chain_to(&dataConfig, outControlDma);
+    dma_channel_configure(outDma, &dataConfig, &pio->txf[outSm], outFrameAddress, outFrameWords, false);
+
+    dma_channel_config controlConfig = dma_channel_get_default_config(outControlDma);
+    channel_config_set_transfer_data_size(&controlConfig, DMA_SIZE_32);
+    channel_config_set_read_increment(&controlConfig, false);
+    channel_config_set_write_increment(&controlConfig, false);
+    dma_channel_configure(outControlDma, &controlConfig, &dma_hw->ch[outDma].al3_read_addr_trig, &outFrameAddress, 1, false);
+
+    // any change not yet packed is picked up by the next sync.
+    dma_channel_start(outControlDma);
+}
+
+void PicoPioShiftRegister::stopBackgroundRefresh() {
+    if(outControlDma >= 0) {
+        // the control channel is stopped first, so that it cannot restart the data channel once that is stopped.
+        dma_channel_abort(outControlDma);
+        if(outDma >= 0) dma_channel_abort(outDma);
+        dma_channel_abort(outControlDma);
+        dma_channel_unclaim(outControlDma);
+        outControlDma = -1;
+    }
+    if(outDma >= 0) {
+        dma_channel_abort(outDma);
+        dma_channel_unclaim(outDma);
+        outDma = -1;
+    }
+    if(outSm >= 0 && outOffset >= 0) {
+        // the abort can leave part of a frame in the FIFO and OSR, so the state machine is emptied and sent back to
+        // the start of the program, otherwise the next frame would be read from the middle of the last one.
+        pio_sm_set_enabled(pio, outSm, false);
+        pio_sm_clear_fifos(pio, outSm);
+        pio_sm_restart(pio, outSm);
+        pio_sm_exec(pio, outSm, pio_encode_jmp(outOffset));
+        pio_sm_set_enabled(pio, outSm, true);
+    }
+    // the last frame sent stays latched, but any change since must be sent by the next sync.
+    needsWrite = true;
+}
+
+void PicoPioShiftRegister::captureInputs() {
+    if(needsInit) initDevice();
+    if(!initOk || inSm < 0 || captureInProgress) return;
+    startCapture();
+}
+
+void PicoPioShiftRegister::startCapture() {
+    dma_channel_config rxConfig = dma_channel_get_default_config(inDma);
+    channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+    channel_config_set_read_increment(&rxConfig, false);
+    channel_config_set_write_increment(&rxConfig, true);
+    channel_config_set_dreq(&rxConfig, pio_get_dreq(pio, inSm, false));
+    dma_channel_configure(inDma, &rxConfig, captureBuffer, &pio->rxf[inSm], readConfig.numDevices, true);
+
+    captureInProgress = true;
+    pio_sm_put(pio, inSm, (uint32_t(readConfig.numDevices) * 8U) - 1U);
+}
+
+void PicoPioShiftRegister::completeCapture() {
+    // the device furthest along the chain arrives first, it holds the highest numbered pins.
+    for(uint8_t i = 0; i < readConfig.numDevices; i++) {
+        lastRead[readConfig.numDevices - 1 - i] = captureBuffer[i];
+    }
+    captureInProgress = false;
+    completedCaptures++;
+}
+
+bool PicoPioShiftRegister::runLoop() {
+    if(needsInit) initDevice();
+    if(!initOk) return false;
+
+    if(inSm >= 0) {
+        if(captureInProgress && !dma_channel_is_busy(inDma)) completeCapture();
+        if(!captureInProgress) startCapture();
+        if(blockingCapture) {
+            dma_channel_wait_for_finish_blocking(inDma);
+            completeCapture();
+        }
+    }
+
+    if(outSm >= 0 && needsWrite && packFrame()) {
+        needsWrite = false;
+        // with background refresh the next pass of the DMA picks the frame up, otherwise it is queued to the FIFO.
+        if(!backgroundRefresh) {
+            for(uint16_t i = 0; i < outFrameWords; i++) {
+                pio_sm_put_blocking(pio, outSm, outFrameAddress[i]);
+            }
+        }
+    }
+    return true;
+}
+
+void PicoPioShiftRegister::writeValue(pinid_t pin, uint8_t value) {
+    if(pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
+    pin = pin - SHIFT_REGISTER_OUTPUT_CUTOVER;
+    if((pin / 8) >= writeConfig.numDevices) return;
+
+    uint8_t& current = toWrite[pin / 8];
+    uint8_t newVal = value ? (current | (1U << (pin % 8))) : (current & ~(1U << (pin % 8)));
+    if(newVal != current) {
+        current = newVal;
+        needsWrite = true;
+    }
+}
+
+uint8_t PicoPioShiftRegister::readValue(pinid_t pin) {
+    if((pin / 8) >= readConfig.numDevices) return LOW;
+    return ((lastRead[pin / 8] & (1U << (pin % 8))) != 0) ? HIGH : LOW;
+}
+
+void PicoPioShiftRegister::writePort(pinid_t pin, uint8_t portVal) {
+    if(pin < SHIFT_REGISTER_OUTPUT_CUTOVER) return;
+    pinid_t device = (pin - SHIFT_REGISTER_OUTPUT_CUTOVER) / 8;
+    if(device >= writeConfig.numDevices) return;
+    if(toWrite[device] != portVal) {
+        toWrite[device] = portVal;
+        needsWrite = true;
+    }
+}
+
+uint8_t PicoPioShiftRegister::readPort(pinid_t pin) {
+    pinid_t device = pin / 8;
+    return (device < readConfig.numDevices) ? lastRead[device] : 0;
+}
+
+IoPinMask PicoPioShiftRegister::readPinMask(pinid_t startPin, IoPinMask mask) {
+    if(startPin >= SHIFT_REGISTER_OUTPUT_CUTOVER) return 0;
+    return shiftRegBufferRead(lastRead, readConfig.numDevices, startPin) & mask;
+}
+
+void PicoPioShiftRegister::writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) {
+    if(startPin < SHIFT_REGISTER_OUTPUT_CUTOVER) {
+        uint8_t toSkip = SHIFT_REGISTER_OUTPUT_CUTOVER - startPin;
+        if(toSkip >= 32) return;
+        mask >>= toSkip;
+        values >>= toSkip;
+        startPin = SHIFT_REGISTER_OUTPUT_CUTOVER;
+    }
+    if(mask == 0 || writeConfig.numDevices == 0) return;
+
+    if(shiftRegBufferWrite(toWrite, writeConfig.numDevices, startPin - SHIFT_REGISTER_OUTPUT_CUTOVER, mask, values)) {
+        needsWrite = true;
+    }
+}
+
+#endif // BUILD_FOR_PICO_CMAKE
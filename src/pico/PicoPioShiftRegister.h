@@ -0,0 +1,160 @@
+#ifndef IOABSTRACTION_PICO_PIO_SHIFT_REGISTER_H
+#define IOABSTRACTION_PICO_PIO_SHIFT_REGISTER_H
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+/**
+ * @file PicoPioShiftRegister.h
+ * @brief Drives 74HC595 output and 74HC165 input shift register chains from a PIO state machine on the RP2040, so
+ * that the chains are clocked in hardware and the output chain can be refreshed continuously by DMA.
+ */
+
+#include "../IoAbstraction.h"
+#include <hardware/pio.h>
+
+// START user adjustable section
+
+/**
+ * The default rate in bits per second that the chains are clocked at, 595 and 165 devices run far faster than
+ * this at 3.3V, but long wiring to the chains may need it lowered with setBitRate.
+ */
+#ifndef PICO_SHIFTREG_BIT_RATE
+#define PICO_SHIFTREG_BIT_RATE 5000000
+#endif
+
+// END user adjustable section
+
+/**
+ * A shift register abstraction with the same pin layout as ShiftRegisterIoAbstraction, up to four 165 input devices
+ * on pins 0 to 31 and a 595 output chain of any length from pin 32 onwards, but where each chain is clocked by its own
+ * PIO state machine instead of being bit banged. The clock, data and latch pins can be any GPIO.
+ *
+ * For the outputs, by default each sync that follows a change queues the chain to the state machine and returns
+ * straight away. With setBackgroundRefresh, two DMA channels instead send the chain to the state machine over and over
+ * with no CPU time at all, as is needed when the chain drives a multiplexed LED display, each change is then picked up
+ * by the next refresh.
+ *
+ * For the inputs, each sync captures the inputs in one load of the 165 chain, so all the pins are from the same
+ * instant, and reads always see the last complete capture. By default sync waits for the capture, which takes a few
+ * microseconds, see setBlockingCapture to instead pick up the capture at the next sync.
+ *
+ * It needs a free state machine in the chosen PIO for each chain used, and two DMA channels for background refresh
+ * and one for input capture.
+ */
+class PicoPioShiftRegister : public BasicIoAbstraction {
+private:
+    PIO pio;
+    ShiftRegConfig readConfig;
+    ShiftRegConfig writeConfig;
+    uint32_t bitRate;
+    int outSm;
+    int inSm;
+    int outDma;
+    int outControlDma;
+    int inDma;
+    // where each program was loaded into the PIO instruction memory, -1 until loaded.
+    int outOffset;
+    int inOffset;
+    // the output frame is the bit count less one, followed by the chain packed MSB first, as the state machine needs.
+    // There are two frames back to back, the one last published is read by the DMA while the other is built.
+    uint32_t* outFrame;
+    const uint32_t* volatile outFrameAddress;
+    uint16_t outFrameWords;
+    uint8_t* toWrite;
+    uint8_t* lastRead;
+    uint8_t* captureBuffer;
+    uint16_t completedCaptures;
+    bool needsInit;
+    bool initOk;
+    bool needsWrite;
+    bool backgroundRefresh;
+    bool blockingCapture;
+    bool captureInProgress;
+
+    bool initOutputs();
+    bool initInputs();
+    bool packFrame();
+    void startBackgroundRefresh();
+    void stopBackgroundRefresh();
+    void startCapture();
+    void completeCapture();
+public:
+    /**
+     * Create the abstraction, the state machines are claimed on the first sync, or by calling initDevice.
+     * @param readConfig the 165 input chain, with numDevices from 0 to 4, 0 for no inputs
+     * @param writeConfig the 595 output chain, with numDevices 0 for no outputs
+     * @param pio the PIO block to use, defaults to pio0
+     */
+    PicoPioShiftRegister(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig, PIO pio = pio0);
+    ~PicoPioShiftRegister() override;
+
+    /**
+     * Claims the state machines and DMA channels and loads the programs, called by the first sync if not already.
+     * @return true if all of the resources were available
+     */
+    bool initDevice();
+
+    /**
+     * Sets the rate that the chains are clocked at, call before the first sync.
+     * @param bitsPerSecond the bit rate
+     */
+    void setBitRate(uint32_t bitsPerSecond) { bitRate = bitsPerSecond; }
+
+    /**
+     * Turns continuous DMA refresh of the output chain on or off, see the class description.
+     * @param refresh true to refresh continuously, false to send the chain only after a change
+     */
+    void setBackgroundRefresh(bool refresh);
+
+    /**
+     * @param blocking true, the default, for each sync to wait for its input capture, false to start the capture and
+     *        pick it up at the next sync
+     */
+    void setBlockingCapture(bool blocking) { blockingCapture = blocking; }
+
+    /** Starts a capture of the input chain now unless one is in progress, it is picked up by the next sync. */
+    void captureInputs();
+
+    /** @return the number of captures completed, it wraps around, so compare for changes only */
+    uint16_t getCompletedCaptureCount() const { return completedCaptures; }
+
+    /**
+     * @return the output frame most recently built, the bit count less one followed by the chain four bytes to a
+     * word, first byte in the top bits. An earlier frame stays unchanged until the next change after this one.
+     */
+    const uint32_t* getOutputFrame() const { return outFrameAddress; }
+
+    /** @return false if the state machines or DMA channels could not be claimed */
+    bool isInitialisedOk() const { return initOk; }
+
+    /** Direction is fixed by the pin number, so this does nothing */
+    void pinDirection(pinid_t /*pin*/, uint8_t /*mode*/) override { }
+    void writeValue(pinid_t pin, uint8_t value) override;
+    uint8_t readValue(pinid_t pin) override;
+    /** Interrupts are not supported on shift registers */
+    void attachInterrupt(pinid_t, RawIntHandler, uint8_t) override { }
+
+    /**
+     * Picks up any completed capture and starts the next, then queues the outputs if they changed and background
+     * refresh is off.
+     */
+    bool runLoop() override;
+
+    void writePort(pinid_t pin, uint8_t portVal) override;
+    uint8_t readPort(pinid_t pin) override;
+    IoPinMask readPinMask(pinid_t startPin, IoPinMask mask) override;
+    void writePinMask(pinid_t startPin, IoPinMask mask, IoPinMask values) override;
+};
+
+/**
+ * Creates a PIO driven shift register with both an input and output chain, see PicoPioShiftRegister.
+ * @param readConfig the 165 input chain, numDevices 0 for no inputs
+ * @param writeConfig the 595 output chain, numDevices 0 for no outputs
+ * @param pio the PIO block to use
+ * @return the abstraction
+ */
+inline IoAbstractionRef pioShiftRegister(const ShiftRegConfig& readConfig, const ShiftRegConfig& writeConfig, PIO pio = pio0) {
+    return ioaCreate<PicoPioShiftRegister>(readConfig, writeConfig, pio);
+}
+
+#endif // BUILD_FOR_PICO_CMAKE
+#endif //IOABSTRACTION_PICO_PIO_SHIFT_REGISTER_H
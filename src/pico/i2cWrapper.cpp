@@ -3,27 +3,41 @@
 
 #include "i2cWrapper.h"
 #include "PlatformDeterminationWire.h"
+#include "I2cBusStatistics.h"
 
 // on pico i2c is set up by the user before first use
 PicoI2cWrapper defaultWireType;
 WireType defaultWireTypePtr = &defaultWireType;
 
 bool PicoI2cWrapper::wireRead(uint8_t addr, uint8_t *dst, size_t len) {
+    IOA_I2C_STATS_START
     auto amtAvail = i2c_get_read_available(nativeI2c);
-    if(amtAvail < len) return false;
-    return i2c_read_blocking(nativeI2c, addr, dst, len, false);
+    bool ok = amtAvail >= len && i2c_read_blocking(nativeI2c, addr, dst, len, false);
+    IOA_I2C_STATS_RECORD(addr, len, ok, 0)
+    return ok;
 }
 
 bool PicoI2cWrapper::wireWrite(uint8_t addr, const uint8_t *src, size_t len, int retries, bool sendStop) {
+    IOA_I2C_STATS_START
     int tries = 0;
     while(i2c_write_blocking(nativeI2c, addr, src, len, !sendStop) <= 0) {
-        if(tries > retries) return false;
+        if(tries > retries) {
+            IOA_I2C_STATS_RECORD(addr, len, false, tries)
+            return false;
+        }
         taskManager.yieldForMicros(50);
         tries++;
     }
+    IOA_I2C_STATS_RECORD(addr, len, true, tries)
     return true;
 }
 
+bool PicoI2cWrapper::wireReady(uint8_t addr) {
+    // the SDK has no address only transfer, a one byte read is acknowledged the same way and changes nothing.
+    uint8_t data;
+    return i2c_read_blocking(nativeI2c, addr, &data, 1, false) > 0;
+}
+
 void ioaWireBegin(i2c_inst_t * i2c) {
     defaultWireTypePtr->init(i2c);
 }
@@ -38,4 +52,9 @@ bool ioaWireWriteWithRetry(WireType wire, int address, const uint8_t* buffer, si
     return wire->wireWrite(address, buffer, len, retriesAllowed, sendStop);
 }
 
+bool ioaWireReady(WireType wire, int address) {
+    if(wire == nullptr || !wire->isValid()) return false;
+    return wire->wireReady(address);
+}
+
 #endif
\ No newline at end of file
@@ -15,6 +15,7 @@ public:
 
     bool wireRead(uint8_t addr, uint8_t *dst, size_t len);
     bool wireWrite(uint8_t addr, const uint8_t *dst, size_t len, int retries, bool sendStop);
+    bool wireReady(uint8_t addr);
 };
 
 #endif //TCCLIBS_I2CWRAPPER_H
@@ -1,5 +1,7 @@
 #include "picoAnalogDevice.h"
 #include "IoLogging.h"
+#include "../AnalogStream.h"
+#include <hardware/irq.h>
 
 #if defined(BUILD_FOR_PICO_CMAKE)
 
@@ -25,6 +27,7 @@ void PicoAnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
         }
 
         adc_gpio_init(pin);
+        inputChannelMask |= 1U << (pin - ADC_PICO_FIRST_OFFSET);
     } else {
         gpio_set_function(pin, GPIO_FUNC_PWM);
         uint slice_num = pwm_gpio_to_slice_num(pin);
@@ -38,22 +41,159 @@ void PicoAnalogDevice::initPin(pinid_t pin, AnalogDirection direction) {
     }
 }
 
+// the latest value of each channel in background mode, written only by the FIFO interrupt.
+static volatile uint16_t picoLatestValues[ADC_PICO_CHANNELS];
+static volatile uint32_t picoBackgroundConversions = 0;
+static uint8_t picoBackgroundMask = 0;
+static uint8_t picoNextChannel = 0;
+
+static uint8_t picoFirstChannel(uint8_t mask) {
+    uint8_t channel = 0;
+    while(channel < ADC_PICO_CHANNELS && ((mask >> channel) & 1U) == 0) channel++;
+    return channel;
+}
+
+static uint8_t picoChannelAfter(uint8_t channel, uint8_t mask) {
+    do {
+        channel = (channel + 1) % ADC_PICO_CHANNELS;
+    } while(((mask >> channel) & 1U) == 0);
+    return channel;
+}
+
+static void picoAdcFifoHandler() {
+    // on overflow the order of the remaining samples is not known, so empty the FIFO and wait for the channel that
+    // is converting now to finish, which the ADC reports in AINSEL.
+    if(adc_hw->fcs & ADC_FCS_OVER_BITS) {
+        hw_set_bits(&adc_hw->fcs, ADC_FCS_OVER_BITS);
+        uint8_t converting = (adc_hw->cs & ADC_CS_AINSEL_BITS) >> ADC_CS_AINSEL_LSB;
+        adc_fifo_drain();
+        picoNextChannel = converting;
+        return;
+    }
+    // round robin converts the selected channels in ascending order, so each sample belongs to the next of them.
+    while(!adc_fifo_is_empty()) {
+        picoLatestValues[picoNextChannel] = adc_fifo_get() & ADC_PICO_MAX_VAL;
+        picoNextChannel = picoChannelAfter(picoNextChannel, picoBackgroundMask);
+        picoBackgroundConversions = picoBackgroundConversions + 1;
+    }
+}
+
+bool PicoAnalogDevice::startBackgroundConversion(uint32_t conversionsPerSecond) {
+    if(streamDmaChannel >= 0 || inputChannelMask == 0 || conversionsPerSecond == 0) return false;
+    if(background) stopBackgroundConversion();
+
+    // take one set of readings the slow way first, so no read returns 0 before the first round completes.
+    for(uint8_t ch = 0; ch < ADC_PICO_CHANNELS; ch++) {
+        if((inputChannelMask >> ch) & 1U) {
+            adc_select_input(ch);
+            picoLatestValues[ch] = adc_read();
+        }
+    }
+
+    uint8_t channels = 0;
+    for(uint8_t ch = 0; ch < ADC_PICO_CHANNELS; ch++) channels += (inputChannelMask >> ch) & 1U;
+    float divider = (48000000.0F / float(conversionsPerSecond)) - 1.0F;
+    if(divider < 95.0F) divider = 0.0F;
+
+    picoBackgroundMask = inputChannelMask;
+    picoNextChannel = picoFirstChannel(inputChannelMask);
+    adc_select_input(picoNextChannel);
+    adc_set_round_robin(channels > 1 ? inputChannelMask : 0);
+    adc_fifo_setup(true, false, channels < 4 ? channels : 4, false, false);
+    adc_set_clkdiv(divider);
+    adc_fifo_drain();
+    irq_set_exclusive_handler(ADC_IRQ_FIFO, picoAdcFifoHandler);
+    adc_irq_set_enabled(true);
+    irq_set_enabled(ADC_IRQ_FIFO, true);
+    background = true;
+    adc_run(true);
+    return true;
+}
+
+void PicoAnalogDevice::stopBackgroundConversion() {
+    if(!background) return;
+    adc_run(false);
+    irq_set_enabled(ADC_IRQ_FIFO, false);
+    adc_irq_set_enabled(false);
+    irq_remove_handler(ADC_IRQ_FIFO, picoAdcFifoHandler);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_set_round_robin(0);
+    // a conversion may still be completing, so wait for the ADC to be idle before it is next used on demand.
+    while(!(adc_hw->cs & ADC_CS_READY_BITS)) { }
+    adc_fifo_drain();
+    background = false;
+}
+
+uint32_t PicoAnalogDevice::getBackgroundConversions() const {
+    return picoBackgroundConversions;
+}
+
 unsigned int PicoAnalogDevice::getCurrentValue(pinid_t pin) {
     if(pin < ADC_PICO_FIRST_OFFSET || pin > ADC_PICO_LAST_PIN) {
         serlogF(SER_ERROR, "Pin outside range");
         return 0;
     }
-    adc_select_input(pin - ADC_PICO_FIRST_OFFSET);
+    uint8_t channel = pin - ADC_PICO_FIRST_OFFSET;
+    if(background && ((picoBackgroundMask >> channel) & 1U)) return picoLatestValues[channel];
+    if(background) return 0;
+    adc_select_input(channel);
     return adc_read();
 }
 
 float PicoAnalogDevice::getCurrentFloat(pinid_t pin) {
-    if(pin < ADC_PICO_FIRST_OFFSET || pin > ADC_PICO_LAST_PIN) {
-        serlogF(SER_ERROR, "Pin outside range");
-        return 0;
+    return float(getCurrentValue(pin)) / ADC_PICO_RANGE;
+}
+
+void PicoAnalogDevice::getCurrentValues(const pinid_t* pins, unsigned int* values, uint8_t count) {
+    if(background) {
+        for(uint8_t i = 0; i < count; i++) values[i] = getCurrentValue(pins[i]);
+        return;
+    }
+
+    uint mask = 0;
+    bool ascending = count > 1;
+    for(uint8_t i = 0; i < count; i++) {
+        if(pins[i] < ADC_PICO_FIRST_OFFSET || pins[i] > ADC_PICO_LAST_PIN) {
+            serlogF(SER_ERROR, "Pin outside range");
+            values[i] = 0;
+            ascending = false;
+            continue;
+        }
+        uint adcChannel = pins[i] - ADC_PICO_FIRST_OFFSET;
+        if((mask >> adcChannel) != 0) ascending = false;
+        mask |= 1U << adcChannel;
+    }
+
+    if(ascending) {
+        // in one shot mode round robin moves to the next selected input after each conversion.
+        adc_select_input(pins[0] - ADC_PICO_FIRST_OFFSET);
+        adc_set_round_robin(mask);
+        for(uint8_t i = 0; i < count; i++) values[i] = adc_read();
+        adc_set_round_robin(0);
+        return;
+    }
+
+    int selected = -1;
+    for(uint8_t i = 0; i < count; i++) {
+        if(pins[i] < ADC_PICO_FIRST_OFFSET || pins[i] > ADC_PICO_LAST_PIN) continue;
+        int adcChannel = pins[i] - ADC_PICO_FIRST_OFFSET;
+        if(adcChannel != selected) {
+            adc_select_input(adcChannel);
+            selected = adcChannel;
+        }
+        values[i] = adc_read();
+    }
+}
+
+void PicoAnalogDevice::getCurrentFloats(const pinid_t* pins, float* values, uint8_t count) {
+    unsigned int raw[8];
+    uint8_t done = 0;
+    while(done < count) {
+        uint8_t chunk = (count - done) < 8 ? uint8_t(count - done) : 8;
+        getCurrentValues(&pins[done], raw, chunk);
+        for(uint8_t i = 0; i < chunk; i++) values[done + i] = float(raw[i]) / ADC_PICO_RANGE;
+        done += chunk;
     }
-    adc_select_input(pin - ADC_PICO_FIRST_OFFSET);
-    return float(adc_read()) / ADC_PICO_RANGE;
 }
 
 void PicoAnalogDevice::setCurrentValue(pinid_t pin, unsigned int newValue) {
@@ -63,4 +203,89 @@ void PicoAnalogDevice::setCurrentValue(pinid_t pin, unsigned int newValue) {
     pwm_set_chan_level(slice_num, channel_num, newValue);
 }
 
+// the stream and DMA channel in use, there is only one ADC, so only one stream at a time.
+static AnalogStream* volatile picoActiveStream = nullptr;
+static int picoStreamDmaChannel = -1;
+
+static void picoAdcDmaHandler() {
+    if(picoStreamDmaChannel < 0 || !dma_channel_get_irq0_status(picoStreamDmaChannel)) return;
+    dma_channel_acknowledge_irq0(picoStreamDmaChannel);
+    auto stream = picoActiveStream;
+    if(stream == nullptr) return;
+
+    // rearm straight away with the other block, the FIFO holds four samples, which covers the time taken here.
+    uint16_t* next = stream->blockComplete();
+    dma_channel_set_write_addr(picoStreamDmaChannel, next, false);
+    dma_channel_set_trans_count(picoStreamDmaChannel, stream->getSamplesPerBlock(), true);
+}
+
+bool PicoAnalogDevice::startStreaming(AnalogStream& stream) {
+    if(picoActiveStream != nullptr || background) {
+        serlogF(SER_WARNING, "ADC already streaming");
+        return false;
+    }
+
+    // round robin starts from the lowest selected channel and goes in ascending order, so the frame order of the
+    // stream must match, otherwise use the software fallback.
+    uint mask = 0;
+    for(uint8_t i = 0; i < stream.getChannelCount(); i++) {
+        pinid_t pin = stream.getChannelPin(i);
+        if(pin < ADC_PICO_FIRST_OFFSET || pin > ADC_PICO_LAST_PIN) return false;
+        uint adcChannel = pin - ADC_PICO_FIRST_OFFSET;
+        if(i != 0 && (mask >> adcChannel) != 0) return false;
+        mask |= 1U << adcChannel;
+    }
+
+    // the ADC clock is 48MHz and a conversion takes 96 cycles, so this is the fastest it can go.
+    float divider = (48000000.0F / float(stream.getSampleRate() * stream.getChannelCount())) - 1.0F;
+    if(divider < 95.0F) divider = 0.0F;
+
+    int dmaChannel = dma_claim_unused_channel(false);
+    if(dmaChannel < 0) {
+        serlogF(SER_WARNING, "No DMA for ADC stream");
+        return false;
+    }
+    streamDmaChannel = picoStreamDmaChannel = dmaChannel;
+    picoActiveStream = &stream;
+
+    adc_run(false);
+    adc_fifo_drain();
+    uint lowest = 0;
+    while(((mask >> lowest) & 1U) == 0) lowest++;
+    adc_select_input(lowest);
+    adc_set_round_robin(stream.getChannelCount() > 1 ? mask : 0);
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(divider);
+
+    dma_channel_config config = dma_channel_get_default_config(dmaChannel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_ADC);
+    dma_channel_configure(dmaChannel, &config, stream.getFillingBuffer(), &adc_hw->fifo, stream.getSamplesPerBlock(), true);
+
+    dma_channel_set_irq0_enabled(dmaChannel, true);
+    irq_add_shared_handler(DMA_IRQ_0, picoAdcDmaHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    adc_run(true);
+    return true;
+}
+
+void PicoAnalogDevice::stopStreaming(AnalogStream& stream) {
+    if(picoActiveStream != &stream || streamDmaChannel < 0) return;
+    adc_run(false);
+    dma_channel_set_irq0_enabled(streamDmaChannel, false);
+    dma_channel_abort(streamDmaChannel);
+    dma_channel_acknowledge_irq0(streamDmaChannel);
+    irq_remove_handler(DMA_IRQ_0, picoAdcDmaHandler);
+    dma_channel_unclaim(streamDmaChannel);
+    adc_fifo_setup(false, false, 0, false, false);
+    adc_set_round_robin(0);
+    adc_fifo_drain();
+    picoActiveStream = nullptr;
+    picoStreamDmaChannel = -1;
+    streamDmaChannel = -1;
+}
+
 #endif // Pico only
@@ -5,6 +5,7 @@
 #include "../AnalogDeviceAbstraction.h"
 #include <hardware/adc.h>
 #include <hardware/pwm.h>
+#include <hardware/dma.h>
 
 #define ADC_PICO_FIRST_OFFSET 26
 #define ADC_PICO_LAST_PIN  30
@@ -12,12 +13,26 @@
 #define ADC_PICO_BITS 12
 #define ADC_PICO_RANGE (1 << 12)
 #define ADC_PICO_MAX_VAL (ADC_PICO_RANGE - 1)
+#define ADC_PICO_CHANNELS 5
 
+/**
+ * The internal analog device on the RP2040, it supports hardware streaming, see AnalogStream, where the ADC samples
+ * the channels round robin into its FIFO and a DMA channel moves each block from the FIFO into the stream, so there
+ * is one interrupt per block rather than per sample. The ADC can only round robin in ascending channel order, so add
+ * the stream's channels in pin order. Only one stream can use the ADC at once.
+ *
+ * Alternatively call startBackgroundConversion, and the ADC free runs round robin over every input pin initialised,
+ * with the FIFO interrupt keeping the latest value of each channel, getCurrentValue then reads that value from memory
+ * without waiting for a conversion. Streaming and background conversion cannot be used together.
+ */
 class PicoAnalogDevice : public AnalogDevice {
 private:
     bool initialised = false;
     float pwmDivider = .8f;
     uint pwmWrap = 4096;
+    int streamDmaChannel = -1;
+    uint8_t inputChannelMask = 0;
+    bool background = false;
 public:
     void setPwmDivider(float pwmDiv, uint wrap) {
         pwmDivider = pwmDiv;
@@ -44,6 +59,36 @@ public:
         setCurrentValue(pin, uint(newValue * float(ADC_PICO_RANGE)));
     }
 
+    /**
+     * Reads the pins back to back, when they are in ascending order with no repeats the ADC steps through them with
+     * round robin, otherwise each input is selected in turn.
+     */
+    void getCurrentValues(const pinid_t* pins, unsigned int* values, uint8_t count) override;
+
+    void getCurrentFloats(const pinid_t* pins, float* values, uint8_t count) override;
+
+    /**
+     * Starts the ADC converting every initialised input continuously in the background, from then on reads return the
+     * latest value converted for the pin, which is at most one round of conversions old. Pins initialised later are
+     * added when it is restarted.
+     * @param conversionsPerSecond the total conversions per second shared between the channels, at most 500000
+     * @return true if started, false if there are no inputs or the ADC is streaming
+     */
+    bool startBackgroundConversion(uint32_t conversionsPerSecond = 10000);
+
+    /** Stops background conversion, reads go back to converting on demand. */
+    void stopBackgroundConversion();
+
+    /** @return true if the ADC is converting in the background */
+    bool isBackgroundConversion() const { return background; }
+
+    /** @return the number of conversions completed in the background, for checking it is running at the rate expected */
+    uint32_t getBackgroundConversions() const;
+
+    bool startStreaming(AnalogStream& stream) override;
+
+    void stopStreaming(AnalogStream& stream) override;
+
     float asVoltageLevel(pinid_t pin) {
         return float(getCurrentValue(pin)) * float(ADC_PICO_VREF / (ADC_PICO_RANGE - 1));
     }
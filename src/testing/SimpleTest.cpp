@@ -83,11 +83,40 @@ namespace SimpleTest {
             serlogF2(SER_DEBUG, "Tests finished - ", sz);
         }
 
+        // the timings in a form that is easy to pick out of the log: name, iterations, min, mean, max in micros
+        for(uint8_t i = 0; i < timingCount; i++) {
+            auto& t = timings[i];
+            char sz[50];
+            int pos = fastltoaAt(sz, 0, t.iterations, 100000L, NOT_PADDED, sizeof sz);
+            sz[pos++] = ',';
+            pos = fastltoaAt(sz, pos, (long)t.minMicros, 1000000000L, NOT_PADDED, sizeof sz);
+            sz[pos++] = ',';
+            pos = fastltoaAt(sz, pos, (long)t.meanMicros, 1000000000L, NOT_PADDED, sizeof sz);
+            sz[pos++] = ',';
+            fastltoaAt(sz, pos, (long)t.maxMicros, 1000000000L, NOT_PADDED, sizeof sz);
+            serlogF4(SER_DEBUG, "Timing ", t.name, "n,min,mean,max us =", sz);
+        }
+
         if(failed > 0) {
             serlogF(SER_DEBUG, "T E S T S   F A I L E D")
         }
     }
 
+    bool TestManager::recordTiming(const char* name, const TimedRun& run) {
+        if(timingCount == SIMPLE_TEST_MAX_TIMINGS) return false;
+        timings[timingCount].name = name;
+        timings[timingCount].iterations = run.getIterations();
+        timings[timingCount].minMicros = run.getMinMicros();
+        timings[timingCount].meanMicros = run.getMeanMicros();
+        timings[timingCount].maxMicros = run.getMaxMicros();
+        timingCount++;
+        return true;
+    }
+
+    void TimedRun::record(const char* name) const {
+        TestManager::getInstance()->recordTiming(name, *this);
+    }
+
     void TestManager::begin() {
         serlogF(SER_DEBUG, "==== 8< ==== 8< ==== START EXECUTION ==== 8< ==== 8< ====");
         serlogF3(SER_DEBUG, "Starting test execution on ", testsRecorded.count(), "tests");
@@ -146,6 +175,17 @@ namespace STestInternal {
         }
     }
 
+    void assertTimingInternal(PGM_TYPE file, int line, unsigned long taken, unsigned long allowed, const char *what) {
+        auto current = SimpleTest::UnitTestExecutor::getCurrentTest();
+        if(current == nullptr || current->getTestStatus() != SimpleTest::RUNNING) return;
+
+        if(taken > allowed) {
+            current->setFailed(file, line, what);
+            serlogF4(SER_DEBUG, "Assertion failure at ", file, ", line", line);
+            serlogF4(SER_DEBUG, "Took too long: ", what, taken, allowed);
+        }
+    }
+
     void internalEquality(PGM_TYPE file, int line, bool eq, uint32_t x, uint32_t y, const char* how) {
         auto current = SimpleTest::UnitTestExecutor::getCurrentTest();
         if(current == nullptr || current->getTestStatus() != SimpleTest::RUNNING) return;
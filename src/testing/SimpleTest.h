@@ -16,6 +16,11 @@
 
 #define FAIL_REASON_SIZE 32
 
+/** the number of timing results that the test manager keeps to print in the summary */
+#ifndef SIMPLE_TEST_MAX_TIMINGS
+#define SIMPLE_TEST_MAX_TIMINGS 16
+#endif
+
 #ifdef __AVR__
 #include <avr/pgmspace.h>
 #define FromPgm(x) F(x)
@@ -84,6 +89,63 @@ namespace SimpleTest {
         UnitTestExecutor* getTest() { return executor; }
     };
 
+    /**
+     * Measures a piece of code that is run a number of times, it is used with the timedLoop macro, which runs the
+     * body of the loop a number of warm up times that are not counted, then the given number of times, taking the time
+     * of each pass with micros(). The minimum, mean and maximum time of a pass are then available, and can be checked
+     * with assertCompletesWithin and assertMeanWithin, or recorded for the summary with `record`. As each pass is timed
+     * on its own, the results are only as fine as the resolution of micros(), 4us on most AVR boards, so for very short
+     * code put a few repeats inside the loop.
+     */
+    class TimedRun {
+    private:
+        unsigned long totalMicros = 0;
+        unsigned long minMicros = 0xffffffffUL;
+        unsigned long maxMicros = 0;
+        unsigned long passStart = 0;
+        uint16_t iterations;
+        uint16_t warmUp;
+        uint16_t passes = 0;
+    public:
+        TimedRun(uint16_t iterations, uint16_t warmUp) : iterations(iterations), warmUp(warmUp) {}
+
+        /** called by the timedLoop macro at the start of each pass, it records the pass that just finished */
+        bool nextPass() {
+            unsigned long now = micros();
+            if(passes > warmUp) {
+                unsigned long taken = now - passStart;
+                totalMicros += taken;
+                if(taken < minMicros) minMicros = taken;
+                if(taken > maxMicros) maxMicros = taken;
+            }
+            if(passes == (iterations + warmUp)) return false;
+            passes++;
+            passStart = micros();
+            return true;
+        }
+
+        uint16_t getIterations() const { return iterations; }
+        unsigned long getMinMicros() const { return iterations == 0 ? 0 : minMicros; }
+        unsigned long getMaxMicros() const { return maxMicros; }
+        unsigned long getMeanMicros() const { return iterations == 0 ? 0 : totalMicros / iterations; }
+        unsigned long getTotalMicros() const { return totalMicros; }
+
+        /**
+         * Records the result with the test manager so that it is printed in the summary at the end of the run.
+         * @param name the name to print it with, it must be a constant string
+         */
+        void record(const char* name) const;
+    };
+
+    /** A timing result recorded for the summary */
+    struct TimingRecord {
+        const char* name;
+        unsigned long minMicros;
+        unsigned long meanMicros;
+        unsigned long maxMicros;
+        uint16_t iterations;
+    };
+
     /**
      * Implement this predicate to be able to filter out tests based on the name or any other parameter.
      * You are given a reference to the test and can return true = run test, false = dont run.
@@ -97,6 +159,8 @@ namespace SimpleTest {
         int currentIndex = 0;
         bool needsSummary = true;
         TestFilterPredicate filterPredicate = nullptr;
+        TimingRecord timings[SIMPLE_TEST_MAX_TIMINGS];
+        uint8_t timingCount = 0;
 
         TestManager(): testsRecorded(32) {}
 
@@ -113,6 +177,12 @@ namespace SimpleTest {
 
         void printSummary();
 
+        /**
+         * Records a timing result to be printed with the summary, see TimedRun::record
+         * @return true if recorded, false if SIMPLE_TEST_MAX_TIMINGS are already recorded
+         */
+        bool recordTiming(const char* name, const TimedRun& run);
+
         void setTestFilterPredicate(TestFilterPredicate predicate) {
             filterPredicate = predicate;
         }
@@ -135,6 +205,8 @@ namespace STestInternal {
 
     void assertFloatInternal(PGM_TYPE file, int line, float x, float y, float allowable);
 
+    void assertTimingInternal(PGM_TYPE file, int line, unsigned long taken, unsigned long allowed, const char *what);
+
     inline void assertEqualityInternal(PGM_TYPE file, int line, short x, short y) {
         internalEquality(file, line, x == y, x, y, "==");
     }
@@ -241,6 +313,21 @@ namespace STestInternal {
 #define assertFloatNear(expected, actual, allowable) STestInternal::assertFloatInternal(FromPgm(__FILE__), __LINE__, expected, actual, allowable)
 #define fail(reason) STestInternal::failInternal(FromPgm(__FILE__), __LINE__, reason)
 
+/**
+ * Runs the statement or block that follows as many times as the TimedRun was created with, first the warm up passes
+ * without timing, then the timed passes, the results are then available from the TimedRun, for example:
+ *
+ *     TimedRun run(100, 5);
+ *     timedLoop(run) { fastltoa(sz, 1234, 4, NOT_PADDED, sizeof sz); }
+ *     assertCompletesWithin(run, 50);
+ *     run.record("ltoa");
+ */
+#define timedLoop(run) while((run).nextPass())
+/** asserts that every timed pass of the run took no more than the given microseconds */
+#define assertCompletesWithin(run, maxMicros) STestInternal::assertTimingInternal(FromPgm(__FILE__), __LINE__, (run).getMaxMicros(), maxMicros, "max us")
+/** asserts that the mean time of a pass of the run was no more than the given microseconds */
+#define assertMeanWithin(run, meanMicros) STestInternal::assertTimingInternal(FromPgm(__FILE__), __LINE__, (run).getMeanMicros(), meanMicros, "mean us")
+
 #define testi(name, ignored) \
 class UnitTest_##name : public SimpleTest::UnitTestExecutor {\
 public:\
@@ -42,7 +42,68 @@ bool wireWriteReg8(WireType wireType, uint8_t addr, uint8_t reg, uint8_t command
     return ioaWireWriteWithRetry(wireType, addr, data, sizeof data);
 }
 
-void toggleBitInRegister8(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value) {
+bool wireWriteRegBlock(WireType wireType, uint8_t addr, uint8_t firstReg, const uint8_t* data, uint8_t len) {
+    if(len > IOA_WIRE_REG_BLOCK_MAX) return false;
+    uint8_t buffer[IOA_WIRE_REG_BLOCK_MAX + 1];
+    buffer[0] = firstReg;
+    memcpy(&buffer[1], data, len);
+    return ioaWireWriteWithRetry(wireType, addr, buffer, len + 1);
+}
+
+WireRegisterShadow::WireRegisterShadow(uint8_t firstReg, uint8_t count) : values{}, dirtyRegisters(0),
+        firstRegister(firstReg), numRegisters(min(count, uint8_t(IOA_REGISTER_SHADOW_SIZE))), loaded(false) {
+}
+
+bool WireRegisterShadow::load(WireType wireType, uint8_t addr) {
+    if(loaded) return true;
+    uint8_t reg = firstRegister;
+    loaded = ioaWireWriteWithRetry(wireType, addr, &reg, 1, 0, false) && ioaWireRead(wireType, addr, values, numRegisters);
+    return loaded;
+}
+
+void WireRegisterShadow::setValue(uint8_t reg, uint8_t value) {
+    uint8_t idx = reg - firstRegister;
+    if(values[idx] == value) return;
+    values[idx] = value;
+    dirtyRegisters |= (1UL << idx);
+}
+
+void WireRegisterShadow::setKnownValue(uint8_t reg, uint8_t value) {
+    if(!loaded || !contains(reg)) return;
+    uint8_t idx = reg - firstRegister;
+    values[idx] = value;
+    dirtyRegisters &= ~(1UL << idx);
+}
+
+bool WireRegisterShadow::flush(WireType wireType, uint8_t addr) {
+    if(dirtyRegisters == 0) return true;
+
+    // registers between the first and last change are sent with their shadowed value, which costs a byte each but
+    // saves a whole transaction over writing each run separately.
+    uint8_t first = 0;
+    while(!(dirtyRegisters & (1UL << first))) first++;
+    uint8_t last = numRegisters - 1;
+    while(!(dirtyRegisters & (1UL << last))) last--;
+
+    uint8_t data[IOA_REGISTER_SHADOW_SIZE + 1];
+    data[0] = firstRegister + first;
+    uint8_t len = last - first + 1;
+    memcpy(&data[1], &values[first], len);
+    if(!ioaWireWriteWithRetry(wireType, addr, data, len + 1)) return false;
+
+    serlogF3(SER_IOA_DEBUG, "Shadow flush(reg, len): ", data[0], len);
+    dirtyRegisters = 0;
+    return true;
+}
+
+void toggleBitInRegister8(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value, WireRegisterShadow* shadow) {
+    if(shadow && shadow->contains(regAddr) && shadow->load(wireType, addr)) {
+        uint8_t reg = shadow->getValue(regAddr);
+        bitWrite(reg, theBit, value);
+        shadow->setValue(regAddr, reg);
+        return;
+    }
+
     uint8_t reg = wireReadReg8(wireType, addr, regAddr);
     bitWrite(reg, theBit, value);
 
@@ -54,7 +115,15 @@ void toggleBitInRegister8(WireType wireType, uint8_t addr, uint8_t regAddr, uint
     wireWriteReg8(wireType, addr, regAddr, reg);
 }
 
-void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value) {
+void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value, WireRegisterShadow* shadow) {
+    if(shadow && shadow->contains(regAddr) && shadow->contains(regAddr + 1) && shadow->load(wireType, addr)) {
+        uint8_t reg = (theBit < 8) ? regAddr : regAddr + 1;
+        uint8_t regVal = shadow->getValue(reg);
+        bitWrite(regVal, theBit % 8, value);
+        shadow->setValue(reg, regVal);
+        return;
+    }
+
     uint16_t reg = wireReadReg16(wireType, addr, regAddr);
     bitWrite(reg, theBit, value);
 
@@ -66,8 +135,9 @@ void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uin
     wireWriteReg16(wireType, addr, regAddr, reg);
 }
 
-void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lowBits, uint8_t val) {
-    auto regVal = wireReadReg8(wireImpl, i2cAddress, reg);
+void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lowBits, uint8_t val, WireRegisterShadow* shadow) {
+    bool shadowed = shadow && shadow->contains(reg) && shadow->load(wireImpl, i2cAddress);
+    uint8_t regVal = shadowed ? shadow->getValue(reg) : wireReadReg8(wireImpl, i2cAddress, reg);
     if(lowBits) {
         regVal = regVal & 0xF0;
         regVal = regVal | val;
@@ -75,8 +145,8 @@ void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lo
         regVal = regVal & 0x0F;
         regVal = regVal | (val << 4);
     }
-    wireWriteReg8(wireImpl, i2cAddress, reg, regVal);
-
+    if(shadowed) shadow->setValue(reg, regVal);
+    else wireWriteReg8(wireImpl, i2cAddress, reg, regVal);
 }
 
 
@@ -16,6 +16,85 @@
  * @brief a series of wire helper functions that make dealing with device register IO simpler
  */
 
+// START user adjustable section
+
+/**
+ * The largest number of contiguous registers that a WireRegisterShadow can hold, up to 32.
+ */
+#ifndef IOA_REGISTER_SHADOW_SIZE
+#define IOA_REGISTER_SHADOW_SIZE 16
+#endif
+
+// END user adjustable section
+
+/** The most registers that wireWriteRegBlock writes in one transaction, the same limit as a register shadow. */
+#define IOA_WIRE_REG_BLOCK_MAX 32
+
+/**
+ * A shadow copy of a contiguous range of configuration registers on an I2C device, that the read-modify-write helpers
+ * below consult when one is provided. The whole range is read in one transfer the first time it is needed, after
+ * that changes are made only to the shadow, and flush writes everything from the first to the last changed register
+ * in one burst. Only plain read/write registers that the device does not change itself should be in the range, and
+ * the device must auto increment the register address.
+ */
+class WireRegisterShadow {
+private:
+    uint8_t values[IOA_REGISTER_SHADOW_SIZE];
+    uint32_t dirtyRegisters;
+    uint8_t firstRegister;
+    uint8_t numRegisters;
+    bool loaded;
+public:
+    /**
+     * Create a shadow for a range of registers, nothing is read until it is first used.
+     * @param firstReg the first register in the range
+     * @param count the number of registers, up to IOA_REGISTER_SHADOW_SIZE
+     */
+    WireRegisterShadow(uint8_t firstReg, uint8_t count);
+
+    /** @return true if the register is in the shadowed range */
+    bool contains(uint8_t reg) const { return reg >= firstRegister && (reg - firstRegister) < numRegisters; }
+
+    /** @return true if there are changes waiting to be flushed */
+    bool isDirty() const { return dirtyRegisters != 0; }
+
+    /** @return true once the range has been read from the device */
+    bool isLoaded() const { return loaded; }
+
+    /**
+     * Reads the whole range from the device, if it has not already been read.
+     * @return true if the shadow is loaded
+     */
+    bool load(WireType wireType, uint8_t addr);
+
+    /** @return the shadowed value of a register, which must be in range and loaded */
+    uint8_t getValue(uint8_t reg) const { return values[reg - firstRegister]; }
+
+    /**
+     * Change the value of a register, it is only marked as needing a write if the value actually changes.
+     * @param reg the register, which must be in range
+     * @param value the new value
+     */
+    void setValue(uint8_t reg, uint8_t value);
+
+    /**
+     * Record a value that has been written to the device directly, so that a later flush does not overwrite it. Has
+     * no effect before the shadow is loaded, as the value will be read then.
+     * @param reg the register, which must be in range
+     * @param value the value now on the device
+     */
+    void setKnownValue(uint8_t reg, uint8_t value);
+
+    /**
+     * Writes any changed registers in a single burst, from the first to the last changed register.
+     * @return true if there was nothing to write or the write succeeded, on failure the changes remain pending
+     */
+    bool flush(WireType wireType, uint8_t addr);
+
+    /** Forget the shadow state, for example after the device has been reset, pending changes are lost. */
+    void invalidate() { loaded = false; dirtyRegisters = 0; }
+};
+
 
 /**
  * Writes a 4 bit value into an 8 bit register preserving the other 4 bits.
@@ -24,8 +103,9 @@
  * @param reg the register to write to
  * @param lowBits if the low or high bits are to be modified
  * @param val the new value between 0..15
+ * @param shadow optional register shadow, when it covers the register only the shadow is changed
  */
-void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lowBits, uint8_t val);
+void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lowBits, uint8_t val, WireRegisterShadow* shadow = nullptr);
 
 /**
  * Toggles a bit in a 16 bit register to the new value
@@ -34,8 +114,9 @@ void write4BitToReg8(WireType wireImpl, uint8_t i2cAddress, uint8_t reg, bool lo
  * @param regAddr the register to write to
  * @param theBit the bit to change
  * @param value the new value
+ * @param shadow optional register shadow, when it covers both registers only the shadow is changed
  */
-void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value);
+void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value, WireRegisterShadow* shadow = nullptr);
 
 /**
  * Toggles a bit in an 8 bit register to the new value
@@ -44,8 +125,9 @@ void toggleBitInRegister16(WireType wireType, uint8_t addr, uint8_t regAddr, uin
  * @param regAddr the register to write to
  * @param theBit the bit to change
  * @param value the new value
+ * @param shadow optional register shadow, when it covers the register only the shadow is changed
  */
-void toggleBitInRegister8(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value);
+void toggleBitInRegister8(WireType wireType, uint8_t addr, uint8_t regAddr, uint8_t theBit, bool value, WireRegisterShadow* shadow = nullptr);
 
 /**
  * Writes an 8 bit value to a register
@@ -67,6 +149,17 @@ bool wireWriteReg8(WireType wireType, uint8_t addr, uint8_t reg, uint8_t command
  */
 bool wireWriteReg16(WireType wireType, uint8_t addr, uint8_t reg, uint16_t command);
 
+/**
+ * Writes a run of adjacent registers in one transaction, for devices that auto increment the register address.
+ * @param wireType the wire implementation
+ * @param addr the i2c address
+ * @param firstReg the first register to write
+ * @param data the values for each register in turn
+ * @param len the number of registers, up to IOA_WIRE_REG_BLOCK_MAX
+ * @return true if success
+ */
+bool wireWriteRegBlock(WireType wireType, uint8_t addr, uint8_t firstReg, const uint8_t* data, uint8_t len);
+
 /**
  * Reads an 8 bit value from a given register
  * @param wireType the wire implementation
@@ -80,4 +80,55 @@ test(testI2CEeprom) {
     serdebugF("Oversize finished OK");
 }
 
+test(testI2CEepromPageCache) {
+    I2cAt24Eeprom eeprom(i2cAddr, eepromType);
+    assertTrue(eeprom.enablePageCache(2));
+    assertFalse(eeprom.enablePageCache(2));
+
+    // scattered writes across three pages only change the cache until flushed, the third evicts the first.
+    eeprom.write32(10, 0xdeadbeef);
+    eeprom.write16(pageSize + 3, 0x1234);
+    assertTrue(eeprom.isCacheDirty());
+    eeprom.write8((pageSize * 2) + 1, 0x55);
+    assertEquals(0xdeadbeefUL, (unsigned long)eeprom.read32(10));
+    eeprom.flushCache();
+    assertFalse(eeprom.isCacheDirty());
+    assertFalse(eeprom.hasErrorOccurred());
+
+    // read back without a cache to make sure the pages were written to the device.
+    I2cAt24Eeprom uncached(i2cAddr, eepromType);
+    assertEquals(0xdeadbeefUL, (unsigned long)uncached.read32(10));
+    assertEquals((uint16_t)0x1234, uncached.read16(pageSize + 3));
+    assertEquals((uint8_t)0x55, uncached.read8((pageSize * 2) + 1));
+    assertFalse(uncached.hasErrorOccurred());
+}
+
+int asyncFlushes = 0;
+bool asyncFlushOk = false;
+
+void onFlushComplete(I2cAt24Eeprom* eeprom, bool success) {
+    asyncFlushes++;
+    asyncFlushOk = success;
+}
+
+test(testI2CEepromAsyncFlush) {
+    // task manager writes the pages after the test returns control, so the eeprom must outlive the test.
+    static I2cAt24Eeprom eeprom(i2cAddr, eepromType);
+    assertFalse(eeprom.enableAsyncWrites(onFlushComplete));
+    assertTrue(eeprom.enablePageCache(2));
+    assertTrue(eeprom.enableAsyncWrites(onFlushComplete));
+
+    for(int i = 0; i < pageSize * 2; i++) eeprom.write8(i, i + 1);
+    eeprom.flushCache();
+    assertTrue(eeprom.isFlushInProgress());
+    unsigned long started = millis();
+    while(eeprom.isFlushInProgress() && (millis() - started) < 500) taskManager.yieldForMicros(100);
+    assertEquals(1, asyncFlushes);
+    assertTrue(asyncFlushOk);
+    assertFalse(eeprom.isCacheDirty());
+
+    I2cAt24Eeprom uncached(i2cAddr, eepromType);
+    assertEquals((uint8_t)(pageSize + 1), uncached.read8(pageSize));
+}
+
 DEFAULT_TEST_RUNLOOP
@@ -0,0 +1,205 @@
+/**
+ * Benchmarks of the core hot paths, run in the same way as the other test suites. Each benchmark runs its body a
+ * fixed number of times against the mock devices and logs one line in the form below, so that results can be
+ * collected from the log by matching on BENCH, and compared between builds to track regressions:
+ *
+ *     BENCH,name,param,iterations,totalMicros,nanosPerIteration
+ *
+ * As the timing uses micros(), the results are only as fine as the board's micros() resolution, so the iteration
+ * counts are chosen so that each benchmark runs for at least a few milliseconds.
+ */
+
+#include <testing/SimpleTest.h>
+#include <IoAbstraction.h>
+#include <MockIoAbstraction.h>
+#include <MockEepromAbstraction.h>
+#include <KeyboardManager.h>
+#include <TextUtilities.h>
+
+using namespace SimpleTest;
+
+#ifdef __AVR__
+#define BENCH_MAX_KEYS 32
+#define BENCH_ITERATIONS 200
+#else
+#define BENCH_MAX_KEYS 128
+#define BENCH_ITERATIONS 2000
+#endif
+
+// the device pins come first in the multi io, then each mock expander has 16 pins.
+#define BENCH_DEVICE_PINS 16
+#define BENCH_PINS_PER_MOCK 16
+
+volatile unsigned long benchSink = 0;
+
+void benchReport(const char* name, long param, unsigned long iterations, unsigned long totalMicros) {
+    char sz[64];
+    int pos = 0;
+    strncpy(sz, name, 24);
+    sz[24] = 0;
+    pos = (int)strlen(sz);
+    sz[pos++] = ',';
+    pos = fastltoaAt(sz, pos, param, 1000000000L, NOT_PADDED, sizeof sz);
+    sz[pos++] = ',';
+    pos = fastltoaAt(sz, pos, (long)iterations, 1000000000L, NOT_PADDED, sizeof sz);
+    sz[pos++] = ',';
+    pos = fastltoaAt(sz, pos, (long)totalMicros, 1000000000L, NOT_PADDED, sizeof sz);
+    sz[pos++] = ',';
+    unsigned long nanos = ((totalMicros / iterations) * 1000UL) + (((totalMicros % iterations) * 1000UL) / iterations);
+    fastltoaAt(sz, pos, (long)nanos, 1000000000L, NOT_PADDED, sizeof sz);
+    serlogF2(SER_DEBUG, "BENCH,", sz);
+}
+
+template<typename Body> void runBenchmark(const char* name, long param, unsigned long iterations, Body body) {
+    // one pass first so that any lazy set up is not counted.
+    body();
+    unsigned long start = micros();
+    for(unsigned long i = 0; i < iterations; i++) {
+        body();
+    }
+    benchReport(name, param, iterations, micros() - start);
+}
+
+MultiIoAbstraction* createMockedMultiIo(uint8_t mocks) {
+    auto multiIo = new MultiIoAbstraction(BENCH_DEVICE_PINS);
+    for(uint8_t i = 0; i < mocks; i++) {
+        multiIo->addIoExpander(new MockedIoAbstraction(2), BENCH_PINS_PER_MOCK);
+    }
+    return multiIo;
+}
+
+void benchKeyCallback(pinid_t key, bool held) {
+    benchSink = benchSink + key;
+}
+
+test(benchSwitchesRunLoop) {
+    pinid_t keyCounts[] = { 8, 32, 128 };
+    for(auto keys : keyCounts) {
+        if(keys > BENCH_MAX_KEYS) continue;
+        auto multiIo = createMockedMultiIo(uint8_t((keys + BENCH_PINS_PER_MOCK - 1) / BENCH_PINS_PER_MOCK));
+        switches.init(multiIo, SWITCHES_POLL_EVERYTHING, true);
+        for(pinid_t i = 0; i < keys; i++) {
+            switches.addSwitch(BENCH_DEVICE_PINS + i, benchKeyCallback);
+        }
+        runBenchmark("switchesRunLoop", keys, BENCH_ITERATIONS / 4, [] {
+            switches.runLoop();
+        });
+        switches.resetAllSwitches();
+        delete multiIo;
+    }
+    taskManager.reset();
+}
+
+test(benchMultiIoRouting) {
+    uint8_t depths[] = { 1, 4, 8 };
+    for(auto depth : depths) {
+        auto multiIo = createMockedMultiIo(depth);
+        // the last pin of the last expander, the furthest from the start
+        pinid_t pin = BENCH_DEVICE_PINS + (depth * BENCH_PINS_PER_MOCK) - 1;
+        multiIo->pinMode(pin, INPUT);
+        runBenchmark("multiIoReadAndSync", depth, BENCH_ITERATIONS, [multiIo, pin] {
+            benchSink = benchSink + multiIo->digitalRead(pin);
+            multiIo->sync();
+        });
+        delete multiIo;
+    }
+}
+
+int benchEncoderValue = 0;
+
+void benchEncoderCallback(int value) {
+    benchEncoderValue = value;
+}
+
+test(benchEncoderDecode) {
+    HardwareRotaryEncoder encoder(2, 3, benchEncoderCallback, HWACCEL_NONE, FULL_CYCLE);
+    encoder.changePrecision(10000, 5000, true);
+
+    // a full quadrature cycle as four recorded edges, each pass moves the encoder by one step
+    IoInterruptEvent edges[4] = { { 0, 2, LOW }, { 0, 3, LOW }, { 0, 2, HIGH }, { 0, 3, HIGH } };
+    unsigned long when = 0;
+    runBenchmark("encoderDecodeCycle", 4, BENCH_ITERATIONS, [&edges, &encoder, &when] {
+        for(auto& edge : edges) {
+            when += 2000;
+            edge.timestamp = when;
+            encoder.encoderChangedFromEvent(edge);
+        }
+    });
+    assertNotEquals(5000, benchEncoderValue);
+}
+
+test(benchTextFormatting) {
+    char sz[20];
+    long value = 0;
+    runBenchmark("fastltoa", 9, BENCH_ITERATIONS, [&sz, &value] {
+        sz[0] = 0;
+        fastltoa(sz, (value += 12347), 9, NOT_PADDED, sizeof sz);
+    });
+    runBenchmark("fastltoaAt", 9, BENCH_ITERATIONS, [&sz, &value] {
+        fastltoaAt(sz, 0, (value += 12347), 1000000000L, NOT_PADDED, sizeof sz);
+    });
+
+    float fl = 0.0F;
+    runBenchmark("fastftoa", 3, BENCH_ITERATIONS, [&sz, &fl] {
+        sz[0] = 0;
+        fastftoa(sz, (fl += 1.2345F), 3, sizeof sz);
+    });
+    runBenchmark("fastDecimalToaAt", 3, BENCH_ITERATIONS, [&sz, &value] {
+        fastDecimalToaAt(sz, 0, (value += 1234), 3, sizeof sz);
+    });
+    benchSink = benchSink + sz[0];
+}
+
+const char benchKeyboardKeys[] PROGMEM = "123A456B789C*0#D";
+
+class BenchKeyboardListener : public KeyboardListener {
+public:
+    void keyPressed(char key, bool held) override { benchSink = benchSink + key; }
+    void keyReleased(char key) override { benchSink = benchSink + key; }
+};
+
+test(benchMatrixKeyboardExec) {
+    MockedIoAbstraction mockIo(2);
+    KeyboardLayout layout(4, 4, benchKeyboardKeys);
+    for(int r = 0; r < 4; r++) layout.setRowPin(r, r);
+    for(int c = 0; c < 4; c++) layout.setColPin(c, 4 + c);
+    BenchKeyboardListener listener;
+
+    MatrixKeyboardManager keyboard;
+    keyboard.initialise(&mockIo, &layout, &listener, false);
+    keyboard.setColumnSettleMicros(0);
+    runBenchmark("matrixKeyboardExec", 16, BENCH_ITERATIONS, [&keyboard] {
+        keyboard.exec();
+    });
+    taskManager.reset();
+}
+
+test(benchEepromBlockIo) {
+    MockEepromAbstraction eeprom(1024);
+    uint8_t buffer[256];
+    for(int i = 0; i < 256; i++) buffer[i] = uint8_t(i);
+
+    size_t sizes[] = { 16, 64, 256 };
+    for(auto size : sizes) {
+        runBenchmark("eepromWriteBlock", (long)size, BENCH_ITERATIONS / 4, [&eeprom, &buffer, size] {
+            eeprom.writeBlock(100, buffer, size);
+        });
+        runBenchmark("eepromReadBlock", (long)size, BENCH_ITERATIONS / 4, [&eeprom, &buffer, size] {
+            eeprom.readBlock(buffer, 100, size);
+        });
+        runBenchmark("eepromRead8", (long)size, BENCH_ITERATIONS / 4, [&eeprom, &buffer, size] {
+            for(size_t i = 0; i < size; i++) buffer[i] = eeprom.read8(100 + i);
+        });
+    }
+    assertFalse(eeprom.hasErrorOccurred());
+}
+
+IOLOG_MBED_PORT_IF_NEEDED(USBTX, USBRX)
+
+void setup() {
+    IOLOG_START_SERIAL
+    serlogF(SER_DEBUG, "BENCH,name,param,iterations,totalMicros,nanosPerIteration");
+    startTesting();
+}
+
+DEFAULT_TEST_RUNLOOP
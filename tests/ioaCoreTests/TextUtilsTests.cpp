@@ -1,5 +1,6 @@
 
 #include <testing/SimpleTest.h>
+#include <limits.h>
 #include <TextUtilities.h>
 
 test(testTcUtilIntegerConversions) {
@@ -59,4 +60,48 @@ test(testTcUtilHexCoversions) {
 
     intToHexString(szBuffer, 3, 0xFFFF, 4, false);
     assertStringEquals("FF", szBuffer);
-}
\ No newline at end of file
+}
+test(testTcUtilPositionalConversions) {
+    char szBuffer[30];
+    char szExpected[30];
+
+    // the positional version must give the same results as the appending version, for lengths either side of 16 bits
+    long values[] = { 0, 7, 42, 907, 65535, 65536, 123456, 99999999, -22, -70000 };
+    for(auto value : values) {
+        strcpy(szExpected, "v=");
+        fastltoa_mv(szExpected, value, 1000000L, '0', sizeof(szExpected));
+        strcpy(szBuffer, "v=");
+        int end = fastltoaAt(szBuffer, 2, value, 1000000L, '0', sizeof(szBuffer));
+        assertStringEquals(szExpected, szBuffer);
+        assertEquals((int)strlen(szBuffer), end);
+    }
+
+    // several values built into one buffer using the returned positions
+    int pos = fastltoaAt(szBuffer, 0, 12, 100, '0', sizeof(szBuffer));
+    szBuffer[pos++] = ':';
+    pos = fastltoaAt(szBuffer, pos, 5, 100, '0', sizeof(szBuffer));
+    szBuffer[pos++] = ':';
+    fastltoaAt(szBuffer, pos, 9, 100, '0', sizeof(szBuffer));
+    assertStringEquals("12:05:09", szBuffer);
+
+    // the length is never exceeded
+    fastltoaAt(szBuffer, 0, 123456, 1000000L, NOT_PADDED, 5);
+    assertStringEquals("1236", szBuffer);
+
+    szExpected[0] = 0;
+    fastftoa(szExpected, -12.25F, 3, sizeof(szExpected));
+    fastftoaAt(szBuffer, 0, -12.25F, 3, sizeof(szBuffer));
+    assertStringEquals(szExpected, szBuffer);
+
+    fastDecimalToaAt(szBuffer, 0, 12345, 2, sizeof(szBuffer));
+    assertStringEquals("123.45", szBuffer);
+    fastDecimalToaAt(szBuffer, 0, -5, 3, sizeof(szBuffer));
+    assertStringEquals("-0.005", szBuffer);
+    fastDecimalToaAt(szBuffer, 0, 100, 1, sizeof(szBuffer));
+    assertStringEquals("10.0", szBuffer);
+#if LONG_MAX == 2147483647L
+    // the most negative value has no positive counterpart in a long.
+    fastDecimalToaAt(szBuffer, 0, LONG_MIN, 2, sizeof(szBuffer));
+    assertStringEquals("-21474836.48", szBuffer);
+#endif
+}
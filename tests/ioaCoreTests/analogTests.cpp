@@ -0,0 +1,397 @@
+#include <TaskManagerIO.h>
+#include <testing/SimpleTest.h>
+#include "AnalogStream.h"
+#include "DeviceEvents.h"
+#include "FilteredAnalogDevice.h"
+#include "AnalogEventGroup.h"
+#include "DfRobotInputAbstraction.h"
+#include "JoystickSwitchInput.h"
+
+using namespace SimpleTest;
+
+class FakeAnalogDevice : public AnalogDevice {
+public:
+    unsigned int reads = 0;
+    int forcedValue = -1;
+    bool hardwareStreaming = false;
+    AnalogStream* streaming = nullptr;
+    AnalogThresholdWatcher* watcher = nullptr;
+    unsigned int watchedCounts = 0;
+
+    int getMaximumRange(AnalogDirection direction, pinid_t pin) override { return 1024; }
+    int getBitDepth(AnalogDirection direction, pinid_t pin) override { return 10; }
+    void initPin(pinid_t pin, AnalogDirection direction) override { }
+    // each read gives the pin in the upper part and a count in the lower, so the order can be checked
+    unsigned int getCurrentValue(pinid_t pin) override {
+        unsigned int value = (pin * 100) + (reads % 100);
+        reads++;
+        return (forcedValue >= 0) ? forcedValue : value;
+    }
+    float getCurrentFloat(pinid_t pin) override { return float(getCurrentValue(pin)) / 1024.0F; }
+    void setCurrentValue(pinid_t pin, unsigned int newValue) override { }
+    void setCurrentFloat(pinid_t pin, float newValue) override { }
+
+    bool startStreaming(AnalogStream& stream) override {
+        if(!hardwareStreaming) return false;
+        streaming = &stream;
+        return true;
+    }
+
+    void stopStreaming(AnalogStream& stream) override { streaming = nullptr; }
+
+    // only pin 5 has a comparator
+    bool startThresholdWatch(pinid_t pin, unsigned int thresholdCounts, AnalogThresholdWatcher* w) override {
+        if(pin != 5) return false;
+        watcher = w;
+        watchedCounts = thresholdCounts;
+        return true;
+    }
+
+    void stopThresholdWatch(pinid_t pin) override { watcher = nullptr; }
+
+    void rearmThresholdWatch(pinid_t pin) override { rearms++; }
+
+    int rearms = 0;
+};
+
+FakeAnalogDevice fakeAnalogDevice;
+int streamBlocks = 0;
+uint16_t streamFirstSample = 0;
+uint16_t streamLastSample = 0;
+uint16_t streamFrames = 0;
+uint8_t streamChannels = 0;
+
+void onStreamBlock(const uint16_t* samples, uint16_t frames, uint8_t channels) {
+    streamBlocks++;
+    streamFrames = frames;
+    streamChannels = channels;
+    streamFirstSample = samples[0];
+    streamLastSample = samples[(frames * channels) - 1];
+}
+
+test(testAnalogStreamSoftwareFallback) {
+    // the stream is registered with task manager, so it must outlive the test.
+    static AnalogStream stream(&fakeAnalogDevice, 4, onStreamBlock);
+    fakeAnalogDevice.hardwareStreaming = false;
+    fakeAnalogDevice.reads = 0;
+    streamBlocks = 0;
+
+    assertTrue(stream.addChannel(2));
+    assertTrue(stream.addChannel(3));
+    assertTrue(stream.start(1000));
+    assertFalse(stream.isHardwareStreaming());
+    assertFalse(stream.addChannel(4));
+    assertEquals(8, stream.getSamplesPerBlock());
+
+    // each run reads one frame, and the block is delivered on the run that completes it.
+    for(int i = 0; i < 3; i++) stream.exec();
+    assertEquals(0, streamBlocks);
+    stream.exec();
+    assertEquals(1, streamBlocks);
+    assertEquals(4, streamFrames);
+    assertEquals(2, streamChannels);
+    assertEquals(200, streamFirstSample);
+    assertEquals(307, streamLastSample);
+    assertEquals(1000U, stream.timeOfNextCheck());
+
+    for(int i = 0; i < 4; i++) stream.exec();
+    assertEquals(2, streamBlocks);
+    assertEquals(208, streamFirstSample);
+    assertEquals(0U, stream.getOverruns());
+    stream.stop();
+    assertFalse(stream.isRunning());
+}
+
+test(testAnalogStreamHardwareBlocksAndOverruns) {
+    static AnalogStream stream(&fakeAnalogDevice, 2, onStreamBlock);
+    fakeAnalogDevice.hardwareStreaming = true;
+    streamBlocks = 0;
+
+    assertTrue(stream.addChannel(1));
+    assertTrue(stream.start(8000));
+    assertTrue(stream.isHardwareStreaming());
+    assertTrue(fakeAnalogDevice.streaming == &stream);
+
+    // the device fills the block then hands it over, getting the other block back.
+    uint16_t* fill = stream.getFillingBuffer();
+    fill[0] = 10;
+    fill[1] = 11;
+    uint16_t* next = stream.blockComplete();
+    assertTrue(next == stream.getBlockBuffer(1));
+    stream.exec();
+    assertEquals(1, streamBlocks);
+    assertEquals(10, streamFirstSample);
+    assertEquals(11, streamLastSample);
+
+    // three blocks without a delivery, the third reuses the block still waiting, which is an overrun.
+    next[0] = 20;
+    next[1] = 21;
+    next = stream.blockComplete();
+    next[0] = 30;
+    next[1] = 31;
+    next = stream.blockComplete();
+    assertEquals(0U, stream.getOverruns());
+    next = stream.blockComplete();
+    assertEquals(1U, stream.getOverruns());
+
+    // delivery is still in the order filled
+    stream.exec();
+    assertEquals(3, streamBlocks);
+    assertEquals(30, streamFirstSample);
+
+    stream.stop();
+    assertTrue(fakeAnalogDevice.streaming == nullptr);
+}
+
+test(testAnalogBatchReadsInOrder) {
+    fakeAnalogDevice.reads = 0;
+    pinid_t pins[] = { 4, 1, 4 };
+    unsigned int values[3];
+    fakeAnalogDevice.getCurrentValues(pins, values, 3);
+    assertEquals(400U, values[0]);
+    assertEquals(101U, values[1]);
+    assertEquals(402U, values[2]);
+
+    float floats[3];
+    fakeAnalogDevice.getCurrentFloats(pins, floats, 3);
+    assertEquals(403U, (unsigned int)(floats[0] * 1024.0F + 0.5F));
+    assertEquals(104U, (unsigned int)(floats[1] * 1024.0F + 0.5F));
+}
+
+test(testAnalogFixedPointConversions) {
+    assertEquals(0U, (unsigned int)analogCountsToFixed(0, 10));
+    assertEquals(ANALOG_FIXED_MAX, (unsigned int)analogCountsToFixed(1023, 10));
+    assertEquals(ANALOG_FIXED_MAX, (unsigned int)analogCountsToFixed(4095, 12));
+    assertEquals(ANALOG_FIXED_MAX, (unsigned int)analogCountsToFixed(255, 8));
+    assertEquals(0x8020U, (unsigned int)analogCountsToFixed(512, 10));
+    assertEquals(0x1234U, (unsigned int)analogCountsToFixed(0x1234, 16));
+
+    assertEquals(0U, (unsigned int)analogFloatToFixed(-0.5F));
+    assertEquals(ANALOG_FIXED_MAX, (unsigned int)analogFloatToFixed(1.5F));
+    assertEquals(0x8000U, (unsigned int)analogFloatToFixed(0.5F));
+    assertEquals(767U, analogFixedToCounts(analogFloatToFixed(0.75F), 10));
+    assertEquals(512U, analogFixedToCounts(analogCountsToFixed(512, 10), 10));
+}
+
+class CountingAnalogEvent : public AnalogInEvent {
+public:
+    int runs = 0;
+    CountingAnalogEvent(AnalogDevice& device, AnalogEventMode mode, pinid_t pin = 2)
+            : AnalogInEvent(device, pin, 0.25F, mode, 1000) {}
+    void exec() override { runs++; }
+    float lastReadingValue() const { return lastReading; }
+};
+
+test(testAnalogEventComparesInCounts) {
+    fakeAnalogDevice.forcedValue = 100;
+    CountingAnalogEvent exceeds(fakeAnalogDevice, AnalogInEvent::ANALOGIN_EXCEEDS);
+    CountingAnalogEvent change(fakeAnalogDevice, AnalogInEvent::ANALOGIN_CHANGE);
+
+    // 0.25 of a 10 bit range is 255 counts
+    exceeds.timeOfNextCheck();
+    change.timeOfNextCheck();
+    assertFalse(exceeds.isTriggered());
+    assertFalse(change.isTriggered());
+    assertEquals(100U, exceeds.getLastReadingCounts());
+
+    fakeAnalogDevice.forcedValue = 300;
+    exceeds.timeOfNextCheck();
+    change.timeOfNextCheck();
+    assertTrue(exceeds.isTriggered());
+    assertFalse(change.isTriggered());
+    assertEquals(int(300.0F * 1000.0F / 1023.0F), int(exceeds.lastReadingValue() * 1000.0F));
+
+    // a change of more than 255 from the value it last triggered at, or the first reading
+    fakeAnalogDevice.forcedValue = 400;
+    change.timeOfNextCheck();
+    assertTrue(change.isTriggered());
+    fakeAnalogDevice.forcedValue = -1;
+}
+
+test(testFilteredAnalogDeviceStages) {
+    FilteredAnalogDevice filtered(&fakeAnalogDevice);
+    assertTrue(filtered.addFilter(2, 2));
+    assertTrue(filtered.addFilter(3, 0, 3));
+    assertTrue(filtered.addFilter(4, 0, 0, 2));
+    assertFalse(filtered.addFilter(5, ANALOG_FILTER_MAX_EXTRA_BITS + 1));
+
+    // oversampling by two bits takes sixteen readings and adds two bits of range
+    fakeAnalogDevice.reads = 0;
+    fakeAnalogDevice.forcedValue = 100;
+    assertEquals(400U, filtered.getCurrentValue(2));
+    assertEquals(12, filtered.getBitDepth(DIR_IN, 2));
+    assertEquals(4096, filtered.getMaximumRange(DIR_IN, 2));
+    assertEquals(10, filtered.getBitDepth(DIR_IN, 1));
+
+    // a median of three removes a single spike once the window has filled
+    int medianInputs[] = { 100, 102, 900, 104 };
+    unsigned int medianOutputs[4];
+    for(int i = 0; i < 4; i++) {
+        fakeAnalogDevice.forcedValue = medianInputs[i];
+        medianOutputs[i] = filtered.getCurrentValue(3);
+    }
+    assertEquals(102U, medianOutputs[2]);
+    assertEquals(104U, medianOutputs[3]);
+
+    // the average moves a quarter of the way each read, starting from the first reading
+    fakeAnalogDevice.forcedValue = 100;
+    assertEquals(100U, filtered.getCurrentValue(4));
+    fakeAnalogDevice.forcedValue = 200;
+    assertEquals(125U, filtered.getCurrentValue(4));
+    assertEquals(143U, filtered.getCurrentValue(4));
+    filtered.resetFilter(4);
+    assertEquals(200U, filtered.getCurrentValue(4));
+
+    // pins without a filter pass straight through
+    assertEquals(200U, filtered.getCurrentValue(1));
+    fakeAnalogDevice.forcedValue = -1;
+}
+
+test(testAnalogEventHysteresis) {
+    CountingAnalogEvent exceeds(fakeAnalogDevice, AnalogInEvent::ANALOGIN_EXCEEDS);
+    exceeds.setHysteresis(0.05F);
+
+    // threshold is 255 counts and the band 51 counts, so it must fall to 204 before it can trigger again
+    unsigned int readings[] = { 300, 240, 300, 200, 300 };
+    bool expected[] = { true, false, false, false, true };
+    for(int i = 0; i < 5; i++) {
+        assertEquals(expected[i], exceeds.evaluateReading(readings[i]));
+    }
+}
+
+test(testAnalogEventGroupSamplesEachPinOnce) {
+    CountingAnalogEvent first(fakeAnalogDevice, AnalogInEvent::ANALOGIN_EXCEEDS);
+    CountingAnalogEvent second(fakeAnalogDevice, AnalogInEvent::ANALOGIN_BELOW);
+    CountingAnalogEvent otherPin(fakeAnalogDevice, AnalogInEvent::ANALOGIN_EXCEEDS, 3);
+    FilteredAnalogDevice otherDevice(&fakeAnalogDevice);
+    CountingAnalogEvent wrongDevice(otherDevice, AnalogInEvent::ANALOGIN_EXCEEDS);
+
+    AnalogEventGroup group(&fakeAnalogDevice, 5000);
+    assertTrue(group.addEvent(&first));
+    assertTrue(group.addEvent(&second));
+    assertTrue(group.addEvent(&otherPin));
+    assertFalse(group.addEvent(&wrongDevice));
+    assertEquals(3, group.getEventCount());
+    assertEquals(2, group.getPinCount());
+
+    // once grouped the events no longer read for themselves
+    fakeAnalogDevice.forcedValue = 300;
+    fakeAnalogDevice.reads = 0;
+    first.timeOfNextCheck();
+    assertEquals(0U, fakeAnalogDevice.reads);
+
+    // one read of each pin serves every event on it
+    assertEquals(2, group.sampleAndEvaluate());
+    assertEquals(2U, fakeAnalogDevice.reads);
+    assertTrue(first.isTriggered());
+    assertFalse(second.isTriggered());
+    assertTrue(otherPin.isTriggered());
+
+    fakeAnalogDevice.forcedValue = 100;
+    assertEquals(5000U, group.timeOfNextCheck());
+    assertEquals(4U, fakeAnalogDevice.reads);
+    assertTrue(second.isTriggered());
+    fakeAnalogDevice.forcedValue = -1;
+}
+
+test(testAnalogEventHardwareThreshold) {
+    CountingAnalogEvent polled(fakeAnalogDevice, AnalogInEvent::ANALOGIN_EXCEEDS);
+    assertFalse(polled.useHardwareThreshold());
+    CountingAnalogEvent change(fakeAnalogDevice, AnalogInEvent::ANALOGIN_CHANGE, 5);
+    assertFalse(change.useHardwareThreshold());
+
+    CountingAnalogEvent watched(fakeAnalogDevice, AnalogInEvent::ANALOGIN_BELOW, 5);
+    assertTrue(watched.useHardwareThreshold());
+    assertTrue(watched.isHardwareThreshold());
+    assertEquals(255U, fakeAnalogDevice.watchedCounts);
+
+    // no polling once watched in hardware
+    fakeAnalogDevice.reads = 0;
+    assertEquals((uint32_t)secondsToMicros(1), watched.timeOfNextCheck());
+    assertEquals(0U, fakeAnalogDevice.reads);
+
+    // crossings arrive as if from the interrupt, it latches until the condition is no longer met
+    fakeAnalogDevice.watcher->thresholdCrossed(true);
+    assertFalse(watched.isTriggered());
+    fakeAnalogDevice.watcher->thresholdCrossed(false);
+    assertTrue(watched.isTriggered());
+
+    // the device is only rearmed once the triggered event has run, and then only once.
+    fakeAnalogDevice.rearms = 0;
+    watched.timeOfNextCheck();
+    assertEquals(0, fakeAnalogDevice.rearms);
+    watched.setTriggered(false);
+    assertEquals((uint32_t)secondsToMicros(1), watched.timeOfNextCheck());
+    assertEquals(1, fakeAnalogDevice.rearms);
+    watched.timeOfNextCheck();
+    assertEquals(1, fakeAnalogDevice.rearms);
+
+    fakeAnalogDevice.watcher->thresholdCrossed(false);
+    assertFalse(watched.isTriggered());
+
+    watched.stopHardwareThreshold();
+    assertTrue(fakeAnalogDevice.watcher == nullptr);
+    assertFalse(watched.isHardwareThreshold());
+}
+
+test(testDfRobotDecodesInCounts) {
+    fakeAnalogDevice.forcedValue = 20;
+    DfRobotInputAbstraction dfRobot(&dfRobotAvrRanges, 2, &fakeAnalogDevice);
+    assertEquals(1 << DF_KEY_RIGHT, dfRobot.readPort(0));
+
+    fakeAnalogDevice.forcedValue = 300;
+    dfRobot.runLoop();
+    assertEquals(1 << DF_KEY_DOWN, dfRobot.readPort(0));
+    assertTrue(dfRobot.readValue(DF_KEY_DOWN));
+
+    // a move within the allowable range is ignored as noise, even if it crosses a boundary
+    dfRobot.readingAvailable(455);
+    assertEquals(1 << DF_KEY_LEFT, dfRobot.readPort(0));
+    dfRobot.readingAvailable(446);
+    assertEquals(1 << DF_KEY_LEFT, dfRobot.readPort(0));
+
+    dfRobot.readingAvailable(1000);
+    assertEquals(0, dfRobot.readPort(0));
+    assertEquals(1 << DF_KEY_UP, dfRobot.mapAnalogToPin(0.2F));
+    fakeAnalogDevice.forcedValue = -1;
+}
+
+void onJoystickAxis(int) { }
+
+test(testTwoAxisJoystickSharesOneSample) {
+    RotaryEncoder xEncoder(onJoystickAxis);
+    RotaryEncoder yEncoder(onJoystickAxis);
+    xEncoder.changePrecision(100, 50);
+    yEncoder.changePrecision(100, 50);
+    TwoAxisJoystick joystick(&fakeAnalogDevice, 2, 3);
+    joystick.attachEncoders(&xEncoder, &yEncoder);
+
+    // pushed right and up, both axes come from one batch read and move straight away.
+    fakeAnalogDevice.forcedValue = 1000;
+    fakeAnalogDevice.reads = 0;
+    joystick.exec();
+    assertEquals(2U, fakeAnalogDevice.reads);
+    assertEquals(51, xEncoder.getCurrentReading());
+    assertEquals(51, yEncoder.getCurrentReading());
+    assertEquals(uint8_t((1U << JOYSTICK_XY_RIGHT) | (1U << JOYSTICK_XY_UP)), joystick.readPort(0));
+    assertEquals(uint8_t(1), joystick.readValue(JOYSTICK_XY_RIGHT));
+    assertEquals(uint8_t(0), joystick.readValue(JOYSTICK_XY_LEFT));
+
+    // held, the next repeat waits for the interval plus the acceleration delay.
+    joystick.exec();
+    assertEquals(51, xEncoder.getCurrentReading());
+
+    // within the deadzone nothing is pressed, then pushing the other way moves at once.
+    fakeAnalogDevice.forcedValue = 520;
+    joystick.exec();
+    assertEquals(uint8_t(0), joystick.getDirections());
+    fakeAnalogDevice.forcedValue = 0;
+    joystick.setAxisInverted(1, true);
+    joystick.exec();
+    assertEquals(50, xEncoder.getCurrentReading());
+    assertEquals(52, yEncoder.getCurrentReading());
+    assertEquals(uint8_t((1U << JOYSTICK_XY_LEFT) | (1U << JOYSTICK_XY_UP)), joystick.getDirections());
+
+    assertEquals(50U, TwoAxisJoystick::nextInterval(9));
+    fakeAnalogDevice.forcedValue = -1;
+}
@@ -2,6 +2,7 @@
 #include <testing/SimpleTest.h>
 #include <IoAbstractionWire.h>
 #include <MockIoAbstraction.h>
+#include <StaticIoAbstraction.h>
 
 using namespace SimpleTest;
 
@@ -141,4 +142,550 @@ test(testMultiIoPassThrough) {
 
     assertEquals(ioDevice1.getErrorMode(), NO_ERROR);
     assertEquals(ioDevice2.getErrorMode(), NO_ERROR);
-}
\ No newline at end of file
+}
+
+MockedIoAbstraction maskDevice1;
+MockedIoAbstraction maskDevice2;
+MultiIoAbstraction multiIoMask(16);
+
+test(testMultiIoPinMaskSplitsAcrossDevices) {
+    multiIoMask.addIoExpander(&maskDevice1, 16);
+    multiIoMask.addIoExpander(&maskDevice2, 16);
+
+    for(int i=0; i<8; i++) {
+        multiIoMask.pinMode(16 + i, INPUT);
+        multiIoMask.pinMode(24 + i, OUTPUT);
+        multiIoMask.pinMode(32 + i, INPUT);
+        multiIoMask.pinMode(40 + i, OUTPUT);
+    }
+
+    maskDevice1.setValueForReading(0, 0x00a5);
+    maskDevice2.setValueForReading(0, 0x005a);
+
+    // pins 20..23 are on the first device and 32..35 on the second, the output pins between are not in the mask.
+    assertEquals((IoPinMask)0xa00a, multiIoMask.readPinMask(20, 0xf00f));
+
+    // pins 24..31 are outputs on the first device and 40..47 outputs on the second.
+    multiIoMask.writePinMask(24, 0xff00ff, 0x3300cc);
+    assertEquals((uint16_t)0xcc00, maskDevice1.getWrittenValue(0));
+    assertEquals((uint16_t)0x3300, maskDevice2.getWrittenValue(0));
+
+    assertEquals(maskDevice1.getErrorMode(), NO_ERROR);
+    assertEquals(maskDevice2.getErrorMode(), NO_ERROR);
+}
+
+test(testStaticMultiAndNegatingIo) {
+    MockedIoAbstraction staticDevice1;
+    MockedIoAbstraction staticDevice2;
+    StaticNegatingIo<MockedIoAbstraction> negatedDevice2(staticDevice2);
+    StaticMultiIo<MockedIoAbstraction, 16, StaticNegatingIo<MockedIoAbstraction>> staticMulti(staticDevice1, negatedDevice2);
+    StaticIoAdapter<decltype(staticMulti)> adapter(staticMulti);
+    IoAbstractionRef ref = &adapter;
+
+    for(int i=0; i<8; i++) {
+        ref->pinMode(i, INPUT);
+        ref->pinMode(i + 8, OUTPUT);
+        ref->pinMode(i + 16, INPUT);
+        ref->pinMode(i + 24, OUTPUT);
+    }
+
+    staticDevice1.setValueForReading(0, 0x0001);
+    staticDevice2.setValueForReading(0, 0x00fe);
+
+    // the first device reads directly, the second is inverted by the negating layer.
+    assertEquals(HIGH, staticMulti.digitalRead(0));
+    assertEquals(LOW, staticMulti.digitalRead(1));
+    assertEquals(HIGH, ref->digitalRead(16));
+    assertEquals(LOW, ref->digitalRead(17));
+    assertEquals((IoPinMask)0x00010001, ref->readPinMask(0, 0x00ff00ff));
+
+    staticMulti.digitalWrite(8, HIGH);
+    ref->digitalWrite(24, LOW);
+    assertTrue(ref->sync());
+    assertEquals((uint16_t)0x0100, staticDevice1.getWrittenValue(0));
+    assertEquals((uint16_t)0x0100, staticDevice2.getWrittenValue(0));
+
+    assertEquals(staticDevice1.getErrorMode(), NO_ERROR);
+    assertEquals(staticDevice2.getErrorMode(), NO_ERROR);
+}
+
+test(testShiftRegBufferBeyondThirtyTwoBits) {
+    // twelve devices worth of buffer, as used by long 595 chains.
+    uint8_t buffer[12] = {};
+
+    // a write that is not byte aligned and crosses into the fifth byte of the window.
+    assertTrue(shiftRegBufferWrite(buffer, sizeof buffer, 84, 0xffffffff, 0x12345678));
+    assertEquals((uint8_t)0x80, buffer[10]);
+    assertEquals((uint8_t)0x67, buffer[11]);
+
+    // bits past the end of the buffer are ignored on write and read back as zero.
+    assertEquals((IoPinMask)0x678, shiftRegBufferRead(buffer, sizeof buffer, 84));
+    assertEquals((IoPinMask)0x67800000, shiftRegBufferRead(buffer, sizeof buffer, 64));
+
+    // writing the same values again is not a change, so a chain would not need to be shifted.
+    assertFalse(shiftRegBufferWrite(buffer, sizeof buffer, 84, 0xfff, 0x678));
+    assertTrue(shiftRegBufferWrite(buffer, sizeof buffer, 0, 0x1, 0x1));
+    assertEquals((uint8_t)0x01, buffer[0]);
+}
+
+test(testMultiIoRoutesBeyondInitialDelegateCapacity) {
+    // more expanders than MAX_ALLOWABLE_DELEGATES, with ranges that do not line up with the routing blocks.
+    const int numDevices = MAX_ALLOWABLE_DELEGATES + 4;
+    MockedIoAbstraction* devices[numDevices];
+    auto* bigMulti = new MultiIoAbstraction(5);
+    for(int i = 0; i < numDevices; i++) {
+        devices[i] = new MockedIoAbstraction();
+        bigMulti->addIoExpander(devices[i], 7);
+    }
+
+    for(int i = 0; i < numDevices; i++) {
+        pinid_t firstPin = 5 + (i * 7);
+        for(int p = 0; p < 7; p++) bigMulti->pinMode(firstPin + p, INPUT);
+        devices[i]->setValueForReading(0, 1 << (i % 7));
+    }
+
+    for(int i = 0; i < numDevices; i++) {
+        pinid_t firstPin = 5 + (i * 7);
+        for(int p = 0; p < 7; p++) {
+            assertEquals((uint8_t)((p == (i % 7)) ? HIGH : LOW), bigMulti->digitalRead(firstPin + p));
+        }
+        assertEquals(devices[i]->getErrorMode(), NO_ERROR);
+    }
+
+    // a mask spanning several of the small devices is split between them.
+    assertEquals((IoPinMask)0x0101, bigMulti->readPinMask(5, 0x3fff));
+
+    delete bigMulti; // also deletes the mocked devices
+}
+
+class FailingSyncMockIo : public MockedIoAbstraction {
+public:
+    bool runLoop() override {
+        MockedIoAbstraction::runLoop();
+        return false;
+    }
+};
+
+test(testMultiIoOnlySyncsDirtyDelegatesAndIsolatesFailures) {
+    auto* failing = new FailingSyncMockIo();
+    auto* outputs = new MockedIoAbstraction();
+    auto* idle = new MockedIoAbstraction();
+    MultiIoAbstraction dirtyMulti(10);
+    dirtyMulti.addIoExpander(failing, 16);
+    dirtyMulti.addIoExpander(outputs, 16);
+    dirtyMulti.addIoExpander(idle, 16);
+
+    // every delegate is synced once after being added, the failure does not stop the later delegates.
+    assertFalse(dirtyMulti.sync());
+    assertEquals(1, failing->getNumberOfRunLoops());
+    assertEquals(1, outputs->getNumberOfRunLoops());
+    assertEquals(1, idle->getNumberOfRunLoops());
+    assertFalse(dirtyMulti.getDelegateSyncStatus(1));
+    assertTrue(dirtyMulti.getDelegateSyncStatus(2));
+
+    // now only the delegate with pending writes, plus the failed one retrying, are synced.
+    dirtyMulti.pinMode(26, OUTPUT);
+    dirtyMulti.digitalWrite(26, HIGH);
+    assertFalse(dirtyMulti.sync());
+    assertEquals(2, failing->getNumberOfRunLoops());
+    assertEquals(2, outputs->getNumberOfRunLoops());
+    assertEquals(1, idle->getNumberOfRunLoops());
+    assertEquals((uint16_t)0x0001, outputs->getWrittenValue(1));
+
+    // with nothing written the output delegate is left alone.
+    assertFalse(dirtyMulti.sync());
+    assertEquals(2, outputs->getNumberOfRunLoops());
+    assertEquals(1, idle->getNumberOfRunLoops());
+    assertEquals(outputs->getErrorMode(), NO_ERROR);
+
+    // a write made directly on the delegate is not seen, it is only synced once written through the multi IO.
+    outputs->digitalWrite(0, LOW);
+    assertFalse(dirtyMulti.sync());
+    assertEquals(2, outputs->getNumberOfRunLoops());
+    dirtyMulti.digitalWrite(26, LOW);
+    assertFalse(dirtyMulti.sync());
+    assertEquals(3, outputs->getNumberOfRunLoops());
+    assertEquals(outputs->getErrorMode(), NO_ERROR);
+}
+
+class SwitchableSyncMockIo : public MockedIoAbstraction {
+public:
+    bool failSync = false;
+    bool runLoop() override {
+        MockedIoAbstraction::runLoop();
+        return !failSync;
+    }
+};
+
+test(testMultiIoFrameCaptureReadsOneSnapshot) {
+    auto* first = new MockedIoAbstraction();
+    auto* second = new SwitchableSyncMockIo();
+    MultiIoAbstraction frameMulti(10);
+    frameMulti.addIoExpander(first, 16);
+    frameMulti.addIoExpander(second, 16);
+    frameMulti.setFrameCapture(MULTIIO_FRAME_SINGLE);
+    for(int i=0; i<4; i++) {
+        frameMulti.pinMode(10 + i, INPUT);
+        frameMulti.pinMode(26 + i, INPUT);
+    }
+
+    // before the first capture, reads go straight to the devices.
+    first->setValueForReading(0, 0x0003);
+    assertEquals((IoPinMask)0x3, frameMulti.readPinMask(10, 0xf));
+
+    // after a sync both devices are read from the frame, even though the devices have since changed.
+    first->setValueForReading(1, 0x0005);
+    second->setValueForReading(1, 0x000a);
+    assertTrue(frameMulti.sync());
+    uint16_t frame = frameMulti.getFrameNumber();
+    first->setValueForReading(1, 0x000f);
+    second->setValueForReading(1, 0x0000);
+    assertEquals((IoPinMask)0x000a0005, frameMulti.readPinMask(10, 0x000f000f));
+    assertEquals((uint8_t)1, frameMulti.readValue(27));
+    assertEquals((uint8_t)0, frameMulti.readValue(26));
+
+    first->setValueForReading(2, 0x0006);
+    second->setValueForReading(2, 0x0009);
+    assertTrue(frameMulti.sync());
+    assertEquals((uint16_t)(frame + 1), frameMulti.getFrameNumber());
+    assertEquals((IoPinMask)0x00090006, frameMulti.readPinMask(10, 0x000f000f));
+
+    // double buffered, a frame is only published when every device synced.
+    frameMulti.setFrameCapture(MULTIIO_FRAME_DOUBLE);
+    first->setValueForReading(3, 0x0001);
+    second->setValueForReading(3, 0x0002);
+    assertTrue(frameMulti.sync());
+    assertEquals((IoPinMask)0x00020001, frameMulti.readPinMask(10, 0x000f000f));
+    frame = frameMulti.getFrameNumber();
+
+    second->failSync = true;
+    first->setValueForReading(4, 0x0008);
+    assertFalse(frameMulti.sync());
+    assertEquals(frame, frameMulti.getFrameNumber());
+    assertEquals((IoPinMask)0x00020001, frameMulti.readPinMask(10, 0x000f000f));
+
+    second->failSync = false;
+    first->setValueForReading(5, 0x0008);
+    second->setValueForReading(5, 0x0004);
+    assertTrue(frameMulti.sync());
+    assertEquals((IoPinMask)0x00040008, frameMulti.readPinMask(10, 0x000f000f));
+
+    assertEquals(first->getErrorMode(), NO_ERROR);
+    assertEquals(second->getErrorMode(), NO_ERROR);
+}
+
+test(testMultiIoFrameCaptureIncludesPinsSetUpFirst) {
+    auto* device = new MockedIoAbstraction();
+    MultiIoAbstraction frameMulti(10);
+    frameMulti.addIoExpander(device, 16);
+    for(int i=0; i<4; i++) {
+        frameMulti.pinMode(10 + i, INPUT);
+    }
+
+    // the inputs were configured before frame capture was turned on, and must still be captured.
+    frameMulti.setFrameCapture(MULTIIO_FRAME_SINGLE);
+    device->setValueForReading(1, 0x0009);
+    assertTrue(frameMulti.sync());
+    device->setValueForReading(1, 0x0000);
+    assertEquals((IoPinMask)0x9, frameMulti.readPinMask(10, 0xf));
+    assertEquals((uint8_t)1, frameMulti.readValue(13));
+
+    // turning capture off reads live, and turning it back on keeps the inputs.
+    frameMulti.setFrameCapture(MULTIIO_FRAME_OFF);
+    assertEquals((IoPinMask)0x0, frameMulti.readPinMask(10, 0xf));
+    frameMulti.setFrameCapture(MULTIIO_FRAME_SINGLE);
+    device->setValueForReading(2, 0x0006);
+    assertTrue(frameMulti.sync());
+    device->setValueForReading(2, 0x0000);
+    assertEquals((IoPinMask)0x6, frameMulti.readPinMask(10, 0xf));
+
+    assertEquals(device->getErrorMode(), NO_ERROR);
+}
+
+test(testCostModelIoChargesOnlyTheTrafficEachSyncNeeds) {
+    auto* inputs = new CostModelIoAbstraction();
+    MockBusCostModel registerModel;
+    registerModel.registerBytes = 1;
+    auto* outputs = new CostModelIoAbstraction(6, registerModel);
+    MultiIoAbstraction costMulti(10);
+    costMulti.addIoExpander(inputs, 16);
+    costMulti.addIoExpander(outputs, 16);
+
+    // 2 data bytes plus the address byte at 100KHz is 29 clocks each of 10us.
+    assertEquals((uint32_t)290, inputs->transactionMicros(2));
+
+    for(pinid_t i = 0; i < 8; i++) {
+        costMulti.pinMode(10 + i, INPUT);
+        costMulti.pinMode(26 + i, OUTPUT);
+    }
+    costMulti.sync();
+    inputs->resetStatistics();
+    outputs->resetStatistics();
+
+    // reading many input pins costs one read per sync, and the unchanged outputs are not synced at all.
+    for(int poll = 0; poll < 3; poll++) {
+        for(pinid_t i = 0; i < 8; i++) costMulti.digitalRead(10 + i);
+        costMulti.sync();
+    }
+    assertEquals((uint32_t)3, inputs->getStatistics().syncs);
+    assertEquals((uint32_t)3, inputs->getStatistics().transactions);
+    assertEquals((uint32_t)6, inputs->getStatistics().bytesRead);
+    assertEquals((uint32_t)0, inputs->getStatistics().bytesWritten);
+    assertEquals((uint32_t)870, inputs->getStatistics().simulatedMicros);
+    assertEquals((uint32_t)0, outputs->getStatistics().syncs);
+
+    // writing several outputs is one write of the register and port bytes.
+    costMulti.digitalWrite(26, HIGH);
+    costMulti.digitalWrite(27, HIGH);
+    costMulti.sync();
+    assertEquals((uint32_t)1, outputs->getStatistics().syncs);
+    assertEquals((uint32_t)1, outputs->getStatistics().transactions);
+    assertEquals((uint32_t)3, outputs->getStatistics().bytesWritten);
+    assertEquals(outputs->transactionMicros(3), outputs->getStatistics().simulatedMicros);
+}
+
+class TestMultiPortDevice : public StandardMultiPortDevice {
+public:
+    TestMultiPortDevice() : StandardMultiPortDevice(5) {}
+    void pinDirection(pinid_t pin, uint8_t mode) override { if(mode != OUTPUT) setReadPort(pin / 8); }
+    void attachInterrupt(pinid_t, RawIntHandler, uint8_t) override { }
+    bool runLoop() override { clearChangeFlags(); return true; }
+    void setReadValue(uint8_t port, uint8_t value) { lastRead[port] = value; }
+    uint8_t getWriteValue(uint8_t port) const { return toWrite[port]; }
+protected:
+    void initDevice() override { markInitialised(); }
+};
+
+test(testMultiPortDeviceSpansPorts) {
+    TestMultiPortDevice device;
+    assertEquals((uint8_t)5, device.getPortCount());
+
+    // a single pin in the last port of a 40 bit device
+    device.writeValue(39, HIGH);
+    assertEquals((uint8_t)0x80, device.getWriteValue(4));
+    assertTrue(device.isWritePortSet(4));
+    assertFalse(device.isWritePortSet(0));
+
+    // a mask that starts mid port and covers three ports only changes the masked bits
+    device.writePort(8, 0xff);
+    device.runLoop();
+    device.writePinMask(12, 0x00ff0f, 0x00aa05);
+    assertEquals((uint8_t)0x5f, device.getWriteValue(1));
+    assertEquals((uint8_t)0xa0, device.getWriteValue(2));
+    assertEquals((uint8_t)0x0a, device.getWriteValue(3));
+    assertFalse(device.isWritePortSet(0));
+    assertTrue(device.isWritePortSet(1));
+    assertTrue(device.isWritePortSet(3));
+
+    device.setReadValue(2, 0x34);
+    device.setReadValue(3, 0x12);
+    device.setReadValue(4, 0xc0);
+    assertEquals((IoPinMask)0x1234, device.readPinMask(16, 0xffff));
+    assertEquals((IoPinMask)0xc0123, device.readPinMask(20, 0xfffff));
+    assertTrue(device.readValue(39));
+    assertFalse(device.readValue(40));
+}
+
+test(testStaticStorageAndFactoryAllocation) {
+    static_assert(IoaRamFootprint<MockedIoAbstraction, MockedIoAbstraction>::bytes == 2 * sizeof(MockedIoAbstraction), "footprint");
+
+    IoaStaticStorage<MockedIoAbstraction> storage;
+    assertFalse(storage.isConstructed());
+    auto mockIo = storage.create(4);
+    assertTrue(storage.isConstructed());
+    assertEquals((void*)storage.get(), (void*)mockIo);
+    assertTrue(mockIo == storage.create(2));
+
+    // without a pool configured, factories still construct on the heap and nothing is taken from the pool.
+    auto multiIo = multiIoExpander(10);
+    assertTrue(multiIo != nullptr);
+    assertFalse(ioaPoolOwns(multiIo));
+    assertEquals((size_t)0, ioaPoolUsed());
+    ioaDestroy(multiIo);
+}
+
+class StepRecordingInitDevice : public DeferredInitDevice {
+private:
+    const void* bus;
+    uint8_t stepsNeeded;
+    uint8_t failOnStep;
+    char id;
+public:
+    static char order[16];
+    static int orderLen;
+
+    StepRecordingInitDevice(const void* bus, uint8_t stepsNeeded, char id, uint8_t failOnStep = 0xff)
+            : bus(bus), stepsNeeded(stepsNeeded), failOnStep(failOnStep), id(id) {}
+
+    IoDeviceInitState initStep(uint8_t step) override {
+        if(orderLen < 15) order[orderLen++] = id;
+        if(step == failOnStep) {
+            failOnStep = 0xff;
+            return IOINIT_FAILED;
+        }
+        return (step + 1 >= stepsNeeded) ? IOINIT_READY : IOINIT_IN_PROGRESS;
+    }
+
+    const void* getInitBus() const override { return bus; }
+};
+
+char StepRecordingInitDevice::order[16];
+int StepRecordingInitDevice::orderLen = 0;
+char readyOrder[8];
+int readyCount = 0;
+
+test(testInitPipelineInterleavesDevicesAndBuses) {
+    int busA, busB;
+    StepRecordingInitDevice slowA(&busA, 3, '1');
+    StepRecordingInitDevice flakyA(&busA, 2, '2', 1);
+    StepRecordingInitDevice quickB(&busB, 1, 'b');
+    StepRecordingInitDevice::orderLen = 0;
+    readyCount = 0;
+
+    IoDeviceInitPipeline pipeline;
+    assertTrue(pipeline.addDevice(&slowA));
+    assertTrue(pipeline.addDevice(&flakyA));
+    assertTrue(pipeline.addDevice(&quickB));
+    assertTrue(slowA.isInitDeferred());
+
+    // register the callback without scheduling, so that each pass can be checked in turn.
+    pipeline.start([](uint8_t idx, bool ok) {
+        if(ok) readyOrder[readyCount++] = char('0' + idx);
+    });
+    taskManager.reset();
+
+    // the device on the second bus is stepped between the two on the first.
+    assertTrue(pipeline.runPass());
+    assertTrue(pipeline.isReady(2));
+    assertEquals(IOINIT_IN_PROGRESS, pipeline.getState(0));
+    assertTrue(slowA.isInitDeferred());
+    assertFalse(quickB.isInitDeferred());
+
+    // the failed step is retried on the next pass, without affecting the others.
+    assertTrue(pipeline.runPass());
+    assertFalse(pipeline.runPass());
+    assertTrue(pipeline.isComplete());
+    assertTrue(pipeline.isReady(0));
+    assertTrue(pipeline.isReady(1));
+    assertFalse(flakyA.isInitDeferred());
+
+    StepRecordingInitDevice::order[StepRecordingInitDevice::orderLen] = 0;
+    assertStringEquals("1b22112", StepRecordingInitDevice::order);
+    readyOrder[readyCount] = 0;
+    assertStringEquals("201", readyOrder);
+}
+
+class AlwaysFailingInitDevice : public DeferredInitDevice {
+public:
+    int attempts = 0;
+    IoDeviceInitState initStep(uint8_t) override {
+        attempts++;
+        return IOINIT_FAILED;
+    }
+};
+
+test(testInitPipelineReportsFailureAfterRetries) {
+    AlwaysFailingInitDevice failing;
+    StepRecordingInitDevice working(nullptr, 2, 'w');
+    IoDeviceInitPipeline pipeline;
+    pipeline.addDevice(&failing);
+    pipeline.addDevice(&working);
+
+    assertFalse(pipeline.runToCompletion());
+    assertEquals(IOINIT_FAILED, pipeline.getState(0));
+    assertTrue(pipeline.isReady(1));
+    assertEquals(1 + IOA_INIT_STEP_RETRIES, failing.attempts);
+    assertFalse(failing.isInitDeferred());
+}
+
+class FlakyStepsInitDevice : public DeferredInitDevice {
+private:
+    uint8_t failuresLeft = IOA_INIT_STEP_RETRIES;
+public:
+    IoDeviceInitState initStep(uint8_t step) override {
+        // every step fails as many times as it may be retried before it works.
+        if(failuresLeft != 0) {
+            failuresLeft--;
+            return IOINIT_FAILED;
+        }
+        failuresLeft = IOA_INIT_STEP_RETRIES;
+        return (step == 2) ? IOINIT_READY : IOINIT_IN_PROGRESS;
+    }
+};
+
+test(testInitPipelineRetriesAreCountedPerStep) {
+    FlakyStepsInitDevice flaky;
+    IoDeviceInitPipeline pipeline;
+    pipeline.addDevice(&flaky);
+
+    assertTrue(pipeline.runToCompletion());
+    assertTrue(pipeline.isReady(0));
+}
+
+// the shift register tests drive board pins 2 to 7, nothing needs to be connected to them.
+int shiftRegSyncsNotified = 0;
+
+void onShiftRegSynced(BasicIoAbstraction*) {
+    shiftRegSyncsNotified++;
+}
+
+int fillTaskManager() {
+    int filled = 0;
+    while(filled < 1000 && taskManager.scheduleOnce(60, [] {}, TIME_SECONDS) != TASKMGR_INVALIDID) filled++;
+    return filled;
+}
+
+test(testShiftRegisterAsyncSyncRunsOnTaskManager) {
+    shiftRegSyncsNotified = 0;
+    ShiftRegisterIoAbstraction shiftReg(ShiftRegConfig(2, 3, 4, 1), ShiftRegConfig(5, 6, 7, 1));
+    shiftReg.setAsyncSync(true, onShiftRegSynced);
+    shiftReg.writeValue(SHIFT_REGISTER_OUTPUT_CUTOVER, HIGH);
+
+    assertTrue(shiftReg.runLoop());
+    assertTrue(shiftReg.isSyncInProgress());
+    assertEquals((uint16_t)0, shiftReg.getCompletedSyncCount());
+
+    // the input and then the output step each run as a task once their latch has settled.
+    unsigned long started = millis();
+    while(shiftReg.isSyncInProgress() && (millis() - started) < 100) taskManager.runLoop();
+    assertFalse(shiftReg.isSyncInProgress());
+    assertEquals((uint16_t)1, shiftReg.getCompletedSyncCount());
+    assertEquals(1, shiftRegSyncsNotified);
+    taskManager.reset();
+}
+
+test(testShiftRegisterAsyncSyncFallsBackWhenNoTaskSlot) {
+    shiftRegSyncsNotified = 0;
+    ShiftRegisterIoAbstraction shiftReg(ShiftRegConfig(2, 3, 4, 1), ShiftRegConfig(5, 6, 7, 1));
+    shiftReg.setAsyncSync(true, onShiftRegSynced);
+    shiftReg.writeValue(SHIFT_REGISTER_OUTPUT_CUTOVER, HIGH);
+    assertNotEquals(0, fillTaskManager());
+
+    // no step can be scheduled, so the sync completes before returning and the next can start.
+    assertTrue(shiftReg.runLoop());
+    assertFalse(shiftReg.isSyncInProgress());
+    assertEquals((uint16_t)1, shiftReg.getCompletedSyncCount());
+    assertEquals(1, shiftRegSyncsNotified);
+    assertTrue(shiftReg.runLoop());
+    assertEquals((uint16_t)2, shiftReg.getCompletedSyncCount());
+    taskManager.reset();
+}
+
+test(testShiftRegister165AsyncSyncFallsBackWhenNoTaskSlot) {
+    shiftRegSyncsNotified = 0;
+    ShiftRegisterIoAbstraction165In shiftReg(ShiftRegConfig(2, 3, 4, 2));
+    shiftReg.setAsyncSync(true, onShiftRegSynced);
+
+    assertTrue(shiftReg.runLoop());
+    assertTrue(shiftReg.isSyncInProgress());
+    taskManager.reset();
+    shiftReg.exec();
+    assertEquals((uint16_t)1, shiftReg.getCompletedSyncCount());
+
+    assertNotEquals(0, fillTaskManager());
+    assertTrue(shiftReg.runLoop());
+    assertFalse(shiftReg.isSyncInProgress());
+    assertEquals((uint16_t)2, shiftReg.getCompletedSyncCount());
+    assertEquals(2, shiftRegSyncsNotified);
+    taskManager.reset();
+}
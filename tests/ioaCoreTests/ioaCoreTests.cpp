@@ -4,6 +4,9 @@
 #include <PlatformDeterminationWire.h>
 #include <MockEepromAbstraction.h>
 #include <EepromAbstractionWire.h>
+#include <EepromRecordStore.h>
+#include <EepromSettingsBlob.h>
+#include <I2cBusStatistics.h>
 
 using namespace SimpleTest;
 
@@ -19,6 +22,28 @@ bool romClear(EepromAbstraction& eeprom, EepromPosition pos) {
     return true;
 }
 
+class RecordingTxnListener : public I2cTransactionListener {
+public:
+    I2cTransaction* completed[4] = {};
+    bool results[4] = {};
+    uint8_t count = 0;
+
+    void i2cTransactionComplete(I2cTransaction* transaction, bool success) override {
+        if(count < 4) {
+            completed[count] = transaction;
+            results[count] = success;
+        }
+        count++;
+    }
+};
+
+bool serviceI2cScheduler() {
+    for(int i = 0; i < 100 && i2cTransactionScheduler.getQueuedCount() != 0; i++) {
+        i2cTransactionScheduler.exec();
+    }
+    return i2cTransactionScheduler.getQueuedCount() == 0;
+}
+
 // for devices where an I2C rom is not installed. We cannot directly test.
 #ifndef IOA_EXCLUDE_I2C_TESTS
 
@@ -59,6 +84,118 @@ test(testI2cSingleWrites) {
     assertFalse(eeprom.hasErrorOccurred());
 }
 
+test(testI2cLargeBlockTransfers) {
+    I2cAt24Eeprom eeprom(0x50, PAGESIZE_AT24C128);
+    uint8_t block[300];
+    for(int i = 0; i < 300; i++) block[i] = uint8_t(i * 7);
+    eeprom.writeBlock(1000, block, sizeof block);
+
+    uint8_t readBack[300] = {};
+    eeprom.readBlock(readBack, 1000, sizeof readBack);
+    assertFalse(eeprom.hasErrorOccurred());
+    assertTrue(memcmp(block, readBack, sizeof block) == 0);
+    assertEquals((uint16_t)((block[10] << 8) | block[11]), eeprom.read16(1010));
+}
+
+class FailingWriteAt24Eeprom : public I2cAt24Eeprom {
+public:
+    bool failWrites = false;
+
+    FailingWriteAt24Eeprom() : I2cAt24Eeprom(0x50, PAGESIZE_AT24C128) {}
+
+protected:
+    void romWrite(EepromPosition romDest, const uint8_t* memSrc, size_t len) override {
+        // a write beyond the end of the device fails without any bus traffic, as a device that stopped acking would.
+        I2cAt24Eeprom::romWrite(failWrites ? 0xffffU : romDest, memSrc, len);
+    }
+};
+
+test(testI2cCacheKeepsPageWhenEvictionFails) {
+    const EepromPosition cachedPos = 20;
+    const EepromPosition otherPos = (64 * 3) + 5;
+    I2cAt24Eeprom uncached(0x50, PAGESIZE_AT24C128);
+    uint8_t cachedVal = uncached.read8(cachedPos) ^ 0xffU;
+    uint8_t otherVal = uncached.read8(otherPos) ^ 0xffU;
+
+    FailingWriteAt24Eeprom eeprom;
+    assertTrue(eeprom.enablePageCache(1));
+    eeprom.write8(cachedPos, cachedVal);
+    assertTrue(eeprom.isCacheDirty());
+
+    // the only slot cannot be written out, so the other page is read and written directly instead.
+    eeprom.failWrites = true;
+    eeprom.write8(otherPos, otherVal);
+    assertFalse(eeprom.hasErrorOccurred());
+    assertEquals(otherVal, uncached.read8(otherPos));
+
+    // the dirty page is still cached and has not reached the device.
+    assertTrue(eeprom.isCacheDirty());
+    assertEquals(cachedVal, eeprom.read8(cachedPos));
+    assertTrue(uncached.read8(cachedPos) != cachedVal);
+
+    // and once the device takes writes again, the flush writes it.
+    eeprom.failWrites = false;
+    eeprom.flushCache();
+    assertFalse(eeprom.isCacheDirty());
+    assertFalse(eeprom.hasErrorOccurred());
+    assertEquals(cachedVal, uncached.read8(cachedPos));
+}
+
+test(testI2cSchedulerCompletesRead) {
+    RecordingTxnListener listener;
+    uint8_t address[2] = {0, 0};
+    uint8_t data[4] = {};
+    I2cTransaction txn;
+    txn.prepare(defaultWireTypePtr, 0x50, &listener);
+    txn.setWrite(address, sizeof address);
+    txn.setRead(data, sizeof data);
+    assertTrue(txn.hasRead());
+    assertTrue(i2cTransactionScheduler.submit(&txn));
+    assertTrue(serviceI2cScheduler());
+
+    assertEquals((uint8_t)1, listener.count);
+    assertTrue(listener.completed[0] == &txn);
+    assertTrue(listener.results[0]);
+    assertTrue(txn.wasSuccessful());
+    assertTrue(txn.isIdle());
+
+    I2cAt24Eeprom eeprom(0x50, PAGESIZE_AT24C128);
+    assertEquals(eeprom.read8(0), data[0]);
+    assertEquals(eeprom.read8(3), data[3]);
+}
+
+int scheduledFlushes = 0;
+bool scheduledFlushOk = false;
+
+void onScheduledFlushComplete(I2cAt24Eeprom* /*eeprom*/, bool success) {
+    scheduledFlushes++;
+    scheduledFlushOk = success;
+}
+
+test(testI2cScheduledEepromFlush) {
+    // the queue completes the writes after control returns to task manager, so the eeprom must outlive the test.
+    static I2cAt24Eeprom eeprom(0x50, PAGESIZE_AT24C128);
+    assertTrue(eeprom.enablePageCache(2));
+    assertTrue(eeprom.enableAsyncWrites(onScheduledFlushComplete));
+    eeprom.setScheduledTransfers(true);
+    for(int i = 0; i < 80; i++) eeprom.write8(900 + i, i ^ 0x5a);
+
+    // each page write is only submitted, the flush carries on from the completion callbacks.
+    eeprom.flushCache();
+    assertTrue(eeprom.isFlushInProgress());
+    unsigned long started = millis();
+    while(eeprom.isFlushInProgress() && (millis() - started) < 500) taskManager.yieldForMicros(100);
+    assertEquals(1, scheduledFlushes);
+    assertTrue(scheduledFlushOk);
+    assertFalse(eeprom.isCacheDirty());
+    assertEquals((uint8_t)0, i2cTransactionScheduler.getQueuedCount());
+
+    I2cAt24Eeprom uncached(0x50, PAGESIZE_AT24C128);
+    assertEquals((uint8_t)(0 ^ 0x5a), uncached.read8(900));
+    assertEquals((uint8_t)(79 ^ 0x5a), uncached.read8(979));
+    assertFalse(uncached.hasErrorOccurred());
+}
+
 test(badI2cEepromDoesNotLockCode) {
     serdebug("I2C bad EEPROM address test start.");
 
@@ -94,6 +231,324 @@ test(testMockEeprom) {
     assertTrue(eeprom.hasErrorOccurred());
 }
 
+test(testMockEepromLargeBlocks) {
+    MockEepromAbstraction eeprom(1024);
+    uint8_t block[600];
+    for(int i = 0; i < 600; i++) block[i] = uint8_t(i);
+
+    // the default implementation splits into calls of no more than 255 bytes.
+    eeprom.EepromAbstraction::writeBlock(100, block, sizeof block);
+    uint8_t readBack[600] = {};
+    eeprom.readBlock(readBack, 100, sizeof readBack);
+    assertTrue(memcmp(block, readBack, sizeof block) == 0);
+    memset(readBack, 0, sizeof readBack);
+    eeprom.EepromAbstraction::readBlock(readBack, 100, sizeof readBack);
+    assertTrue(memcmp(block, readBack, sizeof block) == 0);
+    assertFalse(eeprom.hasErrorOccurred());
+
+    eeprom.readBlock(readBack, 900, sizeof readBack);
+    assertTrue(eeprom.hasErrorOccurred());
+}
+
+test(testEepromRecordStoreWearLevels) {
+    MockEepromAbstraction eeprom(256);
+    EepromRecordStore store(&eeprom, 20, 6);
+    assertTrue(store.begin());
+    assertEquals((uint8_t)0, store.getKeyCount());
+    assertEquals((uint32_t)1234, store.readUint32(1, 1234));
+
+    // a value that rarely changes, then many writes of a counter, which spread round the other slots.
+    assertTrue(store.writeUint32(1, 0xf00d));
+    for(uint32_t i = 0; i < 40; i++) assertTrue(store.writeUint32(2, i));
+    assertEquals((uint32_t)41, store.getLastSequence());
+    assertTrue(store.writeUint32(2, 39));
+    assertEquals((uint32_t)41, store.getLastSequence());
+    assertEquals((uint32_t)0xf00d, store.readUint32(1));
+    assertEquals((uint32_t)39, store.readUint32(2));
+
+    // a second store over the same region rebuilds the index in one scan.
+    EepromRecordStore rebooted(&eeprom, 20, 6);
+    assertTrue(rebooted.begin());
+    assertEquals((uint8_t)2, rebooted.getKeyCount());
+    assertEquals((uint32_t)41, rebooted.getLastSequence());
+    assertEquals(store.getHeadSlot(), rebooted.getHeadSlot());
+    assertEquals((uint32_t)0xf00d, rebooted.readUint32(1));
+    assertEquals((uint32_t)39, rebooted.readUint32(2));
+
+    // a torn write of the latest record fails its CRC, so the previous value is used.
+    uint16_t latestSlot = (rebooted.getHeadSlot() + 5) % 6;
+    eeprom.write8(20 + (latestSlot * 12) + 6, 0x55);
+    EepromRecordStore afterTear(&eeprom, 20, 6);
+    assertTrue(afterTear.begin());
+    assertEquals((uint32_t)38, afterTear.readUint32(2));
+
+    uint8_t tooLong[8] = {};
+    assertFalse(store.write(3, tooLong, sizeof tooLong));
+}
+
+class BlockCountingEeprom : public MockEepromAbstraction {
+public:
+    int blockReads = 0;
+    int blockWrites = 0;
+    size_t bytesWritten = 0;
+
+    BlockCountingEeprom() : MockEepromAbstraction(256) {}
+
+    void readBlock(uint8_t* memDest, EepromPosition romSrc, size_t len) override {
+        blockReads++;
+        MockEepromAbstraction::readBlock(memDest, romSrc, len);
+    }
+
+    void writeBlock(EepromPosition romDest, const uint8_t* memSrc, size_t len) override {
+        blockWrites++;
+        bytesWritten += len;
+        MockEepromAbstraction::writeBlock(romDest, memSrc, len);
+    }
+};
+
+test(testEepromSettingsBlobLoadsOnceAndSavesChanges) {
+    BlockCountingEeprom eeprom;
+    EepromSettingsBlob settings(&eeprom, 16, 40, 3);
+
+    // nothing stored yet, so the first access loads, finds it invalid and starts from zero.
+    assertEquals((uint32_t)0, settings.get32(0));
+    assertFalse(settings.isValid());
+    assertEquals(2, eeprom.blockReads);
+    settings.set32(0, 0xdeadf00d);
+    settings.set16(10, 1234);
+    assertTrue(settings.save());
+    assertTrue(settings.isValid());
+    assertFalse(settings.isDirty());
+
+    // loaded again with the same version it is valid, and the fields are served from RAM.
+    EepromSettingsBlob reloaded(&eeprom, 16, 40, 3);
+    assertTrue(reloaded.load());
+    int readsAfterLoad = eeprom.blockReads;
+    assertEquals((uint32_t)0xdeadf00d, reloaded.get32(0));
+    assertEquals((uint16_t)1234, reloaded.get16(10));
+    assertEquals(readsAfterLoad, eeprom.blockReads);
+
+    // only the changed bytes and the header are written back, an unchanged value writes nothing.
+    eeprom.blockWrites = 0;
+    eeprom.bytesWritten = 0;
+    reloaded.set16(10, 1234);
+    assertFalse(reloaded.isDirty());
+    reloaded.set8(20, 7);
+    assertTrue(reloaded.save());
+    assertEquals(2, eeprom.blockWrites);
+    assertEquals((size_t)(1 + EEPROM_SETTINGS_HEADER_SIZE), eeprom.bytesWritten);
+
+    // a different version, or a corrupted byte, gives a blob that is not valid.
+    EepromSettingsBlob newLayout(&eeprom, 16, 40, 4);
+    assertFalse(newLayout.load());
+    eeprom.write8(16 + EEPROM_SETTINGS_HEADER_SIZE + 5, 0x55);
+    EepromSettingsBlob corrupted(&eeprom, 16, 40, 3);
+    assertFalse(corrupted.load());
+}
+
+test(testCostModelEepromCharges) {
+    EepromCostModel model;
+    model.transactionMicros = 100;
+    model.byteMicros = 10;
+    model.writeCycleMicros = 5000;
+    model.pageSize = 16;
+    CostModelEepromAbstraction eeprom(256, model);
+
+    // a 40 byte block starting part way through a page needs four page writes.
+    uint8_t block[40] = {};
+    eeprom.writeBlock(10, block, sizeof block);
+    auto& stats = eeprom.getStatistics();
+    assertEquals((uint32_t)4, stats.transactions);
+    assertEquals((uint32_t)4, stats.pageWrites);
+    assertEquals((uint32_t)40, stats.bytesWritten);
+    assertEquals((uint32_t)((4 * (100 + 5000)) + (40 * 10)), stats.simulatedMicros);
+
+    // a typed read is one transaction however the mock carries it out.
+    eeprom.resetStatistics();
+    eeprom.read32(10);
+    assertEquals((uint32_t)1, stats.transactions);
+    assertEquals((uint32_t)4, stats.bytesRead);
+    assertEquals((uint32_t)(100 + 40), stats.simulatedMicros);
+
+    eeprom.write8(12, 1);
+    eeprom.write8(12, 2);
+    assertEquals((uint16_t)3, eeprom.getCellWrites(12));
+    assertEquals((uint16_t)3, eeprom.getMaxCellWear());
+    eeprom.resetStatistics(true);
+    assertEquals((uint16_t)0, eeprom.getMaxCellWear());
+
+    // loading a settings blob is two transactions whatever its size.
+    EepromSettingsBlob settings(&eeprom, 0, 100, 1);
+    settings.load();
+    assertEquals((uint32_t)2, stats.transactions);
+}
+
+test(testI2cBusStatisticsPerAddress) {
+    I2cBusStatistics stats;
+    stats.recordTransaction(0x20, 2, true, 0, 150);
+    stats.recordTransaction(0x50, 34, true, 3, 900);
+    stats.recordTransaction(0x20, 2, false, 0, 400);
+
+    assertEquals((uint8_t)2, stats.getDeviceCount());
+    auto expander = stats.getStatisticsFor(0x20);
+    assertTrue(expander != nullptr);
+    assertEquals((uint32_t)2, expander->transactions);
+    assertEquals((uint32_t)2, expander->bytes);
+    assertEquals((uint32_t)1, expander->nacks);
+    assertEquals((uint32_t)550, expander->totalMicros);
+    assertEquals((uint32_t)400, expander->maxMicros);
+
+    auto rom = stats.getStatisticsFor(0x50);
+    assertTrue(rom != nullptr);
+    assertEquals((uint32_t)3, rom->retries);
+    assertEquals((uint32_t)34, rom->bytes);
+    assertTrue(stats.getStatisticsFor(0x21) == nullptr);
+
+    // fill the table, anything beyond it is only counted as overflow
+    for(uint8_t addr = 0x60; addr < 0x60 + IOA_I2C_STATISTICS_DEVICES; addr++) {
+        stats.recordTransaction(addr, 1, true, 0, 10);
+    }
+    assertEquals((uint8_t)IOA_I2C_STATISTICS_DEVICES, stats.getDeviceCount());
+    assertEquals((uint32_t)2, stats.getOverflowTransactions());
+
+    stats.reset();
+    assertEquals((uint8_t)0, stats.getDeviceCount());
+    assertTrue(stats.getStatisticsFor(0x20) == nullptr);
+}
+
+test(testI2cSchedulerQueuesAndReportsFailure) {
+    RecordingTxnListener listener;
+    uint8_t reg = 0;
+    I2cTransaction first;
+    I2cTransaction second;
+
+    // nothing answers at this address, so both fail, but each still completes, in the order submitted.
+    first.prepare(defaultWireTypePtr, 0x73, &listener);
+    first.setWrite(&reg, 1);
+    second.prepare(defaultWireTypePtr, 0x73, &listener);
+    second.setWrite(&reg, 1);
+    assertTrue(i2cTransactionScheduler.submit(&first));
+    assertFalse(i2cTransactionScheduler.submit(&first));
+    assertTrue(i2cTransactionScheduler.submit(&second));
+    assertEquals((int)I2C_TXN_QUEUED, (int)first.getStatus());
+    assertEquals((uint8_t)2, i2cTransactionScheduler.getQueuedCount());
+
+    assertTrue(serviceI2cScheduler());
+    assertEquals((uint8_t)2, listener.count);
+    assertTrue(listener.completed[0] == &first);
+    assertTrue(listener.completed[1] == &second);
+    assertFalse(listener.results[0]);
+    assertFalse(listener.results[1]);
+    assertFalse(first.wasSuccessful());
+    assertTrue(first.isIdle());
+    assertTrue(second.isIdle());
+
+    // once complete a transaction can be submitted again.
+    assertTrue(i2cTransactionScheduler.submit(&first));
+    assertTrue(serviceI2cScheduler());
+    assertEquals((uint8_t)3, listener.count);
+}
+
+test(testI2cSchedulerTakesHighestPriorityFirst) {
+    RecordingTxnListener listener;
+    uint8_t reg = 0;
+    I2cTransaction bulk;
+    I2cTransaction output;
+    I2cTransaction input1;
+    I2cTransaction input2;
+    bulk.prepare(defaultWireTypePtr, 0x73, &listener, I2C_PRIORITY_BULK);
+    output.prepare(defaultWireTypePtr, 0x73, &listener);
+    input1.prepare(defaultWireTypePtr, 0x73, &listener, I2C_PRIORITY_INPUT);
+    input2.prepare(defaultWireTypePtr, 0x73, &listener, I2C_PRIORITY_INPUT);
+    I2cTransaction* all[] = {&bulk, &output, &input1, &input2};
+    for(auto* txn : all) {
+        txn->setWrite(&reg, 1);
+    }
+
+    // submitted lowest priority first, they are taken highest priority first, in submission order within a priority.
+    assertTrue(i2cTransactionScheduler.submit(&bulk));
+    assertTrue(i2cTransactionScheduler.submit(&output));
+    assertTrue(i2cTransactionScheduler.submit(&input1));
+    assertTrue(i2cTransactionScheduler.submit(&input2));
+    assertTrue(serviceI2cScheduler());
+
+    assertEquals((uint8_t)4, listener.count);
+    assertTrue(listener.completed[0] == &input1);
+    assertTrue(listener.completed[1] == &input2);
+    assertTrue(listener.completed[2] == &output);
+    assertTrue(listener.completed[3] == &bulk);
+}
+
+test(testI2cSchedulerYieldsAfterBulkTransaction) {
+    RecordingTxnListener listener;
+    uint8_t reg = 0;
+    I2cTransaction bulk1;
+    I2cTransaction bulk2;
+    bulk1.prepare(defaultWireTypePtr, 0x73, &listener, I2C_PRIORITY_BULK);
+    bulk1.setWrite(&reg, 1);
+    bulk2.prepare(defaultWireTypePtr, 0x73, &listener, I2C_PRIORITY_BULK);
+    bulk2.setWrite(&reg, 1);
+    assertTrue(i2cTransactionScheduler.submit(&bulk1));
+    assertTrue(i2cTransactionScheduler.submit(&bulk2));
+
+    // each run completes only one bulk transaction before returning to task manager.
+    i2cTransactionScheduler.exec();
+    assertEquals((uint8_t)1, listener.count);
+    assertTrue(listener.completed[0] == &bulk1);
+    assertTrue(serviceI2cScheduler());
+    assertEquals((uint8_t)2, listener.count);
+}
+
+test(testI2cSchedulerRejectsWhenQueueFull) {
+    RecordingTxnListener listener;
+    uint8_t reg = 0;
+    I2cTransaction txns[IOA_I2C_QUEUE_SIZE + 1];
+    for(auto& txn : txns) {
+        txn.prepare(defaultWireTypePtr, 0x73, &listener);
+        txn.setWrite(&reg, 1);
+    }
+
+    for(int i = 0; i < IOA_I2C_QUEUE_SIZE; i++) {
+        assertTrue(i2cTransactionScheduler.submit(&txns[i]));
+    }
+    assertFalse(i2cTransactionScheduler.submit(&txns[IOA_I2C_QUEUE_SIZE]));
+    assertTrue(txns[IOA_I2C_QUEUE_SIZE].isIdle());
+    assertFalse(i2cTransactionScheduler.submit(nullptr));
+
+    assertTrue(serviceI2cScheduler());
+    assertEquals((uint8_t)IOA_I2C_QUEUE_SIZE, listener.count);
+}
+
+#if !defined(IOA_USE_MBED) && !defined(BUILD_FOR_PICO_CMAKE)
+#include <ArduinoEEPROMAbstraction.h>
+
+// defined with the device tests, schedules tasks until task manager has no more room.
+int fillTaskManager();
+
+test(testEepromCommitRetriedWhenTaskManagerFull) {
+#ifdef IOA_EEPROM_NEEDS_COMMIT
+    EEPROM.begin(64);
+#endif
+    ArduinoEEPROMAbstraction eeprom(&EEPROM);
+    eeprom.setCommitInterval(10);
+    taskManager.reset();
+    uint8_t original = eeprom.read8(20);
+
+    // the commit cannot be scheduled, so the change waits for the next write.
+    assertTrue(fillTaskManager() > 0);
+    eeprom.write8(20, original ^ 0xff);
+    assertTrue(eeprom.isDirty());
+    taskManager.reset();
+
+    eeprom.write8(20, original);
+    unsigned long started = millis();
+    while(eeprom.isDirty() && (millis() - started) < 200) taskManager.yieldForMicros(1000);
+    assertFalse(eeprom.isDirty());
+    assertEquals(original, eeprom.read8(20));
+    taskManager.reset();
+}
+#endif
+
 IOLOG_MBED_PORT_IF_NEEDED(USBTX, USBRX)
 
 #ifdef IOA_USE_MBED
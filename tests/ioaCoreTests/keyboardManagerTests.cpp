@@ -0,0 +1,176 @@
+#include <TaskManagerIO.h>
+#include <testing/SimpleTest.h>
+#include "MockIoAbstraction.h"
+#include "KeyboardManager.h"
+
+using namespace SimpleTest;
+
+class RecordingKeyboardListener : public KeyboardListener {
+public:
+    char lastKey = 0;
+    int presses = 0;
+    int releases = 0;
+
+    void keyPressed(char key, bool held) override {
+        lastKey = key;
+        presses++;
+    }
+
+    void keyReleased(char key) override {
+        lastKey = key;
+        releases++;
+    }
+};
+
+const char testKeyboardKeys[] PROGMEM = "123456789*0#";
+
+test(testMatrixKeyboardScansOneColumnPerStep) {
+    MockedIoAbstraction mockIo(25);
+    KeyboardLayout layout(4, 3, testKeyboardKeys);
+    for(int r = 0; r < 4; r++) layout.setRowPin(r, r);
+    for(int c = 0; c < 3; c++) layout.setColPin(c, 4 + c);
+    RecordingKeyboardListener listener;
+
+    // row 0 always reads low, so the key in the last column scanned is reported.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000e);
+
+    MatrixKeyboardManager keyboard;
+    keyboard.initialise(&mockIo, &layout, &listener, false);
+    keyboard.setColumnSettleMicros(0);
+    assertFalse(keyboard.isScanning());
+
+    // the first step drives column 0, then each step reads a column and drives the next.
+    keyboard.exec();
+    assertTrue(keyboard.isScanning());
+    keyboard.exec();
+    keyboard.exec();
+    assertTrue(keyboard.isScanning());
+    keyboard.exec();
+    assertFalse(keyboard.isScanning());
+    assertEquals(0, listener.presses);
+
+    // the second scan completes the debounce
+    for(int i = 0; i < 3; i++) keyboard.exec();
+    assertEquals(0, listener.presses);
+    keyboard.exec();
+    assertEquals(1, listener.presses);
+    assertEquals('3', listener.lastKey);
+    assertFalse(keyboard.isScanning());
+    assertLessThan((unsigned long)millisToMicros(KEYBOARD_TASK_MILLIS), keyboard.getLastScanMicros());
+
+    // and once nothing is pressed the release is reported at the end of the next scan.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000f);
+    for(int i = 0; i < 4; i++) keyboard.exec();
+    assertEquals(1, listener.releases);
+    taskManager.reset();
+}
+
+test(testMatrixKeyboardMultiKeyAndGhosting) {
+    MockedIoAbstraction mockIo(25);
+    KeyboardLayout layout(4, 3, testKeyboardKeys);
+    for(int r = 0; r < 4; r++) layout.setRowPin(r, r);
+    for(int c = 0; c < 3; c++) layout.setColPin(c, 4 + c);
+    RecordingKeyboardListener listener;
+
+    MatrixKeyboardManager keyboard;
+    keyboard.setMultiKeyMode(true);
+    keyboard.initialise(&mockIo, &layout, &listener, false);
+    keyboard.setColumnSettleMicros(0);
+
+    // the mock reads the same rows for every column, so with row 0 low the whole top row is pressed together.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000e);
+    for(int i = 0; i < 8; i++) keyboard.exec();
+    assertEquals(3, listener.presses);
+    assertTrue(keyboard.isKeyPressed(0, 0));
+    assertTrue(keyboard.isKeyPressed(0, 2));
+    assertFalse(keyboard.isKeyPressed(1, 0));
+
+    // rows 0 and 1 in every column is a ghosting pattern, so the scans are ignored.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000c);
+    for(int i = 0; i < 8; i++) keyboard.exec();
+    assertEquals(3, listener.presses);
+    assertEquals((uint32_t)2, keyboard.getGhostedScans());
+    assertFalse(keyboard.isKeyPressed(1, 1));
+
+    // every key is released separately
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000f);
+    for(int i = 0; i < 8; i++) keyboard.exec();
+    assertEquals(3, listener.releases);
+    assertFalse(keyboard.isKeyPressed(0, 1));
+    taskManager.reset();
+}
+
+test(testMatrixKeyboardWaitsForSettleAndPollInterval) {
+    MockedIoAbstraction mockIo(25);
+    KeyboardLayout layout(4, 3, testKeyboardKeys);
+    for(int r = 0; r < 4; r++) layout.setRowPin(r, r);
+    for(int c = 0; c < 3; c++) layout.setColPin(c, 4 + c);
+    RecordingKeyboardListener listener;
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000f);
+
+    MatrixKeyboardManager keyboard;
+    keyboard.initialise(&mockIo, &layout, &listener, false);
+    keyboard.setColumnSettleMicros(2000);
+
+    // a column that has just been driven is not read until it has settled, the check is scheduled for then.
+    keyboard.setTriggered(false);
+    keyboard.exec();
+    assertTrue(keyboard.isScanning());
+    uint32_t wait = keyboard.timeOfNextCheck();
+    assertFalse(keyboard.isTriggered());
+    assertTrue(wait > 0 && wait <= 2000);
+
+    // an early wake, such as from an interrupt, leaves the column to settle.
+    keyboard.exec();
+    assertFalse(keyboard.isTriggered());
+
+    delayMicroseconds(2100);
+    keyboard.timeOfNextCheck();
+    assertTrue(keyboard.isTriggered());
+
+    // complete the scan, the next one does not start until a poll interval after this one started.
+    keyboard.setColumnSettleMicros(0);
+    for(int i = 0; i < 3; i++) keyboard.exec();
+    assertFalse(keyboard.isScanning());
+    keyboard.setTriggered(false);
+    wait = keyboard.timeOfNextCheck();
+    assertFalse(keyboard.isTriggered());
+    assertTrue(wait > 0 && wait <= (uint32_t)millisToMicros(KEYBOARD_TASK_MILLIS));
+
+    delay(KEYBOARD_TASK_MILLIS + 2);
+    keyboard.timeOfNextCheck();
+    assertTrue(keyboard.isTriggered());
+    taskManager.reset();
+}
+
+test(testMatrixKeyboardInterruptModeWaitsWhenIdle) {
+    MockedIoAbstraction mockIo(25);
+    KeyboardLayout layout(4, 3, testKeyboardKeys);
+    for(int r = 0; r < 4; r++) layout.setRowPin(r, r);
+    for(int c = 0; c < 3; c++) layout.setColPin(c, 4 + c);
+    RecordingKeyboardListener listener;
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000f);
+
+    MatrixKeyboardManager keyboard;
+    keyboard.initialise(&mockIo, &layout, &listener, true);
+    keyboard.setColumnSettleMicros(0);
+
+    // with nothing pressed the keyboard waits for an interrupt rather than polling.
+    keyboard.setTriggered(false);
+    assertEquals((uint32_t)secondsToMicros(1), keyboard.timeOfNextCheck());
+    assertFalse(keyboard.isTriggered());
+
+    // an interrupt starts a scan, and while a key is being debounced or held it polls.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000e);
+    keyboard.markTriggeredAndNotify();
+    for(int i = 0; i < 4; i++) keyboard.exec();
+    assertFalse(keyboard.isScanning());
+    keyboard.setTriggered(false);
+    uint32_t wait = keyboard.timeOfNextCheck();
+    assertTrue(wait <= (uint32_t)millisToMicros(KEYBOARD_TASK_MILLIS));
+
+    delay(KEYBOARD_TASK_MILLIS + 2);
+    keyboard.timeOfNextCheck();
+    assertTrue(keyboard.isTriggered());
+    taskManager.reset();
+}
@@ -46,3 +46,54 @@ test(testNegatingIoAbstractionRead) {
     assertEquals(mockIo.getErrorMode(), NO_ERROR);
 }
 
+test(testNegatingIoAbstractionPinMask) {
+    MockedIoAbstraction mockIo;
+    NegatingIoAbstraction negatingIo(&mockIo);
+
+    for(int i=0;i<8;i++) {
+        negatingIo.pinDirection(i, INPUT);
+        negatingIo.pinDirection(i+8, OUTPUT);
+    }
+
+    mockIo.setValueForReading(0, 0x0f);
+    assertEquals((IoPinMask)0xf0, negatingIo.readPinMask(0, 0xff));
+
+    negatingIo.writePinMask(8, 0x0f, 0x05);
+    assertEquals((uint16_t)0x0a00, mockIo.getWrittenValue(0));
+
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
+
+test(testNegatingIoAbstractionPerPinMask) {
+    MockedIoAbstraction mockIo;
+    // only pins 1, 2 and 9 are inverted.
+    NegatingIoAbstraction negatingIo(&mockIo, 0x0206);
+
+    for(int i=0;i<8;i++) {
+        negatingIo.pinDirection(i, INPUT);
+        negatingIo.pinDirection(i+8, OUTPUT);
+    }
+    assertTrue(negatingIo.isPinInverted(9));
+    assertFalse(negatingIo.isPinInverted(8));
+
+    mockIo.setValueForReading(0, 0x0f);
+    assertEquals((IoPinMask)0x09, negatingIo.readPinMask(0, 0x0f));
+    assertEquals(0x09U, (unsigned int)negatingIo.readPort(3));
+    assertEquals((uint8_t)1, negatingIo.readValue(0));
+    assertEquals((uint8_t)0, negatingIo.readValue(1));
+
+    // writes to port 1 only invert pin 9, whether by pin, port or mask.
+    negatingIo.writePort(8, 0x00);
+    assertEquals((uint16_t)0x0200, mockIo.getWrittenValue(0));
+    negatingIo.writePinMask(8, 0x03, 0x03);
+    assertEquals((uint16_t)0x0100, mockIo.getWrittenValue(0));
+    negatingIo.writeValue(9, LOW);
+    assertEquals((uint16_t)0x0300, mockIo.getWrittenValue(0));
+
+    // the mask can start part way in, pins before it are not inverted.
+    negatingIo.setInversionMask(0x1, 9);
+    assertEquals((IoPinMask)0x0200, negatingIo.getInversion(0));
+    assertFalse(negatingIo.isPinInverted(1));
+
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
@@ -0,0 +1,47 @@
+
+#include <TaskManagerIO.h>
+#include <testing/SimpleTest.h>
+
+using namespace SimpleTest;
+
+#if defined(BUILD_FOR_PICO_CMAKE)
+
+#include "pico/PicoPioShiftRegister.h"
+
+// these tests claim a state machine on pio1 and drive GPIO 2 to 4, nothing needs to be connected to them.
+
+test(testPioShiftRegisterPacksOutputFrame) {
+    PicoPioShiftRegister shiftReg(ShiftRegConfig(), ShiftRegConfig(2, 3, 4, 3), pio1);
+    assertTrue(shiftReg.initDevice());
+
+    shiftReg.writePort(SHIFT_REGISTER_OUTPUT_CUTOVER, 0xa5);
+    shiftReg.writePort(SHIFT_REGISTER_OUTPUT_CUTOVER + 8, 0x3c);
+    shiftReg.writeValue(SHIFT_REGISTER_OUTPUT_CUTOVER + 16, HIGH);
+    assertTrue(shiftReg.runLoop());
+
+    // the bit count less one, then the chain four bytes to a word, first byte in the top bits.
+    const uint32_t* frame = shiftReg.getOutputFrame();
+    assertEquals((uint32_t)23, frame[0]);
+    assertEquals((uint32_t)0xa53c0100, frame[1]);
+}
+
+test(testPioShiftRegisterBuildsIntoTheSpareFrame) {
+    PicoPioShiftRegister shiftReg(ShiftRegConfig(), ShiftRegConfig(2, 3, 4, 1), pio1);
+    shiftReg.setBackgroundRefresh(true);
+    assertTrue(shiftReg.runLoop());
+
+    shiftReg.writePort(SHIFT_REGISTER_OUTPUT_CUTOVER, 0x81);
+    shiftReg.runLoop();
+    const uint32_t* first = shiftReg.getOutputFrame();
+    assertEquals((uint32_t)0x81000000, first[1]);
+
+    // the next change is built in the other buffer, so the frame being refreshed is never partly written.
+    shiftReg.writePort(SHIFT_REGISTER_OUTPUT_CUTOVER, 0x42);
+    for(int i = 0; i < 100 && shiftReg.getOutputFrame() == first; i++) shiftReg.runLoop();
+    const uint32_t* second = shiftReg.getOutputFrame();
+    assertTrue(second != first);
+    assertEquals((uint32_t)0x42000000, second[1]);
+    assertEquals((uint32_t)0x81000000, first[1]);
+}
+
+#endif // BUILD_FOR_PICO_CMAKE
@@ -0,0 +1,113 @@
+#include <testing/SimpleTest.h>
+#include <IoAbstraction.h>
+#include <TaskManagerIO.h>
+
+using namespace SimpleTest;
+
+#ifdef IOA_USE_ARDUINO
+
+#include <extras/Pga2310VolumeControl.h>
+#include <extras/Mcp23s17IoAbstraction.h>
+
+// defined with the device tests, schedules tasks until task manager has no more room.
+int fillTaskManager();
+
+// the SPI tests use the board SPI bus with pin 9 as chip select, nothing needs to be connected to it.
+
+test(testPga2310RampLevelOnLongRamps) {
+    // the part way level of a ramp lasting three hours, where the change times the elapsed time exceeds 32 bits.
+    uint32_t threeHours = 3UL * 60UL * 60UL * 1000UL;
+    assertEquals((uint8_t)0, Pga2310VolumeControl::rampLevelAt(0, 255, 0, threeHours));
+    assertEquals((uint8_t)127, Pga2310VolumeControl::rampLevelAt(0, 255, threeHours / 2, threeHours));
+    assertEquals((uint8_t)254, Pga2310VolumeControl::rampLevelAt(0, 255, threeHours - 1, threeHours));
+    assertEquals((uint8_t)128, Pga2310VolumeControl::rampLevelAt(255, 0, threeHours / 2, threeHours));
+}
+
+test(testPga2310RampStartsOnceTaskManagerHasRoom) {
+    SPIWithSettings spi(&SPI, 9);
+    Pga2310VolumeControl volume(spi);
+    volume.initPin(0, DIR_OUT);
+    taskManager.reset();
+
+    // the tick cannot be scheduled, so the ramp waits for the next change.
+    assertTrue(fillTaskManager() > 0);
+    volume.rampTo(0, 100, 20);
+    assertTrue(volume.isRamping(0));
+    taskManager.reset();
+
+    volume.rampTo(0, 100, 20);
+    unsigned long started = millis();
+    while(volume.isRamping(0) && (millis() - started) < 500) taskManager.yieldForMicros(1000);
+    assertFalse(volume.isRamping(0));
+    assertEquals(100U, volume.getCurrentValue(0));
+    taskManager.reset();
+}
+
+/**
+ * Stands in for the SPI bus of an MCP23S17, holding the registers in memory and acting on each transaction the way the
+ * device does with sequential addressing, so the two bytes after the register are the A and B registers of a pair.
+ */
+class MockBusMcp23s17 : public Mcp23s17IoAbstraction {
+public:
+    uint8_t registers[0x16];
+    uint8_t lastOpcode = 0;
+    int transfers = 0;
+    bool failTransfers = false;
+
+    MockBusMcp23s17(SPIWithSettings& spi, uint8_t hwAddr) : Mcp23s17IoAbstraction(spi, hwAddr), registers{} {
+        // the power on state, all pins are inputs.
+        registers[MCP23S17_IODIR] = registers[MCP23S17_IODIR + 1] = 0xff;
+    }
+
+protected:
+    bool transfer(uint8_t* data, size_t len) override {
+        transfers++;
+        if(failTransfers || len != 4 || data[1] >= sizeof(registers) - 1) return false;
+        lastOpcode = data[0];
+        if(data[0] & 0x01) {
+            data[2] = registers[data[1]];
+            data[3] = registers[data[1] + 1];
+        } else {
+            registers[data[1]] = data[2];
+            registers[data[1] + 1] = data[3];
+        }
+        return true;
+    }
+};
+
+test(testMcp23s17TransfersBothPortsAtOnce) {
+    SPIWithSettings spi(&SPI, 9);
+    MockBusMcp23s17 device(spi, 3);
+
+    // hardware addressing is turned on in both halves of IOCON at the device's own address.
+    device.pinMode(2, OUTPUT);
+    device.pinMode(9, INPUT_PULLUP);
+    assertEquals((uint8_t)0x08, device.registers[MCP23S17_IOCON]);
+    assertEquals((uint8_t)0x08, device.registers[MCP23S17_IOCON + 1]);
+    assertEquals((uint8_t)(MCP23S17_OPCODE_WRITE | (3 << 1)), device.lastOpcode);
+    assertEquals((uint8_t)0xfb, device.registers[MCP23S17_IODIR]);
+    assertEquals((uint8_t)0xff, device.registers[MCP23S17_IODIR + 1]);
+    assertEquals((uint8_t)0x02, device.registers[MCP23S17_GPPU + 1]);
+
+    // a sync is one transfer writing both latches and one reading both ports.
+    device.registers[MCP23S17_GPIO + 1] = 0x02;
+    device.writeValue(2, HIGH);
+    device.transfers = 0;
+    assertTrue(device.sync());
+    assertEquals(2, device.transfers);
+    assertEquals((uint8_t)0x04, device.registers[MCP23S17_OLAT]);
+    assertEquals((uint8_t)0x00, device.registers[MCP23S17_OLAT + 1]);
+    assertEquals((uint8_t)(MCP23S17_OPCODE_READ | (3 << 1)), device.lastOpcode);
+    assertEquals((uint8_t)HIGH, device.readValue(9));
+    assertEquals((uint8_t)LOW, device.readValue(8));
+
+    // with no output change, only the inputs are read.
+    device.transfers = 0;
+    assertTrue(device.sync());
+    assertEquals(1, device.transfers);
+
+    device.failTransfers = true;
+    assertFalse(device.sync());
+}
+
+#endif // IOA_USE_ARDUINO
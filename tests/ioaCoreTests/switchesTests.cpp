@@ -2,6 +2,10 @@
 #include <testing/SimpleTest.h>
 #include "MockIoAbstraction.h"
 #include "SwitchInput.h"
+#include "EncoderRegistry.h"
+#include "QuadratureCounterEncoder.h"
+#include "NegatingIoAbstraction.h"
+#include "esp32/ESP32InputTask.h"
 
 using namespace SimpleTest;
 
@@ -294,3 +298,661 @@ testF(SwitchesFixture, testChangingFromListenerToCallback) {
     assertEquals(callsMade, 1);
     assertFalse(testSwitchListener.wasActivated());
 }
+
+testF(SwitchesFixture, testGroupedReadWithInvertedKey) {
+    switches.initialise(&mockIo, true);
+    switches.addSwitch(3, onSwitchPressed, NO_REPEAT);
+    // this key is active high, as its logic is inverted from the pull up default
+    switches.addSwitch(12, onSwitchPressed, NO_REPEAT, true);
+
+    // at rest 3 is high and 12 is low, then 12 goes high and is pressed after two reads
+    mockIo.setValueForReading(1, 0x0008);
+    mockIo.setValueForReading(2, 0x1008);
+    mockIo.setValueForReading(3, 0x1008);
+    mockIo.setValueForReading(4, 0x1000);
+    mockIo.setValueForReading(5, 0x1000);
+
+    switches.runLoop();
+    switches.runLoop();
+    assertFalse(pressed);
+    switches.runLoop();
+    assertTrue(pressed);
+    assertEquals((uint8_t)12, key);
+    switches.runLoop();
+    switches.runLoop();
+    assertEquals(2, callsMade);
+    assertEquals((uint8_t)3, key);
+    assertTrue(switches.isSwitchPressed(12));
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
+
+testF(SwitchesFixture, testGroupedReadFoldsNegatingMask) {
+    // pin 12 is inverted by the device rather than by the key, the same readings must give the same result.
+    NegatingIoAbstraction negating(&mockIo, 0x1000);
+    switches.initialise(&negating, true);
+    switches.foldInversionOf(&negating);
+    switches.addSwitch(3, onSwitchPressed, NO_REPEAT);
+    switches.addSwitch(12, onSwitchPressed, NO_REPEAT);
+
+    mockIo.setValueForReading(1, 0x0008);
+    mockIo.setValueForReading(2, 0x1008);
+    mockIo.setValueForReading(3, 0x1008);
+    mockIo.setValueForReading(4, 0x1000);
+    mockIo.setValueForReading(5, 0x1000);
+
+    switches.runLoop();
+    switches.runLoop();
+    assertFalse(pressed);
+    switches.runLoop();
+    assertTrue(pressed);
+    assertEquals((uint8_t)12, key);
+    switches.runLoop();
+    switches.runLoop();
+    assertEquals(2, callsMade);
+    assertEquals((uint8_t)3, key);
+    assertTrue(switches.isSwitchPressed(12));
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
+
+testF(SwitchesFixture, testIdleBackoffPollingWakesOnInterrupt) {
+    switches.init(&mockIo, SWITCHES_POLL_KEYS_WITH_BACKOFF, true);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+    assertTrue(switches.isIdleBackoff());
+    assertFalse(switches.isInterruptDriven());
+    assertTrue(mockIo.isIntRegisteredAs(2, CHANGE));
+
+    // nothing pressed, so the interval backs off up to the maximum.
+    for(int i=0; i<25; i++) mockIo.setValueForReading(i, 0x0004);
+    assertEquals((uint16_t)SWITCH_POLL_INTERVAL, switches.getBackoffInterval());
+    auto started = millis();
+    while(switches.getBackoffInterval() != SWITCH_IDLE_MAX_POLL_INTERVAL && (millis() - started) < 3000) {
+        taskManager.yieldForMicros(1000);
+    }
+    assertEquals((uint16_t)SWITCH_IDLE_MAX_POLL_INTERVAL, switches.getBackoffInterval());
+
+    // a key press interrupt goes straight back to fast polling, and the press is seen within two polls.
+    for(int i=0; i<25; i++) mockIo.setValueForReading(i, 0x0000);
+    mockIo.getInterruptFunction()();
+    started = millis();
+    while(!pressed && (millis() - started) < 200) {
+        taskManager.yieldForMicros(1000);
+    }
+    assertTrue(pressed);
+    assertLessThan((uint32_t)(SWITCH_POLL_INTERVAL * 3), safeMilliDiffFromNow(started));
+    assertEquals((uint16_t)SWITCH_POLL_INTERVAL, switches.getBackoffInterval());
+}
+
+testF(SwitchesFixture, testReinitCancelsIdleBackoffPoll) {
+    switches.init(&mockIo, SWITCHES_POLL_KEYS_WITH_BACKOFF, true);
+    switches.init(&mockIo, SWITCHES_POLL_EXTERNALLY, true);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+
+    // the backoff poll from the first init must not keep polling the device.
+    auto started = millis();
+    while((millis() - started) < (SWITCH_POLL_INTERVAL * 4)) {
+        taskManager.yieldForMicros(1000);
+    }
+    assertEquals(0, mockIo.getNumberOfRunLoops());
+    assertEquals((uint16_t)0, switches.getBackoffInterval());
+}
+
+testF(SwitchesFixture, testVerticalDebounceEngine) {
+    switches.initialise(&mockIo, true);
+    switches.setDebounceEngine(SWITCH_DEBOUNCE_VERTICAL);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+    switches.addSwitch(5, onSwitchPressed, NO_REPEAT);
+    switches.onRelease(2, onSwitchReleased);
+
+    // pull up switches, 2 bounces then is pressed, then 5 is pressed, and then 2 is released.
+    uint16_t samples[] = { 0x0024, 0x0020, 0x0024, 0x0020, 0x0020, 0x0000, 0x0000, 0x0004, 0x0004 };
+    for(int i = 0; i < 9; i++) mockIo.setValueForReading(i + 1, samples[i]);
+
+    for(int i = 0; i < 4; i++) switches.runLoop();
+    assertFalse(pressed);
+    switches.runLoop();
+    assertTrue(pressed);
+    assertEquals((uint8_t)2, key);
+    assertEquals(1, callsMade);
+    assertTrue(switches.isSwitchPressed(2));
+
+    switches.runLoop();
+    assertEquals(1, callsMade);
+    switches.runLoop();
+    assertEquals(2, callsMade);
+    assertEquals((uint8_t)5, key);
+
+    switches.runLoop();
+    assertFalse(keyReleased);
+    switches.runLoop();
+    assertTrue(keyReleased);
+    assertFalse(held);
+    assertFalse(switches.isSwitchPressed(2));
+    assertTrue(switches.isSwitchPressed(5));
+
+    // keep 5 pressed, it becomes held once it has been down for more than HOLD_THRESHOLD polls.
+    mockIo.resetIo();
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x0004);
+    for(int i = 0; i < (HOLD_THRESHOLD - 2); i++) switches.runLoop();
+    assertFalse(held);
+    switches.runLoop();
+    assertTrue(held);
+    assertEquals((uint8_t)5, key);
+    assertEquals(3, callsMade);
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
+
+testF(SwitchesFixture, testEncoderRegistryDecodesSnapshots) {
+    // start with room for two, so that adding six means the registry has to grow.
+    RotaryEncoderRegistry registry(&mockIo, 2);
+    SnapshotRotaryEncoder* encs[6];
+    for(int i = 0; i < 6; i++) {
+        encs[i] = new SnapshotRotaryEncoder(i * 2, (i * 2) + 1, encoderCallback, HWACCEL_NONE);
+        assertTrue(registry.addEncoder(encs[i]));
+        encs[i]->changePrecision(20, 10);
+    }
+    assertEquals((uint8_t)6, registry.getEncoderCount());
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+
+    // let the direction change rejection from construction pass.
+    taskManager.yieldForMicros(REJECT_DIRECTION_CHANGE_THRESHOLD + 10000);
+    callsMade = 0;
+
+    // at rest all pins are high, encoder 1 (pins 2, 3) turns a full cycle up with A leading, and encoder 4
+    // (pins 8, 9) turns a full cycle down with B leading, both decoded from the same snapshots.
+    IoPinMask snapshots[] = { 0x0fff, 0x0dfb, 0x0cf3, 0x0ef7, 0x0fff };
+    for(auto snapshot : snapshots) registry.decodeSnapshot(0, snapshot);
+    assertEquals(1, encs[1]->getPendingSteps());
+    assertEquals(-1, encs[4]->getPendingSteps());
+    assertEquals(0, encs[0]->getPendingSteps());
+    assertEquals(0, callsMade);
+
+    // the steps are applied when the registry runs on task manager
+    registry.exec();
+    assertEquals(11, encs[1]->getCurrentReading());
+    assertEquals(9, encs[4]->getCurrentReading());
+    assertEquals(10, encs[0]->getCurrentReading());
+    assertEquals(2, callsMade);
+    assertEquals(0, encs[1]->getPendingSteps());
+
+    for(auto enc : encs) delete enc;
+}
+
+test(testEncoderVelocityAccelerationProfile) {
+    RotaryEncoder encoder(encoderCallback);
+    encoder.changePrecision(60000, 30000);
+    QuadraticAccelerationProfile profile;
+    encoder.setAccelerationProfile(&profile);
+    assertTrue(encoder.hasAccelerationProfile());
+
+    // the first event is from rest, then a fast spin at 100 events per second builds up the velocity
+    unsigned long when = 1000000UL;
+    assertEquals(1, encoder.acceleratedAmount(when));
+    int amount = 0;
+    for(int i = 0; i < 20; i++) {
+        when += 10000UL;
+        amount = encoder.acceleratedAmount(when);
+    }
+    assertMoreThan(90, (int)encoder.getVelocity());
+    assertMoreThan(1000, amount);
+    assertTrue(amount <= 60000 / 8);
+
+    // large steps do not overflow the reading
+    encoder.increment(amount);
+    assertEquals(30000 + amount, encoder.getCurrentReading());
+
+    // after a pause, and then turning slowly, the encoder moves a single step at a time
+    when += 300000UL;
+    assertEquals(1, encoder.acceleratedAmount(when));
+    when += 200000UL;
+    assertEquals(1, encoder.acceleratedAmount(when));
+
+    // wrapping downwards by more than the current reading lands the right distance from the top
+    encoder.changePrecision(100, 5, true);
+    encoder.increment(-10);
+    assertEquals(96, encoder.getCurrentReading());
+}
+
+class TestQuadratureCounter : public QuadratureCounter {
+public:
+    int32_t count = 0;
+    bool began = false;
+    bool begin(pinid_t, pinid_t) override { began = true; return true; }
+    int32_t readCount() override { return count; }
+};
+
+test(testQuadratureCounterEncoderTurnsCountsIntoDetents) {
+    TestQuadratureCounter counter;
+    QuadratureCounterEncoder encoder(&counter, 2, 3, encoderCallback, HWACCEL_NONE, FULL_CYCLE);
+    encoder.changePrecision(100, 50);
+    assertTrue(encoder.start());
+    assertTrue(counter.began);
+    assertFalse(encoder.isEncoderPin(2));
+
+    // a full cycle is four counts, so eight counts is two detents up
+    counter.count = 8;
+    encoder.pollCounter();
+    assertEquals(52, encoder.getCurrentReading());
+
+    // part of a detent is kept until the rest of it arrives
+    counter.count = 6;
+    encoder.pollCounter();
+    assertEquals(52, encoder.getCurrentReading());
+    counter.count = 3;
+    encoder.pollCounter();
+    assertEquals(51, encoder.getCurrentReading());
+
+    // quarter cycle encoders move on every count, here the count left over from before cancels one of the two
+    encoder.setEncoderType(QUARTER_CYCLE);
+    counter.count = 5;
+    encoder.pollCounter();
+    assertEquals(52, encoder.getCurrentReading());
+    taskManager.reset();
+}
+
+testF(SwitchesFixture, testKeysFoundThroughPinIndex) {
+    switches.initialise(&mockIo, true);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+    switches.addSwitch(9, onSwitchPressed, NO_REPEAT);
+    switches.onRelease(9, onSwitchReleased);
+
+    // before the first poll the index is not built, so keys are found by search, afterwards through the index.
+    assertFalse(switches.isSwitchPressed(9));
+    assertFalse(switches.isSwitchPressed(5));
+    for(int i = 0; i < 4; i++) mockIo.setValueForReading(i, 0x0004);
+    switches.runLoop();
+    switches.runLoop();
+    assertTrue(switches.isSwitchPressed(9));
+    assertFalse(switches.isSwitchPressed(2));
+    assertFalse(switches.isSwitchPressed(5));
+    assertFalse(switches.isSwitchPressed(20));
+    assertEquals((uint8_t)9, key);
+
+    // the previous state is kept along with the current one, so the release is notified as not held.
+    mockIo.setValueForReading(3, 0x0204);
+    switches.runLoop();
+    assertTrue(keyReleased);
+    assertFalse(held);
+
+    // adding a key makes the index out of date, it must still be found until the next poll rebuilds it.
+    switches.addSwitch(4, [](pinid_t, bool) { callsMade2++; }, NO_REPEAT);
+    switches.pushSwitch(4, false);
+    assertEquals(1, callsMade2);
+    switches.pushSwitch(7, false);
+    assertEquals(1, callsMade2);
+}
+
+testF(SwitchesFixture, testQueuedDeliveryCoalescesEncoderChanges) {
+    switches.initialise(&mockIo, true);
+    switches.setQueuedDelivery(true);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+
+    // the press is found on the first loop, but not delivered until the queue is.
+    mockIo.setValueForReading(1, 0x0000);
+    mockIo.setValueForReading(2, 0x0000);
+    switches.runLoop();
+    switches.runLoop();
+    assertFalse(pressed);
+    switches.deliverQueuedEvents();
+    assertTrue(pressed);
+    assertEquals(1, callsMade);
+
+    // five steps of the encoder are delivered as a single call with the final value.
+    callsMade = 0;
+    RotaryEncoder encoder(encoderCallback);
+    encoder.changePrecision(100, 10);
+    for(int i = 0; i < 5; i++) encoder.increment(1);
+    assertEquals(0, callsMade);
+    auto started = millis();
+    while(callsMade == 0 && (millis() - started) < 100) {
+        taskManager.yieldForMicros(1000);
+    }
+    assertEquals(1, callsMade);
+    assertEquals(15, encoderCurrentVal);
+
+    // once turned off, changes are delivered straight away again.
+    switches.setQueuedDelivery(false);
+    assertFalse(switches.isQueuedDelivery());
+    encoder.increment(1);
+    assertEquals(2, callsMade);
+    assertEquals(16, encoderCurrentVal);
+}
+
+testF(SwitchesFixture, testReplacedEncoderLeavesDeliveryQueue) {
+    switches.initialise(&mockIo, true);
+    switches.setQueuedDelivery(true);
+    RotaryEncoder first(encoderCallback);
+    RotaryEncoder second(encoderCallback2);
+    switches.setEncoder(0, &first);
+    first.changePrecision(100, 10);
+    second.changePrecision(100, 20);
+    callsMade = callsMade2 = 0;
+
+    // the change of the replaced encoder is waiting when it is replaced, so it is never delivered.
+    first.increment(1);
+    switches.setEncoder(0, &second);
+    second.increment(1);
+    switches.deliverQueuedEvents();
+    assertEquals(0, callsMade);
+    assertEquals(1, callsMade2);
+    assertEquals(21, encoderCurrentVal);
+
+    // an encoder destroyed with a change waiting is also taken out of the queue.
+    auto* temporary = new RotaryEncoder(encoderCallback);
+    temporary->changePrecision(100, 30);
+    callsMade = 0;
+    temporary->increment(1);
+    delete temporary;
+    switches.deliverQueuedEvents();
+    assertEquals(0, callsMade);
+    switches.setEncoder(0, nullptr);
+}
+
+testF(SwitchesFixture, testQueuedDeliveryRetriesWhenNoTaskSlot) {
+    switches.initialise(&mockIo, true);
+    switches.setQueuedDelivery(true);
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+    int filled = 0;
+    while(filled < 1000 && taskManager.scheduleOnce(60, [] {}, TIME_SECONDS) != TASKMGR_INVALIDID) filled++;
+    assertNotEquals(0, filled);
+
+    // delivery cannot be scheduled, so the event waits, and the next loop of switches schedules it again.
+    assertTrue(switches.queueKeyEvent(2, false, false));
+    taskManager.reset();
+    switches.runLoop();
+    auto started = millis();
+    while(callsMade < 1 && (millis() - started) < 100) {
+        taskManager.yieldForMicros(1000);
+    }
+    assertEquals(1, callsMade);
+}
+
+testF(SwitchesFixture, testSwitchPinModesAppliedAsAdded) {
+    switches.initialise(&mockIo, true);
+
+    // by default the pin can be read straight after the switch is added.
+    switches.addSwitch(13, onSwitchPressed, NO_REPEAT);
+    mockIo.readValue(13);
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+
+    // deferred modes are all applied once deferring is turned off.
+    switches.deferPinModes(true);
+    switches.addSwitch(14, onSwitchPressed, NO_REPEAT);
+    switches.addSwitch(15, onSwitchPressed, NO_REPEAT);
+    switches.deferPinModes(false);
+    mockIo.readValue(14);
+    mockIo.readValue(15);
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+}
+
+char keyOrder[SWITCH_EVENT_QUEUE_SIZE * 3];
+int keyOrderCount = 0;
+
+testF(SwitchesFixture, testFullKeyQueueKeepsDeliveryOrder) {
+    switches.initialise(&mockIo, true);
+    switches.setQueuedDelivery(true);
+    keyOrderCount = 0;
+    switches.addSwitch(2, [](pinid_t, bool) { keyOrder[keyOrderCount++] = 'P'; }, NO_REPEAT);
+    switches.onRelease(2, [](pinid_t, bool) { keyOrder[keyOrderCount++] = 'R'; });
+    KeyboardItem item(2, [](pinid_t, bool) { keyOrder[keyOrderCount++] = 'P'; });
+    item.onRelease([](pinid_t, bool) { keyOrder[keyOrderCount++] = 'R'; });
+
+    // more press and release pairs than the queue holds, the ones that do not fit must not overtake those queued.
+    int pairs = (SWITCH_EVENT_QUEUE_SIZE / 2) + 2;
+    for(int i = 0; i < pairs; i++) {
+        item.trigger(false);
+        item.triggerRelease(false);
+    }
+    switches.deliverQueuedEvents();
+
+    assertEquals(pairs * 2, keyOrderCount);
+    for(int i = 0; i < keyOrderCount; i++) {
+        assertEquals((i % 2) ? 'R' : 'P', keyOrder[i]);
+    }
+}
+
+class CountingQueueLock : public SwitchEventQueueLock {
+public:
+    int locks = 0;
+    int depth = 0;
+    bool nested = false;
+    void lock() override {
+        locks++;
+        if(depth++ != 0) nested = true;
+    }
+    void unlock() override { depth--; }
+};
+
+testF(SwitchesFixture, testCrossThreadDeliveryQueuesUnderTheLock) {
+    CountingQueueLock queueLock;
+    switches.init(&mockIo, SWITCHES_POLL_EXTERNALLY, true);
+    assertTrue(switches.isExternallyPolled());
+    assertTrue(switches.isEncoderPollingEnabled());
+    switches.setCrossThreadDelivery(&queueLock);
+    assertTrue(switches.isQueuedDelivery());
+    switches.addSwitch(2, onSwitchPressed, NO_REPEAT);
+
+    mockIo.setValueForReading(1, 0x0000);
+    mockIo.setValueForReading(2, 0x0000);
+    switches.runLoop();
+    switches.runLoop();
+    assertFalse(pressed);
+
+    // encoder values are captured as they queue, and combined into one call with the latest value.
+    RotaryEncoder encoder(encoderCallback);
+    encoder.changePrecision(100, 10);
+    for(int i = 0; i < 3; i++) encoder.increment(1);
+    assertEquals(0, callsMade);
+    switches.deliverQueuedEvents();
+    assertTrue(pressed);
+    assertEquals(2, callsMade);
+    assertEquals(13, encoderCurrentVal);
+    assertTrue(queueLock.locks > 0);
+    assertEquals(0, queueLock.depth);
+    assertFalse(queueLock.nested);
+
+    // when the queue is full, events are dropped rather than called back on the side reading the switches.
+    callsMade = 0;
+    for(int i = 0; i < SWITCH_EVENT_QUEUE_SIZE + 2; i++) {
+        assertTrue(switches.queueKeyEvent(2, false, false));
+    }
+    assertEquals(0, callsMade);
+    assertEquals((uint16_t)2, switches.getDroppedEventCount());
+
+    // going back to regular delivery sends what was queued first.
+    switches.setCrossThreadDelivery(nullptr);
+    assertEquals(SWITCH_EVENT_QUEUE_SIZE, callsMade);
+    assertEquals(0, queueLock.depth);
+}
+
+test(testInputLatencyStatisticsHistogram) {
+    InputLatencyStatistics stats;
+    stats.record(INPUT_LATENCY_SWITCH, 2, 400);
+    stats.record(INPUT_LATENCY_SWITCH, 2, 45000);
+    stats.record(INPUT_LATENCY_SWITCH, 2, 3000);
+    stats.record(INPUT_LATENCY_ENCODER, 2, 150);
+
+    // the same id of a different kind is a separate source
+    assertEquals((uint8_t)2, stats.getSourceCount());
+    auto sw = stats.getStatisticsFor(INPUT_LATENCY_SWITCH, 2);
+    assertTrue(sw != nullptr);
+    assertEquals((uint32_t)3, sw->samples);
+    assertEquals((uint32_t)400, sw->minMicros);
+    assertEquals((uint32_t)45000, sw->maxMicros);
+    assertEquals((uint32_t)48400, sw->totalMicros);
+
+    // buckets end at 1, 2, 4, 8, 16, 32 and 64ms, anything longer is in the last one
+    assertEquals((uint16_t)1, sw->histogram[0]);
+    assertEquals((uint16_t)1, sw->histogram[2]);
+    assertEquals((uint16_t)1, sw->histogram[6]);
+    stats.record(INPUT_LATENCY_SWITCH, 2, 1000000);
+    assertEquals((uint16_t)1, sw->histogram[IOA_LATENCY_BUCKETS - 1]);
+    assertEquals((uint32_t)IOA_LATENCY_FIRST_BUCKET_MICROS * 4, InputLatencyStatistics::getBucketLimitMicros(2));
+
+    // fill the table, anything beyond it is only counted as overflow
+    for(int i = 0; i < IOA_LATENCY_SOURCES; i++) stats.record(INPUT_LATENCY_MATRIX_KEY, 'A' + i, 100);
+    assertEquals((uint8_t)IOA_LATENCY_SOURCES, stats.getSourceCount());
+    assertEquals((uint32_t)2, stats.getOverflowSamples());
+    stats.dumpToLog();
+
+    stats.reset();
+    assertEquals((uint8_t)0, stats.getSourceCount());
+    assertTrue(stats.getStatisticsFor(INPUT_LATENCY_SWITCH, 2) == nullptr);
+}
+
+test(testInterruptEventRingKeepsOrderAndCountsDrops) {
+    InterruptEventRing ring;
+    assertTrue(ring.isEmpty());
+
+    // fill the ring, then one more that must be dropped.
+    for(int i = 0; i < IOA_INTERRUPT_RING_SIZE; i++) {
+        assertTrue(ring.pushFromIsr(i, i & 1, 1000UL + i));
+    }
+    assertFalse(ring.pushFromIsr(99, 0, 5000UL));
+    assertEquals((uint16_t)1, ring.getDroppedCount());
+    assertEquals((uint8_t)IOA_INTERRUPT_RING_SIZE, ring.available());
+
+    IoInterruptEvent ev{};
+    assertTrue(ring.pop(ev));
+    assertEquals((pinid_t)0, ev.pin);
+    assertEquals((unsigned long)1000UL, ev.timestamp);
+
+    // the rest come out in batches, still in the order they went in.
+    IoInterruptEvent batch[4];
+    int expected = 1;
+    uint8_t count;
+    while((count = ring.popBatch(batch, 4)) != 0) {
+        for(int i = 0; i < count; i++) {
+            assertEquals((pinid_t)expected, batch[i].pin);
+            assertEquals((uint8_t)(expected & 1), batch[i].level);
+            expected++;
+        }
+    }
+    assertEquals(IOA_INTERRUPT_RING_SIZE, expected);
+    assertTrue(ring.isEmpty());
+
+    // and the indexes wrap correctly once it has been emptied.
+    assertTrue(ring.pushFromIsr(7, 1, 2000UL));
+    assertTrue(ring.pop(ev));
+    assertEquals((pinid_t)7, ev.pin);
+}
+
+testF(SwitchesFixture, testExpanderPinsShareOneRecordedInterrupt) {
+    IoInterruptEvent ev{};
+    while(ioInterruptRing.pop(ev));
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x000c);
+
+    // the pins of a device other than the board share its interrupt line, so they must share one handler.
+    switches.initialiseInterrupt(&mockIo, true);
+    switches.addSwitch(2, onSwitchPressed);
+    RawIntHandler handler = mockIo.getInterruptFunction();
+    switches.addSwitch(3, onSwitchPressed);
+    assertTrue(mockIo.isIntRegisteredAs(3, CHANGE));
+    assertTrue(handler == mockIo.getInterruptFunction());
+
+    // which pin changed is not known in the interrupt, so the event says any of them may have.
+    handler();
+    assertEquals((uint8_t)1, ioInterruptRing.available());
+    assertTrue(ioInterruptRing.pop(ev));
+    assertEquals(IOA_INTERRUPT_PIN_UNKNOWN, ev.pin);
+    assertEquals((uint8_t)IOA_INTERRUPT_LEVEL_UNKNOWN, ev.level);
+
+    // and every key is read when it is handled, so the second key is found.
+    for(int i = 0; i < 25; i++) mockIo.setValueForReading(i, 0x0004);
+    assertPressedState(true);
+    assertEquals((pinid_t)3, (pinid_t)key);
+}
+
+testF(SwitchesFixture, testEncoderEventUsesBothPinsSampledAtTheEdge) {
+    switches.init(&mockIo, SWITCHES_POLL_EVERYTHING, true);
+    auto* enc = new HardwareRotaryEncoder(2, 3, encoderCallback, HWACCEL_NONE);
+    enc->changePrecision(20, 10);
+    taskManager.yieldForMicros(REJECT_DIRECTION_CHANGE_THRESHOLD + 10000);
+
+    // only pin A raises edges here, pin B is known only from being sampled in the same interrupt, and a level of B
+    // kept from an earlier edge would never show a change, so no step would be decoded.
+    unsigned long now = micros();
+    IoInterruptEvent rise1 = { now, 2, 1, 1 };
+    IoInterruptEvent fall = { now + 1000, 2, 0, 0 };
+    IoInterruptEvent rise2 = { now + 2000, 2, 1, 1 };
+    enc->encoderChangedFromEvent(rise1);
+    assertEquals(11, enc->getCurrentReading());
+    enc->encoderChangedFromEvent(fall);
+    enc->encoderChangedFromEvent(rise2);
+    assertEquals(12, enc->getCurrentReading());
+    assertEquals(mockIo.getErrorMode(), NO_ERROR);
+    delete enc;
+}
+
+test(testInputWakeScheduleAlignsAndReportsEarliest) {
+    // with no tick the delay is left alone.
+    inputWakeSchedule.setTickMicros(0);
+    assertEquals((uint32_t)3000, inputWakeSchedule.alignDelay(3000));
+
+    // with a tick, the delay ends on the next tick boundary, up to one tick later than asked for.
+    inputWakeSchedule.setTickMicros(10000);
+    uint32_t aligned = inputWakeSchedule.alignDelay(3000);
+    uint32_t phase = uint32_t(micros() + aligned) % 10000;
+    assertTrue(aligned >= 3000 && aligned < 13000);
+    assertTrue(phase < 200 || phase > 9800);
+
+    WakeDeadline slow;
+    WakeDeadline fast;
+    assertEquals((uint32_t)20000, fast.nextRunIn(20000, false));
+    assertTrue(slow.nextRunIn(50000) >= 50000);
+    assertTrue(fast.isPending());
+    assertTrue(inputWakeSchedule.microsToNextDeadline() <= 20000);
+
+    // once waiting for an interrupt it no longer counts, and an overdue deadline wants to run straight away.
+    fast.waitingForInterrupt();
+    assertFalse(fast.isPending());
+    slow.nextRunIn(0, false);
+    assertEquals((uint32_t)0, inputWakeSchedule.microsToNextDeadline());
+    slow.waitingForInterrupt();
+    inputWakeSchedule.setTickMicros(0);
+}
+
+test(testWakeDeadlineLeavesScheduleWhenDestroyed) {
+    WakeDeadline lasting;
+    lasting.nextRunIn(1000, false);
+    const WakeDeadline* gone;
+    {
+        WakeDeadline shortLived;
+        shortLived.nextRunIn(10, false);
+        gone = &shortLived;
+        assertTrue(inputWakeSchedule.contains(gone));
+
+        // a copy is not on the schedule until it is used itself.
+        WakeDeadline copied(shortLived);
+        assertFalse(inputWakeSchedule.contains(&copied));
+    }
+    assertFalse(inputWakeSchedule.contains(gone));
+    assertTrue(inputWakeSchedule.contains(&lasting));
+    assertTrue(inputWakeSchedule.microsToNextDeadline() <= 1000);
+}
+
+test(testInputTaskPollsStayAtIntervalWhenWoken) {
+    InputPollCadence cadence(10, 1000);
+    assertEquals((uint32_t)10, cadence.waitBeforePoll(1000));
+
+    // wakes part way through only shorten the wait that is left, the poll is still due at 1010.
+    assertEquals((uint32_t)7, cadence.waitBeforePoll(1003));
+    assertEquals((uint32_t)2, cadence.waitBeforePoll(1008));
+    assertEquals((uint32_t)0, cadence.waitBeforePoll(1010));
+
+    // a poll made a little late does not move the ones after it.
+    cadence.pollMade(1012);
+    assertEquals((uint32_t)8, cadence.waitBeforePoll(1012));
+    cadence.pollMade(1020);
+    assertEquals((uint32_t)10, cadence.waitBeforePoll(1020));
+
+    // once two intervals behind, the polls start again from now rather than running back to back.
+    assertEquals((uint32_t)0, cadence.waitBeforePoll(1055));
+    cadence.pollMade(1055);
+    assertEquals((uint32_t)10, cadence.waitBeforePoll(1055));
+
+    // the tick count wrapping around does not upset the interval.
+    InputPollCadence wrapping(10, 0xfffffffaUL);
+    assertEquals((uint32_t)2, wrapping.waitBeforePoll(2));
+    wrapping.pollMade(4);
+    assertEquals((uint32_t)10, wrapping.waitBeforePoll(4));
+}
@@ -77,4 +77,26 @@ test(hitsOnlyFirstAssertion) {
     assertEquals(10, 4);
     assertFloatNear(10.4, 4.2, 0.01);
     assertStringEquals("123", "432");
-}
\ No newline at end of file
+}
+test(testTimedLoopRunsWarmUpAndTimedPasses) {
+    int passes = 0;
+    TimedRun run(10, 2);
+    timedLoop(run) {
+        passes++;
+    }
+    assertEquals(12, passes);
+    assertEquals((uint16_t)10, run.getIterations());
+    assertTrue(run.getMinMicros() <= run.getMeanMicros());
+    assertTrue(run.getMeanMicros() <= run.getMaxMicros());
+    assertCompletesWithin(run, 10000UL);
+    run.record("emptyLoop");
+}
+
+test(testThatTimingAssertFails) {
+    TimedRun run(2, 0);
+    timedLoop(run) {
+        unsigned long start = micros();
+        while((micros() - start) < 200UL);
+    }
+    assertMeanWithin(run, 10UL);
+}